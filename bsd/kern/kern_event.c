@@ -236,7 +236,9 @@ static void kqworkloop_update_threads_qos(struct kqworkloop *kqwl, int op, kq_in
 static int kqworkloop_end_processing(struct kqworkloop *kqwl, int flags, int kevent_flags);
 
 static struct knote *knote_alloc(void);
+static struct knote *knote_alloc_batch(struct knote_batch *knb);
 static void knote_free(struct knote *kn);
+static void knote_free_bulk(struct knote **kns, uint32_t count);
 static int kq_add_knote(struct kqueue *kq, struct knote *kn,
     struct knote_lock_ctx *knlc, struct proc *p);
 static struct knote *kq_find_knote_and_kq_lock(struct kqueue *kq,
@@ -250,6 +252,7 @@ static void knote_apply_touch(kqueue_t kqu, struct knote *kn,
 static void knote_suppress(kqueue_t kqu, struct knote *kn);
 static void knote_unsuppress(kqueue_t kqu, struct knote *kn);
 static void knote_drop(kqueue_t kqu, struct knote *kn, struct knote_lock_ctx *knlc);
+static void knote_drop_nofree(kqueue_t kqu, struct knote *kn, struct knote_lock_ctx *knlc);
 
 // both these functions may dequeue the knote and it is up to the caller
 // to enqueue the knote back
@@ -3749,6 +3752,24 @@ filt_bad_process(struct knote *kn, struct kevent_qos_s *kev)
 	panic("%s[%d](%p, %p)", __func__, kn->kn_filter, kn, kev);
 }
 
+/*
+ * Processes with a lot of knotes drop them all in knotes_dealloc():
+ * return them to the zone in batches rather than one at a time.
+ */
+#define KNOTES_DEALLOC_BATCH 16
+
+static void
+knotes_dealloc_drop(struct kqueue *kq, struct knote *kn,
+    struct knote **batch, uint32_t *nbatch)
+{
+	knote_drop_nofree(kq, kn, NULL);
+	batch[(*nbatch)++] = kn;
+	if (*nbatch == KNOTES_DEALLOC_BATCH) {
+		knote_free_bulk(batch, *nbatch);
+		*nbatch = 0;
+	}
+}
+
 /*
  * knotes_dealloc - detach all knotes for the process and drop them
  *
@@ -3761,6 +3782,8 @@ knotes_dealloc(proc_t p)
 	struct filedesc *fdp = &p->p_fd;
 	struct kqueue *kq;
 	struct knote *kn;
+	struct knote *batch[KNOTES_DEALLOC_BATCH];
+	uint32_t nbatch = 0;
 	struct  klist *kn_hash = NULL;
 	u_long kn_hashmask;
 	int i;
@@ -3774,7 +3797,7 @@ knotes_dealloc(proc_t p)
 				kq = knote_get_kq(kn);
 				kqlock(kq);
 				proc_fdunlock(p);
-				knote_drop(kq, kn, NULL);
+				knotes_dealloc_drop(kq, kn, batch, &nbatch);
 				proc_fdlock(p);
 			}
 		}
@@ -3794,7 +3817,7 @@ knotes_dealloc(proc_t p)
 				kq = knote_get_kq(kn);
 				kqlock(kq);
 				knhash_unlock(fdp);
-				knote_drop(kq, kn, NULL);
+				knotes_dealloc_drop(kq, kn, batch, &nbatch);
 				knhash_lock(fdp);
 			}
 		}
@@ -3806,6 +3829,10 @@ knotes_dealloc(proc_t p)
 
 	knhash_unlock(fdp);
 
+	if (nbatch) {
+		knote_free_bulk(batch, nbatch);
+	}
+
 	if (kn_hash) {
 		hashdestroy(kn_hash, M_KQUEUE, kn_hashmask);
 	}
@@ -4004,6 +4031,18 @@ kevent_register_wait_return(struct _kevent_register *cont_args)
 int
 kevent_register(struct kqueue *kq, struct kevent_qos_s *kev,
     struct knote **kn_out)
+{
+	return kevent_register_batch(kq, kev, kn_out, NULL);
+}
+
+/*
+ * kevent_register_batch - kevent_register() taking new knotes from knb
+ *
+ *	knb may be NULL
+ */
+int
+kevent_register_batch(struct kqueue *kq, struct kevent_qos_s *kev,
+    struct knote **kn_out, struct knote_batch *knb)
 {
 	struct proc *p = kq->kq_p;
 	const struct filterops *fops;
@@ -4089,7 +4128,7 @@ restart:
 			}
 		}
 
-		kn = knote_alloc();
+		kn = knote_alloc_batch(knb);
 		kn->kn_fp = knote_fp;
 		kn->kn_is_fd = fops->f_isfd;
 		kn->kn_kq_packed = VM_PACK_POINTER((vm_offset_t)kq, KNOTE_KQ_PACKED);
@@ -7239,7 +7278,8 @@ knote_apply_touch(kqueue_t kqu, struct knote *kn, struct kevent_qos_s *kev,
 }
 
 /*
- * knote_drop - disconnect and drop the knote
+ * knote_drop_nofree - disconnect and drop the knote, leaving it to the
+ * caller to free it
  *
  * Called with the kqueue locked, returns with the kqueue unlocked.
  *
@@ -7249,7 +7289,7 @@ knote_apply_touch(kqueue_t kqu, struct knote *kn, struct kevent_qos_s *kev,
  * (or not yet attached to) its source object.
  */
 static void
-knote_drop(struct kqueue *kq, struct knote *kn, struct knote_lock_ctx *knlc)
+knote_drop_nofree(struct kqueue *kq, struct knote *kn, struct knote_lock_ctx *knlc)
 {
 	struct proc *p = kq->kq_p;
 
@@ -7278,7 +7318,17 @@ knote_drop(struct kqueue *kq, struct knote *kn, struct knote_lock_ctx *knlc)
 	if (kn->kn_is_fd && ((kn->kn_status & KN_VANISHED) == 0)) {
 		fp_drop(p, (int)kn->kn_id, kn->kn_fp, 0);
 	}
+}
 
+/*
+ * knote_drop - disconnect, drop and free the knote
+ *
+ * Called with the kqueue locked, returns with the kqueue unlocked.
+ */
+static void
+knote_drop(struct kqueue *kq, struct knote *kn, struct knote_lock_ctx *knlc)
+{
+	knote_drop_nofree(kq, kn, knlc);
 	knote_free(kn);
 }
 
@@ -7304,6 +7354,33 @@ knote_alloc(void)
 	return zalloc_flags(knote_zone, Z_WAITOK | Z_ZERO | Z_NOFAIL);
 }
 
+/*
+ * Batches of registrations (kevent changelists, poll) take their new
+ * knotes from a bulk allocation rather than one zalloc each.
+ */
+static struct knote *
+knote_alloc_batch(struct knote_batch *knb)
+{
+	if (knb == NULL || (knb->knb_count == 0 && knb->knb_left <= 1)) {
+		return knote_alloc();
+	}
+	if (knb->knb_count == 0) {
+		knb->knb_count = zalloc_bulk(knote_zone, (void **)knb->knb_knotes,
+		    MIN(knb->knb_left, KNOTE_ALLOC_BATCH),
+		    Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	}
+	return knb->knb_knotes[--knb->knb_count];
+}
+
+void
+knote_batch_drain(struct knote_batch *knb)
+{
+	if (knb->knb_count) {
+		zfree_bulk(knote_zone, (void **)knb->knb_knotes, knb->knb_count);
+		knb->knb_count = 0;
+	}
+}
+
 static void
 knote_free(struct knote *kn)
 {
@@ -7311,6 +7388,15 @@ knote_free(struct knote *kn)
 	zfree(knote_zone, kn);
 }
 
+static void
+knote_free_bulk(struct knote **kns, uint32_t count)
+{
+	for (uint32_t i = 0; i < count; i++) {
+		assert((kns[i]->kn_status & (KN_LOCKED | KN_POSTING)) == 0);
+	}
+	zfree_bulk(knote_zone, (void **)kns, count);
+}
+
 #pragma mark - syscalls: kevent, kevent64, kevent_qos, kevent_id
 
 kevent_ctx_t
@@ -8086,6 +8172,7 @@ kevent_internal(kqueue_t kqu,
     bool legacy)
 {
 	int error = 0, noutputs = 0, register_rc;
+	struct knote_batch knb = { };
 
 	/* only bound threads can receive events on workloops */
 	if (!legacy && (flags & KEVENT_FLAG_WORKLOOP)) {
@@ -8137,7 +8224,15 @@ kevent_internal(kqueue_t kqu,
 			break;
 		}
 
-		register_rc = kevent_register(kqu.kq, &kev, &kn);
+		/*
+		 * The last registration may not return (f_post_register_wait),
+		 * so it doesn't use the batch.
+		 */
+		knb.knb_left = (uint32_t)nchanges;
+		if (nchanges == 1) {
+			knote_batch_drain(&knb);
+		}
+		register_rc = kevent_register_batch(kqu.kq, &kev, &kn, &knb);
 		if (__improbable(!legacy && (register_rc & FILTER_REGISTER_WAIT))) {
 			thread_t thread = current_thread();
 
@@ -8204,6 +8299,7 @@ kevent_internal(kqueue_t kqu,
 		}
 		nchanges--;
 	}
+	knote_batch_drain(&knb);
 
 	if ((flags & KEVENT_FLAG_ERROR_EVENTS) == 0 &&
 	    nevents > 0 && noutputs == 0 && error == 0) {
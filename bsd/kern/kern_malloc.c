@@ -75,6 +75,8 @@
 #include <sys/sysctl.h>
 #include <sys/kauth.h>
 
+#include <mach_debug/zone_info.h>
+
 #include <vm/vm_kern_xnu.h>
 
 #include <libkern/libkern.h>
@@ -433,3 +435,50 @@ SYSCTL_PROC(_kern, OID_AUTO, zones_collectable_bytes,
     CTLTYPE_QUAD | CTLFLAG_RD | CTLFLAG_MASKED | CTLFLAG_LOCKED,
     0, 0, &sysctl_zones_collectable_bytes, "Q",
     "Collectable memory in zones");
+
+extern uint32_t zone_cache_tune_info_get(zone_cache_tune_info_t *info,
+    uint32_t count);
+
+/*
+ * kern.zone_cache_tuning
+ *
+ * Returns an array of zone_cache_tune_info_t, one per zone
+ * with per-cpu caching enabled.
+ */
+static int
+sysctl_zone_cache_tuning SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp, arg1, arg2)
+	zone_cache_tune_info_t *info;
+	uint32_t count, n;
+	int error;
+
+	if (!kauth_cred_issuser(kauth_cred_get())) {
+		return EPERM;
+	}
+
+	count = zone_cache_tune_info_get(NULL, 0);
+	if (req->oldptr == USER_ADDR_NULL) {
+		/* leave some room for zones that start caching meanwhile */
+		req->oldidx = (count + 8) * sizeof(*info);
+		return 0;
+	}
+	if (count == 0) {
+		return 0;
+	}
+
+	info = kalloc_data(count * sizeof(*info), Z_WAITOK | Z_ZERO);
+	if (info == NULL) {
+		return ENOMEM;
+	}
+	n = zone_cache_tune_info_get(info, count);
+	error = SYSCTL_OUT(req, info, MIN(n, count) * sizeof(*info));
+	kfree_data(info, count * sizeof(*info));
+
+	return error;
+}
+
+SYSCTL_PROC(_kern, OID_AUTO, zone_cache_tuning,
+    CTLTYPE_STRUCT | CTLFLAG_RD | CTLFLAG_MASKED | CTLFLAG_LOCKED,
+    0, 0, &sysctl_zone_cache_tuning, "S,zone_cache_tune_info",
+    "Per-zone cache auto-tuning state");
@@ -79,6 +79,7 @@
 #include <sys/sysproto.h>
 
 #include <vm/vm_pageout_xnu.h>
+#include <vm/vm_compressor_info.h>         /* for perf_compressor_data */
 
 #include <os/atomic_private.h>
 
@@ -2369,14 +2370,6 @@ SYSCTL_PROC(_kern, OID_AUTO, test_ca_event, CTLTYPE_INT | CTLFLAG_WR | CTLFLAG_L
 
 
 #if DEVELOPMENT || DEBUG
-struct perf_compressor_data {
-	user_addr_t buffer;
-	size_t buffer_size;
-	uint64_t benchmark_time;
-	uint64_t bytes_processed;
-	uint64_t compressor_growth;
-};
-
 static int
 sysctl_perf_compressor SYSCTL_HANDLER_ARGS
 {
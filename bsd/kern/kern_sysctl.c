@@ -636,6 +636,35 @@ sysctl_sched_stats_enable(__unused struct sysctl_oid *oidp, __unused void *arg1,
 
 SYSCTL_PROC(_kern, OID_AUTO, sched_stats_enable, CTLFLAG_LOCKED | CTLFLAG_WR, 0, 0, sysctl_sched_stats_enable, "-", "");
 
+/*
+ * Returns uint64_t[npsets][SCHED_LATENCY_HIST_BUCKETS][SCHED_LATENCY_HIST_BINS]
+ * runnable-to-dispatch latency counts, see sched_prim.h for the layout.
+ * Writing anything resets the counters.
+ */
+STATIC int
+sysctl_sched_latency_hist(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
+{
+	uint32_t npsets = sched_latency_hist_get(NULL, 0);
+	size_t size = (size_t)npsets * SCHED_LATENCY_HIST_BUCKETS * SCHED_LATENCY_HIST_BINS * sizeof(uint64_t);
+	uint64_t *hist = kalloc_data(size, Z_WAITOK | Z_ZERO);
+	if (hist == NULL) {
+		return ENOMEM;
+	}
+
+	sched_latency_hist_get(hist, npsets);
+	if (req->newlen > 0) {
+		sched_latency_hist_reset();
+	}
+
+	int error = sysctl_io_opaque(req, hist, size, NULL);
+	kfree_data(hist, size);
+	return error;
+}
+
+SYSCTL_PROC(_kern, OID_AUTO, sched_latency_hist,
+    CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_LOCKED,
+    0, 0, sysctl_sched_latency_hist, "Q", "Scheduler runnable-to-dispatch latency histograms per pset and sched bucket");
+
 extern uint32_t sched_debug_flags;
 SYSCTL_INT(_debug, OID_AUTO, sched, CTLFLAG_RW | CTLFLAG_LOCKED, &sched_debug_flags, 0, "scheduler debug");
 
@@ -4487,6 +4516,17 @@ extern uint32_t vm_compressor_time_thread;
 extern uint32_t c_segment_svp_in_hash;
 extern uint32_t c_segment_svp_hash_succeeded;
 extern uint32_t c_segment_svp_hash_failed;
+extern uint64_t c_batch_pages;
+extern uint64_t c_batch_runs;
+extern uint32_t c_dedup_entries;
+extern uint64_t c_dedup_hits;
+extern uint64_t c_dedup_bytes_saved;
+extern uint64_t c_dedup_verify_failed;
+extern uint32_t vm_swapin_prefetch_max;
+extern uint64_t vm_swapin_prefetch_issued;
+extern uint64_t vm_swapin_prefetch_hits;
+extern uint64_t vm_swapin_prefetch_misses;
+extern uint64_t vm_swapin_prefetch_wasted;
 
 #if DEVELOPMENT || DEBUG
 extern uint32_t vm_compressor_minorcompact_threshold_divisor;
@@ -4594,6 +4634,17 @@ SYSCTL_UINT(_vm, OID_AUTO, compressor_segment_pages_compressed, CTLFLAG_RD | CTL
 SYSCTL_UINT(_vm, OID_AUTO, compressor_segment_svp_in_hash, CTLFLAG_RD | CTLFLAG_LOCKED, &c_segment_svp_in_hash, 0, "");
 SYSCTL_UINT(_vm, OID_AUTO, compressor_segment_svp_hash_succeeded, CTLFLAG_RD | CTLFLAG_LOCKED, &c_segment_svp_hash_succeeded, 0, "");
 SYSCTL_UINT(_vm, OID_AUTO, compressor_segment_svp_hash_failed, CTLFLAG_RD | CTLFLAG_LOCKED, &c_segment_svp_hash_failed, 0, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_batch_pages, CTLFLAG_RD | CTLFLAG_LOCKED, &c_batch_pages, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_batch_runs, CTLFLAG_RD | CTLFLAG_LOCKED, &c_batch_runs, "");
+SYSCTL_UINT(_vm, OID_AUTO, compressor_dedup_entries, CTLFLAG_RD | CTLFLAG_LOCKED, &c_dedup_entries, 0, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_dedup_hits, CTLFLAG_RD | CTLFLAG_LOCKED, &c_dedup_hits, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_dedup_bytes_saved, CTLFLAG_RD | CTLFLAG_LOCKED, &c_dedup_bytes_saved, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_dedup_verify_failed, CTLFLAG_RD | CTLFLAG_LOCKED, &c_dedup_verify_failed, "");
+SYSCTL_UINT(_vm, OID_AUTO, swapin_prefetch_max, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_swapin_prefetch_max, 0, "");
+SYSCTL_QUAD(_vm, OID_AUTO, swapin_prefetch_issued, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_swapin_prefetch_issued, "");
+SYSCTL_QUAD(_vm, OID_AUTO, swapin_prefetch_hits, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_swapin_prefetch_hits, "");
+SYSCTL_QUAD(_vm, OID_AUTO, swapin_prefetch_misses, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_swapin_prefetch_misses, "");
+SYSCTL_QUAD(_vm, OID_AUTO, swapin_prefetch_wasted, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_swapin_prefetch_wasted, "");
 
 #if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
 extern uint64_t compressor_ro_uncompressed;
@@ -4773,6 +4824,16 @@ SYSCTL_INT(_vm, OID_AUTO, lz4_max_preselects, CTLFLAG_RW | CTLFLAG_LOCKED, &vmct
 SYSCTL_INT(_vm, OID_AUTO, lz4_run_preselection_threshold, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.lz4_run_preselection_threshold, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, lz4_run_continue_bytes, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.lz4_run_continue_bytes, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, lz4_profitable_bytes, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.lz4_profitable_bytes, 0, "");
+
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_sampled_pages, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.sampled_pages, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_sampled_wk, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.sampled_wk, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_sampled_lz4, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.sampled_lz4, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_sampled_raw, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.sampled_raw, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_sampled_hybrid, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.sampled_hybrid, "");
+SYSCTL_QUAD(_vm, OID_AUTO, compressor_sampled_atime, CTLFLAG_RD | CTLFLAG_LOCKED, &compressor_stats.sampled_abstime, "");
+SYSCTL_INT(_vm, OID_AUTO, compressor_sample_wk_hit_percent, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.sample_wk_hit_percent, 0, "");
+SYSCTL_INT(_vm, OID_AUTO, compressor_sample_lz4_entropy, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.sample_lz4_entropy_q8, 0, "");
+SYSCTL_INT(_vm, OID_AUTO, compressor_sample_raw_entropy, CTLFLAG_RW | CTLFLAG_LOCKED, &vmctune.sample_raw_entropy_q8, 0, "");
 #if DEVELOPMENT || DEBUG
 extern int vm_compressor_current_codec;
 extern int vm_compressor_test_seg_wp;
@@ -4793,11 +4854,13 @@ SYSCTL_INT(_vm, OID_AUTO, vm_ktrace, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_ktrace_ena
 extern uint32_t phantom_cache_thrashing_threshold;
 extern uint32_t phantom_cache_eval_period_in_msecs;
 extern uint32_t phantom_cache_thrashing_threshold_ssd;
+extern boolean_t phantom_cache_refault_activate;
 
 
 SYSCTL_INT(_vm, OID_AUTO, phantom_cache_eval_period_in_msecs, CTLFLAG_RW | CTLFLAG_LOCKED, &phantom_cache_eval_period_in_msecs, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, phantom_cache_thrashing_threshold, CTLFLAG_RW | CTLFLAG_LOCKED, &phantom_cache_thrashing_threshold, 0, "");
 SYSCTL_INT(_vm, OID_AUTO, phantom_cache_thrashing_threshold_ssd, CTLFLAG_RW | CTLFLAG_LOCKED, &phantom_cache_thrashing_threshold_ssd, 0, "");
+SYSCTL_INT(_vm, OID_AUTO, phantom_cache_refault_activate, CTLFLAG_RW | CTLFLAG_LOCKED, &phantom_cache_refault_activate, 0, "");
 #endif
 
 #if    defined(__LP64__)
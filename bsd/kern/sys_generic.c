@@ -1691,6 +1691,7 @@ poll_nocancel(struct proc *p, struct poll_nocancel_args *uap, int32_t *retval)
 {
 	struct pollfd *fds = NULL;
 	struct kqueue *kq = NULL;
+	struct knote_batch knb = { };
 	int error = 0;
 	u_int nfds = uap->nfds;
 	u_int rfds = 0;
@@ -1739,6 +1740,9 @@ poll_nocancel(struct proc *p, struct poll_nocancel_args *uap, int32_t *retval)
 			continue;
 		}
 
+		/* knotes for the remaining descriptors come in bulk */
+		knb.knb_left = nfds - i;
+
 		/* convert the poll event into a kqueue kevent */
 		struct kevent_qos_s kev = {
 			.ident = fds[i].fd,
@@ -1752,7 +1756,7 @@ poll_nocancel(struct proc *p, struct poll_nocancel_args *uap, int32_t *retval)
 			if (events & (POLLPRI | POLLRDBAND)) {
 				kev.flags |= EV_OOBAND;
 			}
-			rc = kevent_register(kq, &kev, NULL);
+			rc = kevent_register_batch(kq, &kev, NULL, &knb);
 			assert((rc & FILTER_REGISTER_WAIT) == 0);
 		}
 
@@ -1760,7 +1764,7 @@ poll_nocancel(struct proc *p, struct poll_nocancel_args *uap, int32_t *retval)
 		if ((kev.flags & EV_ERROR) == 0 &&
 		    (events & (POLLOUT | POLLWRNORM | POLLWRBAND))) {
 			kev.filter = EVFILT_WRITE;
-			rc = kevent_register(kq, &kev, NULL);
+			rc = kevent_register_batch(kq, &kev, NULL, &knb);
 			assert((rc & FILTER_REGISTER_WAIT) == 0);
 		}
 
@@ -1781,7 +1785,7 @@ poll_nocancel(struct proc *p, struct poll_nocancel_args *uap, int32_t *retval)
 			if (events & POLLWRITE) {
 				kev.fflags |= NOTE_WRITE;
 			}
-			rc = kevent_register(kq, &kev, NULL);
+			rc = kevent_register_batch(kq, &kev, NULL, &knb);
 			assert((rc & FILTER_REGISTER_WAIT) == 0);
 		}
 
@@ -1792,6 +1796,7 @@ poll_nocancel(struct proc *p, struct poll_nocancel_args *uap, int32_t *retval)
 			fds[i].revents = 0;
 		}
 	}
+	knote_batch_drain(&knb);
 
 	/*
 	 * Did we have any trouble registering?
@@ -2930,6 +2935,38 @@ SYSCTL_PROC(_kern, OID_AUTO, sched_thread_bind_cluster_id, CTLTYPE_INT | CTLFLAG
 extern int sched_edge_migrate_ipi_immediate;
 SYSCTL_INT(_kern, OID_AUTO, sched_edge_migrate_ipi_immediate, CTLFLAG_RW | CTLFLAG_LOCKED, &sched_edge_migrate_ipi_immediate, 0, "Edge Scheduler uses immediate IPIs for migration event based on execution latency");
 
+extern uint32_t sched_edge_steal_stats_get(uint64_t *stats, uint32_t count);
+extern void sched_edge_steal_stats_reset(void);
+
+/*
+ * Returns an { attempts, successes } pair of uint64_t for each
+ * (source cluster, destination cluster) pair, source major.
+ * Writing anything resets the counters.
+ */
+static int
+sysctl_sched_edge_steal_stats(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
+{
+	uint32_t nclusters = sched_edge_steal_stats_get(NULL, 0);
+	size_t size = nclusters * nclusters * 2 * sizeof(uint64_t);
+	uint64_t *stats = kalloc_data(size, Z_WAITOK | Z_ZERO);
+	if (stats == NULL) {
+		return ENOMEM;
+	}
+
+	sched_edge_steal_stats_get(stats, nclusters * nclusters);
+	if (req->newlen > 0) {
+		sched_edge_steal_stats_reset();
+	}
+
+	int error = sysctl_io_opaque(req, stats, size, NULL);
+	kfree_data(stats, size);
+	return error;
+}
+
+SYSCTL_PROC(_kern, OID_AUTO, sched_edge_steal_stats,
+    CTLTYPE_OPAQUE | CTLFLAG_RW | CTLFLAG_LOCKED,
+    0, 0, sysctl_sched_edge_steal_stats, "Q", "Edge Scheduler steal attempts and successes per cluster pair");
+
 #endif /* CONFIG_SCHED_EDGE */
 
 #endif /* __AMP__ */
@@ -5018,6 +5018,19 @@ m_copy_pkthdr(struct mbuf *to, struct mbuf *from)
 	}
 }
 
+/*
+ * Turn the leading mbuf of a packet into a plain one, so that it can be
+ * chained behind another packet.  Its tags are released with the header.
+ */
+void
+m_demote_pkthdr(struct mbuf *m)
+{
+	VERIFY(m->m_flags & M_PKTHDR);
+
+	m_tag_delete_chain(m);
+	m->m_flags &= ~M_PKTHDR;
+}
+
 /*
  * Duplicate "from"'s mbuf pkthdr in "to".
  * "from" must have M_PKTHDR set, and "to" must be empty.
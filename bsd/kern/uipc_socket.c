@@ -951,6 +951,18 @@ out:
 
 void
 sodealloc(struct socket *so)
+{
+	sodealloc_teardown(so);
+	sodealloc_free(so);
+}
+
+/*
+ * First half of sodealloc(): releases everything the socket refers to,
+ * leaving only its memory for sodealloc_free().  Used by protocols
+ * that must keep the memory around for lockless readers.
+ */
+void
+sodealloc_teardown(struct socket *so)
 {
 	kauth_cred_unref(&so->so_cred);
 
@@ -958,7 +970,11 @@ sodealloc(struct socket *so)
 	sflt_termsock(so);
 
 	so->so_gencnt = OSIncrementAtomic64((SInt64 *)&so_gencnt);
+}
 
+void
+sodealloc_free(struct socket *so)
+{
 	if (so->so_flags1 & SOF1_CACHED_IN_SOCK_LAYER) {
 		cached_sock_free(so);
 	} else {
@@ -102,6 +102,7 @@
 #include <sys/socket.h>
 #include <sys/socketvar.h>
 #include <sys/vnode.h>
+#include <sys/ubc.h>
 
 #include <net/if.h>
 #include <net/bpf.h>
@@ -133,6 +134,12 @@
 #include <kern/thread_call.h>
 #include <libkern/section_keywords.h>
 
+#include <mach/mach_vm.h>
+#include <mach/vm_map.h>
+#include <vm/vm_kern_xnu.h>
+#include <vm/vm_memory_entry_xnu.h>
+
+#include <os/atomic_private.h>
 #include <os/log.h>
 
 #include <IOKit/IOBSD.h>
@@ -205,6 +212,11 @@ static int bpf_hdr_comp_enable = 1;
 SYSCTL_INT(_debug, OID_AUTO, bpf_hdr_comp_enable, CTLFLAG_RW | CTLFLAG_LOCKED,
     &bpf_hdr_comp_enable, 1, "");
 
+#define BPF_RING_MAXSIZE        (64 * 1024 * 1024)
+static unsigned int bpf_ring_maxsize = BPF_RING_MAXSIZE;
+SYSCTL_UINT(_debug, OID_AUTO, bpf_ring_maxsize, CTLFLAG_RW | CTLFLAG_LOCKED,
+    &bpf_ring_maxsize, 0, "Upper limit on the size of a BPF shared capture ring");
+
 static int sysctl_bpf_stats SYSCTL_HANDLER_ARGS;
 SYSCTL_PROC(_debug, OID_AUTO, bpf_stats, CTLTYPE_STRUCT | CTLFLAG_RD | CTLFLAG_LOCKED,
     0, 0,
@@ -254,6 +266,12 @@ static void     bpf_set_packet_service_class(struct mbuf *, int);
 static void     bpf_acquire_d(struct bpf_d *);
 static void     bpf_release_d(struct bpf_d *);
 
+static int      bpf_ring_setup(struct bpf_d *, struct bpf_ring_req *);
+static void     bpf_ring_free(struct bpf_d *);
+static bool     bpf_ring_acquire(struct bpf_d *);
+static void     bpf_ring_publish(struct bpf_d *);
+static uint32_t bpf_ring_ready(struct bpf_d *);
+
 static  int bpf_devsw_installed;
 
 void bpf_init(void *unused);
@@ -1282,6 +1300,15 @@ bpfread(dev_t dev, struct uio *uio, int ioflag)
 
 	bpf_acquire_d(d);
 
+	/*
+	 * Packets go to the shared ring instead
+	 */
+	if (d->bd_ring != NULL) {
+		bpf_release_d(d);
+		lck_mtx_unlock(bpf_mlock);
+		return EOPNOTSUPP;
+	}
+
 	/*
 	 * Restrict application to use a buffer the same size as
 	 * as kernel buffers.
@@ -1814,6 +1841,13 @@ bpf_setup(struct bpf_d *d_to, uuid_t uuid_from, ifnet_t ifp)
 		    __func__, error);
 		return error;
 	}
+	if (d_from->bd_ring != NULL || d_to->bd_ring != NULL) {
+		error = EINVAL;
+		os_log_error(OS_LOG_DEFAULT,
+		    "%s: shared ring capture error %d",
+		    __func__, error);
+		return error;
+	}
 
 	/*
 	 * Prevent any read or write while copying
@@ -2114,9 +2148,11 @@ bpfioctl(dev_t dev, u_long cmd, caddr_t __sized_by(IOCPARM_LEN(cmd)) addr,
 	case BIOCSBLEN: {               /* u_int */
 		u_int size;
 
-		if (d->bd_bif != 0 || (d->bd_flags & BPF_DETACHING)) {
+		if (d->bd_bif != 0 || (d->bd_flags & BPF_DETACHING) ||
+		    d->bd_ring != NULL) {
 			/*
-			 * Interface already attached, unable to change buffers
+			 * Interface already attached, or the buffer is
+			 * the shared ring, unable to change buffers
 			 */
 			error = EINVAL;
 			break;
@@ -2742,6 +2778,16 @@ bpfioctl(dev_t dev, u_long cmd, caddr_t __sized_by(IOCPARM_LEN(cmd)) addr,
 			if_set_xflags(d->bd_bif->bif_ifp, IFXF_DISABLE_INPUT);
 		}
 		break;
+	case BIOCSETRING: {             /* struct bpf_ring_req */
+		struct bpf_ring_req req;
+
+		bcopy(addr, &req, sizeof(req));
+		error = bpf_ring_setup(d, &req);
+		if (error == 0) {
+			bcopy(&req, addr, sizeof(req));
+		}
+		break;
+	}
 	}
 
 	bpf_release_d(d);
@@ -2759,6 +2805,7 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
     u_long cmd)
 {
 	struct bpf_insn *fcode, *old;
+	struct bpf_dprog *dfcode, *dold;
 	u_int flen, size;
 
 	while (d->bd_hbuf_read) {
@@ -2770,16 +2817,21 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
 	}
 
 	old = d->bd_filter;
+	dold = d->bd_dfilter;
 	if (bf_insns == USER_ADDR_NULL) {
 		if (bf_len != 0) {
 			return EINVAL;
 		}
 		d->bd_filter = NULL;
 		d->bd_filter_len = 0;
+		d->bd_dfilter = NULL;
 		reset_d(d);
 		if (old != 0) {
 			kfree_data_addr(old);
 		}
+		if (dold != NULL) {
+			bpf_decode_free(dold);
+		}
 		return 0;
 	}
 	flen = bf_len;
@@ -2794,8 +2846,18 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
 	}
 	if (copyin(bf_insns, (caddr_t)fcode, size) == 0 &&
 	    bpf_validate(fcode, (int)flen)) {
+		/*
+		 * Translate the program once here rather than decoding
+		 * every instruction for every packet in bpf_filter().
+		 */
+		dfcode = bpf_decode(fcode, flen);
+		if (dfcode == NULL) {
+			kfree_data(fcode, size);
+			return ENOMEM;
+		}
 		d->bd_filter = fcode;
 		d->bd_filter_len = flen;
+		d->bd_dfilter = dfcode;
 
 		if (cmd == BIOCSETF32 || cmd == BIOCSETF64) {
 			reset_d(d);
@@ -2804,6 +2866,9 @@ bpf_setf(struct bpf_d *d, u_int bf_len, user_addr_t bf_insns,
 		if (old != 0) {
 			kfree_data_addr(old);
 		}
+		if (dold != NULL) {
+			bpf_decode_free(dold);
+		}
 
 		return 0;
 	}
@@ -3070,11 +3135,14 @@ bpfselect(dev_t dev, int which, void * wql, struct proc *p)
 
 	switch (which) {
 	case FREAD:
-		if (d->bd_hlen != 0 ||
+		if (d->bd_ring != NULL) {
+			ret = (bpf_ring_ready(d) != 0);
+		} else if (d->bd_hlen != 0 ||
 		    ((d->bd_immediate ||
 		    d->bd_state == BPF_TIMED_OUT) && d->bd_slen != 0)) {
 			ret = 1;         /* read has data to return */
-		} else {
+		}
+		if (ret == 0) {
 			/*
 			 * Read has no data to return.
 			 * Make the select wait, and start a timer if
@@ -3121,7 +3189,14 @@ filt_bpfread_common(struct knote *kn, struct kevent_qos_s *kev, struct bpf_d *d)
 	int ready = 0;
 	int64_t data = 0;
 
-	if (d->bd_immediate) {
+	if (d->bd_ring != NULL) {
+		/*
+		 * The amount of data is the number of ring blocks
+		 * owned by the process.
+		 */
+		data = bpf_ring_ready(d);
+		ready = (data > 0);
+	} else if (d->bd_immediate) {
 		/*
 		 * If there's data in the hold buffer, it's the
 		 * amount of data a read will return.
@@ -3353,8 +3428,7 @@ bpf_tap_imp(
 		}
 
 		++d->bd_rcount;
-		slen = bpf_filter(d->bd_filter, d->bd_filter_len,
-		    bpf_pkt_ptr,
+		slen = bpf_filter_decoded(d->bd_dfilter, bpf_pkt_ptr,
 		    (u_int)bpf_pkt->bpfp_total_length, 0);
 
 		if (slen != 0) {
@@ -4050,6 +4124,15 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 		return;
 	}
 
+	/*
+	 * In ring mode the store buffer is a block owned by the kernel,
+	 * drop the packet when the process still holds all of them.
+	 */
+	if (d->bd_ring != NULL && !bpf_ring_acquire(d)) {
+		++d->bd_dcount;
+		return;
+	}
+
 	/*
 	 * Round up the end of the previous packet to the next longword.
 	 */
@@ -4063,12 +4146,21 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 		 * We cannot rotate buffers if a read is in progress
 		 * so drop the packet
 		 */
-		if (d->bd_hbuf_read) {
+		if (d->bd_ring != NULL) {
+			/*
+			 * Hand the full block to the process and move
+			 * on to the next one
+			 */
+			bpf_ring_publish(d);
+			if (!bpf_ring_acquire(d)) {
+				++d->bd_dcount;
+				bpf_wakeup(d);
+				return;
+			}
+		} else if (d->bd_hbuf_read) {
 			++d->bd_dcount;
 			return;
-		}
-
-		if (d->bd_fbuf == NULL) {
+		} else if (d->bd_fbuf == NULL) {
 			if (d->bd_headdrop == 0) {
 				/*
 				 * We haven't completed the previous read yet,
@@ -4187,6 +4279,16 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 			}
 #endif /* SKYWALK */
 		}
+		if (d->bd_ring != NULL) {
+			/*
+			 * The process sees ring records as they are written,
+			 * there is no read() to resolve the flow id into a
+			 * pid, so don't expose it
+			 */
+			ehp->bh_flowid = 0;
+			ehp->bh_flags &= ~(BPF_HDR_EXT_FLAGS_TCP |
+			    BPF_HDR_EXT_FLAGS_UDP);
+		}
 	} else {
 		hp = (struct bpf_hdr *)(void *)(d->bd_sbuf + curlen);
 		memset(hp, 0, BPF_WORDALIGN(sizeof(*hp)));
@@ -4268,12 +4370,209 @@ catchpacket(struct bpf_d *d, struct bpf_packet * pkt,
 	}
 }
 
+/*
+ * Shared ring capture.
+ *
+ * The ring is a kernel allocation shared with the process that set it up.
+ * Each block starts with a struct bpf_ring_block and the store buffer of
+ * catchpacket() is the area after the header of the current block, so
+ * packets are copied once, straight into memory the process can read.
+ * The status word of a block says who owns it: the kernel fills blocks in
+ * order and flips them to BPF_RING_USER, the process flips them back once
+ * it has consumed the records.
+ */
+static int
+bpf_ring_setup(struct bpf_d *d, struct bpf_ring_req *req)
+{
+	vm_offset_t kaddr = 0;
+	mach_vm_offset_t uaddr = 0;
+	memory_object_size_t entry_size;
+	ipc_port_t entry = IPC_PORT_NULL;
+	kern_return_t kr;
+	size_t size;
+	int error = 0;
+
+	if (d->bd_bif != NULL || (d->bd_flags & BPF_DETACHING) ||
+	    d->bd_ring != NULL) {
+		return EINVAL;
+	}
+	if (req->br_blocksize < PAGE_SIZE ||
+	    req->br_blocksize > BPF_BUFSIZE_CAP ||
+	    (req->br_blocksize & PAGE_MASK) != 0 ||
+	    req->br_nblocks < 2 || req->br_nblocks > BPF_RING_MAXBLOCKS) {
+		return EINVAL;
+	}
+	size = (size_t)req->br_blocksize * req->br_nblocks;
+	if (size > bpf_ring_maxsize) {
+		return EINVAL;
+	}
+
+	/*
+	 * The ring can be tens of megabytes: allocate and map it without
+	 * holding up every other BPF device, and only install it once the
+	 * descriptor has been checked again
+	 */
+	lck_mtx_unlock(bpf_mlock);
+
+	kr = kmem_alloc(kernel_map, &kaddr, size, KMA_DATA_SHARED | KMA_ZERO,
+	    VM_KERN_MEMORY_MBUF);
+	if (kr != KERN_SUCCESS) {
+		lck_mtx_lock(bpf_mlock);
+		return ENOMEM;
+	}
+
+	entry_size = size;
+	kr = mach_make_memory_entry_64(kernel_map, &entry_size, kaddr,
+	    MAP_MEM_VM_SHARE | VM_PROT_READ | VM_PROT_WRITE, &entry,
+	    IPC_PORT_NULL);
+	if (kr == KERN_SUCCESS) {
+		kr = mach_vm_map_kernel(current_map(), &uaddr, size, 0,
+		    VM_MAP_KERNEL_FLAGS_ANYWHERE(), entry, 0, FALSE,
+		    VM_PROT_READ | VM_PROT_WRITE, VM_PROT_READ | VM_PROT_WRITE,
+		    VM_INHERIT_NONE);
+		mach_memory_entry_port_release(entry);
+	}
+	if (kr != KERN_SUCCESS) {
+		kmem_free(kernel_map, kaddr, size);
+		lck_mtx_lock(bpf_mlock);
+		return mach_to_bsd_errno(kr);
+	}
+
+	lck_mtx_lock(bpf_mlock);
+
+	if ((d->bd_flags & BPF_CLOSING) != 0) {
+		error = ENXIO;
+	} else if (d->bd_bif != NULL || (d->bd_flags & BPF_DETACHING) ||
+	    d->bd_ring != NULL) {
+		/* attached or given a ring while the lock was dropped */
+		error = EINVAL;
+	}
+	if (error != 0) {
+		lck_mtx_unlock(bpf_mlock);
+		(void)mach_vm_deallocate(current_map(), uaddr, size);
+		kmem_free(kernel_map, kaddr, size);
+		lck_mtx_lock(bpf_mlock);
+		return error;
+	}
+
+	d->bd_ring = __unsafe_forge_bidi_indexable(caddr_t, kaddr, size);
+	d->bd_ring_size = size;
+	d->bd_ring_bsize = req->br_blocksize;
+	d->bd_ring_nblocks = req->br_nblocks;
+	d->bd_ring_cur = 0;
+	d->bd_ring_seq = 0;
+	d->bd_bufsize = req->br_blocksize - sizeof(struct bpf_ring_block);
+
+	req->br_addr = uaddr;
+	req->br_size = size;
+
+	os_log(OS_LOG_DEFAULT, "bpf%d ring %u blocks of %u bytes",
+	    d->bd_dev_minor, d->bd_ring_nblocks, d->bd_ring_bsize);
+
+	return 0;
+}
+
+static struct bpf_ring_block *
+bpf_ring_block(struct bpf_d *d, uint32_t idx)
+{
+	return (struct bpf_ring_block *)(void *)
+	       (d->bd_ring + (size_t)idx * d->bd_ring_bsize);
+}
+
+/*
+ * Make the current block the store buffer if the kernel owns it
+ */
+static bool
+bpf_ring_acquire(struct bpf_d *d)
+{
+	struct bpf_ring_block *brb;
+
+	if (d->bd_sbuf != NULL) {
+		return true;
+	}
+	brb = bpf_ring_block(d, d->bd_ring_cur);
+	if (os_atomic_load(&brb->brb_status, acquire) != BPF_RING_KERNEL) {
+		return false;
+	}
+	d->bd_sbuf = d->bd_ring + (size_t)d->bd_ring_cur * d->bd_ring_bsize +
+	    sizeof(struct bpf_ring_block);
+	d->bd_slen = 0;
+	d->bd_scnt = 0;
+	d->bd_prev_slen = 0;
+	return true;
+}
+
+/*
+ * Hand the current block over to the process
+ */
+static void
+bpf_ring_publish(struct bpf_d *d)
+{
+	struct bpf_ring_block *brb;
+
+	brb = bpf_ring_block(d, d->bd_ring_cur);
+	brb->brb_len = d->bd_slen;
+	brb->brb_count = d->bd_scnt;
+	brb->brb_seq = d->bd_ring_seq++;
+	brb->brb_drops = d->bd_dcount;
+	os_atomic_store(&brb->brb_status, BPF_RING_USER, release);
+
+	d->bd_bcs.bcs_total_read += d->bd_scnt;
+	d->bd_sbuf = NULL;
+	d->bd_slen = 0;
+	d->bd_scnt = 0;
+	d->bd_ring_cur = (d->bd_ring_cur + 1) % d->bd_ring_nblocks;
+}
+
+/*
+ * Return the number of blocks owned by the process, publishing the
+ * partially filled block if the process is caught up and waiting for it
+ */
+static uint32_t
+bpf_ring_ready(struct bpf_d *d)
+{
+	uint32_t pending = 0;
+
+	for (uint32_t i = 0; i < d->bd_ring_nblocks; i++) {
+		if (os_atomic_load(&bpf_ring_block(d, i)->brb_status, relaxed) ==
+		    BPF_RING_USER) {
+			pending++;
+		}
+	}
+	if (pending == 0 && d->bd_sbuf != NULL && d->bd_slen != 0 &&
+	    (d->bd_immediate || d->bd_state == BPF_TIMED_OUT)) {
+		bpf_ring_publish(d);
+		pending = 1;
+	}
+	if (pending != 0 && d->bd_state == BPF_TIMED_OUT) {
+		d->bd_state = BPF_IDLE;
+	}
+	return pending;
+}
+
+static void
+bpf_ring_free(struct bpf_d *d)
+{
+	if (d->bd_ring == NULL) {
+		return;
+	}
+	/* The mapping in the process holds its own reference on the pages */
+	kmem_free(kernel_map, (vm_offset_t)d->bd_ring, d->bd_ring_size);
+	d->bd_ring = NULL;
+	d->bd_ring_size = 0;
+	d->bd_sbuf = NULL;
+}
+
 static void
 bpf_freebufs(struct bpf_d *d)
 {
-	if (d->bd_sbuf != NULL) {
+	/* buffers allocated before a ring was set up are still ours to free */
+	if (d->bd_sbuf != NULL &&
+	    (d->bd_ring == NULL || d->bd_sbuf < d->bd_ring ||
+	    d->bd_sbuf >= d->bd_ring + d->bd_ring_size)) {
 		kfree_data_addr(d->bd_sbuf);
 	}
+	d->bd_sbuf = NULL;
 	if (d->bd_hbuf != NULL) {
 		kfree_data_addr(d->bd_hbuf);
 	}
@@ -4296,14 +4595,19 @@ bpf_allocbufs(struct bpf_d *d)
 {
 	bpf_freebufs(d);
 
-	d->bd_fbuf = kalloc_data(d->bd_bufsize, Z_WAITOK | Z_ZERO);
-	if (d->bd_fbuf == NULL) {
-		goto nobufs;
-	}
+	if (d->bd_ring != NULL) {
+		/* The store buffer is the current block of the ring */
+		d->bd_sbuf = NULL;
+	} else {
+		d->bd_fbuf = kalloc_data(d->bd_bufsize, Z_WAITOK | Z_ZERO);
+		if (d->bd_fbuf == NULL) {
+			goto nobufs;
+		}
 
-	d->bd_sbuf = kalloc_data(d->bd_bufsize, Z_WAITOK | Z_ZERO);
-	if (d->bd_sbuf == NULL) {
-		goto nobufs;
+		d->bd_sbuf = kalloc_data(d->bd_bufsize, Z_WAITOK | Z_ZERO);
+		if (d->bd_sbuf == NULL) {
+			goto nobufs;
+		}
 	}
 	d->bd_slen = 0;
 	d->bd_hlen = 0;
@@ -4344,10 +4648,15 @@ bpf_freed(struct bpf_d *d)
 	}
 
 	bpf_freebufs(d);
+	bpf_ring_free(d);
 
 	if (d->bd_filter) {
 		kfree_data_addr_sized_by(d->bd_filter, d->bd_filter_len);
 	}
+	if (d->bd_dfilter != NULL) {
+		bpf_decode_free(d->bd_dfilter);
+		d->bd_dfilter = NULL;
+	}
 }
 
 /*
@@ -279,6 +279,7 @@ struct bpf_comp_stats {
 #define BIOCSNOTSTAMP   _IOW('B', 145, int)
 #define BIOCGDVRTIN     _IOR('B', 146, int)
 #define BIOCSDVRTIN     _IOW('B', 146, int)
+#define BIOCSETRING     _IOWR('B', 147, struct bpf_ring_req)
 #endif /* PRIVATE */
 
 /*
@@ -414,6 +415,41 @@ struct bpf_comp_hdr {
 #define BPF_D_OUT       0x2     /* See outgoing packets */
 #define BPF_D_INOUT     0x3     /* See incoming and outgoing packets */
 
+/*
+ * Shared capture ring, set up with BIOCSETRING before BIOCSETIF.
+ *
+ * The kernel maps br_nblocks blocks of br_blocksize bytes into the calling
+ * process and returns their address in br_addr.  Each block starts with a
+ * struct bpf_ring_block followed by brb_len bytes of packet records, laid
+ * out as read() would return them.  The kernel fills blocks in order and
+ * hands each one over by setting brb_status to BPF_RING_USER; the process
+ * gives it back by setting brb_status to BPF_RING_KERNEL.  Packets that
+ * arrive while the next block is still owned by the process are dropped.
+ *
+ * EVFILT_READ and select() report the descriptor readable while a block
+ * is owned by the process; read() is not supported.  The process must not
+ * rely on bh_pid and bh_comm, nor on pktap headers being finalized.
+ */
+struct bpf_ring_req {
+	uint32_t        br_blocksize;   /* in: bytes per block, page multiple */
+	uint32_t        br_nblocks;     /* in: number of blocks */
+	uint64_t        br_addr;        /* out: address of the ring */
+	uint64_t        br_size;        /* out: size of the ring */
+};
+
+struct bpf_ring_block {
+	uint32_t        brb_status;     /* BPF_RING_KERNEL or BPF_RING_USER */
+	uint32_t        brb_len;        /* bytes of packet records */
+	uint32_t        brb_count;      /* number of packet records */
+	uint32_t        brb_seq;        /* block sequence number */
+	uint64_t        brb_drops;      /* packets dropped so far */
+	uint64_t        brb_reserved;
+};
+
+#define BPF_RING_KERNEL         0
+#define BPF_RING_USER           1
+#define BPF_RING_MAXBLOCKS      1024
+
 #endif /* PRIVATE */
 #endif /* !defined(DRIVERKIT) */
 
@@ -1494,6 +1530,12 @@ extern void     bpfdetach(struct ifnet *);
 extern void     bpfilterattach(int);
 extern u_int    bpf_filter(const struct bpf_insn *__counted_by(pc_len), u_int pc_len,
     u_char *__sized_by(sizeof(struct bpf_packet)), u_int wirelen, u_int);
+
+struct bpf_dprog;
+extern struct bpf_dprog *bpf_decode(const struct bpf_insn *__counted_by(len), u_int len);
+extern void     bpf_decode_free(struct bpf_dprog *);
+extern u_int    bpf_filter_decoded(const struct bpf_dprog *,
+    u_char *__sized_by(sizeof(struct bpf_packet)), u_int wirelen, u_int);
 #endif /* KERNEL_PRIVATE */
 
 #endif /* !defined(DRIVERKIT) */
@@ -68,6 +68,7 @@
  */
 
 #include <sys/param.h>
+#include <stdbool.h>
 #include <string.h>
 
 #ifdef sun
@@ -76,6 +77,7 @@
 
 #ifdef KERNEL
 #include <sys/mbuf.h>
+#include <kern/kalloc.h>
 #include <net/sockaddr_utils.h>
 #endif
 #include <net/bpf.h>
@@ -416,6 +418,53 @@ bp_xbyte(struct bpf_packet *bp, bpf_u_int32 k, int *err)
 	return 0;
 }
 
+/*
+ * Return the leading bytes of the packet that can be read in place: the
+ * header when there is one, otherwise the first mbuf or buflet.  A load
+ * that falls entirely inside these bytes reads the same data bp_x*()
+ * would, without walking the chain.
+ */
+static u_char *__indexable
+bp_contig(struct bpf_packet *bp, u_int *len_p)
+{
+	*len_p = 0;
+	if (bp->bpfp_header_length != 0) {
+		*len_p = (u_int)bp->bpfp_header_length;
+		return (u_char *)bp->bpfp_header;
+	}
+	switch (bp->bpfp_type) {
+	case BPF_PACKET_TYPE_MBUF: {
+		struct mbuf *m = bp->bpfp_mbuf;
+
+		if (m == NULL || m->m_len <= 0) {
+			break;
+		}
+		*len_p = (u_int)m->m_len;
+		return mtod(m, u_char *);
+	}
+#if SKYWALK
+	case BPF_PACKET_TYPE_PKT: {
+		kern_buflet_t __single buflet;
+		u_char *cp;
+
+		buflet = kern_packet_get_next_buflet(bp->bpfp_pkt, NULL);
+		if (buflet == NULL) {
+			break;
+		}
+		cp = (u_char *)buflet_get_address(buflet);
+		if (cp == NULL) {
+			break;
+		}
+		*len_p = kern_buflet_get_data_length(buflet);
+		return cp;
+	}
+#endif /* SKYWALK */
+	default:
+		break;
+	}
+	return NULL;
+}
+
 #endif
 
 /*
@@ -771,6 +820,696 @@ bpf_filter(const struct bpf_insn *__counted_by(pc_len) pc_orig, u_int pc_len,
 	}
 }
 
+/*
+ * Pre-decoded filter programs.
+ *
+ * bpf_setf() translates a validated program once into an array of
+ * struct bpf_dinsn, which bpf_filter_decoded() runs with threaded
+ * dispatch instead of decoding every opcode again for every packet:
+ *
+ *  - each instruction carries the index of its handler,
+ *  - jump targets are absolute instruction indices,
+ *  - an absolute load immediately followed by a jeq/jset against a
+ *    constant is fused into one instruction.  The compare keeps its
+ *    own slot so that jumps landing on it still work.
+ *
+ * Packet loads first look at the contiguous leading bytes of the packet
+ * and only walk the mbuf chain when they fall outside of them.
+ */
+enum {
+	BPF_DOP_INVALID = 0,
+	BPF_DOP_RET_K,
+	BPF_DOP_RET_A,
+	BPF_DOP_LD_W_ABS,
+	BPF_DOP_LD_H_ABS,
+	BPF_DOP_LD_B_ABS,
+	BPF_DOP_LD_W_LEN,
+	BPF_DOP_LDX_W_LEN,
+	BPF_DOP_LD_W_IND,
+	BPF_DOP_LD_H_IND,
+	BPF_DOP_LD_B_IND,
+	BPF_DOP_LDX_MSH_B,
+	BPF_DOP_LD_IMM,
+	BPF_DOP_LDX_IMM,
+	BPF_DOP_LD_MEM,
+	BPF_DOP_LDX_MEM,
+	BPF_DOP_ST,
+	BPF_DOP_STX,
+	BPF_DOP_JA,
+	BPF_DOP_JGT_K,
+	BPF_DOP_JGE_K,
+	BPF_DOP_JEQ_K,
+	BPF_DOP_JSET_K,
+	BPF_DOP_JGT_X,
+	BPF_DOP_JGE_X,
+	BPF_DOP_JEQ_X,
+	BPF_DOP_JSET_X,
+	BPF_DOP_ADD_X,
+	BPF_DOP_SUB_X,
+	BPF_DOP_MUL_X,
+	BPF_DOP_DIV_X,
+	BPF_DOP_AND_X,
+	BPF_DOP_OR_X,
+	BPF_DOP_LSH_X,
+	BPF_DOP_RSH_X,
+	BPF_DOP_ADD_K,
+	BPF_DOP_SUB_K,
+	BPF_DOP_MUL_K,
+	BPF_DOP_DIV_K,
+	BPF_DOP_AND_K,
+	BPF_DOP_OR_K,
+	BPF_DOP_LSH_K,
+	BPF_DOP_RSH_K,
+	BPF_DOP_NEG,
+	BPF_DOP_TAX,
+	BPF_DOP_TXA,
+	/* superinstructions: load A, then compare it against di_cmp */
+	BPF_DOP_LD_W_ABS_JEQ,
+	BPF_DOP_LD_H_ABS_JEQ,
+	BPF_DOP_LD_B_ABS_JEQ,
+	BPF_DOP_LD_W_ABS_JSET,
+	BPF_DOP_LD_H_ABS_JSET,
+	BPF_DOP_LD_B_ABS_JSET,
+	BPF_DOP_MAX
+};
+
+struct bpf_dinsn {
+	uint16_t        di_op;          /* BPF_DOP_* handler */
+	uint16_t        di_jt;          /* target index when true */
+	uint16_t        di_jf;          /* target index when false */
+	uint16_t        di_pad;
+	bpf_u_int32     di_k;           /* operand, load offset when fused */
+	bpf_u_int32     di_cmp;         /* compare operand when fused */
+};
+
+struct bpf_dprog {
+	u_int                   dp_len;
+	struct bpf_dinsn        __counted_by(dp_len) dp_insns[];
+};
+
+static uint16_t
+bpf_decode_op(const struct bpf_insn *p, bool *jump)
+{
+	*jump = false;
+
+	switch (p->code) {
+	case BPF_RET | BPF_K:
+		return BPF_DOP_RET_K;
+	case BPF_RET | BPF_A:
+		return BPF_DOP_RET_A;
+	case BPF_LD | BPF_W | BPF_ABS:
+		return BPF_DOP_LD_W_ABS;
+	case BPF_LD | BPF_H | BPF_ABS:
+		return BPF_DOP_LD_H_ABS;
+	case BPF_LD | BPF_B | BPF_ABS:
+		return BPF_DOP_LD_B_ABS;
+	case BPF_LD | BPF_W | BPF_LEN:
+		return BPF_DOP_LD_W_LEN;
+	case BPF_LDX | BPF_W | BPF_LEN:
+		return BPF_DOP_LDX_W_LEN;
+	case BPF_LD | BPF_W | BPF_IND:
+		return BPF_DOP_LD_W_IND;
+	case BPF_LD | BPF_H | BPF_IND:
+		return BPF_DOP_LD_H_IND;
+	case BPF_LD | BPF_B | BPF_IND:
+		return BPF_DOP_LD_B_IND;
+	case BPF_LDX | BPF_MSH | BPF_B:
+		return BPF_DOP_LDX_MSH_B;
+	case BPF_LD | BPF_IMM:
+		return BPF_DOP_LD_IMM;
+	case BPF_LDX | BPF_IMM:
+		return BPF_DOP_LDX_IMM;
+	case BPF_LD | BPF_MEM:
+		return p->k < BPF_MEMWORDS ? BPF_DOP_LD_MEM : BPF_DOP_INVALID;
+	case BPF_LDX | BPF_MEM:
+		return p->k < BPF_MEMWORDS ? BPF_DOP_LDX_MEM : BPF_DOP_INVALID;
+	case BPF_ST:
+		return p->k < BPF_MEMWORDS ? BPF_DOP_ST : BPF_DOP_INVALID;
+	case BPF_STX:
+		return p->k < BPF_MEMWORDS ? BPF_DOP_STX : BPF_DOP_INVALID;
+	case BPF_ALU | BPF_ADD | BPF_X:
+		return BPF_DOP_ADD_X;
+	case BPF_ALU | BPF_SUB | BPF_X:
+		return BPF_DOP_SUB_X;
+	case BPF_ALU | BPF_MUL | BPF_X:
+		return BPF_DOP_MUL_X;
+	case BPF_ALU | BPF_DIV | BPF_X:
+		return BPF_DOP_DIV_X;
+	case BPF_ALU | BPF_AND | BPF_X:
+		return BPF_DOP_AND_X;
+	case BPF_ALU | BPF_OR | BPF_X:
+		return BPF_DOP_OR_X;
+	case BPF_ALU | BPF_LSH | BPF_X:
+		return BPF_DOP_LSH_X;
+	case BPF_ALU | BPF_RSH | BPF_X:
+		return BPF_DOP_RSH_X;
+	case BPF_ALU | BPF_ADD | BPF_K:
+		return BPF_DOP_ADD_K;
+	case BPF_ALU | BPF_SUB | BPF_K:
+		return BPF_DOP_SUB_K;
+	case BPF_ALU | BPF_MUL | BPF_K:
+		return BPF_DOP_MUL_K;
+	case BPF_ALU | BPF_DIV | BPF_K:
+		return p->k != 0 ? BPF_DOP_DIV_K : BPF_DOP_INVALID;
+	case BPF_ALU | BPF_AND | BPF_K:
+		return BPF_DOP_AND_K;
+	case BPF_ALU | BPF_OR | BPF_K:
+		return BPF_DOP_OR_K;
+	case BPF_ALU | BPF_LSH | BPF_K:
+		return BPF_DOP_LSH_K;
+	case BPF_ALU | BPF_RSH | BPF_K:
+		return BPF_DOP_RSH_K;
+	case BPF_ALU | BPF_NEG:
+		return BPF_DOP_NEG;
+	case BPF_MISC | BPF_TAX:
+		return BPF_DOP_TAX;
+	case BPF_MISC | BPF_TXA:
+		return BPF_DOP_TXA;
+	}
+
+	*jump = true;
+	switch (p->code) {
+	case BPF_JMP | BPF_JA:
+		return BPF_DOP_JA;
+	case BPF_JMP | BPF_JGT | BPF_K:
+		return BPF_DOP_JGT_K;
+	case BPF_JMP | BPF_JGE | BPF_K:
+		return BPF_DOP_JGE_K;
+	case BPF_JMP | BPF_JEQ | BPF_K:
+		return BPF_DOP_JEQ_K;
+	case BPF_JMP | BPF_JSET | BPF_K:
+		return BPF_DOP_JSET_K;
+	case BPF_JMP | BPF_JGT | BPF_X:
+		return BPF_DOP_JGT_X;
+	case BPF_JMP | BPF_JGE | BPF_X:
+		return BPF_DOP_JGE_X;
+	case BPF_JMP | BPF_JEQ | BPF_X:
+		return BPF_DOP_JEQ_X;
+	case BPF_JMP | BPF_JSET | BPF_X:
+		return BPF_DOP_JSET_X;
+	}
+
+	*jump = false;
+	return BPF_DOP_INVALID;
+}
+
+/*
+ * Translate the program f into d.  Anything that would let the decoded
+ * program misbehave (out of range jumps or scratch memory, falling off
+ * the end) decodes to an instruction that rejects the packet, so this
+ * doesn't depend on bpf_validate() for safety.
+ */
+static void
+bpf_decode_insns(const struct bpf_insn *__counted_by(len) f, u_int len,
+    struct bpf_dinsn *__counted_by(len) d)
+{
+	u_int i;
+
+	for (i = 0; i < len; i++) {
+		const struct bpf_insn *p = &f[i];
+		struct bpf_dinsn *di = &d[i];
+		u_int jt = 0, jf = 0;
+		bool jump;
+		uint16_t op;
+
+		op = bpf_decode_op(p, &jump);
+		if (jump) {
+			if (op == BPF_DOP_JA) {
+				jt = jf = (p->k < len - i - 1) ? i + 1 + p->k : len;
+			} else {
+				jt = i + 1 + p->jt;
+				jf = i + 1 + p->jf;
+			}
+			if (jt >= len || jf >= len) {
+				op = BPF_DOP_INVALID;
+				jt = jf = 0;
+			}
+		} else if (op != BPF_DOP_RET_K && op != BPF_DOP_RET_A &&
+		    i + 1 >= len) {
+			op = BPF_DOP_INVALID;
+		}
+
+		di->di_op = op;
+		di->di_jt = (uint16_t)jt;
+		di->di_jf = (uint16_t)jf;
+		di->di_pad = 0;
+		di->di_k = p->k;
+		di->di_cmp = 0;
+	}
+
+	for (i = 0; i + 1 < len; i++) {
+		struct bpf_dinsn *di = &d[i];
+		const struct bpf_dinsn *next = &d[i + 1];
+		uint16_t op;
+
+		if (next->di_op == BPF_DOP_JEQ_K) {
+			switch (di->di_op) {
+			case BPF_DOP_LD_W_ABS:
+				op = BPF_DOP_LD_W_ABS_JEQ;
+				break;
+			case BPF_DOP_LD_H_ABS:
+				op = BPF_DOP_LD_H_ABS_JEQ;
+				break;
+			case BPF_DOP_LD_B_ABS:
+				op = BPF_DOP_LD_B_ABS_JEQ;
+				break;
+			default:
+				continue;
+			}
+		} else if (next->di_op == BPF_DOP_JSET_K) {
+			switch (di->di_op) {
+			case BPF_DOP_LD_W_ABS:
+				op = BPF_DOP_LD_W_ABS_JSET;
+				break;
+			case BPF_DOP_LD_H_ABS:
+				op = BPF_DOP_LD_H_ABS_JSET;
+				break;
+			case BPF_DOP_LD_B_ABS:
+				op = BPF_DOP_LD_B_ABS_JSET;
+				break;
+			default:
+				continue;
+			}
+		} else {
+			continue;
+		}
+		di->di_op = op;
+		di->di_jt = next->di_jt;
+		di->di_jf = next->di_jf;
+		di->di_cmp = next->di_k;
+	}
+}
+
+#ifdef KERNEL
+#define BPF_DLOAD_SLOW(dst, xfn, k) do {                        \
+	if (bp == NULL) {                                       \
+	        return 0;                                       \
+	}                                                       \
+	(dst) = xfn(bp, (k), &merr);                            \
+	if (merr != 0) {                                        \
+	        return 0;                                       \
+	}                                                       \
+} while (0)
+#else /* KERNEL */
+#define BPF_DLOAD_SLOW(dst, xfn, k) return 0
+#endif /* KERNEL */
+
+#define BPF_DLOAD_W(dst, k) do {                                \
+	if ((k) < clen && clen - (k) >= sizeof(int32_t)) {      \
+	        (dst) = EXTRACT_LONG(&cp[(k)]);                 \
+	} else {                                                \
+	        BPF_DLOAD_SLOW(dst, bp_xword, k);               \
+	}                                                       \
+} while (0)
+
+#define BPF_DLOAD_H(dst, k) do {                                \
+	if ((k) < clen && clen - (k) >= sizeof(int16_t)) {      \
+	        (dst) = EXTRACT_SHORT(&cp[(k)]);                \
+	} else {                                                \
+	        BPF_DLOAD_SLOW(dst, bp_xhalf, k);               \
+	}                                                       \
+} while (0)
+
+#define BPF_DLOAD_B(dst, k) do {                                \
+	if ((k) < clen) {                                       \
+	        (dst) = cp[(k)];                                \
+	} else {                                                \
+	        BPF_DLOAD_SLOW(dst, bp_xbyte, k);               \
+	}                                                       \
+} while (0)
+
+#define BPF_DDISPATCH()         goto *bpf_dop_labels[pc->di_op]
+#define BPF_DNEXT() do {                                        \
+	pc++;                                                   \
+	BPF_DDISPATCH();                                        \
+} while (0)
+#define BPF_DJUMP(cond) do {                                    \
+	pc = &dp->dp_insns[(cond) ? pc->di_jt : pc->di_jf];     \
+	BPF_DDISPATCH();                                        \
+} while (0)
+
+/*
+ * Execute the decoded program dp on the packet p.  The arguments and
+ * the result are the same as for bpf_filter() on the original program.
+ */
+u_int
+bpf_filter_decoded(const struct bpf_dprog *dp,
+    u_char *__sized_by(sizeof(struct bpf_packet)) p, u_int wirelen, u_int buflen)
+{
+	static const void *const bpf_dop_labels[BPF_DOP_MAX] = {
+		[BPF_DOP_INVALID]       = &&op_invalid,
+		[BPF_DOP_RET_K]         = &&op_ret_k,
+		[BPF_DOP_RET_A]         = &&op_ret_a,
+		[BPF_DOP_LD_W_ABS]      = &&op_ld_w_abs,
+		[BPF_DOP_LD_H_ABS]      = &&op_ld_h_abs,
+		[BPF_DOP_LD_B_ABS]      = &&op_ld_b_abs,
+		[BPF_DOP_LD_W_LEN]      = &&op_ld_w_len,
+		[BPF_DOP_LDX_W_LEN]     = &&op_ldx_w_len,
+		[BPF_DOP_LD_W_IND]      = &&op_ld_w_ind,
+		[BPF_DOP_LD_H_IND]      = &&op_ld_h_ind,
+		[BPF_DOP_LD_B_IND]      = &&op_ld_b_ind,
+		[BPF_DOP_LDX_MSH_B]     = &&op_ldx_msh_b,
+		[BPF_DOP_LD_IMM]        = &&op_ld_imm,
+		[BPF_DOP_LDX_IMM]       = &&op_ldx_imm,
+		[BPF_DOP_LD_MEM]        = &&op_ld_mem,
+		[BPF_DOP_LDX_MEM]       = &&op_ldx_mem,
+		[BPF_DOP_ST]            = &&op_st,
+		[BPF_DOP_STX]           = &&op_stx,
+		[BPF_DOP_JA]            = &&op_ja,
+		[BPF_DOP_JGT_K]         = &&op_jgt_k,
+		[BPF_DOP_JGE_K]         = &&op_jge_k,
+		[BPF_DOP_JEQ_K]         = &&op_jeq_k,
+		[BPF_DOP_JSET_K]        = &&op_jset_k,
+		[BPF_DOP_JGT_X]         = &&op_jgt_x,
+		[BPF_DOP_JGE_X]         = &&op_jge_x,
+		[BPF_DOP_JEQ_X]         = &&op_jeq_x,
+		[BPF_DOP_JSET_X]        = &&op_jset_x,
+		[BPF_DOP_ADD_X]         = &&op_add_x,
+		[BPF_DOP_SUB_X]         = &&op_sub_x,
+		[BPF_DOP_MUL_X]         = &&op_mul_x,
+		[BPF_DOP_DIV_X]         = &&op_div_x,
+		[BPF_DOP_AND_X]         = &&op_and_x,
+		[BPF_DOP_OR_X]          = &&op_or_x,
+		[BPF_DOP_LSH_X]         = &&op_lsh_x,
+		[BPF_DOP_RSH_X]         = &&op_rsh_x,
+		[BPF_DOP_ADD_K]         = &&op_add_k,
+		[BPF_DOP_SUB_K]         = &&op_sub_k,
+		[BPF_DOP_MUL_K]         = &&op_mul_k,
+		[BPF_DOP_DIV_K]         = &&op_div_k,
+		[BPF_DOP_AND_K]         = &&op_and_k,
+		[BPF_DOP_OR_K]          = &&op_or_k,
+		[BPF_DOP_LSH_K]         = &&op_lsh_k,
+		[BPF_DOP_RSH_K]         = &&op_rsh_k,
+		[BPF_DOP_NEG]           = &&op_neg,
+		[BPF_DOP_TAX]           = &&op_tax,
+		[BPF_DOP_TXA]           = &&op_txa,
+		[BPF_DOP_LD_W_ABS_JEQ]  = &&op_ld_w_abs_jeq,
+		[BPF_DOP_LD_H_ABS_JEQ]  = &&op_ld_h_abs_jeq,
+		[BPF_DOP_LD_B_ABS_JEQ]  = &&op_ld_b_abs_jeq,
+		[BPF_DOP_LD_W_ABS_JSET] = &&op_ld_w_abs_jset,
+		[BPF_DOP_LD_H_ABS_JSET] = &&op_ld_h_abs_jset,
+		[BPF_DOP_LD_B_ABS_JSET] = &&op_ld_b_abs_jset,
+	};
+	u_int32_t A = 0, X = 0;
+	bpf_u_int32 k;
+	int32_t mem[BPF_MEMWORDS];
+	const struct bpf_dinsn *pc;
+	u_char *cp;
+	u_int clen;
+#ifdef KERNEL
+	int merr;
+	struct bpf_packet *bp = NULL;
+#endif /* KERNEL */
+
+	if (dp == NULL || dp->dp_len == 0) {
+		/*
+		 * No filter means accept all.
+		 */
+		return (u_int) - 1;
+	}
+
+	bzero(mem, sizeof(mem));
+
+#ifdef KERNEL
+	if (buflen == 0) {
+		bp = (struct bpf_packet *)(void *)p;
+		cp = bp_contig(bp, &clen);
+	} else
+#endif /* KERNEL */
+	{
+		cp = p;
+		clen = buflen;
+	}
+
+	pc = &dp->dp_insns[0];
+	BPF_DDISPATCH();
+
+op_invalid:
+	return 0;
+
+op_ret_k:
+	return (u_int)pc->di_k;
+
+op_ret_a:
+	return (u_int)A;
+
+op_ld_w_abs:
+	k = pc->di_k;
+	BPF_DLOAD_W(A, k);
+	BPF_DNEXT();
+
+op_ld_h_abs:
+	k = pc->di_k;
+	BPF_DLOAD_H(A, k);
+	BPF_DNEXT();
+
+op_ld_b_abs:
+	k = pc->di_k;
+	BPF_DLOAD_B(A, k);
+	BPF_DNEXT();
+
+op_ld_w_len:
+	A = wirelen;
+	BPF_DNEXT();
+
+op_ldx_w_len:
+	X = wirelen;
+	BPF_DNEXT();
+
+	/*
+	 * An offset that wraps around is never inside the contiguous bytes,
+	 * but the chain walk still gets the wrapped offset as before.
+	 */
+op_ld_w_ind:
+	k = X + pc->di_k;
+	if (k < X) {
+		BPF_DLOAD_SLOW(A, bp_xword, k);
+	} else {
+		BPF_DLOAD_W(A, k);
+	}
+	BPF_DNEXT();
+
+op_ld_h_ind:
+	k = X + pc->di_k;
+	if (k < X) {
+		BPF_DLOAD_SLOW(A, bp_xhalf, k);
+	} else {
+		BPF_DLOAD_H(A, k);
+	}
+	BPF_DNEXT();
+
+op_ld_b_ind:
+	k = X + pc->di_k;
+	if (k < X) {
+		BPF_DLOAD_SLOW(A, bp_xbyte, k);
+	} else {
+		BPF_DLOAD_B(A, k);
+	}
+	BPF_DNEXT();
+
+op_ldx_msh_b:
+	k = pc->di_k;
+	BPF_DLOAD_B(X, k);
+	X = (X & 0xf) << 2;
+	BPF_DNEXT();
+
+op_ld_imm:
+	A = pc->di_k;
+	BPF_DNEXT();
+
+op_ldx_imm:
+	X = pc->di_k;
+	BPF_DNEXT();
+
+op_ld_mem:
+	A = mem[pc->di_k];
+	BPF_DNEXT();
+
+op_ldx_mem:
+	X = mem[pc->di_k];
+	BPF_DNEXT();
+
+op_st:
+	mem[pc->di_k] = A;
+	BPF_DNEXT();
+
+op_stx:
+	mem[pc->di_k] = X;
+	BPF_DNEXT();
+
+op_ja:
+	BPF_DJUMP(true);
+
+op_jgt_k:
+	BPF_DJUMP(A > pc->di_k);
+
+op_jge_k:
+	BPF_DJUMP(A >= pc->di_k);
+
+op_jeq_k:
+	BPF_DJUMP(A == pc->di_k);
+
+op_jset_k:
+	BPF_DJUMP(A & pc->di_k);
+
+op_jgt_x:
+	BPF_DJUMP(A > X);
+
+op_jge_x:
+	BPF_DJUMP(A >= X);
+
+op_jeq_x:
+	BPF_DJUMP(A == X);
+
+op_jset_x:
+	BPF_DJUMP(A & X);
+
+op_add_x:
+	A += X;
+	BPF_DNEXT();
+
+op_sub_x:
+	A -= X;
+	BPF_DNEXT();
+
+op_mul_x:
+	A *= X;
+	BPF_DNEXT();
+
+op_div_x:
+	if (X == 0) {
+		return 0;
+	}
+	A /= X;
+	BPF_DNEXT();
+
+op_and_x:
+	A &= X;
+	BPF_DNEXT();
+
+op_or_x:
+	A |= X;
+	BPF_DNEXT();
+
+op_lsh_x:
+	A <<= X;
+	BPF_DNEXT();
+
+op_rsh_x:
+	A >>= X;
+	BPF_DNEXT();
+
+op_add_k:
+	A += pc->di_k;
+	BPF_DNEXT();
+
+op_sub_k:
+	A -= pc->di_k;
+	BPF_DNEXT();
+
+op_mul_k:
+	A *= pc->di_k;
+	BPF_DNEXT();
+
+op_div_k:
+	A /= pc->di_k;
+	BPF_DNEXT();
+
+op_and_k:
+	A &= pc->di_k;
+	BPF_DNEXT();
+
+op_or_k:
+	A |= pc->di_k;
+	BPF_DNEXT();
+
+op_lsh_k:
+	A <<= pc->di_k;
+	BPF_DNEXT();
+
+op_rsh_k:
+	A >>= pc->di_k;
+	BPF_DNEXT();
+
+op_neg:
+	A = -A;
+	BPF_DNEXT();
+
+op_tax:
+	X = A;
+	BPF_DNEXT();
+
+op_txa:
+	A = X;
+	BPF_DNEXT();
+
+op_ld_w_abs_jeq:
+	k = pc->di_k;
+	BPF_DLOAD_W(A, k);
+	BPF_DJUMP(A == pc->di_cmp);
+
+op_ld_h_abs_jeq:
+	k = pc->di_k;
+	BPF_DLOAD_H(A, k);
+	BPF_DJUMP(A == pc->di_cmp);
+
+op_ld_b_abs_jeq:
+	k = pc->di_k;
+	BPF_DLOAD_B(A, k);
+	BPF_DJUMP(A == pc->di_cmp);
+
+op_ld_w_abs_jset:
+	k = pc->di_k;
+	BPF_DLOAD_W(A, k);
+	BPF_DJUMP(A & pc->di_cmp);
+
+op_ld_h_abs_jset:
+	k = pc->di_k;
+	BPF_DLOAD_H(A, k);
+	BPF_DJUMP(A & pc->di_cmp);
+
+op_ld_b_abs_jset:
+	k = pc->di_k;
+	BPF_DLOAD_B(A, k);
+	BPF_DJUMP(A & pc->di_cmp);
+}
+
+#undef BPF_DJUMP
+#undef BPF_DNEXT
+#undef BPF_DDISPATCH
+#undef BPF_DLOAD_B
+#undef BPF_DLOAD_H
+#undef BPF_DLOAD_W
+#undef BPF_DLOAD_SLOW
+
+#ifdef KERNEL
+/*
+ * Translate a program that passed bpf_validate() for bpf_filter_decoded().
+ */
+struct bpf_dprog *
+bpf_decode(const struct bpf_insn *__counted_by(len) f, u_int len)
+{
+	struct bpf_dprog *dp;
+
+	if (len > BPF_MAXINSNS) {
+		return NULL;
+	}
+	dp = kalloc_type(struct bpf_dprog, struct bpf_dinsn, len, Z_WAITOK | Z_ZERO);
+	if (dp == NULL) {
+		return NULL;
+	}
+	dp->dp_len = len;
+	bpf_decode_insns(f, len, dp->dp_insns);
+	return dp;
+}
+
+void
+bpf_decode_free(struct bpf_dprog *dp)
+{
+	kfree_type(struct bpf_dprog, struct bpf_dinsn, dp->dp_len, dp);
+}
+#endif /* KERNEL */
+
 #ifdef KERNEL
 /*
  * Return true if the 'fcode' is a valid filter program.
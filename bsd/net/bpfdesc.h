@@ -108,6 +108,17 @@ struct bpf_d {
 	caddr_t BPF_BIDI_INDEXABLE bd_sbuf; /* store slot */
 	caddr_t BPF_BIDI_INDEXABLE bd_hbuf; /* hold slot */
 	caddr_t BPF_BIDI_INDEXABLE bd_fbuf; /* free slot */
+	/*
+	 * With a shared ring (BIOCSETRING), sbuf is the ring block at
+	 * bd_ring_cur, or NULL while that block is owned by the process,
+	 * and there are no hold and free buffers.
+	 */
+	caddr_t BPF_BIDI_INDEXABLE bd_ring; /* shared capture ring */
+	size_t          bd_ring_size;   /* ring size in bytes */
+	uint32_t        bd_ring_bsize;  /* bytes per ring block */
+	uint32_t        bd_ring_nblocks; /* number of ring blocks */
+	uint32_t        bd_ring_cur;    /* ring block being filled */
+	uint32_t        bd_ring_seq;    /* next ring block sequence number */
 	uint32_t        bd_slen;        /* current length of store buffer */
 	uint32_t        bd_hlen;        /* current length of hold buffer */
 	uint32_t        bd_scnt;        /* number of packets in store buffer */
@@ -124,6 +135,7 @@ struct bpf_d {
 	struct bpf_if   *bd_bif;        /* interface descriptor */
 	struct bpf_insn *__counted_by(bd_filter_len) bd_filter; /* filter code */
 	uint32_t        bd_filter_len;  /* filter code length  */
+	struct bpf_dprog *bd_dfilter;   /* pre-decoded filter code */
 	uint64_t        bd_rcount;      /* number of packets received */
 	uint64_t        bd_dcount;      /* number of received packets dropped */
 	uint64_t        bd_fcount;      /* number of received packets which matched filter */
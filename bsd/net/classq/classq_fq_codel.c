@@ -89,6 +89,7 @@ static uint32_t l4s_local_ce_report = 0;
 static uint64_t pkt_pacing_leeway = 0; /* in usec */
 static uint64_t max_pkt_pacing_interval = 3 * NSEC_PER_SEC;
 static uint64_t l4s_min_delay_threshold = 20 * NSEC_PER_MSEC; /* 20 ms */
+uint32_t fq_codel_bulk_dequeue = 1;
 #if (DEBUG || DEVELOPMENT)
 SYSCTL_NODE(_net_classq, OID_AUTO, flow_q, CTLFLAG_RW | CTLFLAG_LOCKED,
     0, "FQ-CODEL parameters");
@@ -112,6 +113,10 @@ SYSCTL_QUAD(_net_classq_flow_q, OID_AUTO, max_pkt_pacing_interval,
 
 SYSCTL_QUAD(_net_classq_flow_q, OID_AUTO, l4s_min_delay_threshold,
     CTLFLAG_RW | CTLFLAG_LOCKED, &l4s_min_delay_threshold, "l4s min delay threshold");
+
+SYSCTL_UINT(_net_classq_flow_q, OID_AUTO, bulk_dequeue,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &fq_codel_bulk_dequeue, 0,
+    "dequeue classic flows in bursts");
 #endif /* (DEBUG || DEVELOPMENT) */
 
 void
@@ -892,3 +897,195 @@ fq_getq_flow(fq_if_t *fqs, fq_t *fq, pktsched_pkt_t *pkt, uint64_t now)
 		__builtin_unreachable();
 	}
 }
+
+/*
+ * Dequeue a burst of packets from a classic (non-L4S) flow and append them
+ * to the caller's chain.  This does what repeated calls to fq_getq_flow()
+ * would, but the flow, class and group accounting, the CoDel state update
+ * and the flow control checks are done once for the whole burst rather than
+ * once per packet.  Since `now' doesn't change within a dequeue, the delay
+ * interval can only expire on the first packet of the burst.
+ */
+boolean_t
+fq_getq_flow_bulk(fq_if_t *fqs, fq_if_classq_t *fq_cl, fq_t *fq,
+    int64_t byte_limit, uint32_t pkt_limit, classq_pkt_t *head,
+    classq_pkt_t *tail, uint32_t *byte_cnt, uint32_t *pkt_cnt, uint64_t now)
+{
+	struct ifclassq *ifq = fqs->fqs_ifq;
+	struct ifnet *ifp = ifq->ifcq_ifp;
+	classq_pkt_type_t ptype = fqs->fqs_ptype;
+	boolean_t pacing = (ifclassq_enable_pacing && ifclassq_enable_l4s);
+	boolean_t limit_reached = FALSE;
+	uint32_t cnt = 0, bytes = 0;
+	uint64_t qdelay_sum = 0, num_dequeues, res, product;
+
+	ASSERT(!ifclassq_enable_l4s || fq->fq_tfc_type != FQ_TFC_L4S);
+
+	while (fq->fq_deficit > 0 && limit_reached == FALSE &&
+	    !fq_empty(fq, ptype)) {
+		classq_pkt_t p = CLASSQ_PKT_INITIALIZER(p);
+		volatile uint32_t *__single pkt_flags;
+		uint64_t *__single pkt_timestamp;
+		uint64_t pkt_tx_time = 0, pacing_delay = 0;
+		int64_t qdelay = 0;
+		pktsched_pkt_t pkt;
+		uint32_t plen;
+
+		fq_dequeue(fq, &p, ptype);
+		if (__improbable(p.cp_ptype == QP_INVALID)) {
+			VERIFY(p.cp_mbuf == NULL);
+			break;
+		}
+		_PKTSCHED_PKT_INIT(&pkt);
+		pktsched_pkt_encap(&pkt, &p);
+		plen = pktsched_get_pkt_len(&pkt);
+
+		IFCQ_DEC_LEN(ifq);
+		IFCQ_DEC_BYTES(ifq, plen);
+
+		pktsched_get_pkt_vars(&pkt, &pkt_flags, &pkt_timestamp, NULL,
+		    NULL, NULL, NULL, pacing ? &pkt_tx_time : NULL);
+		if (pacing && pkt_tx_time > *pkt_timestamp) {
+			pacing_delay = pkt_tx_time - *pkt_timestamp;
+			fq_cl->fcl_stat.fcl_paced_pkts++;
+		}
+
+		/* this will compute qdelay in nanoseconds */
+		if (now > *pkt_timestamp) {
+			qdelay = now - *pkt_timestamp;
+		}
+		if (fq_cl->fcl_stat.fcl_min_qdelay == 0 ||
+		    (qdelay > 0 && (u_int64_t)qdelay < fq_cl->fcl_stat.fcl_min_qdelay)) {
+			fq_cl->fcl_stat.fcl_min_qdelay = qdelay;
+		}
+		if (fq_cl->fcl_stat.fcl_max_qdelay == 0 ||
+		    (qdelay > 0 && (u_int64_t)qdelay > fq_cl->fcl_stat.fcl_max_qdelay)) {
+			fq_cl->fcl_stat.fcl_max_qdelay = qdelay;
+		}
+		qdelay_sum += (uint64_t)qdelay;
+
+		ASSERT(pacing_delay <= INT64_MAX);
+		qdelay = MAX(0, qdelay - (int64_t)pacing_delay);
+		if (fq->fq_min_qdelay == 0 ||
+		    (u_int64_t)qdelay < fq->fq_min_qdelay) {
+			fq->fq_min_qdelay = qdelay;
+		}
+		if (cnt == 0 && now >= fq->fq_updatetime) {
+			if (fq->fq_min_qdelay > FQ_TARGET_DELAY(fq)) {
+				FQ_SET_DELAY_HIGH(fq);
+			} else {
+				FQ_CLEAR_DELAY_HIGH(fq);
+			}
+			/* Reset measured queue delay and update time */
+			fq->fq_updatetime = now + FQ_UPDATE_INTERVAL(fq);
+			fq->fq_min_qdelay = 0;
+		}
+
+		*pkt_timestamp = 0;
+		fq->fq_deficit -= plen;
+
+		switch (ptype) {
+		case QP_MBUF:
+			*pkt_flags &= ~PKTF_PRIV_GUARDED;
+			if (__improbable((fq->fq_flags & FQF_FRESH_FLOW) != 0)) {
+				*pkt_flags |= PKTF_NEW_FLOW;
+				fq->fq_flags &= ~FQF_FRESH_FLOW;
+			}
+			if (head->cp_mbuf == NULL) {
+				*head = p;
+			} else {
+				ASSERT(tail->cp_mbuf->m_nextpkt == NULL);
+				tail->cp_mbuf->m_nextpkt = p.cp_mbuf;
+			}
+			*tail = p;
+			tail->cp_mbuf->m_nextpkt = NULL;
+			break;
+#if SKYWALK
+		case QP_PACKET:
+			/* sanity check */
+			ASSERT((*pkt_flags & ~PKT_F_COMMON_MASK) == 0);
+			if (__improbable((fq->fq_flags & FQF_FRESH_FLOW) != 0)) {
+				p.cp_kpkt->pkt_pflags |= PKT_F_NEW_FLOW;
+				fq->fq_flags &= ~FQF_FRESH_FLOW;
+			}
+			if (head->cp_kpkt == NULL) {
+				*head = p;
+			} else {
+				ASSERT(tail->cp_kpkt->pkt_nextpkt == NULL);
+				tail->cp_kpkt->pkt_nextpkt = p.cp_kpkt;
+			}
+			*tail = p;
+			tail->cp_kpkt->pkt_nextpkt = NULL;
+			break;
+#endif /* SKYWALK */
+		default:
+			VERIFY(0);
+			/* NOTREACHED */
+			__builtin_unreachable();
+		}
+
+		ifclassq_set_packet_metadata(ifq, ifp, &p);
+
+		cnt++;
+		bytes += plen;
+		*pkt_cnt += 1;
+		*byte_cnt += plen;
+
+		/* Check if the limit is reached */
+		if (*pkt_cnt >= pkt_limit || *byte_cnt >= byte_limit) {
+			limit_reached = TRUE;
+		}
+	}
+
+	if (cnt == 0) {
+		return limit_reached;
+	}
+
+	fq->fq_next_tx_time = FQ_INVALID_TX_TS;
+	VERIFY(fq->fq_bytes >= bytes);
+	fq->fq_bytes -= bytes;
+	fq->fq_pkts_since_last_report += cnt;
+
+	fq_cl->fcl_stat.fcl_byte_cnt -= bytes;
+	fq_cl->fcl_stat.fcl_pkt_cnt -= cnt;
+	fq_cl->fcl_flags &= ~FCL_PACED;
+	FQ_GRP_SUB_LEN(fq, cnt);
+	FQ_GRP_DEC_BYTES(fq, bytes);
+
+	/* Fold the burst into the class average with a single division */
+	num_dequeues = fq_cl->fcl_stat.fcl_dequeue;
+	if (os_add_overflow(num_dequeues, cnt, &res) ||
+	    os_mul_overflow(fq_cl->fcl_stat.fcl_avg_qdelay, num_dequeues, &product) ||
+	    os_add_overflow(product, qdelay_sum, &product)) {
+		/* Reset the dequeue num and dequeue bytes */
+		fq_cl->fcl_stat.fcl_dequeue = 0;
+		fq_cl->fcl_stat.fcl_dequeue_bytes = 0;
+		fq_cl->fcl_stat.fcl_avg_qdelay = qdelay_sum / cnt;
+	} else {
+		fq_cl->fcl_stat.fcl_avg_qdelay = product / res;
+	}
+	fq_cl->fcl_stat.fcl_dequeue += cnt;
+	fq_cl->fcl_stat.fcl_dequeue_bytes += bytes;
+
+	if (fqs->fqs_large_flow != fq || !fq_if_almost_at_drop_limit(fqs)) {
+		FQ_CLEAR_OVERWHELMING(fq);
+	}
+	if (!FQ_IS_DELAY_HIGH(fq) || fq_empty(fq, ptype)) {
+		FQ_CLEAR_DELAY_HIGH(fq);
+	}
+
+	if ((fq->fq_flags & FQF_FLOWCTL_ON) &&
+	    !FQ_IS_DELAY_HIGH(fq) && !FQ_IS_OVERWHELMING(fq)) {
+		fq_if_flow_feedback(fqs, fq, fq_cl);
+	}
+
+	if (fq_empty(fq, ptype)) {
+		/* Reset getqtime so that we don't count idle times */
+		fq->fq_getqtime = 0;
+	} else {
+		fq->fq_getqtime = now;
+	}
+	fq_if_is_flow_heavy(fqs, fq);
+
+	return limit_reached;
+}
@@ -248,6 +248,8 @@ typedef struct flowq fq_t;
 struct fq_codel_sched_data;
 struct fq_if_classq;
 
+extern uint32_t fq_codel_bulk_dequeue;
+
 /* Function definitions */
 extern void fq_codel_init(void);
 extern fq_t *fq_alloc(classq_pkt_type_t);
@@ -258,6 +260,9 @@ extern void fq_getq_flow(struct fq_codel_sched_data *, fq_t *,
     pktsched_pkt_t *, uint64_t now);
 extern void fq_codel_dequeue(fq_if_t *fqs, fq_t *fq,
     pktsched_pkt_t *pkt, uint64_t now);
+extern boolean_t fq_getq_flow_bulk(fq_if_t *, struct fq_if_classq *, fq_t *,
+    int64_t, uint32_t, classq_pkt_t *, classq_pkt_t *, uint32_t *, uint32_t *,
+    uint64_t);
 extern void fq_getq_flow_internal(struct fq_codel_sched_data *,
     fq_t *, pktsched_pkt_t *);
 extern void fq_head_drop(struct fq_codel_sched_data *, fq_t *);
@@ -1454,6 +1454,11 @@ dlil_init(void)
 
 	PE_parse_boot_argn("net_async", &net_async, sizeof(net_async));
 
+	if (PE_parse_boot_argn("if_rcvq_rss", &if_rcvq_rss, sizeof(if_rcvq_rss))) {
+		if_rcvq_rss = MIN(MAX(if_rcvq_rss, 1), IF_RCVQ_RSS_MAX);
+	}
+	dlil_input_rss_seed = RandomULong();
+
 	PE_parse_boot_argn("ifnet_debug", &ifnet_debug, sizeof(ifnet_debug));
 
 	PE_parse_boot_argn("if_link_heuristics", &if_link_heuristics_flags, sizeof(if_link_heuristics_flags));
@@ -5090,6 +5095,12 @@ ifnet_attach(ifnet_t ifp, const struct sockaddr_dl *ll_addr)
 			panic_plain("%s: ifp=%p couldn't get an input thread; "
 			    "err=%d", __func__, ifp, err);
 			/* NOTREACHED */
+		} else if (if_rcvq_rss > 1 && !dlil_is_rxpoll_input(thfunc)) {
+			/*
+			 * Spread the input of the interface over additional
+			 * input threads; doesn't apply to hybrid polling.
+			 */
+			dlil_create_rss_input_threads(ifp, if_rcvq_rss);
 		}
 	}
 	/*
@@ -5931,6 +5942,9 @@ ifnet_detach_final(struct ifnet *ifp)
 				    (PZERO - 1) | PSPIN, inp->dlth_name, NULL);
 			}
 			lck_mtx_unlock(&inp->dlth_lock);
+
+			/* along with its flow-steered input threads */
+			dlil_terminate_rss_input_threads(ifp);
 			ifnet_lock_exclusive(ifp);
 		}
 
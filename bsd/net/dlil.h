@@ -184,6 +184,11 @@ struct dlil_threading_info {
 	uint32_t        dlth_trim_cnt;          /* # of trim events */
 	uint32_t        dlth_trim_pkts_dropped; /* # of packets dropped
 	                                         * when trimming */
+	/* Per input queue accounting (see dlil_input_rss) */
+	uint32_t        dlth_rss_index;         /* input queue index */
+	uint64_t        dlth_rss_pkts;          /* # of packets queued */
+	uint64_t        dlth_rss_bytes;         /* # of bytes queued */
+	uint64_t        dlth_rss_wakeups;       /* # of wakeup requests */
 #if IFNET_INPUT_SANITY_CHK
 	/*
 	 * For debugging.
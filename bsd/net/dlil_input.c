@@ -53,10 +53,16 @@
 /* rate limit debug messages */
 struct timespec dlil_dbgrate = { .tv_sec = 1, .tv_nsec = 0 };
 
+/* seed for steering inbound flows to input threads */
+uint32_t dlil_input_rss_seed;
+
 extern void proto_input_run(void);
 
 static errno_t dlil_input_async(struct dlil_threading_info *inp, struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail, const struct ifnet_stat_increment_param *s, boolean_t poll, struct thread *tp);
 static errno_t dlil_input_sync(struct dlil_threading_info *inp, struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail, const struct ifnet_stat_increment_param *s, boolean_t poll, struct thread *tp);
+static errno_t dlil_input_rss(struct dlil_threading_info *inp, struct ifnet *ifp, struct mbuf *m_head, const struct ifnet_stat_increment_param *s, boolean_t poll, struct thread *tp);
+static uint32_t dlil_input_flow_hash(struct ifnet *ifp, struct mbuf *m);
+static struct mbuf *dlil_gro_input(struct mbuf *m_list);
 static void dlil_input_cksum_dbg(struct ifnet *ifp, struct mbuf *m, char *frame_header, protocol_family_t pf);
 static void dlil_input_packet_list_common(struct ifnet *, mbuf_ref_t, u_int32_t, ifnet_model_t, boolean_t);
 static void dlil_input_thread_func(void *, wait_result_t);
@@ -116,8 +122,13 @@ dlil_create_input_thread(ifnet_t ifp, struct dlil_threading_info *inp,
 		 */
 		func = dlil_input_thread_func;
 		VERIFY(inp != dlil_main_input_thread);
-		inp->dlth_name = tsnprintf(inp->dlth_name_storage, sizeof(inp->dlth_name_storage),
-		    "%s_input", if_name(ifp));
+		if (inp->dlth_rss_index != 0) {
+			inp->dlth_name = tsnprintf(inp->dlth_name_storage, sizeof(inp->dlth_name_storage),
+			    "%s_input_%u", if_name(ifp), inp->dlth_rss_index);
+		} else {
+			inp->dlth_name = tsnprintf(inp->dlth_name_storage, sizeof(inp->dlth_name_storage),
+			    "%s_input", if_name(ifp));
+		}
 	} else {
 		/*
 		 * Synchronous strategy if there's a netif below and
@@ -192,8 +203,10 @@ dlil_create_input_thread(ifnet_t ifp, struct dlil_threading_info *inp,
 		 * We create an affinity set so that the matching workloop
 		 * thread or the starter thread (for loopback) can be
 		 * scheduled on the same processor set as the input thread.
+		 * Flow-steered input threads are meant to run elsewhere,
+		 * so they don't get one.
 		 */
-		if (net_affinity) {
+		if (net_affinity && inp->dlth_rss_index == 0) {
 			struct thread *tp __single = inp->dlth_thread;
 			u_int32_t tag;
 			/*
@@ -291,11 +304,107 @@ dlil_input_handler(struct ifnet *ifp, struct mbuf *m_head,
 		return dlil_input_sync(inp, ifp, m_head, m_tail, s, poll, tp);
 	} else
 #endif /* (DEVELOPMENT || DEBUG) */
-	{
+	if (ifp->if_inp_rss_cnt != 0 && inp != dlil_main_input_thread &&
+	    m_head != NULL && !poll) {
+		return dlil_input_rss(inp, ifp, m_head, s, poll, tp);
+	} else {
 		return inp->dlth_strategy(inp, ifp, m_head, m_tail, s, poll, tp);
 	}
 }
 
+/*
+ * Create the flow-steered input threads of an interface, in addition
+ * to its regular input thread `ifp->if_inp', which serves as queue 0.
+ */
+void
+dlil_create_rss_input_threads(ifnet_t ifp, uint32_t nqueues)
+{
+	struct dlil_threading_info *inp;
+	thread_continue_t thfunc = NULL;
+	uint32_t cnt = nqueues - 1;
+	int err;
+
+	VERIFY(ifp->if_inp != NULL);
+	VERIFY(ifp->if_inp_rss == NULL && ifp->if_inp_rss_cnt == 0);
+	VERIFY(nqueues > 1 && nqueues <= IF_RCVQ_RSS_MAX);
+
+	struct dlil_threading_info *__counted_by(cnt) rss =
+	    kalloc_type(struct dlil_threading_info, cnt, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+
+	for (uint32_t i = 0; i < cnt; i++) {
+		inp = &rss[i];
+		inp->dlth_rss_index = i + 1;
+		ifnet_incr_pending_thread_count(ifp);
+		err = dlil_create_input_thread(ifp, inp, &thfunc);
+		VERIFY(err == 0 && thfunc == dlil_input_thread_func);
+	}
+
+	ifp->if_inp_rss = rss;
+	ifp->if_inp_rss_cnt = cnt;
+
+	if (dlil_verbose) {
+		DLIL_PRINTF("%s: %u flow-steered input threads\n",
+		    if_name(ifp), nqueues);
+	}
+}
+
+/*
+ * Terminate the flow-steered input threads of a detaching interface,
+ * once it can no longer receive packets.
+ */
+void
+dlil_terminate_rss_input_threads(ifnet_t ifp)
+{
+	struct dlil_threading_info *inp;
+
+	for (uint32_t i = 0; i < ifp->if_inp_rss_cnt; i++) {
+		inp = &ifp->if_inp_rss[i];
+		VERIFY(!inp->dlth_affinity);
+
+		lck_mtx_lock_spin(&inp->dlth_lock);
+		inp->dlth_flags |= DLIL_INPUT_TERMINATE;
+		if (!(inp->dlth_flags & DLIL_INPUT_RUNNING)) {
+			wakeup_one((caddr_t)&inp->dlth_flags);
+		}
+		while ((inp->dlth_flags & DLIL_INPUT_TERMINATE_COMPLETE) == 0) {
+			(void) msleep(&inp->dlth_flags, &inp->dlth_lock,
+			    (PZERO - 1) | PSPIN, inp->dlth_name, NULL);
+		}
+		lck_mtx_unlock(&inp->dlth_lock);
+
+		dlil_clean_threading_info(inp);
+	}
+
+	kfree_type_counted_by(struct dlil_threading_info, ifp->if_inp_rss_cnt,
+	    ifp->if_inp_rss);
+}
+
+uint32_t
+dlil_get_rcvq_stats(ifnet_t ifp, struct if_rcvq_stats *__counted_by(cnt) stats,
+    uint32_t cnt)
+{
+	struct dlil_threading_info *inp;
+	uint32_t n = 0;
+
+	if (ifp->if_inp == NULL) {
+		return 0;
+	}
+
+	for (uint32_t i = 0; i <= ifp->if_inp_rss_cnt && n < cnt; i++, n++) {
+		inp = (i == 0) ? ifp->if_inp : &ifp->if_inp_rss[i - 1];
+
+		lck_mtx_lock_spin(&inp->dlth_lock);
+		stats[n].ifrq_packets = inp->dlth_rss_pkts;
+		stats[n].ifrq_bytes = inp->dlth_rss_bytes;
+		stats[n].ifrq_wakeups = inp->dlth_rss_wakeups;
+		stats[n].ifrq_dropped = inp->dlth_trim_pkts_dropped;
+		stats[n].ifrq_qlen = qlen(&inp->dlth_pkts);
+		lck_mtx_unlock(&inp->dlth_lock);
+	}
+
+	return n;
+}
+
 __private_extern__ void
 dlil_input_packet_list(struct ifnet *ifp, struct mbuf *m)
 {
@@ -318,6 +427,16 @@ dlil_ifproto_input(struct if_proto * ifproto, mbuf_ref_t m)
 {
 	int error;
 
+	/*
+	 * Coalesce TCP segments before handing them to IP, unless the
+	 * host forwards: forwarded segments must leave as they came in.
+	 */
+	if (if_rx_gro_max != 0 && hwcksum_rx && m->m_nextpkt != NULL &&
+	    ((ifproto->protocol_family == PF_INET && ipforwarding == 0) ||
+	    (ifproto->protocol_family == PF_INET6 && ip6_forwarding == 0))) {
+		m = dlil_gro_input(m);
+	}
+
 	if (ifproto->proto_kpi == kProtoKPI_v1) {
 		/* Version 1 protocols get one packet at a time */
 		while (m != NULL) {
@@ -351,6 +470,311 @@ dlil_ifproto_input(struct if_proto * ifproto, mbuf_ref_t m)
 	}
 }
 
+/*
+ * Software receive coalescing (GRO) of TCP segments.
+ *
+ * In-order TCP segments of the same flow found in one input batch are
+ * merged into a single mbuf chain, so that IP and TCP input run once per
+ * aggregate rather than once per segment.  The rules follow those of the
+ * flowswitch receive aggregation (see flow_agg.c): only data segments
+ * whose checksum was fully verified by the hardware are merged, and their
+ * IP and TCP headers must match but for the PSH flag and the timestamps.
+ * The aggregate keeps the verified checksum state of its first segment.
+ *
+ * An aggregate is closed by a segment carrying PSH, by a segment of its
+ * flow that is out of order or can't be merged, or when it reaches
+ * `if_rx_gro_max' bytes.  A packet whose headers can't be located closes
+ * every aggregate, as it may belong to any of their flows.  Segments are
+ * never held across input batches.
+ *
+ * Nothing is coalesced while IP forwarding is on (see dlil_ifproto_input()).
+ */
+#define DLIL_GRO_FLOWS          8
+#define DLIL_GRO_TCP_FLAGS      (TH_FIN | TH_SYN | TH_RST | TH_URG)
+
+struct dlil_gro_seg {
+	uint8_t         *dgs_l3;        /* IP header */
+	struct tcphdr   *dgs_th;        /* TCP header */
+	uint32_t        dgs_l3hlen;     /* IP header length */
+	uint32_t        dgs_thlen;      /* TCP header length */
+	uint32_t        dgs_ulen;       /* TCP payload length */
+	boolean_t       dgs_v4;         /* IPv4 or IPv6 */
+	boolean_t       dgs_padded;     /* trailing link layer padding */
+};
+
+struct dlil_gro_flow {
+	struct mbuf     *dgf_head;      /* aggregate (its first segment) */
+	struct mbuf     *dgf_last;      /* last mbuf of the aggregate */
+	struct dlil_gro_seg dgf_seg;    /* headers of the aggregate */
+	tcp_seq         dgf_next_seq;   /* next expected sequence number */
+};
+
+/*
+ * Locate the IP and TCP headers of a packet, which must be contiguous.
+ * The packet may extend past the IP length (e.g. Ethernet padding of
+ * short segments), such a segment is never merged.
+ */
+static boolean_t
+dlil_gro_parse(struct mbuf *m, struct dlil_gro_seg *seg)
+{
+	uint8_t *data = mtod(m, uint8_t *);
+	uint32_t l3len;
+
+	if (!IP_HDR_ALIGNED_P(data) || m->m_len < (int)sizeof(struct ip)) {
+		return FALSE;
+	}
+
+	switch (data[0] >> 4) {
+	case IPVERSION: {
+		struct ip *ip = (struct ip *)(void *)data;
+
+		/* no IP options or fragments */
+		if (ip->ip_p != IPPROTO_TCP || (ip->ip_hl << 2) != sizeof(*ip) ||
+		    (ip->ip_off & htons(IP_MF | IP_OFFMASK)) != 0) {
+			return FALSE;
+		}
+		seg->dgs_v4 = TRUE;
+		seg->dgs_l3hlen = sizeof(*ip);
+		l3len = ntohs(ip->ip_len);
+		break;
+	}
+	case IPV6_VERSION >> 4: {
+		struct ip6_hdr *ip6 = (struct ip6_hdr *)(void *)data;
+
+		/* no extension headers */
+		if (m->m_len < (int)sizeof(*ip6) || ip6->ip6_nxt != IPPROTO_TCP) {
+			return FALSE;
+		}
+		seg->dgs_v4 = FALSE;
+		seg->dgs_l3hlen = sizeof(*ip6);
+		l3len = sizeof(*ip6) + ntohs(ip6->ip6_plen);
+		break;
+	}
+	default:
+		return FALSE;
+	}
+
+	if (m->m_len < (int)(seg->dgs_l3hlen + sizeof(struct tcphdr))) {
+		return FALSE;
+	}
+	seg->dgs_l3 = data;
+	seg->dgs_th = (struct tcphdr *)(void *)(data + seg->dgs_l3hlen);
+	seg->dgs_thlen = seg->dgs_th->th_off << 2;
+	if (seg->dgs_thlen < sizeof(struct tcphdr) ||
+	    m->m_len < (int)(seg->dgs_l3hlen + seg->dgs_thlen) ||
+	    l3len < seg->dgs_l3hlen + seg->dgs_thlen ||
+	    (uint32_t)m_pktlen(m) < l3len) {
+		return FALSE;
+	}
+	seg->dgs_ulen = l3len - seg->dgs_l3hlen - seg->dgs_thlen;
+	seg->dgs_padded = (uint32_t)m_pktlen(m) != l3len;
+
+	return TRUE;
+}
+
+static inline uint32_t
+dlil_gro_slot(const struct dlil_gro_seg *seg)
+{
+	return (seg->dgs_th->th_sport ^ seg->dgs_th->th_dport) % DLIL_GRO_FLOWS;
+}
+
+static boolean_t
+dlil_gro_same_flow(const struct dlil_gro_seg *a, const struct dlil_gro_seg *b)
+{
+	if (a->dgs_v4 != b->dgs_v4 ||
+	    a->dgs_th->th_sport != b->dgs_th->th_sport ||
+	    a->dgs_th->th_dport != b->dgs_th->th_dport) {
+		return FALSE;
+	}
+	if (a->dgs_v4) {
+		struct ip *aip = (struct ip *)(void *)a->dgs_l3;
+		struct ip *bip = (struct ip *)(void *)b->dgs_l3;
+
+		return aip->ip_src.s_addr == bip->ip_src.s_addr &&
+		       aip->ip_dst.s_addr == bip->ip_dst.s_addr;
+	} else {
+		struct ip6_hdr *aip6 = (struct ip6_hdr *)(void *)a->dgs_l3;
+		struct ip6_hdr *bip6 = (struct ip6_hdr *)(void *)b->dgs_l3;
+
+		return IN6_ARE_ADDR_EQUAL(&aip6->ip6_src, &bip6->ip6_src) &&
+		       IN6_ARE_ADDR_EQUAL(&aip6->ip6_dst, &bip6->ip6_dst);
+	}
+}
+
+/*
+ * Whether a segment may start or join an aggregate at all.
+ */
+static boolean_t
+dlil_gro_eligible(struct mbuf *m, const struct dlil_gro_seg *seg)
+{
+	return seg->dgs_ulen != 0 && !seg->dgs_padded &&
+	       (seg->dgs_th->th_flags & DLIL_GRO_TCP_FLAGS) == 0 &&
+	       (m->m_pkthdr.csum_flags & (CSUM_DATA_VALID | CSUM_PSEUDO_HDR)) ==
+	       (CSUM_DATA_VALID | CSUM_PSEUDO_HDR) &&
+	       m->m_pkthdr.csum_rx_val == 0xffff &&
+	       !(m->m_pkthdr.pkt_flags & PKTF_WAKE_PKT) &&
+	       m_tag_first(m) == NULL;
+}
+
+/*
+ * Whether an eligible segment of the flow may be appended to its aggregate.
+ */
+static boolean_t
+dlil_gro_can_merge(struct dlil_gro_flow *f, const struct dlil_gro_seg *seg)
+{
+	const struct dlil_gro_seg *sseg = &f->dgf_seg;
+	struct tcphdr *sth = sseg->dgs_th;
+	struct tcphdr *th = seg->dgs_th;
+	uint32_t optlen = seg->dgs_thlen - sizeof(struct tcphdr);
+
+	if (ntohl(th->th_seq) != f->dgf_next_seq ||
+	    (sth->th_flags & TH_PUSH) != 0 ||
+	    m_pktlen(f->dgf_head) + seg->dgs_ulen > MIN(if_rx_gro_max, IP_MAXPACKET) ||
+	    f->dgf_head->m_pkthdr.rx_seg_cnt == UINT8_MAX) {
+		return FALSE;
+	}
+
+	if (seg->dgs_v4) {
+		struct ip *sip = (struct ip *)(void *)sseg->dgs_l3;
+		struct ip *ip = (struct ip *)(void *)seg->dgs_l3;
+
+		if (sip->ip_ttl != ip->ip_ttl || sip->ip_tos != ip->ip_tos ||
+		    (sip->ip_off & htons(IP_DF | IP_RF)) !=
+		    (ip->ip_off & htons(IP_DF | IP_RF))) {
+			return FALSE;
+		}
+	} else {
+		struct ip6_hdr *sip6 = (struct ip6_hdr *)(void *)sseg->dgs_l3;
+		struct ip6_hdr *ip6 = (struct ip6_hdr *)(void *)seg->dgs_l3;
+
+		if (sip6->ip6_flow != ip6->ip6_flow ||
+		    sip6->ip6_hlim != ip6->ip6_hlim) {
+			return FALSE;
+		}
+	}
+
+	if (sth->th_ack != th->th_ack || sth->th_win != th->th_win ||
+	    (sth->th_flags & ~TH_PUSH) != (th->th_flags & ~TH_PUSH) ||
+	    sseg->dgs_thlen != seg->dgs_thlen) {
+		return FALSE;
+	}
+
+	/* TCP options must match, except for the timestamp values */
+	if (optlen > 0 && bcmp(sth + 1, th + 1, optlen) != 0) {
+		uint32_t sts_hdr, ts_hdr;
+
+		if (optlen != TCPOLEN_TSTAMP_APPA) {
+			return FALSE;
+		}
+		bcopy(sth + 1, &sts_hdr, sizeof(sts_hdr));
+		bcopy(th + 1, &ts_hdr, sizeof(ts_hdr));
+		if (sts_hdr != htonl(TCPOPT_TSTAMP_HDR) ||
+		    ts_hdr != htonl(TCPOPT_TSTAMP_HDR)) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+dlil_gro_merge(struct dlil_gro_flow *f, struct mbuf *m,
+    const struct dlil_gro_seg *seg)
+{
+	struct mbuf *head = f->dgf_head;
+	struct dlil_gro_seg *sseg = &f->dgf_seg;
+	struct tcphdr *sth = sseg->dgs_th;
+	uint8_t cnt = head->m_pkthdr.rx_seg_cnt ? : 1;
+	uint8_t mcnt = m->m_pkthdr.rx_seg_cnt ? : 1;
+
+	/* carry the latest timestamps and PSH over to the aggregate */
+	if (seg->dgs_thlen > sizeof(struct tcphdr)) {
+		bcopy(seg->dgs_th + 1, sth + 1,
+		    seg->dgs_thlen - sizeof(struct tcphdr));
+	}
+	sth->th_flags |= (seg->dgs_th->th_flags & TH_PUSH);
+
+	if (sseg->dgs_v4) {
+		struct ip *sip = (struct ip *)(void *)sseg->dgs_l3;
+		uint16_t old_len = sip->ip_len;
+
+		sip->ip_len = htons(ntohs(sip->ip_len) + (uint16_t)seg->dgs_ulen);
+		sip->ip_sum = nat464_cksum_fixup(sip->ip_sum, old_len,
+		    sip->ip_len, 0);
+	} else {
+		struct ip6_hdr *sip6 = (struct ip6_hdr *)(void *)sseg->dgs_l3;
+
+		sip6->ip6_plen = htons(ntohs(sip6->ip6_plen) +
+		    (uint16_t)seg->dgs_ulen);
+	}
+
+	if (cnt == 1) {
+		os_atomic_inc(&if_rx_gro_aggs, relaxed);
+	}
+	if (os_add_overflow(cnt, mcnt, &head->m_pkthdr.rx_seg_cnt)) {
+		head->m_pkthdr.rx_seg_cnt = UINT8_MAX;
+	}
+	head->m_pkthdr.len += seg->dgs_ulen;
+	f->dgf_next_seq += seg->dgs_ulen;
+
+	/* chain the payload of the segment to the aggregate */
+	m_adj(m, seg->dgs_l3hlen + seg->dgs_thlen);
+	m_demote_pkthdr(m);
+	f->dgf_last->m_next = m;
+	f->dgf_last = m_last(m);
+	os_atomic_inc(&if_rx_gro_merged, relaxed);
+}
+
+static struct mbuf *
+dlil_gro_input(struct mbuf *m_list)
+{
+	struct dlil_gro_flow flows[DLIL_GRO_FLOWS];
+	struct dlil_gro_flow *f;
+	struct dlil_gro_seg seg;
+	struct mbuf *m, *next, *head = NULL, **tailp = &head;
+
+	bzero(flows, sizeof(flows));
+	for (m = m_list; m != NULL; m = next) {
+		next = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+
+		if (!dlil_gro_parse(m, &seg)) {
+			/* keep the packet ordered with any flow it may be part of */
+			for (int i = 0; i < DLIL_GRO_FLOWS; i++) {
+				flows[i].dgf_head = NULL;
+			}
+			goto pass;
+		}
+
+		f = &flows[dlil_gro_slot(&seg)];
+		if (f->dgf_head != NULL &&
+		    f->dgf_head->m_pkthdr.rcvif == m->m_pkthdr.rcvif &&
+		    dlil_gro_same_flow(&f->dgf_seg, &seg)) {
+			if (dlil_gro_eligible(m, &seg) &&
+			    dlil_gro_can_merge(f, &seg)) {
+				dlil_gro_merge(f, m, &seg);
+				continue;
+			}
+			/* this segment closes the aggregate of its flow */
+			f->dgf_head = NULL;
+		}
+
+		/* start a new aggregate, closing that of any other flow in the slot */
+		if (dlil_gro_eligible(m, &seg) &&
+		    !(seg.dgs_th->th_flags & TH_PUSH)) {
+			f->dgf_head = m;
+			f->dgf_last = m_last(m);
+			f->dgf_seg = seg;
+			f->dgf_next_seq = ntohl(seg.dgs_th->th_seq) + seg.dgs_ulen;
+		}
+pass:
+		*tailp = m;
+		tailp = &m->m_nextpkt;
+	}
+
+	return head;
+}
+
 static errno_t
 dlil_input_async(struct dlil_threading_info *inp,
     struct ifnet *ifp, struct mbuf *m_head, struct mbuf *m_tail,
@@ -419,6 +843,8 @@ dlil_input_async(struct dlil_threading_info *inp,
 		}
 
 		_addq_multi(input_queue, &head, &tail, m_cnt, m_size);
+		inp->dlth_rss_pkts += m_cnt;
+		inp->dlth_rss_bytes += m_size;
 
 		if (MBUF_QUEUE_IS_OVERCOMMITTED(input_queue)) {
 			dlil_trim_overcomitted_queue_locked(input_queue, &freeq, &s_adj);
@@ -525,6 +951,8 @@ dlil_input_sync(struct dlil_threading_info *inp,
 
 	lck_mtx_lock_spin(&inp->dlth_lock);
 	_addq_multi(&inp->dlth_pkts, &head, &tail, m_cnt, m_size);
+	inp->dlth_rss_pkts += m_cnt;
+	inp->dlth_rss_bytes += m_size;
 
 	if (MBUF_QUEUE_IS_OVERCOMMITTED(&inp->dlth_pkts)) {
 		dlil_trim_overcomitted_queue_locked(&inp->dlth_pkts, &freeq, &s_adj);
@@ -611,6 +1039,155 @@ dlil_input_sync(struct dlil_threading_info *inp,
 	return 0;
 }
 
+/*
+ * Split an inbound packet chain among the input threads of the interface,
+ * steering each packet by its flow hash so that the packets of a flow are
+ * always processed by the same thread, in order.
+ */
+static errno_t
+dlil_input_rss(struct dlil_threading_info *inp, struct ifnet *ifp,
+    struct mbuf *m_head, const struct ifnet_stat_increment_param *s,
+    boolean_t poll, struct thread *tp)
+{
+	struct {
+		struct mbuf     *head;
+		struct mbuf     *tail;
+		u_int32_t       cnt;
+		u_int32_t       size;
+	} rssq[IF_RCVQ_RSS_MAX] = {};
+	struct ifnet_stat_increment_param s_q;
+	dlil_threading_info_ref_t q_inp;
+	u_int32_t nqueues = ifp->if_inp_rss_cnt + 1;
+	u_int32_t i, used = 0, last = 0;
+	boolean_t first = TRUE;
+	struct mbuf *m, *next;
+
+	for (m = m_head; m != NULL; m = next) {
+		next = m->m_nextpkt;
+		m->m_nextpkt = NULL;
+
+		i = dlil_input_flow_hash(ifp, m) % nqueues;
+		if (rssq[i].head == NULL) {
+			rssq[i].head = m;
+			used++;
+			last = i;
+		} else {
+			rssq[i].tail->m_nextpkt = m;
+		}
+		rssq[i].tail = m;
+		rssq[i].cnt++;
+		rssq[i].size += m_pktlen(m);
+	}
+
+	/* the whole chain goes to a single queue; keep the driver's stats */
+	if (used == 1) {
+		q_inp = (last == 0) ? inp : &ifp->if_inp_rss[last - 1];
+		return q_inp->dlth_strategy(q_inp, ifp, rssq[last].head,
+		           rssq[last].tail, s, poll, tp);
+	}
+
+	for (i = 0; i < nqueues; i++) {
+		if (rssq[i].head == NULL) {
+			continue;
+		}
+		/*
+		 * Inbound packet and byte counts follow the packets; any
+		 * other counters are accounted for on the first queue.
+		 */
+		if (first) {
+			s_q = *s;
+			first = FALSE;
+		} else {
+			bzero(&s_q, sizeof(s_q));
+		}
+		s_q.packets_in = rssq[i].cnt;
+		s_q.bytes_in = rssq[i].size;
+
+		q_inp = (i == 0) ? inp : &ifp->if_inp_rss[i - 1];
+		(void) q_inp->dlth_strategy(q_inp, ifp, rssq[i].head,
+		    rssq[i].tail, &s_q, poll, tp);
+	}
+
+	return 0;
+}
+
+struct dlil_input_flow_key {
+	struct in6_addr dfk_src;
+	struct in6_addr dfk_dst;
+	u_int16_t       dfk_sport;
+	u_int16_t       dfk_dport;
+	u_int8_t        dfk_proto;
+	u_int8_t        dfk_pad[3];
+};
+
+/*
+ * Compute the flow hash used to steer an inbound packet.  Prefer the one
+ * provided by the driver or the netif nexus, otherwise hash the addresses,
+ * protocol and ports of IP over Ethernet packets.  Anything else, as well
+ * as packets whose headers aren't contiguous, goes to queue 0.
+ */
+static uint32_t
+dlil_input_flow_hash(struct ifnet *ifp, struct mbuf *m)
+{
+	struct dlil_input_flow_key fk __attribute__((aligned(8)));
+	struct ether_header *eh;
+	uint8_t *data = mtod(m, uint8_t *);
+	u_int32_t hlen = 0;
+
+	if ((m->m_pkthdr.pkt_flags & PKTF_FLOW_ID) &&
+	    m->m_pkthdr.pkt_flowid != 0) {
+		return m->m_pkthdr.pkt_flowid;
+	}
+	if (ifp->if_type != IFT_ETHER || m->m_pkthdr.pkt_hdr == NULL) {
+		return 0;
+	}
+	eh = (struct ether_header *)(void *)m->m_pkthdr.pkt_hdr;
+
+	bzero(&fk, sizeof(fk));
+	switch (ntohs(eh->ether_type)) {
+	case ETHERTYPE_IP: {
+		struct ip ip;
+
+		if (m->m_len < (int)sizeof(ip)) {
+			return 0;
+		}
+		bcopy(data, &ip, sizeof(ip));
+		bcopy(&ip.ip_src, &fk.dfk_src, sizeof(ip.ip_src));
+		bcopy(&ip.ip_dst, &fk.dfk_dst, sizeof(ip.ip_dst));
+		fk.dfk_proto = ip.ip_p;
+		/* fragments are hashed by address only */
+		if (!(ip.ip_off & htons(IP_MF | IP_OFFMASK))) {
+			hlen = ip.ip_hl << 2;
+		}
+		break;
+	}
+	case ETHERTYPE_IPV6: {
+		struct ip6_hdr ip6;
+
+		if (m->m_len < (int)sizeof(ip6)) {
+			return 0;
+		}
+		bcopy(data, &ip6, sizeof(ip6));
+		fk.dfk_src = ip6.ip6_src;
+		fk.dfk_dst = ip6.ip6_dst;
+		fk.dfk_proto = ip6.ip6_nxt;
+		hlen = sizeof(ip6);
+		break;
+	}
+	default:
+		return 0;
+	}
+
+	if ((fk.dfk_proto == IPPROTO_TCP || fk.dfk_proto == IPPROTO_UDP) &&
+	    hlen != 0 && m->m_len >= (int)(hlen + 2 * sizeof(u_int16_t))) {
+		bcopy(data + hlen, &fk.dfk_sport, sizeof(fk.dfk_sport));
+		bcopy(data + hlen + sizeof(u_int16_t), &fk.dfk_dport,
+		    sizeof(fk.dfk_dport));
+	}
+
+	return net_flowhash(&fk, sizeof(fk), dlil_input_rss_seed);
+}
+
 static void
 dlil_input_cksum_dbg(struct ifnet *ifp, struct mbuf *m, char *frame_header,
     protocol_family_t pf)
@@ -1122,8 +1699,13 @@ dlil_input_thread_func(void *v, wait_result_t w)
 
 	/* construct the name for this thread, and then apply it */
 	bzero(thread_name_storage, sizeof(thread_name_storage));
-	thread_name = tsnprintf(thread_name_storage, sizeof(thread_name_storage),
-	    "dlil_input_%s", ifp->if_xname);
+	if (inp->dlth_rss_index != 0) {
+		thread_name = tsnprintf(thread_name_storage, sizeof(thread_name_storage),
+		    "dlil_input_%s_%u", ifp->if_xname, inp->dlth_rss_index);
+	} else {
+		thread_name = tsnprintf(thread_name_storage, sizeof(thread_name_storage),
+		    "dlil_input_%s", ifp->if_xname);
+	}
 	thread_set_thread_name(inp->dlth_thread, thread_name);
 
 	lck_mtx_lock(&inp->dlth_lock);
@@ -1248,6 +1830,7 @@ dlil_input_wakeup(struct dlil_threading_info *inp)
 	LCK_MTX_ASSERT(&inp->dlth_lock, LCK_MTX_ASSERT_OWNED);
 
 	inp->dlth_flags |= DLIL_INPUT_WAITING;
+	inp->dlth_rss_wakeups++;
 	if (!(inp->dlth_flags & DLIL_INPUT_RUNNING)) {
 		inp->dlth_wtot++;
 		wakeup_one((caddr_t)&inp->dlth_flags);
@@ -1097,6 +1097,9 @@ dlil_clean_threading_info(struct dlil_threading_info *inp)
 	VERIFY(qhead(&inp->dlth_pkts) == NULL && qempty(&inp->dlth_pkts));
 	qlimit(&inp->dlth_pkts) = 0;
 	bzero(&inp->dlth_stats, sizeof(inp->dlth_stats));
+	inp->dlth_rss_pkts = 0;
+	inp->dlth_rss_bytes = 0;
+	inp->dlth_rss_wakeups = 0;
 
 	VERIFY(!inp->dlth_affinity);
 	inp->dlth_thread = THREAD_NULL;
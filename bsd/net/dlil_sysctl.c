@@ -53,6 +53,8 @@ static int sysctl_sndq_maxlen SYSCTL_HANDLER_ARGS;
 static int sysctl_rcvq_maxlen SYSCTL_HANDLER_ARGS;
 static int sysctl_rcvq_burst_limit SYSCTL_HANDLER_ARGS;
 static int sysctl_rcvq_trim_pct SYSCTL_HANDLER_ARGS;
+static int sysctl_rcvq_rss SYSCTL_HANDLER_ARGS;
+static int sysctl_rcvq_stats SYSCTL_HANDLER_ARGS;
 static int sysctl_hwcksum_dbg_mode SYSCTL_HANDLER_ARGS;
 static int sysctl_hwcksum_dbg_partial_rxoff_forced SYSCTL_HANDLER_ARGS;
 static int sysctl_hwcksum_dbg_partial_rxoff_adj SYSCTL_HANDLER_ARGS;
@@ -140,6 +142,25 @@ SYSCTL_PROC(_net_link_generic_system, OID_AUTO, rcvq_trim_pct,
     sysctl_rcvq_trim_pct, "I",
     "Percentage (0 - 100) of the queue limit to keep after detecting an overflow burst");
 
+/*
+ * Software receive coalescing of TCP segments in DLIL input: upper
+ * bound of the IP length of an aggregate, 0 disables coalescing.
+ */
+uint32_t if_rx_gro_max = 16384;
+SYSCTL_UINT(_net_link_generic_system, OID_AUTO, rx_gro_max,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &if_rx_gro_max, 0,
+    "Maximum size of coalesced TCP segments on input (0 to disable)");
+
+uint64_t if_rx_gro_aggs = 0;
+SYSCTL_QUAD(_net_link_generic_system, OID_AUTO, rx_gro_aggs,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &if_rx_gro_aggs,
+    "Number of TCP aggregates built on input");
+
+uint64_t if_rx_gro_merged = 0;
+SYSCTL_QUAD(_net_link_generic_system, OID_AUTO, rx_gro_merged,
+    CTLFLAG_RD | CTLFLAG_LOCKED, &if_rx_gro_merged,
+    "Number of TCP segments merged into an aggregate on input");
+
 struct chain_len_stats tx_chain_len_stats;
 SYSCTL_PROC(_net_link_generic_system, OID_AUTO, tx_chain_len_stats,
     CTLFLAG_RD | CTLFLAG_LOCKED, 0, 9,
@@ -228,6 +249,22 @@ SYSCTL_UINT(_net_link_generic_system, OID_AUTO, dlil_input_threads,
     CTLFLAG_RD | CTLFLAG_LOCKED, &cur_dlil_input_threads, 0,
     "Current number of DLIL input threads");
 
+/*
+ * Number of input threads created for an interface using the asynchronous
+ * input strategy, including its regular input thread.  Inbound packets are
+ * steered to the threads by flow hash, so that a single interface can
+ * spread protocol input over several processors while keeping the packets
+ * of each flow in order.  Takes effect for interfaces attached afterwards.
+ */
+uint32_t if_rcvq_rss = 1;
+SYSCTL_PROC(_net_link_generic_system, OID_AUTO, rcvq_rss,
+    CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_LOCKED, &if_rcvq_rss, 1,
+    sysctl_rcvq_rss, "I", "Number of flow-steered input threads per interface");
+
+SYSCTL_NODE(_net_link_generic_system, OID_AUTO, rcvq_stats,
+    CTLFLAG_RD | CTLFLAG_LOCKED, sysctl_rcvq_stats,
+    "Per input queue statistics of an interface");
+
 
 /******************************************************************************
 * Section: hardware-assisted checksum mechanism.                             *
@@ -617,6 +654,63 @@ sysctl_rcvq_burst_limit SYSCTL_HANDLER_ARGS
 	return err;
 }
 
+static int
+sysctl_rcvq_rss SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2)
+	int i, err;
+
+	i = if_rcvq_rss;
+
+	err = sysctl_handle_int(oidp, &i, 0, req);
+	if (err != 0 || req->newptr == USER_ADDR_NULL) {
+		return err;
+	}
+
+	if (i < 1 || i > IF_RCVQ_RSS_MAX) {
+		return EINVAL;
+	}
+
+	if_rcvq_rss = i;
+	return err;
+}
+
+static int
+sysctl_rcvq_stats SYSCTL_HANDLER_ARGS
+{
+#pragma unused(oidp)
+	DECLARE_SYSCTL_HANDLER_ARG_ARRAY(int, 1, name, namelen);
+	struct if_rcvq_stats stats[IF_RCVQ_RSS_MAX] = {};
+	ifnet_t ifp = NULL;
+	uint32_t cnt;
+	int idx;
+
+	if (req->newptr != USER_ADDR_NULL) {
+		return EPERM;
+	}
+
+	idx = name[0];
+	ifnet_head_lock_shared();
+	if (!IF_INDEX_IN_RANGE(idx)) {
+		ifnet_head_done();
+		return ENOENT;
+	}
+	ifp = ifindex2ifnet[idx];
+	ifnet_head_done();
+
+	if (ifp == NULL || !ifnet_is_attached(ifp, 1)) {
+		return ENXIO;
+	}
+	cnt = dlil_get_rcvq_stats(ifp, stats, IF_RCVQ_RSS_MAX);
+	ifnet_decr_iorefcnt(ifp);
+
+	if (req->oldptr == USER_ADDR_NULL) {
+		req->oldidx = cnt * sizeof(stats[0]);
+		return 0;
+	}
+	return SYSCTL_OUT(req, stats, cnt * sizeof(stats[0]));
+}
+
 static int
 sysctl_rcvq_trim_pct SYSCTL_HANDLER_ARGS
 {
@@ -61,6 +61,9 @@ extern uint32_t if_rcvq_burst_limit;
 extern uint32_t if_rcvq_trim_pct;
 extern struct chain_len_stats tx_chain_len_stats;
 extern uint32_t tx_chain_len_count;
+extern uint32_t if_rx_gro_max;
+extern uint64_t if_rx_gro_aggs;
+extern uint64_t if_rx_gro_merged;
 
 
 /******************************************************************************
@@ -87,6 +90,11 @@ extern uint32_t if_input_thread_termination_spin;
 
 extern uint32_t cur_dlil_input_threads;
 
+/* Flow-steered input threads per interface */
+#define IF_RCVQ_RSS_MAX 8
+
+extern uint32_t if_rcvq_rss;
+
 
 /******************************************************************************
 * Section: hardware-assisted checksum mechanism.                             *
@@ -110,6 +110,7 @@
 
 #include <net/nat464_utils.h>
 #include <netinet6/in6_var.h>
+#include <netinet6/ip6_var.h>
 #include <netinet6/nd6.h>
 #include <netinet6/mld6_var.h>
 #include <netinet6/scope6_var.h>
@@ -395,6 +396,11 @@ int dlil_create_input_thread(ifnet_t, struct dlil_threading_info *,
 
 void dlil_terminate_input_thread(struct dlil_threading_info *);
 
+void dlil_create_rss_input_threads(ifnet_t, uint32_t);
+void dlil_terminate_rss_input_threads(ifnet_t);
+uint32_t dlil_get_rcvq_stats(ifnet_t, struct if_rcvq_stats *__counted_by(cnt), uint32_t cnt);
+extern uint32_t dlil_input_rss_seed;
+
 extern boolean_t dlil_is_rxpoll_input(thread_continue_t func);
 boolean_t dlil_is_native_netif_nexus(ifnet_t ifp);
 
@@ -280,6 +280,18 @@ struct if_netif_stats {
 	u_int32_t       ifn_rx_mit_cfg_interval;/* delay interval (nsec) */
 };
 
+/*
+ * Per input queue statistics of an interface; queue 0 is the input
+ * thread of the interface, the others are flow-steered input threads.
+ */
+struct if_rcvq_stats {
+	u_int64_t       ifrq_packets;       /* total # of queued packets */
+	u_int64_t       ifrq_bytes;         /* total # of queued bytes */
+	u_int64_t       ifrq_wakeups;       /* total # of wakeup reqs */
+	u_int32_t       ifrq_dropped;       /* total # of trimmed packets */
+	u_int32_t       ifrq_qlen;          /* current queue length */
+};
+
 struct if_tcp_ecn_perf_stat {
 	u_int64_t total_txpkts;
 	u_int64_t total_rxmitpkts;
@@ -875,6 +887,9 @@ struct ifnet {
 #define if_rxpoll_ival     rxpoll_params.poll_pstats.ifi_poll_interval_time
 
 	struct dlil_threading_info *if_inp;
+	/* flow-steered input threads, in addition to if_inp */
+	struct dlil_threading_info *__counted_by(if_inp_rss_cnt) if_inp_rss;
+	uint32_t                if_inp_rss_cnt;
 
 	/* allocated once along with dlil_ifnet and is never freed */
 	thread_call_t           if_dt_tcall;
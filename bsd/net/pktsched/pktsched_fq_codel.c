@@ -252,6 +252,13 @@ fq_getq_flow_kpkt(fq_if_t *fqs, fq_if_classq_t *fq_cl, fq_t *fq,
 	 * Assert to make sure pflags is part of PKT_F_COMMON_MASK;
 	 * all common flags need to be declared in that mask.
 	 */
+	/* Classic flows aren't paced or CE marked; take them in one burst */
+	if (fq_codel_bulk_dequeue != 0 &&
+	    (!ifclassq_enable_l4s || fq->fq_tfc_type != FQ_TFC_L4S)) {
+		limit_reached = fq_getq_flow_bulk(fqs, fq_cl, fq, byte_limit,
+		    pkt_limit, head, tail, byte_cnt, pkt_cnt, now);
+	}
+
 	while (fq->fq_deficit > 0 && limit_reached == FALSE &&
 	    !KPKTQ_EMPTY(&fq->fq_kpktq) && fq_tx_time_ready(fqs, fq, now, NULL)) {
 		_PKTSCHED_PKT_INIT(&pkt);
@@ -307,6 +314,13 @@ fq_getq_flow_mbuf(fq_if_t *fqs, fq_if_classq_t *fq_cl, fq_t *fq,
 	struct ifclassq *ifq = fqs->fqs_ifq;
 	struct ifnet *ifp = ifq->ifcq_ifp;
 
+	/* Classic flows aren't paced or CE marked; take them in one burst */
+	if (fq_codel_bulk_dequeue != 0 &&
+	    (!ifclassq_enable_l4s || fq->fq_tfc_type != FQ_TFC_L4S)) {
+		limit_reached = fq_getq_flow_bulk(fqs, fq_cl, fq, byte_limit,
+		    pkt_limit, head, tail, byte_cnt, pkt_cnt, now);
+	}
+
 	while (fq->fq_deficit > 0 && limit_reached == FALSE &&
 	    !MBUFQ_EMPTY(&fq->fq_mbufq) && fq_tx_time_ready(fqs, fq, now, NULL)) {
 		_PKTSCHED_PKT_INIT(&pkt);
@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2025 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Poptrie, after Asai and Ohara, "Poptrie: A Compressed Trie with
+ * Population Count for Fast and Scalable Software IP Routing Table
+ * Lookup", SIGCOMM 2015.
+ *
+ * The table is compiled from routes sorted by key, then by prefix length.
+ * A node at bit offset off is built from a contiguous range of routes
+ * sharing their first off bits: prefixes ending within the node's 6 bits
+ * are expanded into its 64 slots, longer ones go to the child node of
+ * their slot.  Slots without a child are leaves, and consecutive leaves
+ * holding the same value are stored once.
+ *
+ * This file is also built in user space by the benchmark in tests/.
+ */
+
+#include <stdbool.h>
+
+#ifdef KERNEL
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/errno.h>
+#include <kern/kalloc.h>
+#include <libkern/OSByteOrder.h>
+#include <net/poptrie.h>
+
+extern void qsort(void *a, size_t n, size_t es,
+    int (*cmp)(const void *, const void *));
+
+#define POPTRIE_ALLOC(size)     kalloc_data(size, Z_WAITOK | Z_ZERO)
+#define POPTRIE_REALLOC(p, osize, nsize) \
+	krealloc_data(p, osize, nsize, Z_WAITOK | Z_ZERO)
+#define POPTRIE_FREE(p, size)   kfree_data(p, size)
+#else /* !KERNEL */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <libkern/OSByteOrder.h>
+#include "poptrie.h"
+
+static void *
+poptrie_realloc(void *p, size_t osize, size_t nsize)
+{
+	char *np = realloc(p, nsize);
+
+	if (np != NULL && nsize > osize) {
+		memset(np + osize, 0, nsize - osize);
+	}
+	return np;
+}
+
+#define POPTRIE_ALLOC(size)     calloc(1, size)
+#define POPTRIE_REALLOC(p, osize, nsize) poptrie_realloc(p, osize, nsize)
+#define POPTRIE_FREE(p, size)   free(p)
+#endif /* !KERNEL */
+
+#define POPTRIE_DIRBITS         16
+#define POPTRIE_DIRSIZE         (1U << POPTRIE_DIRBITS)
+#define POPTRIE_DIR_LEAF        0x80000000U     /* directory entry is a value */
+#define POPTRIE_STRIDE          6
+#define POPTRIE_SLOTS           (1U << POPTRIE_STRIDE)
+#define POPTRIE_SLOTMASK        (POPTRIE_SLOTS - 1)
+#define POPTRIE_MAXDEPTH        \
+	((POPTRIE_KEYLEN_MAX * 8 - POPTRIE_DIRBITS + POPTRIE_STRIDE - 1) / \
+	POPTRIE_STRIDE)
+#define POPTRIE_MAXINDEX        0x7fffffffU
+
+struct poptrie_node {
+	uint64_t        pn_vector;      /* slots with a child node */
+	uint64_t        pn_leafvec;     /* slots starting a run of leaves */
+	uint32_t        pn_base0;       /* first leaf */
+	uint32_t        pn_base1;       /* first child node */
+};
+
+struct poptrie {
+	uint8_t         pt_keylen;      /* key bytes, 4 or 16 */
+	uint32_t        *pt_dir;        /* POPTRIE_DIRSIZE entries */
+	struct poptrie_node *pt_nodes;
+	uint32_t        *pt_leaves;
+	uint32_t        pt_nnodes;
+	uint32_t        pt_nleaves;
+	uint32_t        pt_nodes_max;   /* allocated nodes */
+	uint32_t        pt_leaves_max;  /* allocated leaves */
+};
+
+struct poptrie_build {
+	struct poptrie  *pb_pt;
+	const struct poptrie_route *pb_routes;
+	uint32_t        pb_slots[POPTRIE_MAXDEPTH][POPTRIE_SLOTS];
+};
+
+static inline void
+poptrie_key_load(const uint8_t *key, uint8_t keylen, uint64_t *hi,
+    uint64_t *lo)
+{
+	uint64_t v;
+	uint32_t w;
+
+	if (keylen == sizeof(w)) {
+		memcpy(&w, key, sizeof(w));
+		*hi = (uint64_t)OSSwapBigToHostInt32(w) << 32;
+		*lo = 0;
+	} else {
+		memcpy(&v, key, sizeof(v));
+		*hi = OSSwapBigToHostInt64(v);
+		memcpy(&v, key + sizeof(v), sizeof(v));
+		*lo = OSSwapBigToHostInt64(v);
+	}
+}
+
+/*
+ * Return the POPTRIE_STRIDE bits at bit offset off of the 128-bit key
+ * hi:lo; bits past the end of the key read as zero.
+ */
+static inline uint32_t
+poptrie_bits(uint64_t hi, uint64_t lo, unsigned int off)
+{
+	if (off + POPTRIE_STRIDE <= 64) {
+		return (uint32_t)(hi >> (64 - POPTRIE_STRIDE - off)) &
+		       POPTRIE_SLOTMASK;
+	}
+	if (off < 64) {
+		return (uint32_t)((hi << (off + POPTRIE_STRIDE - 64)) |
+		       (lo >> (128 - POPTRIE_STRIDE - off))) & POPTRIE_SLOTMASK;
+	}
+	if (off + POPTRIE_STRIDE <= 128) {
+		return (uint32_t)(lo >> (128 - POPTRIE_STRIDE - off)) &
+		       POPTRIE_SLOTMASK;
+	}
+	return (uint32_t)(lo << (off + POPTRIE_STRIDE - 128)) &
+	       POPTRIE_SLOTMASK;
+}
+
+uint32_t
+poptrie_lookup(const struct poptrie *pt, const uint8_t *key)
+{
+	const struct poptrie_node *pn;
+	uint64_t hi, lo, bit;
+	unsigned int off;
+	uint32_t idx;
+
+	poptrie_key_load(key, pt->pt_keylen, &hi, &lo);
+	idx = pt->pt_dir[hi >> (64 - POPTRIE_DIRBITS)];
+	if (idx & POPTRIE_DIR_LEAF) {
+		return idx & ~POPTRIE_DIR_LEAF;
+	}
+	pn = &pt->pt_nodes[idx];
+	off = POPTRIE_DIRBITS;
+	for (;;) {
+		bit = 1ULL << poptrie_bits(hi, lo, off);
+		if ((pn->pn_vector & bit) == 0) {
+			break;
+		}
+		pn = &pt->pt_nodes[pn->pn_base1 +
+		    __builtin_popcountll(pn->pn_vector & (bit - 1))];
+		off += POPTRIE_STRIDE;
+	}
+	/* (bit << 1) - 1 covers every slot up to this one, even slot 63 */
+	return pt->pt_leaves[pn->pn_base0 +
+	           __builtin_popcountll(pn->pn_leafvec & ((bit << 1) - 1)) - 1];
+}
+
+static uint32_t
+poptrie_route_bits(const struct poptrie_route *r, uint8_t keylen,
+    unsigned int off)
+{
+	uint64_t hi, lo;
+
+	poptrie_key_load(r->pr_key, keylen, &hi, &lo);
+	return poptrie_bits(hi, lo, off);
+}
+
+static int
+poptrie_route_cmp(const void *a, const void *b)
+{
+	const struct poptrie_route *ra = a, *rb = b;
+	int ret;
+
+	ret = memcmp(ra->pr_key, rb->pr_key, sizeof(ra->pr_key));
+	if (ret == 0) {
+		ret = (int)ra->pr_plen - (int)rb->pr_plen;
+	}
+	return ret;
+}
+
+static int
+poptrie_alloc_nodes(struct poptrie *pt, uint32_t n, uint32_t *idx)
+{
+	if (n > POPTRIE_MAXINDEX - pt->pt_nnodes) {
+		return ENOMEM;
+	}
+	if (pt->pt_nnodes + n > pt->pt_nodes_max) {
+		uint32_t max = MAX(MAX(pt->pt_nodes_max * 2, pt->pt_nnodes + n), 64);
+		void *p;
+
+		max = MIN(max, POPTRIE_MAXINDEX);
+		p = POPTRIE_REALLOC(pt->pt_nodes,
+		    pt->pt_nodes_max * sizeof(struct poptrie_node),
+		    max * sizeof(struct poptrie_node));
+		if (p == NULL) {
+			return ENOMEM;
+		}
+		pt->pt_nodes = p;
+		pt->pt_nodes_max = max;
+	}
+	*idx = pt->pt_nnodes;
+	pt->pt_nnodes += n;
+	return 0;
+}
+
+static int
+poptrie_alloc_leaves(struct poptrie *pt, uint32_t n, uint32_t *idx)
+{
+	if (n > POPTRIE_MAXINDEX - pt->pt_nleaves) {
+		return ENOMEM;
+	}
+	if (pt->pt_nleaves + n > pt->pt_leaves_max) {
+		uint32_t max = MAX(MAX(pt->pt_leaves_max * 2, pt->pt_nleaves + n), 256);
+		void *p;
+
+		max = MIN(max, POPTRIE_MAXINDEX);
+		p = POPTRIE_REALLOC(pt->pt_leaves,
+		    pt->pt_leaves_max * sizeof(uint32_t), max * sizeof(uint32_t));
+		if (p == NULL) {
+			return ENOMEM;
+		}
+		pt->pt_leaves = p;
+		pt->pt_leaves_max = max;
+	}
+	*idx = pt->pt_nleaves;
+	pt->pt_nleaves += n;
+	return 0;
+}
+
+/*
+ * Build node idx at bit offset off from routes [first, last), all of
+ * which share their first off bits; def is the value of the longest
+ * prefix of at most off bits covering the node.
+ */
+static int
+poptrie_fill(struct poptrie_build *pb, uint32_t idx, unsigned int depth,
+    unsigned int off, uint32_t first, uint32_t last, uint32_t def)
+{
+	struct poptrie *pt = pb->pb_pt;
+	const struct poptrie_route *routes = pb->pb_routes;
+	uint32_t *slots = pb->pb_slots[depth];
+	uint64_t vector = 0, leafvec = 0;
+	uint32_t base0, base1, nleaves, prev = 0;
+	uint32_t i, s, child;
+	int error;
+
+	for (s = 0; s < POPTRIE_SLOTS; s++) {
+		slots[s] = def;
+	}
+	/* Expand the prefixes ending in this node, shortest first */
+	for (unsigned int plen = off + 1; plen <= off + POPTRIE_STRIDE; plen++) {
+		for (i = first; i < last; i++) {
+			if (routes[i].pr_plen != plen) {
+				continue;
+			}
+			s = poptrie_route_bits(&routes[i], pt->pt_keylen, off);
+			for (uint32_t n = 1U << (off + POPTRIE_STRIDE - plen);
+			    n > 0; n--, s++) {
+				slots[s] = routes[i].pr_value;
+			}
+		}
+	}
+	for (i = first; i < last; i++) {
+		if (routes[i].pr_plen > off + POPTRIE_STRIDE) {
+			vector |= 1ULL << poptrie_route_bits(&routes[i],
+			    pt->pt_keylen, off);
+		}
+	}
+
+	nleaves = 0;
+	for (s = 0; s < POPTRIE_SLOTS; s++) {
+		if ((vector & (1ULL << s)) == 0 &&
+		    (nleaves == 0 || slots[s] != prev)) {
+			leafvec |= 1ULL << s;
+			prev = slots[s];
+			nleaves++;
+		}
+	}
+	if ((error = poptrie_alloc_leaves(pt, nleaves, &base0)) != 0 ||
+	    (error = poptrie_alloc_nodes(pt,
+	    (uint32_t)__builtin_popcountll(vector), &base1)) != 0) {
+		return error;
+	}
+	for (s = 0, i = base0; s < POPTRIE_SLOTS; s++) {
+		if (leafvec & (1ULL << s)) {
+			pt->pt_leaves[i++] = slots[s];
+		}
+	}
+	pt->pt_nodes[idx].pn_vector = vector;
+	pt->pt_nodes[idx].pn_leafvec = leafvec;
+	pt->pt_nodes[idx].pn_base0 = base0;
+	pt->pt_nodes[idx].pn_base1 = base1;
+
+	/* Routes of a slot are contiguous since they are sorted by key */
+	i = first;
+	child = base1;
+	for (s = 0; s < POPTRIE_SLOTS; s++) {
+		uint32_t start;
+
+		if ((vector & (1ULL << s)) == 0) {
+			continue;
+		}
+		while (poptrie_route_bits(&routes[i], pt->pt_keylen, off) < s) {
+			i++;
+		}
+		start = i;
+		while (i < last &&
+		    poptrie_route_bits(&routes[i], pt->pt_keylen, off) == s) {
+			i++;
+		}
+		error = poptrie_fill(pb, child++, depth + 1,
+		    off + POPTRIE_STRIDE, start, i, slots[s]);
+		if (error != 0) {
+			return error;
+		}
+	}
+	return 0;
+}
+
+static int
+poptrie_build(struct poptrie_build *pb, uint32_t nroutes)
+{
+	struct poptrie *pt = pb->pb_pt;
+	const struct poptrie_route *routes = pb->pb_routes;
+	uint32_t i, j, d, idx;
+	int error;
+
+	for (d = 0; d < POPTRIE_DIRSIZE; d++) {
+		pt->pt_dir[d] = POPTRIE_DIR_LEAF | POPTRIE_NOROUTE;
+	}
+	for (unsigned int plen = 0; plen <= POPTRIE_DIRBITS; plen++) {
+		for (i = 0; i < nroutes; i++) {
+			if (routes[i].pr_plen != plen) {
+				continue;
+			}
+			d = (uint32_t)(routes[i].pr_key[0] << 8) | routes[i].pr_key[1];
+			for (uint32_t n = 1U << (POPTRIE_DIRBITS - plen); n > 0;
+			    n--, d++) {
+				pt->pt_dir[d] = POPTRIE_DIR_LEAF | routes[i].pr_value;
+			}
+		}
+	}
+
+	for (i = 0; i < nroutes; i = j) {
+		bool longer = false;
+
+		d = (uint32_t)(routes[i].pr_key[0] << 8) | routes[i].pr_key[1];
+		for (j = i; j < nroutes &&
+		    ((uint32_t)(routes[j].pr_key[0] << 8) | routes[j].pr_key[1]) == d;
+		    j++) {
+			longer |= (routes[j].pr_plen > POPTRIE_DIRBITS);
+		}
+		if (!longer) {
+			continue;
+		}
+		if ((error = poptrie_alloc_nodes(pt, 1, &idx)) != 0 ||
+		    (error = poptrie_fill(pb, idx, 0, POPTRIE_DIRBITS, i, j,
+		    pt->pt_dir[d] & ~POPTRIE_DIR_LEAF)) != 0) {
+			return error;
+		}
+		pt->pt_dir[d] = idx;
+	}
+	return 0;
+}
+
+struct poptrie *
+poptrie_create(struct poptrie_route *routes, uint32_t nroutes, uint8_t keylen)
+{
+	struct poptrie_build *pb = NULL;
+	struct poptrie *pt;
+	uint32_t i;
+	int error;
+
+	if (keylen != 4 && keylen != POPTRIE_KEYLEN_MAX) {
+		return NULL;
+	}
+	/* Validate and clear the bits past the prefix length */
+	for (i = 0; i < nroutes; i++) {
+		struct poptrie_route *r = &routes[i];
+		unsigned int b;
+
+		if (r->pr_plen > keylen * 8 || r->pr_value == POPTRIE_NOROUTE ||
+		    r->pr_value > POPTRIE_MAXINDEX) {
+			return NULL;
+		}
+		for (b = r->pr_plen; b < POPTRIE_KEYLEN_MAX * 8; b++) {
+			r->pr_key[b / 8] &= (uint8_t)~(0x80 >> (b % 8));
+		}
+	}
+	qsort(routes, nroutes, sizeof(*routes), poptrie_route_cmp);
+
+	pt = POPTRIE_ALLOC(sizeof(*pt));
+	if (pt == NULL) {
+		return NULL;
+	}
+	pt->pt_keylen = keylen;
+	pt->pt_dir = POPTRIE_ALLOC(POPTRIE_DIRSIZE * sizeof(uint32_t));
+	pb = POPTRIE_ALLOC(sizeof(*pb));
+	if (pt->pt_dir == NULL || pb == NULL) {
+		error = ENOMEM;
+		goto done;
+	}
+	pb->pb_pt = pt;
+	pb->pb_routes = routes;
+	error = poptrie_build(pb, nroutes);
+
+	/* Give back what the doubling allocations didn't use */
+	if (error == 0 && pt->pt_nodes_max > pt->pt_nnodes) {
+		void *p = POPTRIE_REALLOC(pt->pt_nodes,
+		    pt->pt_nodes_max * sizeof(struct poptrie_node),
+		    pt->pt_nnodes * sizeof(struct poptrie_node));
+		if (p != NULL || pt->pt_nnodes == 0) {
+			pt->pt_nodes = p;
+			pt->pt_nodes_max = pt->pt_nnodes;
+		}
+	}
+	if (error == 0 && pt->pt_leaves_max > pt->pt_nleaves) {
+		void *p = POPTRIE_REALLOC(pt->pt_leaves,
+		    pt->pt_leaves_max * sizeof(uint32_t),
+		    pt->pt_nleaves * sizeof(uint32_t));
+		if (p != NULL || pt->pt_nleaves == 0) {
+			pt->pt_leaves = p;
+			pt->pt_leaves_max = pt->pt_nleaves;
+		}
+	}
+done:
+	if (pb != NULL) {
+		POPTRIE_FREE(pb, sizeof(*pb));
+	}
+	if (error != 0) {
+		poptrie_destroy(pt);
+		pt = NULL;
+	}
+	return pt;
+}
+
+void
+poptrie_destroy(struct poptrie *pt)
+{
+	if (pt->pt_dir != NULL) {
+		POPTRIE_FREE(pt->pt_dir, POPTRIE_DIRSIZE * sizeof(uint32_t));
+	}
+	if (pt->pt_nodes != NULL) {
+		POPTRIE_FREE(pt->pt_nodes,
+		    pt->pt_nodes_max * sizeof(struct poptrie_node));
+	}
+	if (pt->pt_leaves != NULL) {
+		POPTRIE_FREE(pt->pt_leaves, pt->pt_leaves_max * sizeof(uint32_t));
+	}
+	POPTRIE_FREE(pt, sizeof(*pt));
+}
+
+size_t
+poptrie_size(const struct poptrie *pt)
+{
+	return sizeof(*pt) + POPTRIE_DIRSIZE * sizeof(uint32_t) +
+	       pt->pt_nodes_max * sizeof(struct poptrie_node) +
+	       pt->pt_leaves_max * sizeof(uint32_t);
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2025 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#ifndef _NET_POPTRIE_H_
+#define _NET_POPTRIE_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+
+/*
+ * Read-optimized longest prefix match table (Poptrie).
+ *
+ * The table is compiled once from a list of prefixes and is immutable
+ * afterwards, so lookups need no locking; callers publish a new table
+ * to replace it.  The top POPTRIE_DIRBITS bits of the key index a flat
+ * array, the remaining bits are consumed 6 at a time by nodes holding a
+ * 64-bit map of their children and a 64-bit map of where runs of equal
+ * leaves begin, both indexed with popcount.
+ */
+#define POPTRIE_KEYLEN_MAX      16      /* key bytes, enough for IPv6 */
+#define POPTRIE_NOROUTE         0       /* value of keys matching no prefix */
+
+struct poptrie_route {
+	uint8_t         pr_key[POPTRIE_KEYLEN_MAX];
+	uint8_t         pr_plen;        /* prefix length in bits */
+	uint32_t        pr_value;       /* non-zero, less than 2^31 */
+};
+
+struct poptrie;
+
+/*
+ * Compile routes into a table for keys of keylen bytes; the routes are
+ * sorted in place and prefixes must be unique.  Returns NULL on
+ * allocation failure or an invalid route.
+ */
+extern struct poptrie *poptrie_create(struct poptrie_route *routes,
+    uint32_t nroutes, uint8_t keylen);
+extern void poptrie_destroy(struct poptrie *);
+extern uint32_t poptrie_lookup(const struct poptrie *, const uint8_t *key);
+extern size_t poptrie_size(const struct poptrie *);
+
+#endif /* _NET_POPTRIE_H_ */
@@ -512,6 +512,8 @@ route_init(void)
 	rte_zone = zone_create(RTE_ZONE_NAME, size, ZC_NONE);
 
 	TAILQ_INIT(&rttrash_head);
+
+	rtfib_init();
 }
 
 /*
@@ -916,16 +918,53 @@ routegenid_update(void)
 	routegenid_inet6_update();
 }
 
+/*
+ * The compiled forwarding table is invalidated before the route
+ * generation moves, see rtfib_lookup().
+ */
 void
 routegenid_inet_update(void)
 {
-	os_atomic_inc(&route_genid_inet, relaxed);
+	rtfib_schedule(AF_INET);
+	os_atomic_inc(&route_genid_inet, release);
 }
 
 void
 routegenid_inet6_update(void)
 {
-	os_atomic_inc(&route_genid_inet6, relaxed);
+	rtfib_schedule(AF_INET6);
+	os_atomic_inc(&route_genid_inet6, release);
+}
+
+/*
+ * Route generation update for a route added, cloned or deleted by
+ * rtrequest.  Cloning a host route (e.g. the per destination routes
+ * of RTF_PRCLONING parents) or deleting one doesn't change what the
+ * compiled forwarding tables return for any other destination, so it
+ * leaves them current rather than rebuilding them on every connection:
+ * the parent is flagged instead, see rtfib_cloned().
+ */
+static void
+routegenid_rt_update(int af, struct rtentry *rt, int req)
+{
+	if (af != AF_INET && af != AF_INET6) {
+		return;
+	}
+	if ((rt->rt_flags & (RTF_WASCLONED | RTF_HOST)) !=
+	    (RTF_WASCLONED | RTF_HOST) ||
+	    (req != RTM_DELETE && (req != RTM_RESOLVE || rt->rt_parent == NULL))) {
+		if (af == AF_INET) {
+			routegenid_inet_update();
+		} else {
+			routegenid_inet6_update();
+		}
+		return;
+	}
+	if (req == RTM_RESOLVE) {
+		rtfib_cloned(rt->rt_parent);
+	}
+	os_atomic_inc(af == AF_INET ? &route_genid_inet : &route_genid_inet6,
+	    release);
 }
 
 /*
@@ -969,6 +1008,11 @@ void
 rtalloc_ign(struct route *ro, uint32_t ignore)
 {
 	LCK_MTX_ASSERT(rnh_lock, LCK_MTX_ASSERT_NOTOWNED);
+	/* Try the compiled forwarding table first */
+	if (ro->ro_rt == NULL &&
+	    (ro->ro_rt = rtfib_lookup(SA(&ro->ro_dst), ignore)) != NULL) {
+		return;
+	}
 	lck_mtx_lock(rnh_lock);
 	rtalloc_ign_common_locked(ro, ignore, IFSCOPE_NONE);
 	lck_mtx_unlock(rnh_lock);
@@ -978,6 +1022,10 @@ void
 rtalloc_scoped_ign(struct route *ro, uint32_t ignore, unsigned int ifscope)
 {
 	LCK_MTX_ASSERT(rnh_lock, LCK_MTX_ASSERT_NOTOWNED);
+	if (ifscope == IFSCOPE_NONE && ro->ro_rt == NULL &&
+	    (ro->ro_rt = rtfib_lookup(SA(&ro->ro_dst), ignore)) != NULL) {
+		return;
+	}
 	lck_mtx_lock(rnh_lock);
 	rtalloc_ign_common_locked(ro, ignore, ifscope);
 	lck_mtx_unlock(rnh_lock);
@@ -2153,6 +2201,9 @@ rtrequest_common_locked(int req, struct sockaddr *dst0,
 
 		RT_UNLOCK(rt);
 
+		/* before the last reference to rt may go away below */
+		routegenid_rt_update(af, rt, req);
+
 		/*
 		 * This might result in another rtentry being freed if
 		 * we held its last reference.  Do this after the rtentry
@@ -2175,11 +2226,6 @@ rtrequest_common_locked(int req, struct sockaddr *dst0,
 			/* Dereference or deallocate the route */
 			rtfree_locked(rt);
 		}
-		if (af == AF_INET) {
-			routegenid_inet_update();
-		} else if (af == AF_INET6) {
-			routegenid_inet6_update();
-		}
 		break;
 	}
 	case RTM_RESOLVE:
@@ -2500,11 +2546,7 @@ makeroute:
 			RT_ADDREF_LOCKED(rt);
 		}
 
-		if (af == AF_INET) {
-			routegenid_inet_update();
-		} else if (af == AF_INET6) {
-			routegenid_inet6_update();
-		}
+		routegenid_rt_update(af, rt, req);
 
 		RT_GENID_SYNC(rt);
 
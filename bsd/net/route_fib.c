@@ -0,0 +1,693 @@
+/*
+ * Copyright (c) 2025 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Compiled forwarding tables for the unscoped rtalloc() fast path.
+ *
+ * The radix trees in rt_tables[] remain the routing tables; every change
+ * to them bumps route_genid_inet/route_genid_inet6, and all but cloning
+ * or deleting a host route also invalidate the corresponding table here
+ * and schedule its rebuild.  A rebuild snapshots the tree under rnh_lock,
+ * resolves each prefix exactly as an unscoped rt_lookup() would
+ * (including the primary interface scoping rules) and compiles the
+ * results into a poptrie, which is published with SMR.
+ *
+ * Lookups use the table only while it is current; anything the table
+ * can't answer by itself (cloning routes, cloned entries, misses, scoped
+ * destinations) goes to the radix tree as before.
+ *
+ * Cloned host routes are kept out of the invalidation: the table only
+ * returns a cloning parent to callers ignoring its cloning flags, and
+ * a clone made after the build is the better match for its destination.
+ * rtfib_cloned() stamps the parent, and the table doesn't return a
+ * parent cloned from since it was built.  Deleting a clone makes the
+ * radix tree return the parent again, which the table already does or
+ * defers to the tree for.
+ */
+
+#include <sys/param.h>
+#include <sys/systm.h>
+#include <sys/kernel.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <kern/kalloc.h>
+#include <kern/locks.h>
+#include <kern/smr.h>
+#include <kern/thread_call.h>
+
+#include <net/if.h>
+#include <net/radix.h>
+#include <net/route.h>
+#include <net/poptrie.h>
+#include <net/sockaddr_utils.h>
+
+#include <netinet/in.h>
+
+#include <os/log.h>
+
+extern void qsort(void *a, size_t n, size_t es,
+    int (*cmp)(const void *, const void *));
+
+#define smr_rtfib               smr_system
+#define smr_rtfib_enter()       smr_enter(&smr_rtfib)
+#define smr_rtfib_leave()       smr_leave(&smr_rtfib)
+#define smr_rtfib_synchronize() smr_synchronize(&smr_rtfib)
+
+/* Value of prefixes that have to be looked up in the radix tree */
+#define RTFIB_SLOWPATH          0x7fffffff
+
+struct rtfib {
+	struct poptrie  *rf_trie;
+	uint32_t        rf_genid;       /* rtfib_genid it was built from */
+	uint64_t        rf_clonegen;    /* rtfib_clonegen it was built from */
+	unsigned int    rf_primary;     /* primary ifscope it was built with */
+	uint32_t        rf_nroutes;
+	rtentry_ref_t   rf_routes[] __counted_by(rf_nroutes);
+};
+
+#define RTFIB_INET              0
+#define RTFIB_INET6             1
+#define RTFIB_IDX(af)           ((af) == AF_INET ? RTFIB_INET : RTFIB_INET6)
+
+static SMR_POINTER(struct rtfib *) rtfib_tables[2];
+
+/*
+ * Route as seen by the rebuild; re_rt holds a reference if and only if
+ * RTFIB_ENT_USABLE is set.
+ */
+struct rtfib_ent {
+	rtentry_ref_t   re_rt;
+	uint8_t         re_addr[POPTRIE_KEYLEN_MAX];    /* masked */
+	uint8_t         re_plen;
+	uint8_t         re_flags;
+	unsigned int    re_scope;       /* scope of the key */
+	unsigned int    re_ifindex;     /* rt_ifp */
+};
+
+#define RTFIB_ENT_USABLE        0x01    /* may be returned by the fast path */
+#define RTFIB_ENT_IFSCOPE       0x02    /* RTF_IFSCOPE */
+#define RTFIB_ENT_LOCAL         0x04    /* on loopback, not RTF_GATEWAY */
+#define RTFIB_ENT_HOST          0x08    /* RTF_HOST */
+#define RTFIB_ENT_DEFAULT       0x10    /* key is the unspecified address */
+
+/* Prefixes nest at most once per prefix length */
+#define RTFIB_DEPTH_MAX         (POPTRIE_KEYLEN_MAX * NBBY + 1)
+
+struct rtfib_build {
+	int                     rb_af;
+	uint8_t                 rb_keylen;
+	bool                    rb_error;
+	uint32_t                rb_count;
+	uint32_t                rb_max;
+	struct rtfib_ent        *rb_ents;
+	const struct rtfib_ent  *rb_default;    /* node_lookup_default() */
+	/* prefixes containing the current one, as ranges of rb_ents */
+	uint32_t                rb_depth;
+	uint32_t                rb_start[RTFIB_DEPTH_MAX];
+	uint32_t                rb_end[RTFIB_DEPTH_MAX];
+};
+
+static thread_call_t rtfib_tcall;
+static uint32_t rtfib_pending;
+static uint32_t rtfib_genid[2];
+static uint64_t rtfib_clonegen;         /* protected by rnh_lock */
+
+#define RTFIB_PENDING(af)       (1u << RTFIB_IDX(af))
+
+static int rtfib_enabled = 1;
+static unsigned int rtfib_delay = 10;   /* msec */
+
+static int sysctl_rtfib_enabled SYSCTL_HANDLER_ARGS;
+
+SYSCTL_DECL(_net_route);
+SYSCTL_PROC(_net_route, OID_AUTO, fib,
+    CTLTYPE_INT | CTLFLAG_LOCKED | CTLFLAG_RW,
+    &rtfib_enabled, 0, sysctl_rtfib_enabled, "I",
+    "Use compiled forwarding tables for unscoped route lookups");
+SYSCTL_UINT(_net_route, OID_AUTO, fib_delay,
+    CTLFLAG_RW | CTLFLAG_LOCKED, &rtfib_delay, 0,
+    "Delay in msec before rebuilding a forwarding table");
+
+static void rtfib_update(thread_call_param_t, thread_call_param_t);
+
+void
+rtfib_init(void)
+{
+	rtfib_tcall = thread_call_allocate_with_options(rtfib_update, NULL,
+	    THREAD_CALL_PRIORITY_KERNEL, THREAD_CALL_OPTIONS_ONCE);
+}
+
+static void
+rtfib_schedule_pending(uint32_t bits)
+{
+	uint64_t deadline;
+
+	if ((os_atomic_or_orig(&rtfib_pending, bits, relaxed) & bits) == bits) {
+		return;
+	}
+	clock_interval_to_deadline(rtfib_delay, NSEC_PER_MSEC, &deadline);
+	thread_call_enter_delayed(rtfib_tcall, deadline);
+}
+
+/*
+ * Called for every route change of af that may change what its table
+ * returns: the table stops being used right away, and rebuilds are
+ * coalesced over rtfib_delay.
+ */
+void
+rtfib_schedule(int af)
+{
+	os_atomic_inc(&rtfib_genid[RTFIB_IDX(af)], relaxed);
+	if (!rtfib_enabled || rtfib_tcall == NULL) {
+		return;
+	}
+	rtfib_schedule_pending(RTFIB_PENDING(af));
+}
+
+/*
+ * A host route was just cloned from parent, see the comment at the top.
+ */
+void
+rtfib_cloned(struct rtentry *parent)
+{
+	LCK_MTX_ASSERT(rnh_lock, LCK_MTX_ASSERT_OWNED);
+
+	os_atomic_store(&parent->rt_fib_clonegen, ++rtfib_clonegen, relaxed);
+}
+
+static int
+sysctl_rtfib_enabled SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2)
+	int error, value = rtfib_enabled;
+
+	error = sysctl_handle_int(oidp, &value, 0, req);
+	if (error || req->newptr == USER_ADDR_NULL) {
+		return error;
+	}
+	rtfib_enabled = (value != 0);
+	/* build or retire both tables */
+	if (rtfib_tcall != NULL) {
+		rtfib_schedule_pending(RTFIB_PENDING(AF_INET) |
+		    RTFIB_PENDING(AF_INET6));
+	}
+	return 0;
+}
+
+/*
+ * Prefix length of the address portion of a netmask, or -1 if it
+ * isn't contiguous.  Netmasks are trimmed of their trailing zeroes.
+ */
+static int
+rtfib_masklen(struct sockaddr *mask, size_t off, size_t alen)
+{
+	const uint8_t *m = (const uint8_t *)mask;
+	int plen = 0;
+	size_t i;
+
+	for (i = 0; i < alen && off + i < mask->sa_len; i++) {
+		uint8_t b = m[off + i];
+
+		if (b == 0xff) {
+			plen += NBBY;
+			continue;
+		}
+		b = (uint8_t)~b;
+		if ((b & (uint8_t)(b + 1)) != 0) {
+			return -1;
+		}
+		plen += __builtin_clz((unsigned int)b << 24);
+		for (i++; i < alen && off + i < mask->sa_len; i++) {
+			if (m[off + i] != 0) {
+				return -1;
+			}
+		}
+		break;
+	}
+	return plen;
+}
+
+static int
+rtfib_walk_count(struct radix_node *rn, void *arg)
+{
+#pragma unused(rn)
+	struct rtfib_build *rb = arg;
+
+	rb->rb_max++;
+	return 0;
+}
+
+static int
+rtfib_walk_collect(struct radix_node *rn, void *arg)
+{
+	struct rtfib_build *rb = arg;
+	rtentry_ref_t rt = RT(rn);
+	struct sockaddr *key = rt_key(rt), *mask = rt_mask(rt);
+	struct rtfib_ent *re;
+	size_t off, i;
+	int plen;
+
+	if (rb->rb_count == rb->rb_max) {
+		rb->rb_error = true;
+		return EINVAL;
+	}
+	if (rb->rb_af == AF_INET) {
+		off = offsetof(struct sockaddr_in, sin_addr);
+	} else {
+		off = offsetof(struct sockaddr_in6, sin6_addr);
+	}
+	plen = (mask == NULL) ? rb->rb_keylen * NBBY :
+	    rtfib_masklen(mask, off, rb->rb_keylen);
+	if (plen < 0 || key->sa_len < off + rb->rb_keylen) {
+		rb->rb_error = true;
+		return EINVAL;
+	}
+
+	re = &rb->rb_ents[rb->rb_count++];
+	re->re_rt = rt;
+	re->re_plen = (uint8_t)plen;
+	re->re_scope = (rb->rb_af == AF_INET) ?
+	    sin_get_ifscope(key) : sin6_get_ifscope(key);
+	bcopy((const uint8_t *)key + off, re->re_addr, rb->rb_keylen);
+	for (i = 0; i < rb->rb_keylen; i++) {
+		if (plen >= NBBY * (int)(i + 1)) {
+			continue;
+		}
+		re->re_addr[i] &= (plen > NBBY * (int)i) ?
+		    (uint8_t)(0xff << (NBBY * (i + 1) - plen)) : 0;
+	}
+
+	RT_LOCK_SPIN(rt);
+	if (rt->rt_ifp != NULL) {
+		re->re_ifindex = rt->rt_ifp->if_index;
+		if ((rt->rt_ifp->if_flags & IFF_LOOPBACK) &&
+		    !(rt->rt_flags & RTF_GATEWAY)) {
+			re->re_flags |= RTFIB_ENT_LOCAL;
+		}
+	}
+	if (rt->rt_flags & RTF_IFSCOPE) {
+		re->re_flags |= RTFIB_ENT_IFSCOPE;
+	}
+	if (rt->rt_flags & RTF_HOST) {
+		re->re_flags |= RTFIB_ENT_HOST;
+	}
+	/*
+	 * Cloned, learned and expiring routes are left to the radix tree,
+	 * as holding a reference on them would keep them from expiring.
+	 */
+	if ((rt->rt_flags & (RTF_UP | RTF_CONDEMNED)) == RTF_UP &&
+	    !(rt->rt_flags & (RTF_WASCLONED | RTF_DYNAMIC | RTF_LLINFO |
+	    RTPRF_OURS)) && rt->rt_ifp != NULL) {
+		re->re_flags |= RTFIB_ENT_USABLE;
+		RT_ADDREF_LOCKED(rt);
+	}
+	RT_UNLOCK(rt);
+
+	for (i = 0; i < rb->rb_keylen && re->re_addr[i] == 0; i++) {
+		;
+	}
+	if (i == rb->rb_keylen) {
+		re->re_flags |= RTFIB_ENT_DEFAULT;
+	}
+	return 0;
+}
+
+static int
+rtfib_ent_cmp(const void *a, const void *b)
+{
+	const struct rtfib_ent *ra = a, *rb = b;
+	int cmp;
+
+	cmp = memcmp(ra->re_addr, rb->re_addr, sizeof(ra->re_addr));
+	if (cmp == 0) {
+		cmp = (int)ra->re_plen - (int)rb->re_plen;
+	}
+	return cmp;
+}
+
+/* Whether the prefix of a contains the (longer) prefix of b */
+static bool
+rtfib_ent_contains(const struct rtfib_ent *a, const struct rtfib_ent *b)
+{
+	unsigned int full = a->re_plen / NBBY, rem = a->re_plen % NBBY;
+
+	if (a->re_plen >= b->re_plen ||
+	    memcmp(a->re_addr, b->re_addr, full) != 0) {
+		return false;
+	}
+	return rem == 0 ||
+	       ((a->re_addr[full] ^ b->re_addr[full]) >> (NBBY - rem)) == 0;
+}
+
+/*
+ * Longest of the current nested prefixes with a route of the given
+ * scope, as node_lookup() finds it.
+ */
+static const struct rtfib_ent *
+rtfib_match(const struct rtfib_build *rb, unsigned int ifscope)
+{
+	uint32_t d, i;
+
+	for (d = rb->rb_depth; d-- > 0;) {
+		for (i = rb->rb_start[d]; i < rb->rb_end[d]; i++) {
+			const struct rtfib_ent *re = &rb->rb_ents[i];
+
+			if (ifscope == IFSCOPE_NONE ?
+			    re->re_scope == IFSCOPE_NONE :
+			    (re->re_scope == ifscope &&
+			    (re->re_flags & RTFIB_ENT_IFSCOPE))) {
+				return re;
+			}
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Route an unscoped rt_lookup() returns for destinations within the
+ * innermost current prefix; mirrors rt_lookup_common().
+ */
+static const struct rtfib_ent *
+rtfib_resolve(const struct rtfib_build *rb, unsigned int primary)
+{
+	const struct rtfib_ent *re0, *re;
+	unsigned int ifscope = primary;
+
+	re = re0 = rtfib_match(rb, IFSCOPE_NONE);
+	if (re0 != NULL && !(re0->re_flags & RTFIB_ENT_LOCAL)) {
+		if (re0->re_ifindex != ifscope) {
+			re = NULL;
+			ifscope = re0->re_ifindex;
+		} else if (!(re0->re_flags & RTFIB_ENT_IFSCOPE)) {
+			re = NULL;
+		}
+	}
+	if (re == NULL) {
+		re = rtfib_match(rb, ifscope);
+	}
+	if (re == NULL || (re0 != NULL &&
+	    (((re->re_flags & RTFIB_ENT_DEFAULT) &&
+	    !(re0->re_flags & RTFIB_ENT_DEFAULT)) ||
+	    (!(re->re_flags & RTFIB_ENT_HOST) &&
+	    (re0->re_flags & RTFIB_ENT_HOST))))) {
+		re = re0;
+	}
+	if (re == NULL && rb->rb_default != NULL &&
+	    rb->rb_default->re_ifindex == ifscope) {
+		re = rb->rb_default;
+	}
+	return re;
+}
+
+/*
+ * Compile the snapshot into a table; the references held by the
+ * snapshot move to the table.
+ */
+static struct rtfib *
+rtfib_compile(struct rtfib_build *rb, uint32_t genid, uint64_t clonegen,
+    unsigned int primary)
+{
+	struct poptrie_route *routes = NULL;
+	struct rtfib *fib;
+	uint32_t n = rb->rb_count, nroutes = 0, i, j;
+
+	qsort(rb->rb_ents, n, sizeof(*rb->rb_ents), rtfib_ent_cmp);
+
+	fib = kalloc_type(struct rtfib, rtentry_ref_t, n, Z_WAITOK | Z_ZERO);
+	if (fib == NULL) {
+		return NULL;
+	}
+	fib->rf_nroutes = n;
+	fib->rf_genid = genid;
+	fib->rf_clonegen = clonegen;
+	fib->rf_primary = primary;
+	for (i = 0; i < n; i++) {
+		if (rb->rb_ents[i].re_flags & RTFIB_ENT_USABLE) {
+			fib->rf_routes[i] = rb->rb_ents[i].re_rt;
+		}
+	}
+
+	/* node_lookup_default() matches the unspecified address */
+	for (i = 0; i < n; i++) {
+		const struct rtfib_ent *re = &rb->rb_ents[i];
+
+		if (!(re->re_flags & RTFIB_ENT_DEFAULT)) {
+			break;
+		}
+		if (re->re_scope == IFSCOPE_NONE) {
+			rb->rb_default = re;
+		}
+	}
+
+	if (n > 0) {
+		routes = kalloc_data(n * sizeof(*routes), Z_WAITOK | Z_ZERO);
+		if (routes == NULL) {
+			goto done;
+		}
+	}
+	rb->rb_depth = 0;
+	for (i = 0; i < n; i = j) {
+		const struct rtfib_ent *re;
+
+		for (j = i + 1; j < n &&
+		    rtfib_ent_cmp(&rb->rb_ents[i], &rb->rb_ents[j]) == 0; j++) {
+			;
+		}
+		while (rb->rb_depth > 0 && !rtfib_ent_contains(
+			    &rb->rb_ents[rb->rb_start[rb->rb_depth - 1]],
+			    &rb->rb_ents[i])) {
+			rb->rb_depth--;
+		}
+		VERIFY(rb->rb_depth < RTFIB_DEPTH_MAX);
+		rb->rb_start[rb->rb_depth] = i;
+		rb->rb_end[rb->rb_depth] = j;
+		rb->rb_depth++;
+
+		re = rtfib_resolve(rb, primary);
+		bcopy(rb->rb_ents[i].re_addr, routes[nroutes].pr_key,
+		    sizeof(routes[nroutes].pr_key));
+		routes[nroutes].pr_plen = rb->rb_ents[i].re_plen;
+		routes[nroutes].pr_value =
+		    (re != NULL && (re->re_flags & RTFIB_ENT_USABLE)) ?
+		    (uint32_t)(re - rb->rb_ents) + 1 : RTFIB_SLOWPATH;
+		nroutes++;
+	}
+	fib->rf_trie = poptrie_create(routes, nroutes, rb->rb_keylen);
+
+done:
+	if (routes != NULL) {
+		kfree_data(routes, n * sizeof(*routes));
+	}
+	return fib;
+}
+
+static void
+rtfib_free(struct rtfib *fib)
+{
+	uint32_t i;
+
+	lck_mtx_lock(rnh_lock);
+	for (i = 0; i < fib->rf_nroutes; i++) {
+		if (fib->rf_routes[i] != NULL) {
+			rtfree_locked(fib->rf_routes[i]);
+		}
+	}
+	lck_mtx_unlock(rnh_lock);
+	if (fib->rf_trie != NULL) {
+		poptrie_destroy(fib->rf_trie);
+	}
+	kfree_type(struct rtfib, rtentry_ref_t, fib->rf_nroutes, fib);
+}
+
+static void
+rtfib_rebuild(int af)
+{
+	struct rtfib_build *rb = NULL;
+	struct rtfib *fib = NULL, *ofib;
+	struct radix_node_head *rnh;
+	uint32_t genid = 0, i;
+	uint64_t clonegen = 0;
+	unsigned int primary = IFSCOPE_NONE;
+
+	if (rtfib_enabled) {
+		rb = kalloc_type(struct rtfib_build, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+		rb->rb_af = af;
+		rb->rb_keylen = (af == AF_INET) ? sizeof(struct in_addr) :
+		    sizeof(struct in6_addr);
+
+		lck_mtx_lock(rnh_lock);
+		genid = os_atomic_load(&rtfib_genid[RTFIB_IDX(af)], relaxed);
+		clonegen = rtfib_clonegen;
+		primary = get_primary_ifscope(af);
+		if ((rnh = rt_tables[af]) != NULL) {
+			(void) rnh->rnh_walktree(rnh, rtfib_walk_count, rb);
+			if (rb->rb_max > 0) {
+				rb->rb_ents = kalloc_data(rb->rb_max *
+				    sizeof(*rb->rb_ents), Z_WAITOK | Z_ZERO);
+			}
+			if (rb->rb_ents != NULL) {
+				(void) rnh->rnh_walktree(rnh,
+				    rtfib_walk_collect, rb);
+			}
+		}
+		lck_mtx_unlock(rnh_lock);
+
+		if (!rb->rb_error && rb->rb_max == rb->rb_count) {
+			fib = rtfib_compile(rb, genid, clonegen, primary);
+			if (fib != NULL && fib->rf_trie == NULL) {
+				rtfib_free(fib);
+				fib = NULL;
+			}
+		} else {
+			lck_mtx_lock(rnh_lock);
+			for (i = 0; i < rb->rb_count; i++) {
+				if (rb->rb_ents[i].re_flags & RTFIB_ENT_USABLE) {
+					rtfree_locked(rb->rb_ents[i].re_rt);
+				}
+			}
+			lck_mtx_unlock(rnh_lock);
+		}
+	}
+
+	ofib = smr_serialized_load(&rtfib_tables[RTFIB_IDX(af)]);
+	smr_serialized_store(&rtfib_tables[RTFIB_IDX(af)], fib);
+	if (ofib != NULL) {
+		smr_rtfib_synchronize();
+		rtfib_free(ofib);
+	}
+
+	if (rb != NULL) {
+		if (fib == NULL && rtfib_enabled) {
+			os_log(OS_LOG_DEFAULT, "%s: af %d: %u routes not "
+			    "compiled\n", __func__, af, rb->rb_count);
+		}
+		if (rb->rb_ents != NULL) {
+			kfree_data(rb->rb_ents, rb->rb_max * sizeof(*rb->rb_ents));
+		}
+		kfree_type(struct rtfib_build, rb);
+	}
+}
+
+static void
+rtfib_update(thread_call_param_t arg0, thread_call_param_t arg1)
+{
+#pragma unused(arg0, arg1)
+	uint32_t pending = os_atomic_xchg(&rtfib_pending, 0, relaxed);
+
+	if (pending & RTFIB_PENDING(AF_INET)) {
+		rtfib_rebuild(AF_INET);
+	}
+	if (pending & RTFIB_PENDING(AF_INET6)) {
+		rtfib_rebuild(AF_INET6);
+	}
+}
+
+/*
+ * Unscoped lookup of dst in the compiled table of its family; returns the
+ * route with a reference held and its generation ID synchronized, or NULL
+ * if the caller must look it up in the radix tree.
+ */
+struct rtentry *
+rtfib_lookup(struct sockaddr *dst, uint32_t ignflags)
+{
+	const uint8_t *key;
+	struct rtfib *fib;
+	rtentry_ref_t rt = NULL;
+	uint32_t genid, v;
+
+	/*
+	 * Only plain destinations: rt_lookup() takes the scope of dst from
+	 * its scope ID, and host route keys are compared in full.
+	 */
+	if (dst->sa_family == AF_INET) {
+		struct sockaddr_in *sin = SIN(dst);
+		uint64_t zero;
+
+		bcopy(sin->sin_zero, &zero, sizeof(zero));
+		if (sin->sin_len < sizeof(*sin) || sin->sin_port != 0 ||
+		    zero != 0) {
+			return NULL;
+		}
+		key = (const uint8_t *)&sin->sin_addr;
+		genid = os_atomic_load(&route_genid_inet, acquire);
+	} else if (dst->sa_family == AF_INET6) {
+		struct sockaddr_in6 *sin6 = SIN6(dst);
+
+		if (sin6->sin6_len < sizeof(*sin6) || sin6->sin6_port != 0 ||
+		    sin6->sin6_flowinfo != 0 || sin6->sin6_scope_id != 0 ||
+		    IN6_IS_SCOPE_EMBED(&sin6->sin6_addr)) {
+			return NULL;
+		}
+		key = (const uint8_t *)&sin6->sin6_addr;
+		genid = os_atomic_load(&route_genid_inet6, acquire);
+	} else {
+		return NULL;
+	}
+
+	/*
+	 * The table is invalidated before the route generation moves: if
+	 * it is still current, genid is at least as recent as the table.
+	 */
+	smr_rtfib_enter();
+	fib = smr_entered_load(&rtfib_tables[RTFIB_IDX(dst->sa_family)]);
+	if (fib != NULL && fib->rf_genid ==
+	    os_atomic_load(&rtfib_genid[RTFIB_IDX(dst->sa_family)], relaxed) &&
+	    fib->rf_primary == get_primary_ifscope(dst->sa_family) &&
+	    (v = poptrie_lookup(fib->rf_trie, key)) != POPTRIE_NOROUTE &&
+	    v != RTFIB_SLOWPATH) {
+		/*
+		 * The table holds a reference until readers are done with it;
+		 * preemption is disabled, so don't wait for the route lock.
+		 */
+		rtentry_ref_t frt = fib->rf_routes[v - 1];
+
+		if (lck_mtx_try_lock_spin(&frt->rt_lock)) {
+			/*
+			 * A parent cloned from since the build may have a
+			 * better matching clone in the tree.
+			 */
+			if ((frt->rt_flags & (RTF_UP | RTF_CONDEMNED)) == RTF_UP &&
+			    frt->rt_ifp != NULL && !((frt->rt_flags & ~ignflags) &
+			    (RTF_CLONING | RTF_PRCLONING)) &&
+			    (!(frt->rt_flags & (RTF_CLONING | RTF_PRCLONING)) ||
+			    os_atomic_load(&frt->rt_fib_clonegen, relaxed) <=
+			    fib->rf_clonegen)) {
+				RT_ADDREF_LOCKED(frt);
+				/* current as of the route generation read above */
+				if (frt->rt_tree_genid != NULL) {
+					frt->rt_genid = genid;
+				}
+				rt = frt;
+			}
+			lck_mtx_unlock(&frt->rt_lock);
+		}
+	}
+	smr_rtfib_leave();
+
+	return rt;
+}
@@ -184,6 +184,7 @@ struct rtentry {
 	void (*rt_if_ref_fn)(struct ifnet *, int); /* interface ref func */
 
 	uint32_t *rt_tree_genid;        /* ptr to per-tree route_genid */
+	uint64_t rt_fib_clonegen;       /* last cloned from, see route_fib.c */
 	uint64_t rt_expire;             /* expiration time in uptime seconds */
 	uint64_t base_calendartime;     /* calendar time upon entry creation */
 	uint64_t base_uptime;           /* uptime upon entry creation */
@@ -463,6 +464,10 @@ extern struct rtentry *rtalloc1_scoped(struct sockaddr *, int, uint32_t,
     unsigned int);
 extern struct rtentry *rtalloc1_scoped_locked(struct sockaddr *, int,
     uint32_t, unsigned int);
+extern void rtfib_init(void);
+extern void rtfib_schedule(int);
+extern void rtfib_cloned(struct rtentry *);
+extern struct rtentry *rtfib_lookup(struct sockaddr *, uint32_t);
 extern void rtfree_locked(struct rtentry *);
 extern void rtfree(struct rtentry *);
 extern void rtref(struct rtentry *);
@@ -106,6 +106,7 @@
 
 #include <netinet/ip6.h>
 #include <netinet6/ip6_var.h>
+#include <netinet6/scope6_var.h>
 
 #include <sys/kdebug.h>
 #include <sys/random.h>
@@ -155,6 +156,24 @@ static void inpcb_sched_timeout(void);
 static void inpcb_sched_lazy_timeout(void);
 static void _inpcb_sched_timeout(unsigned int);
 static void inpcb_timeout(void *, void *);
+static boolean_t _inp_restricted_recv(struct inpcb *, struct ifnet *);
+static void in_pcb_smr_rehash(struct inpcb *, bool);
+static void in_pcb_smr_resize(thread_call_param_t, thread_call_param_t);
+static void in_pcb_smr_free(smr_node_t);
+
+SMR_DEFINE(smr_inpcb, "inpcb");
+
+/*
+ * ipi_smr_hash starts out, and never shrinks below, the size of
+ * ipi_hashbase as long as that is a safe allocation size.
+ */
+static inline uint32_t
+inp_smr_hash_min_size(struct inpcbinfo *ipi)
+{
+	return (uint32_t)MIN(ipi->ipi_hashbase_count,
+	           KALLOC_SAFE_ALLOC_SIZE / sizeof(struct smrq_slist_head));
+}
+
 const int inpcb_timeout_lazy = 10;      /* 10 seconds leeway for lazy timers */
 extern int tvtohz(struct timeval *);
 
@@ -570,6 +589,18 @@ in_pcbinfo_attach(struct inpcbinfo *ipi)
 	}
 	TAILQ_INSERT_TAIL(&inpcb_head, ipi, ipi_entry);
 	lck_mtx_unlock(&inpcb_lock);
+
+	if (ipi->ipi_flags & INPCBINFO_SMR_HASH) {
+		lck_mtx_init(&ipi->ipi_smr_lock, ipi->ipi_lock_grp,
+		    &ipi->ipi_lock_attr);
+		smr_hash_init(&ipi->ipi_smr_hash, inp_smr_hash_min_size(ipi));
+		ipi->ipi_smr_resize_tcall = thread_call_allocate_with_options(
+			in_pcb_smr_resize, ipi, THREAD_CALL_PRIORITY_KERNEL,
+			THREAD_CALL_OPTIONS_ONCE);
+		if (ipi->ipi_smr_resize_tcall == NULL) {
+			panic("unable to alloc the inpcb smr resize thread call");
+		}
+	}
 }
 
 int
@@ -591,6 +622,16 @@ in_pcbinfo_detach(struct inpcbinfo *ipi)
 	}
 	lck_mtx_unlock(&inpcb_lock);
 
+	if (error == 0 && (ipi->ipi_flags & INPCBINFO_SMR_HASH)) {
+		thread_call_cancel_wait(ipi->ipi_smr_resize_tcall);
+		thread_call_free(ipi->ipi_smr_resize_tcall);
+		ipi->ipi_smr_resize_tcall = NULL;
+		/* pcbs still being freed via SMR refer to ipi */
+		smr_inpcb_barrier();
+		smr_hash_destroy(&ipi->ipi_smr_hash);
+		lck_mtx_destroy(&ipi->ipi_smr_lock, ipi->ipi_lock_grp);
+	}
+
 	return error;
 }
 
@@ -2177,6 +2218,19 @@ in_pcbdispose(struct inpcb *inp)
 		 * we deallocate the structure.
 		 */
 		ROUTE_RELEASE(&inp->inp_route);
+		if (inp->inp_flags2 & INP2_SMRHASHED) {
+			/*
+			 * Lockless lookups may still be looking at this pcb,
+			 * which can live inside the socket: tear the socket
+			 * down now, but keep the memory of both until they
+			 * are done.
+			 */
+			sodealloc_teardown(so);
+			inp->inp_smr_so = so;
+			smr_inpcb_call(&inp->inp_smr_node, sizeof(*inp),
+			    in_pcb_smr_free);
+			return;
+		}
 		if ((so->so_flags1 & SOF1_CACHED_IN_SOCK_LAYER) == 0) {
 			zfree(ipi->ipi_zone, inp);
 		}
@@ -2184,6 +2238,18 @@ in_pcbdispose(struct inpcb *inp)
 	}
 }
 
+static void
+in_pcb_smr_free(smr_node_t node)
+{
+	struct inpcb *inp = __container_of(node, struct inpcb, inp_smr_node);
+	struct socket *so = inp->inp_smr_so;
+
+	if ((so->so_flags1 & SOF1_CACHED_IN_SOCK_LAYER) == 0) {
+		zfree(inp->inp_pcbinfo->ipi_zone, inp);
+	}
+	sodealloc_free(so);
+}
+
 /*
  * The calling convention of in_getsockaddr() and in_getpeeraddr() was
  * modified to match the pru_sockaddr() and pru_peeraddr() entry points
@@ -2711,8 +2777,20 @@ in_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in_addr faddr,
     u_int fport_arg, struct in_addr laddr, u_int lport_arg, int wildcard,
     struct ifnet *ifp)
 {
+	struct inpcb_smr_key isk = {
+		.isk_faddr4 = faddr,
+		.isk_laddr4 = laddr,
+		.isk_fport  = (u_short)fport_arg,
+		.isk_lport  = (u_short)lport_arg,
+		.isk_vflag  = INP_IPV4,
+	};
 	struct inpcb *inp;
 
+	inp = in_pcblookup_hash_smr(pcbinfo, &isk, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	lck_rw_lock_shared(&pcbinfo->ipi_lock);
 
 	inp = in_pcblookup_hash_locked(pcbinfo, faddr, fport_arg, laddr,
@@ -2729,8 +2807,20 @@ in_pcblookup_hash_try(struct inpcbinfo *pcbinfo, struct in_addr faddr,
     u_int fport_arg, struct in_addr laddr, u_int lport_arg, int wildcard,
     struct ifnet *ifp)
 {
+	struct inpcb_smr_key isk = {
+		.isk_faddr4 = faddr,
+		.isk_laddr4 = laddr,
+		.isk_fport  = (u_short)fport_arg,
+		.isk_lport  = (u_short)lport_arg,
+		.isk_vflag  = INP_IPV4,
+	};
 	struct inpcb *inp;
 
+	inp = in_pcblookup_hash_smr(pcbinfo, &isk, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	if (!lck_rw_try_lock_shared(&pcbinfo->ipi_lock)) {
 		return NULL;
 	}
@@ -2743,6 +2833,211 @@ in_pcblookup_hash_try(struct inpcbinfo *pcbinfo, struct in_addr faddr,
 	return inp;
 }
 
+/*
+ * ipi_smr_hash only holds connected pcbs, hashed like ipi_hashbase on the
+ * foreign address and both ports, so that a hit is the exact match a
+ * locked lookup would have found first.  Wildcard matches and misses
+ * fall back to ipi_hashbase under ipi_lock; this also covers readers
+ * that miss a pcb because a concurrent rehash moved the one they were
+ * standing on to another chain.
+ *
+ * The tuple a pcb is hashed on is kept in inp_smr_key, as in_pcbdisconnect()
+ * clears the foreign address before taking ipi_lock.
+ */
+static inline uint64_t
+inp_smr_key_make(uint32_t faddr, u_short lport, u_short fport)
+{
+	return ((uint64_t)faddr << 32) | ((uint64_t)lport << 16) | fport;
+}
+
+static uint32_t
+inp_smr_key_hash(smrh_key_t key, uint32_t seed)
+{
+	const struct inpcb_smr_key *isk = key.smrk_opaque;
+	uint32_t faddr;
+
+	if (isk->isk_vflag == INP_IPV4) {
+		faddr = isk->isk_faddr4.s_addr;
+	} else {
+		faddr = isk->isk_faddr6.s6_addr32[3];
+	}
+	return smrh_key_hash_u64(SMRH_SCALAR_KEY(inp_smr_key_make(faddr,
+	           isk->isk_lport, isk->isk_fport)), seed);
+}
+
+static uint32_t
+inp_smr_obj_hash(const struct smrq_slink *link, uint32_t seed)
+{
+	const struct inpcb *inp;
+
+	inp = __container_of(link, const struct inpcb, inp_smr_link);
+	return smrh_key_hash_u64(SMRH_SCALAR_KEY(inp->inp_smr_key), seed);
+}
+
+static bool
+inp_smr_obj_equ(const struct smrq_slink *link, smrh_key_t key)
+{
+	const struct inpcb_smr_key *isk = key.smrk_opaque;
+	const struct inpcb *inp;
+
+	inp = __container_of(link, const struct inpcb, inp_smr_link);
+	if (inp->inp_fport != isk->isk_fport ||
+	    inp->inp_lport != isk->isk_lport) {
+		return false;
+	}
+	if (isk->isk_vflag == INP_IPV4) {
+		return (inp->inp_vflag & INP_IPV4) &&
+		       inp->inp_faddr.s_addr == isk->isk_faddr4.s_addr &&
+		       inp->inp_laddr.s_addr == isk->isk_laddr4.s_addr;
+	}
+	return (inp->inp_vflag & INP_IPV6) &&
+	       in6_are_addr_equal_scoped(&inp->in6p_faddr, &isk->isk_faddr6,
+	       inp->inp_fifscope, isk->isk_fifscope) &&
+	       in6_are_addr_equal_scoped(&inp->in6p_laddr, &isk->isk_laddr6,
+	       inp->inp_lifscope, isk->isk_lifscope);
+}
+
+SMRH_TRAITS_DEFINE(inpcb_smr_traits, struct inpcb, inp_smr_link,
+    .domain      = &smr_inpcb,
+    .key_hash    = inp_smr_key_hash,
+    .key_equ     = smrh_key_equ_mem,
+    .obj_hash    = inp_smr_obj_hash,
+    .obj_equ     = inp_smr_obj_equ);
+
+static bool
+inp_smr_hashable(struct inpcb *inp)
+{
+	if (inp->inp_lport == 0 || inp->inp_fport == 0) {
+		return false;
+	}
+	if (inp->inp_vflag & INP_IPV6) {
+		return !IN6_IS_ADDR_UNSPECIFIED(&inp->in6p_faddr);
+	}
+	return inp->inp_faddr.s_addr != INADDR_ANY;
+}
+
+/*
+ * Resizing ipi_smr_hash calls smr_synchronize(), which can't be done with
+ * ipi_lock or a socket lock held, so the rehash path only notices that
+ * the table is out of shape and leaves the work to this thread call.
+ */
+static bool
+inp_smr_should_resize(struct inpcbinfo *ipi)
+{
+	struct smr_hash *smrh = &ipi->ipi_smr_hash;
+
+	LCK_MTX_ASSERT(&ipi->ipi_smr_lock, LCK_MTX_ASSERT_OWNED);
+
+	/* grow if more than 1 element per bucket */
+	if (smr_hash_serialized_should_grow(smrh, 1, 1)) {
+		return true;
+	}
+	/* shrink if more than 4 buckets per element */
+	return smr_hash_serialized_should_shrink(smrh,
+	           inp_smr_hash_min_size(ipi), 4, 1);
+}
+
+static void
+in_pcb_smr_resize(thread_call_param_t arg0, __unused thread_call_param_t arg1)
+{
+	struct inpcbinfo *ipi = arg0;
+	struct smr_hash *smrh = &ipi->ipi_smr_hash;
+	kern_return_t kr = KERN_SUCCESS;
+
+	/*
+	 * Each pass only doubles or halves the table, keep going until
+	 * it matches the current population.
+	 */
+	while (kr == KERN_SUCCESS) {
+		lck_mtx_lock(&ipi->ipi_smr_lock);
+		if (smr_hash_serialized_should_grow(smrh, 1, 1)) {
+			kr = smr_hash_grow_and_unlock(smrh, &ipi->ipi_smr_lock,
+			    &inpcb_smr_traits);
+		} else if (smr_hash_serialized_should_shrink(smrh,
+		    inp_smr_hash_min_size(ipi), 4, 1)) {
+			kr = smr_hash_shrink_and_unlock(smrh,
+			    &ipi->ipi_smr_lock, &inpcb_smr_traits);
+		} else {
+			lck_mtx_unlock(&ipi->ipi_smr_lock);
+			break;
+		}
+	}
+}
+
+/*
+ * Move the pcb to the ipi_smr_hash chain for its current tuple, or just
+ * take it off the hash when it is no longer connected or `insert' is false.
+ * Must be called with the pcbinfo lock held in exclusive mode.
+ */
+static void
+in_pcb_smr_rehash(struct inpcb *inp, bool insert)
+{
+	struct inpcbinfo *ipi = inp->inp_pcbinfo;
+	struct smr_hash *smrh = &ipi->ipi_smr_hash;
+	bool resize;
+
+	if (!(ipi->ipi_flags & INPCBINFO_SMR_HASH)) {
+		return;
+	}
+
+	LCK_RW_ASSERT(&ipi->ipi_lock, LCK_RW_ASSERT_EXCLUSIVE);
+
+	lck_mtx_lock(&ipi->ipi_smr_lock);
+	if (inp->inp_flags2 & INP2_IN_SMRHASH) {
+		smr_hash_serialized_remove(smrh, &inp->inp_smr_link,
+		    &inpcb_smr_traits);
+		inp->inp_flags2 &= ~INP2_IN_SMRHASH;
+	}
+	if (insert && inp_smr_hashable(inp)) {
+		/* in6p_faddr's last word aliases inp_faddr */
+		inp->inp_smr_key = inp_smr_key_make(
+			inp->in6p_faddr.s6_addr32[3], inp->inp_lport,
+			inp->inp_fport);
+		smr_hash_serialized_insert(smrh, &inp->inp_smr_link,
+		    &inpcb_smr_traits);
+		inp->inp_flags2 |= (INP2_IN_SMRHASH | INP2_SMRHASHED);
+	}
+	resize = inp_smr_should_resize(ipi);
+	lck_mtx_unlock(&ipi->ipi_smr_lock);
+
+	if (resize) {
+		thread_call_enter(ipi->ipi_smr_resize_tcall);
+	}
+}
+
+/*
+ * Lockless lookup of a connected pcb by its exact tuple.
+ *
+ * Returns the pcb with a want reference held, or NULL in which case
+ * the caller must fall back to a lookup under the pcbinfo lock.
+ */
+struct inpcb *
+in_pcblookup_hash_smr(struct inpcbinfo *pcbinfo,
+    const struct inpcb_smr_key *isk, struct ifnet *ifp)
+{
+	smrh_key_t key = { .smrk_opaque = isk, .smrk_len = sizeof(*isk) };
+	struct inpcb *inp;
+
+	if (!(pcbinfo->ipi_flags & INPCBINFO_SMR_HASH)) {
+		return NULL;
+	}
+
+	smr_inpcb_enter();
+	inp = smr_hash_entered_find(&pcbinfo->ipi_smr_hash, key,
+	    &inpcb_smr_traits);
+	/*
+	 * NECP only filters listeners, so connected pcbs need no check;
+	 * restricted ones are left to the locked lookup to report.
+	 */
+	if (inp != NULL && (_inp_restricted_recv(inp, ifp) ||
+	    in_pcb_checkstate(inp, WNT_ACQUIRE, 0) == WNT_STOPUSING)) {
+		inp = NULL;
+	}
+	smr_inpcb_leave();
+
+	return inp;
+}
+
 /*
  * @brief	Insert PCB onto various hash lists.
  *
@@ -2852,6 +3147,7 @@ in_pcbinshash(struct inpcb *inp, struct sockaddr *remote, int locked)
 	LIST_INSERT_HEAD(&phd->phd_pcblist, inp, inp_portlist);
 	LIST_INSERT_HEAD(pcbhash, inp, inp_hash);
 	inp->inp_flags2 |= INP2_INHASHLIST;
+	in_pcb_smr_rehash(inp, true);
 
 	if (!locked) {
 		lck_rw_done(&pcbinfo->ipi_lock);
@@ -2932,6 +3228,7 @@ in_pcbrehash(struct inpcb *inp)
 	VERIFY(!(inp->inp_flags2 & INP2_INHASHLIST));
 	LIST_INSERT_HEAD(head, inp, inp_hash);
 	inp->inp_flags2 |= INP2_INHASHLIST;
+	in_pcb_smr_rehash(inp, true);
 
 #if NECP
 	// This call catches updates to the remote addresses
@@ -2961,6 +3258,7 @@ in_pcbremlists(struct inpcb *inp)
 		LIST_REMOVE(inp, inp_hash);
 		inp->inp_hash.le_next = NULL;
 		inp->inp_hash.le_prev = NULL;
+		in_pcb_smr_rehash(inp, false);
 
 		LIST_REMOVE(inp, inp_portlist);
 		inp->inp_portlist.le_next = NULL;
@@ -79,6 +79,7 @@
 #include <sys/bitstring.h>
 #include <sys/tree.h>
 #include <kern/locks.h>
+#include <kern/smr_hash.h>
 #include <kern/zalloc.h>
 #include <netinet/in_stat.h>
 #include <net/if_ports_used.h>
@@ -173,6 +174,10 @@ struct inpcb {
 	struct inpcbport *inp_phd;      /* head of this list */
 	inp_gen_t inp_gencnt;           /* generation count of this instance */
 	int     inp_hash_element;       /* array index of pcb's hash list */
+	struct smrq_slink inp_smr_link; /* ipi_smr_hash linkage */
+	uint64_t inp_smr_key;           /* tuple inp_smr_link is hashed on */
+	struct smr_node inp_smr_node;   /* deferred free for SMR readers */
+	struct socket *inp_smr_so;      /* socket freed along with the pcb */
 	int     inp_wantcnt;            /* wanted count; atomically updated */
 	int     inp_state;              /* state (INUSE/CACHED/DEAD) */
 	u_short inp_fport;              /* foreign port */
@@ -670,7 +675,48 @@ struct inpcbinfo {
 
 #define INPCBINFO_UPDATE_MSS    0x1
 #define INPCBINFO_HANDLE_LQM_ABORT      0x2
+#define INPCBINFO_SMR_HASH      0x4     /* ipi_smr_hash is in use */
 	u_int32_t               ipi_flags;
+
+	/*
+	 * Per-protocol hash of connected pcbs, hashed by foreign address
+	 * and port numbers, that can be looked up without ipi_lock.
+	 * Mutations hold ipi_lock exclusive and ipi_smr_lock; resizing
+	 * calls smr_synchronize() and is deferred to ipi_smr_resize_tcall.
+	 */
+	struct smr_hash         ipi_smr_hash;
+	lck_mtx_t               ipi_smr_lock;
+	thread_call_t           ipi_smr_resize_tcall;
+};
+
+/*
+ * SMR domain protecting lockless lookups in ipi_smr_hash; its own so
+ * that connection churn doesn't delay the reclamation of smr_system.
+ */
+extern struct smr smr_inpcb;
+#define smr_inpcb_enter()       smr_enter(&smr_inpcb)
+#define smr_inpcb_leave()       smr_leave(&smr_inpcb)
+#define smr_inpcb_call(n, sz, cb) smr_call(&smr_inpcb, n, sz, cb)
+#define smr_inpcb_barrier()     smr_barrier(&smr_inpcb)
+
+/*
+ * Exact tuple looked up in ipi_smr_hash; isk_vflag is either
+ * INP_IPV4 or INP_IPV6 and selects which address form is used.
+ */
+struct inpcb_smr_key {
+	union {
+		struct in_addr  isk_faddr4;
+		struct in6_addr isk_faddr6;
+	};
+	union {
+		struct in_addr  isk_laddr4;
+		struct in6_addr isk_laddr6;
+	};
+	uint32_t        isk_fifscope;
+	uint32_t        isk_lifscope;
+	u_short         isk_fport;
+	u_short         isk_lport;
+	u_char          isk_vflag;
 };
 
 #define INP_PCBHASH(faddr, lport, fport, mask) \
@@ -797,6 +843,8 @@ struct inpcbinfo {
 #define INP2_LAST_ROUTE_LOCAL   0x00080000 /* Last used route was local */
 #define INP2_ULTRA_CONSTRAINED_ALLOWED 0x00100000 /* Allow communication over ultra-constrained interfaces */
 #define INP2_ULTRA_CONSTRAINED_CHECKED 0x00200000 /* Checked entitlements for ultra-constrained interfaces */
+#define INP2_IN_SMRHASH         0x00400000 /* pcb is in ipi_smr_hash */
+#define INP2_SMRHASHED          0x00800000 /* pcb was in ipi_smr_hash, free via SMR */
 
 /*
  * Flags passed to in_pcblookup*() functions.
@@ -867,6 +915,8 @@ extern struct inpcb *in_pcblookup_hash_try(struct inpcbinfo *pcbinfo,
     u_int lport_arg, int wildcard, struct ifnet *ifp);
 extern int in_pcblookup_hash_exists(struct inpcbinfo *, struct in_addr,
     u_int, struct in_addr, u_int, int, uid_t *, gid_t *, struct ifnet *);
+extern struct inpcb *in_pcblookup_hash_smr(struct inpcbinfo *,
+    const struct inpcb_smr_key *, struct ifnet *);
 extern void in_pcbnotifyall(struct inpcbinfo *, struct in_addr, int,
     void (*)(struct inpcb *, int));
 extern void in_pcbrehash(struct inpcb *);
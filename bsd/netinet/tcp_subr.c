@@ -590,6 +590,7 @@ tcp_init(struct protosw *pp, struct domain *dp)
 	    tcbinfo.ipi_porthashbase_count);
 	tcbinfo.ipi_porthashmask = tcbinfo.ipi_porthashbase_count - 1;
 	tcbinfo.ipi_zone = tcpcbzone;
+	tcbinfo.ipi_flags |= INPCBINFO_SMR_HASH;
 
 	tcbinfo.ipi_gc = tcp_gc;
 	tcbinfo.ipi_timer = tcp_itimer;
@@ -268,6 +268,7 @@ udp_init(struct protosw *pp, struct domain *dp)
 	    udbinfo.ipi_porthashbase_count);
 	udbinfo.ipi_porthashmask = udbinfo.ipi_porthashbase_count - 1;
 	udbinfo.ipi_zone = inpcbzone;
+	udbinfo.ipi_flags |= INPCBINFO_SMR_HASH;
 
 	pcbinfo = &udbinfo;
 	/*
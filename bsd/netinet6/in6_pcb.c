@@ -1586,8 +1586,22 @@ in6_pcblookup_hash(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
     u_int fport_arg, uint32_t fifscope, struct in6_addr *laddr, u_int lport_arg,
     uint32_t lifscope, int wildcard, struct ifnet *ifp)
 {
+	struct inpcb_smr_key isk = {
+		.isk_faddr6   = *faddr,
+		.isk_laddr6   = *laddr,
+		.isk_fifscope = fifscope,
+		.isk_lifscope = lifscope,
+		.isk_fport    = (u_short)fport_arg,
+		.isk_lport    = (u_short)lport_arg,
+		.isk_vflag    = INP_IPV6,
+	};
 	struct inpcb *inp;
 
+	inp = in_pcblookup_hash_smr(pcbinfo, &isk, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	lck_rw_lock_shared(&pcbinfo->ipi_lock);
 
 	inp = in6_pcblookup_hash_locked(pcbinfo, faddr, fport_arg, fifscope,
@@ -1603,8 +1617,22 @@ in6_pcblookup_hash_try(struct inpcbinfo *pcbinfo, struct in6_addr *faddr,
     u_int fport_arg, uint32_t fifscope, struct in6_addr *laddr, u_int lport_arg,
     uint32_t lifscope, int wildcard, struct ifnet *ifp)
 {
+	struct inpcb_smr_key isk = {
+		.isk_faddr6   = *faddr,
+		.isk_laddr6   = *laddr,
+		.isk_fifscope = fifscope,
+		.isk_lifscope = lifscope,
+		.isk_fport    = (u_short)fport_arg,
+		.isk_lport    = (u_short)lport_arg,
+		.isk_vflag    = INP_IPV6,
+	};
 	struct inpcb *inp;
 
+	inp = in_pcblookup_hash_smr(pcbinfo, &isk, ifp);
+	if (inp != NULL) {
+		return inp;
+	}
+
 	if (!lck_rw_try_lock_shared(&pcbinfo->ipi_lock)) {
 		return NULL;
 	}
@@ -485,6 +485,24 @@ extern void kqworkloops_dealloc(struct proc *);
 
 extern int kevent_register(struct kqueue *, struct kevent_qos_s *,
     struct knote **);
+
+/*
+ * Knotes allocated in bulk for a batch of registrations: before each
+ * registration the caller sets knb_left to how many registrations are
+ * left, and the knotes not used by the end of the batch are released
+ * with knote_batch_drain().
+ */
+#define KNOTE_ALLOC_BATCH 16
+
+struct knote_batch {
+	uint32_t        knb_left;
+	uint32_t        knb_count;
+	struct knote   *knb_knotes[KNOTE_ALLOC_BATCH];
+};
+
+extern int kevent_register_batch(struct kqueue *, struct kevent_qos_s *,
+    struct knote **, struct knote_batch *);
+extern void knote_batch_drain(struct knote_batch *);
 extern int kqueue_scan(struct kqueue *, int flags,
     struct kevent_ctx_s *, kevent_callback_t);
 extern int kqueue_stat(struct kqueue *, void *, int, proc_t);
@@ -1655,6 +1655,7 @@ __private_extern__ struct mbuf *m_getcl(int, int, int);
 __private_extern__ char * __sized_by_or_null(MCLBYTES) m_mclalloc(int);
 __private_extern__ int m_mclhasreference(struct mbuf *);
 __private_extern__ void m_copy_pkthdr(struct mbuf *, struct mbuf *);
+__private_extern__ void m_demote_pkthdr(struct mbuf *);
 __private_extern__ int m_dup_pkthdr(struct mbuf *, struct mbuf *, int);
 __private_extern__ void m_copy_pftag(struct mbuf *, struct mbuf *);
 __private_extern__ void m_copy_necptag(struct mbuf *, struct mbuf *);
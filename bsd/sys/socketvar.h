@@ -949,6 +949,8 @@ extern int socreate(int dom, struct socket **aso, int type, int proto);
 extern int socreate_delegate(int dom, struct socket **aso, int type, int proto,
     pid_t epid);
 extern void sodealloc(struct socket *so);
+extern void sodealloc_teardown(struct socket *so);
+extern void sodealloc_free(struct socket *so);
 extern int sodisconnectlocked(struct socket *so);
 extern void soreference(struct socket *so);
 extern void sodereference(struct socket *so);
@@ -220,6 +220,8 @@ vm_swapfile_io(vnode_t vp, uint64_t offset, uint64_t start, int npages, int flag
 	}
 
 	if (flags & SWAP_READ) {
+		upl_set_iodone(upl, upl_iodone);
+
 		vnode_pagein(vp,
 		    upl,
 		    0,
@@ -2476,6 +2476,49 @@ extern int64_t vm_prefault_nb_pages, vm_prefault_nb_bailout;
 SYSCTL_QUAD(_vm, OID_AUTO, prefault_nb_pages, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_prefault_nb_pages, "");
 SYSCTL_QUAD(_vm, OID_AUTO, prefault_nb_bailout, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_prefault_nb_bailout, "");
 
+/* fault-around window and counts of faults and pages mapped by it */
+extern uint32_t vm_fault_around_pages;
+extern uint64_t vm_fault_around_count, vm_fault_around_pages_entered;
+SYSCTL_UINT(_vm, OID_AUTO, fault_around_pages, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_fault_around_pages, 0, "");
+SYSCTL_QUAD(_vm, OID_AUTO, fault_around_count, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_fault_around_count, "");
+SYSCTL_QUAD(_vm, OID_AUTO, fault_around_pages_entered, CTLFLAG_RD | CTLFLAG_LOCKED, &vm_fault_around_pages_entered, "");
+
+/*
+ * Lets a process opt its own map out of fault-around, e.g. when it
+ * touches a sparse subset of a large file mapping.  Children inherit it.
+ */
+static int
+sysctl_vm_self_fault_around SYSCTL_HANDLER_ARGS
+{
+#pragma unused(arg1, arg2, oidp)
+	int     error = 0;
+	int     value;
+
+	value = vm_map_get_fault_around(current_map());
+	error = SYSCTL_OUT(req, &value, sizeof(int));
+	if (error) {
+		return error;
+	}
+
+	if (!req->newptr) {
+		return 0;
+	}
+
+	error = SYSCTL_IN(req, &value, sizeof(int));
+	if (error) {
+		return error;
+	}
+	vm_map_set_fault_around(current_map(), value != 0);
+	return 0;
+}
+SYSCTL_PROC(_vm, OID_AUTO, self_fault_around, CTLTYPE_INT | CTLFLAG_RW | CTLFLAG_ANYBODY | CTLFLAG_LOCKED | CTLFLAG_MASKED, 0, 0, &sysctl_vm_self_fault_around, "I", "");
+
+/* faults resolved without the map lock, and those that fell back to it */
+SCALABLE_COUNTER_DECLARE(vm_fault_speculative_hits);
+SYSCTL_SCALABLE_COUNTER(_vm, fault_speculative_hits, vm_fault_speculative_hits, "");
+SCALABLE_COUNTER_DECLARE(vm_fault_speculative_fallbacks);
+SYSCTL_SCALABLE_COUNTER(_vm, fault_speculative_fallbacks, vm_fault_speculative_fallbacks, "");
+
 #if defined (__x86_64__)
 extern unsigned int vm_clump_promote_threshold;
 SYSCTL_UINT(_vm, OID_AUTO, vm_clump_promote_threshold, CTLFLAG_RW | CTLFLAG_LOCKED, &vm_clump_promote_threshold, 0, "clump size threshold for promotes");
@@ -3484,6 +3527,17 @@ sysctl_compressor_incore_fragmentation_wasted_pages(__unused struct sysctl_oid *
 
 SYSCTL_PROC(_vm, OID_AUTO, compressor_incore_fragmentation_wasted_pages, CTLTYPE_INT | CTLFLAG_RD | CTLFLAG_LOCKED, 0, 0, sysctl_compressor_incore_fragmentation_wasted_pages, "IU", "");
 
+static int
+sysctl_mglru_stats(__unused struct sysctl_oid *oidp, __unused void *arg1, __unused int arg2, struct sysctl_req *req)
+{
+	struct vm_page_mglru_stats stats;
+
+	vm_page_mglru_get_stats(&stats);
+	return SYSCTL_OUT(req, &stats, sizeof(stats));
+}
+
+SYSCTL_PROC(_vm, OID_AUTO, mglru_stats, CTLTYPE_STRUCT | CTLFLAG_RD | CTLFLAG_LOCKED, 0, 0, sysctl_mglru_stats, "S", "");
+
 
 
 #define SYSCTL_VM_OBJECTS_SLOTMAP_BUF_SIZE (8 * 1024)
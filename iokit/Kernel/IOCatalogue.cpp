@@ -177,7 +177,8 @@ IOCatalogue::init(OSArray * initArray)
 	generation = 1;
 
 	personalities = OSDictionary::withCapacity(32);
-	personalities->setOptions(OSCollection::kSort, OSCollection::kSort);
+	personalities->setOptions(OSCollection::kSort | OSCollection::kHashIndex,
+	    OSCollection::kSort | OSCollection::kHashIndex);
 	for (unsigned int idx = 0; (obj = initArray->getObject(idx)); idx++) {
 		dict = OSDynamicCast(OSDictionary, obj);
 		if (!dict) {
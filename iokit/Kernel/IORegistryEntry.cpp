@@ -318,6 +318,7 @@ IORegistryEntry::init( OSDictionary * dict )
 		fPropertyTable = OSDictionary::withCapacity( kIORegCapacityIncrement );
 		if (fPropertyTable) {
 			fPropertyTable->setCapacityIncrement( kIORegCapacityIncrement );
+			fPropertyTable->setOptions(OSCollection::kHashIndex, OSCollection::kHashIndex);
 		}
 	}
 
@@ -83,6 +83,7 @@
 #include <libkern/OSKextLibPrivate.h>
 #include <libkern/OSReturn.h>
 #include <libkern/OSSerializeBinary.h>
+#include <libkern/OSSerializeFlat.h>
 #include <libkern/OSTypes.h>
 #include <libkern/prelink.h>
 #include <libkern/stack_protector.h>
@@ -203,6 +204,7 @@
 #include <IOKit/IOBSD.h>
 #include <IOKit/IODeviceTreeSupport.h>
 #include <kern/ipc_kobject.h>
+#include <kern/startup.h>
 #include <libkern/Block.h>
 #include <libkern/Block_private.h>
 #include <libkern/c++/OSAllocation.h>
@@ -1972,6 +1974,129 @@ TestLockForArbitration(int)
 
 // --
 
+/*
+ * Compares OSUnserializeXML with the flat format on the properties of every
+ * entry of the service plane: the cost of getting at each entry's IOClass,
+ * and of materializing the whole tree, in time and OSObjects allocated.
+ * Object counts are global and only indicative on a busy system.
+ */
+static int32_t
+OSSerializeFlatBenchObjects(void)
+{
+	return (int32_t)(OSDictionary::metaClass->getInstanceCount() +
+	       OSArray::metaClass->getInstanceCount() +
+	       OSSet::metaClass->getInstanceCount() +
+	       OSNumber::metaClass->getInstanceCount() +
+	       OSString::metaClass->getInstanceCount() +
+	       OSSymbol::metaClass->getInstanceCount() +
+	       OSData::metaClass->getInstanceCount());
+}
+
+static uint64_t
+OSSerializeFlatBenchMicroseconds(uint64_t start)
+{
+	uint64_t ns;
+
+	absolutetime_to_nanoseconds(mach_absolute_time() - start, &ns);
+	return ns / NSEC_PER_USEC;
+}
+
+static int
+OSSerializeFlatBench(__unused int64_t in, int64_t *out)
+{
+	OSSharedPtr<OSArray>            entries;
+	OSSharedPtr<IORegistryIterator> iter;
+	OSSharedPtr<OSSerialize>        xml;
+	OSSharedPtr<OSData>             flat;
+	OSSharedPtr<OSObject>           parsed, materialized;
+	OSArray                        *parsedEntries;
+	IORegistryEntry                *entry;
+	osflat_view_t                   view;
+	uint64_t                        start, xmlUS, flatUS, materializeUS;
+	int32_t                         objs, xmlObjs, flatObjs, materializeObjs;
+	uint32_t                        expected = 0, xmlFound = 0, flatFound = 0;
+	uint32_t                        root, value;
+	bool                            ok;
+
+	*out = 0;
+
+	entries = OSArray::withCapacity(1024);
+	iter = IORegistryIterator::iterateOver(gIOServicePlane, kIORegistryIterateRecursively);
+	if (!entries || !iter) {
+		return ENOMEM;
+	}
+	while ((entry = iter->getNextObject())) {
+		OSSharedPtr<OSDictionary> props = entry->dictionaryWithProperties();
+
+		/* skip entries with objects the flat format can't represent */
+		if (props && OSSerialize::flatWithObject(props.get())) {
+			entries->setObject(props.get());
+			expected += (props->getObject(gIOClassKey) != NULL);
+		}
+	}
+
+	xml = OSSerialize::withCapacity(4096);
+	flat = OSSerialize::flatWithObject(entries.get());
+	if (!xml || !entries->serialize(xml.get()) || !flat) {
+		return ENOMEM;
+	}
+
+	objs = OSSerializeFlatBenchObjects();
+	start = mach_absolute_time();
+	parsed = OSUnserializeXML(xml->text(), xml->getLength());
+	parsedEntries = OSDynamicCast(OSArray, parsed.get());
+	for (uint32_t i = 0; parsedEntries && i < parsedEntries->getCount(); i++) {
+		OSDictionary *props = OSDynamicCast(OSDictionary, parsedEntries->getObject(i));
+
+		xmlFound += (props && props->getObject(gIOClassKey));
+	}
+	xmlUS = OSSerializeFlatBenchMicroseconds(start);
+	xmlObjs = OSSerializeFlatBenchObjects() - objs;
+
+	objs = OSSerializeFlatBenchObjects();
+	start = mach_absolute_time();
+	ok = osflat_validate(flat->getBytesNoCopy(), flat->getLength(), &view);
+	root = ok ? osflat_root(&view) : 0;
+	for (uint32_t i = 0; ok && i < osflat_node(&view, root)->osfn_count; i++) {
+		flatFound += osflat_dict_lookup(&view, osflat_array_get(&view, root, i),
+		    gIOClassKey->getCStringNoCopy(), &value);
+	}
+	flatUS = OSSerializeFlatBenchMicroseconds(start);
+	flatObjs = OSSerializeFlatBenchObjects() - objs;
+	if (!ok) {
+		return EINVAL;
+	}
+
+	objs = OSSerializeFlatBenchObjects();
+	start = mach_absolute_time();
+	materialized = OSUnserializeFlat(&view, root, kOSUnserializeFlatNoCopy);
+	materializeUS = OSSerializeFlatBenchMicroseconds(start);
+	materializeObjs = OSSerializeFlatBenchObjects() - objs;
+
+	printf("osserialize_flat: %u entries, xml %u bytes, flat %u bytes\n",
+	    entries->getCount(), xml->getLength(), flat->getLength());
+	printf("osserialize_flat: xml parse+lookup %llu us, %d objects\n", xmlUS, xmlObjs);
+	printf("osserialize_flat: flat validate+lookup %llu us, %d objects\n", flatUS, flatObjs);
+	printf("osserialize_flat: flat materialize %llu us, %d objects\n",
+	    materializeUS, materializeObjs);
+
+	if (xmlFound != expected || flatFound != expected) {
+		printf("osserialize_flat: found %u (xml) %u (flat) IOClass, expected %u\n",
+		    xmlFound, flatFound, expected);
+		return EINVAL;
+	}
+	if (!materialized || !materialized->isEqualTo(entries.get())) {
+		printf("osserialize_flat: materialized tree differs\n");
+		return EINVAL;
+	}
+
+	*out = 1;
+	return 0;
+}
+SYSCTL_TEST_REGISTER(osserialize_flat_bench, OSSerializeFlatBench);
+
+// --
+
 #endif  /* DEVELOPMENT || DEBUG */
 
 #ifndef __clang_analyzer__
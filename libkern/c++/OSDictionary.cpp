@@ -39,6 +39,7 @@
 #include <libkern/c++/OSSharedPtr.h>
 #include <libkern/c++/OSSymbol.h>
 #include <os/cpp_util.h>
+#include <os/hash.h>
 
 #define super OSCollection
 
@@ -73,11 +74,155 @@ OSDictionary::dictEntry::compare(const void *_e1, const void *_e2)
 	return (uintptr_t)e1->key.get() > (uintptr_t)e2->key.get() ? 1 : -1;
 }
 
+/*
+ * Hash index (kHashIndex)
+ *
+ * Dictionaries with the kHashIndex option and a capacity of at least
+ * kHashIndexMinCapacity entries maintain an open addressing hash table
+ * of the symbol pointers, which is placed right after the @c capacity
+ * entries in the @c dictionary allocation (so that the class layout
+ * is unchanged).
+ *
+ * The table has a power of 2 number of slots, at least twice the capacity,
+ * each slot holding an entry index + 1, or 0 when empty. Entries themselves
+ * keep their usual order (insertion order, or symbol order with kSort),
+ * the table is rebuilt whenever entries move around.
+ *
+ * Whether a dictionary has an index only depends on fOptions and capacity
+ * (see hashIndexed()), which only change in ensureCapacity()
+ * and setOptions().
+ */
+#define kHashIndexMinCapacity   32u
+#define kHashIndexMaxCapacity   (1u << 24)
+#define kHashIndexMinSlots      64u
+
+static inline bool
+hashIndexed(unsigned int options, unsigned int capacity)
+{
+	return (options & OSCollection::kHashIndex) &&
+	       capacity >= kHashIndexMinCapacity &&
+	       capacity <= kHashIndexMaxCapacity;
+}
+
+static inline uint32_t
+hashIndexSlots(unsigned int capacity)
+{
+	uint32_t slots = kHashIndexMinSlots;
+
+	while (slots < 2 * capacity) {
+		slots <<= 1;
+	}
+	return slots;
+}
+
+/* number of entries to allocate for a given capacity */
+unsigned int
+OSDictionary::dictAllocCount(unsigned int capacity, bool indexed)
+{
+	static_assert(kHashIndexMinSlots * sizeof(uint32_t) % sizeof(dictEntry) == 0,
+	    "the index fills whole entries");
+
+	if (!indexed) {
+		return capacity;
+	}
+	return capacity + hashIndexSlots(capacity) * sizeof(uint32_t) / sizeof(dictEntry);
+}
+
+void
+OSDictionary::hashIndexInsert(unsigned int idx)
+{
+	uint32_t *index = (uint32_t *)&dictionary[capacity];
+	uint32_t mask = hashIndexSlots(capacity) - 1;
+	uint32_t h = os_hash_kernel_pointer(dictionary[idx].key.get()) & mask;
+
+	while (index[h]) {
+		h = (h + 1) & mask;
+	}
+	index[h] = idx + 1;
+}
+
+void
+OSDictionary::hashIndexRebuild(void)
+{
+	bzero(&dictionary[capacity], hashIndexSlots(capacity) * sizeof(uint32_t));
+	for (unsigned int i = 0; i < count; i++) {
+		hashIndexInsert(i);
+	}
+}
+
+unsigned int
+OSDictionary::findEntry(const OSSymbol *aKey, bool *exists) const
+{
+	unsigned int i;
+
+	if (hashIndexed(fOptions, capacity)) {
+		const uint32_t *index = (const uint32_t *)&dictionary[capacity];
+		uint32_t mask = hashIndexSlots(capacity) - 1;
+		uint32_t h = os_hash_kernel_pointer(aKey) & mask;
+
+		for (; index[h]; h = (h + 1) & mask) {
+			i = index[h] - 1;
+			if (aKey == dictionary[i].key) {
+				*exists = true;
+				return i;
+			}
+		}
+
+		*exists = false;
+		if (fOptions & kSort) {
+			return OSSymbol::bsearch(aKey, &dictionary[0], count, sizeof(dictionary[0]));
+		}
+		return count;
+	}
+
+	if (fOptions & kSort) {
+		i = OSSymbol::bsearch(aKey, &dictionary[0], count, sizeof(dictionary[0]));
+		*exists = (i < count) && (aKey == dictionary[i].key);
+		return i;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (aKey == dictionary[i].key) {
+			*exists = true;
+			return i;
+		}
+	}
+	*exists = false;
+	return count;
+}
+
+bool
+OSDictionary::hashIndexResize(bool wasIndexed, bool indexed)
+{
+	unsigned int oldCount = dictAllocCount(capacity, wasIndexed);
+	unsigned int newCount = dictAllocCount(capacity, indexed);
+	dictEntry *newDict;
+
+	if (oldCount != newCount) {
+		newDict = kreallocp_type_container(dictEntry, dictionary,
+		    oldCount, &newCount, Z_WAITOK_ZERO);
+		if (!newDict) {
+			return false;
+		}
+		newCount = dictAllocCount(capacity, indexed);
+		OSCONTAINER_ACCUMSIZE(sizeof(dictEntry) * ((int)newCount - (int)oldCount));
+		dictionary = newDict;
+	}
+
+	if (indexed) {
+		hashIndexRebuild();
+	}
+	return true;
+}
+
 void
 OSDictionary::sortBySymbol(void)
 {
 	qsort(dictionary, count, sizeof(OSDictionary::dictEntry),
 	    &OSDictionary::dictEntry::compare);
+	if (hashIndexed(fOptions, capacity)) {
+		hashIndexRebuild();
+	}
 }
 
 bool
@@ -216,6 +361,14 @@ OSDictionary::initWithDictionary(const OSDictionary *dict,
 		sortBySymbol();
 	}
 
+	// keep the hash index of the original, without touching its children
+	if (kHashIndex & dict->fOptions) {
+		(void) super::setOptions(kHashIndex, kHashIndex);
+		if (!hashIndexResize(false, hashIndexed(fOptions, capacity))) {
+			(void) super::setOptions(0, kHashIndex);
+		}
+	}
+
 	return true;
 }
 
@@ -280,8 +433,11 @@ OSDictionary::free()
 	(void) super::setOptions(0, kImmutable);
 	flushCollection();
 	if (dictionary) {
-		kfree_type(dictEntry, capacity, dictionary);
-		OSCONTAINER_ACCUMSIZE( -(capacity * sizeof(dictEntry)));
+		unsigned int allocCount = dictAllocCount(capacity,
+		    hashIndexed(fOptions, capacity));
+
+		kfree_type(dictEntry, allocCount, dictionary);
+		OSCONTAINER_ACCUMSIZE( -(allocCount * sizeof(dictEntry)));
 	}
 
 	super::free();
@@ -316,7 +472,8 @@ unsigned int
 OSDictionary::ensureCapacity(unsigned int newCapacity)
 {
 	dictEntry *newDict;
-	unsigned int finalCapacity;
+	unsigned int finalCapacity, oldCount, newCount;
+	bool wasIndexed, indexed;
 
 	if (newCapacity <= capacity) {
 		return capacity;
@@ -331,12 +488,30 @@ OSDictionary::ensureCapacity(unsigned int newCapacity)
 		return capacity;
 	}
 
+	wasIndexed = hashIndexed(fOptions, capacity);
+	indexed = hashIndexed(fOptions, finalCapacity);
+	oldCount = dictAllocCount(capacity, wasIndexed);
+	newCount = dictAllocCount(finalCapacity, indexed);
+
 	newDict = kreallocp_type_container(dictEntry, dictionary,
-	    capacity, &finalCapacity, Z_WAITOK_ZERO);
+	    oldCount, &newCount, Z_WAITOK_ZERO);
 	if (newDict) {
-		OSCONTAINER_ACCUMSIZE(sizeof(dictEntry) * (finalCapacity - capacity));
+		if (indexed) {
+			// the index is placed after exactly finalCapacity entries
+			newCount = dictAllocCount(finalCapacity, indexed);
+		} else {
+			finalCapacity = newCount;
+		}
+		if (wasIndexed) {
+			// the old index was copied over unused entries
+			bzero(&newDict[capacity], (oldCount - capacity) * sizeof(dictEntry));
+		}
+		OSCONTAINER_ACCUMSIZE(sizeof(dictEntry) * (newCount - oldCount));
 		dictionary = newDict;
 		capacity = finalCapacity;
+		if (indexed) {
+			hashIndexRebuild();
+		}
 	}
 
 	return capacity;
@@ -352,6 +527,10 @@ OSDictionary::flushCollection()
 		dictionary[i].value.reset();
 	}
 	count = 0;
+
+	if (hashIndexed(fOptions, capacity)) {
+		hashIndexRebuild();
+	}
 }
 
 bool
@@ -367,16 +546,7 @@ setObject(const OSSymbol *aKey, const OSMetaClassBase *anObject, bool onlyAdd)
 
 	// if the key exists, replace the object
 
-	if (fOptions & kSort) {
-		i = OSSymbol::bsearch(aKey, &dictionary[0], count, sizeof(dictionary[0]));
-		exists = (i < count) && (aKey == dictionary[i].key);
-	} else {
-		for (exists = false, i = 0; i < count; i++) {
-			if ((exists = (aKey == dictionary[i].key))) {
-				break;
-			}
-		}
-	}
+	i = findEntry(aKey, &exists);
 
 	if (exists) {
 		if (onlyAdd) {
@@ -405,6 +575,14 @@ setObject(const OSSymbol *aKey, const OSMetaClassBase *anObject, bool onlyAdd)
 	dictionary[i].value.reset(anObject, OSRetain);
 	count++;
 
+	if (hashIndexed(fOptions, capacity)) {
+		if (i == count - 1) {
+			hashIndexInsert(i);
+		} else {
+			hashIndexRebuild();
+		}
+	}
+
 	return true;
 }
 
@@ -445,16 +623,7 @@ OSDictionary::removeObject(const OSSymbol *aKey)
 
 	// if the key exists, remove the object
 
-	if (fOptions & kSort) {
-		i = OSSymbol::bsearch(aKey, &dictionary[0], count, sizeof(dictionary[0]));
-		exists = (i < count) && (aKey == dictionary[i].key);
-	} else {
-		for (exists = false, i = 0; i < count; i++) {
-			if ((exists = (aKey == dictionary[i].key))) {
-				break;
-			}
-		}
-	}
+	i = findEntry(aKey, &exists);
 
 	if (exists) {
 		dictEntry oldEntry = dictionary[i];
@@ -463,6 +632,9 @@ OSDictionary::removeObject(const OSSymbol *aKey)
 
 		count--;
 		bcopy(&dictionary[i + 1], &dictionary[i], (count - i) * sizeof(dictionary[0]));
+		if (hashIndexed(fOptions, capacity)) {
+			hashIndexRebuild();
+		}
 
 		oldEntry.key->taggedRelease(OSTypeID(OSCollection));
 		oldEntry.value->taggedRelease(OSTypeID(OSCollection));
@@ -515,7 +687,14 @@ OSDictionary::getObject(const OSSymbol *aKey) const
 	// of OSSymbol::bsearch
 	//
 	// If we have less than 4 objects, scanning is faster.
-	if (count > 4 && (fOptions & kSort)) {
+	if (hashIndexed(fOptions, capacity)) {
+		bool exists;
+
+		i = findEntry(aKey, &exists);
+		if (exists) {
+			return const_cast<OSObject *> ((const OSObject *)dictionary[i].value.get());
+		}
+	} else if (count > 4 && (fOptions & kSort)) {
 		while (l < r) {
 			i = (l + r) / 2;
 			if (aKey == dictionary[i].key) {
@@ -767,6 +946,13 @@ OSDictionary::setOptions(unsigned options, unsigned mask, void *)
 		}
 	}
 
+	if ((old ^ fOptions) & kHashIndex) {
+		if (!hashIndexResize(hashIndexed(old, capacity),
+		    hashIndexed(fOptions, capacity))) {
+			(void) super::setOptions(old, kHashIndex);
+		}
+	}
+
 	if (!(old & kSort) && (fOptions & kSort)) {
 		sortBySymbol();
 	}
@@ -875,3 +1061,164 @@ OSDictionary::iterateObjects(bool (^block)(const OSSymbol * key, OSObject * obje
 {
 	return iterateObjects((void *)block, &OSDictionaryIterateObjectsBlock);
 }
+
+#if DEBUG || DEVELOPMENT
+#include <kern/clock.h>
+#include <kern/startup.h>
+
+/*
+ * Do dictionaries a and b hold the same value for each of keys,
+ * and iterate their keys in the same order?
+ */
+static bool
+osdictionary_hash_index_same(OSDictionary *a, OSDictionary *b, OSArray *keys, const char *when)
+{
+	OSSharedPtr<OSArray> order[2];
+
+	for (unsigned int i = 0; i < keys->getCount(); i++) {
+		const OSSymbol *sym = (const OSSymbol *)keys->getObject(i);
+
+		if (a->getObject(sym) != b->getObject(sym)) {
+			printf("osdictionary_hash_index_test: key %u differs %s\n", i, when);
+			return false;
+		}
+	}
+
+	order[0] = a->copyKeys();
+	order[1] = b->copyKeys();
+	if (!order[0] || !order[1] || !order[0]->isEqualTo(order[1].get())) {
+		printf("osdictionary_hash_index_test: iteration order differs %s\n", when);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Fills dictionaries with `size` keys with and without kHashIndex, both
+ * with `options`, checks that they agree on lookups and iteration order
+ * after insertions, removals and growing to twice the keys, and logs
+ * how long insertions and lookups took.
+ */
+static int
+osdictionary_hash_index_check(int64_t size, unsigned options, int64_t *out)
+{
+	const unsigned int n = (unsigned int)size;
+	const unsigned int lookupRounds = 8;
+	OSSharedPtr<OSArray> keys;
+	OSSharedPtr<OSDictionary> dicts[2];
+	OSSharedPtr<const OSSymbol> missing;
+	uint64_t insertTime[2], lookupTime[2];
+	char name[32];
+
+	if (size <= 0 || size > 100000) {
+		return EINVAL;
+	}
+
+	/* the second half of the keys is only added to grow the dictionaries */
+	keys = OSArray::withCapacity(2 * n);
+	missing = OSSymbol::withCString("osdictionary_hash_index_test.missing");
+	if (!keys || !missing) {
+		return ENOMEM;
+	}
+	for (unsigned int i = 0; i < 2 * n; i++) {
+		snprintf(name, sizeof(name), "osdictionary_hash_index_test.%u", i);
+		OSSharedPtr<const OSSymbol> sym = OSSymbol::withCString(name);
+		if (!sym || !keys->setObject(sym.get())) {
+			return ENOMEM;
+		}
+	}
+
+	for (unsigned int d = 0; d < 2; d++) {
+		uint64_t start;
+
+		dicts[d] = OSDictionary::withCapacity(16);
+		if (!dicts[d]) {
+			return ENOMEM;
+		}
+		dicts[d]->setOptions(options | (d ? OSCollection::kHashIndex : 0),
+		    OSCollection::kSort | OSCollection::kHashIndex);
+
+		start = mach_absolute_time();
+		for (unsigned int i = 0; i < n; i++) {
+			const OSSymbol *sym = (const OSSymbol *)keys->getObject(i);
+
+			if (!dicts[d]->setObject(sym, sym)) {
+				return ENOMEM;
+			}
+		}
+		absolutetime_to_nanoseconds(mach_absolute_time() - start, &insertTime[d]);
+
+		start = mach_absolute_time();
+		for (unsigned int r = 0; r < lookupRounds; r++) {
+			for (unsigned int i = 0; i < n; i++) {
+				OSObject *sym = keys->getObject(i);
+
+				if (dicts[d]->getObject((const OSSymbol *)sym) != sym) {
+					printf("%s: lookup %u failed (index: %d)\n", __func__, i, d);
+					return EINVAL;
+				}
+			}
+		}
+		absolutetime_to_nanoseconds(mach_absolute_time() - start, &lookupTime[d]);
+
+		if (dicts[d]->getObject(missing.get())) {
+			printf("%s: found a missing key (index: %d)\n", __func__, d);
+			return EINVAL;
+		}
+	}
+	if (!osdictionary_hash_index_same(dicts[0].get(), dicts[1].get(), keys.get(), "after insertions")) {
+		return EINVAL;
+	}
+
+	/* remove every third key, then re-add a few */
+	for (unsigned int d = 0; d < 2; d++) {
+		for (unsigned int i = 0; i < n; i += 3) {
+			dicts[d]->removeObject((const OSSymbol *)keys->getObject(i));
+		}
+		for (unsigned int i = 0; i < n; i += 9) {
+			const OSSymbol *sym = (const OSSymbol *)keys->getObject(i);
+
+			dicts[d]->setObject(sym, sym);
+		}
+	}
+	if (!osdictionary_hash_index_same(dicts[0].get(), dicts[1].get(), keys.get(), "after removals")) {
+		return EINVAL;
+	}
+
+	for (unsigned int d = 0; d < 2; d++) {
+		for (unsigned int i = n; i < 2 * n; i++) {
+			const OSSymbol *sym = (const OSSymbol *)keys->getObject(i);
+
+			if (!dicts[d]->setObject(sym, sym)) {
+				return ENOMEM;
+			}
+		}
+	}
+	if (!osdictionary_hash_index_same(dicts[0].get(), dicts[1].get(), keys.get(), "after growing")) {
+		return EINVAL;
+	}
+
+	printf("%s: %u keys%s: insert %llu / %llu ns, lookup %llu / %llu ns "
+	    "(plain / hash index)\n", __func__, n,
+	    (options & OSCollection::kSort) ? ", sorted" : "",
+	    insertTime[0] / n, insertTime[1] / n,
+	    lookupTime[0] / (n * lookupRounds), lookupTime[1] / (n * lookupRounds));
+
+	*out = 1;
+	return 0;
+}
+
+static int
+osdictionary_hash_index_test(int64_t size, int64_t *out)
+{
+	return osdictionary_hash_index_check(size, 0, out);
+}
+SYSCTL_TEST_REGISTER(osdictionary_hash_index, osdictionary_hash_index_test);
+
+static int
+osdictionary_hash_index_sorted_test(int64_t size, int64_t *out)
+{
+	return osdictionary_hash_index_check(size, OSCollection::kSort, out);
+}
+SYSCTL_TEST_REGISTER(osdictionary_hash_index_sorted, osdictionary_hash_index_sorted_test);
+#endif /* DEBUG || DEVELOPMENT */
@@ -841,7 +841,8 @@ OSMetaClass::postModLoad(void * loadHandle)
 				result = kOSMetaClassNoDicts;
 				break;
 			}
-			sAllClassesDict->setOptions(OSCollection::kSort, OSCollection::kSort);
+			sAllClassesDict->setOptions(OSCollection::kSort | OSCollection::kHashIndex,
+			    OSCollection::kSort | OSCollection::kHashIndex);
 
 			// No break; fall through
 			[[clang::fallthrough]];
@@ -0,0 +1,441 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#define IOKIT_ENABLE_SHARED_PTR
+
+#include <libkern/c++/OSContainers.h>
+#include <libkern/c++/OSLib.h>
+#include <libkern/c++/OSSharedPtr.h>
+#include <libkern/c++/OSUnserialize.h>
+#include <libkern/OSSerializeFlat.h>
+
+#include <IOKit/IOLib.h>
+
+extern "C" {
+void qsort(void *, size_t, size_t, int (*)(const void *, const void *));
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+/*
+ * The node, edge and blob sections are accumulated separately and only
+ * laid out behind the header once the whole graph has been walked.
+ * Symbols are deduplicated, so that the keys shared by most dictionaries
+ * of a property tree are only stored once.
+ */
+struct OSSerializeFlatWriter {
+	OSSharedPtr<OSData>       nodes;
+	OSSharedPtr<OSData>       edges;
+	OSSharedPtr<OSData>       blob;
+	OSSharedPtr<OSDictionary> symbols;      /* OSSymbol -> OSNumber node index */
+};
+
+static uint32_t
+flatCount(OSData *section, size_t elemSize)
+{
+	return (uint32_t)(section->getLength() / elemSize);
+}
+
+static bool
+flatAppendNode(OSSerializeFlatWriter *w, uint8_t type, uint8_t bits,
+    uint32_t count, uint64_t value, uint32_t *index)
+{
+	osflat_node_t node = {
+		.osfn_type  = type,
+		.osfn_bits  = bits,
+		.osfn_count = count,
+		.osfn_value = value,
+	};
+
+	*index = flatCount(w->nodes.get(), sizeof(node));
+	if (*index == UINT32_MAX) {
+		return false;
+	}
+	return w->nodes->appendBytes(&node, sizeof(node));
+}
+
+static bool
+flatAppendBlob(OSSerializeFlatWriter *w, const void *bytes, uint32_t len,
+    uint32_t align, uint64_t *offset)
+{
+	uint32_t pad = (uint32_t)(-w->blob->getLength() & (align - 1));
+
+	if (pad && !w->blob->appendBytes(NULL, pad)) {
+		return false;
+	}
+	*offset = w->blob->getLength();
+	return len == 0 || w->blob->appendBytes(bytes, len);
+}
+
+static bool
+flatReserveEdges(OSSerializeFlatWriter *w, uint64_t count, uint64_t *first)
+{
+	*first = flatCount(w->edges.get(), sizeof(uint32_t));
+	if (count > UINT32_MAX / sizeof(uint32_t)) {
+		return false;
+	}
+	return count == 0 || w->edges->appendBytes(NULL, (uint32_t)(count * sizeof(uint32_t)));
+}
+
+static void
+flatSetEdge(OSSerializeFlatWriter *w, uint64_t edge, uint32_t index)
+{
+	/* the section may have moved since the edges were reserved */
+	uint32_t *e = (uint32_t *)(uintptr_t)w->edges->getBytesNoCopy(
+		(unsigned int)(edge * sizeof(uint32_t)), sizeof(uint32_t));
+
+	*e = index;
+}
+
+static int
+flatKeyCompare(const void *a, const void *b)
+{
+	const OSSymbol *ka = *(const OSSymbol * const *)a;
+	const OSSymbol *kb = *(const OSSymbol * const *)b;
+
+	return strcmp(ka->getCStringNoCopy(), kb->getCStringNoCopy());
+}
+
+bool
+OSSerialize::flatSerializeInternal(OSSerializeFlatWriter *w,
+    const OSMetaClassBase *o, uint32_t depth, uint32_t *index)
+{
+	const OSDictionary *dict;
+	const OSArray      *array;
+	const OSSet        *set;
+	const OSNumber     *num;
+	const OSBoolean    *boo;
+	const OSSymbol     *sym;
+	const OSString     *str;
+	const OSData       *ldata;
+	uint64_t            first, offset;
+	uint32_t            count, child;
+	bool                ok = true;
+
+	if (depth > kOSSerializeFlatMaxDepth) {
+		return false;
+	}
+
+	if ((dict = OSDynamicCast(OSDictionary, o))) {
+		OSSharedPtr<OSCollectionIterator> iter;
+		const OSSymbol **keys;
+		const OSSymbol  *key;
+		uint32_t         nkeys = 0;
+
+		count = dict->getCount();
+		if (!flatReserveEdges(w, 2 * (uint64_t)count, &first) ||
+		    !flatAppendNode(w, kOSFlatDictionary, 0, count, first, index)) {
+			return false;
+		}
+		if (count == 0) {
+			return true;
+		}
+
+		keys = kalloc_type(const OSSymbol *, count, Z_WAITOK_ZERO);
+		iter = OSCollectionIterator::withCollection(dict);
+		if (!keys || !iter) {
+			kfree_type(const OSSymbol *, count, keys);
+			return false;
+		}
+		while (nkeys < count &&
+		    (key = OSDynamicCast(OSSymbol, iter->getNextObject()))) {
+			keys[nkeys++] = key;
+		}
+		ok = (nkeys == count);
+		if (ok) {
+			qsort(keys, count, sizeof(keys[0]), flatKeyCompare);
+		}
+
+		for (uint32_t i = 0; ok && i < count; i++) {
+			ok = flatSerializeInternal(w, keys[i], depth + 1, &child);
+			if (ok) {
+				flatSetEdge(w, first + 2 * i, child);
+				ok = flatSerializeInternal(w, dict->getObject(keys[i]),
+				    depth + 1, &child);
+			}
+			if (ok) {
+				flatSetEdge(w, first + 2 * i + 1, child);
+			}
+		}
+		kfree_type(const OSSymbol *, count, keys);
+	} else if ((array = OSDynamicCast(OSArray, o))) {
+		count = array->getCount();
+		if (!flatReserveEdges(w, count, &first) ||
+		    !flatAppendNode(w, kOSFlatArray, 0, count, first, index)) {
+			return false;
+		}
+		for (uint32_t i = 0; ok && i < count; i++) {
+			ok = flatSerializeInternal(w, array->getObject(i), depth + 1, &child);
+			if (ok) {
+				flatSetEdge(w, first + i, child);
+			}
+		}
+	} else if ((set = OSDynamicCast(OSSet, o))) {
+		OSSharedPtr<OSCollectionIterator> iter;
+		OSObject *member;
+		uint32_t  i = 0;
+
+		count = set->getCount();
+		iter  = OSCollectionIterator::withCollection(set);
+		if (!iter || !flatReserveEdges(w, count, &first) ||
+		    !flatAppendNode(w, kOSFlatSet, 0, count, first, index)) {
+			return false;
+		}
+		while (ok && i < count && (member = iter->getNextObject())) {
+			ok = flatSerializeInternal(w, member, depth + 1, &child);
+			if (ok) {
+				flatSetEdge(w, first + i++, child);
+			}
+		}
+		ok = ok && (i == count);
+	} else if ((num = OSDynamicCast(OSNumber, o))) {
+		uint8_t bits = (uint8_t)num->size;
+
+		/* the value of float numbers is the bit pattern of a double */
+		if (bits != 31 && bits != 63) {
+			bits = bits <= 8 ? 8 : bits <= 16 ? 16 : bits <= 32 ? 32 : 64;
+		}
+		ok = flatAppendNode(w, kOSFlatNumber, bits, 0, num->value, index);
+	} else if ((boo = OSDynamicCast(OSBoolean, o))) {
+		ok = flatAppendNode(w, kOSFlatBoolean, boo->isTrue(), 0, 0, index);
+	} else if ((sym = OSDynamicCast(OSSymbol, o))) {
+		OSSharedPtr<OSNumber> known;
+
+		if ((num = OSDynamicCast(OSNumber, w->symbols->getObject(sym)))) {
+			*index = num->unsigned32BitValue();
+			return true;
+		}
+		count = sym->getLength();
+		ok = flatAppendBlob(w, sym->getCStringNoCopy(), count + 1, 1, &offset) &&
+		    flatAppendNode(w, kOSFlatSymbol, 0, count, offset, index);
+		if (ok) {
+			known = OSNumber::withNumber(*index, 32);
+			ok = known && w->symbols->setObject(sym, known.get());
+		}
+	} else if ((str = OSDynamicCast(OSString, o))) {
+		count = str->getLength();
+		ok = flatAppendBlob(w, str->getCStringNoCopy(), count + 1, 1, &offset) &&
+		    flatAppendNode(w, kOSFlatString, 0, count, offset, index);
+	} else if ((ldata = OSDynamicCast(OSData, o))) {
+		count = ldata->getLength();
+		if (ldata->reserved && ldata->reserved->disableSerialization) {
+			count = 0;
+		}
+		ok = flatAppendBlob(w, ldata->getBytesNoCopy(), count,
+		    sizeof(uint64_t), &offset) &&
+		    flatAppendNode(w, kOSFlatData, 0, count, offset, index);
+	} else {
+		return false;
+	}
+
+	return ok;
+}
+
+OSSharedPtr<OSData>
+OSSerialize::flatWithObject(const OSMetaClassBase *o)
+{
+	OSSerializeFlatWriter writer;
+	OSSharedPtr<OSData>   result;
+	osflat_header_t       header = { };
+	uint32_t              root, nodesSize, edgesSize, pad;
+	uint64_t              size;
+
+	writer.nodes   = OSData::withCapacity(16 * sizeof(osflat_node_t));
+	writer.edges   = OSData::withCapacity(16 * sizeof(uint32_t));
+	writer.blob    = OSData::withCapacity(256);
+	writer.symbols = OSDictionary::withCapacity(16);
+	if (!writer.nodes || !writer.edges || !writer.blob || !writer.symbols) {
+		return nullptr;
+	}
+	writer.symbols->setOptions(OSCollection::kHashIndex, OSCollection::kHashIndex);
+
+	if (!o || !flatSerializeInternal(&writer, o, 0, &root)) {
+		return nullptr;
+	}
+
+	nodesSize = writer.nodes->getLength();
+	edgesSize = writer.edges->getLength();
+	pad       = (uint32_t)(-(sizeof(header) + nodesSize + edgesSize) & (sizeof(uint64_t) - 1));
+
+	header.osfh_magic       = kOSSerializeFlatMagic;
+	header.osfh_version     = kOSSerializeFlatVersion;
+	header.osfh_header_size = sizeof(header);
+	header.osfh_root        = root;
+	header.osfh_node_offset = sizeof(header);
+	header.osfh_node_count  = flatCount(writer.nodes.get(), sizeof(osflat_node_t));
+	header.osfh_edge_offset = header.osfh_node_offset + nodesSize;
+	header.osfh_edge_count  = flatCount(writer.edges.get(), sizeof(uint32_t));
+	header.osfh_blob_offset = header.osfh_edge_offset + edgesSize + pad;
+	header.osfh_blob_size   = writer.blob->getLength();
+
+	size = (uint64_t)header.osfh_blob_offset + header.osfh_blob_size;
+	if (size > UINT32_MAX) {
+		return nullptr;
+	}
+	header.osfh_size = (uint32_t)size;
+
+	result = OSData::withCapacity(header.osfh_size);
+	if (!result ||
+	    !result->appendBytes(&header, sizeof(header)) ||
+	    !result->appendBytes(writer.nodes.get()) ||
+	    !result->appendBytes(writer.edges.get()) ||
+	    (pad && !result->appendBytes(NULL, pad)) ||
+	    !result->appendBytes(writer.blob.get())) {
+		return nullptr;
+	}
+
+	return result;
+}
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+static OSSharedPtr<OSObject>
+OSUnserializeFlatNode(const osflat_view_t *view, uint32_t idx,
+    uint32_t options, uint32_t depth)
+{
+	const osflat_node_t *n = osflat_node(view, idx);
+	const bool           nocopy = (options & kOSUnserializeFlatNoCopy);
+	const char          *bytes;
+
+	if (depth > kOSSerializeFlatMaxDepth) {
+		return nullptr;
+	}
+
+	switch (n->osfn_type) {
+	case kOSFlatNumber:
+		if (n->osfn_bits == 63 || n->osfn_bits == 31) {
+			double fp;
+
+			static_assert(sizeof(fp) == sizeof(n->osfn_value));
+			memcpy(&fp, &n->osfn_value, sizeof(fp));
+			if (n->osfn_bits == 31) {
+				return OSNumber::withFloat((float)fp);
+			}
+			return OSNumber::withDouble(fp);
+		}
+		return OSNumber::withNumber(n->osfn_value, n->osfn_bits);
+
+	case kOSFlatBoolean:
+		return OSSharedPtr<OSObject>(n->osfn_bits ? kOSBooleanTrue : kOSBooleanFalse,
+		           OSRetain);
+
+	case kOSFlatSymbol:
+		/* symbols are global, they can never point into the buffer */
+		return OSSymbol::withCString(osflat_string(view, n));
+
+	case kOSFlatString:
+		if (nocopy) {
+			return OSString::withCStringNoCopy(osflat_string(view, n));
+		}
+		return OSString::withCString(osflat_string(view, n));
+
+	case kOSFlatData:
+		bytes = view->osfv_blob + n->osfn_value;
+		if (n->osfn_count == 0) {
+			return OSData::withCapacity(0);
+		}
+		if (nocopy) {
+			return OSData::withBytesNoCopy((void *)(uintptr_t)bytes, n->osfn_count);
+		}
+		return OSData::withBytes(bytes, n->osfn_count);
+
+	case kOSFlatDictionary: {
+		OSSharedPtr<OSDictionary> dict = OSDictionary::withCapacity(n->osfn_count);
+
+		for (uint32_t i = 0; dict && i < n->osfn_count; i++) {
+			const uint32_t *pair = &view->osfv_edges[n->osfn_value + 2 * i];
+			OSSharedPtr<OSObject> key, value;
+
+			key   = OSUnserializeFlatNode(view, pair[0], options, depth + 1);
+			value = OSUnserializeFlatNode(view, pair[1], options, depth + 1);
+			if (!key || !value ||
+			    !dict->setObject(OSDynamicCast(OSSymbol, key.get()), value.get())) {
+				return nullptr;
+			}
+		}
+		return dict;
+	}
+
+	case kOSFlatArray: {
+		OSSharedPtr<OSArray> array = OSArray::withCapacity(n->osfn_count);
+
+		for (uint32_t i = 0; array && i < n->osfn_count; i++) {
+			OSSharedPtr<OSObject> o;
+
+			o = OSUnserializeFlatNode(view, osflat_array_get(view, idx, i),
+			    options, depth + 1);
+			if (!o || !array->setObject(o.get())) {
+				return nullptr;
+			}
+		}
+		return array;
+	}
+
+	case kOSFlatSet: {
+		OSSharedPtr<OSSet> set = OSSet::withCapacity(n->osfn_count);
+
+		for (uint32_t i = 0; set && i < n->osfn_count; i++) {
+			OSSharedPtr<OSObject> o;
+
+			o = OSUnserializeFlatNode(view, osflat_array_get(view, idx, i),
+			    options, depth + 1);
+			if (!o || !set->setObject(o.get())) {
+				return nullptr;
+			}
+		}
+		return set;
+	}
+	}
+
+	return nullptr;
+}
+
+OSSharedPtr<OSObject>
+OSUnserializeFlat(const osflat_view_t *view, uint32_t node, uint32_t options,
+    OSString **errorString)
+{
+	OSSharedPtr<OSObject> result;
+
+	if (errorString) {
+		*errorString = NULL;
+	}
+
+	if (node >= view->osfv_node_count) {
+		if (errorString) {
+			*errorString = OSString::withCString("node index out of range").detach();
+		}
+		return nullptr;
+	}
+
+	result = OSUnserializeFlatNode(view, node, options, 0);
+	if (!result && errorString) {
+		*errorString = OSString::withCString("couldn't materialize node").detach();
+	}
+
+	return result;
+}
@@ -71,6 +71,20 @@ struct pqueue_entry_traits<queue_t, priority_queue_entry_deadline_t> {
 	}
 };
 
+template <typename queue_t>
+struct pqueue_entry_traits<queue_t, priority_queue_entry_deadline_stable_t> {
+	static inline int
+	compare(queue_t que __unused,
+	    priority_queue_entry_deadline_stable_t e1,
+	    priority_queue_entry_deadline_stable_t e2)
+	{
+		if (e1->deadline != e2->deadline) {
+			return priority_heap_compare_ints(e1->deadline, e2->deadline);
+		}
+		return priority_heap_compare_ints(e1->stamp, e2->stamp);
+	}
+};
+
 template <typename queue_t>
 struct pqueue_entry_traits<queue_t, priority_queue_entry_sched_t> {
 	static inline int
@@ -469,6 +483,11 @@ PRIORITY_QUEUE_MAKE_IMPL(pqueue_deadline_min_t,
 PRIORITY_QUEUE_MAKE_IMPL(pqueue_deadline_max_t,
     struct priority_queue_deadline_max *, priority_queue_entry_deadline_t);
 
+PRIORITY_QUEUE_MAKE_IMPL(pqueue_deadline_stable_min_t,
+    struct priority_queue_deadline_stable_min *, priority_queue_entry_deadline_stable_t);
+PRIORITY_QUEUE_MAKE_IMPL(pqueue_deadline_stable_max_t,
+    struct priority_queue_deadline_stable_max *, priority_queue_entry_deadline_stable_t);
+
 PRIORITY_QUEUE_MAKE_IMPL(pqueue_sched_stable_min_t,
     struct priority_queue_sched_stable_min *, priority_queue_entry_stable_t);
 PRIORITY_QUEUE_MAKE_IMPL(pqueue_sched_stable_max_t,
@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#ifndef _OS_OSSERIALIZEFLAT_H
+#define _OS_OSSERIALIZEFLAT_H
+
+/*
+ * Flat, offset based serialization of OSObject graphs.
+ *
+ * Unlike the OSSerializeBinary stream, which has to be parsed front to back
+ * into freshly allocated objects, a flat buffer can be validated once with
+ * osflat_validate() and then walked in place: nodes are found by index,
+ * dictionary lookups are a binary search over sorted keys, and strings and
+ * data are referenced where they are in the buffer. OSObjects only need to
+ * be materialized (see OSUnserializeFlat()) for the parts that are used.
+ *
+ * Layout (all offsets from the start of the buffer, host byte order):
+ *
+ *      ╭──────────────────╮
+ *      │ osflat_header_t  │
+ *      ├──────────────────┤ osfh_node_offset
+ *      │ osflat_node_t [] │ osfh_node_count nodes
+ *      ├──────────────────┤ osfh_edge_offset
+ *      │ uint32_t []      │ osfh_edge_count node indices
+ *      ├──────────────────┤ osfh_blob_offset
+ *      │ bytes            │ strings (NUL terminated) and data
+ *      ╰──────────────────╯
+ *
+ * Collections reference a run of @c osfn_count consecutive edges
+ * (2 * @c osfn_count for dictionaries, as key, value pairs) starting at
+ * @c osfn_value. Dictionary keys are symbol nodes sorted by strcmp() order.
+ *
+ * Collections form a tree laid out in preorder: the root collection comes
+ * first, every other collection is referenced by exactly one edge, and
+ * collections appear in the node array in the order a depth first walk
+ * from the root reaches them. Their edge runs don't overlap and are in
+ * the same order. Leaf nodes can be shared freely. This keeps the work
+ * needed to validate or materialize a buffer linear in its size.
+ *
+ * This header has no kernel dependencies so that flat buffers
+ * can be produced and inspected from userspace as well.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define kOSSerializeFlatMagic           0x4c464f53u     /* "SOFL" */
+#define kOSSerializeFlatVersion         1
+#define kOSSerializeFlatMaxDepth        64
+
+typedef enum {
+	kOSFlatDictionary       = 1,
+	kOSFlatArray            = 2,
+	kOSFlatSet              = 3,
+	kOSFlatNumber           = 4,
+	kOSFlatSymbol           = 5,
+	kOSFlatString           = 6,
+	kOSFlatData             = 7,
+	kOSFlatBoolean          = 8,
+} osflat_type_t;
+
+typedef struct osflat_header {
+	uint32_t        osfh_magic;
+	uint16_t        osfh_version;
+	uint16_t        osfh_header_size;
+	uint32_t        osfh_size;              /* size of the whole buffer */
+	uint32_t        osfh_root;              /* index of the root node */
+	uint32_t        osfh_node_offset;
+	uint32_t        osfh_node_count;
+	uint32_t        osfh_edge_offset;
+	uint32_t        osfh_edge_count;
+	uint32_t        osfh_blob_offset;
+	uint32_t        osfh_blob_size;
+} osflat_header_t;
+
+typedef struct osflat_node {
+	uint8_t         osfn_type;              /* osflat_type_t */
+	uint8_t         osfn_bits;              /* numbers: 8/16/32/64, 31 (float) or 63 (double),
+	                                         * booleans: the value */
+	uint16_t        osfn_reserved;
+	uint32_t        osfn_count;             /* collections: number of entries,
+	                                         * strings and data: length in bytes
+	                                         * (without the terminating NUL) */
+	uint64_t        osfn_value;             /* numbers: the value,
+	                                         * strings and data: offset in the blob,
+	                                         * collections: index of the first edge */
+} osflat_node_t;
+
+/*
+ * A validated flat buffer, filled by osflat_validate().
+ */
+typedef struct osflat_view {
+	const osflat_header_t  *osfv_header;
+	const osflat_node_t    *osfv_nodes;
+	const uint32_t         *osfv_edges;
+	const char             *osfv_blob;
+	uint32_t                osfv_node_count;
+	uint32_t                osfv_edge_count;
+	uint32_t                osfv_blob_size;
+} osflat_view_t;
+
+static inline bool
+osflat_section_ok(uint32_t size, uint32_t offset, uint64_t length, uint32_t align)
+{
+	return (offset % align) == 0 && offset <= size && length <= size - offset;
+}
+
+static inline bool
+osflat_is_collection(uint8_t type)
+{
+	return type == kOSFlatDictionary || type == kOSFlatArray || type == kOSFlatSet;
+}
+
+static inline uint64_t
+osflat_edge_span(const osflat_node_t *n)
+{
+	return n->osfn_type == kOSFlatDictionary ?
+	       2 * (uint64_t)n->osfn_count : n->osfn_count;
+}
+
+static inline const char *
+osflat_string(const osflat_view_t *v, const osflat_node_t *n)
+{
+	return v->osfv_blob + n->osfn_value;
+}
+
+static inline uint32_t
+osflat_next_collection(const osflat_view_t *v, uint32_t idx)
+{
+	while (idx < v->osfv_node_count &&
+	    !osflat_is_collection(v->osfv_nodes[idx].osfn_type)) {
+		idx++;
+	}
+	return idx;
+}
+
+/*
+ * Walks the collections depth first from the root, and checks that each
+ * one is reached exactly once, in index order. Sharing a collection would
+ * otherwise let a small buffer describe an exponentially large graph.
+ */
+static inline bool
+osflat_validate_tree(const osflat_view_t *v)
+{
+	struct {
+		uint32_t        node;
+		uint32_t        edge;
+	} stack[kOSSerializeFlatMaxDepth + 1];
+	uint32_t root = v->osfv_header->osfh_root;
+	uint32_t depth = 0, next;
+
+	next = osflat_next_collection(v, 0);
+	if (!osflat_is_collection(v->osfv_nodes[root].osfn_type)) {
+		return next == v->osfv_node_count;
+	}
+	if (root != next) {
+		return false;
+	}
+	next = osflat_next_collection(v, next + 1);
+
+	stack[0].node = root;
+	stack[0].edge = 0;
+	for (;;) {
+		const osflat_node_t *n = &v->osfv_nodes[stack[depth].node];
+		uint32_t c;
+
+		if (stack[depth].edge == osflat_edge_span(n)) {
+			if (depth == 0) {
+				break;
+			}
+			depth--;
+			continue;
+		}
+		c = v->osfv_edges[n->osfn_value + stack[depth].edge++];
+		if (!osflat_is_collection(v->osfv_nodes[c].osfn_type)) {
+			continue;
+		}
+		if (c != next || depth == kOSSerializeFlatMaxDepth) {
+			return false;
+		}
+		next = osflat_next_collection(v, next + 1);
+
+		depth++;
+		stack[depth].node = c;
+		stack[depth].edge = 0;
+	}
+
+	/* no collection is left out of the tree */
+	return next == v->osfv_node_count;
+}
+
+/*
+ * Checks that every offset, length and index in the buffer is in bounds,
+ * that strings are NUL terminated, that dictionary keys are sorted symbols,
+ * and that collections form a tree (see above). The accessors below can
+ * then be used without further checks.
+ */
+static inline bool
+osflat_validate(const void *buffer, size_t size, osflat_view_t *v)
+{
+	const osflat_header_t *h = (const osflat_header_t *)buffer;
+	uint64_t next_edge = 0;
+	uint32_t bsize;
+
+	if (((uintptr_t)buffer % sizeof(uint64_t)) || size < sizeof(*h) ||
+	    size > UINT32_MAX) {
+		return false;
+	}
+	bsize = (uint32_t)size;
+
+	if (h->osfh_magic != kOSSerializeFlatMagic ||
+	    h->osfh_version != kOSSerializeFlatVersion ||
+	    h->osfh_header_size != sizeof(*h) ||
+	    h->osfh_size != bsize) {
+		return false;
+	}
+	if (!osflat_section_ok(bsize, h->osfh_node_offset,
+	    (uint64_t)h->osfh_node_count * sizeof(osflat_node_t), sizeof(uint64_t)) ||
+	    !osflat_section_ok(bsize, h->osfh_edge_offset,
+	    (uint64_t)h->osfh_edge_count * sizeof(uint32_t), sizeof(uint32_t)) ||
+	    !osflat_section_ok(bsize, h->osfh_blob_offset, h->osfh_blob_size, 1) ||
+	    h->osfh_root >= h->osfh_node_count) {
+		return false;
+	}
+
+	v->osfv_header     = h;
+	v->osfv_nodes      = (const osflat_node_t *)((uintptr_t)buffer + h->osfh_node_offset);
+	v->osfv_edges      = (const uint32_t *)((uintptr_t)buffer + h->osfh_edge_offset);
+	v->osfv_blob       = (const char *)buffer + h->osfh_blob_offset;
+	v->osfv_node_count = h->osfh_node_count;
+	v->osfv_edge_count = h->osfh_edge_count;
+	v->osfv_blob_size  = h->osfh_blob_size;
+
+	for (uint32_t i = 0; i < v->osfv_node_count; i++) {
+		const osflat_node_t *n = &v->osfv_nodes[i];
+		const char *prev = NULL;
+		uint64_t span;
+
+		switch (n->osfn_type) {
+		case kOSFlatNumber:
+			if (n->osfn_bits != 8 && n->osfn_bits != 16 &&
+			    n->osfn_bits != 32 && n->osfn_bits != 64 &&
+			    n->osfn_bits != 31 && n->osfn_bits != 63) {
+				return false;
+			}
+			break;
+
+		case kOSFlatBoolean:
+			if (n->osfn_bits > 1) {
+				return false;
+			}
+			break;
+
+		case kOSFlatSymbol:
+		case kOSFlatString:
+			if (n->osfn_value >= v->osfv_blob_size ||
+			    n->osfn_count >= v->osfv_blob_size - n->osfn_value) {
+				return false;
+			}
+			if (v->osfv_blob[n->osfn_value + n->osfn_count] != '\0' ||
+			    strlen(osflat_string(v, n)) != n->osfn_count) {
+				return false;
+			}
+			break;
+
+		case kOSFlatData:
+			if (n->osfn_value > v->osfv_blob_size ||
+			    n->osfn_count > v->osfv_blob_size - n->osfn_value) {
+				return false;
+			}
+			break;
+
+		case kOSFlatDictionary:
+		case kOSFlatArray:
+		case kOSFlatSet:
+			span = osflat_edge_span(n);
+			if (n->osfn_value < next_edge ||
+			    n->osfn_value > v->osfv_edge_count ||
+			    span > v->osfv_edge_count - n->osfn_value) {
+				return false;
+			}
+			next_edge = n->osfn_value + span;
+			for (uint64_t e = 0; e < span; e++) {
+				uint32_t c = v->osfv_edges[n->osfn_value + e];
+				const osflat_node_t *cn;
+
+				if (c >= v->osfv_node_count) {
+					return false;
+				}
+				cn = &v->osfv_nodes[c];
+				if (osflat_is_collection(cn->osfn_type) && c <= i) {
+					return false;
+				}
+				if (n->osfn_type != kOSFlatDictionary || (e & 1)) {
+					continue;
+				}
+				/* keys are validated symbols if c < i, or checked below */
+				if (cn->osfn_type != kOSFlatSymbol ||
+				    cn->osfn_value >= v->osfv_blob_size ||
+				    cn->osfn_count >= v->osfv_blob_size - cn->osfn_value ||
+				    v->osfv_blob[cn->osfn_value + cn->osfn_count] != '\0') {
+					return false;
+				}
+				if (prev && strcmp(prev, osflat_string(v, cn)) >= 0) {
+					return false;
+				}
+				prev = osflat_string(v, cn);
+			}
+			break;
+
+		default:
+			return false;
+		}
+	}
+
+	return osflat_validate_tree(v);
+}
+
+static inline const osflat_node_t *
+osflat_node(const osflat_view_t *v, uint32_t idx)
+{
+	return &v->osfv_nodes[idx];
+}
+
+static inline uint32_t
+osflat_root(const osflat_view_t *v)
+{
+	return v->osfv_header->osfh_root;
+}
+
+/*
+ * Returns the index of the @c i-th member of an array or set node.
+ */
+static inline uint32_t
+osflat_array_get(const osflat_view_t *v, uint32_t idx, uint32_t i)
+{
+	return v->osfv_edges[osflat_node(v, idx)->osfn_value + i];
+}
+
+/*
+ * Looks up @c key in a dictionary node, and returns the index of its value
+ * in @c *value. The keys being sorted, this is a binary search in place.
+ */
+static inline bool
+osflat_dict_lookup(const osflat_view_t *v, uint32_t idx, const char *key,
+    uint32_t *value)
+{
+	const osflat_node_t *n = osflat_node(v, idx);
+	const uint32_t *edges = &v->osfv_edges[n->osfn_value];
+	uint32_t l = 0, r = n->osfn_count;
+
+	if (n->osfn_type != kOSFlatDictionary) {
+		return false;
+	}
+
+	while (l < r) {
+		uint32_t m = l + (r - l) / 2;
+		int cmp = strcmp(key, osflat_string(v, osflat_node(v, edges[2 * m])));
+
+		if (cmp == 0) {
+			*value = edges[2 * m + 1];
+			return true;
+		}
+		if (cmp < 0) {
+			r = m;
+		} else {
+			l = m + 1;
+		}
+	}
+
+	return false;
+}
+
+#endif /* _OS_OSSERIALIZEFLAT_H */
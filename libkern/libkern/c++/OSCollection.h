@@ -245,10 +245,19 @@ public:
  * This is generally an advisory flag, used for debugging;
  * setting it does not mean a collection will in fact
  * disallow modifications.
+ *
+ * @const kHashIndex
+ * @discussion
+ * Used with <code>@link setOptions setOptions@/link</code>
+ * to have large dictionaries maintain a hash index of their keys,
+ * making lookups constant time at the expense of some memory.
+ * The index is only built once the dictionary capacity reaches
+ * a threshold, and iteration order is not affected.
  */
 	typedef enum {
 		kImmutable  = 0x00000001,
 		kSort       = 0x00000002,
+		kHashIndex  = 0x00000004,
 		kMASK       = (unsigned) - 1
 	} _OSCollectionFlags;
 
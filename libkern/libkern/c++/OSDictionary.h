@@ -100,6 +100,8 @@ typedef OSDictionary* OSDictionaryPtr;
  * <b>Note:</b> OSDictionary currently uses a linear search algorithm,
  * and is not designed for high-performance access of many values.
  * It is intended as a simple associative-storage mechanism only.
+ * Within the kernel, large dictionaries can opt into a hash index
+ * with the <code>kHashIndex</code> option (see OSCollection).
  *
  * <b>Use Restrictions</b>
  *
@@ -948,6 +950,11 @@ public:
 	bool setObject(const OSSymbol *aKey, const OSMetaClassBase *anObject, bool onlyAdd);
 	void sortBySymbol(void);
 	OSPtr<OSArray> copyKeys(void);
+	unsigned int findEntry(const OSSymbol *aKey, bool *exists) const;
+	static unsigned int dictAllocCount(unsigned int capacity, bool indexed);
+	void hashIndexInsert(unsigned int idx);
+	void hashIndexRebuild(void);
+	bool hashIndexResize(bool wasIndexed, bool indexed);
 #endif /* XNU_KERNEL_PRIVATE */
 
 
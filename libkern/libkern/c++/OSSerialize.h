@@ -126,6 +126,27 @@ public:
 	    uint32_t * startCollection);
 	void endBinaryCollection(uint32_t startCollection);
 
+#ifdef XNU_KERNEL_PRIVATE
+	static bool flatSerializeInternal(struct OSSerializeFlatWriter *w,
+	    const OSMetaClassBase *o, uint32_t depth, uint32_t *index);
+
+/*!
+ * @function flatWithObject
+ *
+ * @abstract
+ * Serializes an object graph in the flat format of
+ * <code>libkern/OSSerializeFlat.h</code>.
+ *
+ * @param object  The root of the graph, made of OSDictionary, OSArray, OSSet,
+ *                OSNumber, OSBoolean, OSSymbol, OSString and OSData objects.
+ *
+ * @result
+ * An OSData holding the flat buffer, or <code>NULL</code> if the graph
+ * contains other kinds of objects or is nested too deeply.
+ */
+	static OSPtr<OSData> flatWithObject(const OSMetaClassBase *object);
+#endif /* XNU_KERNEL_PRIVATE */
+
 public:
 
 /*!
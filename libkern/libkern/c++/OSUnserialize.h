@@ -114,6 +114,40 @@ OSUnserializeBinary(const char *buffer, size_t bufferSize, OSString * *errorStri
 extern "C++" OSPtr<OSObject>
 OSUnserializeBinary(const char *buffer, size_t bufferSize, OSSharedPtr<OSString>& errorString);
 
+#ifdef XNU_KERNEL_PRIVATE
+struct osflat_view;
+
+enum {
+	kOSUnserializeFlatNoCopy = 0x1,
+};
+
+/*!
+ * @function OSUnserializeFlat
+ *
+ * @abstract
+ * Materializes one node of a flat buffer (see <code>libkern/OSSerializeFlat.h</code>)
+ * and everything below it as OSObjects.
+ *
+ * @param view         A view filled by a successful <code>osflat_validate()</code>.
+ * @param node         The index of the node to materialize,
+ *                     e.g. <code>osflat_root(view)</code>.
+ * @param options      With <code>kOSUnserializeFlatNoCopy</code>, OSStrings and
+ *                     OSData reference the buffer rather than copying out of it;
+ *                     the buffer must then outlive the returned objects.
+ * @param errorString  Optional; set to a description of the failure.
+ *
+ * @result
+ * The materialized object, or <code>NULL</code> on failure.
+ *
+ * @discussion
+ * The buffer is not validated again, which makes it cheap to materialize
+ * only the subtrees that are needed after looking them up in place.
+ */
+extern "C++" OSPtr<OSObject>
+OSUnserializeFlat(const struct osflat_view *view, uint32_t node, uint32_t options,
+    OSString **errorString = NULL);
+#endif /* XNU_KERNEL_PRIVATE */
+
 #ifdef __APPLE_API_OBSOLETE
 extern OSPtr<OSObject> OSUnserialize(const char *buffer, OSString * *errorString = NULL);
 
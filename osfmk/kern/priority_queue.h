@@ -77,6 +77,12 @@ __BEGIN_DECLS
  *             * whether the entry was preempted or not
  *             * a timestamp.
  *
+ *         - deadline, in which case the key is a 64-bit deadline.
+ *
+ *         - deadline_stable, in which case the key is a 64-bit deadline,
+ *           and equal deadlines are ordered by a caller provided stamp
+ *           (smaller is "lower").
+ *
  *         - generic, in which case a comparison function must be passed to
  *           the priority_queue_init.
  *
@@ -158,6 +164,18 @@ typedef struct priority_queue_entry_deadline {
 	uint64_t                              deadline;
 } *priority_queue_entry_deadline_t;
 
+typedef struct priority_queue_entry_deadline_stable {
+	struct priority_queue_entry_deadline_stable *next;
+	struct priority_queue_entry_deadline_stable *prev;
+	long                                  __key: PRIORITY_QUEUE_ENTRY_KEY_BITS;
+#if CONFIG_KERNEL_TAGGING
+	unsigned long                         tag: PRIORITY_QUEUE_ENTRY_TAG_BITS;
+#endif /* CONFIG_KERNEL_TAGGING */
+	long                                  child: PRIORITY_QUEUE_ENTRY_CHILD_BITS;
+	uint64_t                              deadline;
+	uint64_t                              stamp;
+} *priority_queue_entry_deadline_stable_t;
+
 typedef struct priority_queue_entry_sched {
 	struct priority_queue_entry_sched  *next;
 	struct priority_queue_entry_sched  *prev;
@@ -194,6 +212,14 @@ typedef struct priority_queue_entry_deadline {
 	uint64_t                              deadline;
 } *priority_queue_entry_deadline_t;
 
+typedef struct priority_queue_entry_deadline_stable {
+	struct priority_queue_entry_deadline_stable *next;
+	struct priority_queue_entry_deadline_stable *prev;
+	long                                  child;
+	uint64_t                              deadline;
+	uint64_t                              stamp;
+} *priority_queue_entry_deadline_stable_t;
+
 /*
  * For 32-bit platforms, use an extra field to store the key since child pointer packing
  * is not an option. The child is maintained as a long to use the same packing/unpacking
@@ -262,6 +288,16 @@ struct priority_queue_deadline_max {
 	struct priority_queue_entry_deadline *pq_root;
 };
 
+/*
+ * Type of deadline based stable heaps
+ */
+struct priority_queue_deadline_stable_min {
+	struct priority_queue_entry_deadline_stable *pq_root;
+};
+struct priority_queue_deadline_stable_max {
+	struct priority_queue_entry_deadline_stable *pq_root;
+};
+
 /*
  * Type of scheduler priority based heaps
  */
@@ -293,6 +329,8 @@ struct priority_queue_sched_stable_max {
 	struct priority_queue_max *: false, \
 	struct priority_queue_deadline_min *: true, \
 	struct priority_queue_deadline_max *: false, \
+	struct priority_queue_deadline_stable_min *: true, \
+	struct priority_queue_deadline_stable_max *: false, \
 	struct priority_queue_sched_min *: true, \
 	struct priority_queue_sched_max *: false, \
 	struct priority_queue_sched_stable_min *: true, \
@@ -713,6 +751,9 @@ PRIORITY_QUEUE_MAKE_CB(struct priority_queue_max *, priority_queue_entry_t);
 PRIORITY_QUEUE_MAKE(struct priority_queue_deadline_min *, priority_queue_entry_deadline_t);
 PRIORITY_QUEUE_MAKE(struct priority_queue_deadline_max *, priority_queue_entry_deadline_t);
 
+PRIORITY_QUEUE_MAKE(struct priority_queue_deadline_stable_min *, priority_queue_entry_deadline_stable_t);
+PRIORITY_QUEUE_MAKE(struct priority_queue_deadline_stable_max *, priority_queue_entry_deadline_stable_t);
+
 PRIORITY_QUEUE_MAKE(struct priority_queue_sched_min *, priority_queue_entry_sched_t);
 PRIORITY_QUEUE_MAKE(struct priority_queue_sched_max *, priority_queue_entry_sched_t);
 
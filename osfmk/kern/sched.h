@@ -75,6 +75,7 @@
 #include <kern/timer_call.h>
 #include <kern/ast.h>
 #include <kern/bits.h>
+#include <kern/priority_queue.h>
 
 #define NRQS_MAX        (128)                           /* maximum number of priority levels */
 
@@ -266,9 +267,23 @@ rq_bitmap_clear(bitmap_t *__header_indexable map, u_int n)
 
 #endif /* defined(CONFIG_SCHED_TIMESHARE_CORE) */
 
+/*
+ * Each realtime priority level keeps its threads both in enqueue order (for
+ * scans) and in a deadline min-heap, so that the earliest deadline thread of
+ * the level is found in O(1) and enqueue/dequeue cost O(log n) rather than a
+ * sorted list insert.
+ *
+ * The non-empty levels are themselves kept in a per-runqueue heap keyed by
+ * their earliest deadline (rt_queue.ed_queue), so that the runqueue-wide
+ * earliest deadline does not need a rescan of every level on dequeue.
+ *
+ * Both heaps break deadline ties with the enqueue sequence number of the
+ * thread (rt_queue.enqueue_seq), so equal deadlines come out in FIFO order.
+ */
 typedef struct {
 	queue_head_t            pri_queue;                      /* runnable RT threads for this priority */
-	uint64_t                pri_earliest_deadline;          /* earliest deadline for this priority */
+	struct priority_queue_deadline_stable_min pri_deadline_queue; /* same threads, ordered by realtime.deadline */
+	struct priority_queue_entry_deadline_stable pri_ed_link;      /* linkage in rt_queue.ed_queue, keyed by the earliest deadline for this priority */
 	int                     pri_count;                      /* # of threads for this priority */
 	uint32_t                pri_constraint;                 /* constraint of earliest deadline thread for this priority */
 } rt_queue_pri_t;
@@ -281,6 +296,9 @@ struct rt_queue {
 
 	bitmap_t                bitmap[BITMAP_LEN(NRTQS)];
 
+	struct priority_queue_deadline_stable_min ed_queue;     /* non-empty rt_queue_pri, by earliest deadline */
+	uint64_t                enqueue_seq;                    /* stamp of the last enqueued thread */
+
 	rt_queue_pri_t          rt_queue_pri[NRTQS];
 
 	struct runq_stats       runq_stats;
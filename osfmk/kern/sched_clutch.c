@@ -3784,6 +3784,24 @@ const struct sched_dispatch_table sched_edge_dispatch = {
 
 static bitmap_t sched_edge_available_pset_bitmask[BITMAP_LEN(MAX_PSETS)];
 
+/*
+ * Clusters with more runnable threads at some sched bucket than available CPUs.
+ * Maintained by sched_edge_pset_overload_update() whenever the runnable depths
+ * are recomputed, and used by idle CPUs to go straight to the clusters worth
+ * stealing from (see sched_edge_steal_thread()).
+ */
+static _Atomic bitmap_t sched_edge_overloaded_pset_map[BITMAP_LEN(MAX_PSETS)];
+
+/*
+ * Steal attempts (candidate cluster locked and evaluated) and successful
+ * steals for each (source cluster, destination cluster) pair.
+ */
+typedef struct {
+	uint64_t        sess_attempts;
+	uint64_t        sess_successes;
+} sched_edge_steal_stats_t;
+static sched_edge_steal_stats_t sched_edge_steal_stats[MAX_PSETS][MAX_PSETS];
+
 /*
  * sched_edge_thread_bound_cluster_id()
  *
@@ -4258,48 +4276,180 @@ sched_edge_steal_possible(processor_set_t idle_pset, processor_set_t candidate_p
 	return false;
 }
 
+/*
+ * sched_edge_pset_overload_update()
+ *
+ * Recomputes whether the pset belongs in sched_edge_overloaded_pset_map, from
+ * the runnable depths just published by sched_update_pset_load_average().
+ * Called with the pset lock held.
+ */
+void
+sched_edge_pset_overload_update(processor_set_t pset)
+{
+	uint32_t avail_cpu_count = (uint32_t)pset_available_cpu_count(pset);
+	bool overloaded = false;
+
+	/* The runnable depths are cumulative, so checking the lowest bucket would do; be robust to that changing */
+	for (sched_bucket_t bucket = TH_BUCKET_FIXPRI; bucket < TH_BUCKET_SCHED_MAX; bucket++) {
+		if (os_atomic_load(&pset->pset_runnable_depth[bucket], relaxed) > avail_cpu_count) {
+			overloaded = true;
+			break;
+		}
+	}
+
+	if (overloaded) {
+		atomic_bitmap_set(sched_edge_overloaded_pset_map, pset->pset_cluster_id, memory_order_relaxed);
+	} else {
+		atomic_bitmap_clear(sched_edge_overloaded_pset_map, pset->pset_cluster_id, memory_order_relaxed);
+	}
+}
+
+/*
+ * sched_edge_steal_excess()
+ *
+ * Lockless estimate of how many more runnable threads the candidate pset has
+ * than CPUs to run them, over the buckets where it has unbound threads that
+ * could be stolen. Only used to rank candidates; sched_edge_steal_possible()
+ * makes the actual decision with the pset lock held.
+ */
+static int
+sched_edge_steal_excess(processor_set_t candidate_pset)
+{
+	sched_clutch_root_t candidate_clutch_root = &candidate_pset->pset_clutch_root;
+	int avail_cpu_count = pset_available_cpu_count(candidate_pset);
+	int excess = 0;
+
+	for (int bucket = bitmap_lsb_first(candidate_clutch_root->scr_unbound_runnable_bitmap, TH_BUCKET_SCHED_MAX);
+	    bucket >= 0;
+	    bucket = bitmap_lsb_next(candidate_clutch_root->scr_unbound_runnable_bitmap, TH_BUCKET_SCHED_MAX, bucket)) {
+		int depth = (int)os_atomic_load(&candidate_pset->pset_runnable_depth[bucket], relaxed);
+		excess = MAX(excess, depth - avail_cpu_count);
+	}
+	return excess;
+}
+
+/*
+ * sched_edge_steal_overloaded_candidate()
+ *
+ * Picks the most overloaded cluster to steal from among the candidates, using
+ * sched_edge_overloaded_pset_map rather than probing every cluster. Clusters
+ * on the same die as the idle pset are preferred over remote ones, since
+ * stealing across dies is the most expensive edge; within a die, the cluster
+ * with the largest excess wins and ties go to the first cluster in
+ * sched_edge_iterate_clusters_ordered() order.
+ */
+static processor_set_t
+sched_edge_steal_overloaded_candidate(processor_set_t pset, uint64_t candidate_pset_bitmap)
+{
+	uint64_t overloaded_map = os_atomic_load(&sched_edge_overloaded_pset_map[0], relaxed) & candidate_pset_bitmap;
+	uint64_t search_maps[] = {
+		overloaded_map & pset->local_psets[0],
+		overloaded_map & pset->remote_psets[0],
+	};
+
+	for (int i = 0; i < (int)(sizeof(search_maps) / sizeof(search_maps[0])); i++) {
+		processor_set_t selected_pset = NULL;
+		int max_excess = 0;
+		int cluster_id = -1;
+		while ((cluster_id = sched_edge_iterate_clusters_ordered(pset, search_maps[i], cluster_id)) != -1) {
+			processor_set_t candidate_pset = pset_array[cluster_id];
+			if (candidate_pset == NULL) {
+				continue;
+			}
+			if (candidate_pset->sched_edges[pset->pset_cluster_id].sce_steal_allowed == false) {
+				continue;
+			}
+			int excess = sched_edge_steal_excess(candidate_pset);
+			if (excess > max_excess) {
+				max_excess = excess;
+				selected_pset = candidate_pset;
+			}
+		}
+		if (selected_pset != NULL) {
+			return selected_pset;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * sched_edge_steal_thread_from_pset()
+ *
+ * Steals the highest unbound thread of the bucket picked by
+ * sched_edge_steal_possible() from steal_from_pset, if any.
+ */
+static thread_t
+sched_edge_steal_thread_from_pset(processor_set_t pset, processor_set_t steal_from_pset)
+{
+	thread_t stolen_thread = THREAD_NULL;
+	sched_edge_steal_stats_t *stats = &sched_edge_steal_stats[steal_from_pset->pset_cluster_id][pset->pset_cluster_id];
+
+	os_atomic_inc(&stats->sess_attempts, relaxed);
+	pset_lock(steal_from_pset);
+	sched_bucket_t bucket_for_steal;
+	if (sched_edge_steal_possible(pset, steal_from_pset, &bucket_for_steal)) {
+		uint64_t current_timestamp = mach_absolute_time();
+		sched_clutch_root_t clutch_root_for_steal = &steal_from_pset->pset_clutch_root;
+		stolen_thread = sched_clutch_thread_unbound_lookup(clutch_root_for_steal, &clutch_root_for_steal->scr_unbound_buckets[bucket_for_steal], NULL, NULL);
+		sched_clutch_thread_remove(clutch_root_for_steal, stolen_thread, current_timestamp, SCHED_CLUTCH_BUCKET_OPTIONS_SAMEPRI_RR);
+
+		sched_clutch_dbg_thread_select_packed_t debug_info = {0};
+		debug_info.trace_data.version = SCHED_CLUTCH_DBG_THREAD_SELECT_PACKED_VERSION;
+		debug_info.trace_data.traverse_mode = SCHED_CLUTCH_TRAVERSE_REMOVE_HIERARCHY_ONLY;
+		debug_info.trace_data.cluster_id = steal_from_pset->pset_cluster_id;
+		debug_info.trace_data.selection_was_cluster_bound = false;
+		KERNEL_DEBUG_CONSTANT_IST(KDEBUG_TRACE, MACHDBG_CODE(DBG_MACH_SCHED_CLUTCH, MACH_SCHED_CLUTCH_THREAD_SELECT) | DBG_FUNC_NONE,
+		    thread_tid(stolen_thread), thread_group_get_id(stolen_thread->thread_group), bucket_for_steal, debug_info.scdts_trace_data_packed, 0);
+		KDBG(MACHDBG_CODE(DBG_MACH_SCHED_CLUTCH, MACH_SCHED_EDGE_STEAL) | DBG_FUNC_NONE, thread_tid(stolen_thread), pset->pset_cluster_id, steal_from_pset->pset_cluster_id, 0);
+
+		sched_update_pset_load_average(steal_from_pset, current_timestamp);
+		os_atomic_inc(&stats->sess_successes, relaxed);
+	}
+	pset_unlock(steal_from_pset);
+	return stolen_thread;
+}
+
+/*
+ * sched_edge_steal_thread()
+ *
+ * Steals a single thread for the idle pset from one of the candidate clusters.
+ *
+ * Overloaded clusters, which have threads waiting for lack of CPUs, are tried
+ * first and the most overloaded one wins. Stealing one thread at a time (rather
+ * than all the threads of a clutch bucket) keeps the donor cluster from being
+ * drained below what its own CPUs can run. If that fails, typically because
+ * the load went away since the overload map was updated, fall back to walking
+ * all candidates in die order, which is also where homogeneous clusters that
+ * aren't overloaded get stolen from.
+ */
 static thread_t
 sched_edge_steal_thread(processor_set_t pset, uint64_t candidate_pset_bitmap)
 {
 	thread_t stolen_thread = THREAD_NULL;
 
-	/*
-	 * Edge Scheduler Optimization
-	 *
-	 * The logic today bails as soon as it finds a cluster where the cluster load is
-	 * greater than the edge weight. Maybe it should have a more advanced version
-	 * which looks for the maximum delta etc.
-	 */
+	processor_set_t overloaded_pset = sched_edge_steal_overloaded_candidate(pset, candidate_pset_bitmap);
+	if (overloaded_pset != NULL) {
+		stolen_thread = sched_edge_steal_thread_from_pset(pset, overloaded_pset);
+		if (stolen_thread != THREAD_NULL) {
+			return stolen_thread;
+		}
+	}
+
 	int cluster_id = -1;
 	while ((cluster_id = sched_edge_iterate_clusters_ordered(pset, candidate_pset_bitmap, cluster_id)) != -1) {
 		processor_set_t steal_from_pset = pset_array[cluster_id];
-		if (steal_from_pset == NULL) {
+		if (steal_from_pset == NULL || steal_from_pset == overloaded_pset) {
 			continue;
 		}
 		sched_clutch_edge *incoming_edge = &pset_array[cluster_id]->sched_edges[pset->pset_cluster_id];
 		if (incoming_edge->sce_steal_allowed == false) {
 			continue;
 		}
-		pset_lock(steal_from_pset);
-		sched_bucket_t bucket_for_steal;
-		if (sched_edge_steal_possible(pset, steal_from_pset, &bucket_for_steal)) {
-			uint64_t current_timestamp = mach_absolute_time();
-			sched_clutch_root_t clutch_root_for_steal = &steal_from_pset->pset_clutch_root;
-			stolen_thread = sched_clutch_thread_unbound_lookup(clutch_root_for_steal, &clutch_root_for_steal->scr_unbound_buckets[bucket_for_steal], NULL, NULL);
-			sched_clutch_thread_remove(clutch_root_for_steal, stolen_thread, current_timestamp, SCHED_CLUTCH_BUCKET_OPTIONS_SAMEPRI_RR);
-
-			sched_clutch_dbg_thread_select_packed_t debug_info = {0};
-			debug_info.trace_data.version = SCHED_CLUTCH_DBG_THREAD_SELECT_PACKED_VERSION;
-			debug_info.trace_data.traverse_mode = SCHED_CLUTCH_TRAVERSE_REMOVE_HIERARCHY_ONLY;
-			debug_info.trace_data.cluster_id = steal_from_pset->pset_cluster_id;
-			debug_info.trace_data.selection_was_cluster_bound = false;
-			KERNEL_DEBUG_CONSTANT_IST(KDEBUG_TRACE, MACHDBG_CODE(DBG_MACH_SCHED_CLUTCH, MACH_SCHED_CLUTCH_THREAD_SELECT) | DBG_FUNC_NONE,
-			    thread_tid(stolen_thread), thread_group_get_id(stolen_thread->thread_group), bucket_for_steal, debug_info.scdts_trace_data_packed, 0);
-			KDBG(MACHDBG_CODE(DBG_MACH_SCHED_CLUTCH, MACH_SCHED_EDGE_STEAL) | DBG_FUNC_NONE, thread_tid(stolen_thread), pset->pset_cluster_id, steal_from_pset->pset_cluster_id, 0);
-
-			sched_update_pset_load_average(steal_from_pset, current_timestamp);
+		/* Don't bother taking the lock of a cluster with nothing to steal */
+		if (bitmap_lsb_first(steal_from_pset->pset_clutch_root.scr_unbound_runnable_bitmap, TH_BUCKET_SCHED_MAX) == -1) {
+			continue;
 		}
-		pset_unlock(steal_from_pset);
+		stolen_thread = sched_edge_steal_thread_from_pset(pset, steal_from_pset);
 		if (stolen_thread != THREAD_NULL) {
 			break;
 		}
@@ -4307,6 +4457,39 @@ sched_edge_steal_thread(processor_set_t pset, uint64_t candidate_pset_bitmap)
 	return stolen_thread;
 }
 
+/*
+ * sched_edge_steal_stats_get()
+ *
+ * Copies the steal statistics of up to count (source, destination) cluster
+ * pairs, source major, into stats as { attempts, successes } pairs.
+ * Returns the number of clusters.
+ */
+uint32_t
+sched_edge_steal_stats_get(uint64_t *stats, uint32_t count)
+{
+	uint32_t max_clusters = (uint32_t)sched_edge_max_clusters;
+	uint32_t i = 0;
+
+	for (uint32_t src = 0; src < max_clusters; src++) {
+		for (uint32_t dst = 0; dst < max_clusters && i < count; dst++, i++) {
+			stats[2 * i] = os_atomic_load(&sched_edge_steal_stats[src][dst].sess_attempts, relaxed);
+			stats[2 * i + 1] = os_atomic_load(&sched_edge_steal_stats[src][dst].sess_successes, relaxed);
+		}
+	}
+	return max_clusters;
+}
+
+void
+sched_edge_steal_stats_reset(void)
+{
+	for (int src = 0; src < sched_edge_max_clusters; src++) {
+		for (int dst = 0; dst < sched_edge_max_clusters; dst++) {
+			os_atomic_store(&sched_edge_steal_stats[src][dst].sess_attempts, 0, relaxed);
+			os_atomic_store(&sched_edge_steal_stats[src][dst].sess_successes, 0, relaxed);
+		}
+	}
+}
+
 /*
  * sched_edge_processor_idle()
  *
@@ -359,6 +359,14 @@ void sched_edge_tg_preferred_cluster_change(struct thread_group *tg, uint32_t *t
 
 uint16_t sched_edge_cluster_cumulative_count(sched_clutch_root_t root_clutch, sched_bucket_t bucket);
 uint16_t sched_edge_shared_rsrc_runnable_load(sched_clutch_root_t root_clutch, cluster_shared_rsrc_type_t load_type);
+void sched_edge_pset_overload_update(processor_set_t pset);
+
+/*
+ * Work stealing statistics per (source, destination) cluster pair, as
+ * { attempts, successes } pairs of uint64_t. Exported for debugging and tuning.
+ */
+uint32_t sched_edge_steal_stats_get(uint64_t *stats, uint32_t count);
+void sched_edge_steal_stats_reset(void);
 
 #endif /* CONFIG_SCHED_EDGE */
 
@@ -136,6 +136,39 @@
 struct sched_statistics PERCPU_DATA(sched_stats);
 bool sched_stats_active;
 
+struct sched_latency_hist PERCPU_DATA(sched_latency_hist);
+TUNABLE(bool, sched_latency_hist_enabled, "sched_latency_hist", true);
+static uint64_t sched_latency_hist_abstime_per_us;
+static_assert(SCHED_LATENCY_HIST_BUCKETS == TH_BUCKET_SCHED_MAX + 1);
+
+/*
+ * Counts how long a thread that is going on core waited since it was last
+ * made runnable (woken up, or put back on a runqueue after a preemption),
+ * against its sched bucket on this CPU. Only the owning CPU writes its
+ * histogram, at splsched, so this is a plain increment rather than an atomic
+ * read-modify-write; a concurrent reset may lose a count.
+ */
+static inline void
+sched_latency_hist_record(processor_t processor, thread_t thread, uint64_t latency)
+{
+	if (!sched_latency_hist_enabled || sched_latency_hist_abstime_per_us == 0) {
+		return;
+	}
+
+	uint32_t bucket = (thread->sched_mode == TH_MODE_REALTIME) ?
+	    SCHED_LATENCY_HIST_RT_BUCKET : thread->th_sched_bucket;
+	if (bucket >= SCHED_LATENCY_HIST_BUCKETS) {
+		return;
+	}
+
+	/* bit_floor() is -1 for latencies under 1us, which lands them in bin 0 */
+	int bin = bit_floor(latency / sched_latency_hist_abstime_per_us) + 1;
+	bin = MIN(bin, SCHED_LATENCY_HIST_BINS - 1);
+
+	uint64_t *count = &PERCPU_GET_RELATIVE(sched_latency_hist, processor, processor)->slh_count[bucket][bin];
+	os_atomic_store(count, os_atomic_load(count, relaxed) + 1, relaxed);
+}
+
 static uint64_t
 deadline_add(uint64_t d, uint64_t e)
 {
@@ -172,72 +205,6 @@ rt_runq_priority(processor_set_t pset)
 	return i;
 }
 
-static thread_t rt_runq_first(rt_queue_t rt_runq);
-
-#if DEBUG
-static void
-check_rt_runq_consistency(rt_queue_t rt_run_queue, thread_t thread)
-{
-	bitmap_t *map = rt_run_queue->bitmap;
-
-	uint64_t earliest_deadline = RT_DEADLINE_NONE;
-	uint32_t constraint = RT_CONSTRAINT_NONE;
-	int ed_index = NOPRI;
-	int count = 0;
-	bool found_thread = false;
-
-	for (int pri = BASEPRI_RTQUEUES; pri <= MAXPRI; pri++) {
-		int i = pri - BASEPRI_RTQUEUES;
-		rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
-		queue_t queue = &rt_runq->pri_queue;
-		queue_entry_t iter;
-		int n = 0;
-		uint64_t previous_deadline = 0;
-		qe_foreach(iter, queue) {
-			thread_t iter_thread = qe_element(iter, struct thread, runq_links);
-			assert_thread_magic(iter_thread);
-			if (iter_thread == thread) {
-				found_thread = true;
-			}
-			assert(iter_thread->sched_pri == (i + BASEPRI_RTQUEUES));
-			assert(iter_thread->realtime.deadline < RT_DEADLINE_NONE);
-			assert(iter_thread->realtime.constraint < RT_CONSTRAINT_NONE);
-			assert(previous_deadline <= iter_thread->realtime.deadline);
-			n++;
-			if (iter == queue_first(queue)) {
-				assert(rt_runq->pri_earliest_deadline == iter_thread->realtime.deadline);
-				assert(rt_runq->pri_constraint == iter_thread->realtime.constraint);
-			}
-			previous_deadline = iter_thread->realtime.deadline;
-		}
-		assert(n == rt_runq->pri_count);
-		if (n == 0) {
-			assert(bitmap_test(map, i) == false);
-			assert(rt_runq->pri_earliest_deadline == RT_DEADLINE_NONE);
-			assert(rt_runq->pri_constraint == RT_CONSTRAINT_NONE);
-		} else {
-			assert(bitmap_test(map, i) == true);
-		}
-		if (rt_runq->pri_earliest_deadline < earliest_deadline) {
-			earliest_deadline = rt_runq->pri_earliest_deadline;
-			constraint = rt_runq->pri_constraint;
-			ed_index = i;
-		}
-		count += n;
-	}
-	assert(os_atomic_load_wide(&rt_run_queue->earliest_deadline, relaxed) == earliest_deadline);
-	assert(os_atomic_load(&rt_run_queue->count, relaxed) == count);
-	assert(os_atomic_load(&rt_run_queue->constraint, relaxed) == constraint);
-	assert(os_atomic_load(&rt_run_queue->ed_index, relaxed) == ed_index);
-	if (thread) {
-		assert(found_thread);
-	}
-}
-#define CHECK_RT_RUNQ_CONSISTENCY(q, th)    check_rt_runq_consistency(q, th)
-#else
-#define CHECK_RT_RUNQ_CONSISTENCY(q, th)    do {} while (0)
-#endif
-
 uint32_t rt_constraint_threshold;
 
 static bool
@@ -614,6 +581,9 @@ sched_timebase_init(void)
 	clock_interval_to_absolutetime_interval(1, NSEC_PER_SEC, &abstime);
 	sched_one_second_interval = abstime;
 
+	clock_interval_to_absolutetime_interval(1, NSEC_PER_USEC, &abstime);
+	sched_latency_hist_abstime_per_us = abstime;
+
 	SCHED(timebase_init)();
 	sched_realtime_timebase_init();
 }
@@ -770,19 +740,7 @@ sched_timeshare_timebase_init(void)
 void
 pset_rt_init(processor_set_t pset)
 {
-	for (int pri = BASEPRI_RTQUEUES; pri <= MAXPRI; pri++) {
-		int i = pri - BASEPRI_RTQUEUES;
-		rt_queue_pri_t *rqi = &pset->rt_runq.rt_queue_pri[i];
-		queue_init(&rqi->pri_queue);
-		rqi->pri_count = 0;
-		rqi->pri_earliest_deadline = RT_DEADLINE_NONE;
-		rqi->pri_constraint = RT_CONSTRAINT_NONE;
-	}
-	os_atomic_init(&pset->rt_runq.count, 0);
-	os_atomic_init(&pset->rt_runq.earliest_deadline, RT_DEADLINE_NONE);
-	os_atomic_init(&pset->rt_runq.constraint, RT_CONSTRAINT_NONE);
-	os_atomic_init(&pset->rt_runq.ed_index, NOPRI);
-	memset(&pset->rt_runq.runq_stats, 0, sizeof pset->rt_runq.runq_stats);
+	rt_runq_init(&pset->rt_runq);
 }
 
 /* epsilon for comparing RT deadlines */
@@ -2487,13 +2445,23 @@ pset_has_stealable_rt_threads(processor_set_t pset)
 	return rt_runq_count(pset) > bit_count(avail_map);
 }
 
+/*
+ * Summary of the psets whose stealable_rt_threads_earliest_deadline is set,
+ * updated lock-free by each pset alongside its own deadline. Looking for
+ * earlier RT threads on other psets only visits the psets in this map, which
+ * is empty whenever no pset has more RT threads than CPUs to run them.
+ */
+static _Atomic pset_map_t sched_rt_stealable_pset_map;
+
 static void
 pset_update_rt_stealable_state(processor_set_t pset)
 {
 	if (pset_has_stealable_rt_threads(pset)) {
 		pset->stealable_rt_threads_earliest_deadline = rt_runq_earliest_deadline(pset);
+		os_atomic_or(&sched_rt_stealable_pset_map, BIT(pset->pset_id), relaxed);
 	} else {
 		pset->stealable_rt_threads_earliest_deadline = RT_DEADLINE_NONE;
+		os_atomic_andnot(&sched_rt_stealable_pset_map, BIT(pset->pset_id), relaxed);
 	}
 }
 
@@ -2598,7 +2566,7 @@ static bool processor_is_fast_track_candidate_for_realtime_thread(processor_set_
 static bool
 other_psets_have_earlier_rt_threads_pending(processor_set_t stealing_pset, uint64_t earliest_deadline)
 {
-	pset_map_t pset_map = stealing_pset->node->pset_map;
+	pset_map_t pset_map = stealing_pset->node->pset_map & os_atomic_load(&sched_rt_stealable_pset_map, relaxed);
 
 	bit_clear(pset_map, stealing_pset->pset_id);
 
@@ -4021,6 +3989,8 @@ thread_dispatch(
 		latency = processor->last_dispatch - self->last_made_runnable_time;
 		assert(latency >= self->same_pri_latency);
 
+		sched_latency_hist_record(processor, self, latency);
+
 		urgency = thread_get_urgency(self, &arg1, &arg2);
 
 		thread_tell_urgency(urgency, arg1, arg2, latency, self);
@@ -4488,191 +4458,6 @@ run_queue_peek(
 	}
 }
 
-static bool
-rt_runq_enqueue(rt_queue_t rt_run_queue, thread_t thread, processor_t processor)
-{
-	int pri = thread->sched_pri;
-	assert((pri >= BASEPRI_RTQUEUES) && (pri <= MAXPRI));
-	int i = pri - BASEPRI_RTQUEUES;
-	rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
-	bitmap_t *map = rt_run_queue->bitmap;
-
-	bitmap_set(map, i);
-
-	queue_t     queue       = &rt_runq->pri_queue;
-	uint64_t    deadline    = thread->realtime.deadline;
-	bool        preempt     = false;
-	bool        earliest    = false;
-
-	if (queue_empty(queue)) {
-		enqueue_tail(queue, &thread->runq_links);
-		preempt = true;
-		earliest = true;
-		rt_runq->pri_earliest_deadline = deadline;
-		rt_runq->pri_constraint = thread->realtime.constraint;
-	} else {
-		/* Insert into rt_runq in thread deadline order */
-		queue_entry_t iter;
-		qe_foreach(iter, queue) {
-			thread_t iter_thread = qe_element(iter, struct thread, runq_links);
-			assert_thread_magic(iter_thread);
-
-			if (deadline < iter_thread->realtime.deadline) {
-				if (iter == queue_first(queue)) {
-					preempt = true;
-					earliest = true;
-					rt_runq->pri_earliest_deadline = deadline;
-					rt_runq->pri_constraint = thread->realtime.constraint;
-				}
-				insque(&thread->runq_links, queue_prev(iter));
-				break;
-			} else if (iter == queue_last(queue)) {
-				enqueue_tail(queue, &thread->runq_links);
-				break;
-			}
-		}
-	}
-	if (earliest && (deadline < os_atomic_load_wide(&rt_run_queue->earliest_deadline, relaxed))) {
-		os_atomic_store_wide(&rt_run_queue->earliest_deadline, deadline, relaxed);
-		os_atomic_store(&rt_run_queue->constraint, thread->realtime.constraint, relaxed);
-		os_atomic_store(&rt_run_queue->ed_index, pri - BASEPRI_RTQUEUES, relaxed);
-	}
-
-	SCHED_STATS_RUNQ_CHANGE(&rt_run_queue->runq_stats, os_atomic_load(&rt_run_queue->count, relaxed));
-	rt_runq->pri_count++;
-	os_atomic_inc(&rt_run_queue->count, relaxed);
-
-	thread_set_runq_locked(thread, processor);
-
-	CHECK_RT_RUNQ_CONSISTENCY(rt_run_queue, thread);
-
-	return preempt;
-}
-
-static thread_t
-rt_runq_dequeue(rt_queue_t rt_run_queue)
-{
-	bitmap_t *map = rt_run_queue->bitmap;
-	int i = bitmap_first(map, NRTQS);
-	assert((i >= 0) && (i < NRTQS));
-
-	rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
-
-	if (!sched_rt_runq_strict_priority) {
-		int ed_index = os_atomic_load(&rt_run_queue->ed_index, relaxed);
-		if (ed_index != i) {
-			assert((ed_index >= 0) && (ed_index < NRTQS));
-			rt_queue_pri_t *ed_runq = &rt_run_queue->rt_queue_pri[ed_index];
-
-			thread_t ed_thread = qe_queue_first(&ed_runq->pri_queue, struct thread, runq_links);
-			thread_t hi_thread = qe_queue_first(&rt_runq->pri_queue, struct thread, runq_links);
-
-			if (ed_thread->realtime.computation + hi_thread->realtime.computation + rt_deadline_epsilon < hi_thread->realtime.constraint) {
-				/* choose the earliest deadline thread */
-				rt_runq = ed_runq;
-				i = ed_index;
-			}
-		}
-	}
-
-	assert(rt_runq->pri_count > 0);
-	uint64_t earliest_deadline = RT_DEADLINE_NONE;
-	uint32_t constraint = RT_CONSTRAINT_NONE;
-	int ed_index = NOPRI;
-	thread_t new_thread = qe_dequeue_head(&rt_runq->pri_queue, struct thread, runq_links);
-	SCHED_STATS_RUNQ_CHANGE(&rt_run_queue->runq_stats, os_atomic_load(&rt_run_queue->count, relaxed));
-	if (--rt_runq->pri_count > 0) {
-		thread_t next_rt = qe_queue_first(&rt_runq->pri_queue, struct thread, runq_links);
-		assert(next_rt != THREAD_NULL);
-		earliest_deadline = next_rt->realtime.deadline;
-		constraint = next_rt->realtime.constraint;
-		ed_index = i;
-	} else {
-		bitmap_clear(map, i);
-	}
-	rt_runq->pri_earliest_deadline = earliest_deadline;
-	rt_runq->pri_constraint = constraint;
-
-	for (i = bitmap_first(map, NRTQS); i >= 0; i = bitmap_next(map, i)) {
-		rt_runq = &rt_run_queue->rt_queue_pri[i];
-		if (rt_runq->pri_earliest_deadline < earliest_deadline) {
-			earliest_deadline = rt_runq->pri_earliest_deadline;
-			constraint = rt_runq->pri_constraint;
-			ed_index = i;
-		}
-	}
-	os_atomic_store_wide(&rt_run_queue->earliest_deadline, earliest_deadline, relaxed);
-	os_atomic_store(&rt_run_queue->constraint, constraint, relaxed);
-	os_atomic_store(&rt_run_queue->ed_index, ed_index, relaxed);
-	os_atomic_dec(&rt_run_queue->count, relaxed);
-
-	thread_clear_runq(new_thread);
-
-	CHECK_RT_RUNQ_CONSISTENCY(rt_run_queue, THREAD_NULL);
-
-	return new_thread;
-}
-
-static thread_t
-rt_runq_first(rt_queue_t rt_run_queue)
-{
-	bitmap_t *map = rt_run_queue->bitmap;
-	int i = bitmap_first(map, NRTQS);
-	if (i < 0) {
-		return THREAD_NULL;
-	}
-	rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
-	thread_t next_rt = qe_queue_first(&rt_runq->pri_queue, struct thread, runq_links);
-
-	return next_rt;
-}
-
-static void
-rt_runq_remove(rt_queue_t rt_run_queue, thread_t thread)
-{
-	CHECK_RT_RUNQ_CONSISTENCY(rt_run_queue, thread);
-
-	int pri = thread->sched_pri;
-	assert((pri >= BASEPRI_RTQUEUES) && (pri <= MAXPRI));
-	int i = pri - BASEPRI_RTQUEUES;
-	rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
-	bitmap_t *map = rt_run_queue->bitmap;
-
-	assert(rt_runq->pri_count > 0);
-	uint64_t earliest_deadline = RT_DEADLINE_NONE;
-	uint32_t constraint = RT_CONSTRAINT_NONE;
-	int ed_index = NOPRI;
-	remqueue(&thread->runq_links);
-	SCHED_STATS_RUNQ_CHANGE(&rt_run_queue->runq_stats, os_atomic_load(&rt_run_queue->count, relaxed));
-	if (--rt_runq->pri_count > 0) {
-		thread_t next_rt = qe_queue_first(&rt_runq->pri_queue, struct thread, runq_links);
-		earliest_deadline = next_rt->realtime.deadline;
-		constraint = next_rt->realtime.constraint;
-		ed_index = i;
-	} else {
-		bitmap_clear(map, i);
-	}
-	rt_runq->pri_earliest_deadline = earliest_deadline;
-	rt_runq->pri_constraint = constraint;
-
-	for (i = bitmap_first(map, NRTQS); i >= 0; i = bitmap_next(map, i)) {
-		rt_runq = &rt_run_queue->rt_queue_pri[i];
-		if (rt_runq->pri_earliest_deadline < earliest_deadline) {
-			earliest_deadline = rt_runq->pri_earliest_deadline;
-			constraint = rt_runq->pri_constraint;
-			ed_index = i;
-		}
-	}
-	os_atomic_store_wide(&rt_run_queue->earliest_deadline, earliest_deadline, relaxed);
-	os_atomic_store(&rt_run_queue->constraint, constraint, relaxed);
-	os_atomic_store(&rt_run_queue->ed_index, ed_index, relaxed);
-	os_atomic_dec(&rt_run_queue->count, relaxed);
-
-	thread_clear_runq_locked(thread);
-
-	CHECK_RT_RUNQ_CONSISTENCY(rt_run_queue, THREAD_NULL);
-}
-
 rt_queue_t
 sched_rtlocal_runq(processor_set_t pset)
 {
@@ -4797,7 +4582,8 @@ retry:
 	target_pset = NULL;
 	target_deadline = earliest_deadline - rt_deadline_epsilon;
 
-	for (int pset_id = lsb_first(pset_map); pset_id >= 0; pset_id = lsb_next(pset_map, pset_id)) {
+	pset_map_t stealable_map = pset_map & os_atomic_load(&sched_rt_stealable_pset_map, relaxed);
+	for (int pset_id = lsb_first(stealable_map); pset_id >= 0; pset_id = lsb_next(stealable_map, pset_id)) {
 		processor_set_t nset = pset_array[pset_id];
 
 		/*
@@ -7955,6 +7741,48 @@ sched_stats_handle_runq_change(struct runq_stats *stats, int old_count)
 	stats->last_change_timestamp = timestamp;
 }
 
+uint32_t
+sched_latency_hist_get(uint64_t *hist, uint32_t npsets)
+{
+	const uint32_t pset_stride = SCHED_LATENCY_HIST_BUCKETS * SCHED_LATENCY_HIST_BINS;
+	uint32_t needed = 0;
+
+	percpu_foreach_base(pcpu_base) {
+		processor_t processor = PERCPU_GET_WITH_BASE(pcpu_base, processor);
+		struct sched_latency_hist *cpu_hist = PERCPU_GET_WITH_BASE(pcpu_base, sched_latency_hist);
+
+		if (processor->processor_set == PROCESSOR_SET_NULL) {
+			continue;
+		}
+		uint32_t pset_id = processor->processor_set->pset_id;
+		needed = MAX(needed, pset_id + 1);
+		if (pset_id >= npsets) {
+			continue;
+		}
+
+		uint64_t *pset_hist = &hist[pset_id * pset_stride];
+		for (uint32_t bucket = 0; bucket < SCHED_LATENCY_HIST_BUCKETS; bucket++) {
+			for (uint32_t bin = 0; bin < SCHED_LATENCY_HIST_BINS; bin++) {
+				pset_hist[bucket * SCHED_LATENCY_HIST_BINS + bin] +=
+				    os_atomic_load(&cpu_hist->slh_count[bucket][bin], relaxed);
+			}
+		}
+	}
+	return needed;
+}
+
+void
+sched_latency_hist_reset(void)
+{
+	percpu_foreach(cpu_hist, sched_latency_hist) {
+		for (uint32_t bucket = 0; bucket < SCHED_LATENCY_HIST_BUCKETS; bucket++) {
+			for (uint32_t bin = 0; bin < SCHED_LATENCY_HIST_BINS; bin++) {
+				os_atomic_store(&cpu_hist->slh_count[bucket][bin], 0, relaxed);
+			}
+		}
+	}
+}
+
 /*
  *     For calls from assembly code
  */
@@ -10034,6 +9862,7 @@ sched_update_pset_load_average(processor_set_t pset, uint64_t curtime)
 			KTRC(MACHDBG_CODE(DBG_MACH_SCHED_CLUTCH, MACH_SCHED_EDGE_LOAD_AVG) | DBG_FUNC_NONE, pset->pset_cluster_id, (load_average >> SCHED_PSET_LOAD_EWMA_FRACTION_BITS), load_average & SCHED_PSET_LOAD_EWMA_FRACTION_MASK, sched_bucket);
 		}
 	}
+	sched_edge_pset_overload_update(pset);
 	os_atomic_store(&pset->pset_load_last_update, curtime, relaxed);
 }
 
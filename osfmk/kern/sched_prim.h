@@ -86,6 +86,23 @@ extern int              thread_get_current_cpuid(void);
  */
 uint64_t sched_get_quantum_us(void);
 
+/*
+ * Runnable-to-dispatch latency histograms, kept per CPU and summed per pset.
+ *
+ * Bin 0 counts latencies under 1us, bin b counts [2^(b-1), 2^b) us and the
+ * last bin everything above. There is a bucket per sched_bucket_t up to
+ * TH_BUCKET_SCHED_MAX, followed by one for realtime threads.
+ */
+#define SCHED_LATENCY_HIST_BINS         24
+#define SCHED_LATENCY_HIST_BUCKETS      7
+
+/*
+ * Sums the per-CPU histograms into uint64_t[npsets][SCHED_LATENCY_HIST_BUCKETS][SCHED_LATENCY_HIST_BINS],
+ * indexed by pset_id, and returns the number of psets needed to hold them all.
+ */
+extern uint32_t sched_latency_hist_get(uint64_t *hist, uint32_t npsets);
+extern void sched_latency_hist_reset(void);
+
 #endif /* XNU_KERNEL_PRIVATE */
 
 #if defined(MACH_KERNEL_PRIVATE) || SCHED_TEST_HARNESS
@@ -103,6 +120,21 @@ extern void             sched_timebase_init(void);
 
 extern void             pset_rt_init(processor_set_t pset);
 
+/* Realtime runqueue primitives, see sched_rt.c; the pset lock must be held */
+extern void             rt_runq_init(rt_queue_t rt_run_queue);
+
+extern bool             rt_runq_enqueue(rt_queue_t rt_run_queue, thread_t thread, processor_t processor);
+
+extern thread_t         rt_runq_dequeue(rt_queue_t rt_run_queue);
+
+extern thread_t         rt_runq_first(rt_queue_t rt_run_queue);
+
+extern void             rt_runq_remove(rt_queue_t rt_run_queue, thread_t thread);
+
+extern uint32_t         rt_deadline_epsilon;
+
+extern int              sched_rt_runq_strict_priority;
+
 extern void             sched_rtlocal_init(processor_set_t pset);
 
 extern rt_queue_t       sched_rtlocal_runq(processor_set_t pset);
@@ -490,6 +522,13 @@ struct sched_statistics {
 PERCPU_DECL(struct sched_statistics, sched_stats);
 extern bool             sched_stats_active;
 
+#define SCHED_LATENCY_HIST_RT_BUCKET    TH_BUCKET_SCHED_MAX
+
+struct sched_latency_hist {
+	uint64_t        slh_count[SCHED_LATENCY_HIST_BUCKETS][SCHED_LATENCY_HIST_BINS];
+};
+PERCPU_DECL(struct sched_latency_hist, sched_latency_hist);
+
 extern void sched_stats_handle_csw(
 	processor_t processor,
 	int reasons,
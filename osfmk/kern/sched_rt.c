@@ -0,0 +1,345 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#if !SCHED_TEST_HARNESS
+
+#include <mach/mach_types.h>
+#include <kern/kern_types.h>
+#include <kern/debug.h>
+#include <kern/misc_protos.h>
+#include <kern/queue.h>
+#include <kern/sched.h>
+#include <kern/thread.h>
+
+#endif /* !SCHED_TEST_HARNESS */
+
+#include <kern/processor.h>
+#include <kern/sched_prim.h>
+#include <kern/priority_queue.h>
+
+/*
+ * Realtime run queue
+ *
+ * The highest runnable realtime priority is found through the rt_queue
+ * bitmap. Within a priority level, threads sit in a deadline min-heap
+ * (rt_queue_pri_t.pri_deadline_queue), and the non-empty levels sit in a
+ * second min-heap keyed by their earliest deadline (rt_queue.ed_queue). Both
+ * the strict priority and the earliest deadline choices are therefore read
+ * off heap roots, and enqueue, dequeue and remove are O(log n) in the number
+ * of threads rather than a sorted list insert plus a rescan of every level.
+ *
+ * Threads are also linked in enqueue order on rt_queue_pri_t.pri_queue, so
+ * that scans of the runqueue don't need to walk the heaps.
+ *
+ * Each enqueue stamps the thread with the next rt_queue.enqueue_seq, which
+ * breaks deadline ties in both heaps: threads with equal deadlines at the
+ * same priority come out in FIFO order, as with the sorted lists the heaps
+ * replaced, and an equal deadline never preempts.  Levels whose earliest
+ * deadlines are equal are ordered by the stamp of that thread.
+ *
+ * All routines expect the pset lock to be held. The earliest_deadline,
+ * constraint and count fields of the rt_queue are published with atomic
+ * stores for lock-free readers on other processors.
+ */
+
+static inline thread_t
+rt_runq_pri_first(rt_queue_pri_t *rt_runq)
+{
+	return priority_queue_min(&rt_runq->pri_deadline_queue, struct thread, rt_runq_link);
+}
+
+#if DEBUG
+static void
+check_rt_runq_consistency(rt_queue_t rt_run_queue, thread_t thread)
+{
+	bitmap_t *map = rt_run_queue->bitmap;
+
+	uint64_t earliest_deadline = RT_DEADLINE_NONE;
+	int count = 0;
+	bool found_thread = false;
+
+	for (int i = 0; i < NRTQS; i++) {
+		rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
+		uint64_t pri_earliest_deadline = RT_DEADLINE_NONE;
+		thread_t iter_thread;
+		int n = 0;
+
+		qe_foreach_element(iter_thread, &rt_runq->pri_queue, runq_links) {
+			assert_thread_magic(iter_thread);
+			if (iter_thread == thread) {
+				found_thread = true;
+			}
+			assert(iter_thread->sched_pri == (i + BASEPRI_RTQUEUES));
+			assert(iter_thread->realtime.deadline < RT_DEADLINE_NONE);
+			assert(iter_thread->realtime.constraint < RT_CONSTRAINT_NONE);
+			assert(iter_thread->rt_runq_link.deadline == iter_thread->realtime.deadline);
+			assert(iter_thread->rt_runq_link.stamp <= rt_run_queue->enqueue_seq);
+			if (iter_thread->realtime.deadline < pri_earliest_deadline) {
+				pri_earliest_deadline = iter_thread->realtime.deadline;
+			}
+			n++;
+		}
+		assert(n == rt_runq->pri_count);
+		assert(rt_runq->pri_ed_link.deadline == pri_earliest_deadline);
+		if (n == 0) {
+			assert(bitmap_test(map, i) == false);
+			assert(priority_queue_empty(&rt_runq->pri_deadline_queue));
+			assert(rt_runq->pri_constraint == RT_CONSTRAINT_NONE);
+		} else {
+			thread_t first = rt_runq_pri_first(rt_runq);
+			assert(bitmap_test(map, i) == true);
+			assert(first->realtime.deadline == pri_earliest_deadline);
+			assert(rt_runq->pri_ed_link.stamp == first->rt_runq_link.stamp);
+			assert(rt_runq->pri_constraint == first->realtime.constraint);
+		}
+		if (pri_earliest_deadline < earliest_deadline) {
+			earliest_deadline = pri_earliest_deadline;
+		}
+		count += n;
+	}
+	assert(os_atomic_load_wide(&rt_run_queue->earliest_deadline, relaxed) == earliest_deadline);
+	assert(os_atomic_load(&rt_run_queue->count, relaxed) == count);
+
+	int ed_index = os_atomic_load(&rt_run_queue->ed_index, relaxed);
+	if (count == 0) {
+		assert(ed_index == NOPRI);
+		assert(priority_queue_empty(&rt_run_queue->ed_queue));
+		assert(os_atomic_load(&rt_run_queue->constraint, relaxed) == RT_CONSTRAINT_NONE);
+	} else {
+		assert((ed_index >= 0) && (ed_index < NRTQS));
+		assert(rt_run_queue->rt_queue_pri[ed_index].pri_ed_link.deadline == earliest_deadline);
+		assert(os_atomic_load(&rt_run_queue->constraint, relaxed) == rt_run_queue->rt_queue_pri[ed_index].pri_constraint);
+	}
+	if (thread) {
+		assert(found_thread);
+	}
+}
+#define CHECK_RT_RUNQ_CONSISTENCY(q, th)    check_rt_runq_consistency(q, th)
+#else
+#define CHECK_RT_RUNQ_CONSISTENCY(q, th)    do {} while (0)
+#endif
+
+void
+rt_runq_init(rt_queue_t rt_run_queue)
+{
+	for (int i = 0; i < NRTQS; i++) {
+		rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
+		queue_init(&rt_runq->pri_queue);
+		priority_queue_init(&rt_runq->pri_deadline_queue);
+		priority_queue_entry_init(&rt_runq->pri_ed_link);
+		rt_runq->pri_ed_link.deadline = RT_DEADLINE_NONE;
+		rt_runq->pri_count = 0;
+		rt_runq->pri_constraint = RT_CONSTRAINT_NONE;
+	}
+	bitmap_zero(rt_run_queue->bitmap, NRTQS);
+	priority_queue_init(&rt_run_queue->ed_queue);
+	rt_run_queue->enqueue_seq = 0;
+	os_atomic_init(&rt_run_queue->count, 0);
+	os_atomic_init(&rt_run_queue->earliest_deadline, RT_DEADLINE_NONE);
+	os_atomic_init(&rt_run_queue->constraint, RT_CONSTRAINT_NONE);
+	os_atomic_init(&rt_run_queue->ed_index, NOPRI);
+	memset(&rt_run_queue->runq_stats, 0, sizeof rt_run_queue->runq_stats);
+}
+
+/*
+ * Re-keys priority level i in the ed_queue after the root of its deadline
+ * heap may have changed, adding or removing the level when it turns
+ * non-empty or empty.
+ */
+static void
+rt_runq_pri_update(rt_queue_t rt_run_queue, int i, bool was_empty)
+{
+	rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
+
+	if (rt_runq->pri_count == 0) {
+		assert(!was_empty);
+		bitmap_clear(rt_run_queue->bitmap, i);
+		priority_queue_remove(&rt_run_queue->ed_queue, &rt_runq->pri_ed_link);
+		rt_runq->pri_ed_link.deadline = RT_DEADLINE_NONE;
+		rt_runq->pri_constraint = RT_CONSTRAINT_NONE;
+		return;
+	}
+
+	thread_t next_rt = rt_runq_pri_first(rt_runq);
+	uint64_t old_deadline = rt_runq->pri_ed_link.deadline;
+	uint64_t old_stamp = rt_runq->pri_ed_link.stamp;
+	uint64_t new_deadline = next_rt->rt_runq_link.deadline;
+	uint64_t new_stamp = next_rt->rt_runq_link.stamp;
+
+	rt_runq->pri_ed_link.deadline = new_deadline;
+	rt_runq->pri_ed_link.stamp = new_stamp;
+	rt_runq->pri_constraint = next_rt->realtime.constraint;
+
+	if (was_empty) {
+		bitmap_set(rt_run_queue->bitmap, i);
+		priority_queue_insert(&rt_run_queue->ed_queue, &rt_runq->pri_ed_link);
+	} else if (new_deadline < old_deadline ||
+	    (new_deadline == old_deadline && new_stamp < old_stamp)) {
+		priority_queue_entry_decreased(&rt_run_queue->ed_queue, &rt_runq->pri_ed_link);
+	} else if (new_deadline > old_deadline || new_stamp > old_stamp) {
+		priority_queue_entry_increased(&rt_run_queue->ed_queue, &rt_runq->pri_ed_link);
+	}
+}
+
+/*
+ * Publishes the earliest deadline of the whole runqueue, which is the key
+ * of the ed_queue root.
+ */
+static void
+rt_runq_update_earliest_deadline(rt_queue_t rt_run_queue)
+{
+	uint64_t earliest_deadline = RT_DEADLINE_NONE;
+	uint32_t constraint = RT_CONSTRAINT_NONE;
+	int ed_index = NOPRI;
+
+	rt_queue_pri_t *ed_runq = priority_queue_min(&rt_run_queue->ed_queue, rt_queue_pri_t, pri_ed_link);
+	if (ed_runq != NULL) {
+		earliest_deadline = ed_runq->pri_ed_link.deadline;
+		constraint = ed_runq->pri_constraint;
+		ed_index = (int)(ed_runq - rt_run_queue->rt_queue_pri);
+	}
+	os_atomic_store_wide(&rt_run_queue->earliest_deadline, earliest_deadline, relaxed);
+	os_atomic_store(&rt_run_queue->constraint, constraint, relaxed);
+	os_atomic_store(&rt_run_queue->ed_index, ed_index, relaxed);
+}
+
+/*
+ * Returns true if the thread now has the earliest deadline of its priority
+ * level, in which case it should preempt.
+ */
+bool
+rt_runq_enqueue(rt_queue_t rt_run_queue, thread_t thread, processor_t processor)
+{
+	int pri = thread->sched_pri;
+	assert((pri >= BASEPRI_RTQUEUES) && (pri <= MAXPRI));
+	int i = pri - BASEPRI_RTQUEUES;
+	rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
+	bool was_empty = (rt_runq->pri_count == 0);
+
+	enqueue_tail(&rt_runq->pri_queue, &thread->runq_links);
+	priority_queue_entry_init(&thread->rt_runq_link);
+	thread->rt_runq_link.deadline = thread->realtime.deadline;
+	thread->rt_runq_link.stamp = ++rt_run_queue->enqueue_seq;
+	bool preempt = priority_queue_insert(&rt_runq->pri_deadline_queue, &thread->rt_runq_link);
+
+	SCHED_STATS_RUNQ_CHANGE(&rt_run_queue->runq_stats, os_atomic_load(&rt_run_queue->count, relaxed));
+	rt_runq->pri_count++;
+	os_atomic_inc(&rt_run_queue->count, relaxed);
+
+	if (preempt) {
+		rt_runq_pri_update(rt_run_queue, i, was_empty);
+		rt_runq_update_earliest_deadline(rt_run_queue);
+	}
+
+	thread_set_runq_locked(thread, processor);
+
+	CHECK_RT_RUNQ_CONSISTENCY(rt_run_queue, thread);
+
+	return preempt;
+}
+
+thread_t
+rt_runq_dequeue(rt_queue_t rt_run_queue)
+{
+	bitmap_t *map = rt_run_queue->bitmap;
+	int i = bitmap_first(map, NRTQS);
+	assert((i >= 0) && (i < NRTQS));
+
+	rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
+
+	if (!sched_rt_runq_strict_priority) {
+		int ed_index = os_atomic_load(&rt_run_queue->ed_index, relaxed);
+		if (ed_index != i) {
+			assert((ed_index >= 0) && (ed_index < NRTQS));
+			rt_queue_pri_t *ed_runq = &rt_run_queue->rt_queue_pri[ed_index];
+
+			thread_t ed_thread = rt_runq_pri_first(ed_runq);
+			thread_t hi_thread = rt_runq_pri_first(rt_runq);
+
+			if (ed_thread->realtime.computation + hi_thread->realtime.computation + rt_deadline_epsilon < hi_thread->realtime.constraint) {
+				/* choose the earliest deadline thread */
+				rt_runq = ed_runq;
+				i = ed_index;
+			}
+		}
+	}
+
+	assert(rt_runq->pri_count > 0);
+	thread_t new_thread = priority_queue_remove_min(&rt_runq->pri_deadline_queue, struct thread, rt_runq_link);
+	remqueue(&new_thread->runq_links);
+	SCHED_STATS_RUNQ_CHANGE(&rt_run_queue->runq_stats, os_atomic_load(&rt_run_queue->count, relaxed));
+	rt_runq->pri_count--;
+	os_atomic_dec(&rt_run_queue->count, relaxed);
+
+	rt_runq_pri_update(rt_run_queue, i, false);
+	rt_runq_update_earliest_deadline(rt_run_queue);
+
+	thread_clear_runq(new_thread);
+
+	CHECK_RT_RUNQ_CONSISTENCY(rt_run_queue, THREAD_NULL);
+
+	return new_thread;
+}
+
+thread_t
+rt_runq_first(rt_queue_t rt_run_queue)
+{
+	bitmap_t *map = rt_run_queue->bitmap;
+	int i = bitmap_first(map, NRTQS);
+	if (i < 0) {
+		return THREAD_NULL;
+	}
+	return rt_runq_pri_first(&rt_run_queue->rt_queue_pri[i]);
+}
+
+void
+rt_runq_remove(rt_queue_t rt_run_queue, thread_t thread)
+{
+	CHECK_RT_RUNQ_CONSISTENCY(rt_run_queue, thread);
+
+	int pri = thread->sched_pri;
+	assert((pri >= BASEPRI_RTQUEUES) && (pri <= MAXPRI));
+	int i = pri - BASEPRI_RTQUEUES;
+	rt_queue_pri_t *rt_runq = &rt_run_queue->rt_queue_pri[i];
+
+	assert(rt_runq->pri_count > 0);
+	bool was_first = priority_queue_remove(&rt_runq->pri_deadline_queue, &thread->rt_runq_link);
+	remqueue(&thread->runq_links);
+	SCHED_STATS_RUNQ_CHANGE(&rt_run_queue->runq_stats, os_atomic_load(&rt_run_queue->count, relaxed));
+	rt_runq->pri_count--;
+	os_atomic_dec(&rt_run_queue->count, relaxed);
+
+	if (was_first) {
+		rt_runq_pri_update(rt_run_queue, i, false);
+		rt_runq_update_earliest_deadline(rt_run_queue);
+	}
+
+	thread_clear_runq_locked(thread);
+
+	CHECK_RT_RUNQ_CONSISTENCY(rt_run_queue, THREAD_NULL);
+}
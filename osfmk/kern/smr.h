@@ -1074,6 +1074,25 @@ extern struct smr smr_system_sleepable;
 #define smr_proc_task_barrier()         smr_barrier(&smr_proc_task)
 
 
+/*!
+ * @brief
+ * The SMR domain for VM map entries (speculative page faults).
+ *
+ * @discussion
+ * VM maps use their own domain: map entries are retired at a high rate
+ * by mmap/munmap heavy processes, and sharing @c smr_system would make
+ * every other subsystem's @c smr_synchronize() wait on them.
+ */
+extern struct smr smr_vm_map;
+#define smr_vm_map_entered()            smr_entered(&smr_vm_map)
+#define smr_vm_map_enter()              smr_enter(&smr_vm_map)
+#define smr_vm_map_leave()              smr_leave(&smr_vm_map)
+
+#define smr_vm_map_call(n, sz, cb)      smr_call(&smr_vm_map, n, sz, cb)
+#define smr_vm_map_synchronize()        smr_synchronize(&smr_vm_map)
+#define smr_vm_map_barrier()            smr_barrier(&smr_vm_map)
+
+
 /*!
  * @macro smr_iokit
  *
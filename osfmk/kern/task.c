@@ -1843,6 +1843,8 @@ task_create_internal(
 	counter_alloc(&(new_task->pages_grabbed_kern));
 	counter_alloc(&(new_task->pages_grabbed_iopl));
 	counter_alloc(&(new_task->pages_grabbed_upl));
+	counter_alloc(&(new_task->refaults));
+	counter_alloc(&(new_task->refaults_activated));
 
 	/* Copy resource acc. info from Parent for Corpe Forked task. */
 	if (parent_task != NULL && (t_flags & TF_CORPSE_FORK)) {
@@ -2005,6 +2007,8 @@ task_rollup_accounting_info(task_t to_task, task_t from_task)
 	counter_add(&to_task->cow_faults, counter_load(&from_task->cow_faults));
 	counter_add(&to_task->messages_sent, counter_load(&from_task->messages_sent));
 	counter_add(&to_task->messages_received, counter_load(&from_task->messages_received));
+	counter_add(&to_task->refaults, counter_load(&from_task->refaults));
+	counter_add(&to_task->refaults_activated, counter_load(&from_task->refaults_activated));
 	to_task->decompressions = from_task->decompressions;
 	to_task->syscalls_mach = from_task->syscalls_mach;
 	to_task->syscalls_unix = from_task->syscalls_unix;
@@ -2234,6 +2238,8 @@ task_deallocate_internal(
 	counter_free(&task->pages_grabbed_kern);
 	counter_free(&task->pages_grabbed_iopl);
 	counter_free(&task->pages_grabbed_upl);
+	counter_free(&task->refaults);
+	counter_free(&task->refaults_activated);
 
 #if CONFIG_COALITIONS
 	task_release_coalitions(task);
@@ -6152,6 +6158,11 @@ task_info(
 			    &vm_info->ledger_tag_neural_nofootprint_peak);
 			*task_info_count = TASK_VM_INFO_REV7_COUNT;
 		}
+		if (original_task_info_count >= TASK_VM_INFO_REV8_COUNT) {
+			vm_info->refaults = (int32_t) MIN(counter_load(&task->refaults), INT32_MAX);
+			vm_info->refaults_activated = (int32_t) MIN(counter_load(&task->refaults_activated), INT32_MAX);
+			*task_info_count = TASK_VM_INFO_REV8_COUNT;
+		}
 
 		break;
 	}
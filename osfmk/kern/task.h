@@ -297,6 +297,8 @@ struct task {
 	counter_t pages_grabbed_kern; /* pages grabbed (kernel) */
 	counter_t pages_grabbed_iopl; /* pages grabbed (iopl) */
 	counter_t pages_grabbed_upl;  /* pages grabbed (upl) */
+	counter_t refaults;           /* file pages read back soon after eviction */
+	counter_t refaults_activated; /* of which were part of the working set */
 	uint32_t decompressions;      /* decompression counter (from threads that already terminated) */
 	uint32_t syscalls_mach;       /* mach system call counter */
 	uint32_t syscalls_unix;       /* unix system call counter */
@@ -409,6 +409,7 @@ struct thread {
 		struct mpsc_queue_chain         mpsc_links;             /* thread daemon mpsc links */
 		struct priority_queue_entry_sched wait_prioq_links;       /* priority ordered waitq links */
 	};
+	struct priority_queue_entry_deadline_stable rt_runq_link; /* realtime run queue deadline heap linkage, valid when runq_links is */
 
 	event64_t               wait_event;     /* wait queue event */
 	struct { processor_t    runq; } __runq; /* internally managed run queue assignment, see above comment */
@@ -342,6 +342,10 @@ struct zone_magazine {
  * in the depot or shrink it based on the @c zc_grow_level and @c zc_shrink_level
  * thresholds.
  *
+ * The ceiling for the number of buckets (@c z_depot_limit) is itself tuned
+ * per zone by @c zone_cache_tune(), from the zone allocation rate,
+ * contention and recirculation rate.
+ *
  * The per-cpu layer will attempt to work with its depot, finding both full and
  * empty magazines cached there. If it can't get what it needs, then it will
  * mediate with the zone recirculation layer. Such recirculation is done in
@@ -618,6 +622,21 @@ static int zalloc_simulate_vm_pressure;
  * zc_free_batch_size
  *   The size of batches of frees/reclaim that can be done keeping
  *   the zone lock held (and preemption disabled).
+ *
+ * zc_tune_boost
+ *   how many times the default depot limit (derived from zc_pcpu_max)
+ *   a contended zone can be allowed by zone_cache_tune().
+ *
+ *   1 to disable.
+ *
+ * zc_tune_cold_rate
+ *   number of allocations per second below which a zone is considered cold.
+ *
+ * zc_tune_cold_periods
+ *   number of consecutive working set periods a zone must be cold
+ *   before zone_cache_tune() shrinks its depot limit.
+ *
+ *   0 to disable.
  */
 Z_TUNABLE(uint16_t, zc_mag_size, 8);
 static Z_TUNABLE(uint32_t, zc_enable_level, 10);
@@ -627,6 +646,9 @@ static Z_TUNABLE(uint32_t, zc_pcpu_max, 128 << 10);
 static Z_TUNABLE(uint32_t, zc_autotrim_size, 16 << 10);
 static Z_TUNABLE(uint32_t, zc_autotrim_buckets, 8);
 static Z_TUNABLE(uint32_t, zc_free_batch_size, 128);
+static Z_TUNABLE(uint32_t, zc_tune_boost, 4);
+static Z_TUNABLE(uint32_t, zc_tune_cold_rate, 64);
+static Z_TUNABLE(uint32_t, zc_tune_cold_periods, 4);
 
 static SECURITY_READ_ONLY_LATE(size_t)    zone_pages_wired_max;
 static SECURITY_READ_ONLY_LATE(vm_map_t)  zone_submaps[Z_SUBMAP_IDX_COUNT];
@@ -2388,6 +2410,8 @@ zone_recirc_lock_nopreempt_check_contention(zone_t zone)
 {
 	uint32_t ticket;
 
+	zpercpu_get(zone->z_stats)->zs_recirc++;
+
 	if (__probable(hw_lck_ticket_reserve_nopreempt(&zone->z_recirc_lock,
 	    &ticket, &zone_locks_grp))) {
 		return;
@@ -2797,15 +2821,20 @@ zone_magazine_free_list(struct zone_depot *zd)
 	zd->zd_empty = 0;
 }
 
+static uint16_t
+zone_depot_limit_default(zone_t zone)
+{
+	size_t size_per_mag = zone_elem_inner_size(zone) * zc_mag_size();
+
+	return (uint16_t)MIN(zc_pcpu_max() / size_per_mag, INT16_MAX);
+}
+
 void
 zone_enable_caching(zone_t zone)
 {
-	size_t size_per_mag = zone_elem_inner_size(zone) * zc_mag_size();
 	zone_cache_t caches;
-	size_t depot_limit;
 
-	depot_limit = zc_pcpu_max() / size_per_mag;
-	zone->z_depot_limit = (uint16_t)MIN(depot_limit, INT16_MAX);
+	zone->z_depot_limit = zone_depot_limit_default(zone);
 
 	caches = zalloc_percpu_permanent_type(struct zone_cache);
 	zpercpu_foreach(zc, caches) {
@@ -2822,6 +2851,9 @@ zone_enable_caching(zone_t zone)
 	zone->z_recirc_cont_wma = 0;
 	zone->z_elems_free_min = 0; /* becomes z_recirc_empty_min */
 	zone->z_elems_free_wma = 0; /* becomes z_recirc_empty_wma */
+	zone->z_tune_allocated = 0;
+	zone->z_tune_recirc = 0;
+	zone->z_tune_idle = 0;
 	zone_unlock(zone);
 }
 
@@ -6273,6 +6305,67 @@ void
 	zfree_ext(zone, zstats, addr, ZFREE_PACK_SIZE(esize, esize));
 }
 
+void
+zfree_bulk(zone_t zov, void **elems, uint32_t count)
+{
+	zone_t zone = zov->z_self;
+	zone_stats_t zstats = zov->z_stats;
+	vm_offset_t esize = zone_elem_inner_size(zone);
+	zone_cache_t cache;
+	uint32_t n = 0, m;
+	int cpu;
+
+	assert(zone > &zone_array[ZONE_ID__LAST_RO]);
+	assert(!zone->z_percpu && !zone->z_permanent && !zone->z_smr);
+
+#if KASAN_CLASSIC
+	/* elements have to go through the quarantine one by one */
+	const bool batched = false;
+#else
+	const bool batched = zone->z_pcpu_cache != NULL;
+#endif /* KASAN_CLASSIC */
+
+	if (!batched) {
+		for (; n < count; n++) {
+			vm_memtag_bzero_fast_checked(elems[n], esize);
+			zfree_ext(zone, zstats, elems[n], ZFREE_PACK_SIZE(esize, esize));
+		}
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		vm_offset_t elem = (vm_offset_t)elems[i];
+
+		vm_memtag_bzero_fast_checked(elems[i], esize);
+		DTRACE_VM2(zfree, zone_t, zone, void*, elem);
+		ZFREE_LOG(zone, elem, 1);
+		elems[i] = (void *)__zcache_mark_invalid(zone, elem,
+		    ZFREE_PACK_SIZE(esize, esize));
+	}
+
+	while (n < count) {
+		disable_preemption();
+		cpu = cpu_number();
+
+		cache = zfree_cached_get_pcpu_cache(zone, cpu);
+		if (__improbable(cache == NULL)) {
+			zpercpu_get_cpu(zstats, cpu)->zs_mem_freed += esize;
+			/* transfers the preemption disable to the zone lock */
+			zfree_item(zone, (vm_offset_t)elems[n++]);
+			continue;
+		}
+
+		m = MIN(count - n, (uint32_t)(zc_mag_size() - cache->zc_free_cur));
+		zpercpu_get_cpu(zstats, cpu)->zs_mem_freed += m * esize;
+		do {
+			cache->zc_free_elems[cache->zc_free_cur++] =
+			    (vm_offset_t)elems[n++];
+		} while (--m > 0);
+
+		enable_preemption();
+	}
+}
+
 __attribute__((noinline))
 void
 zfree_percpu(union zone_or_view zov, void *addr)
@@ -6340,6 +6433,17 @@ void
 	zone_cache_t cache;
 	int cpu;
 
+	if (__improbable(zone->z_pcpu_cache == NULL)) {
+		/*
+		 * A ZC_SMR zone whose domain isn't bound yet (bootstrap):
+		 * there can't be any reader, free the element right away.
+		 */
+		esize = zone_elem_inner_size(zone);
+		vm_memtag_bzero_fast_checked(addr, esize);
+		zfree_ext(zone, zone->z_stats, addr, ZFREE_PACK_SIZE(esize, esize));
+		return;
+	}
+
 	ZFREE_LOG(zone, elem, 1);
 
 	disable_preemption();
@@ -7092,6 +7196,72 @@ zstack_t
 	return zcache_alloc_n_ext(zid, count, flags, ops);
 }
 
+uint32_t
+zalloc_bulk(zone_t zov, void **elems, uint32_t count, zalloc_flags_t flags)
+{
+	zone_t zone = zov->z_self;
+	zone_stats_t zstats = zov->z_stats;
+	vm_offset_t esize = zone_elem_inner_size(zone);
+	bool batched = zone->z_pcpu_cache != NULL;
+	zone_cache_t cache;
+	uint32_t n = 0, m;
+	int cpu;
+
+	assert(zone > &zone_array[ZONE_ID__LAST_RO]);
+	assert(!zone->z_percpu && !zone->z_smr);
+	assert(startup_phase < STARTUP_SUB_EARLY_BOOT ||
+	    ml_get_interrupts_enabled());
+
+#if VM_TAG_SIZECLASSES
+	/* the tag is resolved per allocation by zalloc_ext() */
+	if (__improbable(zone->z_uses_tags)) {
+		batched = false;
+	}
+#endif /* VM_TAG_SIZECLASSES */
+#if ZALLOC_ENABLE_ZERO_CHECK
+	if (zalloc_skip_zero_check()) {
+		flags |= Z_NOZZC;
+	}
+#endif
+
+	while (batched && n < count) {
+		disable_preemption();
+		cpu = cpu_number();
+
+		cache = zalloc_cached_get_pcpu_cache(zone, NULL, cpu, flags);
+		if (__improbable(cache == NULL)) {
+			/* out of cached elements, let zalloc_ext() refill */
+			enable_preemption();
+			break;
+		}
+
+		m = MIN(count - n, (uint32_t)cache->zc_alloc_cur);
+		zpercpu_get_cpu(zstats, cpu)->zs_mem_allocated += m * esize;
+		for (uint32_t i = n; i < n + m; i++) {
+			vm_offset_t index = --cache->zc_alloc_cur;
+
+			elems[i] = (void *)cache->zc_alloc_elems[index];
+			cache->zc_alloc_elems[index] = 0;
+		}
+
+		enable_preemption();
+
+		for (; m > 0; m--, n++) {
+			elems[n] = zalloc_return(zone, (vm_offset_t)elems[n],
+			    flags, esize).addr;
+		}
+	}
+
+	for (; n < count; n++) {
+		elems[n] = zalloc_ext(zone, zstats, flags).addr;
+		if (__improbable(elems[n] == NULL)) {
+			break;
+		}
+	}
+
+	return n;
+}
+
 __attribute__((always_inline))
 void *
 zalloc(zone_t zov)
@@ -8082,6 +8252,153 @@ zone_trim_async(__unused thread_call_param_t p0, __unused thread_call_param_t p1
 	current_thread()->options &= ~TH_OPT_ZONE_PRIV;
 }
 
+/*
+ * Per-zone cache auto-tuning
+ *
+ * compute_zone_working_set_size() grows the per-cpu depots of a zone
+ * (z_depot_size) while its recirculation lock is contended and shrinks
+ * them when it isn't, but never past z_depot_limit, which by default only
+ * depends on the element size (see zone_depot_limit_default()).
+ *
+ * zone_cache_tune() moves that limit for each zone:
+ * - zones that reached their limit and are still contended and cycling
+ *   magazines through the recirculation depot get a larger limit,
+ *   up to zc_tune_boost() times the default;
+ * - zones whose allocation rate stays under zc_tune_cold_rate()
+ *   for zc_tune_cold_periods() periods have their limit halved,
+ *   so that memory cached in their per-cpu depots is given back;
+ * - otherwise the limit drifts back to the default.
+ *
+ * Decisions are reported by the kern.zone_cache_tuning sysctl.
+ */
+static void
+zone_cache_tune_sample(zone_t z)
+{
+	uint64_t allocated = 0, recirc = 0, rate;
+	uint32_t period = zpercpu_count() * ZONE_WSS_UPDATE_PERIOD;
+	bool first = (z->z_tune_allocated == 0 && z->z_tune_recirc == 0);
+
+	zpercpu_foreach(zs, z->z_stats) {
+		allocated += zs->zs_mem_allocated;
+		recirc += zs->zs_recirc;
+	}
+	for (zone_view_t zv = z->z_views; zv; zv = zv->zv_next) {
+		if (zv->zv_stats == z->z_stats) {
+			continue;
+		}
+		zpercpu_foreach(zs, zv->zv_stats) {
+			allocated += zs->zs_mem_allocated;
+		}
+	}
+
+	if (!first) {
+		rate = (allocated - z->z_tune_allocated) /
+		    zone_elem_inner_size(z) / ZONE_WSS_UPDATE_PERIOD;
+		rate = (3 * (uint64_t)z->z_tune_alloc_rate + rate) / 4;
+		z->z_tune_alloc_rate = (uint32_t)MIN(rate, UINT32_MAX);
+
+		rate = (recirc - z->z_tune_recirc) * Z_WMA_UNIT / period;
+		rate = (3 * (uint64_t)z->z_tune_recirc_wma + rate) / 4;
+		z->z_tune_recirc_wma = (uint32_t)MIN(rate, UINT32_MAX);
+	}
+
+	z->z_tune_allocated = allocated;
+	z->z_tune_recirc = recirc;
+}
+
+static void
+zone_cache_tune(zone_t z, uint32_t cont)
+{
+	uint32_t def = zone_depot_limit_default(z);
+	uint32_t max = MIN(def * MAX(zc_tune_boost(), 1), INT16_MAX);
+	uint32_t limit = z->z_depot_limit;
+	uint8_t decision = ZONE_CACHE_TUNE_NONE;
+
+	zone_cache_tune_sample(z);
+
+	if (zone_exhausted(z)) {
+		z->z_tune_decision = decision;
+		return;
+	}
+
+	if (z->z_tune_alloc_rate < zc_tune_cold_rate()) {
+		if (z->z_tune_idle < UINT16_MAX) {
+			z->z_tune_idle++;
+		}
+	} else {
+		z->z_tune_idle = 0;
+	}
+
+	if (zc_tune_cold_periods() &&
+	    z->z_tune_idle >= zc_tune_cold_periods()) {
+		if (limit > 0) {
+			limit /= 2;
+			decision = ZONE_CACHE_TUNE_SHRINK;
+		}
+	} else if (z->z_depot_size >= limit && limit < max &&
+	    cont > zc_grow_level() && z->z_tune_recirc_wma > zc_grow_level()) {
+		limit = limit < def ? def : MIN(max, (3 * limit + 2) / 2);
+		decision = ZONE_CACHE_TUNE_GROW;
+	} else if (limit > def && cont <= zc_shrink_level()) {
+		limit -= MAX((limit - def) / 2, 1);
+		decision = ZONE_CACHE_TUNE_RELAX;
+	} else if (limit < def && z->z_tune_idle == 0) {
+		limit = def;
+		decision = ZONE_CACHE_TUNE_RELAX;
+	}
+
+	if (decision == ZONE_CACHE_TUNE_GROW) {
+		z->z_tune_grows++;
+	} else if (decision == ZONE_CACHE_TUNE_SHRINK) {
+		z->z_tune_shrinks++;
+	}
+
+	z->z_depot_limit = (uint16_t)limit;
+	if (z->z_depot_size > limit) {
+		z->z_depot_size = (uint16_t)limit;
+		z->z_depot_cleanup = true;
+	}
+	z->z_tune_decision = decision;
+}
+
+uint32_t
+zone_cache_tune_info_get(zone_cache_tune_info_t *info, uint32_t count)
+{
+	uint32_t n = 0;
+
+	zone_foreach(z) {
+		zone_cache_tune_info_t zcti;
+
+		zone_lock(z);
+		if (z->z_self != z || z->z_pcpu_cache == NULL) {
+			zone_unlock(z);
+			continue;
+		}
+		zcti = (zone_cache_tune_info_t){
+			.zcti_alloc_rate = z->z_tune_alloc_rate,
+			.zcti_contention = z->z_recirc_cont_wma,
+			.zcti_recirc = z->z_tune_recirc_wma,
+			.zcti_mag_size = zc_mag_size(),
+			.zcti_depot_size = z->z_depot_size,
+			.zcti_depot_limit = z->z_depot_limit,
+			.zcti_depot_limit_default = zone_depot_limit_default(z),
+			.zcti_decision = z->z_tune_decision,
+			.zcti_grows = z->z_tune_grows,
+			.zcti_shrinks = z->z_tune_shrinks,
+		};
+		zone_unlock(z);
+
+		if (n < count) {
+			snprintf(zcti.zcti_name, sizeof(zcti.zcti_name), "%s%s",
+			    zone_heap_name(z), z->z_name);
+			info[n] = zcti;
+		}
+		n++;
+	}
+
+	return n;
+}
+
 void
 compute_zone_working_set_size(__unused void *param)
 {
@@ -8135,7 +8452,10 @@ compute_zone_working_set_size(__unused void *param)
 		zone_recirc_unlock_nopreempt(z);
 
 		if (z->z_pcpu_cache) {
-			uint16_t size = z->z_depot_size;
+			uint16_t size;
+
+			zone_cache_tune(z, cur);
+			size = z->z_depot_size;
 
 			if (zone_exhausted(z)) {
 				if (z->z_depot_size) {
@@ -9623,6 +9943,12 @@ zone_create_ext(
 		zone_create_assert_not_both(name, flags, ZC_DESTRUCTIBLE, ZC_READONLY);
 		z->z_destructible = true;
 	}
+	if (flags & ZC_SMR) {
+		zone_create_assert_not_both(name, flags, ZC_SMR, ZC_CACHING);
+		zone_create_assert_not_both(name, flags, ZC_SMR, ZC_NOCACHING);
+		zone_create_assert_not_both(name, flags, ZC_SMR, ZC_PERCPU);
+		z->z_smr = true;
+	}
 	/*
 	 * Handle Internal flags
 	 */
@@ -9787,8 +10113,13 @@ zone_get_sig_eq(zone_t zone)
 void
 zone_enable_smr(zone_t zone, struct smr *smr, zone_smr_free_cb_t free_cb)
 {
-	/* moving to SMR must be done before the zone has ever been used */
-	assert(zone->z_va_cur == 0 && !zone->z_smr && !zone->z_nocaching);
+	/*
+	 * moving to SMR must be done before the zone has ever been used,
+	 * zones made with ZC_SMR have been SMR since creation and only
+	 * get their domain bound here.
+	 */
+	assert(zone->z_smr ? zone->z_pcpu_cache == NULL : zone->z_va_cur == 0);
+	assert(!zone->z_nocaching);
 	assert(!zone_security_array[zone_index(zone)].z_lifo);
 	assert((smr->smr_flags & SMR_SLEEPABLE) == 0);
 
@@ -11134,6 +11465,67 @@ out:
 }
 SYSCTL_TEST_REGISTER(zone_basic_test, zone_basic_test_run);
 
+static int
+zone_bulk_test_run(__unused int64_t in, int64_t *out)
+{
+	const uint32_t count = 200;
+	zone_t test_zone;
+	void **elems;
+	uint32_t n;
+	int rc = 0;
+
+	if (os_atomic_xchg(&any_zone_test_running, true, relaxed)) {
+		printf("zone_bulk_test: Test already running.\n");
+		return EALREADY;
+	}
+
+	elems = kalloc_type(void *, count, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	test_zone = zone_create("test_zone_bulk", 64,
+	    ZC_DESTRUCTIBLE | ZC_CACHING);
+	assert(test_zone);
+
+	for (int iter = 0; iter < 4 && rc == 0; iter++) {
+		n = zalloc_bulk(test_zone, elems, count, Z_WAITOK | Z_ZERO);
+		if (n != count) {
+			printf("zone_bulk_test: only allocated %u/%u elements\n",
+			    n, count);
+			rc = ENOMEM;
+		}
+
+		for (uint32_t i = 0; i < n && rc == 0; i++) {
+			if (elems[i] == NULL ||
+			    memcmp_zero_ptr_aligned(elems[i], 64) != 0) {
+				printf("zone_bulk_test: bad element %u: %p\n",
+				    i, elems[i]);
+				rc = EIO;
+			}
+			for (uint32_t j = 0; j < i && rc == 0; j++) {
+				if (elems[i] == elems[j]) {
+					printf("zone_bulk_test: element %p returned twice\n",
+					    elems[i]);
+					rc = EIO;
+				}
+			}
+			if (rc == 0) {
+				memset(elems[i], 0xa5, 64);
+			}
+		}
+
+		zfree_bulk(test_zone, elems, n);
+	}
+
+	zdestroy(test_zone);
+	kfree_type(void *, count, elems);
+
+	if (rc == 0) {
+		printf("zone_bulk_test: Test passed\n");
+		*out = 1;
+	}
+	os_atomic_store(&any_zone_test_running, false, relaxed);
+	return rc;
+}
+SYSCTL_TEST_REGISTER(zone_bulk_test, zone_bulk_test_run);
+
 #define N_ALLOCATIONS 100
 
 static int
@@ -11545,7 +11937,12 @@ zone_alloc_replenish_test(__unused int64_t in, int64_t *out)
 	while (list != NULL) {
 		node = list;
 		list = list->next;
-		zfree(z, node);
+		/* map entries are SMR protected with vm_speculative_faults */
+		if (z->z_smr) {
+			zfree_smr(z, node);
+		} else {
+			zfree(z, node);
+		}
 	}
 
 	*out = 1;
@@ -166,6 +166,9 @@ __options_decl(zone_create_flags_t, uint64_t, {
 	ZC_DESTRUCTIBLE         = 0x80000000,
 
 #ifdef XNU_KERNEL_PRIVATE
+	/** Zone will use SMR, its domain is bound later by zone_enable_smr() */
+	ZC_SMR                  = 0x0020000000000000,
+
 	/** This zone contains pure data meant to be shared */
 	ZC_SHARED_DATA          = 0x0040000000000000,
 
@@ -1423,7 +1426,8 @@ typedef void (*zone_smr_free_cb_t)(void *, size_t);
  *
  * @discussion
  * This can only be done once, and must be done before
- * the first allocation is made with this zone.
+ * the first allocation is made with this zone, unless
+ * the zone was created with @c ZC_SMR.
  *
  * @param zone          the zone to enable SMR for
  * @param smr           the smr domain to use
@@ -2208,6 +2212,58 @@ extern void zfree_nozero_n(
 	(zfree_nozero_n)(__zfree_zid, zstack_load_and_erase(&(stack))); \
 })
 
+/*!
+ * @function zalloc_bulk
+ *
+ * @abstract
+ * Allocates a batch of elements from the specified zone into an array.
+ *
+ * @discussion
+ * Unlike @c zalloc_n(), this works for any zone (including zone views),
+ * not only zones with a fixed zone ID, and doesn't link the elements
+ * together.
+ *
+ * Elements are taken from the per-CPU magazines (refilled from the depot
+ * as needed) a magazine at a time with preemption disabled once, instead
+ * of once per element. Zones without per-CPU caching, or running out of
+ * cached elements, fall back to the regular @c zalloc_flags() path.
+ *
+ * This can't be used on per-cpu, read-only or SMR zones.
+ *
+ * @param zone          the zone or zone view to allocate from.
+ * @param elems         the array to fill with elements.
+ * @param count         how many elements to allocate.
+ * @param flags         a set of @c zalloc_flags_t flags.
+ *
+ * @returns             how many elements were allocated, fewer than
+ *                      @c count only if an allocation failed (which
+ *                      @c Z_NOFAIL prevents).
+ */
+extern uint32_t zalloc_bulk(
+	zone_t                  zone,
+	void                  **elems,
+	uint32_t                count,
+	zalloc_flags_t          flags);
+
+/*!
+ * @function zfree_bulk
+ *
+ * @abstract
+ * Batched variant of zfree(): frees an array of elements.
+ *
+ * @discussion
+ * The counterpart of @c zalloc_bulk(), elements are pushed into the
+ * per-CPU magazines a magazine at a time.
+ *
+ * @param zone          the zone or zone view to free the elements to.
+ * @param elems         the elements to free.
+ * @param count         the number of elements in @c elems.
+ */
+extern void zfree_bulk(
+	zone_t                  zone,
+	void                  **elems,
+	uint32_t                count);
+
 #pragma mark XNU only: cached objects
 
 /*!
@@ -143,6 +143,7 @@ struct zone_stats {
 	uint64_t            zs_alloc_fail;
 	uint32_t            zs_alloc_rr;     /* allocation rr bias */
 	uint32_t _Atomic    zs_alloc_not_early;
+	uint64_t            zs_recirc;       /* recirculation depot exchanges */
 };
 
 typedef struct zone_magazine *zone_magazine_t;
@@ -382,6 +383,30 @@ struct zone {
 
 	uint8_t             z_cacheline3[0] __attribute__((aligned(64)));
 
+	/*
+	 * Cache auto-tuning state (see zone_cache_tune()),
+	 * protected by the zone lock.
+	 *
+	 * z_tune_allocated / z_tune_recirc:
+	 *   sums of the zs_mem_allocated / zs_recirc per-cpu stats
+	 *   at the last sample.
+	 *
+	 * z_tune_alloc_rate:
+	 *   weighted moving average of allocations per second.
+	 *
+	 * z_tune_recirc_wma:
+	 *   weighted moving average of recirculation depot exchanges
+	 *   per second x cpu, in Z_WMA_UNIT units.
+	 */
+	uint64_t            z_tune_allocated;
+	uint64_t            z_tune_recirc;
+	uint32_t            z_tune_alloc_rate;
+	uint32_t            z_tune_recirc_wma;
+	uint32_t            z_tune_grows;
+	uint32_t            z_tune_shrinks;
+	uint16_t            z_tune_idle;       /* consecutive cold periods */
+	uint8_t             z_tune_decision;   /* last zone_cache_tune_decision_t */
+
 #if KASAN_CLASSIC
 	uint16_t            z_kasan_redzone;
 	spl_t               z_kasan_spl;
@@ -777,6 +802,14 @@ zone_stats_get_mem_allocated(zone_stats_t stats)
  */
 extern uint64_t get_zones_collectable_bytes(void);
 
+/*
+ * For sysctl kern.zone_cache_tuning: fills up to @c count entries of @c info
+ * for zones with caching enabled, and returns how many such zones exist.
+ */
+extern uint32_t zone_cache_tune_info_get(
+	struct zone_cache_tune_info *info,
+	uint32_t                count);
+
 /*!
  * @enum zone_gc_level_t
  *
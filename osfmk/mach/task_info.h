@@ -426,6 +426,10 @@ struct task_vm_info {
 	/* added for rev7 */
 	int64_t ledger_tag_neural_nofootprint_total;
 	int64_t ledger_tag_neural_nofootprint_peak;
+
+	/* added for rev8 */
+	integer_t refaults;             /* file pages read back soon after eviction */
+	integer_t refaults_activated;   /* of which were part of the working set */
 };
 typedef struct task_vm_info     task_vm_info_data_t;
 typedef struct task_vm_info     *task_vm_info_t;
@@ -434,7 +438,9 @@ typedef struct task_vm_info     *task_vm_info_t;
 /*
  * The capacity of task_info_t in mach_types.defs also needs to be adjusted
  */
-#define TASK_VM_INFO_REV7_COUNT TASK_VM_INFO_COUNT
+#define TASK_VM_INFO_REV8_COUNT TASK_VM_INFO_COUNT
+#define TASK_VM_INFO_REV7_COUNT /* doesn't include refaults */ \
+	((mach_msg_type_number_t) (TASK_VM_INFO_REV8_COUNT - 2))
 #define TASK_VM_INFO_REV6_COUNT /* doesn't include neural total and peak */ \
 	((mach_msg_type_number_t) (TASK_VM_INFO_REV7_COUNT - 4))
 #define TASK_VM_INFO_REV5_COUNT /* doesn't include ledger swapins */ \
@@ -79,6 +79,7 @@ __options_decl(vm_map_create_options_t, uint32_t, {
 	VM_MAP_CREATE_CORPSE_FOOTPRINT = 0x00000002,
 	VM_MAP_CREATE_DISABLE_HOLELIST = 0x00000004,
 	VM_MAP_CREATE_NEVER_FAULTS     = 0x00000008,
+	VM_MAP_CREATE_BTREE_STORE      = 0x00000010,
 });
 
 /*
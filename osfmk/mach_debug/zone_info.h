@@ -167,6 +167,34 @@ typedef struct mach_memory_info {
 
 typedef mach_memory_info_t *mach_memory_info_array_t;
 
+/*
+ * Per-zone cache tuning state, as reported by the kern.zone_cache_tuning
+ * sysctl for every zone with per-cpu caching enabled.
+ *
+ * Rates are averaged over the periodic zone working set updates;
+ * zcti_contention and zcti_recirc are per second and per cpu,
+ * in 1/256th units.
+ */
+#define ZONE_CACHE_TUNE_NONE            0       /* no change */
+#define ZONE_CACHE_TUNE_GROW            1       /* depot limit raised */
+#define ZONE_CACHE_TUNE_SHRINK          2       /* depot limit lowered (cold zone) */
+#define ZONE_CACHE_TUNE_RELAX           3       /* depot limit decayed toward default */
+
+typedef struct zone_cache_tune_info {
+	char            zcti_name[MACH_ZONE_NAME_MAX_LEN];
+	uint64_t        zcti_alloc_rate;        /* allocations per second */
+	uint32_t        zcti_contention;        /* recirculation lock contentions */
+	uint32_t        zcti_recirc;            /* recirculation depot exchanges */
+	uint16_t        zcti_mag_size;          /* elements per magazine */
+	uint16_t        zcti_depot_size;        /* magazines allowed per cpu depot */
+	uint16_t        zcti_depot_limit;       /* current ceiling for zcti_depot_size */
+	uint16_t        zcti_depot_limit_default;
+	uint32_t        zcti_decision;          /* last ZONE_CACHE_TUNE_* decision */
+	uint32_t        zcti_grows;
+	uint32_t        zcti_shrinks;
+	uint32_t        _zcti_resv;
+} zone_cache_tune_info_t;
+
 /*
  * MAX_ZTRACE_DEPTH configures how deep of a stack trace is taken on each zalloc in the zone of interest.  15
  * levels is usually enough to get past all the layers of code in kalloc and IOKit and see who the actual
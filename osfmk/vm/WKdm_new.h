@@ -110,6 +110,24 @@ WKdm_compress_new(const WK_word* src_buf,
     unsigned int limit);
 #endif
 
+/*
+ * Portable C implementations (WKdm_simd.c), format compatible with the
+ * assembly ones above. page_words is the page size in words, i.e. 1024
+ * or 4096, and scratch must be at least page_words * 4 bytes.
+ */
+int
+WKdm_compress_simd(const WK_word* src_buf,
+    WK_word* dest_buf,
+    WK_word* scratch,
+    unsigned int limit,
+    unsigned int page_words);
+void
+WKdm_decompress_simd(const WK_word* src_buf,
+    WK_word* dest_buf,
+    WK_word* scratch,
+    unsigned int bytes,
+    unsigned int page_words);
+
 #ifdef __cplusplus
 } /* extern "C" */
 #endif
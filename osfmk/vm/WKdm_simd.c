@@ -0,0 +1,460 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Portable C implementation of the WKdm compressor and decompressor.
+ *
+ * The output is bit for bit identical to the hand written encoders in
+ * osfmk/x86_64/WKdmCompress_new.s and osfmk/arm64/WKdmCompress_{4k,16k}.s,
+ * including the zero/single value page, mostly-zero (MZV) page and early
+ * abort special cases, so either implementation can decode the output of
+ * the other.  See WKdmCompress_new.s for a description of the format.
+ *
+ * The scan pass is inherently serial because of the dictionary updates,
+ * so vector code is used where the format allows it: detecting runs of
+ * zero words, computing the hash keys of a block of input words, and
+ * packing/unpacking the tags, queue positions and low bits areas.  The
+ * vector types are clang ext_vector types (see lz4.h); on targets where
+ * the kernel is built without SIMD (x86_64 -msoft-float) clang lowers
+ * them to scalar code.
+ *
+ * This file has no dependencies beyond WKdm_new.h so it can be built in
+ * userspace, see tools/tests/wkdm.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "WKdm_new.h"
+
+#define WKDM_MZV_MAGIC          17185   /* header word of a mostly-zero page */
+#define WKDM_HEADER_WORDS       3
+#define WKDM_HEADER_BYTES       (WKDM_HEADER_WORDS * 4)
+#define WKDM_LOW_BITS_MASK      0x3FFu
+#define WKDM_DICT_WORDS         16
+
+/* early abort checkpoint, per 4k of input */
+#define WKDM_CHKPT_BYTES        416
+#define WKDM_CHKPT_TAG_BYTES    (WKDM_CHKPT_BYTES / 16)
+#define WKDM_CHKPT_SHRUNK_BYTES 426
+
+#define WKDM_TAG_ZERO           0
+#define WKDM_TAG_PARTIAL        1
+#define WKDM_TAG_MISS           2
+#define WKDM_TAG_EXACT          3
+
+#define WKDM_BLOCK_WORDS        8
+
+_Static_assert((WKDM_CHKPT_BYTES / 4) % WKDM_BLOCK_WORDS == 0,
+    "the early abort checkpoint must fall on a block boundary");
+
+#if __has_attribute(__ext_vector_type__)
+typedef __attribute__((__ext_vector_type__(4))) uint32_t wk_vector_uint4;
+typedef __attribute__((__ext_vector_type__(8))) uint32_t wk_vector_uint8;
+#else
+typedef uint32_t wk_vector_uint4 __attribute__((__vector_size__(16)));
+typedef uint32_t wk_vector_uint8 __attribute__((__vector_size__(32)));
+#endif
+
+/*
+ * Maps bits [10:17] of a word to its dictionary slot, this is the
+ * _hashLookupTable_new / _hashLookupTable table of the assembly
+ * implementations expressed as word indices instead of byte offsets.
+ */
+static const uint8_t wkdm_hash_to_dict[256] = {
+	0, 13, 2, 14, 4, 3, 7, 5, 1, 9, 12, 6, 11, 10, 8, 15,
+	2, 3, 7, 5, 1, 15, 4, 9, 6, 12, 11, 8, 13, 14, 10, 3,
+	2, 12, 4, 13, 15, 7, 14, 8, 5, 6, 9, 10, 11, 1, 2, 10,
+	15, 8, 5, 11, 1, 9, 13, 6, 4, 14, 12, 3, 7, 4, 2, 10,
+	9, 7, 8, 3, 1, 11, 13, 5, 6, 12, 15, 14, 10, 12, 2, 8,
+	7, 9, 1, 11, 5, 14, 15, 6, 13, 4, 3, 3, 1, 12, 5, 2,
+	13, 4, 15, 6, 9, 11, 7, 14, 10, 8, 9, 5, 6, 15, 10, 11,
+	13, 4, 8, 1, 12, 2, 7, 14, 3, 7, 8, 10, 13, 9, 4, 5,
+	12, 2, 1, 15, 6, 14, 11, 3, 2, 9, 6, 7, 4, 15, 5, 14,
+	8, 10, 12, 3, 1, 11, 13, 11, 10, 3, 14, 2, 9, 6, 15, 7,
+	12, 1, 8, 5, 4, 13, 15, 3, 6, 9, 2, 1, 4, 14, 12, 11,
+	10, 13, 8, 5, 7, 8, 3, 9, 7, 6, 14, 10, 4, 13, 11, 1,
+	5, 15, 2, 12, 12, 13, 3, 5, 8, 11, 9, 7, 1, 10, 6, 2,
+	14, 15, 4, 9, 8, 2, 10, 1, 13, 6, 11, 5, 3, 7, 12, 14,
+	4, 15, 1, 13, 15, 12, 5, 4, 14, 11, 6, 2, 10, 3, 8, 7,
+	9, 6, 8, 3, 1, 5, 4, 15, 9, 7, 2, 13, 10, 12, 11, 14,
+};
+
+static inline wk_vector_uint8
+wk_load8(const WK_word *p)
+{
+	wk_vector_uint8 v;
+
+	__builtin_memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline bool
+wk_is_zero8(wk_vector_uint8 v)
+{
+	uint64_t w[4];
+
+	__builtin_memcpy(w, &v, sizeof(w));
+	return (w[0] | w[1] | w[2] | w[3]) == 0;
+}
+
+static inline uint32_t
+wk_load32(const void *p)
+{
+	uint32_t v;
+
+	__builtin_memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+/*
+ * Size estimate used by both the early abort checkpoint and the choice
+ * between the default and the MZV packers.  The multiply by 1365 >> 11
+ * approximates the 2/3 ratio of the low bits packing exactly like the
+ * assembly does, which matters for reproducing its decisions.
+ */
+static inline uint32_t
+wk_packed_estimate(uint32_t nfull, uint32_t nqpos, uint32_t nlow)
+{
+	return ((nlow * 2 * 1365) >> 11) + nfull * 4 + (nqpos >> 1);
+}
+
+static int
+WKdm_pack_sparse(const WK_word *src_buf, WK_word *dest_buf, uint32_t page_words,
+    uint32_t size)
+{
+	uint8_t *out = (uint8_t *)dest_buf;
+	uint32_t magic = WKDM_MZV_MAGIC;
+
+	__builtin_memcpy(out, &magic, sizeof(magic));
+	out += sizeof(magic);
+
+	for (uint32_t i = 0; i < page_words; i += WKDM_BLOCK_WORDS) {
+		wk_vector_uint8 v = wk_load8(&src_buf[i]);
+
+		if (wk_is_zero8(v)) {
+			continue;
+		}
+		for (uint32_t j = 0; j < WKDM_BLOCK_WORDS; j++) {
+			uint32_t w = v[j];
+			uint16_t offset = (uint16_t)((i + j) * sizeof(WK_word));
+
+			if (w == 0) {
+				continue;
+			}
+			__builtin_memcpy(out, &w, sizeof(w));
+			__builtin_memcpy(out + sizeof(w), &offset, sizeof(offset));
+			out += sizeof(w) + sizeof(offset);
+		}
+	}
+
+	return (int)size;
+}
+
+/*
+ * Packs 16 tags per output word: byte j of word k holds the tags of
+ * input words 16k + j, 16k + j + 4, 16k + j + 8 and 16k + j + 12.
+ */
+static inline void
+WKdm_pack_2bits(const uint8_t *tags, WK_word *out, uint32_t page_words)
+{
+	const wk_vector_uint4 shifts = { 0, 2, 4, 6 };
+
+	for (uint32_t k = 0; k < page_words / 16; k++) {
+		wk_vector_uint4 t;
+
+		__builtin_memcpy(&t, &tags[16 * k], sizeof(t));
+		t <<= shifts;
+		out[k] = t[0] | t[1] | t[2] | t[3];
+	}
+}
+
+int
+WKdm_compress_simd(const WK_word *src_buf, WK_word *dest_buf, WK_word *scratch,
+    unsigned int limit, unsigned int page_words)
+{
+	const uint32_t scale = page_words / 1024;
+	const uint32_t tags_words = page_words / 16;
+	const uint32_t checkpoint = (WKDM_CHKPT_BYTES / 4) * scale;
+	uint8_t *tags = (uint8_t *)scratch;
+	uint8_t *qpos = tags + page_words;
+	uint16_t *low_bits = (uint16_t *)(void *)(qpos + page_words);
+	WK_word *full_patt = dest_buf + WKDM_HEADER_WORDS + tags_words;
+	WK_word dictionary[WKDM_DICT_WORDS] = { 0 };
+	uint32_t nfull = 0, nqpos = 0, nlow = 0;
+	int32_t byte_count = (int32_t)limit - (int32_t)(WKDM_HEADER_BYTES + tags_words * 4);
+
+#if defined(__x86_64__)
+	/* WKdmCompress_new.s rejects budgets that can't fit the tags upfront */
+	if (byte_count <= 0) {
+		return -1;
+	}
+#endif
+
+	/*
+	 * Scan and tag pass, see WKdmCompress_new.s
+	 */
+	for (uint32_t i = 0; i < page_words; i += WKDM_BLOCK_WORDS) {
+		wk_vector_uint8 v = wk_load8(&src_buf[i]);
+		wk_vector_uint8 keys;
+
+		if (wk_is_zero8(v)) {
+			__builtin_memset(&tags[i], WKDM_TAG_ZERO, WKDM_BLOCK_WORDS);
+			goto next_block;
+		}
+
+		keys = (v >> 10) & 0xFF;
+
+		for (uint32_t j = 0; j < WKDM_BLOCK_WORDS; j++) {
+			WK_word input_word = v[j];
+			uint32_t dict_index;
+			WK_word dict_word;
+
+			if (input_word == 0) {
+				tags[i + j] = WKDM_TAG_ZERO;
+				continue;
+			}
+
+			dict_index = wkdm_hash_to_dict[keys[j]];
+			dict_word = dictionary[dict_index];
+
+			if (input_word == dict_word) {
+				tags[i + j] = WKDM_TAG_EXACT;
+				qpos[nqpos++] = (uint8_t)dict_index;
+			} else if (((input_word ^ dict_word) >> 10) == 0) {
+				tags[i + j] = WKDM_TAG_PARTIAL;
+				qpos[nqpos++] = (uint8_t)dict_index;
+				low_bits[nlow++] = (uint16_t)(input_word & WKDM_LOW_BITS_MASK);
+				dictionary[dict_index] = input_word;
+			} else {
+				/* check before writing so we never go past the budget */
+				byte_count -= 4;
+				if (byte_count <= 0) {
+					return -1;
+				}
+				tags[i + j] = WKDM_TAG_MISS;
+				full_patt[nfull++] = input_word;
+				dictionary[dict_index] = input_word;
+			}
+		}
+
+next_block:
+		if (i + WKDM_BLOCK_WORDS == checkpoint && checkpoint != page_words) {
+			uint32_t est = wk_packed_estimate(nfull, nqpos, nlow);
+
+			if (est > (WKDM_CHKPT_SHRUNK_BYTES - WKDM_CHKPT_TAG_BYTES) * scale) {
+				return -1;
+			}
+		}
+	}
+
+	/*
+	 * Zero and single value pages: the caller stores the value itself.
+	 */
+	if (nfull == 0 && nqpos == 0) {
+		return 0;
+	}
+	if (nlow == 0 && nqpos == page_words - 1 && nfull == 1 && tags[0] == WKDM_TAG_MISS) {
+		return 0;
+	}
+	if (nlow == 1 && nqpos == page_words && tags[0] == WKDM_TAG_PARTIAL) {
+		return 0;
+	}
+
+	/*
+	 * Mostly zero pages: (word, byte offset) pairs are smaller.
+	 */
+	uint32_t sparse_size = (nfull + nqpos) * 6 + 4;
+	uint32_t default_size = wk_packed_estimate(nfull, nqpos, nlow) +
+	    WKDM_HEADER_BYTES + tags_words * 4;
+
+	if (default_size >= sparse_size) {
+		if (sparse_size > limit) {
+			return -1;
+		}
+		return WKdm_pack_sparse(src_buf, dest_buf, page_words, sparse_size);
+	}
+
+	/*
+	 * Default packer.
+	 */
+	WK_word *next = full_patt + nfull;
+	uint32_t qpos_words = (nqpos + 7) >> 3;
+
+	dest_buf[0] = (WK_word)(next - dest_buf);
+	WKdm_pack_2bits(tags, dest_buf + WKDM_HEADER_WORDS, page_words);
+
+	byte_count -= (int32_t)(qpos_words * 4);
+	if (byte_count < 0) {
+		return -1;
+	}
+	__builtin_memset(&qpos[nqpos], 0, qpos_words * 8 - nqpos);
+	for (uint32_t k = 0; k < qpos_words; k++) {
+		uint32_t q0 = wk_load32(&qpos[8 * k]);
+		uint32_t q1 = wk_load32(&qpos[8 * k + 4]);
+
+		*next++ = q0 | (q1 << 4);
+	}
+	dest_buf[1] = (WK_word)(next - dest_buf);
+
+	uint32_t k = 0;
+	for (; k + 3 <= nlow; k += 3) {
+		byte_count -= 4;
+		if (byte_count <= 0) {
+			return -1;
+		}
+		*next++ = low_bits[k] | (low_bits[k + 1] << 10) | (low_bits[k + 2] << 20);
+	}
+	if (k < nlow) {
+		WK_word w = low_bits[k];
+
+		byte_count -= 4;
+		if (byte_count <= 0) {
+			return -1;
+		}
+		if (k + 1 < nlow) {
+			w |= low_bits[k + 1] << 10;
+		}
+		*next++ = w;
+	}
+	dest_buf[2] = (WK_word)(next - dest_buf);
+
+	return (int)((size_t)(next - dest_buf) * sizeof(WK_word));
+}
+
+void
+WKdm_decompress_simd(const WK_word *src_buf, WK_word *dest_buf, WK_word *scratch,
+    unsigned int bytes, unsigned int page_words)
+{
+	const uint32_t tags_words = page_words / 16;
+	const wk_vector_uint4 shifts = { 0, 2, 4, 6 };
+	uint8_t *tags = (uint8_t *)scratch;
+	WK_word dictionary[WKDM_DICT_WORDS] = { 0 };
+
+	if (src_buf[0] == WKDM_MZV_MAGIC) {
+		const uint8_t *next = (const uint8_t *)src_buf + sizeof(WK_word);
+		const uint8_t *end = (const uint8_t *)src_buf + bytes;
+
+		__builtin_memset(dest_buf, 0, page_words * sizeof(WK_word));
+		while (next < end) {
+			uint32_t w = wk_load32(next);
+			uint16_t offset;
+
+			__builtin_memcpy(&offset, next + 4, sizeof(offset));
+			dest_buf[offset / sizeof(WK_word)] = w;
+			next += 6;
+		}
+		return;
+	}
+
+	/*
+	 * Unpack the tags, 16 per word, see WKdm_pack_2bits().
+	 */
+	for (uint32_t k = 0; k < tags_words; k++) {
+		WK_word w = src_buf[WKDM_HEADER_WORDS + k];
+		wk_vector_uint4 t = { w, w, w, w };
+
+		t = (t >> shifts) & 0x03030303;
+		__builtin_memcpy(&tags[16 * k], &t, sizeof(t));
+	}
+
+	/*
+	 * Queue positions (8 per word) and low bits (3 per word) are
+	 * consumed in order, so they are decoded on the fly.
+	 */
+	const WK_word *full_patt = src_buf + WKDM_HEADER_WORDS + tags_words;
+	const WK_word *qpos_next = src_buf + src_buf[0];
+	const WK_word *low_next = src_buf + src_buf[1];
+	uint64_t qpos_bits = 0;
+	uint32_t qpos_left = 0;
+	uint32_t low_word = 0;
+	uint32_t low_left = 0;
+
+	for (uint32_t i = 0; i < page_words; i += WKDM_BLOCK_WORDS) {
+		uint64_t block_tags;
+
+		__builtin_memcpy(&block_tags, &tags[i], sizeof(block_tags));
+		if (block_tags == 0) {
+			const wk_vector_uint8 zero = { 0 };
+
+			__builtin_memcpy(&dest_buf[i], &zero, sizeof(zero));
+			continue;
+		}
+
+		for (uint32_t j = 0; j < WKDM_BLOCK_WORDS; j++) {
+			uint32_t tag = (uint32_t)(block_tags >> (8 * j)) & 0xff;
+			uint32_t dict_index;
+			WK_word w;
+
+			switch (tag) {
+			case WKDM_TAG_ZERO:
+				w = 0;
+				break;
+
+			case WKDM_TAG_MISS:
+				w = *full_patt++;
+				dictionary[wkdm_hash_to_dict[(w >> 10) & 0xFF]] = w;
+				break;
+
+			default:
+				if (qpos_left == 0) {
+					/*
+					 * A packed word holds q0..q3 in the low nibbles
+					 * and q4..q7 in the high nibbles: reorder them
+					 * into a stream of 8 nibbles.
+					 */
+					uint32_t p = *qpos_next++;
+					uint32_t lo = p & 0x0F0F0F0F;
+					uint32_t hi = (p >> 4) & 0x0F0F0F0F;
+
+					qpos_bits = (uint64_t)lo | ((uint64_t)hi << 32);
+					qpos_left = 8;
+				}
+				dict_index = (uint32_t)qpos_bits & 0xF;
+				qpos_bits >>= 8;
+				qpos_left--;
+
+				if (tag == WKDM_TAG_EXACT) {
+					w = dictionary[dict_index];
+				} else {
+					if (low_left == 0) {
+						low_word = *low_next++;
+						low_left = 3;
+					}
+					w = (dictionary[dict_index] & ~WKDM_LOW_BITS_MASK) |
+					    (low_word & WKDM_LOW_BITS_MASK);
+					low_word >>= 10;
+					low_left--;
+					dictionary[dict_index] = w;
+				}
+				break;
+			}
+			dest_buf[i + j] = w;
+		}
+	}
+}
@@ -50,6 +50,7 @@
 #include <vm/vm_compressor_info.h>         /* for c_segment_info */
 #endif
 #include <kern/ledger.h>
+#include <libkern/crypto/sha2.h>
 #include <kern/policy_internal.h>
 #include <kern/thread_group.h>
 #include <san/kasan.h>
@@ -226,6 +227,15 @@ struct c_sv_hash_entry {
 #define C_SV_CSEG_ID            ((1 << 22) - 1)
 #endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
 
+/*
+ * Slot mappings with s_cseg in [C_DEDUP_CSEG_BASE, C_SV_CSEG_ID) don't
+ * refer to a c_seg but to an entry of the dedup table, whose index is
+ * ((s_cseg - C_DEDUP_CSEG_BASE) * C_SLOT_MAX_INDEX + s_cindx).
+ */
+#define C_DEDUP_CSEG_IDS        16
+#define C_DEDUP_CSEG_BASE       (C_SV_CSEG_ID - C_DEDUP_CSEG_IDS)
+#define C_SLOT_IS_DEDUP(slot)   ((slot)->s_cseg >= C_DEDUP_CSEG_BASE && (slot)->s_cseg < C_SV_CSEG_ID)
+
 /* elements of c_segments array */
 union c_segu {
 	c_segment_t     c_seg;
@@ -402,6 +412,9 @@ void compute_swapout_target_age(void);
 boolean_t c_seg_major_compact(c_segment_t, c_segment_t);
 boolean_t c_seg_major_compact_ok(c_segment_t, c_segment_t);
 
+static vm_decompress_result_t c_decompress_page(char *, volatile c_slot_mapping_t, vm_compressor_options_t, int *);
+static void c_dedup_init(void);
+
 int  c_seg_minor_compaction_and_unlock(c_segment_t, boolean_t);
 int  c_seg_do_minor_compaction_and_unlock(c_segment_t, boolean_t, boolean_t, boolean_t);
 void c_seg_try_minor_compaction_and_unlock(c_segment_t c_seg);
@@ -1135,6 +1148,8 @@ vm_compressor_init(void)
 	compressor_segment_zone = zone_create("compressor_segment",
 	    c_segment_size, ZC_PGZ_USE_GUARDS | ZC_NOENCRYPT | ZC_ZFREE_CLEARMEM);
 
+	c_dedup_init();
+
 	c_segments_busy = FALSE;
 
 	c_segments_next_page = (caddr_t)c_segments;
@@ -2048,6 +2063,10 @@ c_seg_free_locked(c_segment_t c_seg)
 		c_overage_swapped_count--;
 		c_seg->c_overage_swap = FALSE;
 	}
+	if (c_seg->c_prefetched) {
+		c_seg->c_prefetched = 0;
+		os_atomic_inc(&vm_swapin_prefetch_wasted, relaxed);
+	}
 	if (!(C_SEG_IS_ONDISK(c_seg))) {
 		c_buffer = c_seg->c_store.c_buffer;
 	} else {
@@ -4532,18 +4551,102 @@ c_seg_swapin_requeue(c_segment_t c_seg, boolean_t has_data, boolean_t minor_comp
 
 
 
+/*
+ * Finishes swapping in a c_seg whose contents have been read into addr,
+ * kr being the result of the read.  The c_seg has to be busy with
+ * c_busy_swapping set and unlocked on entry.
+ * PAGE_REPLACMENT_DISALLOWED has to be FALSE on entry and is returned TRUE
+ * returns 1 if the c_seg was freed, 0 otherwise in which case the c_seg is
+ * returned locked and still busy
+ */
+int
+c_seg_swapin_complete(c_segment_t c_seg, vm_offset_t addr, uint32_t io_size, kern_return_t kr,
+    boolean_t force_minor_compaction, boolean_t age_on_swapin_q)
+{
+	if (kr != KERN_SUCCESS) {
+		PAGE_REPLACEMENT_DISALLOWED(TRUE);
+
+		kernel_memory_depopulate(addr, io_size, KMA_COMPRESSOR,
+		    VM_KERN_MEMORY_COMPRESSOR);
+
+		c_seg_swapin_requeue(c_seg, FALSE, TRUE, age_on_swapin_q);
+		return 0;
+	}
+#if ENCRYPTED_SWAP
+	vm_swap_decrypt(c_seg);
+#endif /* ENCRYPTED_SWAP */
+
+#if CHECKSUM_THE_SWAP
+	if (c_seg->cseg_swap_size != io_size) {
+		panic("swapin size doesn't match swapout size");
+	}
+
+	if (c_seg->cseg_hash != vmc_hash((char*) c_seg->c_store.c_buffer, (int)io_size)) {
+		panic("c_seg_swapin - Swap hash mismatch");
+	}
+#endif /* CHECKSUM_THE_SWAP */
+
+	PAGE_REPLACEMENT_DISALLOWED(TRUE);
+
+	c_seg_swapin_requeue(c_seg, TRUE, force_minor_compaction == TRUE ? FALSE : TRUE, age_on_swapin_q);
+
+#if CONFIG_FREEZE
+	/*
+	 * c_seg_swapin_requeue() returns with the c_seg lock held.
+	 */
+	if (!lck_mtx_try_lock_spin_always(c_list_lock)) {
+		assert(c_seg->c_busy);
+
+		lck_mtx_unlock_always(&c_seg->c_lock);
+		lck_mtx_lock_spin_always(c_list_lock);
+		lck_mtx_lock_spin_always(&c_seg->c_lock);
+	}
+
+	if (c_seg->c_task_owner) {
+		c_seg_update_task_owner(c_seg, NULL);
+	}
+
+	lck_mtx_unlock_always(c_list_lock);
+
+	os_atomic_add(&c_segment_pages_compressed_incore, c_seg->c_slots_used, relaxed);
+	if (c_seg->c_has_donated_pages) {
+		os_atomic_add(&c_segment_pages_compressed_incore_late_swapout, c_seg->c_slots_used, relaxed);
+	}
+#endif /* CONFIG_FREEZE */
+
+	os_atomic_add(&compressor_bytes_used, c_seg->c_bytes_used, relaxed);
+
+	if (force_minor_compaction == TRUE) {
+		if (c_seg_minor_compaction_and_unlock(c_seg, FALSE)) {
+			/*
+			 * c_seg was completely empty so it was freed,
+			 * so be careful not to reference it again
+			 */
+			return 1;
+		}
+
+		lck_mtx_lock_spin_always(&c_seg->c_lock);
+	}
+	return 0;
+}
+
+
 /*
  * c_seg has to be locked and is returned locked if the c_seg isn't freed
  * PAGE_REPLACMENT_DISALLOWED has to be TRUE on entry and is returned TRUE
  * c_seg_swapin returns 1 if the c_seg was freed, 0 otherwise
+ *
+ * When prefetch is TRUE the swapin is on behalf of a fault and the
+ * c_segs that were swapped out along with this one are read in
+ * asynchronously as well (see vm_swapin_prefetch()).
  */
-
-int
-c_seg_swapin(c_segment_t c_seg, boolean_t force_minor_compaction, boolean_t age_on_swapin_q)
+static int
+c_seg_swapin_internal(c_segment_t c_seg, boolean_t force_minor_compaction, boolean_t age_on_swapin_q, boolean_t prefetch)
 {
 	vm_offset_t     addr = 0;
 	uint32_t        io_size = 0;
 	uint64_t        f_offset;
+	kern_return_t   kr;
 	thread_pri_floor_t token;
 
 	assert(C_SEG_IS_ONDISK(c_seg));
@@ -4566,6 +4669,9 @@ c_seg_swapin(c_segment_t c_seg, boolean_t force_minor_compaction, boolean_t age_
 	token = thread_priority_floor_start();
 	lck_mtx_unlock_always(&c_seg->c_lock);
 
+	if (prefetch == TRUE) {
+		vm_swapin_prefetch(c_seg);
+	}
 	PAGE_REPLACEMENT_DISALLOWED(FALSE);
 
 	addr = (vm_offset_t)C_SEG_BUFFER_ADDRESS(c_seg->c_mysegno);
@@ -4574,73 +4680,15 @@ c_seg_swapin(c_segment_t c_seg, boolean_t force_minor_compaction, boolean_t age_
 	kernel_memory_populate(addr, io_size, KMA_NOFAIL | KMA_COMPRESSOR,
 	    VM_KERN_MEMORY_COMPRESSOR);
 
-	if (vm_swap_get(c_seg, f_offset, io_size) != KERN_SUCCESS) {
-		PAGE_REPLACEMENT_DISALLOWED(TRUE);
-
-		kernel_memory_depopulate(addr, io_size, KMA_COMPRESSOR,
-		    VM_KERN_MEMORY_COMPRESSOR);
-
-		c_seg_swapin_requeue(c_seg, FALSE, TRUE, age_on_swapin_q);
-	} else {
-#if ENCRYPTED_SWAP
-		vm_swap_decrypt(c_seg);
-#endif /* ENCRYPTED_SWAP */
-
-#if CHECKSUM_THE_SWAP
-		if (c_seg->cseg_swap_size != io_size) {
-			panic("swapin size doesn't match swapout size");
-		}
-
-		if (c_seg->cseg_hash != vmc_hash((char*) c_seg->c_store.c_buffer, (int)io_size)) {
-			panic("c_seg_swapin - Swap hash mismatch");
-		}
-#endif /* CHECKSUM_THE_SWAP */
-
-		PAGE_REPLACEMENT_DISALLOWED(TRUE);
+	kr = vm_swap_get(c_seg, f_offset, io_size);
 
-		c_seg_swapin_requeue(c_seg, TRUE, force_minor_compaction == TRUE ? FALSE : TRUE, age_on_swapin_q);
-
-#if CONFIG_FREEZE
+	if (c_seg_swapin_complete(c_seg, addr, io_size, kr, force_minor_compaction, age_on_swapin_q)) {
 		/*
-		 * c_seg_swapin_requeue() returns with the c_seg lock held.
+		 * Drop the boost so that the thread priority
+		 * is returned back to where it is supposed to be.
 		 */
-		if (!lck_mtx_try_lock_spin_always(c_list_lock)) {
-			assert(c_seg->c_busy);
-
-			lck_mtx_unlock_always(&c_seg->c_lock);
-			lck_mtx_lock_spin_always(c_list_lock);
-			lck_mtx_lock_spin_always(&c_seg->c_lock);
-		}
-
-		if (c_seg->c_task_owner) {
-			c_seg_update_task_owner(c_seg, NULL);
-		}
-
-		lck_mtx_unlock_always(c_list_lock);
-
-		os_atomic_add(&c_segment_pages_compressed_incore, c_seg->c_slots_used, relaxed);
-		if (c_seg->c_has_donated_pages) {
-			os_atomic_add(&c_segment_pages_compressed_incore_late_swapout, c_seg->c_slots_used, relaxed);
-		}
-#endif /* CONFIG_FREEZE */
-
-		os_atomic_add(&compressor_bytes_used, c_seg->c_bytes_used, relaxed);
-
-		if (force_minor_compaction == TRUE) {
-			if (c_seg_minor_compaction_and_unlock(c_seg, FALSE)) {
-				/*
-				 * c_seg was completely empty so it was freed,
-				 * so be careful not to reference it again
-				 *
-				 * Drop the boost so that the thread priority
-				 * is returned back to where it is supposed to be.
-				 */
-				thread_priority_floor_end(&token);
-				return 1;
-			}
-
-			lck_mtx_lock_spin_always(&c_seg->c_lock);
-		}
+		thread_priority_floor_end(&token);
+		return 1;
 	}
 	C_SEG_WAKEUP_DONE(c_seg);
 
@@ -4653,6 +4701,12 @@ c_seg_swapin(c_segment_t c_seg, boolean_t force_minor_compaction, boolean_t age_
 	return 0;
 }
 
+int
+c_seg_swapin(c_segment_t c_seg, boolean_t force_minor_compaction, boolean_t age_on_swapin_q)
+{
+	return c_seg_swapin_internal(c_seg, force_minor_compaction, age_on_swapin_q, FALSE);
+}
+
 /*
  * TODO: refactor the CAS loops in c_segment_sv_hash_drop_ref() and c_segment_sv_hash_instert()
  * to os_atomic_rmw_loop() [rdar://139546215]
@@ -4747,81 +4801,48 @@ c_compressed_record_data(char *src, int c_size)
 #endif
 
 
+#if C_SLOT_C_CODEC_BITS
+static_assert(CCODEC_COUNT <= (1u << C_SLOT_C_CODEC_BITS),
+    "codec IDs must fit in c_slot.c_codec");
+#endif
+
+
 /**
- * Do the actual compression of the given page
+ * Run the configured codec on a page
  * @param src [IN] address in the physical aperture of the page to compress.
- * @param slot_ptr [OUT] fill the slot-mapping of the c_seg+slot where the page ends up being stored
- * @param current_chead [IN-OUT] current filling c_seg. pointer comes from the current compression thread state
- *          On the very first call this is going to point to NULL and this function will fill that pointer with a new
- *          filling c_sec if the current filling c_seg doesn't have enough space, it will be replaced in this location
- *          with a new filling c_seg
+ * @param dst [OUT] where to write the compressed data, at least max_csize bytes.
+ * @param max_csize [IN] space available at dst, the codec is given a budget of max_csize - 4.
  * @param scratch_buf [IN] pointer from the current thread state, used by the compression codec
- * @return KERN_RESOURCE_SHORTAGE if the compressor has been exhausted
+ * @param ccodec [OUT] codec the page was compressed with
+ * @param incomp_copy [OUT] set if the codec already copied an incompressible page to dst
+ * @return the compressed size, 0 if the page is a uniform 32 bit value, or -1 if there was not enough space
+ *         or it was incompressible
  */
-static kern_return_t
-c_compress_page(
+static int
+c_compress_page_codec(
 	char             *src,
-	c_slot_mapping_t slot_ptr,
-	c_segment_t      *current_chead,
+	char             *dst,
+	int              max_csize,
 	char             *scratch_buf,
-	__unused vm_compressor_options_t flags)
+	uint16_t         *ccodec,
+	boolean_t        *incomp_copy)
 {
 	int              c_size = -1;
-	int              c_rounded_size = 0;
-	int              max_csize;
-	bool             nearing_limits;
-	c_slot_t         cs;
-	c_segment_t      c_seg;
-
-	KERNEL_DEBUG(0xe0400000 | DBG_FUNC_START, *current_chead, 0, 0, 0, 0);
-retry:  /* may need to retry if the currently filling c_seg will not have enough space */
-	c_seg = c_seg_allocate(current_chead, &nearing_limits);
-	if (c_seg == NULL) {
-		if (nearing_limits) {
-			memorystatus_respond_to_compressor_exhaustion();
-		}
-		return KERN_RESOURCE_SHORTAGE;
-	}
-
-	/*
-	 * returns with c_seg lock held
-	 * and PAGE_REPLACEMENT_DISALLOWED(TRUE)...
-	 * c_nextslot has been allocated and
-	 * c_store.c_buffer populated
-	 */
-	assert(c_seg->c_state == C_IS_FILLING);
-
-	cs = C_SEG_SLOT_FROM_INDEX(c_seg, c_seg->c_nextslot);
-
-	C_SLOT_ASSERT_PACKABLE(slot_ptr);
-	cs->c_packed_ptr = C_SLOT_PACK_PTR(slot_ptr);
+	int              max_csize_adj = (max_csize - 4); /* how much size we have left in this c_seg to fill. */
 
-	cs->c_offset = c_seg->c_nextoffset;
-
-	unsigned int avail_space = c_seg_bufsize - C_SEG_OFFSET_TO_BYTES((int32_t)cs->c_offset);
-
-
-	max_csize = avail_space;
-	if (max_csize > PAGE_SIZE) {
-		max_csize = PAGE_SIZE;
-	}
-
-#if CHECKSUM_THE_DATA
-	cs->c_hash_data = vmc_hash(src, PAGE_SIZE);
-#endif
-	boolean_t incomp_copy = FALSE; /* codec indicates it already did copy an incompressible page */
-	int max_csize_adj = (max_csize - 4); /* how much size we have left in this c_seg to fill. */
+	*ccodec = CCWK;
+	*incomp_copy = FALSE;
 
 	if (vm_compressor_algorithm() != VM_COMPRESSOR_DEFAULT_CODEC) {
 #if defined(__arm64__)
-		uint16_t ccodec = CINVALID;
 		uint32_t inline_popcount;
+
+		*ccodec = CINVALID;
 		if (max_csize >= C_SEG_OFFSET_ALIGNMENT_BOUNDARY) {
 			vm_memtag_disable_checking();
-			c_size = metacompressor((const uint8_t *) src,
-			    (uint8_t *) &c_seg->c_store.c_buffer[cs->c_offset],
-			    max_csize_adj, &ccodec,
-			    scratch_buf, &incomp_copy, &inline_popcount);
+			c_size = metacompressor((const uint8_t *) src, (uint8_t *) dst,
+			    max_csize_adj, ccodec,
+			    scratch_buf, incomp_copy, &inline_popcount);
 			vm_memtag_enable_checking();
 			assert(inline_popcount == C_SLOT_NO_POPCOUNT);
 
@@ -4833,26 +4854,29 @@ retry:  /* may need to retry if the currently filling c_seg will not have enough
 		} else {
 			c_size = -1;
 		}
-		assert(ccodec == CCWK || ccodec == CCLZ4);
-		cs->c_codec = ccodec;
+		assert(*ccodec < CCODEC_COUNT);
 #endif
+	} else if (vm_compressor_wkdm_simd) {
+		vm_memtag_disable_checking();
+		c_size = WKdm_compress_simd((const WK_word *)(uintptr_t)src, (WK_word *)(uintptr_t)dst,
+		    (WK_word *)(uintptr_t)scratch_buf, max_csize_adj, PAGE_SIZE / sizeof(WK_word));
+		vm_memtag_enable_checking();
 	} else {
 #if defined(__arm64__)
 		vm_memtag_disable_checking();
-		cs->c_codec = CCWK;
 		__unreachable_ok_push
 		if (PAGE_SIZE == 4096) {
-			c_size = WKdm_compress_4k((WK_word *)(uintptr_t)src, (WK_word *)(uintptr_t)&c_seg->c_store.c_buffer[cs->c_offset],
+			c_size = WKdm_compress_4k((WK_word *)(uintptr_t)src, (WK_word *)(uintptr_t)dst,
 			    (WK_word *)(uintptr_t)scratch_buf, max_csize_adj);
 		} else {
-			c_size = WKdm_compress_16k((WK_word *)(uintptr_t)src, (WK_word *)(uintptr_t)&c_seg->c_store.c_buffer[cs->c_offset],
+			c_size = WKdm_compress_16k((WK_word *)(uintptr_t)src, (WK_word *)(uintptr_t)dst,
 			    (WK_word *)(uintptr_t)scratch_buf, max_csize_adj);
 		}
 		__unreachable_ok_pop
 		vm_memtag_enable_checking();
 #else
 		vm_memtag_disable_checking();
-		c_size = WKdm_compress_new((const WK_word *)(uintptr_t)src, (WK_word *)(uintptr_t)&c_seg->c_store.c_buffer[cs->c_offset],
+		c_size = WKdm_compress_new((const WK_word *)(uintptr_t)src, (WK_word *)(uintptr_t)dst,
 		    (WK_word *)(uintptr_t)scratch_buf, max_csize_adj);
 		vm_memtag_enable_checking();
 #endif
@@ -4862,60 +4886,24 @@ retry:  /* may need to retry if the currently filling c_seg will not have enough
 	assertf(((c_size <= max_csize_adj) && (c_size >= -1)),
 	    "c_size invalid (%d, %d), cur compressions: %d", c_size, max_csize_adj, c_segment_pages_compressed);
 
-	if (c_size == -1) {
-		if (max_csize < PAGE_SIZE) {
-			c_current_seg_filled(c_seg, current_chead);
-			assert(*current_chead == NULL);
-
-			lck_mtx_unlock_always(&c_seg->c_lock);
-			/* TODO: it may be worth requiring codecs to distinguish
-			 * between incompressible inputs and failures due to budget exhaustion.
-			 * right now this assumes that if the space we had is > PAGE_SIZE, then the codec failed due to incompressible input */
-
-			PAGE_REPLACEMENT_DISALLOWED(FALSE);
-			goto retry;  /* previous c_seg didn't have enought space, we finalized it and can try again with a fresh c_seg */
-		}
-		c_size = PAGE_SIZE; /* tag:WK-INCOMPRESSIBLE */
-
-		if (incomp_copy == FALSE) { /* codec did not copy the incompressible input */
-			vm_memtag_disable_checking();
-			memcpy(&c_seg->c_store.c_buffer[cs->c_offset], src, c_size);
-			vm_memtag_enable_checking();
-		}
-
-		os_atomic_inc(&c_segment_noncompressible_pages, relaxed);
-	} else if (c_size == 0) {
-		{
-			/*
-			 * Special case - this is a page completely full of a single 32 bit value.
-			 * We store some values directly in the c_slot_mapping, if not there, the
-			 * 4 byte value goes in the compressor segment.
-			 */
-			int hash_index = c_segment_sv_hash_insert(*(uint32_t *) (uintptr_t) src);
-
-			if (hash_index != -1) {
-				slot_ptr->s_cindx = hash_index;
-				slot_ptr->s_cseg = C_SV_CSEG_ID;
-#if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
-				slot_ptr->s_uncompressed = 0;
-#endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
+	return c_size;
+}
 
-				os_atomic_inc(&c_segment_svp_hash_succeeded, relaxed);
-#if RECORD_THE_COMPRESSED_DATA
-				c_compressed_record_data(src, 4);
-#endif
-				/* we didn't write anything to c_buffer and didn't end up using the slot in the c_seg at all, so skip all
-				 * the book-keeping of the case that we did */
-				goto sv_compression;
-			}
-		}
-		os_atomic_inc(&c_segment_svp_hash_failed, relaxed);
+/*
+ * Single value page that didn't fit in c_segment_sv_hash: the value is
+ * stored in the segment as a 4 byte slot.
+ */
+#define C_SV_SLOT_SIZE  4
 
-		c_size = 4;
-		vm_memtag_disable_checking();
-		memcpy(&c_seg->c_store.c_buffer[cs->c_offset], src, c_size);
-		vm_memtag_enable_checking();
-	}
+/**
+ * Account for the c_size bytes of compressed data written at cs->c_offset and point slot_ptr at them.
+ * Called with the c_seg lock held.
+ * @return the space used in the c_seg, i.e. c_size rounded to the segment alignment
+ */
+static int
+c_seg_commit_slot(c_segment_t c_seg, c_slot_t cs, c_slot_mapping_t slot_ptr, int c_size)
+{
+	int c_rounded_size;
 
 #if RECORD_THE_COMPRESSED_DATA
 	c_compressed_record_data((char *)&c_seg->c_store.c_buffer[cs->c_offset], c_size);
@@ -4951,43 +4939,653 @@ retry:  /* may need to retry if the currently filling c_seg will not have enough
 	slot_ptr->s_uncompressed = 0;
 #endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
 
-sv_compression:
-	/* can we say this c_seg is full? */
-	if (c_seg->c_nextoffset >= c_seg_off_limit || c_seg->c_nextslot >= C_SLOT_MAX_INDEX) {
-		/* condition 1: segment buffer is almost full, don't bother trying to fill it further.
-		 * condition 2: we can't have any more slots in this c_segment even if we had buffer space */
-		c_current_seg_filled(c_seg, current_chead);
-		assert(*current_chead == NULL);
-	}
+	return c_rounded_size;
+}
 
-	lck_mtx_unlock_always(&c_seg->c_lock);
+/*
+ * Try to store a single value page in c_segment_sv_hash, in which case it
+ * doesn't need any space in a c_seg.
+ */
+static bool
+c_sv_commit_slot(uint32_t value, c_slot_mapping_t slot_ptr)
+{
+	int hash_index = c_segment_sv_hash_insert(value);
 
-	PAGE_REPLACEMENT_DISALLOWED(FALSE);
+	if (hash_index == -1) {
+		os_atomic_inc(&c_segment_svp_hash_failed, relaxed);
+		return false;
+	}
+	slot_ptr->s_cindx = hash_index;
+	slot_ptr->s_cseg = C_SV_CSEG_ID;
+#if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
+	slot_ptr->s_uncompressed = 0;
+#endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
 
+	os_atomic_inc(&c_segment_svp_hash_succeeded, relaxed);
 #if RECORD_THE_COMPRESSED_DATA
-	if ((c_compressed_record_cptr - c_compressed_record_sbuf) >= c_seg_allocsize) {
-		c_compressed_record_write(c_compressed_record_sbuf, (int)(c_compressed_record_cptr - c_compressed_record_sbuf));
-		c_compressed_record_cptr = c_compressed_record_sbuf;
-	}
+	c_compressed_record_data((char *)&value, 4);
 #endif
-	if (c_size) {
-		os_atomic_add(&c_segment_compressed_bytes, c_size, relaxed);
-		os_atomic_add(&compressor_bytes_used, c_rounded_size, relaxed);
-	}
-	os_atomic_add(&c_segment_input_bytes, PAGE_SIZE, relaxed);
+	return true;
+}
 
-	os_atomic_inc(&c_segment_pages_compressed, relaxed);
-#if DEVELOPMENT || DEBUG
-	if (!compressor_running_perf_test) {
-		/*
-		 * The perf_compressor benchmark should not be able to trigger
-		 * compressor thrashing jetsams.
-		 */
-		os_atomic_inc(&sample_period_compression_count, relaxed);
-	}
-#else /* DEVELOPMENT || DEBUG */
-	os_atomic_inc(&sample_period_compression_count, relaxed);
-#endif /* DEVELOPMENT || DEBUG */
+/*
+ * Content addressed dedup of compressed pages.
+ *
+ * Identical pages compress to identical bytes, so once a page has been
+ * compressed into the filling c_seg, the compressed data is hashed and
+ * looked up in c_dedup_buckets.  The first time a hash is seen it is only
+ * remembered as a candidate.  The next page with that hash keeps its copy
+ * in the c_seg and hands it to a new c_dedup_entry: the c_slot then points
+ * back at the entry's cde_slot instead of a pager slot, which lets
+ * compaction and swapping move the shared copy around like any other.
+ * Later copies whose SHA-256 digest matches the shared one's just take a
+ * reference on the entry rather than using space in the c_seg.  Digests
+ * are only computed once a hash has been seen, outside the bucket lock.
+ *
+ * Pages are only shared between c_segs of the same c_task_owner, so that
+ * frozen tasks keep being charged for their own pages.
+ *
+ * An entry lives until its last reference is dropped, at which point its
+ * copy is freed from its c_seg as for a regular slot.
+ */
+#define C_DEDUP_WAYS            8
+#define C_DEDUP_ENTRIES         (C_DEDUP_CSEG_IDS * C_SLOT_MAX_INDEX)
+#define C_DEDUP_BUCKETS         (C_DEDUP_ENTRIES / C_DEDUP_WAYS)
+#define C_DEDUP_LOCKS           64
+#define C_DEDUP_HASH_WORDS      32      /* words of compressed data sampled by c_dedup_hash() */
+
+struct c_dedup_entry {
+	struct c_slot_mapping   cde_slot;       /* where the shared copy is, its c_slot points back here */
+	uint32_t                cde_refs;       /* slot mappings referencing this entry */
+	uint16_t                cde_size;
+	uint8_t                 cde_codec;
+	uint8_t                 cde_dying;      /* the last reference is being dropped, don't share */
+	uint64_t                cde_owner;      /* c_dedup_owner() of the c_seg it was created in */
+	uint8_t                 cde_digest[SHA256_DIGEST_LENGTH];
+};
+typedef struct c_dedup_entry *c_dedup_entry_t;
+
+struct c_dedup_bucket {
+	uint32_t                cdb_hash[C_DEDUP_WAYS];         /* 0 for an unused way */
+	c_dedup_entry_t         cdb_entry[C_DEDUP_WAYS];        /* NULL if the hash is only a candidate */
+	uint32_t                cdb_hand;                       /* next candidate to replace */
+};
+
+typedef enum {
+	C_DEDUP_NONE,           /* not shared, the caller commits the slot */
+	C_DEDUP_SHARED,         /* references an identical copy, the c_slot is unused */
+	C_DEDUP_OWNER,          /* the slot was committed as the copy of a new entry */
+} c_dedup_result_t;
+
+TUNABLE(bool, vm_compressor_dedup, "vm_compressor_dedup", false);
+
+static bool                     c_dedup_enabled;
+static struct c_dedup_bucket    *c_dedup_buckets;
+static lck_mtx_t                c_dedup_locks[C_DEDUP_LOCKS];
+static zone_t                   c_dedup_zone;
+
+uint32_t        c_dedup_entries;        /* entries holding a shared copy */
+uint64_t        c_dedup_hits;           /* pages that were stored as a reference to a shared copy */
+uint64_t        c_dedup_bytes_saved;    /* c_seg space currently saved by the shared copies */
+uint64_t        c_dedup_verify_failed;  /* hash matches whose digest differed */
+
+static void
+c_dedup_init(void)
+{
+	if (!vm_compressor_dedup) {
+		return;
+	}
+	if (c_segments_limit >= C_DEDUP_CSEG_BASE) {
+		printf("vm_compressor: %u c_segs leave no room for dedup slot mappings, dedup disabled\n",
+		    c_segments_limit);
+		return;
+	}
+	c_dedup_buckets = kalloc_type(struct c_dedup_bucket, C_DEDUP_BUCKETS,
+	    Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	/* entries are pointed to by c_slots, so need to be in the packable VM submap */
+	c_dedup_zone = zone_create("compressor_dedup", sizeof(struct c_dedup_entry),
+	    ZC_VM | ZC_NOENCRYPT);
+	for (int i = 0; i < C_DEDUP_LOCKS; i++) {
+		lck_mtx_init(&c_dedup_locks[i], &vm_compressor_lck_grp, LCK_ATTR_NULL);
+	}
+	c_dedup_enabled = true;
+}
+
+static inline lck_mtx_t *
+c_dedup_lock(uint32_t bucket)
+{
+	return &c_dedup_locks[bucket % C_DEDUP_LOCKS];
+}
+
+static inline uint32_t
+c_dedup_slot_id(c_slot_mapping_t slot_ptr)
+{
+	return (slot_ptr->s_cseg - C_DEDUP_CSEG_BASE) * C_SLOT_MAX_INDEX + slot_ptr->s_cindx;
+}
+
+static inline void
+c_dedup_set_slot(c_slot_mapping_t slot_ptr, uint32_t id)
+{
+	slot_ptr->s_cseg = C_DEDUP_CSEG_BASE + id / C_SLOT_MAX_INDEX;
+	slot_ptr->s_cindx = id % C_SLOT_MAX_INDEX;
+#if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
+	slot_ptr->s_uncompressed = 0;
+#endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
+}
+
+/*
+ * Sampled hash of the compressed data: hits are always verified with a
+ * digest of all of it, so this only needs to keep collisions rare.
+ */
+static uint32_t
+c_dedup_hash(const char *data, int c_size, uint16_t ccodec)
+{
+	const uint32_t  *words = (const uint32_t *)(uintptr_t)data;
+	uint32_t        nwords = (uint32_t)(c_size / sizeof(uint32_t));
+	uint32_t        stride = MAX(nwords / C_DEDUP_HASH_WORDS, 1);
+	uint32_t        h = ((uint32_t)c_size << 8) ^ ccodec;
+
+	for (uint32_t i = 0; i < nwords; i += stride) {
+		h = (h ^ words[i]) * 0x01000193;
+		h ^= h >> 15;
+	}
+	h ^= words[nwords - 1];
+	h *= 0x9e3779b1;
+	h ^= h >> 16;
+
+	return h ? h : 1;
+}
+
+static void
+c_dedup_digest(const char *data, int c_size, uint8_t digest[SHA256_DIGEST_LENGTH])
+{
+	SHA256_CTX      ctx;
+
+	SHA256_Init(&ctx);
+	SHA256_Update(&ctx, data, c_size);
+	SHA256_Final(digest, &ctx);
+}
+
+/*
+ * Frozen c_segs are charged to their task: identifies it, or 0 for
+ * c_segs that don't have an owner.  The unique id rather than the
+ * task pointer so that entries outliving their task can't match
+ * another one allocated at the same address.
+ */
+static inline uint64_t
+c_dedup_owner(c_segment_t c_seg)
+{
+	task_t          owner = c_seg->c_task_owner;
+
+	return owner ? get_task_uniqueid(owner) + 1 : 0;
+}
+
+/*
+ * Has hash been seen in bucket b, as a candidate or a shared copy?
+ */
+static bool
+c_dedup_known(struct c_dedup_bucket *b, uint32_t hash)
+{
+	for (int way = 0; way < C_DEDUP_WAYS; way++) {
+		if (b->cdb_hash[way] == hash) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Pick a candidate way of a full bucket to replace, entries with a shared
+ * copy are only removed once their last reference goes away.
+ */
+static int
+c_dedup_victim(struct c_dedup_bucket *b)
+{
+	for (int n = 0; n < C_DEDUP_WAYS; n++) {
+		int way = (int)(b->cdb_hand++ % C_DEDUP_WAYS);
+
+		if (b->cdb_entry[way] == NULL) {
+			return way;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Look up the c_size bytes of compressed data just written at cs->c_offset in the dedup table.
+ * Called with the c_seg lock held and PAGE_REPLACEMENT_DISALLOWED(TRUE).
+ * The bucket lock is dropped while computing the digest, so the bucket
+ * is looked at again afterwards.
+ * @param c_rounded_size [OUT] space used in the c_seg for C_DEDUP_OWNER
+ */
+static c_dedup_result_t
+c_dedup_insert(c_segment_t c_seg, c_slot_t cs, c_slot_mapping_t slot_ptr, int c_size, uint16_t ccodec,
+    int *c_rounded_size)
+{
+	const char      *data = (const char *)&c_seg->c_store.c_buffer[cs->c_offset];
+	uint32_t        hash = c_dedup_hash(data, c_size, ccodec);
+	uint32_t        bindx = hash % C_DEDUP_BUCKETS;
+	struct c_dedup_bucket *b = &c_dedup_buckets[bindx];
+	uint64_t        owner = c_dedup_owner(c_seg);
+	uint8_t         digest[SHA256_DIGEST_LENGTH];
+	bool            have_digest = false;
+	c_dedup_result_t result = C_DEDUP_NONE;
+	c_dedup_entry_t e;
+	int             free_way = -1;
+	int             candidate_way = -1;
+	bool            compared = false;
+
+	lck_mtx_lock_spin_always(c_dedup_lock(bindx));
+
+	if (c_dedup_known(b, hash)) {
+		/* worth a digest, but don't hold up the other buckets of the lock with it */
+		lck_mtx_unlock_always(c_dedup_lock(bindx));
+		c_dedup_digest(data, c_size, digest);
+		have_digest = true;
+		lck_mtx_lock_spin_always(c_dedup_lock(bindx));
+	}
+
+	for (int way = 0; way < C_DEDUP_WAYS; way++) {
+		if (b->cdb_hash[way] == 0) {
+			if (free_way == -1) {
+				free_way = way;
+			}
+			continue;
+		}
+		if (b->cdb_hash[way] != hash) {
+			continue;
+		}
+		e = b->cdb_entry[way];
+		if (e == NULL) {
+			candidate_way = way;
+			continue;
+		}
+		if (e->cde_dying || e->cde_size != c_size || e->cde_codec != ccodec ||
+		    e->cde_owner != owner || !have_digest) {
+			/* a copy that showed up while we were computing the digest is only missed */
+			continue;
+		}
+		compared = true;
+		if (memcmp(e->cde_digest, digest, sizeof(digest)) != 0) {
+			os_atomic_inc(&c_dedup_verify_failed, relaxed);
+			break;
+		}
+		e->cde_refs++;
+		c_dedup_set_slot(slot_ptr, bindx * C_DEDUP_WAYS + way);
+		os_atomic_inc(&c_dedup_hits, relaxed);
+		os_atomic_add(&c_dedup_bytes_saved, C_SEG_ROUND_TO_ALIGNMENT(c_size), relaxed);
+		result = C_DEDUP_SHARED;
+		break;
+	}
+
+	if (compared) {
+		/* there's a shared copy for this hash already, don't make another */
+	} else if (candidate_way != -1 && have_digest) {
+		/*
+		 * Second time we see this data: keep this copy and share it
+		 * with the ones to come.
+		 */
+		e = zalloc_flags(c_dedup_zone, Z_NOWAIT | Z_ZERO);
+		if (e != NULL) {
+			*c_rounded_size = c_seg_commit_slot(c_seg, cs, slot_ptr, c_size);
+
+			e->cde_slot = *slot_ptr;
+			e->cde_refs = 1;
+			e->cde_size = (uint16_t)c_size;
+			e->cde_codec = (uint8_t)ccodec;
+			e->cde_owner = owner;
+			memcpy(e->cde_digest, digest, sizeof(digest));
+			C_SLOT_ASSERT_PACKABLE(&e->cde_slot);
+			cs->c_packed_ptr = C_SLOT_PACK_PTR(&e->cde_slot);
+
+			b->cdb_entry[candidate_way] = e;
+			c_dedup_set_slot(slot_ptr, bindx * C_DEDUP_WAYS + candidate_way);
+			os_atomic_inc(&c_dedup_entries, relaxed);
+			result = C_DEDUP_OWNER;
+		}
+	} else if (candidate_way == -1) {
+		/* first time we see this data, remember it as a candidate */
+		if (free_way == -1) {
+			free_way = c_dedup_victim(b);
+		}
+		if (free_way != -1) {
+			b->cdb_hash[free_way] = hash;
+		}
+	}
+
+	lck_mtx_unlock_always(c_dedup_lock(bindx));
+
+	return result;
+}
+
+static inline void
+c_dedup_drop_ref_locked(c_dedup_entry_t e)
+{
+	assert(e->cde_refs > 1);
+	e->cde_refs--;
+	os_atomic_sub(&c_dedup_bytes_saved, C_SEG_ROUND_TO_ALIGNMENT(e->cde_size), relaxed);
+}
+
+/*
+ * Drop the last reference on entry id, removing the shared copy from its
+ * c_seg with c_decompress_page(), which decompresses it first unless dst
+ * is NULL.  The entry is left in place, with its reference, when the copy
+ * couldn't be removed (i.e. *zeroslot was cleared).
+ *
+ * Called with the bucket lock held, returns with it dropped.
+ */
+static vm_decompress_result_t
+c_dedup_release_locked(uint32_t id, c_dedup_entry_t e, char *dst, vm_compressor_options_t flags,
+    int *zeroslot)
+{
+	uint32_t        bindx = id / C_DEDUP_WAYS;
+	struct c_dedup_bucket *b = &c_dedup_buckets[bindx];
+	vm_decompress_result_t retval;
+
+	assert(e->cde_refs == 1 && !e->cde_dying);
+	e->cde_dying = 1;
+	lck_mtx_unlock_always(c_dedup_lock(bindx));
+
+	retval = c_decompress_page(dst, &e->cde_slot, flags, zeroslot);
+
+	lck_mtx_lock_spin_always(c_dedup_lock(bindx));
+	if (*zeroslot) {
+		b->cdb_hash[id % C_DEDUP_WAYS] = 0;
+		b->cdb_entry[id % C_DEDUP_WAYS] = NULL;
+	} else {
+		e->cde_dying = 0;
+	}
+	lck_mtx_unlock_always(c_dedup_lock(bindx));
+
+	if (*zeroslot) {
+		os_atomic_dec(&c_dedup_entries, relaxed);
+		zfree(c_dedup_zone, e);
+	}
+	return retval;
+}
+
+/*
+ * vm_compressor_get() for a slot mapping referencing a dedup entry.
+ */
+static vm_decompress_result_t
+c_dedup_get(char *dst, c_slot_mapping_t slot_ptr, vm_compressor_options_t flags, int *zeroslot)
+{
+	uint32_t        id = c_dedup_slot_id(slot_ptr);
+	uint32_t        bindx = id / C_DEDUP_WAYS;
+	c_dedup_entry_t e;
+	vm_decompress_result_t retval;
+
+	if (__improbable(flags & C_KDP)) {
+		if (kdp_lck_mtx_lock_spin_is_acquired(c_dedup_lock(bindx))) {
+			*zeroslot = 0;
+			return DECOMPRESS_NEED_BLOCK;
+		}
+		e = c_dedup_buckets[bindx].cdb_entry[id % C_DEDUP_WAYS];
+		return c_decompress_page(dst, &e->cde_slot, flags, zeroslot);
+	}
+
+	lck_mtx_lock_spin_always(c_dedup_lock(bindx));
+	e = c_dedup_buckets[bindx].cdb_entry[id % C_DEDUP_WAYS];
+	assert(e != NULL && e->cde_refs && !e->cde_dying);
+
+	if (e->cde_refs == 1 && !(flags & C_KEEP)) {
+		/* we're the only user left, take the copy out as for a regular slot */
+		return c_dedup_release_locked(id, e, dst, flags, zeroslot);
+	}
+
+	/* keep the shared copy around while decompressing it */
+	e->cde_refs++;
+	lck_mtx_unlock_always(c_dedup_lock(bindx));
+
+	retval = c_decompress_page(dst, &e->cde_slot, flags | C_KEEP, zeroslot);
+	assert(*zeroslot == 0);
+
+	lck_mtx_lock_spin_always(c_dedup_lock(bindx));
+	e->cde_refs--;
+
+	if ((flags & C_KEEP) || retval < DECOMPRESS_SUCCESS) {
+		lck_mtx_unlock_always(c_dedup_lock(bindx));
+	} else if (e->cde_refs > 1) {
+		c_dedup_drop_ref_locked(e);
+		lck_mtx_unlock_always(c_dedup_lock(bindx));
+
+		os_atomic_dec(&c_segment_pages_compressed, relaxed);
+		*zeroslot = 1;
+	} else if (flags & C_DONT_BLOCK) {
+		/*
+		 * Everybody else let go while we were decompressing and
+		 * freeing the copy might block: keep the slot, the caller
+		 * handles it as if C_KEEP had been passed.
+		 */
+		lck_mtx_unlock_always(c_dedup_lock(bindx));
+	} else {
+		*zeroslot = 1;
+		(void)c_dedup_release_locked(id, e, NULL, 0, zeroslot);
+	}
+	return retval;
+}
+
+/*
+ * vm_compressor_free() for a slot mapping referencing a dedup entry.
+ */
+static vm_decompress_result_t
+c_dedup_free(c_slot_mapping_t slot_ptr, vm_compressor_options_t flags, int *zeroslot)
+{
+	uint32_t        id = c_dedup_slot_id(slot_ptr);
+	uint32_t        bindx = id / C_DEDUP_WAYS;
+	c_dedup_entry_t e;
+
+	lck_mtx_lock_spin_always(c_dedup_lock(bindx));
+	e = c_dedup_buckets[bindx].cdb_entry[id % C_DEDUP_WAYS];
+	assert(e != NULL && e->cde_refs && !e->cde_dying);
+
+	if (e->cde_refs == 1) {
+		return c_dedup_release_locked(id, e, NULL, flags, zeroslot);
+	}
+	c_dedup_drop_ref_locked(e);
+	lck_mtx_unlock_always(c_dedup_lock(bindx));
+
+	os_atomic_dec(&c_segment_pages_compressed, relaxed);
+	return DECOMPRESS_SUCCESS;
+}
+
+/**
+ * Commit the c_size bytes of compressed data at cs->c_offset to slot_ptr, unless an identical
+ * copy is already stored, in which case slot_ptr references that copy instead.
+ * Called with the c_seg lock held and PAGE_REPLACEMENT_DISALLOWED(TRUE).
+ * @return the space used in the c_seg, 0 if the page shares an existing copy
+ */
+static int
+c_seg_commit_slot_dedup(c_segment_t c_seg, c_slot_t cs, c_slot_mapping_t slot_ptr, int c_size, uint16_t ccodec)
+{
+	int c_rounded_size = 0;
+
+	if (c_dedup_enabled && c_size > C_SV_SLOT_SIZE) {
+		switch (c_dedup_insert(c_seg, cs, slot_ptr, c_size, ccodec, &c_rounded_size)) {
+		case C_DEDUP_SHARED:
+			return 0;
+		case C_DEDUP_OWNER:
+			return c_rounded_size;
+		case C_DEDUP_NONE:
+			break;
+		}
+	}
+	return c_seg_commit_slot(c_seg, cs, slot_ptr, c_size);
+}
+
+/*
+ * Is the c_seg full enough that it isn't worth trying to fill it further?
+ */
+static inline bool
+c_seg_is_filled(c_segment_t c_seg)
+{
+	/* condition 1: segment buffer is almost full, don't bother trying to fill it further.
+	 * condition 2: we can't have any more slots in this c_segment even if we had buffer space */
+	return c_seg->c_nextoffset >= c_seg_off_limit || c_seg->c_nextslot >= C_SLOT_MAX_INDEX;
+}
+
+/*
+ * Global accounting for pages that were just compressed, done once per
+ * page or batch of pages once all the c_seg locks have been dropped.
+ */
+static void
+c_compress_account(uint32_t pages, uint64_t c_bytes, uint64_t c_rounded_bytes)
+{
+	if (c_bytes) {
+		os_atomic_add(&c_segment_compressed_bytes, c_bytes, relaxed);
+		os_atomic_add(&compressor_bytes_used, c_rounded_bytes, relaxed);
+	}
+	os_atomic_add(&c_segment_input_bytes, (uint64_t)pages * PAGE_SIZE, relaxed);
+
+	os_atomic_add(&c_segment_pages_compressed, pages, relaxed);
+#if DEVELOPMENT || DEBUG
+	if (!compressor_running_perf_test) {
+		/*
+		 * The perf_compressor benchmark should not be able to trigger
+		 * compressor thrashing jetsams.
+		 */
+		os_atomic_add(&sample_period_compression_count, pages, relaxed);
+	}
+#else /* DEVELOPMENT || DEBUG */
+	os_atomic_add(&sample_period_compression_count, pages, relaxed);
+#endif /* DEVELOPMENT || DEBUG */
+}
+
+/**
+ * Do the actual compression of the given page
+ * @param src [IN] address in the physical aperture of the page to compress.
+ * @param slot_ptr [OUT] fill the slot-mapping of the c_seg+slot where the page ends up being stored
+ * @param current_chead [IN-OUT] current filling c_seg. pointer comes from the current compression thread state
+ *          On the very first call this is going to point to NULL and this function will fill that pointer with a new
+ *          filling c_sec if the current filling c_seg doesn't have enough space, it will be replaced in this location
+ *          with a new filling c_seg
+ * @param scratch_buf [IN] pointer from the current thread state, used by the compression codec
+ * @return KERN_RESOURCE_SHORTAGE if the compressor has been exhausted
+ */
+static kern_return_t
+c_compress_page(
+	char             *src,
+	c_slot_mapping_t slot_ptr,
+	c_segment_t      *current_chead,
+	char             *scratch_buf,
+	__unused vm_compressor_options_t flags)
+{
+	int              c_size = -1;
+	int              c_rounded_size = 0;
+	int              max_csize;
+	bool             nearing_limits;
+	c_slot_t         cs;
+	c_segment_t      c_seg;
+	uint16_t         ccodec;
+
+	KERNEL_DEBUG(0xe0400000 | DBG_FUNC_START, *current_chead, 0, 0, 0, 0);
+retry:  /* may need to retry if the currently filling c_seg will not have enough space */
+	c_seg = c_seg_allocate(current_chead, &nearing_limits);
+	if (c_seg == NULL) {
+		if (nearing_limits) {
+			memorystatus_respond_to_compressor_exhaustion();
+		}
+		return KERN_RESOURCE_SHORTAGE;
+	}
+
+	/*
+	 * returns with c_seg lock held
+	 * and PAGE_REPLACEMENT_DISALLOWED(TRUE)...
+	 * c_nextslot has been allocated and
+	 * c_store.c_buffer populated
+	 */
+	assert(c_seg->c_state == C_IS_FILLING);
+
+	cs = C_SEG_SLOT_FROM_INDEX(c_seg, c_seg->c_nextslot);
+
+	C_SLOT_ASSERT_PACKABLE(slot_ptr);
+	cs->c_packed_ptr = C_SLOT_PACK_PTR(slot_ptr);
+
+	cs->c_offset = c_seg->c_nextoffset;
+
+	unsigned int avail_space = c_seg_bufsize - C_SEG_OFFSET_TO_BYTES((int32_t)cs->c_offset);
+
+
+	max_csize = avail_space;
+	if (max_csize > PAGE_SIZE) {
+		max_csize = PAGE_SIZE;
+	}
+
+#if CHECKSUM_THE_DATA
+	cs->c_hash_data = vmc_hash(src, PAGE_SIZE);
+#endif
+	boolean_t incomp_copy = FALSE; /* codec indicates it already did copy an incompressible page */
+
+	c_size = c_compress_page_codec(src, (char *)&c_seg->c_store.c_buffer[cs->c_offset],
+	    max_csize, scratch_buf, &ccodec, &incomp_copy);
+#if C_SLOT_C_CODEC_BITS
+	cs->c_codec = ccodec;
+#endif
+
+	if (c_size == -1) {
+		if (max_csize < PAGE_SIZE) {
+			c_current_seg_filled(c_seg, current_chead);
+			assert(*current_chead == NULL);
+
+			lck_mtx_unlock_always(&c_seg->c_lock);
+			/* TODO: it may be worth requiring codecs to distinguish
+			 * between incompressible inputs and failures due to budget exhaustion.
+			 * right now this assumes that if the space we had is > PAGE_SIZE, then the codec failed due to incompressible input */
+
+			PAGE_REPLACEMENT_DISALLOWED(FALSE);
+			goto retry;  /* previous c_seg didn't have enought space, we finalized it and can try again with a fresh c_seg */
+		}
+		c_size = PAGE_SIZE; /* tag:WK-INCOMPRESSIBLE */
+
+		if (incomp_copy == FALSE) { /* codec did not copy the incompressible input */
+			vm_memtag_disable_checking();
+			memcpy(&c_seg->c_store.c_buffer[cs->c_offset], src, c_size);
+			vm_memtag_enable_checking();
+		}
+
+		os_atomic_inc(&c_segment_noncompressible_pages, relaxed);
+	} else if (c_size == 0) {
+		/*
+		 * Special case - this is a page completely full of a single 32 bit value.
+		 * We store some values directly in the c_slot_mapping, if not there, the
+		 * 4 byte value goes in the compressor segment.
+		 */
+		if (c_sv_commit_slot(*(uint32_t *) (uintptr_t) src, slot_ptr)) {
+			/* we didn't write anything to c_buffer and didn't end up using the slot in the c_seg at all, so skip all
+			 * the book-keeping of the case that we did */
+			goto sv_compression;
+		}
+
+		c_size = C_SV_SLOT_SIZE;
+		vm_memtag_disable_checking();
+		memcpy(&c_seg->c_store.c_buffer[cs->c_offset], src, c_size);
+		vm_memtag_enable_checking();
+	}
+
+	c_rounded_size = c_seg_commit_slot_dedup(c_seg, cs, slot_ptr, c_size, ccodec);
+	if (c_rounded_size == 0) {
+		/* an identical page is already stored, nothing was added to the c_seg */
+		c_size = 0;
+	}
+
+sv_compression:
+	/* can we say this c_seg is full? */
+	if (c_seg_is_filled(c_seg)) {
+		c_current_seg_filled(c_seg, current_chead);
+		assert(*current_chead == NULL);
+	}
+
+	lck_mtx_unlock_always(&c_seg->c_lock);
+
+	PAGE_REPLACEMENT_DISALLOWED(FALSE);
+
+#if RECORD_THE_COMPRESSED_DATA
+	if ((c_compressed_record_cptr - c_compressed_record_sbuf) >= c_seg_allocsize) {
+		c_compressed_record_write(c_compressed_record_sbuf, (int)(c_compressed_record_cptr - c_compressed_record_sbuf));
+		c_compressed_record_cptr = c_compressed_record_sbuf;
+	}
+#endif
+	c_compress_account(1, c_size, c_rounded_size);
 
 	if (nearing_limits) {
 		memorystatus_respond_to_compressor_exhaustion();
@@ -5218,11 +5816,16 @@ bypass_busy_check:
 			}
 #endif /* CONFIG_FREEZE */
 			assert(kdp_mode == FALSE);
-			retval = c_seg_swapin(c_seg, FALSE, TRUE);
+			os_atomic_inc(&vm_swapin_prefetch_misses, relaxed);
+			retval = c_seg_swapin_internal(c_seg, FALSE, TRUE, TRUE);
 			assert(retval == 0);
 
 			retval = DECOMPRESS_SUCCESS_SWAPPEDIN;
 		}
+		if (c_seg->c_prefetched) {
+			c_seg->c_prefetched = 0;
+			os_atomic_inc(&vm_swapin_prefetch_hits, relaxed);
+		}
 		if (c_seg->c_state == C_ON_BAD_Q) {
 			assert(c_seg->c_store.c_buffer == NULL);
 			*zeroslot = 0;
@@ -5301,6 +5904,11 @@ bypass_busy_check:
 					assert(inline_popcount == C_SLOT_NO_POPCOUNT);
 				}
 #endif
+			} else if (vm_compressor_wkdm_simd) {
+				vm_memtag_disable_checking();
+				WKdm_decompress_simd((WK_word *)(uintptr_t)&c_seg->c_store.c_buffer[cs->c_offset],
+				    (WK_word *)(uintptr_t)dst, (WK_word *)(uintptr_t)scratch_buf, c_size, PAGE_SIZE / sizeof(WK_word));
+				vm_memtag_enable_checking();
 			} else {  /* algorithm == VM_COMPRESSOR_DEFAULT_CODEC */
 				vm_memtag_disable_checking();
 #if defined(__arm64__)
@@ -5609,7 +6217,11 @@ vm_compressor_get(ppnum_t pn, int *slot, vm_compressor_options_t flags)
 		pmap_unmap_compressor_page(pn, dst);
 		return DECOMPRESS_SUCCESS;
 	}
-	retval = c_decompress_page(dst, slot_ptr, flags, &zeroslot);
+	if (C_SLOT_IS_DEDUP(slot_ptr)) {
+		retval = c_dedup_get(dst, slot_ptr, flags, &zeroslot);
+	} else {
+		retval = c_decompress_page(dst, slot_ptr, flags, &zeroslot);
+	}
 
 	/*
 	 * zeroslot will be set to 0 by c_decompress_page if (flags & C_KEEP)
@@ -5652,7 +6264,11 @@ vm_compressor_free(int *slot, vm_compressor_options_t flags)
 			return 0;
 		}
 
-		retval = c_decompress_page(NULL, slot_ptr, flags, &zeroslot);
+		if (C_SLOT_IS_DEDUP(slot_ptr)) {
+			retval = c_dedup_free(slot_ptr, flags, &zeroslot);
+		} else {
+			retval = c_decompress_page(NULL, slot_ptr, flags, &zeroslot);
+		}
 		/*
 		 * returns 0 if we successfully freed the specified compressed page
 		 * returns -1 if we encountered an error swapping in the segment - decompression failed
@@ -5708,6 +6324,202 @@ vm_compressor_put(ppnum_t pn, int *slot, void  **current_chead, char *scratch_bu
 	return kr;
 }
 
+/*
+ * Batched compression, used by the pageout path when vmcomp_batch is set.
+ *
+ * Every page of the batch is compressed into its own PAGE_SIZE slice of the
+ * caller's staging buffer without holding any compressor lock, then the
+ * compressed pages are copied into the filling c_seg in runs, taking the
+ * c_seg lock and PAGE_REPLACEMENT_DISALLOWED once per run rather than once
+ * per page.  The staging buffer has an extra page at the end since codecs
+ * may write past their budget, see c_seg_allocsize.
+ */
+uint64_t c_batch_pages = 0;     /* pages compressed by vm_compressor_put_batch() */
+uint64_t c_batch_runs = 0;      /* c_seg lock acquisitions it took to commit them */
+
+#define C_BATCH_DONE    (-2)    /* vcb_csize of an entry that took the regular put path */
+
+/*
+ * Can c_seg take one more slot of c_size bytes without going through
+ * c_seg_allocate() again, i.e. is the slot array and buffer space populated?
+ */
+static inline bool
+c_seg_has_room(c_segment_t c_seg, int c_size)
+{
+	if (c_seg->c_nextslot >= c_seg_fixed_array_len &&
+	    (c_seg->c_nextslot - c_seg_fixed_array_len) >= c_seg->c_slot_var_array_len) {
+		return false;
+	}
+	return C_SEG_OFFSET_TO_BYTES(c_seg->c_populated_offset - c_seg->c_nextoffset) >=
+	       (unsigned int)C_SEG_ROUND_TO_ALIGNMENT(c_size);
+}
+
+void
+vm_compressor_put_batch(vm_compressor_batch_entry_t *entries, uint32_t count, void **current_chead,
+    char *scratch_buf, char *staging_buf)
+{
+	c_segment_t     *chead = (c_segment_t *)current_chead;
+	c_segment_t     c_seg;
+	uint64_t        c_bytes = 0, c_rounded_bytes = 0;
+	uint32_t        pages = 0, runs = 0;
+	bool            nearing_limits = false;
+	uint32_t        i;
+
+	KERNEL_DEBUG(0xe0400000 | DBG_FUNC_START, *chead, count, 0, 0, 0);
+
+	/* stage 1: compress everything into the staging buffer, no locks held */
+	for (i = 0; i < count; i++) {
+		vm_compressor_batch_entry_t *e = &entries[i];
+		char            *dst = staging_buf + (size_t)i * PAGE_SIZE;
+		boolean_t       incomp_copy;
+		char            *src;
+		int             c_size;
+
+		e->vcb_kr = KERN_RESOURCE_SHORTAGE;
+#if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
+		if (e->vcb_flags & C_PAGE_UNMODIFIED) {
+			e->vcb_kr = vm_compressor_put(e->vcb_ppnum, e->vcb_slot, current_chead, scratch_buf, e->vcb_flags);
+			e->vcb_csize = C_BATCH_DONE;
+			continue;
+		}
+#endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
+
+		src = pmap_map_compressor_page(e->vcb_ppnum);
+		assert(src != NULL);
+
+#if CHECKSUM_THE_DATA
+		e->vcb_hash_data = vmc_hash(src, PAGE_SIZE);
+#endif
+		c_size = c_compress_page_codec(src, dst, PAGE_SIZE, scratch_buf, &e->vcb_codec, &incomp_copy);
+		if (c_size == -1) {
+			c_size = PAGE_SIZE; /* tag:WK-INCOMPRESSIBLE */
+			if (incomp_copy == FALSE) {
+				vm_memtag_disable_checking();
+				memcpy(dst, src, c_size);
+				vm_memtag_enable_checking();
+			}
+			os_atomic_inc(&c_segment_noncompressible_pages, relaxed);
+		} else if (c_size == 0) {
+			/* keep the value around for the commit stage */
+			*(uint32_t *)(uintptr_t)dst = *(uint32_t *)(uintptr_t)src;
+		}
+		e->vcb_csize = c_size;
+
+		pmap_unmap_compressor_page(e->vcb_ppnum, src);
+	}
+
+	/* stage 2: commit runs of slots to the filling c_seg */
+	i = 0;
+	while (i < count) {
+		bool            nearing;
+		bool            seg_full = false;
+
+		if (entries[i].vcb_csize == C_BATCH_DONE) {
+			i++;
+			continue;
+		}
+
+		c_seg = c_seg_allocate(chead, &nearing);
+		nearing_limits |= nearing;
+		if (c_seg == NULL) {
+			/* the remaining entries are left as KERN_RESOURCE_SHORTAGE */
+			break;
+		}
+		assert(c_seg->c_state == C_IS_FILLING);
+		runs++;
+
+		for (; i < count; i++) {
+			vm_compressor_batch_entry_t *e = &entries[i];
+			char            *staged = staging_buf + (size_t)i * PAGE_SIZE;
+			c_slot_mapping_t slot_ptr = (c_slot_mapping_t)e->vcb_slot;
+			int             c_size = e->vcb_csize;
+			unsigned int    avail_space;
+			int             c_rounded_size;
+			c_slot_t        cs;
+
+			if (c_size == C_BATCH_DONE) {
+				continue;
+			}
+			if (c_size == 0) {
+				if (c_sv_commit_slot(*(uint32_t *)(uintptr_t)staged, slot_ptr)) {
+					e->vcb_kr = KERN_SUCCESS;
+					pages++;
+					continue;
+				}
+				c_size = e->vcb_csize = C_SV_SLOT_SIZE;
+			}
+
+			/*
+			 * Same space requirements as c_compress_page(): the codec is
+			 * given (space - 4) bytes and incompressible pages need a full page.
+			 */
+			avail_space = c_seg_bufsize - C_SEG_OFFSET_TO_BYTES((int32_t)c_seg->c_nextoffset);
+			if (c_size == PAGE_SIZE ? avail_space < PAGE_SIZE :
+			    (unsigned int)c_size + 4 > avail_space) {
+				seg_full = true;
+				break;
+			}
+			if (!c_seg_has_room(c_seg, c_size)) {
+				break;
+			}
+
+			cs = C_SEG_SLOT_FROM_INDEX(c_seg, c_seg->c_nextslot);
+
+			C_SLOT_ASSERT_PACKABLE(slot_ptr);
+			cs->c_packed_ptr = C_SLOT_PACK_PTR(slot_ptr);
+			cs->c_offset = c_seg->c_nextoffset;
+#if C_SLOT_C_CODEC_BITS
+			cs->c_codec = e->vcb_codec;
+#endif
+#if CHECKSUM_THE_DATA
+			cs->c_hash_data = e->vcb_hash_data;
+#endif
+			vm_memtag_disable_checking();
+			memcpy(&c_seg->c_store.c_buffer[cs->c_offset], staged, c_size);
+			vm_memtag_enable_checking();
+
+			c_rounded_size = c_seg_commit_slot_dedup(c_seg, cs, slot_ptr, c_size, e->vcb_codec);
+			if (c_rounded_size) {
+				c_rounded_bytes += c_rounded_size;
+				c_bytes += c_size;
+			}
+			pages++;
+			e->vcb_kr = KERN_SUCCESS;
+
+			if (c_seg_is_filled(c_seg)) {
+				i++;
+				seg_full = true;
+				break;
+			}
+		}
+		if (seg_full) {
+			c_current_seg_filled(c_seg, chead);
+			assert(*chead == NULL);
+		}
+
+		lck_mtx_unlock_always(&c_seg->c_lock);
+
+		PAGE_REPLACEMENT_DISALLOWED(FALSE);
+
+#if RECORD_THE_COMPRESSED_DATA
+		if ((c_compressed_record_cptr - c_compressed_record_sbuf) >= c_seg_allocsize) {
+			c_compressed_record_write(c_compressed_record_sbuf, (int)(c_compressed_record_cptr - c_compressed_record_sbuf));
+			c_compressed_record_cptr = c_compressed_record_sbuf;
+		}
+#endif
+	}
+
+	c_compress_account(pages, c_bytes, c_rounded_bytes);
+	os_atomic_add(&c_batch_pages, pages, relaxed);
+	os_atomic_add(&c_batch_runs, runs, relaxed);
+
+	if (nearing_limits) {
+		memorystatus_respond_to_compressor_exhaustion();
+	}
+
+	KERNEL_DEBUG(0xe0400000 | DBG_FUNC_END, *chead, pages, c_segment_input_bytes, c_segment_compressed_bytes, 0);
+}
+
 void
 vm_compressor_transfer(
 	int     *dst_slot_p,
@@ -5720,7 +6532,9 @@ vm_compressor_transfer(
 
 	src_slot = (c_slot_mapping_t) src_slot_p;
 
-	if (src_slot->s_cseg == C_SV_CSEG_ID || !vm_compressor_is_slot_compressed(src_slot_p)) {
+	if (src_slot->s_cseg == C_SV_CSEG_ID || C_SLOT_IS_DEDUP(src_slot) ||
+	    !vm_compressor_is_slot_compressed(src_slot_p)) {
+		/* the slot mapping is all there is to move */
 		*dst_slot_p = *src_slot_p;
 		*src_slot_p = 0;
 		return;
@@ -5839,6 +6653,14 @@ vm_compressor_relocate(
 		return kr;
 	}
 
+	if (C_SLOT_IS_DEDUP(src_slot)) {
+		/*
+		 * the data is shared with other pages, possibly owned
+		 * by other tasks, leave it where it is
+		 */
+		return kr;
+	}
+
 	if (vm_compressor_is_slot_compressed((int *)src_slot) == false) {
 		/*
 		 * Unmodified anonymous pages are sitting uncompressed on disk.
@@ -6075,6 +6897,10 @@ vm_compressor_inject_error(int *slot)
 		printf("%s(): cannot inject errors in SV-compressed pages\n", __func__ );
 		return;
 	}
+	if (C_SLOT_IS_DEDUP(slot_ptr)) {
+		printf("%s(): cannot inject errors in deduplicated pages\n", __func__ );
+		return;
+	}
 
 	/* s_cseg is actually "segno+1" */
 	const uint32_t c_segno = slot_ptr->s_cseg - 1;
@@ -32,6 +32,7 @@
 #include "lz4.h"
 #include "WKdm_new.h"
 #include <vm/vm_compressor_algorithms_internal.h>
+#include <vm/vm_compressor_sampler.h>
 #include <vm/vm_compressor_internal.h>
 
 #define MZV_MAGIC (17185)
@@ -68,6 +69,12 @@ typedef struct {
 	uint32_t lz4_total_failures;
 } compressor_state_t;
 
+/*
+ * Use the portable C WKdm (WKdm_simd.c) instead of the assembly
+ * implementation, the compressed format is the same.
+ */
+TUNABLE(bool, vm_compressor_wkdm_simd, "vm_compressor_wkdm_simd", false);
+
 compressor_tuneables_t vmctune = {
 	.lz4_threshold = 2048,
 	.wkdm_reeval_threshold = 1536,
@@ -77,6 +84,9 @@ compressor_tuneables_t vmctune = {
 	.lz4_run_preselection_threshold = ~0U,
 	.lz4_run_continue_bytes = 0,
 	.lz4_profitable_bytes = 0,
+	.sample_wk_hit_percent = 60,
+	.sample_lz4_entropy_q8 = VMC_ENTROPY_Q8(6, 0),
+	.sample_raw_entropy_q8 = VMC_ENTROPY_Q8(7, 64),
 };
 
 compressor_state_t vmcstate = {
@@ -242,6 +252,10 @@ WKdmD(WK_word* src_buf, WK_word* dest_buf, WK_word* scratch, unsigned int bytes,
 #if defined(__arm64__)
 #endif
 	WKdm_hv(src_buf);
+	if (vm_compressor_wkdm_simd) {
+		WKdm_decompress_simd(src_buf, dest_buf, scratch, bytes, PAGE_SIZE / sizeof(WK_word));
+		return true;
+	}
 #if defined(__arm64__)
 #ifndef __ARM_16K_PG__
 	if (PAGE_SIZE == 4096) {
@@ -272,6 +286,10 @@ WKdmC(WK_word* src_buf, WK_word* dest_buf, WK_word* scratch,
 {
 	(void)incomp_copy;
 	int wkcval;
+
+	if (vm_compressor_wkdm_simd) {
+		return WKdm_compress_simd(src_buf, dest_buf, scratch, limit, PAGE_SIZE / sizeof(WK_word));
+	}
 #if defined(__arm64__)
 #ifndef __ARM_16K_PG__
 	if (PAGE_SIZE == 4096) {
@@ -296,13 +314,117 @@ WKdmC(WK_word* src_buf, WK_word* dest_buf, WK_word* scratch,
 }
 
 
+static int
+vmc_wk_compress(const uint8_t *in, uint8_t *cdst, int32_t outbufsz,
+    compressor_encode_scratch_t *cscratch, boolean_t *incomp_copy, uint32_t *pop_count)
+{
+	return WKdmC(in, cdst, &cscratch->wkscratch[0], incomp_copy, outbufsz, pop_count);
+}
+
+static bool
+vmc_wk_decompress(const uint8_t *source, uint8_t *dest, uint32_t csize,
+    compressor_decode_scratch_t *dscratch, uint32_t *pop_count)
+{
+	bool success;
+
+	success = WKdmD(source, dest, &dscratch->wkdecompscratch[0], csize, pop_count);
+
+	VM_DECOMPRESSOR_STAT(compressor_stats.wk_decompressions += 1);
+	VM_DECOMPRESSOR_STAT(compressor_stats.wk_decompressed_bytes += csize);
+	return success;
+}
+
+static int
+vmc_lz4_compress(const uint8_t *in, uint8_t *cdst, int32_t outbufsz,
+    compressor_encode_scratch_t *cscratch, __unused boolean_t *incomp_copy,
+    __unused uint32_t *pop_count)
+{
+	return (int) lz4raw_encode_buffer(cdst, outbufsz, in, PAGE_SIZE, &cscratch->lz4state[0]);
+}
+
+static bool
+vmc_lz4_decompress(const uint8_t *source, uint8_t *dest, uint32_t csize,
+    compressor_decode_scratch_t *dscratch, __unused uint32_t *pop_count)
+{
+	int rval;
+
+	rval = (int)lz4raw_decode_buffer(dest, PAGE_SIZE, source, csize, &dscratch->lz4decodestate[0]);
+	VM_DECOMPRESSOR_STAT(compressor_stats.lz4_decompressions += 1);
+	VM_DECOMPRESSOR_STAT(compressor_stats.lz4_decompressed_bytes += csize);
+
+	__assert_only uint32_t *d32 = dest;
+	assertf(rval == PAGE_SIZE, "LZ4 decode: size != pgsize %d, header: 0x%x, 0x%x, 0x%x",
+	    rval, *d32, *(d32 + 1), *(d32 + 2));
+	return rval == PAGE_SIZE;
+}
+
+/*
+ * Codecs indexed by the ID stored in c_slot.c_codec.
+ *
+ * compress returns the compressed size, 0 for a single value page (WKdm
+ * only) and -1 or 0 on failure depending on the codec, see metacompressor().
+ */
+static const struct vm_compressor_codec {
+	const char *vmc_name;
+	int       (*vmc_compress)(const uint8_t *in, uint8_t *cdst, int32_t outbufsz,
+	    compressor_encode_scratch_t *cscratch, boolean_t *incomp_copy, uint32_t *pop_count);
+	bool      (*vmc_decompress)(const uint8_t *source, uint8_t *dest, uint32_t csize,
+	    compressor_decode_scratch_t *dscratch, uint32_t *pop_count);
+} vm_compressor_codecs[CCODEC_COUNT] = {
+	[CCWK] = {
+		.vmc_name       = "wkdm",
+		.vmc_compress   = vmc_wk_compress,
+		.vmc_decompress = vmc_wk_decompress,
+	},
+	[CCLZ4] = {
+		.vmc_name       = "lz4",
+		.vmc_compress   = vmc_lz4_compress,
+		.vmc_decompress = vmc_lz4_decompress,
+	},
+};
+
+static vmc_route_t
+compressor_sample(const uint8_t *in)
+{
+	vmc_sample_tuneables_t tune = {
+		.vmst_wk_hit_percent = vmctune.sample_wk_hit_percent,
+		.vmst_lz4_entropy_q8 = vmctune.sample_lz4_entropy_q8,
+		.vmst_raw_entropy_q8 = vmctune.sample_raw_entropy_q8,
+	};
+	vmc_sample_t sample;
+	vmc_route_t route;
+	__unused uint64_t sstart;
+
+	VM_COMPRESSOR_STAT_DBG(sstart = mach_absolute_time());
+	vmc_sample_page(in, PAGE_SIZE, &sample);
+	route = vmc_sample_route(&sample, &tune);
+	VM_COMPRESSOR_STAT_DBG(compressor_stats.sampled_abstime += mach_absolute_time() - sstart);
+
+	VM_COMPRESSOR_STAT(compressor_stats.sampled_pages++);
+	switch (route) {
+	case VMC_ROUTE_WK:
+		VM_COMPRESSOR_STAT(compressor_stats.sampled_wk++);
+		break;
+	case VMC_ROUTE_LZ4:
+		VM_COMPRESSOR_STAT(compressor_stats.sampled_lz4++);
+		break;
+	case VMC_ROUTE_RAW:
+		VM_COMPRESSOR_STAT(compressor_stats.sampled_raw++);
+		break;
+	default:
+		VM_COMPRESSOR_STAT(compressor_stats.sampled_hybrid++);
+		break;
+	}
+	return route;
+}
+
 int
 metacompressor(const uint8_t *in, uint8_t *cdst, int32_t outbufsz, uint16_t *codec,
     void *cscratchin, boolean_t *incomp_copy, uint32_t *pop_count_p)
 {
 	int sz = -1;
 	int dowk = FALSE, dolz4 = FALSE, skiplz4 = FALSE;
-	int insize = PAGE_SIZE;
+	bool hybrid = false;
 	compressor_encode_scratch_t *cscratch = cscratchin;
 	/* Not all paths lead to an inline population count. */
 	uint32_t pop_count = C_SLOT_NO_POPCOUNT;
@@ -311,7 +433,30 @@ metacompressor(const uint8_t *in, uint8_t *cdst, int32_t outbufsz, uint16_t *cod
 		dowk = TRUE;
 	} else if (vm_compressor_current_codec == CMODE_LZ4) {
 		dolz4 = TRUE;
+	} else if (vm_compressor_current_codec == CMODE_SAMPLE) {
+		switch (compressor_sample(in)) {
+		case VMC_ROUTE_WK:
+			dowk = TRUE;
+			break;
+		case VMC_ROUTE_LZ4:
+			dolz4 = TRUE;
+			break;
+		case VMC_ROUTE_RAW:
+			/*
+			 * Nothing we have would shrink this page enough to pay
+			 * for itself: let the caller store it as incompressible.
+			 */
+			*codec = CCWK;
+			goto cexit;
+		default:
+			hybrid = true;
+			break;
+		}
 	} else if (vm_compressor_current_codec == CMODE_HYB) {
+		hybrid = true;
+	}
+
+	if (hybrid) {
 		enum compressor_preselect_t presel = compressor_preselect();
 		if (presel == CPRESELLZ4) {
 			dolz4 = TRUE;
@@ -328,13 +473,14 @@ metacompressor(const uint8_t *in, uint8_t *cdst, int32_t outbufsz, uint16_t *cod
 	if (dowk) {
 		*codec = CCWK;
 		VM_COMPRESSOR_STAT(compressor_stats.wk_compressions++);
-		sz = WKdmC(in, cdst, &cscratch->wkscratch[0], incomp_copy, outbufsz, &pop_count);
+		sz = vm_compressor_codecs[CCWK].vmc_compress(in, cdst, outbufsz,
+		    cscratch, incomp_copy, &pop_count);
 
 		if (sz == -1) {
 			VM_COMPRESSOR_STAT(compressor_stats.wk_compressed_bytes_total += PAGE_SIZE);
 			VM_COMPRESSOR_STAT(compressor_stats.wk_compression_failures++);
 
-			if (vm_compressor_current_codec == CMODE_HYB) {
+			if (hybrid) {
 				goto lz4eval;
 			}
 			goto cexit;
@@ -346,7 +492,7 @@ metacompressor(const uint8_t *in, uint8_t *cdst, int32_t outbufsz, uint16_t *cod
 		}
 	}
 lz4eval:
-	if (vm_compressor_current_codec == CMODE_HYB) {
+	if (hybrid) {
 		if (((sz == -1) || (sz >= vmctune.lz4_threshold)) && (skiplz4 == FALSE)) {
 			dolz4 = TRUE;
 		} else {
@@ -368,7 +514,8 @@ lz4compress:
 		int wksz = sz;
 		*codec = CCLZ4;
 
-		sz = (int) lz4raw_encode_buffer(cdst, outbufsz, in, insize, &cscratch->lz4state[0]);
+		sz = vm_compressor_codecs[CCLZ4].vmc_compress(in, cdst, outbufsz,
+		    cscratch, incomp_copy, &pop_count);
 
 		compressor_selector_update(sz, dowk, wksz);
 		if (sz == 0) {
@@ -386,30 +533,14 @@ bool
 metadecompressor(const uint8_t *source, uint8_t *dest, uint32_t csize,
     uint16_t ccodec, void *compressor_dscratchin, uint32_t *pop_count_p)
 {
-	int dolz4 = (ccodec == CCLZ4);
-	int rval;
 	compressor_decode_scratch_t *compressor_dscratch = compressor_dscratchin;
 	/* Not all paths lead to an inline population count. */
 	uint32_t pop_count = C_SLOT_NO_POPCOUNT;
 	bool success;
 
-	if (dolz4) {
-		rval = (int)lz4raw_decode_buffer(dest, PAGE_SIZE, source, csize, &compressor_dscratch->lz4decodestate[0]);
-		VM_DECOMPRESSOR_STAT(compressor_stats.lz4_decompressions += 1);
-		VM_DECOMPRESSOR_STAT(compressor_stats.lz4_decompressed_bytes += csize);
-
-		__assert_only uint32_t *d32 = dest;
-		assertf(rval == PAGE_SIZE, "LZ4 decode: size != pgsize %d, header: 0x%x, 0x%x, 0x%x",
-		    rval, *d32, *(d32 + 1), *(d32 + 2));
-		success = (rval == PAGE_SIZE);
-	} else {
-		assert(ccodec == CCWK);
-
-		success = WKdmD(source, dest, &compressor_dscratch->wkdecompscratch[0], csize, &pop_count);
-
-		VM_DECOMPRESSOR_STAT(compressor_stats.wk_decompressions += 1);
-		VM_DECOMPRESSOR_STAT(compressor_stats.wk_decompressed_bytes += csize);
-	}
+	assertf(ccodec < CCODEC_COUNT, "invalid codec %d", ccodec);
+	success = vm_compressor_codecs[ccodec].vmc_decompress(source, dest, csize,
+	    compressor_dscratch, &pop_count);
 
 	assert(pop_count_p != NULL);
 	*pop_count_p = pop_count;
@@ -459,7 +590,7 @@ vm_compressor_algorithm_init(void)
 
 	PE_parse_boot_argn("vm_compressor_codec", &new_codec, sizeof(new_codec));
 	assertf(((new_codec == VM_COMPRESSOR_DEFAULT_CODEC) || (new_codec == CMODE_WK) ||
-	    (new_codec == CMODE_LZ4) || (new_codec == CMODE_HYB)),
+	    (new_codec == CMODE_LZ4) || (new_codec == CMODE_HYB) || (new_codec == CMODE_SAMPLE)),
 	    "Invalid VM compression codec: %u", new_codec);
 
 #if defined(__arm64__)
@@ -468,6 +599,8 @@ vm_compressor_algorithm_init(void)
 		new_codec = VM_COMPRESSOR_DEFAULT_CODEC;
 	} else if (PE_parse_boot_argn("-vm_compressor_hybrid", &tmpc, sizeof(tmpc))) {
 		new_codec = CMODE_HYB;
+	} else if (PE_parse_boot_argn("-vm_compressor_sampled", &tmpc, sizeof(tmpc))) {
+		new_codec = CMODE_SAMPLE;
 	}
 
 	vm_compressor_current_codec = new_codec;
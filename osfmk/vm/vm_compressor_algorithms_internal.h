@@ -40,6 +40,7 @@ bool metadecompressor(const uint8_t *source, uint8_t *dest, uint32_t csize,
 typedef enum {
 	CCWK = 0, // must be 0 or 1
 	CCLZ4 = 1, //must be 0 or 1
+	CCODEC_COUNT,
 	CINVALID = 0xFFFF
 } vm_compressor_codec_t;
 
@@ -48,9 +49,12 @@ typedef enum {
 	CMODE_LZ4 = 1,
 	CMODE_HYB = 2,
 	VM_COMPRESSOR_DEFAULT_CODEC = 3,
-	CMODE_INVALID = 4
+	CMODE_SAMPLE = 4, /* per-page codec selection, see vm_compressor_sampler.h */
+	CMODE_INVALID = 5
 } vm_compressor_mode_t;
 
+extern bool vm_compressor_wkdm_simd;
+
 void vm_compressor_algorithm_init(void);
 int vm_compressor_algorithm(void);
 
@@ -72,6 +72,13 @@ typedef struct {
 
 	uint64_t wk_decompressed_bytes;
 	uint64_t wk_sv_decompressions;
+
+	uint64_t sampled_pages;
+	uint64_t sampled_wk;
+	uint64_t sampled_lz4;
+	uint64_t sampled_raw;
+	uint64_t sampled_hybrid;
+	uint64_t sampled_abstime;
 } compressor_stats_t;
 
 extern compressor_stats_t compressor_stats;
@@ -86,6 +93,9 @@ typedef struct {
 	uint32_t lz4_run_preselection_threshold;
 	uint32_t lz4_run_continue_bytes;
 	uint32_t lz4_profitable_bytes;
+	uint32_t sample_wk_hit_percent;
+	uint32_t sample_lz4_entropy_q8;
+	uint32_t sample_raw_entropy_q8;
 } compressor_tuneables_t;
 
 extern compressor_tuneables_t vmctune;
@@ -68,6 +68,8 @@ int             vm_swapout_thread_processed_segments = 0;
 int             vm_swapout_thread_awakened = 0;
 bool            vm_swapout_thread_running = FALSE;
 _Atomic bool    vm_swapout_wake_pending = false;
+bool            vm_swapin_prefetch_thread_running = FALSE;
+thread_t        vm_swapin_prefetch_thread_self = THREAD_NULL;
 int             vm_swapfile_create_thread_awakened = 0;
 int             vm_swapfile_create_thread_running = 0;
 int             vm_swapfile_gc_thread_awakened = 0;
@@ -131,6 +133,8 @@ static void vm_swap_handle_delayed_trims(boolean_t);
 static void vm_swap_do_delayed_trim(struct swapfile *);
 static void vm_swap_wait_on_trim_handling_in_progress(void);
 static void vm_swapout_finish(c_segment_t c_seg, uint64_t f_offset, uint32_t size, kern_return_t kr);
+static void vm_swapin_prefetch_thread(void);
+static kern_return_t vm_swap_get_finish(c_segment_t c_seg, struct swapfile *swf, uint64_t f_offset, uint64_t size, int error, boolean_t drop_iocount);
 
 extern int vnode_getwithref(struct vnode* vp);
 
@@ -489,6 +493,14 @@ vm_compressor_swap_init(void)
 	vm_swapout_thread_id = thread->thread_id;
 	thread_deallocate(thread);
 
+	if (kernel_thread_start_priority((thread_continue_t)vm_swapin_prefetch_thread, NULL,
+	    BASEPRI_VM, &thread) != KERN_SUCCESS) {
+		panic("vm_swapin_prefetch_thread: create failed");
+	}
+	thread_set_thread_name(thread, "VM_swapin_prefetch");
+	vm_swapin_prefetch_thread_self = thread;
+	thread_deallocate(thread);
+
 	if (kernel_thread_start_priority((thread_continue_t)vm_swapfile_create_thread, NULL,
 	    BASEPRI_VM, &thread) != KERN_SUCCESS) {
 		panic("vm_swapfile_create_thread: create failed");
@@ -1258,6 +1270,11 @@ again:
 		C_SEG_BUSY(c_seg);
 		c_seg->c_busy_swapping = 1;
 
+		if (c_seg->c_prefetched) {
+			c_seg->c_prefetched = 0;
+			os_atomic_inc(&vm_swapin_prefetch_wasted, relaxed);
+		}
+
 		c_seg_switch_state(c_seg, C_ON_SWAPIO_Q, FALSE);
 
 		lck_mtx_unlock_always(c_list_lock);
@@ -1497,6 +1514,332 @@ vm_swapout_finish(c_segment_t c_seg, uint64_t f_offset, uint32_t size, kern_retu
 }
 
 
+/*
+ * Swap-in prefetch
+ *
+ * c_segs land on the swapped out queue in the order their swapouts
+ * complete, so the neighbours of a c_seg on that queue were usually
+ * filled at about the same time and pushed to swap along with it.
+ * When a fault has to swap a c_seg back in, the faulting thread hands
+ * up to vm_swapin_prefetch_max of those neighbours to the prefetch
+ * thread, which reads them in asynchronously while the fault waits for
+ * its own (synchronous) read.
+ *
+ * A neighbour qualifies if it was created within
+ * VM_SWAPIN_PREFETCH_WINDOW_SECS of the faulting c_seg (and, with the
+ * freezer, belongs to the same task); the scan in each direction stops
+ * at the first c_seg that doesn't qualify.
+ */
+#define VM_SWAPIN_PREFETCH_LIMIT_MAX    8
+#define VM_SWAPIN_PREFETCH_WINDOW_SECS  30
+
+TUNABLE(uint32_t, vm_swapin_prefetch_max, "vm_swapin_prefetch_max", 4);
+
+uint64_t        vm_swapin_prefetch_issued = 0;  /* c_segs read in by the prefetcher */
+uint64_t        vm_swapin_prefetch_hits = 0;    /* prefetched c_segs later decompressed from */
+uint64_t        vm_swapin_prefetch_misses = 0;  /* faults that had to swap a c_seg in */
+uint64_t        vm_swapin_prefetch_wasted = 0;  /* prefetched c_segs freed or swapped out unused */
+
+struct swapin_io_completion vm_swapin_ctx[VM_SWAPIN_PREFETCH_LIMIT_MAX];
+
+int vm_swapin_sic_busy = 0;
+int vm_swapin_sic_pending = 0;
+int vm_swapin_sic_done = 0;
+
+
+static struct swapin_io_completion *
+vm_swapin_find_free_sic(void)
+{
+	int      i;
+
+	for (i = 0; i < VM_SWAPIN_PREFETCH_LIMIT_MAX; i++) {
+		if (vm_swapin_ctx[i].swi_io_busy == 0) {
+			return &vm_swapin_ctx[i];
+		}
+	}
+	assert(vm_swapin_sic_busy == VM_SWAPIN_PREFETCH_LIMIT_MAX);
+
+	return NULL;
+}
+
+static struct swapin_io_completion *
+vm_swapin_find_pending_sic(void)
+{
+	int      i;
+
+	if (vm_swapin_sic_pending) {
+		for (i = 0; i < VM_SWAPIN_PREFETCH_LIMIT_MAX; i++) {
+			if (vm_swapin_ctx[i].swi_io_busy && !vm_swapin_ctx[i].swi_io_issued) {
+				return &vm_swapin_ctx[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+static struct swapin_io_completion *
+vm_swapin_find_done_sic(void)
+{
+	int      i;
+
+	if (vm_swapin_sic_done) {
+		for (i = 0; i < VM_SWAPIN_PREFETCH_LIMIT_MAX; i++) {
+			if (vm_swapin_ctx[i].swi_io_done) {
+				return &vm_swapin_ctx[i];
+			}
+		}
+	}
+	return NULL;
+}
+
+static bool
+vm_swapin_prefetch_eligible(c_segment_t c_seg, c_segment_t neighbour)
+{
+	uint32_t        delta;
+
+	if (neighbour->c_creation_ts > c_seg->c_creation_ts) {
+		delta = neighbour->c_creation_ts - c_seg->c_creation_ts;
+	} else {
+		delta = c_seg->c_creation_ts - neighbour->c_creation_ts;
+	}
+	if (delta > VM_SWAPIN_PREFETCH_WINDOW_SECS) {
+		return false;
+	}
+#if CONFIG_FREEZE
+	if (neighbour->c_task_owner != c_seg->c_task_owner) {
+		return false;
+	}
+#endif /* CONFIG_FREEZE */
+	return true;
+}
+
+/*
+ * c_list_lock and the c_seg lock must be held
+ */
+static void
+vm_swapin_prefetch_enqueue(c_segment_t c_seg)
+{
+	struct swapin_io_completion *sic;
+
+	sic = vm_swapin_find_free_sic();
+	assert(sic);
+
+#if !CHECKSUM_THE_SWAP
+	c_seg_trim_tail(c_seg);
+#endif
+	C_SEG_BUSY(c_seg);
+	c_seg->c_busy_swapping = 1;
+	c_seg->c_busy_for_thread = vm_swapin_prefetch_thread_self;
+
+	sic->swi_c_seg = c_seg;
+	sic->swi_size = round_page_32(C_SEG_OFFSET_TO_BYTES(c_seg->c_populated_offset));
+	sic->swi_f_offset = c_seg->c_store.c_swap_handle;
+	sic->swi_io_issued = 0;
+	sic->swi_io_done = 0;
+	sic->swi_io_error = 0;
+	sic->swi_io_busy = 1;
+
+	vm_swapin_sic_busy++;
+	vm_swapin_sic_pending++;
+}
+
+/*
+ * Called by a thread about to swap in c_seg for a fault, with c_seg
+ * busy and unlocked and PAGE_REPLACEMENT_DISALLOWED held.
+ */
+void
+vm_swapin_prefetch(c_segment_t c_seg)
+{
+	c_segment_t     neighbour;
+	uint32_t        limit;
+	uint32_t        queued = 0;
+
+	limit = MIN(vm_swapin_prefetch_max, VM_SWAPIN_PREFETCH_LIMIT_MAX);
+
+	if (limit == 0 || compressor_store_stop_compaction || COMPRESSOR_NEEDS_TO_SWAP()) {
+		return;
+	}
+#if CONFIG_FREEZE
+	/*
+	 * Segments brought in speculatively would eat into the
+	 * freezer's in-core budget.
+	 */
+	if (freezer_incore_cseg_acct) {
+		return;
+	}
+#endif /* CONFIG_FREEZE */
+
+	lck_mtx_lock_spin_always(c_list_lock);
+
+	assert(c_seg->c_busy);
+
+	if (c_seg->c_state != C_ON_SWAPPEDOUT_Q) {
+		goto done;
+	}
+	for (int dir = 0; dir < 2; dir++) {
+		neighbour = c_seg;
+
+		while (queued < limit && vm_swapin_sic_busy < VM_SWAPIN_PREFETCH_LIMIT_MAX) {
+			if (dir == 0) {
+				neighbour = (c_segment_t)queue_next(&neighbour->c_age_list);
+			} else {
+				neighbour = (c_segment_t)queue_prev(&neighbour->c_age_list);
+			}
+			if (queue_end(&c_swappedout_list_head, (queue_entry_t)neighbour) ||
+			    !vm_swapin_prefetch_eligible(c_seg, neighbour)) {
+				break;
+			}
+			lck_mtx_lock_spin_always(&neighbour->c_lock);
+
+			if (!neighbour->c_busy && neighbour->c_populated_offset) {
+				vm_swapin_prefetch_enqueue(neighbour);
+				queued++;
+			}
+			lck_mtx_unlock_always(&neighbour->c_lock);
+		}
+	}
+done:
+	if (queued && !vm_swapin_prefetch_thread_running) {
+		thread_wakeup((event_t)&vm_swapin_prefetch_thread);
+	}
+	lck_mtx_unlock_always(c_list_lock);
+}
+
+static void
+vm_swapin_finish(c_segment_t c_seg, uint32_t size, kern_return_t kr)
+{
+	/*
+	 * Nothing has asked for the contents of a prefetched c_seg yet, so
+	 * put it on the age queue rather than giving it the swapped in
+	 * queue's grace period.
+	 */
+	if (c_seg_swapin_complete(c_seg, (vm_offset_t)c_seg->c_store.c_buffer, size, kr, FALSE, FALSE) == 0) {
+		if (kr == KERN_SUCCESS) {
+			c_seg->c_prefetched = 1;
+		}
+		C_SEG_WAKEUP_DONE(c_seg);
+		lck_mtx_unlock_always(&c_seg->c_lock);
+	}
+	PAGE_REPLACEMENT_DISALLOWED(FALSE);
+}
+
+static void
+vm_swapin_issue_sic(struct swapin_io_completion *sic)
+{
+	c_segment_t     c_seg = sic->swi_c_seg;
+	vm_offset_t     addr;
+	kern_return_t   kr;
+
+	addr = (vm_offset_t)C_SEG_BUFFER_ADDRESS(c_seg->c_mysegno);
+	c_seg->c_store.c_buffer = (int32_t *)addr;
+
+	kernel_memory_populate(addr, sic->swi_size, KMA_NOFAIL | KMA_COMPRESSOR,
+	    VM_KERN_MEMORY_COMPRESSOR);
+
+	sic->swi_upl_ctx.io_context = (void *)sic;
+	sic->swi_upl_ctx.io_done = (void *)vm_swapin_iodone;
+	sic->swi_upl_ctx.io_error = 0;
+
+	os_atomic_inc(&vm_swapin_prefetch_issued, relaxed);
+
+	kr = vm_swap_get_async(c_seg, sic->swi_f_offset, sic->swi_size, sic);
+
+	if (kr != KERN_SUCCESS) {
+		lck_mtx_lock_spin_always(c_list_lock);
+
+		if (sic->swi_io_done) {
+			sic->swi_io_done = 0;
+			vm_swapin_sic_done--;
+		}
+		lck_mtx_unlock_always(c_list_lock);
+
+		vm_swapin_finish(c_seg, sic->swi_size, kr);
+
+		lck_mtx_lock_spin_always(c_list_lock);
+
+		sic->swi_io_busy = 0;
+		vm_swapin_sic_busy--;
+
+		lck_mtx_unlock_always(c_list_lock);
+	}
+}
+
+static void
+vm_swapin_complete_sic(struct swapin_io_completion *sic)
+{
+	kern_return_t  kr;
+
+	lck_mtx_unlock_always(c_list_lock);
+
+	kr = vm_swap_get_finish(sic->swi_c_seg, sic->swi_swf, sic->swi_f_offset, sic->swi_size, sic->swi_io_error, TRUE /*drop iocount*/);
+	vm_swapin_finish(sic->swi_c_seg, sic->swi_size, kr);
+
+	lck_mtx_lock_spin_always(c_list_lock);
+
+	sic->swi_io_done = 0;
+	sic->swi_io_busy = 0;
+
+	vm_swapin_sic_busy--;
+	vm_swapin_sic_done--;
+}
+
+static void
+vm_swapin_prefetch_thread(void)
+{
+	struct swapin_io_completion *sic;
+
+	lck_mtx_lock_spin_always(c_list_lock);
+
+	vm_swapin_prefetch_thread_running = TRUE;
+
+	while (vm_swapin_sic_pending || vm_swapin_sic_done) {
+		while ((sic = vm_swapin_find_pending_sic())) {
+			sic->swi_io_issued = 1;
+			vm_swapin_sic_pending--;
+
+			lck_mtx_unlock_always(c_list_lock);
+
+			vm_swapin_issue_sic(sic);
+
+			lck_mtx_lock_spin_always(c_list_lock);
+		}
+		while ((sic = vm_swapin_find_done_sic())) {
+			vm_swapin_complete_sic(sic);
+		}
+	}
+	assert_wait((event_t)&vm_swapin_prefetch_thread, THREAD_UNINT);
+
+	vm_swapin_prefetch_thread_running = FALSE;
+
+	lck_mtx_unlock_always(c_list_lock);
+
+	thread_block((thread_continue_t)vm_swapin_prefetch_thread);
+
+	/* NOTREACHED */
+}
+
+
+void
+vm_swapin_iodone(void *io_context, int error)
+{
+	struct swapin_io_completion *sic;
+
+	sic = (struct swapin_io_completion *)io_context;
+
+	lck_mtx_lock_spin_always(c_list_lock);
+
+	sic->swi_io_done = 1;
+	sic->swi_io_error = error;
+	vm_swapin_sic_done++;
+
+	if (!vm_swapin_prefetch_thread_running) {
+		thread_wakeup((event_t)&vm_swapin_prefetch_thread);
+	}
+
+	lck_mtx_unlock_always(c_list_lock);
+}
+
+
 boolean_t
 vm_swap_create_file()
 {
@@ -1643,12 +1986,15 @@ vm_swap_create_file()
 }
 
 extern void vnode_put(struct vnode* vp);
-kern_return_t
-vm_swap_get(c_segment_t c_seg, uint64_t f_offset, uint64_t size)
+
+static kern_return_t
+vm_swap_get_internal(c_segment_t c_seg, uint64_t f_offset, uint64_t size, struct swapin_io_completion *sic)
 {
 	struct swapfile *swf = NULL;
 	uint64_t        file_offset = 0;
 	int             retval = 0;
+	void            *upl_ctx = NULL;
+	boolean_t       drop_iocount = FALSE;
 
 	assert(c_seg->c_store.c_buffer);
 
@@ -1658,8 +2004,9 @@ vm_swap_get(c_segment_t c_seg, uint64_t f_offset, uint64_t size)
 
 	if (swf == NULL || (!(swf->swp_flags & SWAP_READY) && !(swf->swp_flags & SWAP_RECLAIM))) {
 		vm_swap_get_failures++;
-		retval = 1;
-		goto done;
+		lck_mtx_unlock(&vm_swap_data_lock);
+
+		return KERN_FAILURE;
 	}
 	swf->swp_io_count++;
 
@@ -1670,17 +2017,41 @@ vm_swap_get(c_segment_t c_seg, uint64_t f_offset, uint64_t size)
 #endif
 	file_offset = (f_offset & SWAP_SLOT_MASK);
 
+	if (sic) {
+		sic->swi_swf = swf;
+
+		sic->swi_io_error = 0;
+		sic->swi_io_done = 0;
+
+		upl_ctx = (void *)&sic->swi_upl_ctx;
+	}
+
 	if ((retval = vnode_getwithref(swf->swp_vp)) != 0) {
 		printf("vm_swap_get: vnode_getwithref on swapfile failed with %d\n", retval);
 	} else {
-		retval = vm_swapfile_io(swf->swp_vp, file_offset, (uint64_t)c_seg->c_store.c_buffer, (int)(size / PAGE_SIZE_64), SWAP_READ, NULL);
-		vnode_put(swf->swp_vp);
+		retval = vm_swapfile_io(swf->swp_vp, file_offset, (uint64_t)c_seg->c_store.c_buffer, (int)(size / PAGE_SIZE_64), SWAP_READ, upl_ctx);
+		drop_iocount = TRUE;
 	}
 
+	if (retval || upl_ctx == NULL) {
+		return vm_swap_get_finish(c_seg, swf, f_offset, size, retval, drop_iocount);
+	}
+
+	return KERN_SUCCESS;
+}
+
+static kern_return_t
+vm_swap_get_finish(c_segment_t c_seg, struct swapfile *swf, uint64_t f_offset, uint64_t size, int error, boolean_t drop_iocount)
+{
+	if (drop_iocount) {
+		vnode_put(swf->swp_vp);
+	}
 #if DEVELOPMENT || DEBUG
 	C_SEG_WRITE_PROTECT(c_seg);
+#else
+	(void)c_seg;
 #endif
-	if (retval == 0) {
+	if (error == 0) {
 		counter_add(&vm_statistics_swapins, size >> PAGE_SHIFT);
 	} else {
 		vm_swap_get_failures++;
@@ -1698,16 +2069,34 @@ vm_swap_get(c_segment_t c_seg, uint64_t f_offset, uint64_t size)
 		swf->swp_flags &= ~SWAP_WANTED;
 		thread_wakeup((event_t) &swf->swp_flags);
 	}
-done:
 	lck_mtx_unlock(&vm_swap_data_lock);
 
-	if (retval == 0) {
+	if (error == 0) {
 		return KERN_SUCCESS;
 	} else {
 		return KERN_FAILURE;
 	}
 }
 
+kern_return_t
+vm_swap_get(c_segment_t c_seg, uint64_t f_offset, uint64_t size)
+{
+	return vm_swap_get_internal(c_seg, f_offset, size, NULL);
+}
+
+/*
+ * Issues the read and returns; vm_swapin_iodone() is called once it
+ * completes, after which the caller must call vm_swap_get_finish().
+ * On failure everything has already been undone.
+ */
+kern_return_t
+vm_swap_get_async(c_segment_t c_seg, uint64_t f_offset, uint64_t size, struct swapin_io_completion *sic)
+{
+	assert(sic);
+
+	return vm_swap_get_internal(c_seg, f_offset, size, sic);
+}
+
 kern_return_t
 vm_swap_put(vm_offset_t addr, uint64_t *f_offset, uint32_t size, c_segment_t c_seg, struct swapout_io_completion *soc)
 {
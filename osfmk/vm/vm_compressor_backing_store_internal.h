@@ -98,6 +98,32 @@ void vm_swapout_iodone(void *, int);
 kern_return_t vm_swap_put_finish(struct swapfile *, uint64_t *, int, boolean_t);
 kern_return_t vm_swap_put(vm_offset_t, uint64_t*, uint32_t, c_segment_t, struct swapout_io_completion *);
 
+
+struct swapin_io_completion {
+	int          swi_io_busy;       /* reserved by vm_swapin_prefetch() */
+	int          swi_io_issued;     /* read handed to the swapfile */
+	int          swi_io_done;
+	int          swi_io_error;
+
+	uint32_t     swi_size;
+	c_segment_t  swi_c_seg;
+
+	struct swapfile *swi_swf;
+	uint64_t        swi_f_offset;
+
+	struct upl_io_completion swi_upl_ctx;
+};
+void vm_swapin_iodone(void *, int);
+void vm_swapin_prefetch(c_segment_t);
+
+kern_return_t vm_swap_get_async(c_segment_t, uint64_t, uint64_t, struct swapin_io_completion *);
+
+extern uint32_t vm_swapin_prefetch_max;
+extern uint64_t vm_swapin_prefetch_issued;
+extern uint64_t vm_swapin_prefetch_hits;
+extern uint64_t vm_swapin_prefetch_misses;
+extern uint64_t vm_swapin_prefetch_wasted;
+
 void vm_swap_flush(void);
 void vm_swap_reclaim(void);
 void vm_swap_encrypt(c_segment_t);
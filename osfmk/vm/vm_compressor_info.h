@@ -90,4 +90,17 @@ struct vm_map_entry_info {
 
 #define VM_MAP_ENTRY_INFO_MAGIC 'S001'
 
+/*
+ * perf_compressor_data is the argument and result of sysctl kern.perf_compressor
+ * (DEVELOPMENT || DEBUG): the pages of buffer are compressed and the time it
+ * took, the bytes processed and how much the compressor grew are returned.
+ */
+struct perf_compressor_data {
+	user_addr_t     buffer;
+	size_t          buffer_size;
+	uint64_t        benchmark_time;
+	uint64_t        bytes_processed;
+	uint64_t        compressor_growth;
+};
+
 #endif /* PRIVATE */
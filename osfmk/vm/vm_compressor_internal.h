@@ -63,6 +63,7 @@ extern void             vm_swap_free(uint64_t);
 
 extern void             c_seg_swapin_requeue(c_segment_t, boolean_t, boolean_t, boolean_t);
 extern int              c_seg_swapin(c_segment_t, boolean_t, boolean_t);
+extern int              c_seg_swapin_complete(c_segment_t, vm_offset_t, uint32_t, kern_return_t, boolean_t, boolean_t);
 extern void             c_seg_wait_on_busy(c_segment_t);
 extern void             c_seg_trim_tail(c_segment_t);
 extern void             c_seg_switch_state(c_segment_t, int, boolean_t);
@@ -745,19 +745,19 @@ zfree_slot_array(compressor_slot_t *slots, size_t size)
 #endif /* !defined(__LP64__) */
 }
 
-kern_return_t
-vm_compressor_pager_put(
+/*
+ * Find (or create) the slot mapping for a page about to be compressed,
+ * dropping any previously compressed copy of it.
+ */
+static compressor_slot_t *
+compressor_pager_put_slot(
 	memory_object_t                 mem_obj,
 	memory_object_offset_t          offset,
-	ppnum_t                         ppnum,
-	void                            **current_chead,
-	char                            *scratch_buf,
 	int                             *compressed_count_delta_p, /* OUT */
 	vm_compressor_options_t         flags)
 {
 	compressor_pager_t pager;
 	compressor_slot_t *slot_p;
-	kern_return_t kr;
 
 	compressor_pager_stats.put++;
 
@@ -777,7 +777,6 @@ vm_compressor_pager_put(
 	if (os_convert_overflow(offset / PAGE_SIZE, &dummy_conv)) {
 		/* overflow, page number doesn't fit in a uint32 */
 		panic("%s: offset 0x%llx overflow", __FUNCTION__, (uint64_t) offset);
-		return KERN_RESOURCE_SHORTAGE;
 	}
 
 	/* we're looking for the slot_mapping that corresponds to the offset, which vm_compressor_put() is then going to
@@ -805,6 +804,23 @@ vm_compressor_pager_put(
 	 * undo any previous WIMG update, as all live mappings should be
 	 * disconnected.
 	 */
+	return slot_p;
+}
+
+kern_return_t
+vm_compressor_pager_put(
+	memory_object_t                 mem_obj,
+	memory_object_offset_t          offset,
+	ppnum_t                         ppnum,
+	void                            **current_chead,
+	char                            *scratch_buf,
+	int                             *compressed_count_delta_p, /* OUT */
+	vm_compressor_options_t         flags)
+{
+	compressor_slot_t *slot_p;
+	kern_return_t kr;
+
+	slot_p = compressor_pager_put_slot(mem_obj, offset, compressed_count_delta_p, flags);
 
 	kr = vm_compressor_put(ppnum, slot_p, current_chead, scratch_buf, flags);
 	if (kr == KERN_SUCCESS) {
@@ -813,6 +829,37 @@ vm_compressor_pager_put(
 	return kr;
 }
 
+/*
+ * Same as vm_compressor_pager_put() for a batch of pages headed to the same
+ * filling segment, staging_buf must be able to hold (count + 1) pages.
+ * The pages may belong to different pagers.
+ */
+void
+vm_compressor_pager_put_batch(
+	vm_compressor_batch_entry_t     *entries,
+	uint32_t                        count,
+	void                            **current_chead,
+	char                            *scratch_buf,
+	char                            *staging_buf)
+{
+	assert(count <= VM_COMPRESSOR_BATCH_MAX);
+
+	for (uint32_t i = 0; i < count; i++) {
+		vm_compressor_batch_entry_t *e = &entries[i];
+
+		e->vcb_slot = compressor_pager_put_slot(e->vcb_pager, e->vcb_offset,
+		    &e->vcb_compressed_count_delta, e->vcb_flags);
+	}
+
+	vm_compressor_put_batch(entries, count, current_chead, scratch_buf, staging_buf);
+
+	for (uint32_t i = 0; i < count; i++) {
+		if (entries[i].vcb_kr == KERN_SUCCESS) {
+			entries[i].vcb_compressed_count_delta += 1;
+		}
+	}
+}
+
 
 kern_return_t
 vm_compressor_pager_get(
@@ -44,6 +44,33 @@ extern kern_return_t vm_compressor_pager_put(
 	int                             *compressed_count_delta_p,
 	vm_compressor_options_t         flags);
 
+/*
+ * Batched pageout, see vm_compressor_pager_put_batch().
+ */
+#define VM_COMPRESSOR_BATCH_MAX         16
+
+typedef struct vm_compressor_batch_entry {
+	/* filled by the caller */
+	memory_object_t                 vcb_pager;
+	memory_object_offset_t          vcb_offset;
+	ppnum_t                         vcb_ppnum;
+	vm_compressor_options_t         vcb_flags;
+	/* results */
+	kern_return_t                   vcb_kr;
+	int                             vcb_compressed_count_delta;
+	/* private to the compressor */
+	int                             *vcb_slot;
+	int                             vcb_csize;
+	uint16_t                        vcb_codec;
+	uint32_t                        vcb_hash_data;  /* CHECKSUM_THE_DATA */
+} vm_compressor_batch_entry_t;
+
+extern void vm_compressor_pager_put_batch(
+	vm_compressor_batch_entry_t     *entries,
+	uint32_t                        count,
+	void                            **current_chead,
+	char                            *scratch_buf,
+	char                            *staging_buf);
 
 extern unsigned int vm_compressor_pager_state_clr(
 	memory_object_t         mem_obj,
@@ -77,6 +104,8 @@ extern bool osenvironment_is_diagnostics(void);
 extern void vm_compressor_init(void);
 extern bool vm_compressor_is_slot_compressed(int *slot);
 extern kern_return_t vm_compressor_put(ppnum_t pn, int *slot, void **current_chead, char *scratch_buf, vm_compressor_options_t flags);
+extern void vm_compressor_put_batch(vm_compressor_batch_entry_t *entries, uint32_t count, void **current_chead,
+    char *scratch_buf, char *staging_buf);
 extern vm_decompress_result_t vm_compressor_get(ppnum_t pn, int *slot, vm_compressor_options_t flags);
 extern int vm_compressor_free(int *slot, vm_compressor_options_t flags);
 
@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Per-page codec selection for the hybrid compressor.
+ *
+ * Before compressing a page, a fixed number of small chunks spread evenly
+ * across it are sampled to estimate:
+ *  - how many 32-bit words WKdm would encode cheaply (zero words, exact and
+ *    partial dictionary hits, using a WKdm-like 16-entry dictionary), and
+ *  - the byte-level Shannon entropy of the sampled bytes.
+ *
+ * Pages with mostly word-structured content go to WKdm, low entropy byte
+ * streams go to LZ4, and pages whose sample looks like random data are
+ * stored uncompressed without running any codec.  Everything else is left
+ * to the run-length driven hybrid heuristics.
+ *
+ * This header has no kernel dependencies so that the selector can be
+ * exercised from userspace (see tests/vm/compressor_selector.c).
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define VMC_SAMPLE_CHUNKS       32
+#define VMC_SAMPLE_CHUNK_WORDS  4
+#define VMC_SAMPLE_WORDS        (VMC_SAMPLE_CHUNKS * VMC_SAMPLE_CHUNK_WORDS)
+#define VMC_SAMPLE_BYTES        (VMC_SAMPLE_WORDS * 4)
+#define VMC_SAMPLE_BYTES_LOG2   9
+
+_Static_assert(VMC_SAMPLE_BYTES == (1 << VMC_SAMPLE_BYTES_LOG2),
+    "entropy estimate relies on a power of 2 sample size");
+
+#define VMC_DICT_SIZE           16
+#define VMC_PARTIAL_MASK        0xFFFFFC00u     /* WKdm compares the high 22 bits */
+
+/* Entropy values are in bits per byte, 8.8 fixed point */
+#define VMC_ENTROPY_Q8(bits, frac256)   (((bits) << 8) | (frac256))
+
+typedef enum {
+	VMC_ROUTE_HYB = 0,      /* inconclusive, defer to the hybrid heuristics */
+	VMC_ROUTE_WK  = 1,
+	VMC_ROUTE_LZ4 = 2,
+	VMC_ROUTE_RAW = 3,      /* store uncompressed, don't try any codec */
+	VMC_ROUTE_COUNT
+} vmc_route_t;
+
+typedef struct {
+	uint32_t vms_entropy_q8;        /* estimated byte entropy of the sample */
+	uint32_t vms_wk_hits;           /* sampled words with a cheap WKdm encoding */
+} vmc_sample_t;
+
+typedef struct {
+	uint32_t vmst_wk_hit_percent;   /* route to WKdm at or above this hit rate */
+	uint32_t vmst_lz4_entropy_q8;   /* route to LZ4 at or below this entropy */
+	uint32_t vmst_raw_entropy_q8;   /* store raw at or above this entropy */
+} vmc_sample_tuneables_t;
+
+#define VMC_SAMPLE_TUNEABLES_DEFAULT {                                  \
+	.vmst_wk_hit_percent = 60,                                      \
+	.vmst_lz4_entropy_q8 = VMC_ENTROPY_Q8(6, 0),                    \
+	.vmst_raw_entropy_q8 = VMC_ENTROPY_Q8(7, 64),                   \
+}
+
+/*
+ * Piecewise linear log2 in 8.8 fixed point, exact at powers of 2.
+ * x must be non zero.
+ */
+static inline uint32_t
+vmc_log2_q8(uint32_t x)
+{
+	uint32_t msb = 31 - (uint32_t)__builtin_clz(x);
+	uint32_t frac;
+
+	if (msb >= 8) {
+		frac = (x >> (msb - 8)) & 0xFF;
+	} else {
+		frac = (x << (8 - msb)) & 0xFF;
+	}
+	return (msb << 8) | frac;
+}
+
+static inline uint32_t
+vmc_dict_index(uint32_t w)
+{
+	return ((w >> 10) ^ (w >> 14) ^ (w >> 22)) & (VMC_DICT_SIZE - 1);
+}
+
+static inline void
+vmc_sample_page(const void *page, uint32_t page_size, vmc_sample_t *out)
+{
+	const uint32_t *words = (const uint32_t *)page;
+	uint32_t stride = page_size / (VMC_SAMPLE_CHUNKS * 4);
+	uint32_t dict[VMC_DICT_SIZE] = { 0 };
+	uint16_t hist[256] = { 0 };
+	uint32_t hits = 0;
+	uint32_t sum = 0;
+
+	for (uint32_t c = 0; c < VMC_SAMPLE_CHUNKS; c++) {
+		const uint32_t *chunk = words + c * stride;
+
+		for (uint32_t i = 0; i < VMC_SAMPLE_CHUNK_WORDS; i++) {
+			uint32_t w = chunk[i];
+			uint32_t *d = &dict[vmc_dict_index(w)];
+
+			if (w == 0 || ((*d ^ w) & VMC_PARTIAL_MASK) == 0) {
+				hits++;
+			}
+			*d = w;
+
+			hist[w & 0xFF]++;
+			hist[(w >> 8) & 0xFF]++;
+			hist[(w >> 16) & 0xFF]++;
+			hist[w >> 24]++;
+		}
+	}
+
+	/*
+	 * H = log2(N) - (1/N) * sum(c * log2(c)), N == VMC_SAMPLE_BYTES
+	 */
+	for (uint32_t b = 0; b < 256; b++) {
+		if (hist[b] > 1) {
+			sum += hist[b] * vmc_log2_q8(hist[b]);
+		}
+	}
+	sum >>= VMC_SAMPLE_BYTES_LOG2;
+
+	out->vms_wk_hits = hits;
+	out->vms_entropy_q8 = VMC_ENTROPY_Q8(VMC_SAMPLE_BYTES_LOG2, 0) > sum ?
+	    VMC_ENTROPY_Q8(VMC_SAMPLE_BYTES_LOG2, 0) - sum : 0;
+}
+
+static inline vmc_route_t
+vmc_sample_route(const vmc_sample_t *s, const vmc_sample_tuneables_t *t)
+{
+	if (s->vms_wk_hits * 100 >= t->vmst_wk_hit_percent * VMC_SAMPLE_WORDS) {
+		return VMC_ROUTE_WK;
+	}
+	if (s->vms_entropy_q8 >= t->vmst_raw_entropy_q8) {
+		return VMC_ROUTE_RAW;
+	}
+	if (s->vms_entropy_q8 <= t->vmst_lz4_entropy_q8) {
+		return VMC_ROUTE_LZ4;
+	}
+	return VMC_ROUTE_HYB;
+}
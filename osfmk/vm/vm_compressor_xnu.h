@@ -247,11 +247,12 @@ struct c_segment {
 	    c_state:4,                          /* what state is the segment in which dictates which q to find it on */
 	    c_overage_swap:1,
 	    c_has_donated_pages:1,
+	    c_prefetched:1,                     /* swapped in by the prefetcher and not yet decompressed from */
 #if CONFIG_FREEZE
 	    c_has_freezer_pages:1,
-	    c_reserved:21;
+	    c_reserved:20;
 #else /* CONFIG_FREEZE */
-	c_reserved:22;
+	c_reserved:21;
 #endif /* CONFIG_FREEZE */
 
 	int             c_slot_var_array_len;  /* length of the allocated c_slot_var_array */
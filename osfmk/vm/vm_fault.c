@@ -426,6 +426,25 @@ int vm_default_behind = VM_DEFAULT_DEACTIVATE_BEHIND_WINDOW;
 
 #define MAX_SEQUENTIAL_RUN      (1024 * 1024 * 1024)
 
+/*
+ * fault-around: on a read fault that is resolved from the top object,
+ * also map up to vm_fault_around_pages neighbouring pages of that object
+ * that are already resident, so that warm file-backed and shared cache
+ * mappings don't take one trap per page.
+ */
+#define VM_FAULT_AROUND_MAX_PAGES       64
+
+TUNABLE_WRITEABLE(uint32_t, vm_fault_around_pages, "vm_fault_around_pages", 16);
+uint64_t vm_fault_around_count = 0;
+uint64_t vm_fault_around_pages_entered = 0;
+
+/*
+ * speculative faults: resolved without the map lock,
+ * see vm_map_lookup_speculative().
+ */
+SCALABLE_COUNTER_DEFINE(vm_fault_speculative_hits);
+SCALABLE_COUNTER_DEFINE(vm_fault_speculative_fallbacks);
+
 /*
  * vm_page_is_sequential
  *
@@ -4022,6 +4041,351 @@ vm_fault_enter(
 	return kr;
 }
 
+/*
+ * vm_fault_enter_speculative
+ *
+ * vm_fault_enter() for a map looked up with vm_map_lookup_speculative():
+ * the translation is only made with the map pinned for "seq", without
+ * blocking in the pmap layer, so that it never becomes visible after
+ * a writer changed the mapping.  Returns KERN_ABORTED if one did.
+ *
+ * A "fault_type" of VM_PROT_NONE enters the page for fault-around (see
+ * vm_fault_around()): the mapping is left unreferenced and the page is
+ * left where it is on the paging queues.
+ */
+static kern_return_t
+vm_fault_enter_speculative(
+	vm_map_t                map,
+	unsigned int            seq,
+	vm_page_t               m,
+	vm_map_offset_t         vaddr,
+	vm_prot_t               prot,
+	vm_prot_t               caller_prot,
+	vm_prot_t               fault_type,
+	vm_object_fault_info_t  fault_info,
+	int                     *type_of_fault)
+{
+	kern_return_t   kr;
+	bool            page_needs_data_sync;
+
+	kr = vm_fault_enter_prepare(m, map->pmap, vaddr, &prot, caller_prot,
+	    PAGE_SIZE, 0, fault_type, fault_info, type_of_fault,
+	    &page_needs_data_sync);
+	if (fault_type != VM_PROT_NONE) {
+		vm_fault_enqueue_page(VM_PAGE_OBJECT(m), m, FALSE, FALSE,
+		    VM_KERN_MEMORY_NONE, fault_info->no_cache, type_of_fault, kr);
+	}
+	if (kr != KERN_SUCCESS) {
+		return kr;
+	}
+	if (page_needs_data_sync) {
+		pmap_sync_page_data_phys(VM_PAGE_GET_PHYS_PAGE(m));
+	}
+
+	if (!vm_map_speculative_pin(map, seq)) {
+		return KERN_ABORTED;
+	}
+	kr = vm_fault_attempt_pmap_enter(map->pmap, vaddr, PAGE_SIZE, 0, m,
+	    &prot, caller_prot, fault_type, FALSE,
+	    fault_info->pmap_options | PMAP_OPTIONS_NOWAIT);
+	vm_map_speculative_unpin(map);
+	return kr;
+}
+
+/*
+ * vm_fault_enter_around
+ *
+ * vm_fault_enter() for a neighbour entered by vm_fault_around() with
+ * the map locked.  The page is entered with a fault_type of VM_PROT_NONE
+ * so the mapping starts out unreferenced ("old"), and it is not moved
+ * on the paging queues: a page that was read ahead stays speculative
+ * until it is actually touched.
+ */
+static kern_return_t
+vm_fault_enter_around(
+	vm_page_t               m,
+	pmap_t                  pmap,
+	vm_map_offset_t         vaddr,
+	vm_prot_t               prot,
+	vm_object_fault_info_t  fault_info,
+	boolean_t               *need_retry,
+	int                     *type_of_fault,
+	uint8_t                 *object_lock_type)
+{
+	vm_object_t     object = VM_PAGE_OBJECT(m);
+	kern_return_t   kr;
+	bool            page_needs_data_sync;
+	int             pmap_options = fault_info->pmap_options;
+
+	kr = vm_fault_enter_prepare(m, pmap, vaddr, &prot, VM_PROT_READ,
+	    PAGE_SIZE, 0, VM_PROT_NONE, fault_info, type_of_fault,
+	    &page_needs_data_sync);
+	if (kr != KERN_SUCCESS) {
+		return kr;
+	}
+	if (page_needs_data_sync) {
+		pmap_sync_page_data_phys(VM_PAGE_GET_PHYS_PAGE(m));
+	}
+	if (fault_info->fi_xnu_user_debug && !object->code_signed) {
+		pmap_options |= PMAP_OPTIONS_XNU_USER_DEBUG;
+	}
+
+	return vm_fault_pmap_enter_with_object_lock(object, pmap, vaddr,
+	           PAGE_SIZE, 0, m, &prot, VM_PROT_READ, VM_PROT_NONE, FALSE,
+	           pmap_options, need_retry, object_lock_type);
+}
+
+/*
+ * vm_fault_around
+ *
+ * Enter the resident neighbours of the page at "offset" in "object",
+ * which was just mapped at "vaddr" for a read fault.  The window is
+ * vm_fault_around_pages long; it is naturally aligned around the
+ * faulting page, or extends ahead of it (or behind it) when
+ * vm_fault_is_sequential() has seen a forward (or backward) run.
+ *
+ * Only pages that could be soft-faulted in under the current object
+ * lock are considered: they must not be busy, in the laundry, unusual,
+ * off the paging queues or in need of code signing validation, and the
+ * address must not be mapped already.  They are entered read-only,
+ * unreferenced and without blocking in the pmap layer, and stay on
+ * their paging queue, so pages nobody touches age out as before; the
+ * first failure ends the scan.
+ *
+ * The map must be locked, or looked up with vm_map_lookup_speculative()
+ * in which case "spec_map" is the map and "spec_seq" the sequence count
+ * the lookup returned, and the object locked (possibly shared).
+ */
+static void
+vm_fault_around(
+	pmap_t                  pmap,
+	vm_map_t                spec_map,
+	unsigned int            spec_seq,
+	vm_object_t             object,
+	vm_object_offset_t      offset,
+	vm_map_offset_t         vaddr,
+	vm_prot_t               prot,
+	vm_object_fault_info_t  fault_info,
+	uint8_t                 *object_lock_type)
+{
+	vm_object_offset_t      window, start, end, cur;
+	vm_map_offset_t         cur_vaddr;
+	vm_page_t               m;
+	kern_return_t           kr;
+	boolean_t               need_retry = FALSE;
+	int                     type_of_fault;
+	int                     sequential;
+	uint32_t                npages;
+	int64_t                 entered = 0;
+
+	vm_object_lock_assert_held(object);
+
+	npages = MIN(vm_fault_around_pages, VM_FAULT_AROUND_MAX_PAGES);
+	if (npages < 2) {
+		return;
+	}
+	if (pmap_has_prot_policy(pmap, fault_info->pmap_options & PMAP_OPTIONS_TRANSLATED_ALLOW_EXECUTE, prot)) {
+		/*
+		 * The pmap wants to see the full set of protections,
+		 * so we can't hand it a read-only mapping.
+		 */
+		return;
+	}
+	prot &= ~VM_PROT_WRITE;
+
+	offset = vm_object_trunc_page(offset);
+	window = (vm_object_offset_t)npages * PAGE_SIZE_64;
+	sequential = object->sequential;
+	if (sequential > 0) {
+		start = offset + PAGE_SIZE_64;
+		end = offset + window;
+	} else if (sequential < 0) {
+		start = (offset > window) ? offset - window + PAGE_SIZE_64 : 0;
+		end = offset;
+	} else {
+		start = offset - (offset % window);
+		end = start + window;
+	}
+	start = MAX(start, vm_object_round_page(fault_info->lo_offset));
+	end = MIN(end, vm_object_trunc_page(fault_info->hi_offset));
+
+	for (cur = start; cur < end; cur += PAGE_SIZE_64) {
+		if (cur == offset) {
+			continue;
+		}
+		m = vm_page_lookup(object, cur);
+		if (m == VM_PAGE_NULL ||
+		    m->vmp_busy ||
+		    m->vmp_laundry ||
+		    m->vmp_q_state == VM_PAGE_NOT_ON_Q ||
+		    vm_page_is_guard(m) ||
+		    (m->vmp_unusual && (m->vmp_error || m->vmp_restart ||
+		    vm_page_is_private(m) || m->vmp_absent)) ||
+		    m->vmp_cs_tainted != VMP_CS_ALL_FALSE ||
+		    vm_fault_cs_need_validation(pmap, m, object, PAGE_SIZE, 0)) {
+			continue;
+		}
+		cur_vaddr = vaddr + (vm_map_offset_t)(cur - offset);
+		if (pmap_find_phys(pmap, cur_vaddr) != 0) {
+			continue;
+		}
+
+		type_of_fault = DBG_CACHE_HIT_FAULT;
+		if (spec_map != VM_MAP_NULL) {
+			kr = vm_fault_enter_speculative(spec_map, spec_seq, m,
+			    cur_vaddr, prot, VM_PROT_READ, VM_PROT_NONE,
+			    fault_info, &type_of_fault);
+		} else {
+			kr = vm_fault_enter_around(m, pmap, cur_vaddr, prot,
+			    fault_info, &need_retry, &type_of_fault,
+			    object_lock_type);
+		}
+		if (kr != KERN_SUCCESS || need_retry) {
+			break;
+		}
+		entered++;
+	}
+
+	OSIncrementAtomic64((volatile int64_t *)&vm_fault_around_count);
+	if (entered != 0) {
+		OSAddAtomic64(entered, (volatile int64_t *)&vm_fault_around_pages_entered);
+	}
+}
+
+/*
+ * vm_fault_speculative
+ *
+ * Try to resolve a fault on a resident page of the top object
+ * without taking the map lock (see vm_map_lookup_speculative()).
+ *
+ * Only the simplest fast path case is handled: non-executable
+ * mappings, a page that can be entered as is, and for writes,
+ * an anonymous object without a copy object.  Everything else,
+ * including any lock we can't get without blocking, returns false
+ * and the caller retries with the map locked.
+ */
+static bool
+vm_fault_speculative(
+	vm_map_t                map,
+	vm_map_offset_t         vaddr,
+	vm_map_offset_t         trace_real_vaddr,
+	vm_prot_t               caller_prot,
+	vm_object_fault_info_t  fault_info,
+	bool                    rtfault,
+	int                     *type_of_fault)
+{
+	vm_object_t             object;
+	vm_object_offset_t      offset;
+	vm_prot_t               prot;
+	vm_page_t               m;
+	kern_return_t           kr;
+	uint8_t                 object_lock_type;
+	int                     event_code;
+	unsigned int            seq;
+	vm_behavior_t           behavior = fault_info->behavior;
+
+	if (caller_prot & VM_PROT_WRITE) {
+		object_lock_type = OBJECT_LOCK_EXCLUSIVE;
+	} else {
+		object_lock_type = OBJECT_LOCK_SHARED;
+	}
+	if (!vm_map_lookup_speculative(map, vaddr, caller_prot, object_lock_type,
+	    &seq, &object, &offset, &prot, fault_info)) {
+		goto fallback;
+	}
+
+	if (object->blocked_access ||
+	    (!object->pager_created && object->phys_contiguous) ||
+	    VM_OBJECT_PURGEABLE_FAULT_ERROR(object)) {
+		goto unlock;
+	}
+	if (object->vo_copy != VM_OBJECT_NULL) {
+		/* copy-on-write obligations are for the locked path */
+		if (caller_prot & VM_PROT_WRITE) {
+			goto unlock;
+		}
+		prot &= ~VM_PROT_WRITE;
+	} else if ((caller_prot & VM_PROT_WRITE) && !object->internal) {
+		/* vnode_pager_dirtied() is for the locked path */
+		goto unlock;
+	}
+
+	m = vm_page_lookup(object, vm_object_trunc_page(offset));
+	if (m == VM_PAGE_NULL ||
+	    m->vmp_busy ||
+	    m->vmp_laundry ||
+	    vm_page_is_guard(m) ||
+	    (m->vmp_unusual && (m->vmp_error || m->vmp_restart ||
+	    vm_page_is_private(m) || m->vmp_absent)) ||
+	    vm_fault_cs_need_validation(map->pmap, m, object, PAGE_SIZE, 0)) {
+		goto unlock;
+	}
+#if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
+	if (m->vmp_unmodified_ro) {
+		/* clearing it needs the object lock exclusive, see vm_fault_enter() */
+		if (caller_prot & VM_PROT_WRITE) {
+			goto unlock;
+		}
+		prot &= ~VM_PROT_WRITE;
+	}
+#endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
+
+	if (__improbable(rtfault &&
+	    !m->vmp_realtime &&
+	    vm_pageout_protect_realtime)) {
+		vm_page_lock_queues();
+		if (!m->vmp_realtime) {
+			m->vmp_realtime = true;
+			vm_page_realtime_count++;
+		}
+		vm_page_unlock_queues();
+	}
+
+	*type_of_fault = DBG_CACHE_HIT_FAULT;
+	kr = vm_fault_enter_speculative(map, seq, m, vaddr, prot, caller_prot,
+	    caller_prot, fault_info, type_of_fault);
+	if (kr != KERN_SUCCESS) {
+		/* a writer came by, or the pmap layer would have blocked */
+		goto unlock;
+	}
+
+	if (!(caller_prot & VM_PROT_WRITE) &&
+	    !map->no_fault_around &&
+	    !fault_info->no_cache &&
+	    fault_info->behavior != VM_BEHAVIOR_RANDOM) {
+		vm_fault_around(map->pmap, map, seq, object, offset, vaddr,
+		    prot, fault_info, &object_lock_type);
+	}
+
+	if (object->internal) {
+		event_code = (MACHDBG_CODE(DBG_MACH_WORKINGSET, VM_REAL_FAULT_ADDR_INTERNAL));
+	} else if (object->object_is_shared_cache) {
+		event_code = (MACHDBG_CODE(DBG_MACH_WORKINGSET, VM_REAL_FAULT_ADDR_SHAREDCACHE));
+	} else {
+		event_code = (MACHDBG_CODE(DBG_MACH_WORKINGSET, VM_REAL_FAULT_ADDR_EXTERNAL));
+	}
+	KDBG_RELEASE(event_code | DBG_FUNC_NONE, trace_real_vaddr, (fault_info->user_tag << 16) | (caller_prot << 8) | *type_of_fault, m->vmp_offset, get_current_unique_pid());
+	KDBG_FILTERED(MACHDBG_CODE(DBG_MACH_WORKINGSET, VM_REAL_FAULT_FAST), get_current_unique_pid());
+	DTRACE_VM6(real_fault, vm_map_offset_t, trace_real_vaddr, vm_map_offset_t, m->vmp_offset, int, event_code, int, caller_prot, int, *type_of_fault, int, fault_info->user_tag);
+
+	if (*type_of_fault == DBG_CACHE_HIT_FAULT) {
+		vm_fault_is_sequential(object, offset, fault_info->behavior);
+		vm_fault_deactivate_behind(object, offset, fault_info->behavior);
+	}
+
+	vm_object_unlock(object);
+	counter_inc(&vm_fault_speculative_hits);
+	return true;
+
+unlock:
+	vm_object_unlock(object);
+fallback:
+	/* the locked path only inherits the entry's behavior by default */
+	fault_info->behavior = behavior;
+	counter_inc(&vm_fault_speculative_fallbacks);
+	return false;
+}
+
 kern_return_t
 vm_pre_fault_with_info(
 	vm_map_t                map,
@@ -4465,6 +4829,22 @@ vm_fault_internal(
 			}
 		}
 	}
+
+	if (vm_map_speculative_faults &&
+	    map->pmap != kernel_pmap &&
+	    fault_page_size == PAGE_SIZE &&
+	    !fault_info->fi_change_wiring &&
+	    caller_pmap == PMAP_NULL &&
+	    physpage_p == NULL &&
+	    (caller_prot & ~(VM_PROT_READ | VM_PROT_WRITE)) == 0 &&
+	    caller_prot != VM_PROT_NONE) {
+		if (vm_fault_speculative(map, vaddr, trace_real_vaddr,
+		    caller_prot, fault_info, rtfault, &type_of_fault)) {
+			need_copy_on_read = false;
+			kr = KERN_SUCCESS;
+			goto done;
+		}
+	}
 RetryFault:
 	assert(written_on_object == VM_OBJECT_NULL);
 
@@ -5128,6 +5508,26 @@ FastPmapEnter:
 					    &object_lock_type);
 				}
 
+				if (kr == KERN_SUCCESS &&
+				    need_retry == FALSE &&
+				    !(fault_type & VM_PROT_WRITE) &&
+				    !wired &&
+				    top_object == VM_OBJECT_NULL &&
+				    m_object == object &&
+				    real_map == map &&
+				    !original_map->no_fault_around &&
+				    caller_pmap == PMAP_NULL &&
+				    physpage_p == NULL &&
+				    pmap != kernel_pmap &&
+				    fault_page_size == PAGE_SIZE &&
+				    !resilient_media_retry &&
+				    !fault_info->no_cache &&
+				    fault_info->behavior != VM_BEHAVIOR_RANDOM) {
+					vm_fault_around(pmap, VM_MAP_NULL, 0, object,
+					    offset, vaddr, prot, fault_info,
+					    &object_lock_type);
+				}
+
 				vm_fault_complete(
 					map,
 					real_map,
@@ -79,6 +79,7 @@
 #include <mach/memory_object.h>
 #include <mach/mach_vm_server.h>
 #include <machine/cpu_capabilities.h>
+#include <machine/machine_cpu.h>
 #include <mach/sdt.h>
 
 #include <kern/assert.h>
@@ -104,6 +105,7 @@
 #include <vm/vm_kern_internal.h>
 #include <ipc/ipc_port.h>
 #include <kern/sched_prim.h>
+#include <kern/smr.h>
 #include <kern/misc_protos.h>
 
 #include <mach/vm_map_server.h>
@@ -721,6 +723,76 @@ vm_map_entry_copy(
 	new->vme_no_copy_on_read = FALSE;
 }
 
+/*
+ * Speculative faults.
+ *
+ * vm_fault_internal() first tries to resolve a fault without the map lock:
+ * the entry is looked up under SMR (map entries are freed with zfree_smr()),
+ * and the lookup is validated against "spec_seq", which is odd for as long
+ * as a thread holds the map lock exclusively.
+ *
+ * VM objects aren't SMR protected: a validated lookup briefly pins the map
+ * by bumping "spec_faults", which keeps the entry's reference on its object
+ * until the object is locked, and the object can't be terminated while
+ * locked.  The pin is only held with preemption disabled and around
+ * non-blocking work, so writers spin for it to drop in
+ * vm_map_seq_write_begin() rather than block behind a faulting thread.
+ *
+ * Translations are only made with the map pinned again for the same
+ * sequence count (see vm_map_speculative_pin()): a writer either bumped
+ * the count first, and the fault backs off before anything is visible,
+ * or waits for the pin to drop, and its pmap_protect() or pmap_remove()
+ * then sees the new translation.
+ */
+TUNABLE(bool, vm_map_speculative_faults, "vm_speculative_faults", true);
+SMR_DEFINE(smr_vm_map, "VM map");
+
+/*
+ * Index the entries of user maps with the B-tree store rather than the
+ * red-black tree (see vm_map_store_bt.c).  Maps can also opt in with
+ * VM_MAP_CREATE_BTREE_STORE, and forked maps keep their parent's store.
+ */
+static TUNABLE(bool, vm_map_btree_store, "vm_map_btree_store", false);
+
+void
+vm_map_seq_write_begin(vm_map_t map)
+{
+	os_atomic_inc(&map->spec_seq, relaxed);
+	/* pairs with the fence in vm_map_speculative_pin() */
+	os_atomic_thread_fence(seq_cst);
+	while (os_atomic_load(&map->spec_faults, relaxed) != 0) {
+		/* pinned for non-blocking work with preemption disabled */
+		cpu_pause();
+	}
+	os_atomic_thread_fence(acquire);
+}
+
+/*
+ * Variant of vm_map_seq_write_begin() for the try-lock paths,
+ * which must not block: fails if speculative faults are in flight.
+ */
+static bool
+vm_map_seq_try_write_begin(vm_map_t map)
+{
+	os_atomic_inc(&map->spec_seq, relaxed);
+	os_atomic_thread_fence(seq_cst);
+	if (os_atomic_load(&map->spec_faults, relaxed) != 0) {
+		os_atomic_inc(&map->spec_seq, relaxed);
+		return false;
+	}
+	os_atomic_thread_fence(acquire);
+	return true;
+}
+
+void
+vm_map_seq_write_end(vm_map_t map)
+{
+	/* vm_map_unlock() also drops shared locks, which leave the count even */
+	if (os_atomic_load(&map->spec_seq, relaxed) & 1) {
+		os_atomic_inc(&map->spec_seq, release);
+	}
+}
+
 /*
  * Normal lock_read_to_write() returns FALSE/0 on failure.
  * These functions evaluate to zero on success and non-zero value on failure.
@@ -731,6 +803,7 @@ vm_map_lock_read_to_write(vm_map_t map)
 {
 	if (lck_rw_lock_shared_to_exclusive(&(map)->lock)) {
 		DTRACE_VM(vm_map_lock_upgrade);
+		vm_map_seq_write_begin(map);
 		return 0;
 	}
 	return 1;
@@ -741,6 +814,10 @@ boolean_t
 vm_map_try_lock(vm_map_t map)
 {
 	if (lck_rw_try_lock_exclusive(&(map)->lock)) {
+		if (!vm_map_seq_try_write_begin(map)) {
+			lck_rw_done(&(map)->lock);
+			return FALSE;
+		}
 		DTRACE_VM(vm_map_lock_w);
 		return TRUE;
 	}
@@ -1323,9 +1400,13 @@ vm_map_init(void)
 	/*
 	 * Don't quarantine because we always need elements available
 	 * Disallow GC on this zone... to aid the GC.
+	 *
+	 * Speculative faults read entries under SMR: the zone must be
+	 * made SMR before the early entries are crammed into it,
+	 * the domain is bound in vm_kernel_boostraped().
 	 */
-	zone_create_ext(VM_MAP_ENTRY_ZONE_NAME,
-	    sizeof(struct vm_map_entry), VM_MAP_ENTRY_ZFLAGS,
+	zone_create_ext(VM_MAP_ENTRY_ZONE_NAME, sizeof(struct vm_map_entry),
+	    VM_MAP_ENTRY_ZFLAGS | (vm_map_speculative_faults ? ZC_SMR : ZC_NONE),
 	    ZONE_ID_VM_MAP_ENTRY, ^(zone_t z) {
 		z->z_elems_rsv = (uint16_t)(32 *
 		(ml_early_cpu_max_number() + 1));
@@ -1471,7 +1552,13 @@ __startup_func
 static void
 vm_kernel_boostraped(void)
 {
-	zone_enable_caching(&zone_array[ZONE_ID_VM_MAP_ENTRY]);
+	if (vm_map_speculative_faults) {
+		/* see vm_map_lookup_speculative() */
+		zone_enable_smr(&zone_array[ZONE_ID_VM_MAP_ENTRY], &smr_vm_map, bzero);
+	} else {
+		zone_enable_caching(&zone_array[ZONE_ID_VM_MAP_ENTRY]);
+	}
+	vm_map_bt_startup(vm_map_speculative_faults);
 	zone_enable_caching(&zone_array[ZONE_ID_VM_MAP_HOLES]);
 	zone_enable_caching(&zone_array[ZONE_ID_VM_MAP_COPY]);
 
@@ -1675,6 +1762,11 @@ vm_map_create_options(
 	result = zalloc_id(ZONE_ID_VM_MAP, Z_WAITOK | Z_NOFAIL | Z_ZERO);
 
 	vm_map_store_init(&result->hdr);
+	if ((options & VM_MAP_CREATE_BTREE_STORE) ||
+	    (vm_map_btree_store && (options & VM_MAP_CREATE_PAGEABLE) &&
+	    pmap != NULL && pmap != kernel_pmap)) {
+		vm_map_store_init_bt(&result->hdr);
+	}
 	result->hdr.entries_pageable = (bool)(options & VM_MAP_CREATE_PAGEABLE);
 	vm_map_set_page_shift(result, PAGE_SHIFT);
 
@@ -1866,7 +1958,11 @@ vm_map_entry_dispose(
 #if MAP_ENTRY_INSERTION_DEBUG
 	btref_put(entry->vme_insertion_bt);
 #endif
-	zfree(vm_map_entry_zone, entry);
+	if (vm_map_speculative_faults) {
+		zfree_smr(vm_map_entry_zone, entry);
+	} else {
+		zfree(vm_map_entry_zone, entry);
+	}
 }
 
 #define vm_map_copy_entry_dispose(copy_entry) \
@@ -3379,6 +3475,7 @@ vm_map_enter(
 				DTRACE_VM5(map_entry_extend, vm_map_t, map, vm_map_entry_t, entry, vm_address_t, entry->vme_start, vm_address_t, entry->vme_end, vm_address_t, end);
 			}
 			entry->vme_end = end;
+			vm_map_store_entry_resized(map, entry);
 			if (map->holelistenabled) {
 				vm_map_store_update_first_free(map, entry, TRUE);
 			} else {
@@ -8923,6 +9020,7 @@ in_transition:
 		if ((flags & VM_MAP_REMOVE_NO_YIELD) == 0 && s < end) {
 			unsigned int last_timestamp = map->timestamp++;
 
+			vm_map_seq_write_end(map);
 			if (lck_rw_lock_yield_exclusive(&map->lock,
 			    LCK_RW_YIELD_ANY_WAITER)) {
 				if (last_timestamp != map->timestamp + 1) {
@@ -8932,6 +9030,7 @@ in_transition:
 				/* we didn't yield, undo our change */
 				map->timestamp--;
 			}
+			vm_map_seq_write_begin(map);
 		}
 	}
 
@@ -13458,6 +13557,7 @@ vm_map_inherit_limits(vm_map_t new_map, const struct _vm_map *old_map)
 	new_map->data_limit = old_map->data_limit;
 	new_map->user_wire_limit = old_map->user_wire_limit;
 	new_map->reserved_regions = old_map->reserved_regions;
+	new_map->no_fault_around = old_map->no_fault_around;
 }
 
 /*
@@ -13531,6 +13631,9 @@ vm_map_fork(
 	if (old_map->hdr.entries_pageable) {
 		map_create_options |= VM_MAP_CREATE_PAGEABLE;
 	}
+	if (vm_map_store_has_BT_support(&old_map->hdr)) {
+		map_create_options |= VM_MAP_CREATE_BTREE_STORE;
+	}
 	if (options & VM_MAP_FORK_CORPSE_FOOTPRINT) {
 		map_create_options |= VM_MAP_CREATE_CORPSE_FOOTPRINT;
 		footprint_collect_kr = KERN_SUCCESS;
@@ -14929,6 +15032,184 @@ protection_failure:
 	return KERN_SUCCESS;
 }
 
+/*
+ *	vm_map_speculative_pin:
+ *
+ *	Pins the map on behalf of the vm_map_lookup_speculative() that
+ *	returned "seq", unless a writer took the map lock since.  Writers
+ *	wait for the pin to drop before changing anything, so translations
+ *	entered while pinned are seen by whatever pmap operation comes next.
+ *
+ *	Preemption is disabled until vm_map_speculative_unpin(): only
+ *	non-blocking work can be done while pinned.
+ */
+bool
+vm_map_speculative_pin(
+	vm_map_t                map,
+	unsigned int            seq)
+{
+	mp_disable_preemption();
+	os_atomic_inc(&map->spec_faults, relaxed);
+	/* pairs with the fence in vm_map_seq_write_begin() */
+	os_atomic_thread_fence(seq_cst);
+	if (os_atomic_load(&map->spec_seq, relaxed) != seq) {
+		vm_map_speculative_unpin(map);
+		return false;
+	}
+	return true;
+}
+
+void
+vm_map_speculative_unpin(
+	vm_map_t                map)
+{
+	os_atomic_dec(&map->spec_faults, release);
+	mp_enable_preemption();
+}
+
+/*
+ *	vm_map_lookup_speculative:
+ *
+ *	Lockless version of vm_map_lookup_and_lock_object() for the common
+ *	case of a fault on a plain, already populated mapping.
+ *
+ *	On success, the object is returned locked (shared or exclusive as
+ *	per "object_lock_type"), along with the sequence count the lookup
+ *	was validated against.  The map itself isn't held: the caller must
+ *	enter translations under vm_map_speculative_pin(), and give up on
+ *	the fault if that fails.
+ *
+ *	Returns false whenever the locked path must be used instead.
+ */
+bool
+vm_map_lookup_speculative(
+	vm_map_t                map,
+	vm_map_offset_t         vaddr,
+	vm_prot_t               fault_type,
+	uint8_t                 object_lock_type,
+	unsigned int            *seqp,          /* OUT */
+	vm_object_t             *object,        /* OUT */
+	vm_object_offset_t      *offset,        /* OUT */
+	vm_prot_t               *out_prot,      /* OUT */
+	vm_object_fault_info_t  fault_info)     /* OUT */
+{
+	vm_map_entry_t          entry;
+	vm_object_t             entry_object;
+	unsigned int            seq;
+	vm_prot_t               prot;
+	bool                    locked;
+
+	smr_vm_map_enter();
+
+	seq = os_atomic_load(&map->spec_seq, acquire);
+	if (seq & 1) {
+		goto fail;
+	}
+
+	entry = vm_map_store_lookup_entry_speculative(map, vaddr);
+	if (entry == VM_MAP_ENTRY_NULL) {
+		goto fail;
+	}
+
+	/*
+	 * Until the sequence count is validated below, the entry can be
+	 * torn: only look at its fields, don't follow its pointers.
+	 * Whatever is read from it is only used once validated.
+	 */
+	if (entry->is_sub_map ||
+	    entry->in_transition ||
+	    entry->wired_count ||
+	    entry->user_wired_count ||
+	    entry->superpage_size ||
+	    entry->used_for_jit ||
+#if __arm64e__
+	    entry->used_for_tpro ||
+#endif /* __arm64e__ */
+	    entry->csm_associated ||
+	    entry->iokit_acct ||
+	    entry->vme_resilient_codesign ||
+	    entry->vme_resilient_media ||
+	    entry->vme_xnu_user_debug ||
+	    entry->translated_allow_execute ||
+	    entry->vme_kernel_object) {
+		goto fail;
+	}
+
+	/*
+	 * Executable mappings are subject to code signing and
+	 * NX policies that only the locked path implements.
+	 */
+	prot = entry->protection;
+	if ((prot & VM_PROT_EXECUTE) || (fault_type & prot) != fault_type) {
+		goto fail;
+	}
+	if (entry->needs_copy) {
+		if (fault_type & VM_PROT_WRITE) {
+			goto fail;
+		}
+		prot &= ~VM_PROT_WRITE;
+	}
+	entry_object = VME_OBJECT(entry);
+	if (entry_object == VM_OBJECT_NULL) {
+		goto fail;
+	}
+
+	*offset = (vaddr - entry->vme_start) + VME_OFFSET(entry);
+	*out_prot = prot;
+
+	fault_info->user_tag = VME_ALIAS(entry);
+	fault_info->pmap_options = entry->use_pmap ? 0 : PMAP_OPTIONS_ALT_ACCT;
+	if (fault_info->behavior == VM_BEHAVIOR_DEFAULT) {
+		fault_info->behavior = entry->behavior;
+	}
+	fault_info->lo_offset = VME_OFFSET(entry);
+	fault_info->hi_offset =
+	    (entry->vme_end - entry->vme_start) + VME_OFFSET(entry);
+	fault_info->no_cache  = entry->no_cache;
+	fault_info->io_sync = FALSE;
+	fault_info->cs_bypass = FALSE;
+	fault_info->mark_zf_absent = FALSE;
+	fault_info->batch_pmap_op = FALSE;
+	fault_info->csm_associated = FALSE;
+	fault_info->resilient_media = FALSE;
+	fault_info->fi_xnu_user_debug = FALSE;
+	fault_info->no_copy_on_read = entry->vme_no_copy_on_read;
+	fault_info->fi_used_for_tpro = FALSE;
+
+	/*
+	 * Pin the map, which checks that no writer came and went since
+	 * we sampled the sequence count: the entry we found is then
+	 * valid, and holds its object reference until we unpin.
+	 */
+	if (!vm_map_speculative_pin(map, seq)) {
+		goto fail;
+	}
+
+	/*
+	 * Lock the object before unpinning: it can't be terminated
+	 * while locked.
+	 */
+	if (object_lock_type == OBJECT_LOCK_EXCLUSIVE) {
+		locked = vm_object_lock_try(entry_object);
+	} else {
+		locked = vm_object_lock_try_shared(entry_object);
+	}
+	vm_map_speculative_unpin(map);
+	if (!locked) {
+		goto fail;
+	}
+
+	smr_vm_map_leave();
+
+	*seqp = seq;
+	*object = entry_object;
+	return true;
+
+fail:
+	smr_vm_map_leave();
+	return false;
+}
+
 
 /*
  *	vm_map_verify:
@@ -16238,6 +16519,7 @@ vm_map_simplify_entry(
 			    VM_MAP_PAGE_MASK(map)));
 		}
 		this_entry->vme_start = prev_entry->vme_start;
+		vm_map_store_entry_resized(map, this_entry);
 		VME_OFFSET_SET(this_entry, VME_OFFSET(prev_entry));
 
 		if (map->holelistenabled) {
@@ -23116,6 +23398,21 @@ vm_map_unset_corpse_source(vm_map_t map)
 		vm_map_unlock(map);
 	}
 }
+
+void
+vm_map_set_fault_around(vm_map_t map, bool enable)
+{
+	vm_map_lock(map);
+	map->no_fault_around = !enable;
+	vm_map_unlock(map);
+}
+
+bool
+vm_map_get_fault_around(vm_map_t map)
+{
+	return !map->no_fault_around;
+}
+
 /*
  * FORKED CORPSE FOOTPRINT
  *
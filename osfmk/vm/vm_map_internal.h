@@ -522,6 +522,27 @@ extern kern_return_t    vm_map_lookup_and_lock_object(
 	vm_map_t                *real_map,                              /* OUT */
 	bool                    *contended);                            /* OUT */
 
+/* Lockless lookup for the common case of vm_map_lookup_and_lock_object(). */
+extern bool             vm_map_lookup_speculative(
+	vm_map_t                map,
+	vm_map_address_t        vaddr,
+	vm_prot_t               fault_type,
+	uint8_t                 object_lock_type,
+	unsigned int            *seq,                                   /* OUT */
+	vm_object_t             *object,                                /* OUT */
+	vm_object_offset_t      *offset,                                /* OUT */
+	vm_prot_t               *out_prot,                              /* OUT */
+	vm_object_fault_info_t  fault_info);                            /* OUT */
+
+/* Keeps writers out of the map, if it didn't change since the lookup. */
+extern bool             vm_map_speculative_pin(
+	vm_map_t                map,
+	unsigned int            seq);
+extern void             vm_map_speculative_unpin(
+	vm_map_t                map);
+
+extern bool             vm_map_speculative_faults;
+
 /* Verifies that the map has not changed since the given version. */
 extern boolean_t        vm_map_verify(
 	vm_map_t                map,
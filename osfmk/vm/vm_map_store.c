@@ -49,10 +49,28 @@ vm_map_store_has_RB_support( struct vm_map_header *hdr )
 	return TRUE;
 }
 
+/*
+ * Maps indexed by either tree maintain their hole list with
+ * update_first_free_rb(), which doesn't depend on the tree.
+ */
+static inline bool
+vm_map_store_has_tree( struct vm_map_header *hdr )
+{
+#ifdef VM_MAP_STORE_USE_BT
+	if (vm_map_store_has_BT_support( hdr )) {
+		return TRUE;
+	}
+#endif
+	return vm_map_store_has_RB_support( hdr );
+}
+
 void
 vm_map_store_init( struct vm_map_header *hdr )
 {
 	vm_map_store_init_ll( hdr );
+#ifdef VM_MAP_STORE_USE_BT
+	hdr->store_bt = FALSE;
+#endif
 #ifdef VM_MAP_STORE_USE_RB
 	if (vm_map_store_has_RB_support( hdr )) {
 		vm_map_store_init_rb( hdr );
@@ -60,12 +78,37 @@ vm_map_store_init( struct vm_map_header *hdr )
 #endif
 }
 
+#ifdef VM_MAP_STORE_USE_BT
+/*
+ * Switches an empty map from the red-black tree
+ * to the B-tree store (see vm_map_store_bt.c).
+ */
+void
+vm_map_store_init_bt( struct vm_map_header *hdr )
+{
+	assert(hdr->nentries == 0);
+	hdr->rb_head_store.rbh_root = (void *)(int)SKIP_RB_TREE;
+	hdr->store_bt = TRUE;
+	vm_map_bt_init(&hdr->bt_store, &hdr->links);
+}
+#endif
+
 static inline bool
 _vm_map_store_lookup_entry(
 	vm_map_t                map,
 	vm_map_offset_t         address,
 	vm_map_entry_t          *entry)         /* OUT */
 {
+#ifdef VM_MAP_STORE_USE_BT
+	if (vm_map_store_has_BT_support( &map->hdr )) {
+		struct vm_map_links *links;
+		bool found;
+
+		found = vm_map_bt_lookup(&map->hdr.bt_store, address, &links);
+		*entry = links ? CAST_TO_VM_MAP_ENTRY(links) : vm_map_to_entry(map);
+		return found;
+	}
+#endif
 #ifdef VM_MAP_STORE_USE_RB
 	if (vm_map_store_has_RB_support( &map->hdr )) {
 		return vm_map_store_lookup_entry_rb( map, address, entry );
@@ -86,6 +129,23 @@ vm_map_store_lookup_entry(
 	return _vm_map_store_lookup_entry(map, address, entry);
 }
 
+/*
+ * Lookup without the map lock, see vm_map_lookup_speculative().
+ */
+vm_map_entry_t
+vm_map_store_lookup_entry_speculative(
+	vm_map_t                map,
+	vm_map_offset_t         address)
+{
+#ifdef VM_MAP_STORE_USE_BT
+	if (vm_map_store_has_BT_support( &map->hdr )) {
+		return CAST_TO_VM_MAP_ENTRY(vm_map_bt_lookup_speculative(
+			   &map->hdr.bt_store, address));
+	}
+#endif
+	return vm_map_store_lookup_entry_rb_speculative(map, address);
+}
+
 /*
  *	vm_map_entry_{un,}link:
  *
@@ -119,6 +179,11 @@ _vm_map_store_entry_link(
 	}
 
 	vm_map_store_entry_link_ll(mapHdr, after_where, entry);
+#ifdef VM_MAP_STORE_USE_BT
+	if (vm_map_store_has_BT_support( mapHdr )) {
+		vm_map_bt_insert(&mapHdr->bt_store, &entry->links);
+	}
+#endif
 #ifdef VM_MAP_STORE_USE_RB
 	if (vm_map_store_has_RB_support( mapHdr )) {
 		vm_map_store_entry_link_rb(mapHdr, entry);
@@ -180,7 +245,7 @@ vm_map_store_entry_link(
 	} else {
 		update_first_free_ll(map, map->first_free);
 #ifdef VM_MAP_STORE_USE_RB
-		if (vm_map_store_has_RB_support(&map->hdr)) {
+		if (vm_map_store_has_tree(&map->hdr)) {
 			update_first_free_rb(map, entry, TRUE);
 		}
 #endif
@@ -220,6 +285,11 @@ _vm_map_store_entry_unlink(
 	}
 
 	vm_map_store_entry_unlink_ll(mapHdr, entry);
+#ifdef VM_MAP_STORE_USE_BT
+	if (vm_map_store_has_BT_support( mapHdr )) {
+		vm_map_bt_remove(&mapHdr->bt_store, &entry->links);
+	}
+#endif
 #ifdef VM_MAP_STORE_USE_RB
 	if (vm_map_store_has_RB_support( mapHdr )) {
 		vm_map_store_entry_unlink_rb(mapHdr, entry);
@@ -253,7 +323,7 @@ vm_map_store_entry_unlink(
 
 	update_first_free_ll(VMEU_map, VMEU_first_free);
 #ifdef VM_MAP_STORE_USE_RB
-	if (vm_map_store_has_RB_support( &VMEU_map->hdr )) {
+	if (vm_map_store_has_tree( &VMEU_map->hdr )) {
 		update_first_free_rb(VMEU_map, entry, FALSE);
 	}
 #endif
@@ -264,6 +334,9 @@ vm_map_store_copy_reset( vm_map_copy_t copy, vm_map_entry_t entry)
 {
 	int nentries = copy->cpy_hdr.nentries;
 	vm_map_store_copy_reset_ll(copy, entry, nentries);
+#ifdef VM_MAP_STORE_USE_BT
+	assert(!vm_map_store_has_BT_support( &copy->c_u.hdr ));
+#endif
 #ifdef VM_MAP_STORE_USE_RB
 	if (vm_map_store_has_RB_support( &copy->c_u.hdr )) {
 		vm_map_store_copy_reset_rb(copy, entry, nentries);
@@ -279,12 +352,34 @@ vm_map_store_update_first_free(
 {
 	update_first_free_ll(map, first_free_entry);
 #ifdef VM_MAP_STORE_USE_RB
-	if (vm_map_store_has_RB_support( &map->hdr )) {
+	if (vm_map_store_has_tree( &map->hdr )) {
 		update_first_free_rb(map, first_free_entry, new_entry_creation);
 	}
 #endif
 }
 
+/*
+ *	vm_map_store_entry_resized:
+ *
+ *	An entry linked in "map" had its start or end moved in place,
+ *	without overlapping its neighbours (coalescing, simplification).
+ *	Called before anything looks the map up again.
+ */
+void
+vm_map_store_entry_resized(
+	vm_map_t                map,
+	vm_map_entry_t          entry)
+{
+#ifdef VM_MAP_STORE_USE_BT
+	if (vm_map_store_has_BT_support( &map->hdr )) {
+		vm_map_bt_update(&map->hdr.bt_store, &entry->links);
+	}
+#else
+	(void)map;
+	(void)entry;
+#endif
+}
+
 __abortlike
 static void
 __vm_map_store_find_space_holelist_corruption(
@@ -560,6 +655,138 @@ vm_map_store_find_space_forward(
 	return entry;
 }
 
+#ifdef VM_MAP_STORE_USE_BT
+/*
+ * Same placement as vm_map_store_find_space_{forward,backwards}(),
+ * but holes too small for "size" are skipped using the gap annotations
+ * of the B-tree rather than by walking the hole or entry list.
+ */
+static struct vm_map_entry *
+vm_map_store_find_space_bt_backwards(
+	vm_map_t                map,
+	vm_map_offset_t         end,
+	vm_map_offset_t         lowest_addr,
+	vm_map_offset_t         guard_offset,
+	vm_map_size_t           size,
+	vm_map_offset_t         mask,
+	vm_map_offset_t        *addr_out)
+{
+	const vm_map_offset_t map_mask = VM_MAP_PAGE_MASK(map);
+	struct vm_map_links  *prev;
+	vm_map_offset_t       start;
+	vm_map_entry_t        entry;
+
+	if (map->max_offset <= end) {
+		entry = vm_map_to_entry(map);
+		end = map->max_offset;
+	} else if (_vm_map_store_lookup_entry(map, end - 1, &entry)) {
+		end = entry->vme_start;
+	} else {
+		entry = entry->vme_next;
+	}
+
+	for (;;) {
+		/*
+		 * The "entry" follows the proposed new region.
+		 */
+
+		end    = vm_map_trunc_page(end, map_mask);
+		start  = (end - size) & ~mask;
+		start  = vm_map_trunc_page(start, map_mask);
+		end    = start + size;
+		start -= guard_offset;
+
+		if (end < start || start < lowest_addr) {
+			return VM_MAP_ENTRY_NULL;
+		}
+
+		entry = entry->vme_prev;
+		if (entry == vm_map_to_entry(map) || entry->vme_end <= start) {
+			break;
+		}
+
+		prev = vm_map_bt_prev_gap(&map->hdr.bt_store,
+		    entry->vme_start, size);
+		if (prev == NULL) {
+			return VM_MAP_ENTRY_NULL;
+		}
+		entry = CAST_TO_VM_MAP_ENTRY(prev);
+		end = entry->vme_start;
+	}
+
+	*addr_out = start;
+	return entry;
+}
+
+static struct vm_map_entry *
+vm_map_store_find_space_bt_forward(
+	vm_map_t                map,
+	vm_map_offset_t         start,
+	vm_map_offset_t         highest_addr,
+	vm_map_offset_t         guard_offset,
+	vm_map_size_t           size,
+	vm_map_offset_t         mask,
+	vm_map_offset_t        *addr_out)
+{
+	const vm_map_offset_t map_mask = VM_MAP_PAGE_MASK(map);
+	struct vm_map_links  *next;
+	vm_map_entry_t        entry;
+
+	if (__improbable(map->disable_vmentry_reuse)) {
+		assert(!map->is_nested_map);
+
+		start = map->highest_entry_end + PAGE_SIZE_64;
+		while (vm_map_lookup_entry(map, start, &entry)) {
+			start = entry->vme_end + PAGE_SIZE_64;
+		}
+	} else {
+		if (start < map->min_offset) {
+			start = map->min_offset;
+		}
+		if (_vm_map_store_lookup_entry(map, start, &entry)) {
+			start = entry->vme_end;
+		}
+	}
+
+	for (;;) {
+		vm_map_offset_t orig_start = start;
+		vm_map_offset_t end, desired_empty_end;
+
+		/*
+		 * The "entry" precedes the proposed new region.
+		 */
+
+		start  = (start + guard_offset + mask) & ~mask;
+		start  = vm_map_round_page(start, map_mask);
+		end    = start + size;
+		start -= guard_offset;
+		desired_empty_end = vm_map_round_page(end, map_mask);
+
+		if (start < orig_start || desired_empty_end < start ||
+		    highest_addr < desired_empty_end) {
+			return VM_MAP_ENTRY_NULL;
+		}
+
+		if (entry->vme_next == vm_map_to_entry(map) ||
+		    desired_empty_end <= entry->vme_next->vme_start) {
+			break;
+		}
+
+		next = vm_map_bt_next_gap(&map->hdr.bt_store,
+		    entry->vme_next->vme_start, size);
+		if (next == NULL) {
+			entry = vm_map_last_entry(map);
+		} else {
+			entry = CAST_TO_VM_MAP_ENTRY(next)->vme_prev;
+		}
+		start = entry->vme_end;
+	}
+
+	*addr_out = start;
+	return entry;
+}
+#endif /* VM_MAP_STORE_USE_BT */
+
 struct vm_map_entry *
 vm_map_store_find_space(
 	vm_map_t                map,
@@ -573,6 +800,17 @@ vm_map_store_find_space(
 {
 	vm_map_entry_t entry;
 
+#ifdef VM_MAP_STORE_USE_BT
+	if (vm_map_store_has_BT_support(&map->hdr)) {
+		if (backwards) {
+			return vm_map_store_find_space_bt_backwards(map, hint,
+			           limit, guard_offset, size, mask, addr_out);
+		}
+		return vm_map_store_find_space_bt_forward(map, hint, limit,
+		           guard_offset, size, mask, addr_out);
+	}
+#endif
+
 #if defined VM_MAP_STORE_USE_RB
 	__builtin_assume((void*)map->hdr.rb_head_store.rbh_root !=
 	    (void*)(int)SKIP_RB_TREE);
@@ -0,0 +1,674 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#include <kern/smr.h>
+#include <kern/zalloc.h>
+#include <os/atomic_private.h>
+#include <vm/vm_map_xnu.h>
+
+/*
+ * B-tree store for map entries.
+ *
+ * The red-black tree costs a cache miss per level of a lookup (each level
+ * is a different map entry), and finding free space walks the hole list,
+ * which is as long as the map is fragmented.  This store is a B+tree of
+ * up to VM_MAP_BT_FANOUT slots per node:
+ *
+ * - leaves point to entries, sorted by address, and cache their start
+ *   ("pivot"), so that a lookup reads one node per level and a single
+ *   entry,
+ *
+ * - every slot carries a gap annotation: in a leaf, the size of the hole
+ *   between the entry and its predecessor, in an inner node, the largest
+ *   hole under that child, which lets vm_map_bt_{next,prev}_gap() skip
+ *   whole subtrees that have no hole large enough.
+ *
+ * Entries stay on the map's entry list, which is where the predecessor
+ * of an entry (hence its gap) comes from: entries must be put on the list
+ * before they are inserted, and taken off the list before they are
+ * removed.
+ *
+ * Pivots are the entries' start addresses as of their insertion or last
+ * update.  vm_map_clip_start() moves the start of an entry up before it
+ * links the front part, which is inserted before the entry whose (stale)
+ * pivot it shares, and then refreshes it.  Any other in place change of
+ * the bounds of an entry must be followed by vm_map_bt_update().
+ *
+ * Nodes are freed with zfree_smr() when speculative faults are enabled,
+ * and slots are published with release semantics, so that
+ * vm_map_bt_lookup_speculative() can walk the tree under smr_vm_map.
+ */
+
+#define VM_MAP_BT_FANOUT        16
+#define VM_MAP_BT_MIN_FILL      (VM_MAP_BT_FANOUT / 4)
+#define VM_MAP_BT_MAX_HEIGHT    16
+
+struct vm_map_bt_node {
+	vm_map_offset_t         vbn_pivot[VM_MAP_BT_FANOUT];
+	vm_map_size_t           vbn_gap[VM_MAP_BT_FANOUT];
+	void                   *vbn_slot[VM_MAP_BT_FANOUT];
+	struct vm_map_bt_node  *vbn_parent;
+	uint16_t                vbn_count;
+	bool                    vbn_leaf;
+};
+
+static SECURITY_READ_ONLY_LATE(zone_t) vm_map_bt_node_zone;
+static SECURITY_READ_ONLY_LATE(bool) vm_map_bt_node_smr;
+
+__startup_func
+void
+vm_map_bt_startup(bool smr)
+{
+	vm_map_bt_node_zone = zone_create("VM map btree nodes",
+	    sizeof(struct vm_map_bt_node), ZC_NOENCRYPT);
+	if (smr) {
+		zone_enable_smr(vm_map_bt_node_zone, &smr_vm_map, bzero);
+		vm_map_bt_node_smr = true;
+	}
+}
+
+static struct vm_map_bt_node *
+vm_map_bt_node_alloc(struct vm_map_bt *bt, bool leaf)
+{
+	struct vm_map_bt_node *node;
+
+	node = zalloc_flags(vm_map_bt_node_zone, Z_WAITOK | Z_ZERO | Z_NOFAIL);
+	node->vbn_leaf = leaf;
+	bt->vbt_nodes++;
+	return node;
+}
+
+static void
+vm_map_bt_node_free(struct vm_map_bt *bt, struct vm_map_bt_node *node)
+{
+	bt->vbt_nodes--;
+	if (vm_map_bt_node_smr) {
+		zfree_smr(vm_map_bt_node_zone, node);
+	} else {
+		zfree(vm_map_bt_node_zone, node);
+	}
+}
+
+static inline vm_map_size_t
+vm_map_bt_entry_gap(struct vm_map_bt *bt, struct vm_map_links *entry)
+{
+	struct vm_map_links *prev = &entry->prev->links;
+
+	if (prev == bt->vbt_head) {
+		return entry->start;
+	}
+	return entry->start - prev->end;
+}
+
+static inline vm_map_size_t
+vm_map_bt_node_max_gap(const struct vm_map_bt_node *node)
+{
+	vm_map_size_t gap = 0;
+
+	for (int i = 0; i < node->vbn_count; i++) {
+		gap = MAX(gap, node->vbn_gap[i]);
+	}
+	return gap;
+}
+
+/*
+ * Returns the index of the last slot of @node whose pivot is at or
+ * below @address, or -1.
+ */
+static inline int
+vm_map_bt_node_find(const struct vm_map_bt_node *node, vm_map_offset_t address)
+{
+	int i = 0;
+
+	while (i < node->vbn_count && node->vbn_pivot[i] <= address) {
+		i++;
+	}
+	return i - 1;
+}
+
+static int
+vm_map_bt_node_index(
+	const struct vm_map_bt_node *parent,
+	const struct vm_map_bt_node *node)
+{
+	for (int i = 0; i < parent->vbn_count; i++) {
+		if (parent->vbn_slot[i] == node) {
+			return i;
+		}
+	}
+	panic("vm_map_bt: node %p isn't a child of %p", node, parent);
+}
+
+static inline void
+vm_map_bt_node_set(
+	struct vm_map_bt_node  *node,
+	int                     i,
+	vm_map_offset_t         pivot,
+	vm_map_size_t           gap,
+	void                   *slot)
+{
+	node->vbn_pivot[i] = pivot;
+	node->vbn_gap[i] = gap;
+	if (!node->vbn_leaf) {
+		((struct vm_map_bt_node *)slot)->vbn_parent = node;
+	}
+	os_atomic_store(&node->vbn_slot[i], slot, release);
+}
+
+static inline void
+vm_map_bt_node_clear(struct vm_map_bt_node *node, int i)
+{
+	os_atomic_store(&node->vbn_slot[i], NULL, relaxed);
+	node->vbn_pivot[i] = 0;
+	node->vbn_gap[i] = 0;
+}
+
+/*
+ * Reflects the lowest pivot and largest gap of @node in its ancestors.
+ */
+static void
+vm_map_bt_propagate(struct vm_map_bt_node *node)
+{
+	struct vm_map_bt_node *parent;
+	vm_map_size_t gap;
+	int i;
+
+	while ((parent = node->vbn_parent) != NULL) {
+		i = vm_map_bt_node_index(parent, node);
+		gap = vm_map_bt_node_max_gap(node);
+		if (parent->vbn_pivot[i] == node->vbn_pivot[0] &&
+		    parent->vbn_gap[i] == gap) {
+			break;
+		}
+		parent->vbn_pivot[i] = node->vbn_pivot[0];
+		parent->vbn_gap[i] = gap;
+		node = parent;
+	}
+}
+
+static void
+vm_map_bt_node_insert(
+	struct vm_map_bt       *bt,
+	struct vm_map_bt_node  *node,
+	int                     pos,
+	vm_map_offset_t         pivot,
+	vm_map_size_t           gap,
+	void                   *slot);
+
+/*
+ * Moves the upper part of a full node to a new sibling,
+ * growing the tree if @node was the root.
+ *
+ * Maps mostly grow at one end (first fit from the bottom, or top down),
+ * so a node that is full because of an insertion at one of its ends is
+ * split unevenly, leaving its neighbours full rather than half empty.
+ */
+static struct vm_map_bt_node *
+vm_map_bt_split(struct vm_map_bt *bt, struct vm_map_bt_node *node, int pos)
+{
+	struct vm_map_bt_node *sibling, *parent;
+	int half = VM_MAP_BT_FANOUT / 2;
+
+	if (pos == 0) {
+		half = 1;
+	} else if (pos == VM_MAP_BT_FANOUT) {
+		half = VM_MAP_BT_FANOUT - 1;
+	}
+
+	sibling = vm_map_bt_node_alloc(bt, node->vbn_leaf);
+	for (int i = half; i < VM_MAP_BT_FANOUT; i++) {
+		vm_map_bt_node_set(sibling, i - half, node->vbn_pivot[i],
+		    node->vbn_gap[i], node->vbn_slot[i]);
+	}
+	sibling->vbn_count = (uint16_t)(VM_MAP_BT_FANOUT - half);
+
+	parent = node->vbn_parent;
+	if (parent == NULL) {
+		if (bt->vbt_height == VM_MAP_BT_MAX_HEIGHT) {
+			panic("vm_map_bt: tree %p is too deep", bt);
+		}
+		parent = vm_map_bt_node_alloc(bt, false);
+		vm_map_bt_node_set(parent, 0, node->vbn_pivot[0],
+		    vm_map_bt_node_max_gap(node), node);
+		parent->vbn_count = 1;
+		os_atomic_store(&bt->vbt_root, parent, release);
+		bt->vbt_height++;
+	}
+	vm_map_bt_node_insert(bt, parent, vm_map_bt_node_index(parent, node) + 1,
+	    sibling->vbn_pivot[0], vm_map_bt_node_max_gap(sibling), sibling);
+
+	/* the upper part is now reachable through the sibling */
+	os_atomic_store(&node->vbn_count, (uint16_t)half, relaxed);
+	for (int i = half; i < VM_MAP_BT_FANOUT; i++) {
+		vm_map_bt_node_clear(node, i);
+	}
+	vm_map_bt_propagate(node);
+
+	return sibling;
+}
+
+static void
+vm_map_bt_node_insert(
+	struct vm_map_bt       *bt,
+	struct vm_map_bt_node  *node,
+	int                     pos,
+	vm_map_offset_t         pivot,
+	vm_map_size_t           gap,
+	void                   *slot)
+{
+	if (node->vbn_count == VM_MAP_BT_FANOUT) {
+		struct vm_map_bt_node *sibling = vm_map_bt_split(bt, node, pos);
+
+		if (pos > node->vbn_count) {
+			pos -= node->vbn_count;
+			node = sibling;
+		}
+	}
+
+	for (int i = node->vbn_count; i > pos; i--) {
+		vm_map_bt_node_set(node, i, node->vbn_pivot[i - 1],
+		    node->vbn_gap[i - 1], node->vbn_slot[i - 1]);
+	}
+	vm_map_bt_node_set(node, pos, pivot, gap, slot);
+	os_atomic_store(&node->vbn_count, (uint16_t)(node->vbn_count + 1), relaxed);
+	vm_map_bt_propagate(node);
+}
+
+static void
+vm_map_bt_node_remove(
+	struct vm_map_bt       *bt,
+	struct vm_map_bt_node  *node,
+	int                     pos);
+
+/*
+ * Folds a sparse node and one of its siblings together,
+ * so that the tree doesn't degrade after mass unmaps.
+ */
+static void
+vm_map_bt_merge(struct vm_map_bt *bt, struct vm_map_bt_node *node)
+{
+	struct vm_map_bt_node *parent = node->vbn_parent;
+	struct vm_map_bt_node *left, *right;
+	int i, count;
+
+	if (parent->vbn_count < 2) {
+		return;
+	}
+
+	i = vm_map_bt_node_index(parent, node);
+	if (i > 0) {
+		left = parent->vbn_slot[i - 1];
+		right = node;
+	} else {
+		left = node;
+		right = parent->vbn_slot[1];
+		i = 1;
+	}
+	count = left->vbn_count;
+	if (count + right->vbn_count > VM_MAP_BT_FANOUT * 3 / 4) {
+		return;
+	}
+
+	for (int j = 0; j < right->vbn_count; j++) {
+		vm_map_bt_node_set(left, count + j, right->vbn_pivot[j],
+		    right->vbn_gap[j], right->vbn_slot[j]);
+	}
+	os_atomic_store(&left->vbn_count, (uint16_t)(count + right->vbn_count), relaxed);
+	vm_map_bt_propagate(left);
+
+	vm_map_bt_node_remove(bt, parent, i);
+	vm_map_bt_node_free(bt, right);
+}
+
+static void
+vm_map_bt_node_remove(
+	struct vm_map_bt       *bt,
+	struct vm_map_bt_node  *node,
+	int                     pos)
+{
+	struct vm_map_bt_node *parent = node->vbn_parent;
+	int count = node->vbn_count - 1;
+
+	for (int i = pos; i < count; i++) {
+		vm_map_bt_node_set(node, i, node->vbn_pivot[i + 1],
+		    node->vbn_gap[i + 1], node->vbn_slot[i + 1]);
+	}
+	os_atomic_store(&node->vbn_count, (uint16_t)count, relaxed);
+	vm_map_bt_node_clear(node, count);
+
+	if (count == 0) {
+		if (parent == NULL) {
+			os_atomic_store(&bt->vbt_root, NULL, relaxed);
+			bt->vbt_height = 0;
+		} else {
+			vm_map_bt_node_remove(bt, parent,
+			    vm_map_bt_node_index(parent, node));
+		}
+		vm_map_bt_node_free(bt, node);
+	} else if (parent == NULL) {
+		if (count == 1 && !node->vbn_leaf) {
+			struct vm_map_bt_node *child = node->vbn_slot[0];
+
+			child->vbn_parent = NULL;
+			os_atomic_store(&bt->vbt_root, child, release);
+			bt->vbt_height--;
+			vm_map_bt_node_free(bt, node);
+		}
+	} else {
+		vm_map_bt_propagate(node);
+		if (count < VM_MAP_BT_MIN_FILL) {
+			vm_map_bt_merge(bt, node);
+		}
+	}
+}
+
+/*
+ * Finds the leaf slot of an entry: unlike its start, which can be
+ * ahead or behind its pivot (see above), the last address of an entry
+ * is always between its pivot and the next one.
+ */
+static struct vm_map_bt_node *
+vm_map_bt_locate(struct vm_map_bt *bt, struct vm_map_links *entry, int *pos)
+{
+	struct vm_map_bt_node *node = bt->vbt_root;
+	int i;
+
+	while (node != NULL) {
+		i = vm_map_bt_node_find(node, entry->end - 1);
+		if (i < 0) {
+			break;
+		}
+		if (!node->vbn_leaf) {
+			node = node->vbn_slot[i];
+			continue;
+		}
+		if (node->vbn_slot[i] == entry) {
+			*pos = i;
+			return node;
+		}
+		break;
+	}
+
+	panic("vm_map_bt: entry %p [0x%llx:0x%llx] missing from tree %p",
+	    entry, (uint64_t)entry->start, (uint64_t)entry->end, bt);
+}
+
+static void
+vm_map_bt_refresh(struct vm_map_bt *bt, struct vm_map_links *entry)
+{
+	struct vm_map_bt_node *leaf;
+	int pos;
+
+	leaf = vm_map_bt_locate(bt, entry, &pos);
+	leaf->vbn_pivot[pos] = entry->start;
+	leaf->vbn_gap[pos] = vm_map_bt_entry_gap(bt, entry);
+	vm_map_bt_propagate(leaf);
+}
+
+void
+vm_map_bt_init(struct vm_map_bt *bt, struct vm_map_links *head)
+{
+	bt->vbt_root = NULL;
+	bt->vbt_head = head;
+	bt->vbt_height = 0;
+	bt->vbt_nodes = 0;
+}
+
+bool
+vm_map_bt_lookup(
+	struct vm_map_bt       *bt,
+	vm_map_offset_t         address,
+	struct vm_map_links   **entryp)
+{
+	struct vm_map_bt_node *node = bt->vbt_root;
+	struct vm_map_links *entry;
+	int i;
+
+	*entryp = NULL;
+	if (node == NULL) {
+		return false;
+	}
+
+	for (;;) {
+		i = vm_map_bt_node_find(node, address);
+		if (i < 0) {
+			return false;
+		}
+		if (node->vbn_leaf) {
+			break;
+		}
+		node = node->vbn_slot[i];
+	}
+
+	entry = node->vbn_slot[i];
+	*entryp = entry;
+	return address < entry->end;
+}
+
+/*
+ * Lookup without the map lock, under smr_vm_map.
+ *
+ * Nodes can be reshaped under our feet, so the walk is bounded and
+ * may miss: the caller validates the result against the map's sequence
+ * count and falls back to a locked lookup.
+ */
+struct vm_map_links *
+vm_map_bt_lookup_speculative(struct vm_map_bt *bt, vm_map_offset_t address)
+{
+	struct vm_map_bt_node *node;
+	struct vm_map_links *entry;
+	int count, i;
+
+	node = os_atomic_load(&bt->vbt_root, dependency);
+	for (int depth = 0; depth < VM_MAP_BT_MAX_HEIGHT; depth++) {
+		if (node == NULL) {
+			break;
+		}
+		count = MIN(os_atomic_load(&node->vbn_count, relaxed), VM_MAP_BT_FANOUT);
+		for (i = 0; i < count && node->vbn_pivot[i] <= address; i++) {
+		}
+		if (i == 0) {
+			break;
+		}
+		if (!node->vbn_leaf) {
+			node = os_atomic_load(&node->vbn_slot[i - 1], dependency);
+			continue;
+		}
+		entry = os_atomic_load(&node->vbn_slot[i - 1], dependency);
+		if (entry != NULL && entry->start <= address && address < entry->end) {
+			return entry;
+		}
+		break;
+	}
+	return NULL;
+}
+
+void
+vm_map_bt_insert(struct vm_map_bt *bt, struct vm_map_links *entry)
+{
+	struct vm_map_bt_node *node = bt->vbt_root;
+	struct vm_map_links *next = &entry->next->links;
+	int pos;
+
+	if (node == NULL) {
+		node = vm_map_bt_node_alloc(bt, true);
+		vm_map_bt_node_set(node, 0, entry->start,
+		    vm_map_bt_entry_gap(bt, entry), entry);
+		node->vbn_count = 1;
+		os_atomic_store(&bt->vbt_root, node, release);
+		bt->vbt_height = 1;
+		return;
+	}
+
+	while (!node->vbn_leaf) {
+		pos = vm_map_bt_node_find(node, entry->start);
+		node = node->vbn_slot[MAX(pos, 0)];
+	}
+
+	/* go before an entry with an equal, stale, pivot (see above) */
+	for (pos = 0; pos < node->vbn_count; pos++) {
+		if (node->vbn_pivot[pos] >= entry->start) {
+			break;
+		}
+	}
+
+	/* the next entry's gap shrinks, fix it up in place when it's here */
+	if (next != bt->vbt_head && pos < node->vbn_count &&
+	    node->vbn_slot[pos] == next) {
+		node->vbn_pivot[pos] = next->start;
+		node->vbn_gap[pos] = vm_map_bt_entry_gap(bt, next);
+		next = bt->vbt_head;
+	}
+
+	vm_map_bt_node_insert(bt, node, pos, entry->start,
+	    vm_map_bt_entry_gap(bt, entry), entry);
+
+	if (next != bt->vbt_head) {
+		vm_map_bt_refresh(bt, next);
+	}
+}
+
+void
+vm_map_bt_remove(struct vm_map_bt *bt, struct vm_map_links *entry)
+{
+	struct vm_map_links *next = &entry->next->links;
+	struct vm_map_bt_node *leaf;
+	int pos;
+
+	leaf = vm_map_bt_locate(bt, entry, &pos);
+
+	/* the next entry's gap grows, fix it up in place when it's here */
+	if (next != bt->vbt_head && pos + 1 < leaf->vbn_count &&
+	    leaf->vbn_slot[pos + 1] == next) {
+		leaf->vbn_pivot[pos + 1] = next->start;
+		leaf->vbn_gap[pos + 1] = vm_map_bt_entry_gap(bt, next);
+		next = bt->vbt_head;
+	}
+
+	vm_map_bt_node_remove(bt, leaf, pos);
+
+	if (next != bt->vbt_head) {
+		vm_map_bt_refresh(bt, next);
+	}
+}
+
+void
+vm_map_bt_update(struct vm_map_bt *bt, struct vm_map_links *entry)
+{
+	struct vm_map_links *next = &entry->next->links;
+
+	vm_map_bt_refresh(bt, entry);
+	if (next != bt->vbt_head) {
+		vm_map_bt_refresh(bt, next);
+	}
+}
+
+static struct vm_map_links *
+vm_map_bt_node_next_gap(
+	struct vm_map_bt_node  *node,
+	vm_map_offset_t         address,
+	vm_map_size_t           size)
+{
+	struct vm_map_links *entry;
+
+	for (int i = 0; i < node->vbn_count; i++) {
+		if (node->vbn_gap[i] < size) {
+			continue;
+		}
+		if (i + 1 < node->vbn_count && node->vbn_pivot[i + 1] <= address) {
+			continue;
+		}
+		if (node->vbn_leaf) {
+			if (node->vbn_pivot[i] > address) {
+				return node->vbn_slot[i];
+			}
+			continue;
+		}
+		/* only the child straddling "address" can come back empty */
+		entry = vm_map_bt_node_next_gap(node->vbn_slot[i], address, size);
+		if (entry != NULL) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Returns the first entry starting above @address that is preceded
+ * by a hole of at least @size bytes, or NULL.
+ */
+struct vm_map_links *
+vm_map_bt_next_gap(
+	struct vm_map_bt       *bt,
+	vm_map_offset_t         address,
+	vm_map_size_t           size)
+{
+	if (bt->vbt_root == NULL) {
+		return NULL;
+	}
+	return vm_map_bt_node_next_gap(bt->vbt_root, address, size);
+}
+
+static struct vm_map_links *
+vm_map_bt_node_prev_gap(
+	struct vm_map_bt_node  *node,
+	vm_map_offset_t         address,
+	vm_map_size_t           size)
+{
+	struct vm_map_links *entry;
+
+	for (int i = node->vbn_count - 1; i >= 0; i--) {
+		if (node->vbn_gap[i] < size || node->vbn_pivot[i] > address) {
+			continue;
+		}
+		if (node->vbn_leaf) {
+			return node->vbn_slot[i];
+		}
+		entry = vm_map_bt_node_prev_gap(node->vbn_slot[i], address, size);
+		if (entry != NULL) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Returns the last entry starting at or below @address that is preceded
+ * by a hole of at least @size bytes, or NULL.
+ */
+struct vm_map_links *
+vm_map_bt_prev_gap(
+	struct vm_map_bt       *bt,
+	vm_map_offset_t         address,
+	vm_map_size_t           size)
+{
+	if (bt->vbt_root == NULL) {
+		return NULL;
+	}
+	return vm_map_bt_node_prev_gap(bt->vbt_root, address, size);
+}
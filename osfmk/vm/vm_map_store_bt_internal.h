@@ -0,0 +1,85 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+#ifndef _VM_VM_MAP_STORE_BT_H
+#define _VM_VM_MAP_STORE_BT_H
+
+/*
+ * B-tree index of the entries of a map, see vm_map_store_bt.c.
+ *
+ * The tree only knows about struct vm_map_links, so that it can be
+ * built and exercised outside of the kernel (tools/tests/vm_map_store).
+ */
+struct vm_map_bt_node;
+
+struct vm_map_bt {
+	struct vm_map_bt_node  *vbt_root;
+	struct vm_map_links    *vbt_head;       /* head of the entry list */
+	uint32_t                vbt_height;
+	uint32_t                vbt_nodes;
+};
+
+extern void vm_map_bt_startup(
+	bool                    smr);
+
+extern void vm_map_bt_init(
+	struct vm_map_bt       *bt,
+	struct vm_map_links    *head);
+
+extern bool vm_map_bt_lookup(
+	struct vm_map_bt       *bt,
+	vm_map_offset_t         address,
+	struct vm_map_links   **entryp);
+
+extern struct vm_map_links *vm_map_bt_lookup_speculative(
+	struct vm_map_bt       *bt,
+	vm_map_offset_t         address);
+
+extern void vm_map_bt_insert(
+	struct vm_map_bt       *bt,
+	struct vm_map_links    *entry);
+
+extern void vm_map_bt_remove(
+	struct vm_map_bt       *bt,
+	struct vm_map_links    *entry);
+
+extern void vm_map_bt_update(
+	struct vm_map_bt       *bt,
+	struct vm_map_links    *entry);
+
+extern struct vm_map_links *vm_map_bt_next_gap(
+	struct vm_map_bt       *bt,
+	vm_map_offset_t         address,
+	vm_map_size_t           size);
+
+extern struct vm_map_links *vm_map_bt_prev_gap(
+	struct vm_map_bt       *bt,
+	vm_map_offset_t         address,
+	vm_map_size_t           size);
+
+#endif /* _VM_VM_MAP_STORE_BT_H */
@@ -33,6 +33,10 @@
 #define VM_MAP_STORE_USE_RB
 #endif
 
+#ifndef VM_MAP_STORE_USE_BT
+#define VM_MAP_STORE_USE_BT
+#endif
+
 #include <libkern/tree.h>
 #include <mach/shared_region.h>
 
@@ -75,6 +79,9 @@ struct vm_map_links {
 	vm_map_offset_t         end;            /* end address */
 };
 
+#ifdef VM_MAP_STORE_USE_BT
+#include <vm/vm_map_store_bt_internal.h>
+#endif /* VM_MAP_STORE_USE_BT */
 
 /*
  *	Type:		struct vm_map_header
@@ -91,10 +98,14 @@ struct vm_map_header {
 	int                     nentries;       /* Number of entries */
 	uint16_t                page_shift;     /* page shift */
 	uint16_t                entries_pageable : 1;   /* are map entries pageable? */
-	uint16_t                __padding : 15;
+	uint16_t                store_bt : 1;           /* entries indexed by bt_store */
+	uint16_t                __padding : 14;
 #ifdef VM_MAP_STORE_USE_RB
 	struct rb_head          rb_head_store;
 #endif /* VM_MAP_STORE_USE_RB */
+#ifdef VM_MAP_STORE_USE_BT
+	struct vm_map_bt        bt_store;
+#endif /* VM_MAP_STORE_USE_BT */
 };
 
 #define VM_MAP_HDR_PAGE_SHIFT(hdr)      ((hdr)->page_shift)
@@ -171,6 +182,25 @@ extern bool first_free_is_valid_store(
 extern bool vm_map_store_has_RB_support(
 	struct vm_map_header   *header);
 
+#ifdef VM_MAP_STORE_USE_BT
+static inline bool
+vm_map_store_has_BT_support(struct vm_map_header *header)
+{
+	return header->store_bt;
+}
+
+extern void vm_map_store_init_bt(
+	struct vm_map_header   *header);
+#endif /* VM_MAP_STORE_USE_BT */
+
+extern struct vm_map_entry *vm_map_store_lookup_entry_speculative(
+	struct _vm_map         *map,
+	vm_map_offset_t         address);
+
+extern void vm_map_store_entry_resized(
+	struct _vm_map         *map,
+	struct vm_map_entry    *entry);
+
 extern struct vm_map_entry *vm_map_store_find_space(
 	vm_map_t                map,
 	vm_map_offset_t         hint,
@@ -84,6 +84,39 @@ vm_map_store_lookup_entry_rb(vm_map_t map, vm_map_offset_t address, vm_map_entry
 	return FALSE;
 }
 
+/*
+ * Lookup without the map lock, under smr_vm_map (see vm_map_lookup_speculative()).
+ *
+ * The tree can be rebalanced under our feet, so the walk is bounded
+ * and may miss: the caller validates the result against the map's
+ * sequence count and falls back to a locked lookup.
+ */
+#define VM_MAP_STORE_SPECULATIVE_MAX_DEPTH      64
+
+vm_map_entry_t
+vm_map_store_lookup_entry_rb_speculative(vm_map_t map, vm_map_offset_t address)
+{
+	struct vm_map_header *hdr = &map->hdr;
+	struct vm_map_store  *rb_entry;
+	vm_map_entry_t       cur;
+
+	rb_entry = os_atomic_load(&RB_ROOT(&hdr->rb_head_store), dependency);
+	for (int depth = 0; depth < VM_MAP_STORE_SPECULATIVE_MAX_DEPTH; depth++) {
+		if (rb_entry == (struct vm_map_store *)NULL) {
+			break;
+		}
+		cur = VME_FOR_STORE(rb_entry);
+		if (address < cur->vme_start) {
+			rb_entry = os_atomic_load(&RB_LEFT(rb_entry, entry), dependency);
+		} else if (address >= cur->vme_end) {
+			rb_entry = os_atomic_load(&RB_RIGHT(rb_entry, entry), dependency);
+		} else {
+			return cur;
+		}
+	}
+	return VM_MAP_ENTRY_NULL;
+}
+
 void
 vm_map_store_entry_link_rb(struct vm_map_header *mapHdr, vm_map_entry_t entry)
 {
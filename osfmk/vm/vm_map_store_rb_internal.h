@@ -43,6 +43,10 @@ extern bool vm_map_store_lookup_entry_rb(
 	vm_map_offset_t         address,
 	struct vm_map_entry   **entryp);
 
+extern struct vm_map_entry *vm_map_store_lookup_entry_rb_speculative(
+	struct _vm_map         *map,
+	vm_map_offset_t         address);
+
 extern void vm_map_store_entry_link_rb(
 	struct vm_map_header   *header,
 	struct vm_map_entry    *entry);
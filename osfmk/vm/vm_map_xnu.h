@@ -457,9 +457,12 @@ struct _vm_map {
 	/* boolean_t */ uses_user_ranges:1,       /* has the map been configured to use user VM ranges */
 	/* boolean_t */ tpro_enforcement:1,       /* enforce TPRO propagation */
 	/* boolean_t */ corpse_source:1,          /* map is being used to create a corpse for diagnostics.*/
+	/* boolean_t */ no_fault_around:1,        /* don't map resident neighbours on read faults */
 	/* reserved */ res0:1,
-	/* reserved  */pad:9;
+	/* reserved  */pad:8;
 	unsigned int            timestamp;          /* Version number */
+	unsigned int            spec_seq;           /* odd while write-locked, see vm_map_lookup_speculative() */
+	unsigned int            spec_faults;        /* speculative faults pinning the map */
 	/*
 	 * Weak reference to the task that owns this map. This will be NULL if the
 	 * map has terminated, so you must have a task reference to be able to safely
@@ -575,20 +578,33 @@ ZONE_DECLARE_ID(ZONE_ID_VM_MAP, struct _vm_map);
  *	(See vm_map.c::vm_remap())
  */
 
+/*
+ * Write sections of the map lock are bracketed by the speculative
+ * fault sequence count (see vm_map_lookup_speculative()).
+ */
+extern void             vm_map_seq_write_begin(
+	vm_map_t                map);
+extern void             vm_map_seq_write_end(
+	vm_map_t                map);
+
 #define vm_map_lock_init(map)                                           \
 	((map)->timestamp = 0 ,                                         \
+	(map)->spec_seq = 0 ,                                           \
+	(map)->spec_faults = 0 ,                                        \
 	lck_rw_init(&(map)->lock, &vm_map_lck_grp, &vm_map_lck_rw_attr))
 
 #define vm_map_lock(map)                     \
 	MACRO_BEGIN                          \
 	DTRACE_VM(vm_map_lock_w);            \
 	lck_rw_lock_exclusive(&(map)->lock); \
+	vm_map_seq_write_begin(map);         \
 	MACRO_END
 
 #define vm_map_unlock(map)          \
 	MACRO_BEGIN                 \
 	DTRACE_VM(vm_map_unlock_w); \
 	(map)->timestamp++;         \
+	vm_map_seq_write_end(map);  \
 	lck_rw_done(&(map)->lock);  \
 	MACRO_END
 
@@ -608,6 +624,7 @@ ZONE_DECLARE_ID(ZONE_ID_VM_MAP, struct _vm_map);
 	MACRO_BEGIN                                    \
 	DTRACE_VM(vm_map_lock_downgrade);              \
 	(map)->timestamp++;                            \
+	vm_map_seq_write_end(map);                     \
 	lck_rw_lock_exclusive_to_shared(&(map)->lock); \
 	MACRO_END
 
@@ -652,10 +669,15 @@ extern void             vm_map_reference(
 /*
  *	Wait and wakeup macros for in_transition map entries.
  */
-#define vm_map_entry_wait(map, interruptible)           \
-	((map)->timestamp++ ,                           \
-	 lck_rw_sleep(&(map)->lock, LCK_SLEEP_EXCLUSIVE|LCK_SLEEP_PROMOTED_PRI, \
-	                          (event_t)&(map)->hdr,	interruptible))
+#define vm_map_entry_wait(map, interruptible)  ({        \
+	wait_result_t __wr;                             \
+	(map)->timestamp++;                             \
+	vm_map_seq_write_end(map);                      \
+	__wr = lck_rw_sleep(&(map)->lock, LCK_SLEEP_EXCLUSIVE|LCK_SLEEP_PROMOTED_PRI, \
+	                          (event_t)&(map)->hdr,	interruptible); \
+	vm_map_seq_write_begin(map);                    \
+	__wr;                                           \
+})
 
 
 #define vm_map_entry_wakeup(map)        \
@@ -1065,6 +1087,8 @@ extern void vm_map_guard_exception(vm_map_offset_t gap_start, unsigned reason);
 extern bool vm_map_is_corpse_source(vm_map_t map);
 extern void vm_map_set_corpse_source(vm_map_t map);
 extern void vm_map_unset_corpse_source(vm_map_t map);
+extern void vm_map_set_fault_around(vm_map_t map, bool enable);
+extern bool vm_map_get_fault_around(vm_map_t map);
 
 #if CONFIG_DYNAMIC_CODE_SIGNING
 
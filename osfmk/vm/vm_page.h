@@ -248,7 +248,8 @@ struct vm_page {
 	 * That's no longer true and what lock, if any, is needed may depend on the
 	 * value of vmp_q_state.
 	 *
-	 * We use 'vmp_wire_count' to store the local queue id if local queues are enabled.
+	 * We use 'vmp_wire_count' to store the local queue id if local queues are enabled,
+	 * and the multi-generational LRU stamp of pages on the inactive queues.
 	 * See the comments at 'vm_page_queues_remove' as to why this is safe to do.
 	 */
 #define VM_PAGE_SPECIAL_Q_EMPTY (0)
@@ -256,6 +257,7 @@ struct vm_page {
 #define VM_PAGE_SPECIAL_Q_DONATE (2)
 #define VM_PAGE_SPECIAL_Q_FG (3)
 #define vmp_local_id vmp_wire_count
+#define vmp_mglru_stamp vmp_wire_count
 	unsigned int vmp_wire_count:16,      /* how many wired down maps use me? (O&P) */
 	    vmp_q_state:4,                   /* which q is the page on (P) */
 	    vmp_on_specialq:2,
@@ -267,11 +269,11 @@ struct vm_page {
 	    vmp_reference:1,                 /* page has been used (P) */
 	    vmp_lopage:1,
 	    vmp_realtime:1,                  /* page used by realtime thread */
+	    vmp_gen:2,                       /* generation of an active page, see vm_page_mglru (P) */
 #if !CONFIG_TRACK_UNMODIFIED_ANON_PAGES
-	    vmp_unused_page_bits:3;
+	    vmp_unused_page_bits:1;
 #else /* ! CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
-	vmp_unmodified_ro:1,                 /* Tracks if an anonymous page is modified after a decompression (O&P).*/
-	vmp_unused_page_bits:2;
+	vmp_unmodified_ro:1;                 /* Tracks if an anonymous page is modified after a decompression (O&P).*/
 #endif /* ! CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
 
 	/*
@@ -1055,6 +1057,60 @@ vm_page_queue_head_t    vm_page_queue_anonymous;        /* inactive memory queue
 extern
 vm_page_queue_head_t    vm_page_queue_throttled;        /* memory queue for throttled pageout pages */
 
+/*
+ * Multi-generational LRU (vm_page_mglru=1), see vm_page_balance_inactive().
+ *
+ * The active queue is split into generations ordered from its head (oldest)
+ * to its tail (youngest).  An active page records its generation modulo
+ * VM_PAGE_MGLRU_NR_GENS in vmp_gen, so there can't be more live generations.
+ */
+#define VM_PAGE_MGLRU_NR_GENS   4
+
+#define VM_PAGE_MGLRU_ANON      0
+#define VM_PAGE_MGLRU_FILE      1
+#define VM_PAGE_MGLRU_NR_TYPES  2
+
+struct vm_page_mglru_gen_stats {
+	uint64_t        vmg_seq;                /* sequence number of the generation */
+	uint64_t        vmg_birth;              /* mach_absolute_time() when it was opened */
+	uint32_t        vmg_nr_pages[VM_PAGE_MGLRU_NR_TYPES]; /* active pages in it */
+	uint64_t        vmg_promoted;           /* referenced pages moved into it while youngest */
+	uint64_t        vmg_aged;               /* its pages looked at by balancing */
+	uint64_t        vmg_deactivated;        /* of which were moved to the inactive queues */
+	uint64_t        vmg_scanned;            /* of which vm_pageout_scan looked at */
+	uint64_t        vmg_reclaimed;          /* of which were freed, compressed or cleaned */
+};
+
+struct vm_page_mglru {
+	uint64_t        vpm_min_seq;            /* oldest live generation */
+	uint64_t        vpm_max_seq;            /* youngest generation */
+	struct vm_page_mglru_gen_stats vpm_gens[VM_PAGE_MGLRU_NR_GENS];
+	struct vm_page_mglru_gen_stats vpm_total; /* counters since boot */
+
+	/*
+	 * What vm_pageout_scan() does with inactive pages, including those
+	 * that weren't deactivated by balancing or whose generation's slot
+	 * was reused since; see vm_page_mglru_inactive_gen().
+	 */
+	uint64_t        vpm_scanned;            /* pages vm_pageout_scan looked at */
+	uint64_t        vpm_reclaimed;          /* of which were freed, compressed or cleaned */
+
+	/*
+	 * Refault feedback: evictions and refaults of each type, averaged
+	 * over the last generations, and the type to favor reclaiming.
+	 */
+	uint64_t        vpm_evicted_snap[VM_PAGE_MGLRU_NR_TYPES];
+	uint64_t        vpm_refaulted_snap[VM_PAGE_MGLRU_NR_TYPES];
+	uint64_t        vpm_evicted[VM_PAGE_MGLRU_NR_TYPES];
+	uint64_t        vpm_refaulted[VM_PAGE_MGLRU_NR_TYPES];
+	int             vpm_reclaim_bias;       /* VM_PAGE_MGLRU_ANON/FILE, or -1 */
+};
+
+extern
+bool                    vm_page_mglru_enabled;
+extern
+struct vm_page_mglru    vm_page_mglru;          /* (P) */
+
 extern
 queue_head_t    vm_objects_wired;
 extern
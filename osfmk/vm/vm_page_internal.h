@@ -850,6 +850,7 @@ extern kern_return_t pmap_enter_check(
 #define DW_VM_PAGE_QUEUES_REMOVE        0x2000
 #define DW_enqueue_cleaned              0x4000
 #define DW_vm_phantom_cache_update      0x8000
+#define DW_vm_phantom_cache_activate    0x10000
 
 struct vm_page_delayed_work {
 	vm_page_t       dw_m;
@@ -905,6 +906,92 @@ extern void vm_page_enqueue_active(vm_page_t mem, boolean_t first);
 extern void vm_page_check_pageable_safe(vm_page_t page);
 //end int
 
+/*
+ * vm_page_mglru_add:
+ * Account for a page put on the active queue: pages put at its head
+ * join the oldest generation, others the youngest.
+ */
+static inline void
+vm_page_mglru_add(vm_page_t mem, bool internal, bool oldest)
+{
+	uint64_t seq;
+
+	if (!vm_page_mglru_enabled) {
+		return;
+	}
+	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	seq = oldest ? vm_page_mglru.vpm_min_seq : vm_page_mglru.vpm_max_seq;
+	mem->vmp_gen = seq % VM_PAGE_MGLRU_NR_GENS;
+	vm_page_mglru.vpm_gens[mem->vmp_gen].vmg_nr_pages[internal ?
+	    VM_PAGE_MGLRU_ANON : VM_PAGE_MGLRU_FILE]++;
+}
+
+/*
+ * vm_page_mglru_del:
+ * Account for a page taken off the active queue.
+ */
+static inline void
+vm_page_mglru_del(vm_page_t mem, bool internal)
+{
+	uint32_t *nr_pages;
+
+	if (!vm_page_mglru_enabled) {
+		return;
+	}
+	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	nr_pages = &vm_page_mglru.vpm_gens[mem->vmp_gen].vmg_nr_pages[internal ?
+	    VM_PAGE_MGLRU_ANON : VM_PAGE_MGLRU_FILE];
+	assert(*nr_pages > 0);
+	(*nr_pages)--;
+}
+
+/*
+ * vm_page_mglru_requeue:
+ * Account for a page moved from the head of its queue to the tail
+ * without leaving it: on the active queue, that's the youngest generation.
+ */
+static inline void
+vm_page_mglru_requeue(vm_page_t mem)
+{
+	if (mem->vmp_q_state == VM_PAGE_ON_ACTIVE_Q) {
+		vm_page_mglru_del(mem, VM_PAGE_OBJECT(mem)->internal);
+		vm_page_mglru_add(mem, VM_PAGE_OBJECT(mem)->internal, false);
+	}
+}
+
+/*
+ * vm_page_mglru_stamp:
+ * Pages deactivated out of a generation keep its slot in vmp_gen and
+ * the low bits of its sequence number in vmp_mglru_stamp (0 for none)
+ * while on the inactive queues.
+ */
+#define VM_PAGE_MGLRU_STAMP(seq)        ((uint16_t)((seq) % UINT16_MAX + 1))
+#define VM_PAGE_MGLRU_NO_SEQ            UINT64_MAX
+
+/*
+ * vm_page_mglru_inactive_seq:
+ * The generation an inactive page was deactivated from, as long as its
+ * slot hasn't been reused for a younger one, or VM_PAGE_MGLRU_NO_SEQ.
+ */
+static inline uint64_t
+vm_page_mglru_inactive_seq(vm_page_t mem)
+{
+	uint64_t seq;
+
+	if (!vm_page_mglru_enabled || mem->vmp_mglru_stamp == 0) {
+		return VM_PAGE_MGLRU_NO_SEQ;
+	}
+	LCK_MTX_ASSERT(&vm_page_queue_lock, LCK_MTX_ASSERT_OWNED);
+
+	seq = vm_page_mglru.vpm_gens[mem->vmp_gen].vmg_seq;
+	if (VM_PAGE_MGLRU_STAMP(seq) != mem->vmp_mglru_stamp) {
+		return VM_PAGE_MGLRU_NO_SEQ;
+	}
+	return seq;
+}
+
 //todo int
 extern void vm_retire_boot_pages(void);
 
@@ -1224,6 +1224,7 @@ vm_pageout_disconnect_all_pages_in_queue(vm_page_queue_head_t *q, int qcount)
 reenter_pg_on_q:
 		vm_page_queue_remove(q, m, vmp_pageq);
 		vm_page_queue_enter(q, m, vmp_pageq);
+		vm_page_mglru_requeue(m);
 
 		qcount--;
 		try_failed_count = 0;
@@ -1532,6 +1533,7 @@ vm_pageout_page_queue(vm_page_queue_head_t *q, size_t qcount, bool perf_test)
 reenter_pg_on_q:
 		vm_page_queue_remove(q, m, vmp_pageq);
 		vm_page_queue_enter(q, m, vmp_pageq);
+		vm_page_mglru_requeue(m);
 next_pg:
 		qcount--;
 		try_failed_count = 0;
@@ -2479,6 +2481,314 @@ vps_flow_control(struct flow_control *flow_control, int *anons_grabbed, vm_objec
 	return VM_PAGEOUT_SCAN_NEXT_ITERATION;
 }
 
+/*
+ * Multi-generational LRU
+ *
+ * When booted with vm_page_mglru=1, the active queue is split into
+ * generations (see struct vm_page_mglru): pages are activated into the
+ * youngest generation at the tail of the queue, and its head always
+ * belongs to the oldest one.  Instead of deactivating the head of the
+ * active queue unconditionally, vm_page_balance_inactive() then:
+ *
+ * - reads the referenced state of the pages at the head, and promotes
+ *   the ones used since they entered their generation to the youngest
+ *   one, deactivating the others.  Up to VM_PAGE_MGLRU_AGE_BATCH pages
+ *   are looked at per call, past that the head is deactivated as usual
+ *   so that balancing always makes progress.
+ *
+ * - opens a new generation once the youngest holds its share of the
+ *   active queue, and retires the oldest once all its pages are gone.
+ *
+ * The pmap layer already tracks referenced and modified bits per
+ * physical page, so harvesting them doesn't need to walk page tables:
+ * pmap_get_refmod() collects them from all mappings, and clearing them
+ * is done without a TLB flush, like the classic balancing does.
+ *
+ * Each time a generation is opened, the refault rates of anonymous
+ * pages (decompressions per compression) and of file pages (phantom
+ * cache hits per ghost added) are sampled, and vps_choose_victim_page()
+ * favors reclaiming the type that refaults the least.
+ */
+TUNABLE(bool, vm_page_mglru_enabled, "vm_page_mglru", false);
+struct vm_page_mglru vm_page_mglru = {
+	.vpm_reclaim_bias = -1,
+};
+
+#define VM_PAGE_MGLRU_AGE_BATCH         16
+#define VM_PAGE_MGLRU_REFAULT_MIN       64      /* evictions per generation to trust a refault rate */
+
+#define VM_PAGE_MGLRU_GEN(seq) \
+	(&vm_page_mglru.vpm_gens[(seq) % VM_PAGE_MGLRU_NR_GENS])
+
+#define VM_PAGE_MGLRU_COUNT(seq, field)                         \
+	MACRO_BEGIN                                             \
+	VM_PAGE_MGLRU_GEN(seq)->field++;                        \
+	vm_page_mglru.vpm_total.field++;                        \
+	MACRO_END
+
+/*
+ * counts an event of vm_pageout_scan(), and charges it to the generation
+ * the page was deactivated from if it's still in the ring (seq isn't
+ * VM_PAGE_MGLRU_NO_SEQ and its slot hasn't been reused since)
+ */
+#define VM_PAGE_MGLRU_SCAN_COUNT(seq, vpm_field, vmg_field)     \
+	MACRO_BEGIN                                             \
+	if (vm_page_mglru_enabled) {                            \
+	        vm_page_mglru.vpm_field++;                      \
+	        if ((seq) != VM_PAGE_MGLRU_NO_SEQ &&            \
+	            VM_PAGE_MGLRU_GEN(seq)->vmg_seq == (seq)) { \
+	                VM_PAGE_MGLRU_COUNT(seq, vmg_field);    \
+	        }                                               \
+	}                                                       \
+	MACRO_END
+
+static_assert(VM_PAGE_MGLRU_NR_GENS <= 4, "vmp_gen is 2 bits wide");
+static_assert(VM_PAGE_MGLRU_NR_GENS == VM_PAGE_MGLRU_STATS_GENS);
+
+static inline uint32_t
+vm_page_mglru_gen_size(uint64_t seq)
+{
+	struct vm_page_mglru_gen_stats *gen = VM_PAGE_MGLRU_GEN(seq);
+
+	return gen->vmg_nr_pages[VM_PAGE_MGLRU_ANON] + gen->vmg_nr_pages[VM_PAGE_MGLRU_FILE];
+}
+
+static void
+vm_page_mglru_sample_refaults(void)
+{
+	struct vm_page_mglru *vpm = &vm_page_mglru;
+	uint64_t evicted[VM_PAGE_MGLRU_NR_TYPES], refaulted[VM_PAGE_MGLRU_NR_TYPES];
+	uint64_t anon_rate, file_rate;
+
+	evicted[VM_PAGE_MGLRU_ANON] = vm_pageout_vminfo.vm_pageout_compressions;
+	refaulted[VM_PAGE_MGLRU_ANON] = counter_load(&vm_statistics_decompressions);
+	evicted[VM_PAGE_MGLRU_FILE] = vm_pageout_vminfo.vm_phantom_cache_added_ghost;
+	refaulted[VM_PAGE_MGLRU_FILE] = vm_pageout_vminfo.vm_phantom_cache_found_ghost;
+
+	for (int type = 0; type < VM_PAGE_MGLRU_NR_TYPES; type++) {
+		/* each generation weighs as much as all the previous ones */
+		vpm->vpm_evicted[type] = (vpm->vpm_evicted[type] +
+		    evicted[type] - vpm->vpm_evicted_snap[type]) / 2;
+		vpm->vpm_refaulted[type] = (vpm->vpm_refaulted[type] +
+		    refaulted[type] - vpm->vpm_refaulted_snap[type]) / 2;
+		vpm->vpm_evicted_snap[type] = evicted[type];
+		vpm->vpm_refaulted_snap[type] = refaulted[type];
+	}
+
+	if (vpm->vpm_evicted[VM_PAGE_MGLRU_ANON] < VM_PAGE_MGLRU_REFAULT_MIN ||
+	    vpm->vpm_evicted[VM_PAGE_MGLRU_FILE] < VM_PAGE_MGLRU_REFAULT_MIN) {
+		vpm->vpm_reclaim_bias = -1;
+		return;
+	}
+
+	/*
+	 * Compare refaulted / evicted across types, and only favor a type
+	 * when its rate is 25% lower than the other's to avoid flapping.
+	 */
+	anon_rate = vpm->vpm_refaulted[VM_PAGE_MGLRU_ANON] * vpm->vpm_evicted[VM_PAGE_MGLRU_FILE];
+	file_rate = vpm->vpm_refaulted[VM_PAGE_MGLRU_FILE] * vpm->vpm_evicted[VM_PAGE_MGLRU_ANON];
+
+	if (file_rate * 4 > anon_rate * 5) {
+		vpm->vpm_reclaim_bias = VM_PAGE_MGLRU_ANON;
+	} else if (anon_rate * 4 > file_rate * 5) {
+		vpm->vpm_reclaim_bias = VM_PAGE_MGLRU_FILE;
+	} else {
+		vpm->vpm_reclaim_bias = -1;
+	}
+}
+
+/*
+ * Retires the oldest generations once empty, and opens a new one when
+ * the youngest is the only one left or has grown to its share of the
+ * active queue.  Leaves at least 2 generations.
+ */
+static void
+vm_page_mglru_advance(void)
+{
+	struct vm_page_mglru *vpm = &vm_page_mglru;
+	struct vm_page_mglru_gen_stats *gen;
+
+	while (vpm->vpm_min_seq < vpm->vpm_max_seq &&
+	    vm_page_mglru_gen_size(vpm->vpm_min_seq) == 0) {
+		vpm->vpm_min_seq++;
+	}
+
+	if (vpm->vpm_max_seq - vpm->vpm_min_seq + 1 >= VM_PAGE_MGLRU_NR_GENS) {
+		return;
+	}
+	if (vpm->vpm_min_seq != vpm->vpm_max_seq &&
+	    vm_page_mglru_gen_size(vpm->vpm_max_seq) <
+	    vm_page_active_count / (VM_PAGE_MGLRU_NR_GENS - 1)) {
+		return;
+	}
+
+	vpm->vpm_max_seq++;
+	gen = VM_PAGE_MGLRU_GEN(vpm->vpm_max_seq);
+	assert(vm_page_mglru_gen_size(vpm->vpm_max_seq) == 0);
+	*gen = (struct vm_page_mglru_gen_stats){
+		.vmg_seq = vpm->vpm_max_seq,
+		.vmg_birth = mach_absolute_time(),
+	};
+
+	vm_page_mglru_sample_refaults();
+}
+
+static void
+vm_page_mglru_balance(int max_to_move)
+{
+	struct vm_page_mglru *vpm = &vm_page_mglru;
+	vm_page_t       m;
+	vm_object_t     m_object;
+	uint64_t        seq;
+	int             aged = 0;
+	bool            converted = false;
+	bool            referenced;
+
+	while (max_to_move > 0 &&
+	    (vm_page_inactive_count + vm_page_speculative_count) < vm_page_inactive_target &&
+	    !vm_page_queue_empty(&vm_page_queue_active)) {
+		vm_page_mglru_advance();
+
+		m = (vm_page_t) vm_page_queue_first(&vm_page_queue_active);
+		m_object = VM_PAGE_OBJECT(m);
+
+		assert(m->vmp_q_state == VM_PAGE_ON_ACTIVE_Q);
+		assert(!m->vmp_laundry);
+		assert(!is_kernel_object(m_object));
+		assert(!vm_page_is_guard(m));
+
+		DTRACE_VM2(scan, int, 1, (uint64_t *), NULL);
+		VM_PAGE_MGLRU_COUNT(m->vmp_gen, vmg_aged);
+
+		if (aged < VM_PAGE_MGLRU_AGE_BATCH) {
+			aged++;
+
+			referenced = m->vmp_reference;
+			if (!referenced && m->vmp_pmapped) {
+				if (!converted) {
+					/* the pmap layer may block, don't hold a spin lock */
+					vm_page_lockconvert_queues();
+					converted = true;
+				}
+				referenced = (pmap_get_refmod(VM_PAGE_GET_PHYS_PAGE(m)) & VM_MEM_REFERENCED) != 0;
+			}
+
+			if (referenced &&
+			    m->vmp_gen != vpm->vpm_max_seq % VM_PAGE_MGLRU_NR_GENS) {
+				/*
+				 * Used since it entered its generation: move it to
+				 * the youngest one, and start tracking its use anew.
+				 */
+				if (m->vmp_pmapped) {
+					if (!converted) {
+						/* see vm_page_balance_inactive() */
+						vm_page_lockconvert_queues();
+						converted = true;
+					}
+					pmap_clear_refmod_options(VM_PAGE_GET_PHYS_PAGE(m),
+					    VM_MEM_REFERENCED, PMAP_OPTIONS_NOFLUSH, (void *)NULL);
+				}
+				m->vmp_reference = FALSE;
+
+				vm_page_queue_remove(&vm_page_queue_active, m, vmp_pageq);
+				vm_page_mglru_del(m, m_object->internal);
+				vm_page_queue_enter(&vm_page_queue_active, m, vmp_pageq);
+				vm_page_mglru_add(m, m_object->internal, false);
+				VM_PAGE_MGLRU_COUNT(vpm->vpm_max_seq, vmg_promoted);
+				continue;
+			}
+		}
+
+		if (m->vmp_pmapped == TRUE) {
+			if (!converted) {
+				vm_page_lockconvert_queues();
+				converted = true;
+			}
+			pmap_clear_refmod_options(VM_PAGE_GET_PHYS_PAGE(m), VM_MEM_REFERENCED, PMAP_OPTIONS_NOFLUSH, (void *)NULL);
+		}
+
+		VM_PAGEOUT_DEBUG(vm_pageout_balanced, 1);
+		VM_PAGE_MGLRU_COUNT(m->vmp_gen, vmg_deactivated);
+		seq = VM_PAGE_MGLRU_GEN(m->vmp_gen)->vmg_seq;
+		vm_page_deactivate_internal(m, FALSE);
+		if (VM_PAGE_INACTIVE(m)) {
+			/* so vm_pageout_scan() can charge it to this generation */
+			m->vmp_mglru_stamp = VM_PAGE_MGLRU_STAMP(seq);
+		}
+		max_to_move--;
+	}
+}
+
+/*
+ * vm_page_mglru_grab_anonymous:
+ * Lets the refault feedback decide whether vm_pageout_scan() reclaims
+ * anonymous or file backed pages, when both are allowed.
+ */
+static boolean_t
+vm_page_mglru_grab_anonymous(boolean_t grab_anonymous)
+{
+	if (vm_page_anonymous_count <= vm_page_anonymous_min) {
+		return grab_anonymous;
+	}
+
+	switch (vm_page_mglru.vpm_reclaim_bias) {
+	case VM_PAGE_MGLRU_ANON:
+		return TRUE;
+	case VM_PAGE_MGLRU_FILE:
+		return FALSE;
+	default:
+		return grab_anonymous;
+	}
+}
+
+static void
+vm_page_mglru_export_gen(
+	struct vm_page_mglru_gen_info   *info,
+	struct vm_page_mglru_gen_stats  *gen,
+	uint64_t                        now)
+{
+	info->vmgi_seq = gen->vmg_seq;
+	if (gen->vmg_birth) {
+		absolutetime_to_nanoseconds(now - gen->vmg_birth, &info->vmgi_age_ns);
+	}
+	info->vmgi_nr_anon = gen->vmg_nr_pages[VM_PAGE_MGLRU_ANON];
+	info->vmgi_nr_file = gen->vmg_nr_pages[VM_PAGE_MGLRU_FILE];
+	info->vmgi_promoted = gen->vmg_promoted;
+	info->vmgi_aged = gen->vmg_aged;
+	info->vmgi_deactivated = gen->vmg_deactivated;
+	info->vmgi_scanned = gen->vmg_scanned;
+	info->vmgi_reclaimed = gen->vmg_reclaimed;
+}
+
+void
+vm_page_mglru_get_stats(struct vm_page_mglru_stats *stats)
+{
+	struct vm_page_mglru *vpm = &vm_page_mglru;
+	uint64_t now = mach_absolute_time();
+
+	bzero(stats, sizeof(*stats));
+	if (!vm_page_mglru_enabled) {
+		return;
+	}
+
+	vm_page_lock_queues();
+	stats->vms_evicted_anon = vpm->vpm_evicted[VM_PAGE_MGLRU_ANON];
+	stats->vms_evicted_file = vpm->vpm_evicted[VM_PAGE_MGLRU_FILE];
+	stats->vms_refaulted_anon = vpm->vpm_refaulted[VM_PAGE_MGLRU_ANON];
+	stats->vms_refaulted_file = vpm->vpm_refaulted[VM_PAGE_MGLRU_FILE];
+	stats->vms_reclaim_bias = vpm->vpm_reclaim_bias;
+	stats->vms_scanned = vpm->vpm_scanned;
+	stats->vms_reclaimed = vpm->vpm_reclaimed;
+	vm_page_mglru_export_gen(&stats->vms_total, &vpm->vpm_total, now);
+	/* include the retired generations still in the ring */
+	for (uint64_t seq = vpm->vpm_max_seq + 1 - MIN(vpm->vpm_max_seq + 1, VM_PAGE_MGLRU_NR_GENS);
+	    seq <= vpm->vpm_max_seq; seq++) {
+		vm_page_mglru_export_gen(&stats->vms_gens[stats->vms_nr_gens++],
+		    VM_PAGE_MGLRU_GEN(seq), now);
+	}
+	vm_page_unlock_queues();
+}
+
 extern boolean_t vm_darkwake_mode;
 /*
  * This function is called only from vm_pageout_scan and
@@ -2619,6 +2929,10 @@ vps_choose_victim_page(vm_page_t *victim_page, int *anons_grabbed, boolean_t *gr
 	}
 	*grab_anonymous = (vm_page_anonymous_count > vm_page_anonymous_min);
 
+	if (vm_page_mglru_enabled) {
+		*grab_anonymous = vm_page_mglru_grab_anonymous(*grab_anonymous);
+	}
+
 #if CONFIG_JETSAM
 	/* If the file-backed pool has accumulated
 	 * significantly more pages than the jetsam
@@ -2880,6 +3194,7 @@ vps_deal_with_throttled_queues(vm_page_t m, vm_object_t *object, uint32_t *vm_pa
 		vm_page_queue_enter(&vm_page_queue_active, m, vmp_pageq);
 		m->vmp_q_state = VM_PAGE_ON_ACTIVE_Q;
 		vm_page_active_count++;
+		vm_page_mglru_add(m, false, false);
 		vm_page_pageable_external_count++;
 
 		vm_pageout_adjust_eq_iothrottle(&pgo_iothread_external_state, FALSE);
@@ -2946,6 +3261,11 @@ vm_page_balance_inactive(int max_to_move)
 	    vm_page_inactive_count +
 	    vm_page_speculative_count);
 
+	if (vm_page_mglru_enabled) {
+		vm_page_mglru_balance(max_to_move);
+		return;
+	}
+
 	while (max_to_move-- && (vm_page_inactive_count + vm_page_speculative_count) < vm_page_inactive_target) {
 		VM_PAGEOUT_DEBUG(vm_pageout_balanced, 1);
 
@@ -3020,6 +3340,7 @@ vm_pageout_scan(void)
 	boolean_t       force_speculative_aging = FALSE;
 	int             anons_grabbed = 0;
 	int             page_prev_q_state = 0;
+	uint64_t        page_mglru_seq = VM_PAGE_MGLRU_NO_SEQ;
 	boolean_t       page_from_bg_q = FALSE;
 	uint32_t        vm_pageout_inactive_external_forced_reactivate_limit = 0;
 	vm_object_t     m_object = VM_OBJECT_NULL;
@@ -3306,6 +3627,7 @@ return_from_scan:
 		force_anonymous = FALSE;
 
 		page_prev_q_state = m->vmp_q_state;
+		page_mglru_seq = vm_page_mglru_inactive_seq(m);
 		/*
 		 * we just found this page on one of our queues...
 		 * it can't also be on the pageout queue, so safe
@@ -3328,6 +3650,7 @@ return_from_scan:
 		assert(!is_kernel_object(m_object));
 
 		vm_pageout_vminfo.vm_pageout_considered_page++;
+		VM_PAGE_MGLRU_SCAN_COUNT(page_mglru_seq, vpm_scanned, vmg_scanned);
 
 		DTRACE_VM2(scan, int, 1, (uint64_t *), NULL);
 
@@ -3454,6 +3777,7 @@ reclaim_page:
 			m->vmp_snext = local_freeq;
 			local_freeq = m;
 			local_freed++;
+			VM_PAGE_MGLRU_SCAN_COUNT(page_mglru_seq, vpm_reclaimed, vmg_reclaimed);
 
 			if (page_prev_q_state == VM_PAGE_ON_SPECULATIVE_Q) {
 				vm_pageout_vminfo.vm_pageout_freed_speculative++;
@@ -3826,6 +4150,7 @@ throttle_inactive:
 		 * and upon completion will end up on 'vm_page_queue_cleaned' which
 		 * is a preferred queue to steal from
 		 */
+		VM_PAGE_MGLRU_SCAN_COUNT(page_mglru_seq, vpm_reclaimed, vmg_reclaimed);
 		vm_pageout_cluster(m);
 		inactive_burst_count = 0;
 
@@ -4262,7 +4587,27 @@ vm_pageout_iothread_internal_continue(struct pgo_iothread_state *cq, __unused wa
 
 				chead = vm_pageout_select_filling_chead(cq, m);
 
-				if (vm_pageout_compress_page(chead, cq->scratch_buf, m) == KERN_SUCCESS) {
+				if (vm_pageout_state.vm_compressor_batch_pages > 1) {
+					int nprocessed;
+					int ncompressed = vm_pageout_compress_batch(cq, chead, m,
+					    &local_q, &local_freeq, &nprocessed);
+
+#if DEVELOPMENT || DEBUG
+					ncomps += ncompressed;
+					num_pages_processed += nprocessed - 1;
+#endif
+					KDBG_FILTERED(0xe0400024 | DBG_FUNC_END, local_cnt);
+
+					local_freed += ncompressed;
+					if (local_freed >= MAX_FREE_BATCH) {
+						OSAddAtomic64(local_freed, &vm_pageout_vminfo.vm_pageout_compressions);
+
+						vm_page_free_list(local_freeq, TRUE);
+
+						local_freeq = NULL;
+						local_freed = 0;
+					}
+				} else if (vm_pageout_compress_page(chead, cq->scratch_buf, m) == KERN_SUCCESS) {
 #if DEVELOPMENT || DEBUG
 					ncomps++;
 #endif
@@ -4391,14 +4736,15 @@ vm_pageout_iothread_internal_continue(struct pgo_iothread_state *cq, __unused wa
 	/*NOTREACHED*/
 }
 
-/* resolves the pager and maintain stats in the pager and in the vm_object */
-kern_return_t
-vm_pageout_compress_page(void **current_chead, char *scratch_buf, vm_page_t m)
+/*
+ * Makes sure the page's object has a compressor pager, reactivates the page
+ * and returns KERN_FAILURE if it can't have one.
+ */
+static kern_return_t
+vm_pageout_compress_page_prepare(vm_page_t m, memory_object_t *pagerp)
 {
 	vm_object_t     object;
 	memory_object_t pager;
-	int             compressed_count_delta;
-	kern_return_t   retval;
 
 	object = VM_PAGE_OBJECT(m);
 
@@ -4457,29 +4803,34 @@ vm_pageout_compress_page(void **current_chead, char *scratch_buf, vm_page_t m)
 	assert(object->pager_initialized && pager != MEMORY_OBJECT_NULL);
 	assert(object->activity_in_progress > 0);
 
-#if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
-	if (m->vmp_unmodified_ro == true) {
-		os_atomic_inc(&compressor_ro_uncompressed_total_returned, relaxed);
-	}
-#endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
+	*pagerp = pager;
+	return KERN_SUCCESS;
+}
 
+static vm_compressor_options_t
+vm_pageout_compress_page_flags(__unused vm_page_t m)
+{
 	vm_compressor_options_t flags = 0;
 
 #if CONFIG_TRACK_UNMODIFIED_ANON_PAGES
-	if (m->vmp_unmodified_ro) {
+	if (m->vmp_unmodified_ro == true) {
+		os_atomic_inc(&compressor_ro_uncompressed_total_returned, relaxed);
 		flags |= C_PAGE_UNMODIFIED;
 	}
 #endif /* CONFIG_TRACK_UNMODIFIED_ANON_PAGES */
 
+	return flags;
+}
 
-	retval = vm_compressor_pager_put(
-		pager,
-		m->vmp_offset + object->paging_offset,
-		VM_PAGE_GET_PHYS_PAGE(m),
-		current_chead,
-		scratch_buf,
-		&compressed_count_delta,
-		flags);
+/*
+ * Accounts for the result of compressing the page: on success the page is
+ * removed from its object, otherwise it's reactivated.
+ */
+static void
+vm_pageout_compress_page_complete(vm_page_t m, memory_object_t pager,
+    int compressed_count_delta, kern_return_t retval)
+{
+	vm_object_t     object = VM_PAGE_OBJECT(m);
 
 	vm_object_lock(object);
 
@@ -4523,10 +4874,105 @@ vm_pageout_compress_page(void **current_chead, char *scratch_buf, vm_page_t m)
 	}
 	vm_object_activity_end(object);
 	vm_object_unlock(object);
+}
+
+/* resolves the pager and maintain stats in the pager and in the vm_object */
+kern_return_t
+vm_pageout_compress_page(void **current_chead, char *scratch_buf, vm_page_t m)
+{
+	vm_object_t     object;
+	memory_object_t pager;
+	int             compressed_count_delta;
+	kern_return_t   retval;
+
+	if (vm_pageout_compress_page_prepare(m, &pager) != KERN_SUCCESS) {
+		return KERN_FAILURE;
+	}
+	object = VM_PAGE_OBJECT(m);
+
+	retval = vm_compressor_pager_put(
+		pager,
+		m->vmp_offset + object->paging_offset,
+		VM_PAGE_GET_PHYS_PAGE(m),
+		current_chead,
+		scratch_buf,
+		&compressed_count_delta,
+		vm_pageout_compress_page_flags(m));
+
+	vm_pageout_compress_page_complete(m, pager, compressed_count_delta, retval);
 
 	return retval;
 }
 
+/*
+ * Batched version of vm_pageout_compress_page(), see vm_compressor_put_batch().
+ *
+ * Compresses m along with up to vm_compressor_batch_pages - 1 pages taken from
+ * the head of *local_q that are headed to the same filling segment.  Pages
+ * that were compressed are pushed onto *local_freeq.
+ *
+ * Returns the number of pages compressed, *processed is set to the number of
+ * pages taken.
+ */
+static int
+vm_pageout_compress_batch(struct pgo_iothread_state *cq, void **chead, vm_page_t m,
+    vm_page_t *local_q, vm_page_t *local_freeq, int *processed)
+{
+	vm_page_t                       pages[VM_COMPRESSOR_BATCH_MAX];
+	vm_compressor_batch_entry_t     entries[VM_COMPRESSOR_BATCH_MAX];
+	bool                            donate = (chead != &cq->current_regular_swapout_chead);
+	uint32_t                        count = 0;
+	int                             ntaken = 0;
+	int                             ncompressed = 0;
+
+	while (true) {
+		memory_object_t pager;
+
+		ntaken++;
+		if (vm_pageout_compress_page_prepare(m, &pager) == KERN_SUCCESS) {
+			vm_object_t object = VM_PAGE_OBJECT(m);
+
+			entries[count] = (vm_compressor_batch_entry_t){
+				.vcb_pager = pager,
+				.vcb_offset = m->vmp_offset + object->paging_offset,
+				.vcb_ppnum = VM_PAGE_GET_PHYS_PAGE(m),
+				.vcb_flags = vm_pageout_compress_page_flags(m),
+			};
+			pages[count++] = m;
+		}
+
+		m = *local_q;
+		if (count >= vm_pageout_state.vm_compressor_batch_pages || m == NULL ||
+		    (m->vmp_on_specialq == VM_PAGE_SPECIAL_Q_DONATE) != donate) {
+			break;
+		}
+		*local_q = m->vmp_snext;
+		m->vmp_snext = NULL;
+		if (donate) {
+			m->vmp_on_specialq = VM_PAGE_SPECIAL_Q_EMPTY;
+		}
+	}
+
+	if (count) {
+		vm_compressor_pager_put_batch(entries, count, chead, cq->scratch_buf, cq->staging_buf);
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		m = pages[i];
+		vm_pageout_compress_page_complete(m, entries[i].vcb_pager,
+		    entries[i].vcb_compressed_count_delta, entries[i].vcb_kr);
+
+		if (entries[i].vcb_kr == KERN_SUCCESS) {
+			m->vmp_snext = *local_freeq;
+			*local_freeq = m;
+			ncompressed++;
+		}
+	}
+
+	*processed = ntaken;
+	return ncompressed;
+}
+
 
 static void
 vm_pageout_adjust_eq_iothrottle(struct pgo_iothread_state *ethr, boolean_t req_lowpriority)
@@ -5299,6 +5745,7 @@ vm_pageout(void)
 	ethr->current_regular_swapout_chead = NULL;
 	ethr->current_late_swapout_chead = NULL;
 	ethr->scratch_buf = NULL;
+	ethr->staging_buf = NULL;
 #if DEVELOPMENT || DEBUG
 	ethr->benchmark_q = NULL;
 #endif /* DEVELOPMENT || DEBUG */
@@ -5397,6 +5844,7 @@ vm_pageout_internal_start(void)
 	kern_return_t   result = KERN_SUCCESS;
 	host_basic_info_data_t hinfo;
 	vm_offset_t     buf, bufsize;
+	vm_offset_t     staging = 0, stagingsize = 0;
 
 	assert(VM_CONFIG_COMPRESSOR_IS_PRESENT);
 
@@ -5420,8 +5868,22 @@ vm_pageout_internal_start(void)
 		vm_pageout_state.vm_compressor_thread_count = 2;
 	}
 #endif
-	PE_parse_boot_argn("vmcomp_threads", &vm_pageout_state.vm_compressor_thread_count,
-	    sizeof(vm_pageout_state.vm_compressor_thread_count));
+	PE_parse_boot_argn("vmcomp_batch", &vm_pageout_state.vm_compressor_batch_pages,
+	    sizeof(vm_pageout_state.vm_compressor_batch_pages));
+	if (vm_pageout_state.vm_compressor_batch_pages > VM_COMPRESSOR_BATCH_MAX) {
+		vm_pageout_state.vm_compressor_batch_pages = VM_COMPRESSOR_BATCH_MAX;
+	}
+
+	if (!PE_parse_boot_argn("vmcomp_threads", &vm_pageout_state.vm_compressor_thread_count,
+	    sizeof(vm_pageout_state.vm_compressor_thread_count)) &&
+	    vm_pageout_state.vm_compressor_batch_pages > 1) {
+		/*
+		 * Batched compression doesn't serialize the compressor threads on
+		 * the segment locks, let the number of threads scale with the cores.
+		 */
+		vm_pageout_state.vm_compressor_thread_count =
+		    MAX(vm_pageout_state.vm_compressor_thread_count, (int)hinfo.max_cpus / 4);
+	}
 
 	/* did we get from the bootargs an unreasonable number? */
 	if (vm_pageout_state.vm_compressor_thread_count >= hinfo.max_cpus) {
@@ -5452,6 +5914,16 @@ vm_pageout_internal_start(void)
 	    KMA_DATA | KMA_NOFAIL | KMA_KOBJECT | KMA_PERMANENT,
 	    VM_KERN_MEMORY_COMPRESSOR);
 
+	if (vm_pageout_state.vm_compressor_batch_pages > 1) {
+		/* one extra page since codecs may write past their budget */
+		stagingsize = ptoa(vm_pageout_state.vm_compressor_batch_pages + 1);
+
+		kmem_alloc(kernel_map, &staging,
+		    stagingsize * vm_pageout_state.vm_compressor_thread_count,
+		    KMA_DATA | KMA_NOFAIL | KMA_KOBJECT | KMA_PERMANENT,
+		    VM_KERN_MEMORY_COMPRESSOR);
+	}
+
 	for (int i = 0; i < vm_pageout_state.vm_compressor_thread_count; i++) {
 		struct pgo_iothread_state *iq = &pgo_iothread_internal_state[i];
 		iq->id = i;
@@ -5460,6 +5932,7 @@ vm_pageout_internal_start(void)
 		iq->current_regular_swapout_chead = NULL;
 		iq->current_late_swapout_chead = NULL;
 		iq->scratch_buf = (char *)(buf + i * bufsize);
+		iq->staging_buf = staging ? (char *)(staging + i * stagingsize) : NULL;
 #if DEVELOPMENT || DEBUG
 		iq->benchmark_q = &vm_pageout_queue_benchmark;
 #endif /* DEVELOPMENT || DEBUG */
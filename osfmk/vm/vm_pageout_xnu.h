@@ -293,6 +293,7 @@ struct vm_pageout_state {
 	boolean_t vm_pressure_changed;
 	boolean_t vm_restricted_to_single_processor;
 	int vm_compressor_thread_count;
+	uint32_t vm_compressor_batch_pages;     /* pages per vm_compressor_put_batch(), 0 or 1 when off */
 
 	unsigned int vm_page_speculative_q_age_ms;
 	unsigned int vm_page_speculative_percentage;
@@ -373,6 +374,39 @@ struct vm_pageout_vminfo {
 
 extern struct vm_pageout_vminfo vm_pageout_vminfo;
 
+/*
+ * Snapshot of the multi-generational LRU state exported by
+ * sysctl vm.mglru_stats, see vm_page_mglru_get_stats().
+ */
+#define VM_PAGE_MGLRU_STATS_GENS        4
+
+struct vm_page_mglru_gen_info {
+	uint64_t        vmgi_seq;
+	uint64_t        vmgi_age_ns;            /* since the generation was opened */
+	uint32_t        vmgi_nr_anon;
+	uint32_t        vmgi_nr_file;
+	uint64_t        vmgi_promoted;
+	uint64_t        vmgi_aged;
+	uint64_t        vmgi_deactivated;
+	uint64_t        vmgi_scanned;           /* by vm_pageout_scan, once inactive */
+	uint64_t        vmgi_reclaimed;
+};
+
+struct vm_page_mglru_stats {
+	uint64_t        vms_evicted_anon;       /* per generation, decayed */
+	uint64_t        vms_evicted_file;
+	uint64_t        vms_refaulted_anon;
+	uint64_t        vms_refaulted_file;
+	int32_t         vms_reclaim_bias;       /* 0: anonymous, 1: file, -1: none */
+	uint32_t        vms_nr_gens;            /* 0 when disabled */
+	uint64_t        vms_scanned;            /* by vm_pageout_scan, charged to a generation or not */
+	uint64_t        vms_reclaimed;
+	struct vm_page_mglru_gen_info vms_total;
+	struct vm_page_mglru_gen_info vms_gens[VM_PAGE_MGLRU_STATS_GENS]; /* oldest first */
+};
+
+extern void vm_page_mglru_get_stats(struct vm_page_mglru_stats *stats);
+
 extern void vm_swapout_thread(void);
 
 #if DEVELOPMENT || DEBUG
@@ -467,6 +501,7 @@ struct pgo_iothread_state {
 	void                    *current_regular_swapout_chead;
 	void                    *current_late_swapout_chead;
 	char                    *scratch_buf;
+	char                    *staging_buf;       // batched compression output, see vm_compressor_put_batch()
 	int                     id;
 	thread_t                pgo_iothread; // holds a +1 ref
 	sched_cond_atomic_t     pgo_wakeup;
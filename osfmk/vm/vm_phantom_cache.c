@@ -26,6 +26,8 @@
  * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
  */
 
+#include <kern/task.h>
+
 #include <vm/vm_page_internal.h>
 #include <vm/vm_object_internal.h>
 #include <vm/vm_kern_xnu.h>
@@ -65,6 +67,19 @@ uint32_t        sample_period_ghost_added_count_ssd = 0;
 uint32_t        sample_period_ghost_found_count = 0;
 uint32_t        sample_period_ghost_found_count_ssd = 0;
 
+/*
+ * Refault distance: vm_phantom_cache_clock counts the pages added to
+ * the phantom cache, i.e. the file pages evicted, and each ghost keeps
+ * its value at the last eviction into it.  On refault, the pages
+ * evicted since tell how much bigger the inactive queues would have
+ * needed to be for the page to still be resident: if that fits within
+ * the active queue, the page is part of the working set and the page-in
+ * activates it directly rather than letting it age through the inactive
+ * queues again.
+ */
+uint32_t        vm_phantom_cache_clock = 0;
+boolean_t       phantom_cache_refault_activate = TRUE;
+
 uint32_t        vm_phantom_object_id = 1;
 #define         VM_PHANTOM_OBJECT_ID_AFTER_WRAP 1000000
 
@@ -100,6 +115,7 @@ struct phantom_cache_stats {
 	uint32_t        pcs_lookup_page_not_in_entry;
 
 	uint32_t        pcs_updated_phantom_state;
+	uint32_t        pcs_refault_activated;
 } phantom_cache_stats;
 
 
@@ -265,6 +281,7 @@ vm_phantom_cache_add_ghost(vm_page_t m)
 	vm_phantom_cache_hash[ghost_hash_index] = ghost_index;
 
 done:
+	vpce->g_evicted = vm_phantom_cache_clock++;
 	vm_pageout_vminfo.vm_phantom_cache_added_ghost++;
 
 	if (object->phantom_isssd) {
@@ -319,12 +336,21 @@ vm_phantom_cache_lookup_ghost(vm_page_t m, uint32_t pg_mask)
 
 
 
-void
-vm_phantom_cache_update(vm_page_t m)
+/*
+ * Returns TRUE when the refault distance of the page shows it belongs
+ * to the working set, and it should be activated.  `may_activate' is
+ * FALSE when the caller asked for the page to be put on the inactive
+ * queue, which then wins.
+ */
+boolean_t
+vm_phantom_cache_update(vm_page_t m, boolean_t may_activate)
 {
 	int             pg_mask;
 	vm_ghost_t      vpce;
 	vm_object_t     object;
+	task_t          task;
+	uint32_t        distance;
+	boolean_t       activate = FALSE;
 
 	object = VM_PAGE_OBJECT(m);
 
@@ -332,7 +358,7 @@ vm_phantom_cache_update(vm_page_t m)
 	vm_object_lock_assert_exclusive(object);
 
 	if (vm_phantom_cache_num_entries == 0) {
-		return;
+		return FALSE;
 	}
 
 	pg_mask = pg_masks[(m->vmp_offset >> PAGE_SHIFT) & VM_GHOST_PAGE_MASK];
@@ -340,6 +366,29 @@ vm_phantom_cache_update(vm_page_t m)
 	if ((vpce = vm_phantom_cache_lookup_ghost(m, pg_mask))) {
 		vpce->g_pages_held &= ~pg_mask;
 
+		/*
+		 * g_evicted is shared by the pages of the entry, so this
+		 * underestimates the distance of all but the last evicted,
+		 * by no more than the pages evicted in between.
+		 */
+		distance = vm_phantom_cache_clock - vpce->g_evicted;
+
+		if (may_activate && phantom_cache_refault_activate &&
+		    distance <= vm_page_active_count) {
+			phantom_cache_stats.pcs_refault_activated++;
+			activate = TRUE;
+		}
+
+		/*
+		 * charge the task committing the page-in, which is
+		 * the faulting one unless the read was asynchronous
+		 */
+		task = current_task();
+		counter_inc(&task->refaults);
+		if (activate) {
+			counter_inc(&task->refaults_activated);
+		}
+
 		phantom_cache_stats.pcs_updated_phantom_state++;
 		vm_pageout_vminfo.vm_phantom_cache_found_ghost++;
 
@@ -349,6 +398,8 @@ vm_phantom_cache_update(vm_page_t m)
 			OSAddAtomic(1, &sample_period_ghost_found_count);
 		}
 	}
+
+	return activate;
 }
 
 
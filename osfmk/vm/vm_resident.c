@@ -3403,10 +3403,21 @@ vm_page_rename(
 		}
 	}
 
+	if ((internal_to_external || external_to_internal) &&
+	    mem->vmp_q_state == VM_PAGE_ON_ACTIVE_Q) {
+		/* the generation counts are split between anon and file */
+		vm_page_mglru_del(mem, m_object->internal);
+	}
+
 	tag = m_object->wire_tag;
 	vm_page_remove(mem, TRUE);
 	vm_page_insert_internal(mem, new_object, new_offset, tag, TRUE, TRUE, FALSE, FALSE, NULL);
 
+	if ((internal_to_external || external_to_internal) &&
+	    mem->vmp_q_state == VM_PAGE_ON_ACTIVE_Q) {
+		vm_page_mglru_add(mem, new_object->internal, false);
+	}
+
 	if (internal_to_external) {
 		vm_page_pageable_internal_count--;
 		vm_page_pageable_external_count++;
@@ -5841,6 +5852,7 @@ vm_page_reactivate_all_throttled(void)
 			}
 
 			m->vmp_q_state = VM_PAGE_ON_ACTIVE_Q;
+			vm_page_mglru_add(m, m_object->internal, true);
 			VM_PAGE_CHECK(m);
 			vm_page_add_to_specialq(m, FALSE);
 		}
@@ -5932,6 +5944,7 @@ vm_page_reactivate_local(uint32_t lid, boolean_t force, boolean_t nolocks)
 
 			m->vmp_local_id = 0;
 			m->vmp_q_state = VM_PAGE_ON_ACTIVE_Q;
+			vm_page_mglru_add(m, VM_PAGE_OBJECT(m)->internal, true);
 			VM_PAGE_CHECK(m);
 			vm_page_add_to_specialq(m, FALSE);
 			count++;
@@ -7414,7 +7427,13 @@ vm_page_do_delayed_work(
 		}
 #if CONFIG_PHANTOM_CACHE
 		if (dwp->dw_mask & DW_vm_phantom_cache_update) {
-			vm_phantom_cache_update(m);
+			if (vm_phantom_cache_update(m,
+			    (dwp->dw_mask & DW_vm_phantom_cache_activate) != 0) &&
+			    !(dwp->dw_mask & DW_vm_page_free)) {
+				/* refaulted from the working set */
+				dwp->dw_mask &= ~(DW_vm_page_deactivate_internal | DW_vm_page_speculate);
+				dwp->dw_mask |= DW_vm_page_activate;
+			}
 		}
 #endif
 		if (dwp->dw_mask & DW_vm_page_wire) {
@@ -7938,6 +7957,7 @@ hibernate_flush_queue(vm_page_queue_head_t *q, int qcount)
 reenter_pg_on_q:
 		vm_page_queue_remove(q, m, vmp_pageq);
 		vm_page_queue_enter(q, m, vmp_pageq);
+		vm_page_mglru_requeue(m);
 
 		hibernate_stats.hibernate_reentered_on_q++;
 next_pg:
@@ -9457,7 +9477,8 @@ vm_page_buckets_check(void)
  * vm_page_queue_lock to be held, and we already own it.
  *
  * this is why its safe to utilze the wire_count field in the vm_page_t as the local_id...
- * 'wired' and local are ALWAYS mutually exclusive conditions.
+ * 'wired' and local are ALWAYS mutually exclusive conditions.  the same goes for
+ * the mglru_stamp of inactive pages, which is cleared here as they leave their queue.
  */
 
 void
@@ -9540,6 +9561,7 @@ vm_page_queues_remove(vm_page_t mem, boolean_t remove_from_specialq)
 	{
 		vm_page_queue_remove(&vm_page_queue_active, mem, vmp_pageq);
 		vm_page_active_count--;
+		vm_page_mglru_del(mem, m_object->internal);
 		break;
 	}
 
@@ -9549,6 +9571,7 @@ vm_page_queues_remove(vm_page_t mem, boolean_t remove_from_specialq)
 
 		vm_page_inactive_count--;
 		vm_page_queue_remove(&vm_page_queue_anonymous, mem, vmp_pageq);
+		mem->vmp_mglru_stamp = 0;
 		vm_page_anonymous_count--;
 
 		vm_purgeable_q_advance_all();
@@ -9562,6 +9585,7 @@ vm_page_queues_remove(vm_page_t mem, boolean_t remove_from_specialq)
 
 		vm_page_inactive_count--;
 		vm_page_queue_remove(&vm_page_queue_inactive, mem, vmp_pageq);
+		mem->vmp_mglru_stamp = 0;
 		vm_purgeable_q_advance_all();
 		vm_page_balance_inactive(3);
 		break;
@@ -9573,6 +9597,7 @@ vm_page_queues_remove(vm_page_t mem, boolean_t remove_from_specialq)
 
 		vm_page_inactive_count--;
 		vm_page_queue_remove(&vm_page_queue_cleaned, mem, vmp_pageq);
+		mem->vmp_mglru_stamp = 0;
 		vm_page_cleaned_count--;
 		vm_page_balance_inactive(3);
 		break;
@@ -9734,6 +9759,7 @@ vm_page_enqueue_active(vm_page_t mem, boolean_t first)
 		vm_page_queue_enter(&vm_page_queue_active, mem, vmp_pageq);
 	}
 	vm_page_active_count++;
+	vm_page_mglru_add(mem, m_object->internal, first);
 
 	if (m_object->internal) {
 		vm_page_pageable_internal_count++;
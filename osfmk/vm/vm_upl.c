@@ -1024,6 +1024,10 @@ process_upl_to_commit:
 #if CONFIG_PHANTOM_CACHE
 				if (m->vmp_absent && !m_object->internal) {
 					dwp->dw_mask |= DW_vm_phantom_cache_update;
+					if (!(flags & UPL_COMMIT_INACTIVATE)) {
+						/* B_AGE and nocache reads stay inactive */
+						dwp->dw_mask |= DW_vm_phantom_cache_activate;
+					}
 				}
 #endif
 				m->vmp_absent = FALSE;
@@ -1252,6 +1256,15 @@ commit_next_page:
 						token_new_pagecount += local_queue_count;
 					} else {
 						vm_page_active_count += local_queue_count;
+
+						if (vm_page_mglru_enabled) {
+							vm_page_t gen_page = first_local;
+
+							for (int i = 0; i < local_queue_count; i++) {
+								vm_page_mglru_add(gen_page, shadow_object->internal, true);
+								gen_page = (vm_page_t)vm_page_queue_next(&gen_page->vmp_pageq);
+							}
+						}
 					}
 
 					if (shadow_object->internal) {
@@ -0,0 +1,442 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed forms of proprietary software, or to circumvent,
+ * violate, or enable the circumvention or violation of, any terms of an
+ * Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Runs the classic and the pre-decoded BPF interpreters from
+ * bsd/net/bpf_filter.c over the same packets, checks that they agree and
+ * measures them.  Set BPF_FILTER_BENCH_PCAP to an Ethernet pcap file to
+ * benchmark a captured corpus instead of the synthetic one.
+ */
+
+#include <arpa/inet.h>
+#include <libkern/OSByteOrder.h>
+#include <ptrcheck.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <net/bpf.h>
+
+#include <darwintest.h>
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.net"),
+    T_META_RADAR_COMPONENT_NAME("xnu"),
+    T_META_RADAR_COMPONENT_VERSION("networking"),
+    T_META_RUN_CONCURRENTLY(true));
+
+/* The kernel gets these from the KERNEL part of <net/bpf.h> */
+#define EXTRACT_SHORT(p) \
+	((u_int16_t)\
+	        ((u_int16_t)*((u_char *)p+0)<<8|\
+	         (u_int16_t)*((u_char *)p+1)<<0))
+#define EXTRACT_LONG(p) \
+	        ((u_int32_t)*((u_char *)p+0)<<24|\
+	         (u_int32_t)*((u_char *)p+1)<<16|\
+	         (u_int32_t)*((u_char *)p+2)<<8|\
+	         (u_int32_t)*((u_char *)p+3)<<0)
+
+struct bpf_dprog;
+u_int bpf_filter(const struct bpf_insn *pc, u_int pc_len, u_char *p,
+    u_int wirelen, u_int buflen);
+u_int bpf_filter_decoded(const struct bpf_dprog *dp, u_char *p,
+    u_int wirelen, u_int buflen);
+
+#include "../bsd/net/bpf_filter.c"
+
+struct bench_filter {
+	const char              *bf_name;
+	const struct bpf_insn   *bf_insns;
+	u_int                   bf_len;
+};
+
+/* tcpdump -d 'ip' */
+static const struct bpf_insn filter_ip[] = {
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x0800, 0, 1),
+	BPF_STMT(BPF_RET | BPF_K, 262144),
+	BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/* tcpdump -d 'tcp port 80' */
+static const struct bpf_insn filter_tcp_port[] = {
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x86dd, 0, 6),
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 15),
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 54),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 80, 12, 0),
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 56),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 80, 10, 11),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x0800, 0, 10),
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 6, 0, 8),
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 20),
+	BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 6, 0),
+	BPF_STMT(BPF_LDX | BPF_MSH | BPF_B, 14),
+	BPF_STMT(BPF_LD | BPF_H | BPF_IND, 14),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 80, 2, 0),
+	BPF_STMT(BPF_LD | BPF_H | BPF_IND, 16),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 80, 0, 1),
+	BPF_STMT(BPF_RET | BPF_K, 262144),
+	BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/* tcpdump -d 'src net 10.0.0.0/8 and udp' */
+static const struct bpf_insn filter_net_udp[] = {
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x0800, 0, 6),
+	BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 26),
+	BPF_STMT(BPF_ALU | BPF_AND | BPF_K, 0xff000000),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x0a000000, 0, 3),
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 23),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 17, 0, 1),
+	BPF_STMT(BPF_RET | BPF_K, 262144),
+	BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/* Truncate to the IP payload length, through scratch memory */
+static const struct bpf_insn filter_snap_ip_len[] = {
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 0x0800, 0, 6),
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 16),
+	BPF_STMT(BPF_ST, 3),
+	BPF_STMT(BPF_LDX | BPF_W | BPF_LEN, 0),
+	BPF_STMT(BPF_LD | BPF_MEM, 3),
+	BPF_JUMP(BPF_JMP | BPF_JGT | BPF_X, 0, 1, 0),
+	BPF_STMT(BPF_RET | BPF_A, 0),
+	BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+/* A jump that lands on the compare half of a fused load+compare */
+static const struct bpf_insn filter_jump_into_fused[] = {
+	BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 2),
+	BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, 100, 1, 0),
+	BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 0),
+	BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, 7, 0, 1),
+	BPF_STMT(BPF_RET | BPF_K, 1),
+	BPF_STMT(BPF_RET | BPF_K, 0),
+};
+
+#define BENCH_FILTER(f) { #f, f, sizeof(f) / sizeof(f[0]) }
+
+static const struct bench_filter bench_filters[] = {
+	BENCH_FILTER(filter_ip),
+	BENCH_FILTER(filter_tcp_port),
+	BENCH_FILTER(filter_net_udp),
+	BENCH_FILTER(filter_snap_ip_len),
+	BENCH_FILTER(filter_jump_into_fused),
+};
+
+#define BENCH_NFILTERS  (sizeof(bench_filters) / sizeof(bench_filters[0]))
+
+struct bench_pkt {
+	u_char  *bp_data;
+	u_int   bp_caplen;
+	u_int   bp_wirelen;
+};
+
+struct bench_corpus {
+	struct bench_pkt        *bc_pkts;
+	u_int                   bc_count;
+};
+
+static struct bpf_dprog *
+bench_decode(const struct bench_filter *bf)
+{
+	struct bpf_dprog *dp;
+
+	dp = calloc(1, sizeof(*dp) + bf->bf_len * sizeof(struct bpf_dinsn));
+	T_QUIET; T_ASSERT_NOTNULL(dp, "decoded program");
+	dp->dp_len = bf->bf_len;
+	bpf_decode_insns(bf->bf_insns, bf->bf_len, dp->dp_insns);
+	return dp;
+}
+
+static void
+corpus_add(struct bench_corpus *bc, const u_char *data, u_int caplen, u_int wirelen)
+{
+	struct bench_pkt *pkt;
+
+	bc->bc_pkts = reallocf(bc->bc_pkts, (bc->bc_count + 1) * sizeof(*pkt));
+	T_QUIET; T_ASSERT_NOTNULL(bc->bc_pkts, "corpus");
+	pkt = &bc->bc_pkts[bc->bc_count++];
+	pkt->bp_data = malloc(caplen);
+	T_QUIET; T_ASSERT_NOTNULL(pkt->bp_data, "packet");
+	memcpy(pkt->bp_data, data, caplen);
+	pkt->bp_caplen = caplen;
+	pkt->bp_wirelen = wirelen;
+}
+
+static void
+corpus_free(struct bench_corpus *bc)
+{
+	for (u_int i = 0; i < bc->bc_count; i++) {
+		free(bc->bc_pkts[i].bp_data);
+	}
+	free(bc->bc_pkts);
+	bc->bc_pkts = NULL;
+	bc->bc_count = 0;
+}
+
+#define PCAP_MAGIC              0xa1b2c3d4
+#define PCAP_MAGIC_NSEC         0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET  1
+
+struct pcap_file_hdr {
+	uint32_t        magic;
+	uint16_t        version_major;
+	uint16_t        version_minor;
+	int32_t         thiszone;
+	uint32_t        sigfigs;
+	uint32_t        snaplen;
+	uint32_t        linktype;
+};
+
+struct pcap_rec_hdr {
+	uint32_t        ts_sec;
+	uint32_t        ts_frac;
+	uint32_t        caplen;
+	uint32_t        len;
+};
+
+static bool
+corpus_load_pcap(struct bench_corpus *bc, const char *path)
+{
+	struct pcap_file_hdr fh;
+	struct pcap_rec_hdr rh;
+	u_char *buf;
+	bool swap;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		T_LOG("can't open %s", path);
+		return false;
+	}
+	if (fread(&fh, sizeof(fh), 1, f) != 1) {
+		fclose(f);
+		return false;
+	}
+	swap = (fh.magic == OSSwapInt32(PCAP_MAGIC) ||
+	    fh.magic == OSSwapInt32(PCAP_MAGIC_NSEC));
+	if (!swap && fh.magic != PCAP_MAGIC && fh.magic != PCAP_MAGIC_NSEC) {
+		T_LOG("%s is not a pcap file", path);
+		fclose(f);
+		return false;
+	}
+	if ((swap ? OSSwapInt32(fh.linktype) : fh.linktype) != PCAP_LINKTYPE_ETHERNET) {
+		T_LOG("%s is not an Ethernet capture", path);
+		fclose(f);
+		return false;
+	}
+
+	buf = malloc(BPF_MAXBUFSIZE);
+	T_QUIET; T_ASSERT_NOTNULL(buf, "pcap buffer");
+	while (fread(&rh, sizeof(rh), 1, f) == 1) {
+		uint32_t caplen = swap ? OSSwapInt32(rh.caplen) : rh.caplen;
+		uint32_t len = swap ? OSSwapInt32(rh.len) : rh.len;
+
+		if (caplen > BPF_MAXBUFSIZE || fread(buf, caplen, 1, f) != 1) {
+			break;
+		}
+		corpus_add(bc, buf, caplen, len);
+	}
+	free(buf);
+	fclose(f);
+	return bc->bc_count != 0;
+}
+
+#define SYNTH_PKTS      4096
+
+/*
+ * A mix of Ethernet frames: IPv4 and IPv6 TCP and UDP with a few well
+ * known ports, ARP, and some frames truncated by a short snap length.
+ */
+static void
+corpus_synthesize(struct bench_corpus *bc)
+{
+	u_char pkt[1514];
+
+	for (u_int i = 0; i < SYNTH_PKTS; i++) {
+		u_int len = 60 + (u_int)(rand() % (sizeof(pkt) - 60));
+		u_int caplen = len;
+		u_int l4 = 0;
+		uint16_t sport = (uint16_t)(1024 + rand() % 60000);
+		uint16_t dport = (rand() % 4 == 0) ? 80 : (rand() % 3 == 0) ? 53 : 443;
+		uint8_t proto = (rand() % 3 == 0) ? IPPROTO_UDP : IPPROTO_TCP;
+
+		memset(pkt, 0, sizeof(pkt));
+		switch (rand() % 8) {
+		case 0:
+			pkt[12] = 0x08;
+			pkt[13] = 0x06;
+			break;
+		case 1:
+		case 2:
+			pkt[12] = 0x86;
+			pkt[13] = 0xdd;
+			pkt[14] = 0x60;
+			pkt[20] = proto;
+			l4 = 54;
+			break;
+		default:
+			pkt[12] = 0x08;
+			pkt[13] = 0x00;
+			pkt[14] = 0x45;
+			pkt[16] = (uint8_t)((len - 14) >> 8);
+			pkt[17] = (uint8_t)(len - 14);
+			pkt[20] = (rand() % 16 == 0) ? 0x20 : 0;
+			pkt[23] = proto;
+			pkt[26] = (rand() % 2 == 0) ? 10 : 192;
+			pkt[27] = (uint8_t)rand();
+			l4 = 34;
+			break;
+		}
+		if (l4 != 0) {
+			pkt[l4] = (uint8_t)(sport >> 8);
+			pkt[l4 + 1] = (uint8_t)sport;
+			pkt[l4 + 2] = (uint8_t)(dport >> 8);
+			pkt[l4 + 3] = (uint8_t)dport;
+		}
+		if (rand() % 8 == 0) {
+			caplen = MIN(len, (u_int)(rand() % 64));
+		}
+		corpus_add(bc, pkt, caplen, len);
+	}
+}
+
+T_DECL(bpf_filter_decoded_matches,
+    "The pre-decoded interpreter returns the same result as bpf_filter() on random packets")
+{
+	static const uint8_t interesting[] = {0, 6, 7, 8, 17, 80, 0x86, 0xdd};
+	u_char pkt[128];
+
+	srand(8311);
+	for (u_int f = 0; f < BENCH_NFILTERS; f++) {
+		const struct bench_filter *bf = &bench_filters[f];
+		struct bpf_dprog *dp = bench_decode(bf);
+
+		for (int i = 0; i < 100000; i++) {
+			u_int caplen = (u_int)(rand() % sizeof(pkt));
+
+			for (u_int j = 0; j < caplen; j++) {
+				/* Bias towards the values the filters compare against */
+				pkt[j] = (rand() % 2) ? (uint8_t)rand() : interesting[rand() % sizeof(interesting)];
+			}
+			u_int expected = bpf_filter(bf->bf_insns, bf->bf_len, pkt, caplen + 20, caplen);
+			u_int got = bpf_filter_decoded(dp, pkt, caplen + 20, caplen);
+			T_QUIET; T_ASSERT_EQ(got, expected, "%s on a %u byte packet", bf->bf_name, caplen);
+		}
+		free(dp);
+		T_PASS("%s", bf->bf_name);
+	}
+}
+
+T_DECL(bpf_filter_decoded_rejects_bad_programs,
+    "Programs that would run off the end decode to a reject")
+{
+	static const struct bpf_insn no_ret[] = {
+		BPF_STMT(BPF_LD | BPF_IMM, 1),
+	};
+	static const struct bpf_insn far_jump[] = {
+		BPF_STMT(BPF_JMP | BPF_JA, 0xffffffff),
+		BPF_STMT(BPF_RET | BPF_K, 1),
+	};
+	static const struct bpf_insn bad_mem[] = {
+		BPF_STMT(BPF_LD | BPF_MEM, BPF_MEMWORDS),
+		BPF_STMT(BPF_RET | BPF_K, 1),
+	};
+	static const struct bench_filter bad[] = {
+		BENCH_FILTER(no_ret),
+		BENCH_FILTER(far_jump),
+		BENCH_FILTER(bad_mem),
+	};
+	u_char pkt[64] = {};
+
+	for (u_int f = 0; f < sizeof(bad) / sizeof(bad[0]); f++) {
+		struct bpf_dprog *dp = bench_decode(&bad[f]);
+
+		T_EXPECT_EQ(bpf_filter_decoded(dp, pkt, sizeof(pkt), sizeof(pkt)), 0U, "%s", bad[f].bf_name);
+		free(dp);
+	}
+}
+
+#define BENCH_ROUNDS    200
+
+T_DECL(bpf_filter_bench,
+    "Measure bpf_filter() against the pre-decoded interpreter over a packet corpus")
+{
+	struct bench_corpus bc = {};
+	const char *path = getenv("BPF_FILTER_BENCH_PCAP");
+
+	srand(1597);
+	if (path == NULL || !corpus_load_pcap(&bc, path)) {
+		corpus_synthesize(&bc);
+	}
+	T_LOG("corpus of %u packets", bc.bc_count);
+
+	for (u_int f = 0; f < BENCH_NFILTERS; f++) {
+		const struct bench_filter *bf = &bench_filters[f];
+		struct bpf_dprog *dp = bench_decode(bf);
+		uint64_t classic_ns, decoded_ns, start;
+		u_int classic_hits = 0, decoded_hits = 0;
+
+		start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+		for (int r = 0; r < BENCH_ROUNDS; r++) {
+			for (u_int i = 0; i < bc.bc_count; i++) {
+				struct bench_pkt *pkt = &bc.bc_pkts[i];
+
+				classic_hits += (bpf_filter(bf->bf_insns, bf->bf_len, pkt->bp_data,
+				    pkt->bp_wirelen, pkt->bp_caplen) != 0);
+			}
+		}
+		classic_ns = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+
+		start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+		for (int r = 0; r < BENCH_ROUNDS; r++) {
+			for (u_int i = 0; i < bc.bc_count; i++) {
+				struct bench_pkt *pkt = &bc.bc_pkts[i];
+
+				decoded_hits += (bpf_filter_decoded(dp, pkt->bp_data,
+				    pkt->bp_wirelen, pkt->bp_caplen) != 0);
+			}
+		}
+		decoded_ns = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+
+		T_EXPECT_EQ(decoded_hits, classic_hits, "%s: same matches", bf->bf_name);
+		T_LOG("%-24s classic %6.1f ns/pkt, decoded %6.1f ns/pkt, %u%% match",
+		    bf->bf_name,
+		    (double)classic_ns / ((double)BENCH_ROUNDS * bc.bc_count),
+		    (double)decoded_ns / ((double)BENCH_ROUNDS * bc.bc_count),
+		    bc.bc_count ? classic_hits / BENCH_ROUNDS * 100 / bc.bc_count : 0);
+		free(dp);
+	}
+	corpus_free(&bc);
+}
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2025 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+
+#include <darwintest.h>
+
+#include <sys/event.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#include <net/bpf.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bpflib.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_ASROOT(true),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false));
+
+#define RING_NBLOCKS    8
+#define RING_NPACKETS   64
+#define RING_PORT       23456
+
+static int
+bpf_set_ring(int fd, uint32_t blocksize, uint32_t nblocks, struct bpf_ring_req *req)
+{
+	memset(req, 0, sizeof(*req));
+	req->br_blocksize = blocksize;
+	req->br_nblocks = nblocks;
+	return ioctl(fd, BIOCSETRING, req);
+}
+
+T_DECL(bpf_ring_invalid, "test BIOCSETRING argument checking", T_META_TAG_VM_PREFERRED)
+{
+	struct bpf_ring_req req;
+	uint32_t page_size = (uint32_t)getpagesize();
+	int fd = bpf_new();
+	T_ASSERT_POSIX_SUCCESS(fd, "bpf open fd %d", fd);
+
+	T_EXPECT_POSIX_FAILURE(bpf_set_ring(fd, page_size + 1, RING_NBLOCKS, &req), EINVAL,
+	    "block size not a page multiple");
+	T_EXPECT_POSIX_FAILURE(bpf_set_ring(fd, page_size, 1, &req), EINVAL,
+	    "single block");
+	T_EXPECT_POSIX_FAILURE(bpf_set_ring(fd, page_size, BPF_RING_MAXBLOCKS + 1, &req), EINVAL,
+	    "too many blocks");
+
+	T_ASSERT_POSIX_SUCCESS(bpf_set_ring(fd, page_size, RING_NBLOCKS, &req), "BIOCSETRING");
+	T_ASSERT_EQ(req.br_size, (uint64_t)page_size * RING_NBLOCKS, "ring size");
+	T_ASSERT_NE(req.br_addr, 0ULL, "ring address");
+
+	T_EXPECT_POSIX_FAILURE(bpf_set_ring(fd, page_size, RING_NBLOCKS, &req), EINVAL,
+	    "ring already set up");
+	T_EXPECT_POSIX_FAILURE(bpf_set_blen(fd, 4096), EINVAL,
+	    "BIOCSBLEN with a ring");
+
+	T_ASSERT_POSIX_SUCCESS(bpf_setif(fd, "lo0"), "bpf set if lo0");
+	char buf[64];
+	T_EXPECT_POSIX_FAILURE(read(fd, buf, sizeof(buf)), EOPNOTSUPP, "read with a ring");
+
+	close(fd);
+}
+
+static void
+send_udp_packets(int count)
+{
+	struct sockaddr_in sin = {
+		.sin_len = sizeof(sin),
+		.sin_family = AF_INET,
+		.sin_port = htons(RING_PORT),
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	char payload[128];
+	int s = socket(AF_INET, SOCK_DGRAM, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(s, "socket");
+
+	memset(payload, 'r', sizeof(payload));
+	for (int i = 0; i < count; i++) {
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(sendto(s, payload, sizeof(payload), 0,
+		    (struct sockaddr *)&sin, sizeof(sin)), "sendto");
+	}
+	close(s);
+}
+
+T_DECL(bpf_ring_capture, "test capturing packets through the shared ring", T_META_TAG_VM_PREFERRED)
+{
+	struct bpf_ring_req req;
+	uint32_t page_size = (uint32_t)getpagesize();
+	uint32_t next = 0, next_seq = 0;
+	int count = 0;
+	int fd = bpf_new();
+	T_ASSERT_POSIX_SUCCESS(fd, "bpf open fd %d", fd);
+
+	T_ASSERT_POSIX_SUCCESS(bpf_set_ring(fd, page_size, RING_NBLOCKS, &req), "BIOCSETRING");
+	T_ASSERT_POSIX_SUCCESS(bpf_set_immediate(fd, 1), "bpf set immediate");
+	T_ASSERT_POSIX_SUCCESS(bpf_setif(fd, "lo0"), "bpf set if lo0");
+
+	int kq = kqueue();
+	T_ASSERT_POSIX_SUCCESS(kq, "kqueue");
+	struct kevent kev;
+	EV_SET(&kev, fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+	T_ASSERT_POSIX_SUCCESS(kevent(kq, &kev, 1, NULL, 0, NULL), "kevent EV_ADD");
+
+	send_udp_packets(RING_NPACKETS);
+
+	char *ring = (char *)(uintptr_t)req.br_addr;
+	struct timespec ts = { .tv_sec = 1, .tv_nsec = 0 };
+	while (count < RING_NPACKETS) {
+		int n = kevent(kq, NULL, 0, &kev, 1, &ts);
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "kevent");
+		if (n == 0) {
+			break;
+		}
+		T_QUIET; T_ASSERT_GT(kev.data, 0LL, "blocks ready");
+
+		for (;;) {
+			struct bpf_ring_block *brb =
+			    (struct bpf_ring_block *)(void *)(ring + (size_t)next * page_size);
+
+			if (__atomic_load_n(&brb->brb_status, __ATOMIC_ACQUIRE) != BPF_RING_USER) {
+				break;
+			}
+			T_QUIET; T_ASSERT_EQ(brb->brb_seq, next_seq, "block sequence");
+			T_QUIET; T_ASSERT_LE(brb->brb_len, page_size - (uint32_t)sizeof(*brb), "block length");
+
+			char *p = (char *)(brb + 1);
+			uint32_t records = 0;
+			while (p < (char *)(brb + 1) + brb->brb_len) {
+				struct bpf_hdr *hp = (struct bpf_hdr *)(void *)p;
+
+				T_QUIET; T_ASSERT_GT(hp->bh_caplen, 0U, "record caplen");
+				p += BPF_WORDALIGN(hp->bh_hdrlen + hp->bh_caplen);
+				records++;
+			}
+			T_QUIET; T_ASSERT_EQ(records, brb->brb_count, "records in block");
+			count += records;
+
+			__atomic_store_n(&brb->brb_status, BPF_RING_KERNEL, __ATOMIC_RELEASE);
+			next = (next + 1) % RING_NBLOCKS;
+			next_seq++;
+		}
+	}
+	T_LOG("%d packets in %u blocks", count, next_seq);
+	T_EXPECT_GE(count, RING_NPACKETS, "captured all packets");
+
+	close(kq);
+	close(fd);
+}
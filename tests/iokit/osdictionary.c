@@ -0,0 +1,53 @@
+#include <sys/sysctl.h>
+
+#include <darwintest.h>
+#include <darwintest_utils.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.iokit"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("IOKit"),
+	T_META_CHECK_LEAKS(false));
+
+static int64_t
+run_sysctl_test(const char *t, int64_t value)
+{
+	char name[1024];
+	int64_t result = 0;
+	size_t s = sizeof(value);
+	int rc;
+
+	snprintf(name, sizeof(name), "debug.test.%s", t);
+	rc = sysctlbyname(name, &result, &s, &value, s);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(rc, "sysctlbyname(%s)", t);
+	return result;
+}
+
+/*
+ * The kernel side checks lookups and iteration order after insertions,
+ * removals and growing, and logs per-operation insert and lookup times
+ * with and without the hash index for each size.
+ */
+T_DECL(osdictionary_hash_index,
+    "OSDictionary with kHashIndex behaves like a plain OSDictionary",
+    T_META_ASROOT(true),
+    T_META_TAG_VM_NOT_PREFERRED)
+{
+	for (int64_t size = 10; size <= 10000; size *= 10) {
+		T_EXPECT_EQ(1ll,
+		    run_sysctl_test("osdictionary_hash_index", size),
+		    "%lld keys", size);
+	}
+}
+
+T_DECL(osdictionary_hash_index_sorted,
+    "OSDictionary with kSort | kHashIndex behaves like one with kSort",
+    T_META_ASROOT(true),
+    T_META_TAG_VM_NOT_PREFERRED)
+{
+	for (int64_t size = 10; size <= 10000; size *= 10) {
+		T_EXPECT_EQ(1ll,
+		    run_sysctl_test("osdictionary_hash_index_sorted", size),
+		    "%lld keys", size);
+	}
+}
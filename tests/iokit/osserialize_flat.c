@@ -0,0 +1,234 @@
+#include <sys/sysctl.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <darwintest.h>
+#include <darwintest_utils.h>
+
+#include <libkern/OSSerializeFlat.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.iokit"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("IOKit"),
+	T_META_CHECK_LEAKS(false));
+
+static int64_t
+run_sysctl_test(const char *t, int64_t value)
+{
+	char name[1024];
+	int64_t result = 0;
+	size_t s = sizeof(value);
+	int rc;
+
+	snprintf(name, sizeof(name), "debug.test.%s", t);
+	rc = sysctlbyname(name, &result, &s, &value, s);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(rc, "sysctlbyname(%s)", t);
+	return result;
+}
+
+/*
+ * The kernel side logs the time and OSObjects spent looking up the IOClass
+ * of every registry entry with OSUnserializeXML and with the flat format,
+ * and checks that materializing the flat buffer gives back the same tree.
+ */
+T_DECL(osserialize_flat_bench,
+    "flat serialization of the IORegistry round trips",
+    T_META_ASROOT(true),
+    T_META_TAG_VM_NOT_PREFERRED)
+{
+	T_EXPECT_EQ(1ll, run_sysctl_test("osserialize_flat_bench", 0),
+	    "osserialize_flat_bench");
+}
+
+static size_t
+build_buffer(uint64_t *storage, size_t capacity,
+    const osflat_node_t *nodes, uint32_t node_count,
+    const uint32_t *edges, uint32_t edge_count,
+    const char *blob, uint32_t blob_size)
+{
+	osflat_header_t h = {
+		.osfh_magic       = kOSSerializeFlatMagic,
+		.osfh_version     = kOSSerializeFlatVersion,
+		.osfh_header_size = sizeof(h),
+		.osfh_root        = 0,
+		.osfh_node_offset = sizeof(h),
+		.osfh_node_count  = node_count,
+		.osfh_edge_offset = sizeof(h) + node_count * sizeof(nodes[0]),
+		.osfh_edge_count  = edge_count,
+		.osfh_blob_size   = blob_size,
+	};
+	char *p = (char *)storage;
+
+	h.osfh_blob_offset = h.osfh_edge_offset + edge_count * sizeof(edges[0]);
+	h.osfh_size = h.osfh_blob_offset + h.osfh_blob_size;
+	T_QUIET; T_ASSERT_LE((size_t)h.osfh_size, capacity, "buffer fits");
+
+	memcpy(p, &h, sizeof(h));
+	memcpy(p + h.osfh_node_offset, nodes, node_count * sizeof(nodes[0]));
+	memcpy(p + h.osfh_edge_offset, edges, edge_count * sizeof(edges[0]));
+	memcpy(p + h.osfh_blob_offset, blob, blob_size);
+	return h.osfh_size;
+}
+
+#define BUILD_BUFFER(storage, nodes, edges, blob) \
+	build_buffer(storage, sizeof(storage), nodes, \
+	    sizeof(nodes) / sizeof(nodes[0]), edges, \
+	    sizeof(edges) / sizeof(edges[0]), blob, sizeof(blob) - 1)
+
+/*
+ * { "IOClass" = "AppleFoo"; "count" = 42; "list" = (true, <010203>) }
+ */
+static size_t
+build_sample(uint64_t *storage, size_t capacity)
+{
+	static const char strings[] = "IOClass\0AppleFoo\0count\0list\0\0\0\0\0\1\2\3";
+	static const osflat_node_t nodes[] = {
+		{ .osfn_type = kOSFlatDictionary, .osfn_count = 3, .osfn_value = 0 },
+		{ .osfn_type = kOSFlatSymbol, .osfn_count = 7, .osfn_value = 0 },
+		{ .osfn_type = kOSFlatString, .osfn_count = 8, .osfn_value = 8 },
+		{ .osfn_type = kOSFlatSymbol, .osfn_count = 5, .osfn_value = 17 },
+		{ .osfn_type = kOSFlatNumber, .osfn_bits = 32, .osfn_value = 42 },
+		{ .osfn_type = kOSFlatSymbol, .osfn_count = 4, .osfn_value = 23 },
+		{ .osfn_type = kOSFlatArray, .osfn_count = 2, .osfn_value = 6 },
+		{ .osfn_type = kOSFlatBoolean, .osfn_bits = 1 },
+		{ .osfn_type = kOSFlatData, .osfn_count = 3, .osfn_value = 32 },
+	};
+	static const uint32_t edges[] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+	return build_buffer(storage, capacity, nodes, sizeof(nodes) / sizeof(nodes[0]),
+	           edges, sizeof(edges) / sizeof(edges[0]), strings, sizeof(strings) - 1);
+}
+
+static uint32_t
+walk(const osflat_view_t *v, uint32_t idx)
+{
+	const osflat_node_t *n = osflat_node(v, idx);
+	uint32_t count = 1;
+
+	switch (n->osfn_type) {
+	case kOSFlatSymbol:
+	case kOSFlatString:
+		T_QUIET; T_EXPECT_EQ(strlen(osflat_string(v, n)), (size_t)n->osfn_count, NULL);
+		break;
+	case kOSFlatDictionary:
+	case kOSFlatArray:
+	case kOSFlatSet:
+		for (uint64_t e = 0; e < osflat_edge_span(n); e++) {
+			count += walk(v, v->osfv_edges[n->osfn_value + e]);
+		}
+		break;
+	}
+	return count;
+}
+
+T_DECL(osserialize_flat_validate,
+    "flat buffers are walked in place and corrupt ones are rejected")
+{
+	uint64_t storage[64];
+	uint64_t mutated[64];
+	osflat_view_t view;
+	uint32_t value;
+	size_t size = build_sample(storage, sizeof(storage));
+	uint32_t rejected = 0;
+
+	T_ASSERT_TRUE(osflat_validate(storage, size, &view), "sample is valid");
+	T_EXPECT_EQ(walk(&view, osflat_root(&view)), 9u, "walked every node");
+
+	T_ASSERT_TRUE(osflat_dict_lookup(&view, 0, "IOClass", &value), "IOClass");
+	T_EXPECT_EQ_STR(osflat_string(&view, osflat_node(&view, value)), "AppleFoo", NULL);
+	T_ASSERT_TRUE(osflat_dict_lookup(&view, 0, "count", &value), "count");
+	T_EXPECT_EQ(osflat_node(&view, value)->osfn_value, 42ull, NULL);
+	T_ASSERT_TRUE(osflat_dict_lookup(&view, 0, "list", &value), "list");
+	T_EXPECT_EQ(osflat_node(&view, osflat_array_get(&view, value, 1))->osfn_type,
+	    (uint8_t)kOSFlatData, NULL);
+	T_EXPECT_FALSE(osflat_dict_lookup(&view, 0, "missing", &value), "missing");
+
+	for (size_t len = 0; len < size; len++) {
+		T_QUIET; T_EXPECT_FALSE(osflat_validate(storage, len, &view),
+		    "truncated to %zu bytes", len);
+	}
+
+	/*
+	 * Corrupting any byte either gets rejected or leaves a buffer
+	 * that can still be walked without going out of bounds.
+	 */
+	for (size_t i = 0; i < size; i++) {
+		for (uint32_t bit = 0; bit < 8; bit++) {
+			memcpy(mutated, storage, size);
+			((uint8_t *)mutated)[i] ^= (uint8_t)(1u << bit);
+			if (!osflat_validate(mutated, size, &view)) {
+				rejected++;
+				continue;
+			}
+			T_QUIET; T_EXPECT_GT(walk(&view, osflat_root(&view)), 0u, NULL);
+		}
+	}
+	T_LOG("%u of %zu single bit corruptions rejected", rejected, size * 8);
+	T_EXPECT_GT(rejected, 0u, "corruptions are detected");
+}
+
+T_DECL(osserialize_flat_validate_tree,
+    "flat buffers whose collections don't form a tree are rejected")
+{
+	static const char blob[] = "";
+	uint64_t storage[32];
+	osflat_view_t view;
+	size_t size;
+
+	/* ((true, true), (true, true)): leaves can be shared */
+	static const osflat_node_t tree[] = {
+		{ .osfn_type = kOSFlatArray, .osfn_count = 2, .osfn_value = 0 },
+		{ .osfn_type = kOSFlatArray, .osfn_count = 2, .osfn_value = 2 },
+		{ .osfn_type = kOSFlatBoolean, .osfn_bits = 1 },
+		{ .osfn_type = kOSFlatArray, .osfn_count = 2, .osfn_value = 4 },
+	};
+	static const uint32_t tree_edges[] = { 1, 3, 2, 2, 2, 2 };
+
+	size = BUILD_BUFFER(storage, tree, tree_edges, blob);
+	T_EXPECT_TRUE(osflat_validate(storage, size, &view), "tree with shared leaves");
+
+	/* the same array referenced twice */
+	static const osflat_node_t shared[] = {
+		{ .osfn_type = kOSFlatArray, .osfn_count = 2, .osfn_value = 0 },
+		{ .osfn_type = kOSFlatArray, .osfn_count = 2, .osfn_value = 2 },
+		{ .osfn_type = kOSFlatBoolean, .osfn_bits = 1 },
+	};
+	static const uint32_t shared_edges[] = { 1, 1, 2, 2 };
+
+	size = BUILD_BUFFER(storage, shared, shared_edges, blob);
+	T_EXPECT_FALSE(osflat_validate(storage, size, &view), "shared collection");
+
+	/* two arrays using the same edges */
+	static const osflat_node_t overlap[] = {
+		{ .osfn_type = kOSFlatArray, .osfn_count = 2, .osfn_value = 0 },
+		{ .osfn_type = kOSFlatBoolean, .osfn_bits = 1 },
+		{ .osfn_type = kOSFlatArray, .osfn_count = 1, .osfn_value = 0 },
+	};
+	static const uint32_t overlap_edges[] = { 1, 2 };
+
+	size = BUILD_BUFFER(storage, overlap, overlap_edges, blob);
+	T_EXPECT_FALSE(osflat_validate(storage, size, &view), "overlapping edge runs");
+
+	/* collections out of preorder */
+	static const osflat_node_t order[] = {
+		{ .osfn_type = kOSFlatArray, .osfn_count = 2, .osfn_value = 0 },
+		{ .osfn_type = kOSFlatArray, .osfn_count = 0, .osfn_value = 2 },
+		{ .osfn_type = kOSFlatArray, .osfn_count = 0, .osfn_value = 2 },
+	};
+	static const uint32_t order_edges[] = { 2, 1 };
+
+	size = BUILD_BUFFER(storage, order, order_edges, blob);
+	T_EXPECT_FALSE(osflat_validate(storage, size, &view), "collections out of order");
+
+	/* a collection unreachable from the root */
+	static const osflat_node_t orphan[] = {
+		{ .osfn_type = kOSFlatArray, .osfn_count = 1, .osfn_value = 0 },
+		{ .osfn_type = kOSFlatBoolean, .osfn_bits = 1 },
+		{ .osfn_type = kOSFlatArray, .osfn_count = 0, .osfn_value = 1 },
+	};
+	static const uint32_t orphan_edges[] = { 1 };
+
+	size = BUILD_BUFFER(storage, orphan, orphan_edges, blob);
+	T_EXPECT_FALSE(osflat_validate(storage, size, &view), "unreachable collection");
+}
@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Flow steering of DLIL input across the input threads of an interface
+ * (net.link.generic.system.rcvq_rss).
+ *
+ * UDP flows are written with BPF on one end of a feth pair and received
+ * by the other, whose per input queue packet counts are then read from
+ * net.link.generic.system.rcvq_stats.<ifindex>.
+ */
+
+#include <darwintest.h>
+
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+
+#include <net/if.h>
+#include <net/bpf.h>
+#include <net/ethernet.h>
+
+#include <netinet/in.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "net_test_lib.h"
+#include "bpflib.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_ASROOT(true),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false),
+	T_META_ENABLED(!TARGET_OS_BRIDGE));
+
+/* mirrors struct if_rcvq_stats in bsd/net/if_var_private.h */
+struct if_rcvq_stats {
+	u_int64_t       ifrq_packets;
+	u_int64_t       ifrq_bytes;
+	u_int64_t       ifrq_wakeups;
+	u_int32_t       ifrq_dropped;
+	u_int32_t       ifrq_qlen;
+};
+
+#define RCVQ_RSS_MAX            8       /* IF_RCVQ_RSS_MAX */
+#define RCVQ_RSS                4
+#define RCVQ_FLOW_PACKETS       64
+#define RCVQ_FLOWS              64
+#define RCVQ_PACKETS_PER_FLOW   8
+#define RCVQ_PORT_BASE          20000
+
+#define SYSCTL_RCVQ_RSS         "net.link.generic.system.rcvq_rss"
+
+static char ifname1[IF_NAMESIZE];      /* receives the flows */
+static char ifname2[IF_NAMESIZE];      /* sends them, driven with BPF */
+static int bpf_fd = -1;
+static int rcvq_rss = -1;
+
+static ether_addr_t src_ea = {{ 0x02, 0x00, 0x00, 0x00, 0x0a, 0x02 }};
+static ether_addr_t dst_ea;
+
+static void
+cleanup(void)
+{
+	if (bpf_fd != -1) {
+		close(bpf_fd);
+	}
+	if (ifname1[0] != '\0') {
+		(void)ifnet_destroy(ifname1, false);
+	}
+	if (ifname2[0] != '\0') {
+		(void)ifnet_destroy(ifname2, false);
+	}
+	if (rcvq_rss != -1) {
+		(void)sysctlbyname(SYSCTL_RCVQ_RSS, NULL, NULL, &rcvq_rss, sizeof(rcvq_rss));
+	}
+}
+
+static void
+rcvq_setup(void)
+{
+	int val = RCVQ_RSS;
+	size_t len = sizeof(rcvq_rss);
+
+	T_ATEND(cleanup);
+
+	if (sysctlbyname(SYSCTL_RCVQ_RSS, &rcvq_rss, &len, NULL, 0) != 0) {
+		rcvq_rss = -1;
+		T_SKIP("flow-steered input threads aren't supported");
+	}
+	/* only interfaces attached afterwards get the extra input threads */
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname(SYSCTL_RCVQ_RSS, NULL, NULL, &val, sizeof(val)),
+	    SYSCTL_RCVQ_RSS " = %d", val);
+
+	strlcpy(ifname1, FETH_NAME, sizeof(ifname1));
+	T_ASSERT_POSIX_ZERO(ifnet_create_2(ifname1, sizeof(ifname1)), "create %s", ifname1);
+	strlcpy(ifname2, FETH_NAME, sizeof(ifname2));
+	T_ASSERT_POSIX_ZERO(ifnet_create_2(ifname2, sizeof(ifname2)), "create %s", ifname2);
+	fake_set_peer(ifname1, ifname2);
+	ifnet_set_flags(ifname1, IFF_UP, 0);
+	ifnet_set_flags(ifname2, IFF_UP, 0);
+	ifnet_get_lladdr(ifname1, &dst_ea);
+
+	T_ASSERT_POSIX_SUCCESS(bpf_fd = bpf_new(), "bpf_new");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_setif(bpf_fd, ifname2), "bpf on %s", ifname2);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_set_header_complete(bpf_fd, 1), NULL);
+}
+
+/*
+ * Packets counted on each input queue of ifname1, returns the number of queues.
+ */
+static u_int
+rcvq_packets(uint64_t packets[RCVQ_RSS_MAX])
+{
+	struct if_rcvq_stats stats[RCVQ_RSS_MAX] = {};
+	int mib[CTL_MAXNAME];
+	size_t miblen = CTL_MAXNAME - 1;
+	size_t len = sizeof(stats);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlnametomib("net.link.generic.system.rcvq_stats",
+	    mib, &miblen), NULL);
+	mib[miblen++] = (int)if_nametoindex(ifname1);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctl(mib, (u_int)miblen, stats, &len, NULL, 0),
+	    "rcvq_stats of %s", ifname1);
+
+	for (u_int i = 0; i < len / sizeof(stats[0]); i++) {
+		packets[i] = stats[i].ifrq_packets;
+	}
+	return (u_int)(len / sizeof(stats[0]));
+}
+
+static void
+rcvq_send(uint16_t sport, u_int count)
+{
+	uint8_t frame[ETHER_PKT_LEN];
+	uint8_t payload[64] = { 0 };
+	struct in_addr src_ip = { .s_addr = htonl(0xc0000202) };    /* 192.0.2.2 */
+	struct in_addr dst_ip = { .s_addr = htonl(0xc0000201) };    /* 192.0.2.1 */
+	u_int frame_len;
+
+	frame_len = ethernet_udp4_frame_populate(frame, sizeof(frame),
+	    &src_ea, src_ip, sport, &dst_ea, dst_ip, RCVQ_PORT_BASE - 1,
+	    payload, sizeof(payload));
+	T_QUIET; T_ASSERT_GT(frame_len, 0u, "frame for port %u", sport);
+
+	for (u_int i = 0; i < count; i++) {
+		T_QUIET; T_ASSERT_EQ(write(bpf_fd, frame, frame_len), (ssize_t)frame_len,
+		    "bpf write");
+	}
+}
+
+/*
+ * Send `flows' flows of `count' packets, wait for the input threads
+ * to pick them up, and return the packets each queue got.
+ */
+static u_int
+rcvq_run(u_int flows, u_int count, uint64_t delta[RCVQ_RSS_MAX])
+{
+	uint64_t before[RCVQ_RSS_MAX] = {}, after[RCVQ_RSS_MAX] = {};
+	uint64_t total = 0;
+	u_int nqueues;
+
+	nqueues = rcvq_packets(before);
+	for (u_int f = 0; f < flows; f++) {
+		rcvq_send((uint16_t)(RCVQ_PORT_BASE + f), count);
+	}
+	for (int tries = 0; tries < 100; tries++) {
+		total = 0;
+		T_QUIET; T_ASSERT_EQ(rcvq_packets(after), nqueues, "queue count is stable");
+		for (u_int q = 0; q < nqueues; q++) {
+			delta[q] = after[q] - before[q];
+			total += delta[q];
+		}
+		if (total >= (uint64_t)flows * count) {
+			break;
+		}
+		usleep(10 * 1000);
+	}
+	for (u_int q = 0; q < nqueues; q++) {
+		T_LOG("queue %u: %llu packets", q, delta[q]);
+	}
+	T_ASSERT_GE(total, (uint64_t)flows * count, "all %u packets were received", flows * count);
+	return nqueues;
+}
+
+T_DECL(net_rcvq_rss_flows,
+    "one flow stays on one input thread, several flows spread over them",
+    T_META_TAG_VM_PREFERRED)
+{
+	uint64_t delta[RCVQ_RSS_MAX];
+	u_int nqueues, busy;
+	uint64_t most;
+
+	rcvq_setup();
+
+	nqueues = rcvq_run(1, RCVQ_FLOW_PACKETS, delta);
+	if (nqueues < 2) {
+		T_SKIP("%s has a single input queue (not using the asynchronous input strategy)",
+		    ifname1);
+	}
+	T_ASSERT_EQ(nqueues, RCVQ_RSS, "%s has %d input queues", ifname1, RCVQ_RSS);
+
+	most = 0;
+	for (u_int q = 0; q < nqueues; q++) {
+		most = MAX(most, delta[q]);
+	}
+	T_EXPECT_GE(most, (uint64_t)RCVQ_FLOW_PACKETS,
+	    "the %d packets of one flow went to the same input queue", RCVQ_FLOW_PACKETS);
+
+	rcvq_run(RCVQ_FLOWS, RCVQ_PACKETS_PER_FLOW, delta);
+	busy = 0;
+	for (u_int q = 0; q < nqueues; q++) {
+		if (delta[q] >= RCVQ_PACKETS_PER_FLOW) {
+			busy++;
+		}
+	}
+	T_EXPECT_GE(busy, 2u, "%d flows spread over %u of %u input queues",
+	    RCVQ_FLOWS, busy, nqueues);
+}
@@ -0,0 +1,507 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Receive coalescing (GRO) of TCP segments in DLIL input.
+ *
+ * A TCP peer is simulated with BPF on one end of a feth pair: bursts of
+ * segments are written to it and received by a socket bound to the
+ * address of the other end, which checks that the byte stream is intact.
+ */
+
+#include <darwintest.h>
+
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <net/bpf.h>
+#include <net/ethernet.h>
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/tcp.h>
+#include <netinet/if_ether.h>
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "net_test_lib.h"
+#include "bpflib.h"
+#include "in_cksum.h"
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_ASROOT(true),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false),
+	T_META_ENABLED(!TARGET_OS_BRIDGE));
+
+#define GRO_SEG_SIZE            1000
+#define GRO_BURST               32
+#define GRO_BURSTS              16
+#define GRO_PEER_PORT           49152
+#define GRO_MIN_FRAME           (ETHER_MIN_LEN - ETHER_CRC_LEN)
+
+#define SYSCTL_FAKE_HWCSUM      "net.link.fake.hwcsum"
+#define SYSCTL_IP_FORWARDING    "net.inet.ip.forwarding"
+#define SYSCTL_IP6_FORWARDING   "net.inet6.ip6.forwarding"
+
+static char ifname1[IF_NAMESIZE];      /* local end, has the address */
+static char ifname2[IF_NAMESIZE];      /* peer end, driven with BPF */
+
+static struct in_addr local_ip;
+static struct in_addr peer_ip;
+static ether_addr_t local_ea;
+static ether_addr_t peer_ea = {{ 0x02, 0x00, 0x00, 0x00, 0x0a, 0x02 }};
+
+static int bpf_fd = -1;
+static int bpf_len;
+static int listen_fd = -1;
+static int conn_fd = -1;
+static uint16_t local_port;
+static tcp_seq snd_nxt;
+static tcp_seq rcv_nxt;
+
+static int fake_hwcsum = -1;
+static int ip_forwarding = -1;
+static int ip6_forwarding = -1;
+
+static int
+sysctl_swap_integer(const char *name, int val)
+{
+	int old_val;
+	size_t len = sizeof(old_val);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, &old_val, &len,
+	    &val, sizeof(val)), "sysctl %s = %d", name, val);
+	return old_val;
+}
+
+static void
+cleanup(void)
+{
+	if (conn_fd != -1) {
+		close(conn_fd);
+	}
+	if (listen_fd != -1) {
+		close(listen_fd);
+	}
+	if (bpf_fd != -1) {
+		close(bpf_fd);
+	}
+	if (ifname1[0] != '\0') {
+		(void)ifnet_destroy(ifname1, false);
+	}
+	if (ifname2[0] != '\0') {
+		(void)ifnet_destroy(ifname2, false);
+	}
+	if (fake_hwcsum != -1) {
+		(void)sysctl_swap_integer(SYSCTL_FAKE_HWCSUM, fake_hwcsum);
+	}
+	if (ip_forwarding != -1) {
+		(void)sysctl_swap_integer(SYSCTL_IP_FORWARDING, ip_forwarding);
+	}
+	if (ip6_forwarding != -1) {
+		(void)sysctl_swap_integer(SYSCTL_IP6_FORWARDING, ip6_forwarding);
+	}
+}
+
+static uint64_t
+gro_merged(void)
+{
+	uint64_t merged;
+	size_t len = sizeof(merged);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(
+		    "net.link.generic.system.rx_gro_merged", &merged, &len, NULL, 0),
+	    "net.link.generic.system.rx_gro_merged");
+	return merged;
+}
+
+static uint8_t
+gro_payload_byte(uint32_t off)
+{
+	return (uint8_t)(off * 7 + (off >> 8));
+}
+
+/*
+ * Build an Ethernet frame carrying a segment from the simulated peer,
+ * zero padded up to `pad_to' bytes.  The payload is a function of the
+ * sequence numbers it covers.
+ */
+static u_int
+gro_tcp_frame(uint8_t *buf, uint8_t flags, tcp_seq seq, u_int len,
+    u_int pad_to)
+{
+	ether_header_t *eh = (ether_header_t *)(void *)buf;
+	ip_tcp_header_t *ip_tcp = (ip_tcp_header_t *)(void *)(eh + 1);
+	tcp_pseudo_hdr_t *pseudo;
+	uint8_t *payload = (uint8_t *)(ip_tcp + 1);
+	u_int frame_len = (u_int)(sizeof(*eh) + sizeof(*ip_tcp)) + len;
+	static uint16_t ip_id;
+
+	bzero(buf, MAX(frame_len, pad_to));
+	bcopy(&peer_ea, eh->ether_shost, ETHER_ADDR_LEN);
+	bcopy(&local_ea, eh->ether_dhost, ETHER_ADDR_LEN);
+	eh->ether_type = htons(ETHERTYPE_IP);
+
+	for (u_int i = 0; i < len; i++) {
+		payload[i] = gro_payload_byte(seq + i);
+	}
+
+	/* the pseudo header is overwritten by the IP header below */
+	pseudo = (tcp_pseudo_hdr_t *)(void *)((uint8_t *)&ip_tcp->tcp - sizeof(*pseudo));
+	pseudo->src_ip = peer_ip;
+	pseudo->dst_ip = local_ip;
+	pseudo->zero = 0;
+	pseudo->proto = IPPROTO_TCP;
+	pseudo->length = htons(sizeof(ip_tcp->tcp) + len);
+
+	ip_tcp->tcp.th_sport = htons(GRO_PEER_PORT);
+	ip_tcp->tcp.th_dport = htons(local_port);
+	ip_tcp->tcp.th_seq = htonl(seq);
+	ip_tcp->tcp.th_ack = htonl(rcv_nxt);
+	ip_tcp->tcp.th_off = sizeof(ip_tcp->tcp) >> 2;
+	ip_tcp->tcp.th_flags = flags;
+	ip_tcp->tcp.th_win = htons(TCP_MAXWIN);
+	ip_tcp->tcp.th_sum = in_cksum(pseudo,
+	    (int)(sizeof(*pseudo) + sizeof(ip_tcp->tcp) + len));
+
+	bzero(&ip_tcp->ip, sizeof(ip_tcp->ip));
+	ip_tcp->ip.ip_v = IPVERSION;
+	ip_tcp->ip.ip_hl = sizeof(struct ip) >> 2;
+	ip_tcp->ip.ip_ttl = MAXTTL;
+	ip_tcp->ip.ip_p = IPPROTO_TCP;
+	ip_tcp->ip.ip_src = peer_ip;
+	ip_tcp->ip.ip_dst = local_ip;
+	ip_tcp->ip.ip_len = htons(sizeof(*ip_tcp) + len);
+	ip_tcp->ip.ip_id = htons(ip_id++);
+	ip_tcp->ip.ip_sum = in_cksum(&ip_tcp->ip, sizeof(ip_tcp->ip));
+
+	return MAX(frame_len, pad_to);
+}
+
+/*
+ * Frames are written in batches with one write(2), so that they reach
+ * DLIL input back to back.
+ */
+struct gro_batch {
+	uint8_t         *gb_buf;
+	size_t          gb_len;
+	size_t          gb_size;
+};
+
+static uint8_t *
+gro_batch_next(struct gro_batch *b)
+{
+	size_t need = b->gb_len + BPF_WORDALIGN(sizeof(struct bpf_hdr) + ETHER_MAX_LEN);
+
+	if (need > b->gb_size) {
+		b->gb_size = MAX(need, 2 * b->gb_size);
+		b->gb_buf = realloc(b->gb_buf, b->gb_size);
+		T_QUIET; T_ASSERT_NOTNULL(b->gb_buf, "realloc");
+	}
+	return b->gb_buf + b->gb_len + sizeof(struct bpf_hdr);
+}
+
+static void
+gro_batch_commit(struct gro_batch *b, u_int frame_len)
+{
+	struct bpf_hdr bh = {
+		.bh_caplen = frame_len,
+		.bh_datalen = frame_len,
+		.bh_hdrlen = sizeof(struct bpf_hdr),
+	};
+
+	bcopy(&bh, b->gb_buf + b->gb_len, sizeof(bh));
+	b->gb_len += BPF_WORDALIGN(sizeof(bh) + frame_len);
+}
+
+static void
+gro_batch_add_tcp(struct gro_batch *b, uint8_t flags, u_int len, u_int pad_to)
+{
+	uint8_t *frame = gro_batch_next(b);
+
+	gro_batch_commit(b, gro_tcp_frame(frame, flags, snd_nxt, len, pad_to));
+	snd_nxt += len;
+}
+
+static void
+gro_batch_write(struct gro_batch *b)
+{
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(write(bpf_fd, b->gb_buf, b->gb_len),
+	    "bpf write %zu bytes", b->gb_len);
+	b->gb_len = 0;
+}
+
+static void
+gro_arp_reply(const struct ether_arp *req)
+{
+	struct gro_batch b = { 0 };
+	ether_header_t *eh = (ether_header_t *)(void *)gro_batch_next(&b);
+	struct ether_arp *ea = (struct ether_arp *)(void *)(eh + 1);
+
+	bcopy(&peer_ea, eh->ether_shost, ETHER_ADDR_LEN);
+	bcopy(req->arp_sha, eh->ether_dhost, ETHER_ADDR_LEN);
+	eh->ether_type = htons(ETHERTYPE_ARP);
+
+	bzero(ea, sizeof(*ea));
+	ea->arp_hrd = htons(ARPHRD_ETHER);
+	ea->arp_pro = htons(ETHERTYPE_IP);
+	ea->arp_hln = ETHER_ADDR_LEN;
+	ea->arp_pln = sizeof(struct in_addr);
+	ea->arp_op = htons(ARPOP_REPLY);
+	bcopy(&peer_ea, ea->arp_sha, ETHER_ADDR_LEN);
+	bcopy(&peer_ip, ea->arp_spa, sizeof(peer_ip));
+	bcopy(req->arp_sha, ea->arp_tha, ETHER_ADDR_LEN);
+	bcopy(req->arp_spa, ea->arp_tpa, sizeof(ea->arp_tpa));
+
+	gro_batch_commit(&b, sizeof(*eh) + sizeof(*ea));
+	gro_batch_write(&b);
+	free(b.gb_buf);
+}
+
+/*
+ * Read frames sent to the peer, answering its ARP requests, until
+ * a TCP segment with the `flags' shows up.
+ */
+static bool
+gro_read_tcp(uint8_t flags, struct tcphdr *th_out)
+{
+	uint8_t *buf = malloc((size_t)bpf_len);
+
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+	for (int tries = 0; tries < 10; tries++) {
+		ssize_t n = read(bpf_fd, buf, (size_t)bpf_len);
+
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "bpf read");
+		for (uint8_t *bp = buf; bp < buf + n;) {
+			struct bpf_hdr *bh = (struct bpf_hdr *)(void *)bp;
+			ether_header_t *eh = (ether_header_t *)(void *)(bp + bh->bh_hdrlen);
+
+			bp += BPF_WORDALIGN(bh->bh_hdrlen + bh->bh_caplen);
+			if (eh->ether_type == htons(ETHERTYPE_ARP)) {
+				struct ether_arp *ea = (struct ether_arp *)(void *)(eh + 1);
+
+				if (ea->arp_op == htons(ARPOP_REQUEST) &&
+				    bcmp(ea->arp_tpa, &peer_ip, sizeof(peer_ip)) == 0) {
+					gro_arp_reply(ea);
+				}
+			} else if (eh->ether_type == htons(ETHERTYPE_IP)) {
+				ip_tcp_header_t *ip_tcp = (ip_tcp_header_t *)(void *)(eh + 1);
+
+				if (ip_tcp->ip.ip_p == IPPROTO_TCP &&
+				    ip_tcp->tcp.th_dport == htons(GRO_PEER_PORT) &&
+				    (ip_tcp->tcp.th_flags & flags) == flags) {
+					*th_out = ip_tcp->tcp;
+					free(buf);
+					return true;
+				}
+			}
+		}
+	}
+	free(buf);
+	return false;
+}
+
+static void
+gro_setup(void)
+{
+	struct sockaddr_in sin = { 0 };
+	socklen_t socklen = sizeof(sin);
+	struct gro_batch b = { 0 };
+	struct timeval timeout = { .tv_sec = 1 };
+	struct tcphdr th;
+	uint32_t hwcksum_rx, gro_max;
+	size_t len;
+
+	T_ATEND(cleanup);
+
+	len = sizeof(gro_max);
+	if (sysctlbyname("net.link.generic.system.rx_gro_max", &gro_max, &len,
+	    NULL, 0) != 0) {
+		T_SKIP("DLIL receive coalescing isn't supported");
+	}
+	len = sizeof(hwcksum_rx);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("net.link.generic.system.hwcksum_rx",
+	    &hwcksum_rx, &len, NULL, 0), NULL);
+	if (gro_max == 0 || hwcksum_rx == 0) {
+		T_SKIP("receive coalescing is disabled");
+	}
+
+	/* feth marks the checksums of the frames it delivers as verified */
+	fake_hwcsum = sysctl_swap_integer(SYSCTL_FAKE_HWCSUM, 1);
+
+	strlcpy(ifname1, FETH_NAME, sizeof(ifname1));
+	T_ASSERT_POSIX_ZERO(ifnet_create_2(ifname1, sizeof(ifname1)), "create %s", ifname1);
+	strlcpy(ifname2, FETH_NAME, sizeof(ifname2));
+	T_ASSERT_POSIX_ZERO(ifnet_create_2(ifname2, sizeof(ifname2)), "create %s", ifname2);
+	fake_set_peer(ifname1, ifname2);
+	ifnet_set_flags(ifname2, IFF_UP, 0);
+
+	local_ip.s_addr = htonl(0xc0000201);     /* 192.0.2.1 */
+	peer_ip.s_addr = htonl(0xc0000202);      /* 192.0.2.2 */
+	ifnet_attach_ip(ifname1);
+	ifnet_add_ip_address(ifname1, local_ip, inet_class_c_subnet_mask);
+	ifnet_set_flags(ifname1, IFF_UP, 0);
+	ifnet_get_lladdr(ifname1, &local_ea);
+
+	T_ASSERT_POSIX_SUCCESS(bpf_fd = bpf_new(), "bpf_new");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_set_blen(bpf_fd, 128 * 1024), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_get_blen(bpf_fd, &bpf_len), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_set_immediate(bpf_fd, 1), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_setif(bpf_fd, ifname2), "bpf on %s", ifname2);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_set_see_sent(bpf_fd, 0), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_set_header_complete(bpf_fd, 1), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_set_timeout(bpf_fd, &timeout), NULL);
+#ifdef BIOCSBATCHWRITE
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bpf_set_batch_write(bpf_fd, 1), NULL);
+#else
+	T_SKIP("BIOCSBATCHWRITE not supported");
+#endif
+
+	sin.sin_len = sizeof(sin);
+	sin.sin_family = AF_INET;
+	sin.sin_addr = local_ip;
+	T_ASSERT_POSIX_SUCCESS(listen_fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bind(listen_fd, (struct sockaddr *)&sin, sizeof(sin)), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(getsockname(listen_fd, (struct sockaddr *)&sin, &socklen), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(listen(listen_fd, 1), NULL);
+	local_port = ntohs(sin.sin_port);
+
+	/* three way handshake with the simulated peer */
+	snd_nxt = arc4random();
+	rcv_nxt = 0;
+	gro_batch_commit(&b, gro_tcp_frame(gro_batch_next(&b), TH_SYN,
+	    snd_nxt++, 0, 0));
+	gro_batch_write(&b);
+	T_ASSERT_TRUE(gro_read_tcp(TH_SYN | TH_ACK, &th), "received SYN-ACK");
+	rcv_nxt = ntohl(th.th_seq) + 1;
+	gro_batch_commit(&b, gro_tcp_frame(gro_batch_next(&b), TH_ACK,
+	    snd_nxt, 0, 0));
+	gro_batch_write(&b);
+	free(b.gb_buf);
+
+	T_ASSERT_POSIX_SUCCESS(conn_fd = accept(listen_fd, NULL, NULL), "accept");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(setsockopt(conn_fd, SOL_SOCKET, SO_RCVTIMEO,
+	    &(struct timeval){ .tv_sec = 5 }, sizeof(struct timeval)), NULL);
+}
+
+/*
+ * Send bursts of in-order segments, with `padded' inserting short
+ * segments and a pure ACK padded to the Ethernet minimum in each burst,
+ * and check that the receiver gets the exact byte stream.
+ */
+static void
+gro_send_bursts(bool padded)
+{
+	struct gro_batch b = { 0 };
+	uint8_t *buf = malloc(GRO_BURST * GRO_SEG_SIZE + 64);
+	tcp_seq start = snd_nxt;
+
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+	for (int burst = 0; burst < GRO_BURSTS; burst++) {
+		tcp_seq burst_seq = snd_nxt;
+		size_t want, got = 0;
+
+		for (int i = 0; i < GRO_BURST; i++) {
+			uint8_t flags = TH_ACK;
+
+			if (i == GRO_BURST - 1) {
+				flags |= TH_PUSH;
+			}
+			if (padded && i == GRO_BURST / 2) {
+				/* a short segment, and an ACK without data */
+				gro_batch_add_tcp(&b, TH_ACK, 4, GRO_MIN_FRAME);
+				gro_batch_add_tcp(&b, TH_ACK, 0, GRO_MIN_FRAME);
+			}
+			gro_batch_add_tcp(&b, flags, GRO_SEG_SIZE, 0);
+		}
+		gro_batch_write(&b);
+
+		want = snd_nxt - burst_seq;
+		while (got < want) {
+			ssize_t n = recv(conn_fd, buf + got, want - got, 0);
+
+			T_QUIET; T_ASSERT_POSIX_SUCCESS(n, "recv burst %d", burst);
+			T_QUIET; T_ASSERT_GT(n, 0L, "connection still open");
+			got += (size_t)n;
+		}
+		for (size_t i = 0; i < want; i++) {
+			uint32_t off = burst_seq - start + (uint32_t)i;
+
+			if (buf[i] != gro_payload_byte(burst_seq + (uint32_t)i)) {
+				T_ASSERT_FAIL("burst %d: wrong byte at stream offset %u", burst, off);
+			}
+		}
+	}
+	T_PASS("%d bursts of %d segments received intact", GRO_BURSTS, GRO_BURST);
+	free(b.gb_buf);
+	free(buf);
+}
+
+T_DECL(net_rx_gro_stream,
+    "in-order TCP segments are coalesced on input and arrive intact",
+    T_META_TAG_VM_NOT_ELIGIBLE)
+{
+	uint64_t merged;
+
+	gro_setup();
+	merged = gro_merged();
+	gro_send_bursts(false);
+	T_LOG("%llu segments merged", gro_merged() - merged);
+	T_EXPECT_GT(gro_merged(), merged, "segments were coalesced");
+}
+
+T_DECL(net_rx_gro_padded,
+    "Ethernet padded segments close their flow's aggregate",
+    T_META_TAG_VM_NOT_ELIGIBLE)
+{
+	gro_setup();
+	gro_send_bursts(true);
+}
+
+T_DECL(net_rx_gro_forwarding,
+    "nothing is coalesced while IP forwarding is on",
+    T_META_TAG_VM_NOT_ELIGIBLE)
+{
+	uint64_t merged;
+
+	gro_setup();
+	ip_forwarding = sysctl_swap_integer(SYSCTL_IP_FORWARDING, 1);
+	ip6_forwarding = sysctl_swap_integer(SYSCTL_IP6_FORWARDING, 1);
+
+	merged = gro_merged();
+	gro_send_bursts(false);
+	T_EXPECT_EQ(gro_merged(), merged, "no segment was coalesced");
+}
@@ -0,0 +1,454 @@
+/*
+ * Copyright (c) 2025 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed forms of proprietary software, or to circumvent,
+ * violate, or enable the circumvention or violation of, any terms of an
+ * Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Loads a routing table into both the radix tree from bsd/net/radix.c and
+ * the poptrie from bsd/net/poptrie.c, checks that they agree on the
+ * longest prefix match and measures lookups/s.  Set ROUTE_FIB_BENCH_TABLE
+ * to a file of "prefix/length" lines (IPv4 or IPv6, e.g. a BGP table dump)
+ * to benchmark it instead of the synthetic full tables.
+ */
+
+#define PRIVATE 1
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <ptrcheck.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/queue.h>
+#include <sys/socket.h>
+#include <time.h>
+
+#include <darwintest.h>
+
+#ifndef __stateful_pure
+#define __stateful_pure
+#endif
+#include "../bsd/net/radix.h"
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.net"),
+    T_META_RADAR_COMPONENT_NAME("xnu"),
+    T_META_RADAR_COMPONENT_VERSION("networking"),
+    T_META_RUN_CONCURRENTLY(true));
+
+/* What radix.c gets from the kernel */
+#define log(level, ...)                 fprintf(stderr, __VA_ARGS__)
+#define panic(...)                      do { fprintf(stderr, __VA_ARGS__); abort(); } while (0)
+#define VM_KERNEL_ADDRPERM(p)           ((uintptr_t)(p))
+#define min(a, b)                       ((a) < (b) ? (a) : (b))
+
+typedef struct bench_zone {
+	size_t          bz_size;
+} *zone_t;
+
+#define Z_WAITOK_ZERO_NOFAIL            0
+#define ZALIGN_NONE                     0
+#define ZC_PGZ_USE_GUARDS               0
+#define ZC_ZFREE_CLEARMEM               0
+#define KALLOC_TYPE_DEFINE(var, type, flags) \
+	static struct bench_zone var##_storage = { sizeof(type) }; \
+	static zone_t var = &var##_storage
+#define kalloc_type(type, flags)        calloc(1, sizeof(type))
+#define zalloc_flags(z, flags)          calloc(1, (z)->bz_size)
+#define zfree(z, p)                     free(p)
+#define zalloc_permanent(size, align)   calloc(1, (size))
+
+static inline zone_t
+zone_create(const char *name, size_t size, int flags)
+{
+	zone_t z = calloc(1, sizeof(*z));
+
+	(void)name;
+	(void)flags;
+	z->bz_size = size;
+	return z;
+}
+
+struct domain {
+	TAILQ_ENTRY(domain)     dom_entry;
+	int                     dom_maxrtkey;
+};
+static TAILQ_HEAD(, domain) domains = TAILQ_HEAD_INITIALIZER(domains);
+
+#include "../bsd/net/radix.c"
+#include "../bsd/net/poptrie.c"
+
+/* Stand-in for struct rtentry: radix nodes first, key and mask after */
+struct bench_route {
+	struct radix_node       br_nodes[2];
+	struct sockaddr_in6     br_key;
+	struct sockaddr_in6     br_mask;
+	uint32_t                br_index;
+};
+
+struct bench_table {
+	int                     bt_af;
+	uint8_t                 bt_keylen;
+	size_t                  bt_off;         /* address offset in the sockaddr */
+	struct radix_node_head  *bt_rnh;
+	struct bench_route      *bt_routes;
+	uint32_t                bt_nroutes;
+	uint32_t                bt_maxroutes;
+	struct poptrie          *bt_trie;
+};
+
+#define BENCH_V4_ROUTES         900000
+#define BENCH_V6_ROUTES         200000
+#define BENCH_LOOKUPS           (1 << 22)
+
+static void
+bench_radix_init(void)
+{
+	static struct domain dom = { .dom_maxrtkey = sizeof(struct sockaddr_in6) };
+
+	if (rn_zeros == NULL) {
+		TAILQ_INSERT_TAIL(&domains, &dom, dom_entry);
+		rn_init();
+	}
+}
+
+static void
+bench_table_init(struct bench_table *bt, int af, uint32_t maxroutes)
+{
+	memset(bt, 0, sizeof(*bt));
+	bt->bt_af = af;
+	if (af == AF_INET) {
+		bt->bt_keylen = sizeof(struct in_addr);
+		bt->bt_off = offsetof(struct sockaddr_in, sin_addr);
+	} else {
+		bt->bt_keylen = sizeof(struct in6_addr);
+		bt->bt_off = offsetof(struct sockaddr_in6, sin6_addr);
+	}
+	bench_radix_init();
+	T_QUIET; T_ASSERT_EQ(rn_inithead((void **)&bt->bt_rnh,
+	    (int)bt->bt_off * 8), 1, "rn_inithead");
+	bt->bt_maxroutes = maxroutes;
+	bt->bt_routes = calloc(maxroutes, sizeof(*bt->bt_routes));
+	T_QUIET; T_ASSERT_NOTNULL(bt->bt_routes, "routes");
+}
+
+static void
+bench_sockaddr(const struct bench_table *bt, struct sockaddr_in6 *sa,
+    const uint8_t *addr)
+{
+	memset(sa, 0, sizeof(*sa));
+	sa->sin6_len = (bt->bt_af == AF_INET) ? sizeof(struct sockaddr_in) :
+	    sizeof(struct sockaddr_in6);
+	sa->sin6_family = (sa_family_t)bt->bt_af;
+	memcpy((uint8_t *)sa + bt->bt_off, addr, bt->bt_keylen);
+}
+
+/* Adds addr/plen; returns false if the prefix is already there */
+static bool
+bench_table_add(struct bench_table *bt, const uint8_t *addr, uint8_t plen)
+{
+	struct bench_route *br;
+	uint8_t key[16] = {}, mask[16] = {};
+	unsigned int i;
+
+	if (bt->bt_nroutes == bt->bt_maxroutes) {
+		return false;
+	}
+	for (i = 0; i < bt->bt_keylen; i++) {
+		unsigned int bits = (plen > i * 8) ? plen - i * 8 : 0;
+
+		mask[i] = (bits >= 8) ? 0xff : (uint8_t)(0xff00 >> bits);
+		key[i] = addr[i] & mask[i];
+	}
+	br = &bt->bt_routes[bt->bt_nroutes];
+	bench_sockaddr(bt, &br->br_key, key);
+	bench_sockaddr(bt, &br->br_mask, mask);
+	if (bt->bt_rnh->rnh_addaddr(&br->br_key,
+	    plen == bt->bt_keylen * 8 ? NULL : &br->br_mask,
+	    bt->bt_rnh, br->br_nodes) == NULL) {
+		memset(br, 0, sizeof(*br));
+		return false;
+	}
+	br->br_index = bt->bt_nroutes++;
+	return true;
+}
+
+static uint32_t
+bench_radix_lookup(struct bench_table *bt, const uint8_t *addr)
+{
+	struct sockaddr_in6 sa;
+	struct radix_node *rn;
+
+	bench_sockaddr(bt, &sa, addr);
+	rn = bt->bt_rnh->rnh_matchaddr(&sa, bt->bt_rnh);
+	if (rn == NULL || (rn->rn_flags & RNF_ROOT)) {
+		return POPTRIE_NOROUTE;
+	}
+	return ((struct bench_route *)(void *)rn)->br_index + 1;
+}
+
+static void
+bench_trie_build(struct bench_table *bt)
+{
+	struct poptrie_route *routes;
+	uint64_t start;
+	uint32_t i;
+
+	routes = calloc(bt->bt_nroutes, sizeof(*routes));
+	T_QUIET; T_ASSERT_NOTNULL(routes, "routes");
+	for (i = 0; i < bt->bt_nroutes; i++) {
+		struct bench_route *br = &bt->bt_routes[i];
+		const uint8_t *mask = (const uint8_t *)&br->br_mask + bt->bt_off;
+		unsigned int b;
+
+		memcpy(routes[i].pr_key, (uint8_t *)&br->br_key + bt->bt_off,
+		    bt->bt_keylen);
+		for (b = 0; b < bt->bt_keylen * 8u &&
+		    (mask[b / 8] & (0x80 >> (b % 8))); b++) {
+			;
+		}
+		routes[i].pr_plen = (uint8_t)b;
+		routes[i].pr_value = br->br_index + 1;
+	}
+	start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+	bt->bt_trie = poptrie_create(routes, bt->bt_nroutes, bt->bt_keylen);
+	T_QUIET; T_ASSERT_NOTNULL(bt->bt_trie, "poptrie_create");
+	T_LOG("IPv%d: %u routes compiled in %.1f ms into %zu KB",
+	    bt->bt_af == AF_INET ? 4 : 6, bt->bt_nroutes,
+	    (double)(clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start) / 1e6,
+	    poptrie_size(bt->bt_trie) / 1024);
+	free(routes);
+}
+
+static void
+bench_table_destroy(struct bench_table *bt)
+{
+	poptrie_destroy(bt->bt_trie);
+	/* The radix nodes are left behind, as rn_delete() per route is slow */
+	free(bt->bt_rnh);
+}
+
+/*
+ * Prefix lengths roughly as they are distributed in the global BGP tables:
+ * mostly /24 for IPv4 and /48 for IPv6.
+ */
+static uint8_t
+bench_random_plen(int af)
+{
+	int r = rand() % 100;
+
+	if (af == AF_INET) {
+		return r < 58 ? 24 : r < 70 ? 23 : r < 80 ? 22 : r < 86 ? 21 :
+		       r < 90 ? 20 : r < 96 ? 16 + rand() % 4 : 8 + rand() % 8;
+	}
+	return r < 45 ? 48 : r < 60 ? 44 + rand() % 4 : r < 75 ? 40 + rand() % 4 :
+	       r < 90 ? 32 + rand() % 8 : r < 97 ? 29 + rand() % 3 :
+	       49 + rand() % 16;
+}
+
+static void
+bench_random_addr(int af, uint8_t *addr)
+{
+	unsigned int i;
+
+	for (i = 0; i < 16; i++) {
+		addr[i] = (uint8_t)rand();
+	}
+	if (af == AF_INET) {
+		/* unicast space */
+		addr[0] = (uint8_t)(1 + rand() % 223);
+	} else {
+		/* 2000::/3 */
+		addr[0] = (uint8_t)(0x20 | (addr[0] & 0x1f));
+	}
+}
+
+static void
+bench_table_synthesize(struct bench_table *bt, uint32_t nroutes)
+{
+	uint8_t addr[16] = {};
+
+	/* a default route and a few covering prefixes, as on a router */
+	bench_table_add(bt, addr, 0);
+	while (bt->bt_nroutes < nroutes) {
+		bench_random_addr(bt->bt_af, addr);
+		bench_table_add(bt, addr, bench_random_plen(bt->bt_af));
+	}
+}
+
+/* Loads the prefixes of af from ROUTE_FIB_BENCH_TABLE; false if unset */
+static bool
+bench_table_load(struct bench_table *bt)
+{
+	const char *path = getenv("ROUTE_FIB_BENCH_TABLE");
+	char line[256];
+	FILE *f;
+
+	if (path == NULL) {
+		return false;
+	}
+	f = fopen(path, "r");
+	T_QUIET; T_ASSERT_NOTNULL(f, "open %s", path);
+	while (fgets(line, sizeof(line), f) != NULL) {
+		uint8_t addr[16] = {};
+		char *slash = strchr(line, '/');
+		int plen;
+
+		if (slash == NULL) {
+			continue;
+		}
+		*slash = '\0';
+		plen = atoi(slash + 1);
+		if (inet_pton(bt->bt_af, line, addr) == 1 && plen >= 0 &&
+		    plen <= bt->bt_keylen * 8) {
+			bench_table_add(bt, addr, (uint8_t)plen);
+		}
+	}
+	fclose(f);
+	return true;
+}
+
+/* Destinations: mostly within routed prefixes, some anywhere */
+static uint8_t *
+bench_addrs(struct bench_table *bt, uint32_t n)
+{
+	uint8_t *addrs = calloc(n, bt->bt_keylen);
+	uint32_t i;
+
+	T_QUIET; T_ASSERT_NOTNULL(addrs, "addrs");
+	for (i = 0; i < n; i++) {
+		uint8_t *a = &addrs[i * bt->bt_keylen], rnd[16];
+		struct bench_route *br;
+		unsigned int j;
+
+		bench_random_addr(bt->bt_af, rnd);
+		if (bt->bt_nroutes == 0 || rand() % 8 == 0) {
+			memcpy(a, rnd, bt->bt_keylen);
+			continue;
+		}
+		br = &bt->bt_routes[rand() % bt->bt_nroutes];
+		for (j = 0; j < bt->bt_keylen; j++) {
+			uint8_t m = ((uint8_t *)&br->br_mask)[bt->bt_off + j];
+
+			a[j] = (((uint8_t *)&br->br_key)[bt->bt_off + j] & m) |
+			    (rnd[j] & (uint8_t)~m);
+		}
+	}
+	return addrs;
+}
+
+static void
+bench_table_setup(struct bench_table *bt, int af)
+{
+	srand(af);
+	bench_table_init(bt, af, af == AF_INET ? BENCH_V4_ROUTES :
+	    BENCH_V6_ROUTES);
+	if (!bench_table_load(bt)) {
+		bench_table_synthesize(bt, bt->bt_maxroutes);
+	}
+	bench_trie_build(bt);
+}
+
+static void
+bench_verify(int af)
+{
+	struct bench_table bt;
+	uint8_t *addrs;
+	uint32_t i, n = BENCH_LOOKUPS / 4;
+
+	bench_table_setup(&bt, af);
+	addrs = bench_addrs(&bt, n);
+	for (i = 0; i < n; i++) {
+		const uint8_t *a = &addrs[i * bt.bt_keylen];
+
+		T_QUIET; T_ASSERT_EQ(poptrie_lookup(bt.bt_trie, a),
+		    bench_radix_lookup(&bt, a), "lookup %u", i);
+	}
+	T_PASS("IPv%d: poptrie matches the radix tree for %u destinations",
+	    af == AF_INET ? 4 : 6, n);
+	free(addrs);
+	bench_table_destroy(&bt);
+}
+
+static void
+bench_measure(int af)
+{
+	struct bench_table bt;
+	uint8_t *addrs;
+	uint64_t start, radix_ns, trie_ns;
+	uint32_t i, sum = 0;
+
+	bench_table_setup(&bt, af);
+	addrs = bench_addrs(&bt, BENCH_LOOKUPS);
+
+	start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+	for (i = 0; i < BENCH_LOOKUPS; i++) {
+		sum += bench_radix_lookup(&bt, &addrs[i * bt.bt_keylen]);
+	}
+	radix_ns = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+
+	start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+	for (i = 0; i < BENCH_LOOKUPS; i++) {
+		sum -= poptrie_lookup(bt.bt_trie, &addrs[i * bt.bt_keylen]);
+	}
+	trie_ns = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+
+	T_EXPECT_EQ(sum, 0u, "same results");
+	T_LOG("IPv%d: radix %.2f Mlookups/s, poptrie %.2f Mlookups/s (%.1fx)",
+	    af == AF_INET ? 4 : 6,
+	    (double)BENCH_LOOKUPS * 1e3 / (double)radix_ns,
+	    (double)BENCH_LOOKUPS * 1e3 / (double)trie_ns,
+	    (double)radix_ns / (double)trie_ns);
+	free(addrs);
+	bench_table_destroy(&bt);
+}
+
+T_DECL(route_fib_verify_inet,
+    "poptrie longest prefix matches agree with the radix tree (IPv4)")
+{
+	bench_verify(AF_INET);
+}
+
+T_DECL(route_fib_verify_inet6,
+    "poptrie longest prefix matches agree with the radix tree (IPv6)")
+{
+	bench_verify(AF_INET6);
+}
+
+T_DECL(route_fib_bench_inet,
+    "Compare poptrie and radix tree lookups/s on a full IPv4 table")
+{
+	bench_measure(AF_INET);
+}
+
+T_DECL(route_fib_bench_inet6,
+    "Compare poptrie and radix tree lookups/s on a full IPv6 table")
+{
+	bench_measure(AF_INET6);
+}
@@ -0,0 +1,38 @@
+// Copyright (c) 2024 Apple Inc.  All rights reserved.
+
+#include "sched_test_harness/sched_policy_darwintest.h"
+#include "sched_test_harness/sched_clutch_harness.h"
+#include "sched_test_harness/sched_replay_harness.h"
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.scheduler"),
+    T_META_RADAR_COMPONENT_NAME("xnu"),
+    T_META_RADAR_COMPONENT_VERSION("scheduler"),
+    T_META_RUN_CONCURRENTLY(true),
+    T_META_OWNER("emily_peterson"));
+
+SCHED_POLICY_T_DECL(replay_trace,
+    "Replay a thread timeline (SCHED_REPLAY_TRACE, or a synthetic one) "
+    "and report scheduling latency and runqueue throughput")
+{
+	init_runqueue_harness();
+
+	FILE *trace = replay_open_trace(root_bucket_to_highest_pri);
+	test_replay_stats_t stats;
+	bool ok = replay_trace(trace, &stats);
+	fclose(trace);
+	T_ASSERT_TRUE(ok, "replayed trace");
+	replay_log_stats(&stats);
+
+	T_EXPECT_GT(stats.rs_wakeups, 0ULL, "trace has wakeups");
+	T_EXPECT_GT(stats.rs_dispatches, 0ULL, "threads were put on core");
+	T_EXPECT_EQ(stats.rs_migrations, 0ULL, "no migrations with a single cluster");
+	for (int b = 0; b < REPLAY_BUCKETS; b++) {
+		if (stats.rs_latency[b].count > 0) {
+			T_PERF(replay_bucket_names[b], (double)stats.rs_latency[b].p99_us, "us", "p99 wakeup to on core latency");
+		}
+	}
+	if (stats.rs_runq_ns != 0) {
+		T_PERF("runq_ops", (double)stats.rs_runq_ops / ((double)stats.rs_runq_ns / NSEC_PER_SEC), "ops/s", "runqueue operations per second");
+	}
+	SCHED_POLICY_PASS("Replayed trace");
+}
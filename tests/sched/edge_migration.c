@@ -163,3 +163,52 @@ SCHED_POLICY_T_DECL(migration_max_parallelism,
 	}
 	SCHED_POLICY_PASS("Correct recommended parallel width for all configurations");
 }
+
+SCHED_POLICY_T_DECL(migration_steal_overloaded,
+    "Verify that idle CPUs steal from the most overloaded cluster, "
+    "preferring clusters on their own die")
+{
+	int ret;
+	init_migration_harness(dual_die);
+	struct thread_group *tg = create_tg(0);
+	/* Make the threads native to the P-clusters, so they aren't rebalanced as foreign threads */
+	set_tg_sched_bucket_preferred_pset(tg, TH_BUCKET_SHARE_DF, 1);
+	test_thread_t threads[4];
+	for (int i = 0; i < 4; i++) {
+		threads[i] = create_thread(TH_BUCKET_SHARE_DF, tg, root_bucket_to_highest_pri[TH_BUCKET_SHARE_DF]);
+	}
+	int idle_ecpu = cluster_id_to_cpu_id(0);
+
+	/* Two overloaded P-clusters on die 0, cluster 1 more so */
+	enqueue_thread(cluster_target(1), threads[0]);
+	set_pset_runnable_depth(1, TH_BUCKET_SHARE_DF, 8);
+	enqueue_thread(cluster_target(2), threads[1]);
+	set_pset_runnable_depth(2, TH_BUCKET_SHARE_DF, 5);
+	ret = cpu_steal_thread_expect(idle_ecpu, threads[0]);
+	T_QUIET; T_EXPECT_TRUE(ret, "Should steal from the most overloaded cluster");
+	ret = steal_stats_expect(1, 0, 1, 1);
+	T_QUIET; T_EXPECT_TRUE(ret, "Steal from cluster 1 accounted");
+	ret = steal_stats_expect(2, 0, 0, 0);
+	T_QUIET; T_EXPECT_TRUE(ret, "Cluster 2 not even considered");
+	SCHED_POLICY_PASS("Steal from the most overloaded cluster");
+
+	/* A more overloaded P-cluster on die 1 */
+	enqueue_thread(cluster_target(4), threads[2]);
+	set_pset_runnable_depth(4, TH_BUCKET_SHARE_DF, 12);
+	ret = cpu_steal_thread_expect(idle_ecpu, threads[1]);
+	T_QUIET; T_EXPECT_TRUE(ret, "Should steal from the overloaded cluster on the same die first");
+	ret = cpu_steal_thread_expect(idle_ecpu, threads[2]);
+	T_QUIET; T_EXPECT_TRUE(ret, "Should steal from the remote die once the local one is drained");
+	SCHED_POLICY_PASS("Steal on the same die first");
+
+	/* P-cluster with a runnable thread but spare capacity */
+	enqueue_thread(cluster_target(1), threads[3]);
+	set_pset_runnable_depth(1, TH_BUCKET_SHARE_DF, 1);
+	ret = cpu_steal_thread_expect(idle_ecpu, NULL);
+	T_QUIET; T_EXPECT_TRUE(ret, "Should not steal from a heterogeneous cluster which isn't overloaded");
+	ret = cpu_steal_thread_expect(cluster_id_to_cpu_id(2), threads[3]);
+	T_QUIET; T_EXPECT_TRUE(ret, "Should still steal from a homogeneous cluster which isn't overloaded");
+	ret = steal_stats_expect(1, 2, 1, 1);
+	T_QUIET; T_EXPECT_TRUE(ret, "Steal from cluster 1 to cluster 2 accounted");
+	SCHED_POLICY_PASS("Only steal from heterogeneous clusters when overloaded");
+}
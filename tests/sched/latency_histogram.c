@@ -0,0 +1,78 @@
+// Copyright (c) 2024 Apple Inc.  All rights reserved.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/sysctl.h>
+
+#include <darwintest.h>
+#include "test_utils.h"
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.scheduler"),
+    T_META_RADAR_COMPONENT_NAME("xnu"),
+    T_META_RADAR_COMPONENT_VERSION("scheduler"),
+    T_META_RUN_CONCURRENTLY(false),
+    T_META_TAG_VM_PREFERRED);
+
+/* Mirrors the layout documented in osfmk/kern/sched_prim.h */
+#define SCHED_LATENCY_HIST_BINS         24
+#define SCHED_LATENCY_HIST_BUCKETS      7
+
+#define NUM_SLEEPS                      200
+
+static uint64_t *
+read_latency_hist(size_t *npsets)
+{
+	size_t size = 0;
+	int ret = sysctlbyname("kern.sched_latency_hist", NULL, &size, NULL, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(ret, "sysctlbyname kern.sched_latency_hist size");
+
+	const size_t pset_size = SCHED_LATENCY_HIST_BUCKETS * SCHED_LATENCY_HIST_BINS * sizeof(uint64_t);
+	T_QUIET; T_ASSERT_GT(size, 0UL, "at least one pset");
+	T_QUIET; T_ASSERT_EQ(size % pset_size, 0UL, "size is a whole number of psets");
+
+	uint64_t *hist = malloc(size);
+	T_QUIET; T_ASSERT_NOTNULL(hist, "malloc");
+	ret = sysctlbyname("kern.sched_latency_hist", hist, &size, NULL, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(ret, "sysctlbyname kern.sched_latency_hist");
+
+	*npsets = size / pset_size;
+	return hist;
+}
+
+static uint64_t
+bucket_total(uint64_t *hist, size_t npsets, int bucket)
+{
+	uint64_t total = 0;
+	for (size_t pset = 0; pset < npsets; pset++) {
+		for (int bin = 0; bin < SCHED_LATENCY_HIST_BINS; bin++) {
+			total += hist[(pset * SCHED_LATENCY_HIST_BUCKETS + bucket) * SCHED_LATENCY_HIST_BINS + bin];
+		}
+	}
+	return total;
+}
+
+T_DECL(sched_latency_hist,
+    "Verify that wakeups are counted in the scheduler latency histograms and can be reset",
+    T_META_ASROOT(true))
+{
+	int one = 1;
+	int ret = sysctlbyname("kern.sched_latency_hist", NULL, NULL, &one, sizeof(one));
+	T_ASSERT_POSIX_SUCCESS(ret, "reset kern.sched_latency_hist");
+
+	/* Each wakeup of this thread is a dispatch counted in its sched bucket */
+	for (int i = 0; i < NUM_SLEEPS; i++) {
+		usleep(1000);
+	}
+
+	size_t npsets;
+	uint64_t *hist = read_latency_hist(&npsets);
+	uint64_t total = 0;
+	T_LOG("%zu psets", npsets);
+	for (int bucket = 0; bucket < SCHED_LATENCY_HIST_BUCKETS; bucket++) {
+		uint64_t dispatches = bucket_total(hist, npsets, bucket);
+		T_LOG("bucket %d: %llu dispatches", bucket, dispatches);
+		total += dispatches;
+	}
+	T_EXPECT_GE(total, (uint64_t)NUM_SLEEPS, "every wakeup of the test thread was counted");
+	free(hist);
+}
@@ -0,0 +1,227 @@
+// Copyright (c) 2024 Apple Inc.  All rights reserved.
+
+#include <stdlib.h>
+#include <time.h>
+
+#include <darwintest.h>
+#include "sched_test_harness/sched_rt_harness.h"
+
+T_GLOBAL_META(T_META_NAMESPACE("xnu.scheduler"),
+    T_META_RADAR_COMPONENT_NAME("xnu"),
+    T_META_RADAR_COMPONENT_VERSION("scheduler"),
+    T_META_RUN_CONCURRENTLY(true),
+    T_META_OWNER("emily_peterson"));
+
+#define RT_PRI_LOW      97
+#define RT_PRI_HIGH     110
+#define RT_CONSTRAINT   10000
+
+T_DECL(rt_runq_deadline_order,
+    "Threads of the same priority come out in deadline order")
+{
+	rt_init_runqueue();
+
+	test_thread_t late = rt_create_thread(RT_PRI_LOW, 300, 10, RT_CONSTRAINT);
+	test_thread_t early = rt_create_thread(RT_PRI_LOW, 100, 10, RT_CONSTRAINT);
+	test_thread_t middle = rt_create_thread(RT_PRI_LOW, 200, 10, RT_CONSTRAINT);
+
+	T_EXPECT_TRUE(rt_enqueue_thread(late), "first thread at a priority preempts");
+	T_EXPECT_TRUE(rt_enqueue_thread(early), "earlier deadline preempts");
+	T_EXPECT_FALSE(rt_enqueue_thread(middle), "later deadline doesn't preempt");
+	T_EXPECT_EQ(rt_runqueue_count(), 3, "count");
+	T_EXPECT_EQ(rt_runqueue_earliest_deadline(), 100ULL, "earliest deadline");
+	T_EXPECT_EQ(rt_first_thread(), early, "first thread");
+
+	T_EXPECT_EQ(rt_dequeue_thread(), early, "dequeue earliest");
+	T_EXPECT_EQ(rt_runqueue_earliest_deadline(), 200ULL, "earliest deadline");
+	T_EXPECT_EQ(rt_dequeue_thread(), middle, "dequeue middle");
+	T_EXPECT_EQ(rt_dequeue_thread(), late, "dequeue latest");
+	T_EXPECT_EQ(rt_runqueue_count(), 0, "count");
+	T_EXPECT_EQ(rt_runqueue_earliest_deadline(), UINT64_MAX, "no earliest deadline");
+	T_EXPECT_NULL(rt_dequeue_thread(), "empty");
+}
+
+T_DECL(rt_runq_fifo_equal_deadlines,
+    "Threads with equal deadlines come out in enqueue order")
+{
+	rt_init_runqueue();
+
+	test_thread_t first = rt_create_thread(RT_PRI_LOW, 100, 10, RT_CONSTRAINT);
+	test_thread_t second = rt_create_thread(RT_PRI_LOW, 100, 10, RT_CONSTRAINT);
+	test_thread_t third = rt_create_thread(RT_PRI_LOW, 100, 10, RT_CONSTRAINT);
+	test_thread_t early = rt_create_thread(RT_PRI_LOW, 50, 10, RT_CONSTRAINT);
+
+	T_EXPECT_TRUE(rt_enqueue_thread(first), "first thread at a priority preempts");
+	T_EXPECT_FALSE(rt_enqueue_thread(second), "equal deadline doesn't preempt");
+	T_EXPECT_FALSE(rt_enqueue_thread(third), "equal deadline doesn't preempt");
+	T_EXPECT_EQ(rt_first_thread(), first, "first thread");
+
+	T_EXPECT_EQ(rt_dequeue_thread(), first, "dequeue first");
+	T_EXPECT_TRUE(rt_enqueue_thread(early), "earlier deadline preempts");
+	T_EXPECT_FALSE(rt_enqueue_thread(first), "re-enqueued thread goes behind");
+	T_EXPECT_EQ(rt_dequeue_thread(), early, "dequeue earliest");
+	T_EXPECT_EQ(rt_dequeue_thread(), second, "dequeue second");
+	T_EXPECT_EQ(rt_dequeue_thread(), third, "dequeue third");
+	T_EXPECT_EQ(rt_dequeue_thread(), first, "dequeue re-enqueued thread");
+
+	/* Across levels with equal earliest deadlines, the oldest thread is the earliest */
+	test_thread_t low = rt_create_thread(RT_PRI_LOW, 100, 10, RT_CONSTRAINT);
+	test_thread_t mid = rt_create_thread(RT_PRI_LOW + 1, 100, 10, RT_CONSTRAINT);
+	test_thread_t high = rt_create_thread(RT_PRI_HIGH, 100, 10, RT_CONSTRAINT);
+	rt_enqueue_thread(low);
+	rt_enqueue_thread(mid);
+	rt_enqueue_thread(high);
+	T_EXPECT_EQ(rt_runqueue_earliest_deadline(), 100ULL, "earliest deadline");
+	T_EXPECT_EQ(rt_dequeue_thread(), low, "dequeue oldest");
+	T_EXPECT_EQ(rt_dequeue_thread(), mid, "dequeue next oldest");
+	T_EXPECT_EQ(rt_dequeue_thread(), high, "dequeue newest");
+	T_EXPECT_NULL(rt_dequeue_thread(), "empty");
+}
+
+T_DECL(rt_runq_edf_across_priorities,
+    "A lower priority, earlier deadline thread runs first when the higher priority thread can afford it")
+{
+	rt_init_runqueue();
+
+	test_thread_t high = rt_create_thread(RT_PRI_HIGH, 1000, 10, RT_CONSTRAINT);
+	test_thread_t low = rt_create_thread(RT_PRI_LOW, 500, 10, RT_CONSTRAINT);
+	rt_enqueue_thread(high);
+	rt_enqueue_thread(low);
+	T_EXPECT_EQ(rt_first_thread(), high, "first thread is the highest priority");
+	T_EXPECT_EQ(rt_dequeue_thread(), low, "earliest deadline wins");
+	T_EXPECT_EQ(rt_dequeue_thread(), high, "then highest priority");
+
+	/* The higher priority thread's constraint can't absorb the lower priority computation */
+	test_thread_t tight = rt_create_thread(RT_PRI_HIGH, 1000, 10, 15);
+	rt_enqueue_thread(tight);
+	rt_enqueue_thread(low);
+	T_EXPECT_EQ(rt_dequeue_thread(), tight, "highest priority wins on a tight constraint");
+	T_EXPECT_EQ(rt_dequeue_thread(), low, "then earliest deadline");
+
+	rt_set_strict_priority(true);
+	rt_enqueue_thread(high);
+	rt_enqueue_thread(low);
+	T_EXPECT_EQ(rt_dequeue_thread(), high, "strict priority");
+	T_EXPECT_EQ(rt_dequeue_thread(), low, "strict priority");
+}
+
+T_DECL(rt_runq_remove,
+    "Removing threads keeps the earliest deadline up to date")
+{
+	rt_init_runqueue();
+
+	test_thread_t a = rt_create_thread(RT_PRI_LOW, 100, 10, RT_CONSTRAINT);
+	test_thread_t b = rt_create_thread(RT_PRI_HIGH, 200, 10, RT_CONSTRAINT);
+	test_thread_t c = rt_create_thread(RT_PRI_LOW, 300, 10, RT_CONSTRAINT);
+	rt_enqueue_thread(a);
+	rt_enqueue_thread(b);
+	rt_enqueue_thread(c);
+
+	rt_remove_thread(c);
+	T_EXPECT_EQ(rt_runqueue_earliest_deadline(), 100ULL, "removing a later deadline");
+	rt_remove_thread(a);
+	T_EXPECT_EQ(rt_runqueue_earliest_deadline(), 200ULL, "removing the earliest deadline");
+	T_EXPECT_EQ(rt_runqueue_count(), 1, "count");
+	rt_remove_thread(b);
+	T_EXPECT_EQ(rt_runqueue_earliest_deadline(), UINT64_MAX, "removing the last thread");
+	T_EXPECT_EQ(rt_runqueue_count(), 0, "count");
+}
+
+#define RT_RAND_PRIS    4
+#define RT_RAND_THREADS 256
+
+T_DECL(rt_runq_random_strict_priority,
+    "Randomized enqueue/dequeue/remove matches priority, deadline then FIFO order")
+{
+	rt_init_runqueue();
+	rt_set_strict_priority(true);
+	srand(377111);
+
+	test_thread_t threads[RT_RAND_THREADS];
+	bool enqueued[RT_RAND_THREADS] = {};
+	uint64_t stamps[RT_RAND_THREADS] = {};
+	uint64_t next_stamp = 0;
+	for (int i = 0; i < RT_RAND_THREADS; i++) {
+		threads[i] = rt_create_thread(RT_PRI_LOW + (rand() % RT_RAND_PRIS), (uint64_t)(rand() % 1000), 10, RT_CONSTRAINT);
+	}
+
+	int count = 0;
+	for (int round = 0; round < 20000; round++) {
+		int i = rand() % RT_RAND_THREADS;
+		int op = rand() % 3;
+		if (!enqueued[i]) {
+			rt_set_thread_deadline(threads[i], (uint64_t)(rand() % 1000));
+			rt_enqueue_thread(threads[i]);
+			enqueued[i] = true;
+			stamps[i] = ++next_stamp;
+			count++;
+		} else if (op == 0) {
+			rt_remove_thread(threads[i]);
+			enqueued[i] = false;
+			count--;
+		} else if (op == 1) {
+			int expected = -1;
+			uint64_t earliest = UINT64_MAX;
+			for (int j = 0; j < RT_RAND_THREADS; j++) {
+				if (!enqueued[j]) {
+					continue;
+				}
+				/* priority, then deadline, then enqueue order */
+				if ((expected == -1) || (rt_get_thread_pri(threads[j]) > rt_get_thread_pri(threads[expected])) ||
+				    ((rt_get_thread_pri(threads[j]) == rt_get_thread_pri(threads[expected])) &&
+				    ((rt_get_thread_deadline(threads[j]) < rt_get_thread_deadline(threads[expected])) ||
+				    ((rt_get_thread_deadline(threads[j]) == rt_get_thread_deadline(threads[expected])) && (stamps[j] < stamps[expected]))))) {
+					expected = j;
+				}
+				if (rt_get_thread_deadline(threads[j]) < earliest) {
+					earliest = rt_get_thread_deadline(threads[j]);
+				}
+			}
+			T_QUIET; T_ASSERT_EQ(rt_runqueue_earliest_deadline(), earliest, "earliest deadline");
+			test_thread_t thread = rt_dequeue_thread();
+			T_QUIET; T_ASSERT_EQ(thread, threads[expected], "priority, deadline and FIFO order");
+			enqueued[expected] = false;
+			count--;
+		}
+		T_QUIET; T_ASSERT_EQ(rt_runqueue_count(), count, "count");
+	}
+	T_PASS("Randomized runqueue operations matched the reference order");
+}
+
+#define RT_BENCH_OPS    (1 << 20)
+
+T_DECL(rt_runq_bench,
+    "Measure the cost of RT runqueue operations against runqueue depth")
+{
+	static const int depths[] = {4, 32, 256, 2048};
+	srand(2738572);
+
+	for (unsigned int d = 0; d < sizeof(depths) / sizeof(depths[0]); d++) {
+		int depth = depths[d];
+		rt_init_runqueue();
+
+		/* Periodic threads spread over a few priorities, as with audio and display workloads */
+		test_thread_t *threads = calloc((size_t)depth, sizeof(test_thread_t));
+		for (int i = 0; i < depth; i++) {
+			threads[i] = rt_create_thread(RT_PRI_LOW + (rand() % RT_RAND_PRIS), (uint64_t)(rand() % 100000), 1000, 100000);
+			rt_enqueue_thread(threads[i]);
+		}
+
+		uint64_t start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+		for (int op = 0; op < RT_BENCH_OPS; op++) {
+			test_thread_t thread = rt_dequeue_thread();
+			rt_set_thread_deadline(thread, rt_get_thread_deadline(thread) + 50000 + (uint64_t)(rand() % 100000));
+			rt_enqueue_thread(thread);
+		}
+		uint64_t elapsed = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) - start;
+
+		T_EXPECT_EQ(rt_runqueue_count(), depth, "runqueue depth preserved");
+		T_LOG("depth %5d: %.1f ns per dequeue+enqueue", depth, (double)elapsed / RT_BENCH_OPS);
+		while (rt_dequeue_thread() != NULL) {
+		}
+		for (int i = 0; i < depth; i++) {
+			free(threads[i]);
+		}
+		free(threads);
+	}
+}
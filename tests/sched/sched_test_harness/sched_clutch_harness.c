@@ -41,6 +41,18 @@ impl_set_thread_processor_bound(test_thread_t thread, int cpu_id)
 	clutch_impl_set_thread_processor_bound(thread, cpu_id);
 }
 
+void
+impl_set_thread_pri(test_thread_t thread, int root_bucket, int pri)
+{
+	clutch_impl_set_thread_pri(thread, root_bucket, pri);
+}
+
+uint64_t
+impl_thread_quantum_us(test_thread_t thread)
+{
+	return clutch_impl_thread_quantum_us(thread);
+}
+
 void
 impl_cpu_set_thread_current(int cpu_id, test_thread_t thread)
 {
@@ -84,3 +96,26 @@ impl_pop_tracepoint(uint64_t *clutch_trace_code, uint64_t *arg1, uint64_t *arg2,
 {
 	clutch_impl_pop_tracepoint(clutch_trace_code, arg1, arg2, arg3, arg4);
 }
+
+/* The Clutch harness mocks a single pset, so the replay harness sends everything there */
+
+int
+impl_choose_pset_for_thread(test_thread_t thread)
+{
+	(void)thread;
+	return 0;
+}
+
+void
+impl_set_current_processor(int cpu_id)
+{
+	assert(cpu_id == 0);
+}
+
+void
+impl_set_tg_sched_bucket_preferred_pset(struct thread_group *tg, int sched_bucket, int cluster_id)
+{
+	(void)tg;
+	(void)sched_bucket;
+	assert(cluster_id == 0);
+}
@@ -27,6 +27,8 @@ extern struct thread_group *clutch_impl_create_tg(int interactivity_score);
 extern test_thread_t clutch_impl_create_thread(int root_bucket, struct thread_group *tg, int pri);
 extern void clutch_impl_set_thread_sched_mode(test_thread_t thread, int mode);
 extern void clutch_impl_set_thread_processor_bound(test_thread_t thread, int cpu_id);
+extern void clutch_impl_set_thread_pri(test_thread_t thread, int root_bucket, int pri);
+extern uint64_t clutch_impl_thread_quantum_us(test_thread_t thread);
 extern void clutch_impl_cpu_set_thread_current(int cpu_id, test_thread_t thread);
 extern void clutch_impl_cpu_clear_thread_current(int cpu_id);
 extern void clutch_impl_log_tracepoint(uint64_t trace_code, uint64_t a1, uint64_t a2, uint64_t a3, uint64_t a4);
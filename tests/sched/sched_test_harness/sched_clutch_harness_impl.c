@@ -216,6 +216,23 @@ clutch_impl_set_thread_processor_bound(test_thread_t thread, int cpu_id)
 	((thread_t)thread)->bound_processor = cpus[cpu_id];
 }
 
+void
+clutch_impl_set_thread_pri(test_thread_t thread, int root_bucket, int pri)
+{
+	/* Should not be enqueued or on core */
+	assert(((thread_t)thread)->__runq.runq == PROCESSOR_NULL);
+	assert((sched_bucket_t)root_bucket == sched_convert_pri_to_bucket(pri) || (sched_bucket_t)root_bucket == TH_BUCKET_FIXPRI);
+	((thread_t)thread)->base_pri = pri;
+	((thread_t)thread)->sched_pri = pri;
+	((thread_t)thread)->th_sched_bucket = root_bucket;
+}
+
+uint64_t
+clutch_impl_thread_quantum_us(test_thread_t thread)
+{
+	return sched_clutch_thread_quantum_us[((thread_t)thread)->th_sched_bucket];
+}
+
 void
 clutch_impl_cpu_set_thread_current(int cpu_id, test_thread_t thread)
 {
@@ -262,6 +262,18 @@ impl_set_thread_processor_bound(test_thread_t thread, int cpu_id)
 	clutch_impl_set_thread_processor_bound(thread, cpu_id);
 }
 
+void
+impl_set_thread_pri(test_thread_t thread, int root_bucket, int pri)
+{
+	clutch_impl_set_thread_pri(thread, root_bucket, pri);
+}
+
+uint64_t
+impl_thread_quantum_us(test_thread_t thread)
+{
+	return clutch_impl_thread_quantum_us(thread);
+}
+
 void
 impl_set_thread_cluster_bound(test_thread_t thread, int cluster_id)
 {
@@ -356,6 +368,33 @@ impl_set_pset_load_avg(int cluster_id, int QoS, uint64_t load_avg)
 	pset_array[cluster_id]->pset_load_average[QoS] = load_avg;
 }
 
+void
+impl_set_pset_runnable_depth(int cluster_id, int QoS, uint32_t depth)
+{
+	assert(QoS >= 0 && QoS < TH_BUCKET_SCHED_MAX);
+	/* Normally published by sched_update_pset_load_average(), which the harness mocks out */
+	pset_array[cluster_id]->pset_runnable_depth[QoS] = depth;
+	sched_edge_pset_overload_update(pset_array[cluster_id]);
+}
+
+test_thread_t
+impl_cpu_steal_thread(int cpu_id)
+{
+	_curr_cpu = cpu_id;
+	return sched_edge_processor_idle(cpus[cpu_id]->processor_set);
+}
+
+void
+impl_get_steal_stats(int src_cluster_id, int dst_cluster_id, uint64_t *attempts, uint64_t *successes)
+{
+	uint64_t stats[2 * MAX_PSETS * MAX_PSETS];
+	uint32_t num_clusters = sched_edge_steal_stats_get(stats, MAX_PSETS * MAX_PSETS);
+	assert(src_cluster_id < (int)num_clusters && dst_cluster_id < (int)num_clusters);
+	int pair = src_cluster_id * (int)num_clusters + dst_cluster_id;
+	*attempts = stats[2 * pair];
+	*successes = stats[2 * pair + 1];
+}
+
 void
 edge_set_thread_shared_rsrc(test_thread_t thread, bool native_first)
 {
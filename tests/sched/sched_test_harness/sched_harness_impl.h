@@ -34,3 +34,10 @@ extern void                  impl_set_pset_load_avg(int cluster_id, int QoS, uin
 extern void                  impl_set_pset_derecommended(int cluster_id);
 extern void                  impl_set_pset_recommended(int cluster_id);
 extern uint32_t              impl_qos_max_parallelism(int qos, uint64_t options);
+extern void                  impl_set_pset_runnable_depth(int cluster_id, int QoS, uint32_t depth);
+extern test_thread_t         impl_cpu_steal_thread(int cpu_id);
+extern void                  impl_get_steal_stats(int src_cluster_id, int dst_cluster_id, uint64_t *attempts, uint64_t *successes);
+
+/* Replay-specific functions */
+extern void                  impl_set_thread_pri(test_thread_t thread, int th_sched_bucket, int pri);
+extern uint64_t              impl_thread_quantum_us(test_thread_t thread);
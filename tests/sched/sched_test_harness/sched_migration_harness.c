@@ -72,6 +72,34 @@ set_pset_derecommended(int cluster_id)
 	impl_set_pset_derecommended(cluster_id);
 }
 
+void
+set_pset_runnable_depth(int cluster_id, int QoS, uint32_t depth)
+{
+	fprintf(_log, "\tset pset_runnable_depth for cluster %d QoS %d to %u\n", cluster_id, QoS, depth);
+	impl_set_pset_runnable_depth(cluster_id, QoS, depth);
+}
+
+bool
+cpu_steal_thread_expect(int cpu_id, test_thread_t expected_thread)
+{
+	test_thread_t stolen_thread = impl_cpu_steal_thread(cpu_id);
+	fprintf(_log, "%s: cpu %d stole thread %p, expecting %p\n", stolen_thread == expected_thread ?
+	    "PASS" : "FAIL", cpu_id, (void *)stolen_thread, (void *)expected_thread);
+	return stolen_thread == expected_thread;
+}
+
+bool
+steal_stats_expect(int src_cluster_id, int dst_cluster_id, uint64_t expected_attempts, uint64_t expected_successes)
+{
+	uint64_t attempts = 0, successes = 0;
+	impl_get_steal_stats(src_cluster_id, dst_cluster_id, &attempts, &successes);
+	bool pass = (attempts == expected_attempts) && (successes == expected_successes);
+	fprintf(_log, "%s: steals from cluster %d to cluster %d: %llu/%llu succeeded, expecting %llu/%llu\n",
+	    pass ? "PASS" : "FAIL", src_cluster_id, dst_cluster_id, successes, attempts,
+	    expected_successes, expected_attempts);
+	return pass;
+}
+
 bool
 ipi_expect(int cpu_id, test_ipi_type_t ipi_type)
 {
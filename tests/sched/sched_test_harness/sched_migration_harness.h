@@ -45,6 +45,9 @@ extern void      set_current_processor(int cpu_id);
 extern void      set_pset_load_avg(int cluster_id, int QoS, uint64_t load_avg);
 extern void      set_pset_recommended(int cluster_id);
 extern void      set_pset_derecommended(int cluster_id);
+extern void      set_pset_runnable_depth(int cluster_id, int QoS, uint32_t depth);
+extern bool      cpu_steal_thread_expect(int cpu_id, test_thread_t expected_thread);
+extern bool      steal_stats_expect(int src_cluster_id, int dst_cluster_id, uint64_t expected_attempts, uint64_t expected_successes);
 typedef enum {
 	TEST_IPI_NONE              = 0x0,
 	TEST_IPI_IMMEDIATE         = 0x1,
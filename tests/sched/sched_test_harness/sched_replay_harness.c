@@ -0,0 +1,781 @@
+// Copyright (c) 2024 Apple Inc.  All rights reserved.
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <mach/clock_types.h>
+
+#include <darwintest.h>
+#include <darwintest_utils.h>
+
+#include "sched_replay_harness.h"
+#include "sched_harness_impl.h"
+
+#define REPLAY_TH_MODE_FIXED    2 /* Mirrors TH_MODE_FIXED */
+#define REPLAY_MAX_ID           (1 << 20)
+#define REPLAY_MAX_TOKENS       8
+
+#define SYNTHETIC_SEED          4242
+#define SYNTHETIC_TGS           4
+#define SYNTHETIC_THREADS       48
+#define SYNTHETIC_DURATION_US   (2 * USEC_PER_SEC)
+
+const char *replay_bucket_names[REPLAY_BUCKETS] = {
+	"FIXPRI", "FG", "IN", "DF", "UT", "BG",
+};
+
+typedef enum {
+	REPLAY_THREAD_UNUSED = 0,
+	REPLAY_THREAD_BLOCKED,
+	REPLAY_THREAD_RUNNABLE,
+	REPLAY_THREAD_RUNNING,
+} replay_thread_state_t;
+
+typedef struct {
+	test_thread_t         rt_thread;
+	replay_thread_state_t rt_state;
+	int                   rt_bucket;
+	int                   rt_cpu;           /* while running */
+	int                   rt_last_cluster;
+	bool                  rt_woken;         /* runnable because of a wakeup, not a preemption */
+	bool                  rt_block_pending; /* blocked by the trace while still runnable */
+	bool                  rt_pri_pending;
+	int                   rt_next_bucket;
+	int                   rt_next_pri;
+	uint64_t              rt_runnable_us;
+} replay_thread_t;
+
+typedef struct {
+	int                   rc_thread;        /* running thread id, or -1 when idle */
+	uint64_t              rc_quantum_end_us;
+} replay_cpu_t;
+
+typedef struct {
+	uint64_t             *samples;
+	size_t                count;
+	size_t                capacity;
+} replay_samples_t;
+
+typedef struct {
+	test_thread_t         rm_thread;
+	int                   rm_id;
+} replay_map_entry_t;
+
+static struct {
+	struct thread_group **tgs;
+	size_t                num_tgs;
+	replay_thread_t      *threads;
+	size_t                num_threads;
+	replay_map_entry_t   *map;              /* test_thread_t -> thread id */
+	size_t                map_count;
+	size_t                map_capacity;
+	replay_cpu_t         *cpus;
+	int                   num_cpus;
+	uint64_t              now_us;
+	replay_samples_t      latency[REPLAY_BUCKETS];
+	test_replay_stats_t  *stats;
+} replay;
+
+/* Bookkeeping */
+
+static void *
+replay_grow(void *array, size_t *count, size_t id, size_t elem_size)
+{
+	if (id < *count) {
+		return array;
+	}
+	size_t new_count = *count ? *count : 16;
+	while (new_count <= id) {
+		new_count *= 2;
+	}
+	array = realloc(array, new_count * elem_size);
+	T_QUIET; T_ASSERT_NOTNULL(array, "realloc");
+	memset((char *)array + *count * elem_size, 0, (new_count - *count) * elem_size);
+	*count = new_count;
+	return array;
+}
+
+static size_t
+replay_map_slot(test_thread_t thread)
+{
+	uintptr_t h = (uintptr_t)thread;
+	h ^= h >> 17;
+	h *= 0x9E3779B97F4A7C15ull;
+	size_t slot = (size_t)(h >> 32) & (replay.map_capacity - 1);
+	while (replay.map[slot].rm_thread != NULL && replay.map[slot].rm_thread != thread) {
+		slot = (slot + 1) & (replay.map_capacity - 1);
+	}
+	return slot;
+}
+
+static void
+replay_map_insert(test_thread_t thread, int id)
+{
+	if (2 * (replay.map_count + 1) > replay.map_capacity) {
+		replay_map_entry_t *old = replay.map;
+		size_t old_capacity = replay.map_capacity;
+
+		replay.map_capacity = old_capacity ? 2 * old_capacity : 64;
+		replay.map = calloc(replay.map_capacity, sizeof(replay_map_entry_t));
+		T_QUIET; T_ASSERT_NOTNULL(replay.map, "calloc");
+		for (size_t i = 0; i < old_capacity; i++) {
+			if (old[i].rm_thread != NULL) {
+				replay.map[replay_map_slot(old[i].rm_thread)] = old[i];
+			}
+		}
+		free(old);
+	}
+	replay_map_entry_t *entry = &replay.map[replay_map_slot(thread)];
+	entry->rm_thread = thread;
+	entry->rm_id = id;
+	replay.map_count++;
+}
+
+static int
+replay_map_lookup(test_thread_t thread)
+{
+	replay_map_entry_t *entry = &replay.map[replay_map_slot(thread)];
+	T_QUIET; T_ASSERT_EQ_PTR(entry->rm_thread, thread, "thread %p was created by the replay", thread);
+	return entry->rm_id;
+}
+
+static void
+replay_add_sample(int bucket, uint64_t latency_us)
+{
+	replay_samples_t *s = &replay.latency[bucket];
+	if (s->count == s->capacity) {
+		s->capacity = s->capacity ? 2 * s->capacity : 1024;
+		s->samples = realloc(s->samples, s->capacity * sizeof(uint64_t));
+		T_QUIET; T_ASSERT_NOTNULL(s->samples, "realloc");
+	}
+	s->samples[s->count++] = latency_us;
+}
+
+/* Timed calls into the policy-under-test */
+
+static uint64_t
+replay_wall_ns(void)
+{
+	/* mach_absolute_time() is mocked by the harness */
+	return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+static void
+replay_account_op(uint64_t start_ns)
+{
+	replay.stats->rs_runq_ops++;
+	replay.stats->rs_runq_ns += replay_wall_ns() - start_ns;
+}
+
+static void
+replay_enqueue(int cpu_id, int id)
+{
+	uint64_t start = replay_wall_ns();
+	impl_cpu_enqueue_thread(cpu_id, replay.threads[id].rt_thread);
+	replay_account_op(start);
+}
+
+static test_thread_t
+replay_dequeue(int cpu_id)
+{
+	uint64_t start = replay_wall_ns();
+	test_thread_t thread = impl_cpu_dequeue_thread(cpu_id);
+	replay_account_op(start);
+	return thread;
+}
+
+static test_thread_t
+replay_dequeue_compare_current(int cpu_id)
+{
+	uint64_t start = replay_wall_ns();
+	test_thread_t thread = impl_cpu_dequeue_thread_compare_current(cpu_id);
+	replay_account_op(start);
+	return thread;
+}
+
+static bool
+replay_csw_check(int cpu_id)
+{
+	uint64_t start = replay_wall_ns();
+	bool preempt = impl_processor_csw_check(cpu_id);
+	replay_account_op(start);
+	return preempt;
+}
+
+static int
+replay_choose_cluster(int id)
+{
+	replay_thread_t *rt = &replay.threads[id];
+	int hint = rt->rt_last_cluster != -1 ? cluster_id_to_cpu_id(rt->rt_last_cluster) : get_default_cpu();
+	impl_set_current_processor(hint);
+	uint64_t start = replay_wall_ns();
+	int cluster = impl_choose_pset_for_thread(rt->rt_thread);
+	replay_account_op(start);
+	return cluster;
+}
+
+/* Simulated CPUs */
+
+static void
+replay_set_time(uint64_t time_us)
+{
+	if (time_us > replay.now_us) {
+		increment_mock_time_us(time_us - replay.now_us);
+		replay.now_us = time_us;
+	}
+}
+
+static void
+replay_apply_pri(int id)
+{
+	replay_thread_t *rt = &replay.threads[id];
+	if (rt->rt_pri_pending) {
+		impl_set_thread_pri(rt->rt_thread, rt->rt_next_bucket, rt->rt_next_pri);
+		rt->rt_bucket = rt->rt_next_bucket;
+		rt->rt_pri_pending = false;
+	}
+}
+
+static void
+replay_make_runnable(int id, bool woken)
+{
+	replay_thread_t *rt = &replay.threads[id];
+	rt->rt_state = REPLAY_THREAD_RUNNABLE;
+	rt->rt_woken = woken;
+	rt->rt_runnable_us = replay.now_us;
+}
+
+static void
+replay_block(int id)
+{
+	replay_thread_t *rt = &replay.threads[id];
+	rt->rt_state = REPLAY_THREAD_BLOCKED;
+	rt->rt_block_pending = false;
+	replay_apply_pri(id);
+}
+
+/*
+ * Puts a thread chosen by the policy on core. Returns false if the trace
+ * already blocked it, in which case the CPU still needs a thread.
+ */
+static bool
+replay_put_on_core(int cpu_id, int id)
+{
+	replay_thread_t *rt = &replay.threads[id];
+	int cluster = cpu_id_to_cluster_id(cpu_id);
+
+	replay.stats->rs_dispatches++;
+	if (rt->rt_woken) {
+		replay_add_sample(rt->rt_bucket, replay.now_us - rt->rt_runnable_us);
+		rt->rt_woken = false;
+	}
+	if (rt->rt_last_cluster != -1 && rt->rt_last_cluster != cluster) {
+		replay.stats->rs_migrations++;
+	}
+	rt->rt_last_cluster = cluster;
+
+	if (rt->rt_block_pending) {
+		replay.stats->rs_late_blocks++;
+		replay_block(id);
+		return false;
+	}
+
+	rt->rt_state = REPLAY_THREAD_RUNNING;
+	rt->rt_cpu = cpu_id;
+	replay.cpus[cpu_id].rc_thread = id;
+	replay.cpus[cpu_id].rc_quantum_end_us = replay.now_us + impl_thread_quantum_us(rt->rt_thread);
+	impl_cpu_set_thread_current(cpu_id, rt->rt_thread);
+	return true;
+}
+
+static void
+replay_dispatch(int cpu_id)
+{
+	test_thread_t thread;
+
+	assert(replay.cpus[cpu_id].rc_thread == -1);
+	while ((thread = replay_dequeue(cpu_id)) != NULL) {
+		if (replay_put_on_core(cpu_id, replay_map_lookup(thread))) {
+			return;
+		}
+	}
+}
+
+static void
+replay_take_off_core(int cpu_id)
+{
+	replay.threads[replay.cpus[cpu_id].rc_thread].rt_cpu = -1;
+	replay.cpus[cpu_id].rc_thread = -1;
+	impl_cpu_clear_thread_current(cpu_id);
+}
+
+static void
+replay_preempt(int cpu_id)
+{
+	int id = replay.cpus[cpu_id].rc_thread;
+
+	replay.stats->rs_preemptions++;
+	replay_take_off_core(cpu_id);
+	replay_make_runnable(id, false);
+	replay_enqueue(cpu_id, id);
+}
+
+static void
+replay_quantum_expire(int cpu_id)
+{
+	int id = replay.cpus[cpu_id].rc_thread;
+	test_thread_t current = replay.threads[id].rt_thread;
+	test_thread_t chosen = replay_dequeue_compare_current(cpu_id);
+
+	if (chosen == current) {
+		replay.cpus[cpu_id].rc_quantum_end_us = replay.now_us + impl_thread_quantum_us(current);
+		return;
+	}
+	/* chosen has been removed from the runqueue */
+	replay_preempt(cpu_id);
+	if (!replay_put_on_core(cpu_id, replay_map_lookup(chosen))) {
+		replay_dispatch(cpu_id);
+	}
+}
+
+static void
+replay_advance(uint64_t time_us)
+{
+	for (;;) {
+		int cpu_id = -1;
+		uint64_t earliest = time_us;
+		for (int c = 0; c < replay.num_cpus; c++) {
+			if (replay.cpus[c].rc_thread != -1 && replay.cpus[c].rc_quantum_end_us <= earliest) {
+				earliest = replay.cpus[c].rc_quantum_end_us;
+				cpu_id = c;
+			}
+		}
+		if (cpu_id == -1) {
+			break;
+		}
+		replay_set_time(earliest);
+		replay_quantum_expire(cpu_id);
+	}
+	replay_set_time(time_us);
+}
+
+/* Trace events */
+
+static void
+replay_wakeup(int id)
+{
+	replay_thread_t *rt = &replay.threads[id];
+
+	if (rt->rt_state == REPLAY_THREAD_RUNNABLE && rt->rt_block_pending) {
+		/* blocked and woken again before the policy picked it, it's still enqueued */
+		rt->rt_block_pending = false;
+		replay.stats->rs_wakeups++;
+		rt->rt_woken = true;
+		rt->rt_runnable_us = replay.now_us;
+		return;
+	}
+	if (rt->rt_state != REPLAY_THREAD_BLOCKED) {
+		fprintf(_log, "\treplay: wakeup of thread %d which isn't blocked, ignored\n", id);
+		return;
+	}
+	replay_apply_pri(id);
+	replay.stats->rs_wakeups++;
+
+	int cluster = replay_choose_cluster(id);
+	test_hw_topology_t topo = get_hw_topology();
+	int first_cpu = cluster_id_to_cpu_id(cluster);
+	int num_cpus = topo.psets[cluster].num_cpus;
+
+	replay_make_runnable(id, true);
+	replay_enqueue(first_cpu, id);
+
+	for (int c = first_cpu; c < first_cpu + num_cpus; c++) {
+		if (replay.cpus[c].rc_thread == -1) {
+			replay_dispatch(c);
+			return;
+		}
+	}
+	for (int c = first_cpu; c < first_cpu + num_cpus; c++) {
+		if (replay_csw_check(c)) {
+			replay_preempt(c);
+			replay_dispatch(c);
+			return;
+		}
+	}
+}
+
+static void
+replay_block_event(int id)
+{
+	replay_thread_t *rt = &replay.threads[id];
+
+	switch (rt->rt_state) {
+	case REPLAY_THREAD_RUNNING: {
+		int cpu_id = rt->rt_cpu;
+		replay_take_off_core(cpu_id);
+		replay_block(id);
+		replay_dispatch(cpu_id);
+		break;
+	}
+	case REPLAY_THREAD_RUNNABLE:
+		/* Can't pull it out of the runqueue, block it once the policy picks it */
+		rt->rt_block_pending = true;
+		break;
+	default:
+		fprintf(_log, "\treplay: block of thread %d which isn't running, ignored\n", id);
+		break;
+	}
+}
+
+static void
+replay_setpri(int id, int bucket, int pri)
+{
+	replay_thread_t *rt = &replay.threads[id];
+
+	rt->rt_next_bucket = bucket;
+	rt->rt_next_pri = pri;
+	rt->rt_pri_pending = true;
+	/* Only re-prioritize threads which aren't enqueued or on core */
+	if (rt->rt_state == REPLAY_THREAD_BLOCKED) {
+		replay_apply_pri(id);
+	}
+}
+
+/* Trace parsing */
+
+static bool
+replay_parse_bucket(const char *token, int *bucket)
+{
+	for (int b = 0; b < REPLAY_BUCKETS; b++) {
+		if (strcmp(token, replay_bucket_names[b]) == 0) {
+			*bucket = b;
+			return true;
+		}
+	}
+	char *end;
+	long value = strtol(token, &end, 10);
+	if (*end != '\0' || value < 0 || value >= REPLAY_BUCKETS) {
+		return false;
+	}
+	*bucket = (int)value;
+	return true;
+}
+
+static bool
+replay_parse_int(const char *token, long min, long max, long *value)
+{
+	char *end;
+	*value = strtol(token, &end, 10);
+	return *end == '\0' && *value >= min && *value <= max;
+}
+
+static bool
+replay_thread_id(const char *token, int *id)
+{
+	long value;
+	if (!replay_parse_int(token, 0, REPLAY_MAX_ID, &value) ||
+	    (size_t)value >= replay.num_threads ||
+	    replay.threads[value].rt_state == REPLAY_THREAD_UNUSED) {
+		return false;
+	}
+	*id = (int)value;
+	return true;
+}
+
+static bool
+replay_tg(const char *token, struct thread_group **tg)
+{
+	long value;
+	if (!replay_parse_int(token, 0, REPLAY_MAX_ID, &value) ||
+	    (size_t)value >= replay.num_tgs || replay.tgs[value] == NULL) {
+		return false;
+	}
+	*tg = replay.tgs[value];
+	return true;
+}
+
+static bool
+replay_record(char **tok, int ntok, uint64_t *first_us, uint64_t *last_us)
+{
+	struct thread_group *tg;
+	long value, pri, time_us;
+	int id, bucket;
+
+	if (strcmp(tok[0], "tg") == 0) {
+		long score;
+		if (ntok != 3 || !replay_parse_int(tok[1], 0, REPLAY_MAX_ID, &value) ||
+		    !replay_parse_int(tok[2], -1, INT32_MAX, &score)) {
+			return false;
+		}
+		replay.tgs = replay_grow(replay.tgs, &replay.num_tgs, (size_t)value, sizeof(replay.tgs[0]));
+		if (replay.tgs[value] != NULL) {
+			return false;
+		}
+		replay.tgs[value] = create_tg((int)score);
+		return true;
+	}
+
+	if (strcmp(tok[0], "thread") == 0) {
+		if ((ntok != 5 && ntok != 6) || !replay_parse_int(tok[1], 0, REPLAY_MAX_ID, &value) ||
+		    !replay_tg(tok[2], &tg) || !replay_parse_bucket(tok[3], &bucket) ||
+		    !replay_parse_int(tok[4], 0, 127, &pri) ||
+		    (ntok == 6 && strcmp(tok[5], "fixed") != 0)) {
+			return false;
+		}
+		replay.threads = replay_grow(replay.threads, &replay.num_threads, (size_t)value,
+		    sizeof(replay.threads[0]));
+		replay_thread_t *rt = &replay.threads[value];
+		if (rt->rt_state != REPLAY_THREAD_UNUSED) {
+			return false;
+		}
+		rt->rt_thread = create_thread(bucket, tg, (int)pri);
+		if (ntok == 6) {
+			set_thread_sched_mode(rt->rt_thread, REPLAY_TH_MODE_FIXED);
+		}
+		rt->rt_state = REPLAY_THREAD_BLOCKED;
+		rt->rt_bucket = bucket;
+		rt->rt_cpu = -1;
+		rt->rt_last_cluster = -1;
+		replay_map_insert(rt->rt_thread, (int)value);
+		return true;
+	}
+
+	/* Timestamped events */
+	if (ntok < 3 || !replay_parse_int(tok[0], 0, LONG_MAX, &time_us) ||
+	    (*first_us != UINT64_MAX && (uint64_t)time_us < *last_us)) {
+		return false;
+	}
+	if (*first_us == UINT64_MAX) {
+		*first_us = (uint64_t)time_us;
+		replay.now_us = (uint64_t)time_us;
+	}
+	*last_us = (uint64_t)time_us;
+	replay_advance((uint64_t)time_us);
+	replay.stats->rs_events++;
+
+	if (strcmp(tok[1], "wakeup") == 0 && ntok == 3 && replay_thread_id(tok[2], &id)) {
+		replay_wakeup(id);
+	} else if (strcmp(tok[1], "block") == 0 && ntok == 3 && replay_thread_id(tok[2], &id)) {
+		replay_block_event(id);
+	} else if (strcmp(tok[1], "setpri") == 0 && ntok == 5 && replay_thread_id(tok[2], &id) &&
+	    replay_parse_bucket(tok[3], &bucket) && replay_parse_int(tok[4], 0, 127, &pri)) {
+		replay_setpri(id, bucket, (int)pri);
+	} else if (strcmp(tok[1], "recommend") == 0 && ntok == 5 && replay_tg(tok[2], &tg) &&
+	    replay_parse_bucket(tok[3], &bucket) && bucket > 0 &&
+	    replay_parse_int(tok[4], 0, get_hw_topology().num_psets - 1, &value)) {
+		fprintf(_log, "\treplay: TG %p bucket %d recommended for pset %ld\n", (void *)tg, bucket, value);
+		impl_set_tg_sched_bucket_preferred_pset(tg, bucket, (int)value);
+	} else {
+		return false;
+	}
+	return true;
+}
+
+static int
+replay_compare_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return (x > y) - (x < y);
+}
+
+static void
+replay_compute_latency(void)
+{
+	for (int b = 0; b < REPLAY_BUCKETS; b++) {
+		replay_samples_t *s = &replay.latency[b];
+		test_replay_latency_t *l = &replay.stats->rs_latency[b];
+
+		l->count = s->count;
+		if (s->count == 0) {
+			continue;
+		}
+		qsort(s->samples, s->count, sizeof(uint64_t), replay_compare_u64);
+		l->p50_us = s->samples[(s->count - 1) * 50 / 100];
+		l->p90_us = s->samples[(s->count - 1) * 90 / 100];
+		l->p99_us = s->samples[(s->count - 1) * 99 / 100];
+		l->max_us = s->samples[s->count - 1];
+	}
+}
+
+bool
+replay_trace(FILE *trace, test_replay_stats_t *stats)
+{
+	test_hw_topology_t topo = get_hw_topology();
+	uint64_t first_us = UINT64_MAX, last_us = 0;
+	char *line = NULL;
+	size_t line_capacity = 0;
+	unsigned int lineno = 0;
+	bool ok = true;
+
+	memset(stats, 0, sizeof(*stats));
+	replay.stats = stats;
+	replay.num_cpus = 0;
+	for (int p = 0; p < topo.num_psets; p++) {
+		replay.num_cpus += topo.psets[p].num_cpus;
+	}
+	replay.cpus = calloc((size_t)replay.num_cpus, sizeof(replay_cpu_t));
+	T_QUIET; T_ASSERT_NOTNULL(replay.cpus, "calloc");
+	for (int c = 0; c < replay.num_cpus; c++) {
+		replay.cpus[c].rc_thread = -1;
+	}
+	fprintf(_log, "\treplaying trace on %d cpus\n", replay.num_cpus);
+
+	while (ok && getline(&line, &line_capacity, trace) != -1) {
+		char *tok[REPLAY_MAX_TOKENS];
+		char *comment, *save = NULL;
+		int ntok = 0;
+
+		lineno++;
+		if ((comment = strchr(line, '#')) != NULL) {
+			*comment = '\0';
+		}
+		for (char *t = strtok_r(line, " \t\r\n", &save); t != NULL && ntok < REPLAY_MAX_TOKENS;
+		    t = strtok_r(NULL, " \t\r\n", &save)) {
+			tok[ntok++] = t;
+		}
+		if (ntok == 0) {
+			continue;
+		}
+		ok = replay_record(tok, ntok, &first_us, &last_us);
+		if (!ok) {
+			T_LOG("replay: malformed record on line %u", lineno);
+		}
+	}
+	free(line);
+
+	stats->rs_trace_us = first_us == UINT64_MAX ? 0 : last_us - first_us;
+	replay_compute_latency();
+	return ok;
+}
+
+void
+replay_log_stats(const test_replay_stats_t *stats)
+{
+	double trace_s = (double)stats->rs_trace_us / USEC_PER_SEC;
+	double runq_s = (double)stats->rs_runq_ns / NSEC_PER_SEC;
+
+	T_LOG("replayed %llu events over %.3fs of trace", stats->rs_events, trace_s);
+	T_LOG("%llu wakeups, %llu dispatches, %llu preemptions, %llu migrations, %llu late blocks",
+	    stats->rs_wakeups, stats->rs_dispatches, stats->rs_preemptions,
+	    stats->rs_migrations, stats->rs_late_blocks);
+	T_LOG("%llu runqueue operations, %.0f ops/s of trace, %.0f ops/s of wall time",
+	    stats->rs_runq_ops, trace_s > 0 ? (double)stats->rs_runq_ops / trace_s : 0.0,
+	    runq_s > 0 ? (double)stats->rs_runq_ops / runq_s : 0.0);
+	for (int b = 0; b < REPLAY_BUCKETS; b++) {
+		const test_replay_latency_t *l = &stats->rs_latency[b];
+		if (l->count == 0) {
+			continue;
+		}
+		T_LOG("%-6s latency (us): %8llu samples, p50 %6llu, p90 %6llu, p99 %6llu, max %6llu",
+		    replay_bucket_names[b], l->count, l->p50_us, l->p90_us, l->p99_us, l->max_us);
+	}
+}
+
+/* Synthetic traces */
+
+typedef struct {
+	uint64_t se_time_us;
+	int      se_block;              /* blocks sort before wakeups at the same time */
+	int      se_thread;
+} synthetic_event_t;
+
+static int
+synthetic_event_compare(const void *a, const void *b)
+{
+	const synthetic_event_t *x = a, *y = b;
+	if (x->se_time_us != y->se_time_us) {
+		return x->se_time_us < y->se_time_us ? -1 : 1;
+	}
+	if (x->se_block != y->se_block) {
+		return y->se_block - x->se_block;
+	}
+	return x->se_thread - y->se_thread;
+}
+
+static int
+synthetic_first_cluster(test_cpu_type_t cpu_type)
+{
+	test_hw_topology_t topo = get_hw_topology();
+	for (int p = 0; p < topo.num_psets; p++) {
+		if (topo.psets[p].cpu_type == cpu_type) {
+			return p;
+		}
+	}
+	return 0;
+}
+
+static void
+replay_write_synthetic_trace(FILE *trace, const int *bucket_pri)
+{
+	synthetic_event_t *events = NULL;
+	size_t num_events = 0, capacity = 0;
+
+	srand(SYNTHETIC_SEED);
+	fprintf(trace, "# synthetic trace, seed %d\n", SYNTHETIC_SEED);
+	for (int tg = 0; tg < SYNTHETIC_TGS; tg++) {
+		fprintf(trace, "tg %d -1\n", tg);
+	}
+	for (int t = 0; t < SYNTHETIC_THREADS; t++) {
+		/* Skip FIXPRI, cycle through the timeshare buckets */
+		int bucket = 1 + t % (REPLAY_BUCKETS - 1);
+		fprintf(trace, "thread %d %d %s %d\n", t, t % SYNTHETIC_TGS,
+		    replay_bucket_names[bucket], bucket_pri[bucket]);
+
+		/* Alternate bursts of work and sleeps, background work runs longer */
+		uint64_t time_us = (uint64_t)(rand() % 1000);
+		while (time_us < SYNTHETIC_DURATION_US) {
+			uint64_t burst_us = 50 + (uint64_t)(rand() % (bucket >= 4 ? 8000 : 2000));
+			uint64_t sleep_us = 200 + (uint64_t)(rand() % 10000);
+			if (num_events + 2 > capacity) {
+				capacity = capacity ? 2 * capacity : 4096;
+				events = realloc(events, capacity * sizeof(synthetic_event_t));
+				T_QUIET; T_ASSERT_NOTNULL(events, "realloc");
+			}
+			events[num_events++] = (synthetic_event_t){ time_us, 0, t };
+			events[num_events++] = (synthetic_event_t){ time_us + burst_us, 1, t };
+			time_us += burst_us + sleep_us;
+		}
+	}
+
+	if (get_hw_topology().num_psets > 1) {
+		int p_cluster = synthetic_first_cluster(TEST_CPU_TYPE_PERFORMANCE);
+		int e_cluster = synthetic_first_cluster(TEST_CPU_TYPE_EFFICIENCY);
+		for (int tg = 0; tg < SYNTHETIC_TGS; tg++) {
+			for (int bucket = 1; bucket < REPLAY_BUCKETS; bucket++) {
+				fprintf(trace, "0 recommend %d %s %d\n", tg, replay_bucket_names[bucket],
+				    bucket <= 3 ? p_cluster : e_cluster);
+			}
+		}
+	}
+
+	qsort(events, num_events, sizeof(synthetic_event_t), synthetic_event_compare);
+	for (size_t i = 0; i < num_events; i++) {
+		fprintf(trace, "%llu %s %d\n", events[i].se_time_us,
+		    events[i].se_block ? "block" : "wakeup", events[i].se_thread);
+	}
+	free(events);
+}
+
+FILE *
+replay_open_trace(const int *bucket_pri)
+{
+	const char *path = getenv(REPLAY_TRACE_ENV);
+	FILE *trace;
+
+	if (path != NULL) {
+		trace = fopen(path, "r");
+		T_QUIET; T_WITH_ERRNO; T_ASSERT_NOTNULL(trace, "fopen(%s)", path);
+		T_LOG("replaying %s", path);
+		return trace;
+	}
+
+	trace = tmpfile();
+	T_QUIET; T_WITH_ERRNO; T_ASSERT_NOTNULL(trace, "tmpfile");
+	replay_write_synthetic_trace(trace, bucket_pri);
+	rewind(trace);
+	T_LOG("replaying a synthetic trace (set %s to replay a recorded one)", REPLAY_TRACE_ENV);
+	return trace;
+}
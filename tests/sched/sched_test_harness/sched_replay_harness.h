@@ -0,0 +1,69 @@
+// Copyright (c) 2024 Apple Inc.  All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "sched_runqueue_harness.h"
+#include "sched_migration_harness.h"
+
+/*
+ * Replays a recorded thread timeline against the policy-under-test.
+ *
+ * The trace is a text file with one record per line, '#' starting a comment:
+ *
+ *   tg <tg> <interactivity score, or -1>
+ *   thread <tid> <tg> <bucket> <pri> [fixed]
+ *   <time_us> wakeup <tid>
+ *   <time_us> block <tid>
+ *   <time_us> setpri <tid> <bucket> <pri>
+ *   <time_us> recommend <tg> <bucket> <cluster>
+ *
+ * Buckets are named as in th_bucket_t (FIXPRI, FG, IN, DF, UT, BG) or given
+ * by number. Timestamps must not go backwards. tg and thread records must
+ * precede the events referencing them.
+ *
+ * The trace decides when threads become runnable and when they block; the
+ * policy decides where and when they run in between. Threads that aren't
+ * blocked by the trace run until their quantum expires, at which point the
+ * policy may switch to another thread.
+ */
+
+#define REPLAY_BUCKETS 6 /* Mirrors TH_BUCKET_SCHED_MAX */
+
+typedef struct {
+	uint64_t count;
+	uint64_t p50_us;
+	uint64_t p90_us;
+	uint64_t p99_us;
+	uint64_t max_us;
+} test_replay_latency_t;
+
+typedef struct {
+	uint64_t              rs_events;
+	uint64_t              rs_trace_us;        /* span of the replayed timeline */
+	uint64_t              rs_wakeups;
+	uint64_t              rs_dispatches;      /* threads put on core */
+	uint64_t              rs_preemptions;
+	uint64_t              rs_migrations;      /* put on core on a different cluster than last time */
+	uint64_t              rs_late_blocks;     /* blocked by the trace before the policy ran them */
+	uint64_t              rs_runq_ops;        /* calls into the policy's runqueue code */
+	uint64_t              rs_runq_ns;         /* wall time spent in those calls */
+	test_replay_latency_t rs_latency[REPLAY_BUCKETS]; /* wakeup to on core */
+} test_replay_stats_t;
+
+extern const char           *replay_bucket_names[REPLAY_BUCKETS];
+
+/*
+ * Opens the trace named by the SCHED_REPLAY_TRACE environment variable, or
+ * generates a synthetic one mixing threads of every timeshare bucket, using
+ * bucket_pri[] as their priorities, for the current topology.
+ */
+#define REPLAY_TRACE_ENV "SCHED_REPLAY_TRACE"
+extern FILE                 *replay_open_trace(const int *bucket_pri);
+
+/* Replays the whole trace, returns false if it is malformed */
+extern bool                  replay_trace(FILE *trace, test_replay_stats_t *stats);
+extern void                  replay_log_stats(const test_replay_stats_t *stats);
@@ -0,0 +1,116 @@
+// Copyright (c) 2024 Apple Inc.  All rights reserved.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Harness interface */
+#include "sched_rt_harness.h"
+
+/* Include kernel header depdencies */
+#include "shadow_headers/misc_needed_defines.h"
+#include <kern/sched_clutch.h>
+
+/* Include non-header dependencies */
+#include "shadow_headers/misc_needed_deps.c"
+
+/* Tunables otherwise owned by osfmk/kern/sched_prim.c */
+uint32_t rt_deadline_epsilon = 0;
+int sched_rt_runq_strict_priority = false;
+
+/* Realtime runqueue code under-test, safe to include now after satisfying its dependencies */
+#include <kern/sched_rt.c>
+
+/* Implementation of sched_rt_harness.h interface */
+
+static struct rt_queue rt_harness_runq;
+static struct processor rt_harness_cpu;
+static int rt_harness_next_thread_id = 0;
+
+void
+rt_init_runqueue(void)
+{
+	rt_runq_init(&rt_harness_runq);
+	sched_rt_runq_strict_priority = false;
+}
+
+void
+rt_set_strict_priority(bool strict_priority)
+{
+	sched_rt_runq_strict_priority = strict_priority;
+}
+
+test_thread_t
+rt_create_thread(int pri, uint64_t deadline, uint32_t computation, uint32_t constraint)
+{
+	assert((pri >= BASEPRI_RTQUEUES) && (pri <= MAXPRI));
+	thread_t thread = calloc(1, sizeof(struct thread));
+	thread->id = rt_harness_next_thread_id++;
+	thread->thread_id = thread->id;
+	thread->sched_mode = TH_MODE_REALTIME;
+	thread->sched_pri = pri;
+	thread->base_pri = pri;
+	thread->realtime.computation = computation;
+	thread->realtime.constraint = constraint;
+	thread->realtime.deadline = deadline;
+	return thread;
+}
+
+void
+rt_set_thread_deadline(test_thread_t thread, uint64_t deadline)
+{
+	assert(((thread_t)thread)->__runq.runq == PROCESSOR_NULL);
+	((thread_t)thread)->realtime.deadline = deadline;
+}
+
+uint64_t
+rt_get_thread_deadline(test_thread_t thread)
+{
+	return ((thread_t)thread)->realtime.deadline;
+}
+
+int
+rt_get_thread_pri(test_thread_t thread)
+{
+	return ((thread_t)thread)->sched_pri;
+}
+
+bool
+rt_enqueue_thread(test_thread_t thread)
+{
+	return rt_runq_enqueue(&rt_harness_runq, (thread_t)thread, &rt_harness_cpu);
+}
+
+test_thread_t
+rt_dequeue_thread(void)
+{
+	if (os_atomic_load(&rt_harness_runq.count, relaxed) == 0) {
+		return NULL;
+	}
+	return rt_runq_dequeue(&rt_harness_runq);
+}
+
+void
+rt_remove_thread(test_thread_t thread)
+{
+	rt_runq_remove(&rt_harness_runq, (thread_t)thread);
+}
+
+test_thread_t
+rt_first_thread(void)
+{
+	return rt_runq_first(&rt_harness_runq);
+}
+
+int
+rt_runqueue_count(void)
+{
+	return os_atomic_load(&rt_harness_runq.count, relaxed);
+}
+
+uint64_t
+rt_runqueue_earliest_deadline(void)
+{
+	return os_atomic_load_wide(&rt_harness_runq.earliest_deadline, relaxed);
+}
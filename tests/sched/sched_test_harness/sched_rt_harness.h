@@ -0,0 +1,29 @@
+// Copyright (c) 2024 Apple Inc.  All rights reserved.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "sched_runqueue_harness.h"
+
+/*
+ * Drives the realtime runqueue primitives from osfmk/kern/sched_rt.c on a
+ * single runqueue, without any of the surrounding processor selection or
+ * preemption logic.
+ */
+
+extern void                  rt_init_runqueue(void);
+extern void                  rt_set_strict_priority(bool strict_priority);
+extern test_thread_t         rt_create_thread(int pri, uint64_t deadline, uint32_t computation, uint32_t constraint);
+extern void                  rt_set_thread_deadline(test_thread_t thread, uint64_t deadline);
+extern uint64_t              rt_get_thread_deadline(test_thread_t thread);
+extern int                   rt_get_thread_pri(test_thread_t thread);
+
+/* Returns whether the thread became the earliest deadline of its priority */
+extern bool                  rt_enqueue_thread(test_thread_t thread);
+extern test_thread_t         rt_dequeue_thread(void);
+extern void                  rt_remove_thread(test_thread_t thread);
+extern test_thread_t         rt_first_thread(void);
+extern int                   rt_runqueue_count(void);
+extern uint64_t              rt_runqueue_earliest_deadline(void);
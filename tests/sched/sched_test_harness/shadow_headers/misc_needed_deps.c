@@ -85,6 +85,12 @@ struct thread {
 	struct priority_queue_entry_stable      th_clutch_runq_link;
 	struct priority_queue_entry_sched       th_clutch_pri_link;
 	queue_chain_t                           th_clutch_timeshare_link;
+	struct {
+		uint32_t            computation;
+		uint32_t            constraint;
+		uint64_t            deadline;
+	}                       realtime;
+	struct priority_queue_entry_deadline_stable rt_runq_link;
 	uint32_t                sched_flags;            /* current flag bits */
 #define THREAD_BOUND_CLUSTER_NONE       (UINT32_MAX)
 	uint32_t                 th_bound_cluster_id;
@@ -115,6 +121,12 @@ thread_clear_runq(thread_t thread)
 	thread->__runq.runq = PROCESSOR_NULL;
 }
 
+void
+thread_clear_runq_locked(thread_t thread)
+{
+	thread_clear_runq(thread);
+}
+
 void
 thread_set_runq_locked(thread_t thread, processor_t new_runq)
 {
@@ -202,6 +202,28 @@ T_DECL(task_vm_info, "tests task vm info", T_META_ASROOT(true), T_META_LTEPHASE(
 	    "task_info --rev4 call returned value 0x%llx for vm_info.limit_bytes_remaining. Expected anything other than 0x%llx since "
 	    "this value should be modified by rev4",
 	    vm_info.limit_bytes_remaining, CANARY);
+
+	/*
+	 * Test the REV8 version of TASK_VM_INFO.
+	 */
+
+	count                      = TASK_VM_INFO_REV8_COUNT;
+	vm_info.refaults           = -1;
+	vm_info.refaults_activated = -1;
+
+	err = task_info(mach_task_self(), TASK_VM_INFO_PURGEABLE, (task_info_t)&vm_info, &count);
+
+	T_ASSERT_MACH_SUCCESS(err, "verify task_info call succeeded");
+
+	T_EXPECT_EQ(count, TASK_VM_INFO_REV8_COUNT, "task_info count(%d) is equal to TASK_VM_INFO_REV8_COUNT\n", count);
+
+	T_EXPECT_GE(vm_info.refaults, 0, "task_info --rev8 call returned %d refaults", vm_info.refaults);
+
+	T_EXPECT_GE(vm_info.refaults_activated, 0,
+	    "task_info --rev8 call returned %d refaults_activated", vm_info.refaults_activated);
+
+	T_EXPECT_LE(vm_info.refaults_activated, vm_info.refaults,
+	    "task_info --rev8 call returned no more activated refaults than refaults");
 }
 
 T_DECL(host_debug_info, "tests host debug info", T_META_ASROOT(true), T_META_LTEPHASE(LTE_POSTINIT))
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Churn loopback TCP connections so that the lockless pcb hash
+ * (ipi_smr_hash) grows and shrinks several times, and check that
+ * every established connection can still be found by tcp_input.
+ */
+
+#include <sys/param.h>
+#include <sys/socket.h>
+#include <sys/sysctl.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include <darwintest.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.net"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("networking"),
+	T_META_CHECK_LEAKS(false),
+	T_META_ENABLED(!TARGET_OS_BRIDGE));
+
+/* mirrors inp_smr_hash_min_size() */
+#define SMR_HASH_MAX_MIN_SIZE   (16 * 1024 / sizeof(void *))
+#define CHURN_ROUNDS            3
+
+struct conn {
+	int     c_client;
+	int     c_server;
+};
+
+static int
+listen_v4(struct sockaddr_in *sin)
+{
+	socklen_t socklen = sizeof(*sin);
+	int fd;
+
+	memset(sin, 0, sizeof(*sin));
+	sin->sin_len = sizeof(*sin);
+	sin->sin_family = AF_INET;
+	sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(bind(fd, (struct sockaddr *)sin, sizeof(*sin)), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(getsockname(fd, (struct sockaddr *)sin, &socklen), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(listen(fd, SOMAXCONN), NULL);
+
+	return fd;
+}
+
+static void
+conn_open(int listen_fd, const struct sockaddr_in *sin, struct conn *c)
+{
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(c->c_client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(connect(c->c_client, (const struct sockaddr *)sin, sizeof(*sin)), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(c->c_server = accept(listen_fd, NULL, NULL), NULL);
+}
+
+static void
+conn_close(struct conn *c)
+{
+	/* reset rather than linger in TIME_WAIT, which stays hashed */
+	struct linger l = { .l_onoff = 1, .l_linger = 0 };
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(setsockopt(c->c_client, SOL_SOCKET, SO_LINGER, &l, sizeof(l)), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(close(c->c_client), NULL);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(close(c->c_server), NULL);
+	c->c_client = c->c_server = -1;
+}
+
+/*
+ * Send a byte each way: delivering it needs tcp_input to look the
+ * receiving pcb up by its exact tuple.
+ */
+static void
+conn_check(const struct conn *c, unsigned int i)
+{
+	unsigned char out = (unsigned char)i, in = 0;
+
+	T_QUIET; T_ASSERT_EQ(send(c->c_client, &out, 1, 0), 1L, "send to server %u", i);
+	T_QUIET; T_ASSERT_EQ(recv(c->c_server, &in, 1, 0), 1L, "recv on server %u", i);
+	T_QUIET; T_ASSERT_EQ(in, out, "server %u got the right byte", i);
+
+	out = (unsigned char)~i;
+	T_QUIET; T_ASSERT_EQ(send(c->c_server, &out, 1, 0), 1L, "send to client %u", i);
+	T_QUIET; T_ASSERT_EQ(recv(c->c_client, &in, 1, 0), 1L, "recv on client %u", i);
+	T_QUIET; T_ASSERT_EQ(in, out, "client %u got the right byte", i);
+}
+
+static void
+conn_check_all(const struct conn *conns, unsigned int count, const char *what)
+{
+	for (unsigned int i = 0; i < count; i++) {
+		if (conns[i].c_client != -1) {
+			conn_check(&conns[i], i);
+		}
+	}
+	T_PASS("%s: all connections found", what);
+}
+
+T_DECL(tcp_pcb_smr_hash_churn,
+    "connections stay reachable while the lockless pcb hash is resized",
+    T_META_TAG_VM_PREFERRED)
+{
+	struct sockaddr_in sin;
+	struct rlimit rl;
+	struct conn *conns;
+	unsigned int hash_size, min_size, count;
+	size_t len = sizeof(hash_size);
+	int listen_fd;
+
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("net.inet.tcp.tcbhashsize",
+	    &hash_size, &len, NULL, 0), "net.inet.tcp.tcbhashsize");
+	min_size = MIN(hash_size, (unsigned int)SMR_HASH_MAX_MIN_SIZE);
+
+	/*
+	 * Each connection hashes two pcbs: twice the minimum size in
+	 * connections makes the table double three times, and closing
+	 * them all halves it back down as many times.
+	 */
+	count = 2 * min_size + 64;
+	T_LOG("minimum hash size %u, churning %u connections", min_size, count);
+
+	T_ASSERT_POSIX_SUCCESS(getrlimit(RLIMIT_NOFILE, &rl), NULL);
+	if (rl.rlim_cur < 2 * count + 64) {
+		rl.rlim_cur = 2 * count + 64;
+		if (rl.rlim_max < rl.rlim_cur || setrlimit(RLIMIT_NOFILE, &rl) != 0) {
+			T_SKIP("can't raise RLIMIT_NOFILE to %llu", (unsigned long long)rl.rlim_cur);
+		}
+	}
+
+	conns = calloc(count, sizeof(*conns));
+	T_QUIET; T_ASSERT_NOTNULL(conns, NULL);
+	for (unsigned int i = 0; i < count; i++) {
+		conns[i].c_client = conns[i].c_server = -1;
+	}
+
+	listen_fd = listen_v4(&sin);
+
+	for (unsigned int round = 0; round < CHURN_ROUNDS; round++) {
+		T_LOG("round %u", round);
+
+		/* grow: check the early connections as the table passes each size */
+		for (unsigned int i = 0; i < count; i++) {
+			conn_open(listen_fd, &sin, &conns[i]);
+			if (i == min_size || i == 2 * min_size) {
+				conn_check_all(conns, i + 1, "growing");
+			}
+		}
+		conn_check_all(conns, count, "grown");
+
+		/* shrink: close the even half first, then all but a handful */
+		for (unsigned int i = 0; i < count; i += 2) {
+			conn_close(&conns[i]);
+		}
+		conn_check_all(conns, count, "half closed");
+
+		for (unsigned int i = 1; i < count; i += 2) {
+			if (i % 256 != 1) {
+				conn_close(&conns[i]);
+			}
+		}
+		/* let the deferred resize run */
+		usleep(100 * 1000);
+		conn_check_all(conns, count, "shrunk");
+
+		for (unsigned int i = 0; i < count; i++) {
+			if (conns[i].c_client != -1) {
+				conn_close(&conns[i]);
+			}
+		}
+	}
+
+	close(listen_fd);
+	free(conns);
+}
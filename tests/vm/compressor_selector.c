@@ -0,0 +1,193 @@
+#include <darwintest.h>
+#include <darwintest_perf.h>
+#include <compression.h>
+#include <fcntl.h>
+#include <mach/mach_time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <vm/vm_compressor_sampler.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"),
+	T_META_CHECK_LEAKS(false));
+
+/*
+ * Replays a corpus of pages through the compressor's per-page codec
+ * selector (osfmk/vm/vm_compressor_sampler.h) and reports, per route,
+ * how many pages were selected, the compression ratio they achieved and
+ * the cost of sampling and compressing them.
+ *
+ * The corpus is a flat file of page-sized records named by the
+ * VM_COMPRESSOR_CORPUS environment variable (e.g. a dump of anonymous
+ * memory); when it isn't set a synthetic corpus mixing the usual page
+ * shapes is generated.
+ */
+
+#define CORPUS_ENV              "VM_COMPRESSOR_CORPUS"
+#define SYNTHETIC_PAGES         4096
+
+static const char *route_names[VMC_ROUTE_COUNT] = {
+	[VMC_ROUTE_HYB] = "hybrid",
+	[VMC_ROUTE_WK]  = "wkdm",
+	[VMC_ROUTE_LZ4] = "lz4",
+	[VMC_ROUTE_RAW] = "raw",
+};
+
+struct route_stats {
+	uint64_t pages;
+	uint64_t lz4_bytes;     /* compressed size had LZ4 been used */
+	uint64_t lz4_failures;  /* pages LZ4 could not shrink */
+	uint64_t lz4_abstime;
+};
+
+static void
+fill_synthetic_page(uint8_t *page, size_t page_size, uint32_t kind)
+{
+	uint32_t *w = (uint32_t *)page;
+	size_t nwords = page_size / sizeof(uint32_t);
+	static const char text[] =
+	    "The quick brown fox jumps over the lazy dog; "
+	    "pack my box with five dozen liquor jugs. ";
+
+	switch (kind % 5) {
+	case 0: /* zero filled */
+		memset(page, 0, page_size);
+		break;
+	case 1: /* small integers and pointers, WKdm friendly */
+		for (size_t i = 0; i < nwords; i++) {
+			w[i] = (i & 1) ? (uint32_t)(0x10a4c000 + (arc4random() & 0x3ff)) : arc4random_uniform(64);
+		}
+		break;
+	case 2: /* text */
+		for (size_t i = 0; i < page_size; i++) {
+			page[i] = (uint8_t)text[(i + kind) % (sizeof(text) - 1)];
+		}
+		break;
+	case 3: /* random, e.g. already compressed or encrypted data */
+		arc4random_buf(page, page_size);
+		break;
+	default: /* half random, half zero */
+		memset(page, 0, page_size);
+		arc4random_buf(page, page_size / 2);
+		break;
+	}
+}
+
+static uint8_t *
+load_corpus(size_t page_size, size_t *npages)
+{
+	const char *path = getenv(CORPUS_ENV);
+	uint8_t *corpus;
+
+	if (path != NULL) {
+		struct stat st;
+		int fd = open(path, O_RDONLY);
+
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(fd, "open(%s)", path);
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(fstat(fd, &st), "fstat");
+		*npages = (size_t)st.st_size / page_size;
+		T_QUIET; T_ASSERT_GT(*npages, 0UL, "corpus has at least one page");
+		corpus = mmap(NULL, *npages * page_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		T_QUIET; T_ASSERT_NE(corpus, MAP_FAILED, "mmap corpus");
+		close(fd);
+		T_LOG("replaying %zu pages from %s", *npages, path);
+		return corpus;
+	}
+
+	*npages = SYNTHETIC_PAGES;
+	corpus = malloc(*npages * page_size);
+	T_QUIET; T_ASSERT_NOTNULL(corpus, "malloc corpus");
+	for (size_t i = 0; i < *npages; i++) {
+		fill_synthetic_page(corpus + i * page_size, page_size, (uint32_t)i);
+	}
+	T_LOG("replaying %zu synthetic pages (set %s to use a corpus)", *npages, CORPUS_ENV);
+	return corpus;
+}
+
+T_DECL(compressor_selector_replay,
+    "replay a page corpus through the compressor codec selector",
+    T_META_TAG_PERF,
+    T_META_TAG_VM_NOT_ELIGIBLE)
+{
+	vmc_sample_tuneables_t tune = VMC_SAMPLE_TUNEABLES_DEFAULT;
+	struct route_stats stats[VMC_ROUTE_COUNT] = { };
+	size_t page_size = (size_t)getpagesize();
+	size_t npages;
+	uint8_t *corpus = load_corpus(page_size, &npages);
+	uint8_t *dst = malloc(page_size);
+	uint8_t *scratch = malloc(compression_encode_scratch_buffer_size(COMPRESSION_LZ4_RAW));
+	mach_timebase_info_data_t tb;
+	uint64_t sample_abstime = 0;
+
+	T_QUIET; T_ASSERT_NOTNULL(dst, "malloc dst");
+	T_QUIET; T_ASSERT_NOTNULL(scratch, "malloc scratch");
+	mach_timebase_info(&tb);
+
+	for (size_t i = 0; i < npages; i++) {
+		const uint8_t *page = corpus + i * page_size;
+		vmc_sample_t sample;
+		vmc_route_t route;
+		uint64_t start, end;
+		size_t csize;
+
+		start = mach_absolute_time();
+		vmc_sample_page(page, (uint32_t)page_size, &sample);
+		route = vmc_sample_route(&sample, &tune);
+		end = mach_absolute_time();
+		sample_abstime += end - start;
+
+		start = mach_absolute_time();
+		csize = compression_encode_buffer(dst, page_size, page, page_size,
+		    scratch, COMPRESSION_LZ4_RAW);
+		end = mach_absolute_time();
+
+		stats[route].pages++;
+		stats[route].lz4_abstime += end - start;
+		if (csize == 0) {
+			stats[route].lz4_failures++;
+			csize = page_size;
+		}
+		stats[route].lz4_bytes += csize;
+	}
+
+	double sample_ns = (double)sample_abstime * tb.numer / tb.denom / (double)npages;
+	T_LOG("sampler: %.1f ns/page", sample_ns);
+	T_PERF("sampler_time_per_page", sample_ns, "ns", "time to sample and route one page");
+
+	for (int r = 0; r < VMC_ROUTE_COUNT; r++) {
+		struct route_stats *s = &stats[r];
+
+		if (s->pages == 0) {
+			continue;
+		}
+		double ratio = (double)(s->pages * page_size) / (double)s->lz4_bytes;
+		double lz4_ns = (double)s->lz4_abstime * tb.numer / tb.denom / (double)s->pages;
+
+		T_LOG("%-7s %8llu pages (%5.1f%%), lz4 ratio %.2f, lz4 failures %llu, lz4 %.1f ns/page",
+		    route_names[r], s->pages, 100.0 * (double)s->pages / (double)npages,
+		    ratio, s->lz4_failures, lz4_ns);
+	}
+
+	/*
+	 * Pages routed raw skip compression entirely: make sure the selector
+	 * isn't throwing away pages that LZ4 would have shrunk noticeably.
+	 */
+	if (stats[VMC_ROUTE_RAW].pages) {
+		double raw_ratio = (double)(stats[VMC_ROUTE_RAW].pages * page_size) /
+		    (double)stats[VMC_ROUTE_RAW].lz4_bytes;
+		T_EXPECT_LT(raw_ratio, 1.25, "pages stored raw are mostly incompressible");
+	}
+
+	free(scratch);
+	free(dst);
+	if (getenv(CORPUS_ENV) == NULL) {
+		free(corpus);
+	}
+}
@@ -4,6 +4,7 @@
 #include <sys/sysctl.h>
 #include <sys/kern_memorystatus.h>
 #include <sys/kern_memorystatus_freeze.h>
+#include <sys/mman.h>
 #include <time.h>
 #include <mach-o/dyld.h>
 #include <mach/mach_vm.h>
@@ -55,6 +56,7 @@ T_GLOBAL_META(
 	X(FROZEN_BIT_NOT_SET) \
 	X(MEMORYSTATUS_CONTROL_ERROR) \
 	X(UNABLE_TO_ALLOCATE) \
+	X(PAGE_CONTENTS_MISMATCH) \
 	X(EXIT_CODE_MAX) \
 
 #define EXIT_CODES_ENUM(VAR) VAR,
@@ -1002,6 +1004,22 @@ T_DECL(get_frozen_procs, "List processes in the freezer",
 	dispatch_main();
 }
 
+static uint64_t
+get_frozen_to_swap_pages(pid_t pid)
+{
+	memorystatus_jetsam_snapshot_t *snapshot = NULL;
+	memorystatus_jetsam_snapshot_entry_t *entry = NULL;
+	uint64_t pages;
+
+	snapshot = get_jetsam_snapshot(MEMORYSTATUS_FLAGS_SNAPSHOT_ON_DEMAND, false);
+	entry = get_jetsam_snapshot_entry(snapshot, pid);
+	T_QUIET; T_ASSERT_NOTNULL(entry, "Found pid %d in snapshot", pid);
+	pages = entry->jse_frozen_to_swap_pages;
+	free(snapshot);
+
+	return pages;
+}
+
 T_DECL(frozen_to_swap_accounting, "jetsam snapshot has frozen_to_swap accounting",
 	T_META_ENABLED(HAS_FREEZER),
 	T_META_TAG_VM_NOT_PREFERRED) {
@@ -1011,8 +1029,7 @@ T_DECL(frozen_to_swap_accounting, "jetsam snapshot has frozen_to_swap accounting
 
 	check_for_and_enable_freezer();
 	test_after_background_helper_launches(true, "frozen_background", ^{
-		memorystatus_jetsam_snapshot_t *snapshot = NULL;
-		memorystatus_jetsam_snapshot_entry_t *child_entry = NULL;
+		uint64_t frozen_to_swap_pages = 0;
 		/* Place the child in the idle band so that it gets elevated like a typical app. */
 		move_to_idle_band(child_pid);
 		freeze_process(child_pid);
@@ -1022,17 +1039,13 @@ T_DECL(frozen_to_swap_accounting, "jetsam snapshot has frozen_to_swap accounting
 		 * something is either wrong with the compactor or the accounting.
 		 */
 		for (size_t i = 0; i < kFreezeToDiskMaxDelay / kSnapshotSleepDelay; i++) {
-		        snapshot = get_jetsam_snapshot(MEMORYSTATUS_FLAGS_SNAPSHOT_ON_DEMAND, false);
-		        child_entry = get_jetsam_snapshot_entry(snapshot, child_pid);
-		        T_QUIET; T_ASSERT_NOTNULL(child_entry, "Found child in snapshot");
-		        if (child_entry->jse_frozen_to_swap_pages > 0) {
+		        frozen_to_swap_pages = get_frozen_to_swap_pages(child_pid);
+		        if (frozen_to_swap_pages > 0) {
 		                break;
 			}
-		        free(snapshot);
 		        sleep(kSnapshotSleepDelay);
 		}
-		T_QUIET; T_ASSERT_GT(child_entry->jse_frozen_to_swap_pages, 0ULL, "child has some pages in swap");
-		free(snapshot);
+		T_QUIET; T_ASSERT_GT(frozen_to_swap_pages, 0ULL, "child has some pages in swap");
 		/* Kill the child */
 		T_QUIET; T_ASSERT_POSIX_SUCCESS(kill(child_pid, SIGKILL), "Killed child process");
 		T_END;
@@ -1040,6 +1053,155 @@ T_DECL(frozen_to_swap_accounting, "jetsam snapshot has frozen_to_swap accounting
 	dispatch_main();
 }
 
+/*
+ * Pages for the swap-in prefetch test: compressible like allocate_pages()
+ * but each stamped with its index, so that none of them dedup.
+ */
+static void
+fill_prefetch_page(char *page, size_t pgno, size_t vmpgsize)
+{
+	for (size_t i = 0; i < vmpgsize; i += 16) {
+		memset(&page[i], (int)((i / 16) % 211), 16);
+	}
+	memcpy(page, &pgno, sizeof(pgno));
+}
+
+T_HELPER_DECL(prefetch_background, "Frozen process that re-touches its pages in order",
+	T_META_ENABLED(HAS_FREEZER),
+	T_META_ASROOT(true)) {
+	kern_return_t kern_ret;
+	dispatch_source_t ds_signal;
+	size_t vmpgsize = (size_t)get_vmpage_size();
+	size_t num_pages = (MEM_SIZE_MB << 20) / vmpgsize;
+	char *buf;
+
+	buf = mmap(NULL, num_pages * vmpgsize, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	if (buf == MAP_FAILED) {
+		exit(UNABLE_TO_ALLOCATE);
+	}
+	for (size_t i = 0; i < num_pages; i++) {
+		fill_prefetch_page(&buf[i * vmpgsize], i, vmpgsize);
+	}
+
+	check_for_and_enable_freezer();
+	kern_ret = memorystatus_control(MEMORYSTATUS_CMD_SET_PROCESS_IS_FREEZABLE, getpid(), 1, NULL, 0);
+	T_QUIET; T_ASSERT_EQ(kern_ret, KERN_SUCCESS, "set process is freezable");
+
+	signal(SIGUSR1, SIG_IGN);
+	ds_signal = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL, SIGUSR1, 0, dispatch_get_main_queue());
+	if (ds_signal == NULL) {
+		exit(DISPATCH_SOURCE_CREATE_FAILED);
+	}
+	dispatch_source_set_event_handler(ds_signal, ^{
+		char *expected = malloc(vmpgsize);
+		if (expected == NULL) {
+		        exit(UNABLE_TO_ALLOCATE);
+		}
+		/* Thawed: fault everything back in, lowest address first. */
+		for (size_t i = 0; i < num_pages; i++) {
+		        fill_prefetch_page(expected, i, vmpgsize);
+		        if (memcmp(&buf[i * vmpgsize], expected, vmpgsize) != 0) {
+		                exit(PAGE_CONTENTS_MISMATCH);
+			}
+		}
+		free(expected);
+		if (kill(getppid(), SIGUSR1) != 0) {
+		        exit(SIGNAL_TO_PARENT_FAILED);
+		}
+	});
+	dispatch_activate(ds_signal);
+
+	/* Signal to our parent that we can be frozen */
+	if (kill(getppid(), SIGUSR1) != 0) {
+		exit(INITIAL_SIGNAL_TO_PARENT_FAILED);
+	}
+	dispatch_main();
+}
+
+static uint64_t
+sysctl_quad(const char *name)
+{
+	uint64_t value = 0;
+	size_t len = sizeof(value);
+	int ret = sysctlbyname(name, &value, &len, NULL, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(ret, "sysctl %s", name);
+	return value;
+}
+
+T_DECL(thaw_swapin_prefetch, "Re-touching a thawed process in order swaps in prefetched segments",
+	T_META_ENABLED(HAS_FREEZER),
+	T_META_ASROOT(true),
+	T_META_BOOTARGS_SET("-disable_freezer_cseg_acct"),
+	T_META_TAG_VM_NOT_PREFERRED) {
+	static const size_t kSnapshotSleepDelay = 5;
+	static const size_t kFreezeToDiskMaxDelay = 60;
+	__block uint64_t issued, hits, misses;
+	__block bool thawed = false;
+	char bootargs[1024] = {0};
+	uint32_t prefetch_max;
+	size_t len;
+
+	len = sizeof(prefetch_max);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.swapin_prefetch_max", &prefetch_max, &len, NULL, 0),
+	    "vm.swapin_prefetch_max");
+	if (prefetch_max == 0) {
+		T_SKIP("swap-in prefetch is off (vm_swapin_prefetch_max=0)");
+	}
+	/* Prefetch stands down while the freezer only counts in-core segments. */
+	len = sizeof(bootargs);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("kern.bootargs", bootargs, &len, NULL, 0), "kern.bootargs");
+	if (strstr(bootargs, "-disable_freezer_cseg_acct") == NULL) {
+		T_SKIP("swap-in prefetch needs -disable_freezer_cseg_acct on freezer devices");
+	}
+
+	check_for_and_enable_freezer();
+	test_after_background_helper_launches(true, "prefetch_background", ^{
+		uint64_t frozen_to_swap_pages = 0, last = 0;
+		int ret;
+
+		if (thawed) {
+		        /* The child has faulted all of its pages back in. */
+		        issued = sysctl_quad("vm.swapin_prefetch_issued") - issued;
+		        hits = sysctl_quad("vm.swapin_prefetch_hits") - hits;
+		        misses = sysctl_quad("vm.swapin_prefetch_misses") - misses;
+		        T_LOG("re-touch: %llu demand swap-ins, %llu prefetched, %llu prefetch hits",
+		        misses, issued, hits);
+		        if (misses == 0 && hits == 0) {
+		                T_SKIP("none of the child's segments came back from swap");
+			}
+		        T_EXPECT_GT(issued, 0ULL, "neighbouring segments were prefetched");
+		        T_EXPECT_LT(misses, misses + hits,
+		        "fewer synchronous swap-ins than segments swapped in");
+		        T_QUIET; T_ASSERT_POSIX_SUCCESS(kill(child_pid, SIGKILL), "Killed child process");
+		        T_END;
+		}
+
+		move_to_idle_band(child_pid);
+		freeze_process(child_pid);
+		/* Wait for the swapout of the child's segments to settle. */
+		for (size_t i = 0; i < kFreezeToDiskMaxDelay / kSnapshotSleepDelay; i++) {
+		        sleep(kSnapshotSleepDelay);
+		        frozen_to_swap_pages = get_frozen_to_swap_pages(child_pid);
+		        if (frozen_to_swap_pages > 0 && frozen_to_swap_pages == last) {
+		                break;
+			}
+		        last = frozen_to_swap_pages;
+		}
+		T_QUIET; T_ASSERT_GT(frozen_to_swap_pages, 0ULL, "child has some pages in swap");
+		T_LOG("%llu of the child's pages are in swap", frozen_to_swap_pages);
+
+		issued = sysctl_quad("vm.swapin_prefetch_issued");
+		hits = sysctl_quad("vm.swapin_prefetch_hits");
+		misses = sysctl_quad("vm.swapin_prefetch_misses");
+
+		ret = sysctlbyname("kern.memorystatus_thaw", NULL, NULL, &child_pid, sizeof(child_pid));
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(ret, "sysctl kern.memorystatus_thaw failed");
+		thawed = true;
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(kill(child_pid, SIGUSR1), "failed to send SIGUSR1 to child process");
+	});
+	dispatch_main();
+}
+
 T_DECL(freezer_snapshot, "App kills are recorded in the freezer snapshot",
 	T_META_ENABLED(HAS_FREEZER),
 	T_META_TAG_VM_NOT_PREFERRED) {
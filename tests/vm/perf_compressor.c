@@ -38,6 +38,7 @@
 #include <sys/mman.h>
 #include <sys/sysctl.h>
 #include <sys/types.h>
+#include <vm/vm_compressor_info.h>
 
 #include "benchmark/helpers.h"
 
@@ -71,14 +72,6 @@ typedef struct test_args {
 	bool ta_verbose;
 } test_args_t;
 
-struct perf_compressor_data {
-	user_addr_t buffer;
-	size_t buffer_size;
-	uint64_t benchmark_time;
-	uint64_t bytes_processed;
-	uint64_t compressor_growth;
-};
-
 /* Test Variants */
 static const char *kCompressArgument = "compress";
 static const char *kCompressAndDecompressArgument = "compress-and-decompress";
@@ -4,7 +4,11 @@
  *
  * Functional tests for VM compressor/swap.
  */
+#include <sys/mman.h>
 #include <sys/sysctl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include <darwintest.h>
 #include <darwintest_utils.h>
 #include <TargetConditionals.h>
@@ -115,3 +119,160 @@ T_DECL(sysctl_vm_object_dump, "Check that the sysctl that dumps the metadata of
 		offset += sizeof(struct vm_map_entry_info);
 	}
 }
+
+static uint64_t
+sysctl_quad(const char *name)
+{
+	uint64_t value = 0;
+	size_t len = sizeof(value);
+	int rc = sysctlbyname(name, &value, &len, NULL, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(rc, "sysctl `%s`", name);
+	return value;
+}
+
+#define DEDUP_PAGES     256
+
+T_DECL(compressor_dedup, "Check that identical pages share their compressed data",
+    T_META_REQUIRES_SYSCTL_EQ("kern.development", 1),
+    T_META_ASROOT(true),
+    T_META_RUN_CONCURRENTLY(false),
+    T_META_TAG_VM_NOT_ELIGIBLE)
+{
+	char bootargs[1024] = {0};
+	size_t len = sizeof(bootargs);
+	int rc = sysctlbyname("kern.bootargs", bootargs, &len, NULL, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(rc, "kern.bootargs");
+	if (strstr(bootargs, "vm_compressor_dedup=1") == NULL) {
+		T_SKIP("compressor dedup isn't enabled (vm_compressor_dedup=1)");
+	}
+
+	size_t page_size = (size_t)getpagesize();
+	size_t size = DEDUP_PAGES * page_size;
+	uint32_t *ref = malloc(page_size);
+	T_QUIET; T_ASSERT_NOTNULL(ref, "malloc");
+	/* compressible but not a single value page */
+	for (size_t i = 0; i < page_size / sizeof(uint32_t); i++) {
+		ref[i] = (uint32_t)(i % 61) * 0x01010101u;
+	}
+
+	char *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	T_QUIET; T_ASSERT_NE_PTR((void *)buf, MAP_FAILED, "mmap");
+	for (size_t p = 0; p < DEDUP_PAGES; p++) {
+		memcpy(buf + p * page_size, ref, page_size);
+	}
+
+	uint64_t hits = sysctl_quad("vm.compressor_dedup_hits");
+	struct perf_compressor_data data = {
+		.buffer = (user_addr_t)(uintptr_t)buf,
+		.buffer_size = size,
+	};
+	len = sizeof(data);
+	rc = sysctlbyname("kern.perf_compressor", &data, &len, &data, sizeof(data));
+	T_ASSERT_POSIX_SUCCESS(rc, "compress %d identical pages", DEDUP_PAGES);
+	hits = sysctl_quad("vm.compressor_dedup_hits") - hits;
+
+	T_LOG("%llu of %llu bytes compressed, %llu dedup hits", data.bytes_processed, (uint64_t)size, hits);
+	/* the first two copies of the page are stored, the others share them */
+	T_EXPECT_GE(hits, (uint64_t)(data.bytes_processed / page_size) / 2,
+	    "most pages were deduplicated");
+
+	for (size_t p = 0; p < DEDUP_PAGES; p++) {
+		T_QUIET; T_ASSERT_EQ(memcmp(buf + p * page_size, ref, page_size), 0,
+		    "page %zu decompressed correctly", p);
+	}
+	T_PASS("all pages decompressed correctly");
+
+	munmap(buf, size);
+	free(ref);
+}
+
+#define BATCH_PAGES     128
+
+T_DECL(compressor_batch, "Check that the pageout path compresses pages in batches",
+    T_META_REQUIRES_SYSCTL_EQ("kern.development", 1),
+    T_META_ASROOT(true),
+    T_META_RUN_CONCURRENTLY(false),
+    T_META_TAG_VM_NOT_ELIGIBLE)
+{
+	char bootargs[1024] = {0};
+	size_t len = sizeof(bootargs);
+	int rc = sysctlbyname("kern.bootargs", bootargs, &len, NULL, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(rc, "kern.bootargs");
+	char *arg = strstr(bootargs, "vmcomp_batch=");
+	if (arg == NULL || strtoul(arg + strlen("vmcomp_batch="), NULL, 0) < 2) {
+		T_SKIP("batched compression isn't enabled (vmcomp_batch=N, N > 1)");
+	}
+
+	size_t page_size = (size_t)getpagesize();
+	size_t size = BATCH_PAGES * page_size;
+	char *buf = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+	T_QUIET; T_ASSERT_NE_PTR((void *)buf, MAP_FAILED, "mmap");
+	/* compressible, and different from page to page so none is single value or shared */
+	for (size_t p = 0; p < BATCH_PAGES; p++) {
+		uint32_t *words = (uint32_t *)(void *)(buf + p * page_size);
+		for (size_t i = 0; i < page_size / sizeof(uint32_t); i++) {
+			words[i] = (uint32_t)(p << 16) | (uint32_t)(i % 61);
+		}
+	}
+
+	uint64_t pages = sysctl_quad("vm.compressor_batch_pages");
+	uint64_t runs = sysctl_quad("vm.compressor_batch_runs");
+
+	/* hand the pages to the compressor threads, and wait for all of them to be compressed */
+	rc = madvise(buf, size, MADV_PAGEOUT);
+	T_ASSERT_POSIX_SUCCESS(rc, "madvise(MADV_PAGEOUT) %d pages", BATCH_PAGES);
+	for (size_t p = 0; p < BATCH_PAGES; p++) {
+		char vec;
+		int tries = 0;
+		do {
+			rc = mincore(buf + p * page_size, 1, &vec);
+			T_QUIET; T_ASSERT_POSIX_SUCCESS(rc, "mincore");
+			if (!(vec & MINCORE_INCORE)) {
+				break;
+			}
+			usleep(10 * 1000);
+		} while (++tries < 500);
+		T_QUIET; T_ASSERT_FALSE(vec & MINCORE_INCORE, "page %zu was paged out", p);
+	}
+
+	pages = sysctl_quad("vm.compressor_batch_pages") - pages;
+	runs = sysctl_quad("vm.compressor_batch_runs") - runs;
+	T_LOG("%llu pages compressed in batches, committed in %llu runs", pages, runs);
+	T_EXPECT_GE(pages, (uint64_t)BATCH_PAGES, "our pages went through vm_compressor_put_batch()");
+	T_EXPECT_GT(runs, 0ULL, "batches were committed to c_segs");
+	T_EXPECT_LT(runs, pages, "runs commit more than one page per c_seg lock");
+
+	for (size_t p = 0; p < BATCH_PAGES; p++) {
+		uint32_t *words = (uint32_t *)(void *)(buf + p * page_size);
+		for (size_t i = 0; i < page_size / sizeof(uint32_t); i++) {
+			if (words[i] != ((uint32_t)(p << 16) | (uint32_t)(i % 61))) {
+				T_ASSERT_FAIL("page %zu word %zu decompressed incorrectly", p, i);
+			}
+		}
+	}
+	T_PASS("all pages decompressed correctly");
+
+	munmap(buf, size);
+}
+
+T_DECL(swapin_prefetch_accounting, "Check that the swap-in prefetch counters are consistent",
+    T_META_ENABLED(TARGET_OS_OSX), T_META_TAG_VM_PREFERRED)
+{
+	uint32_t max;
+	size_t len = sizeof(max);
+	int rc = sysctlbyname("vm.swapin_prefetch_max", &max, &len, NULL, 0);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(rc, "sysctl `vm.swapin_prefetch_max`");
+
+	/* sample the outcomes before the prefetches that produced them */
+	uint64_t hits = sysctl_quad("vm.swapin_prefetch_hits");
+	uint64_t wasted = sysctl_quad("vm.swapin_prefetch_wasted");
+	uint64_t misses = sysctl_quad("vm.swapin_prefetch_misses");
+	uint64_t issued = sysctl_quad("vm.swapin_prefetch_issued");
+
+	T_LOG("prefetch max %u: %llu issued, %llu hits, %llu wasted, %llu demand swapins",
+	    max, issued, hits, wasted, misses);
+	T_EXPECT_LE(hits + wasted, issued, "every prefetch is used or wasted at most once");
+	if (max == 0) {
+		T_EXPECT_EQ(issued, 0ULL, "nothing is prefetched when prefetch is disabled");
+	}
+}
@@ -0,0 +1,144 @@
+#include <darwintest.h>
+#include <darwintest_utils.h>
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/param.h>
+#include <sys/sysctl.h>
+
+#include <mach/mach_init.h>
+#include <mach/task.h>
+#include <mach/task_info.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"),
+	T_META_ASROOT(true),
+	T_META_RUN_CONCURRENTLY(false));
+
+#define FAULT_AROUND_FILE_PAGES 256
+
+static int32_t
+task_faults(void)
+{
+	task_events_info_data_t info;
+	mach_msg_type_number_t count = TASK_EVENTS_INFO_COUNT;
+
+	T_QUIET; T_ASSERT_MACH_SUCCESS(task_info(mach_task_self(), TASK_EVENTS_INFO,
+	    (task_info_t)&info, &count), "task_info(TASK_EVENTS_INFO)");
+	return info.faults;
+}
+
+static uint32_t
+set_fault_around_pages(uint32_t pages)
+{
+	uint32_t old_pages;
+	size_t size = sizeof(old_pages);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.fault_around_pages",
+	    &old_pages, &size, &pages, sizeof(pages)), "vm.fault_around_pages");
+	return old_pages;
+}
+
+/*
+ * Map a file whose pages are all resident in the UBC and read one byte
+ * per page, returning the number of faults that took.
+ */
+static int32_t
+touch_resident_file(void)
+{
+	char path[MAXPATHLEN];
+	size_t size = FAULT_AROUND_FILE_PAGES * (size_t)vm_page_size;
+	volatile char *addr;
+	char *buf;
+	int32_t faults;
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/fault_around.XXXXXX", dt_tmpdir());
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(fd = mkstemp(path), "mkstemp");
+	buf = malloc(size);
+	T_QUIET; T_ASSERT_NOTNULL(buf, "malloc");
+	memset(buf, 'a', size);
+	T_QUIET; T_ASSERT_EQ(write(fd, buf, size), (ssize_t)size, "write");
+	free(buf);
+
+	addr = mmap(NULL, size, PROT_READ, MAP_FILE | MAP_SHARED, fd, 0);
+	T_QUIET; T_ASSERT_NE((void *)addr, MAP_FAILED, "mmap");
+
+	faults = task_faults();
+	for (size_t off = 0; off < size; off += vm_page_size) {
+		(void)addr[off];
+	}
+	faults = task_faults() - faults;
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(munmap((void *)addr, size), "munmap");
+	close(fd);
+	unlink(path);
+	return faults;
+}
+
+T_DECL(vm_fault_around_resident_file,
+    "Read faults on a resident file mapping map the neighbouring pages",
+    T_META_TAG_VM_PREFERRED)
+{
+	uint64_t entered, entered_after;
+	size_t size = sizeof(entered);
+	uint32_t old_pages;
+	int32_t faults;
+
+	old_pages = set_fault_around_pages(0);
+	faults = touch_resident_file();
+	T_LOG("%d faults with fault-around disabled", faults);
+	T_EXPECT_GE(faults, FAULT_AROUND_FILE_PAGES, "one fault per page");
+
+	set_fault_around_pages(16);
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.fault_around_pages_entered",
+	    &entered, &size, NULL, 0), "vm.fault_around_pages_entered");
+	faults = touch_resident_file();
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.fault_around_pages_entered",
+	    &entered_after, &size, NULL, 0), "vm.fault_around_pages_entered");
+	set_fault_around_pages(old_pages);
+
+	T_LOG("%d faults with a 16 page window, %llu pages entered around faults",
+	    faults, entered_after - entered);
+	T_EXPECT_LT(faults, FAULT_AROUND_FILE_PAGES / 2, "fewer faults than pages");
+	T_EXPECT_GT(entered_after, entered, "pages were entered around faults");
+}
+
+static int
+set_self_fault_around(int enable)
+{
+	int old_enable;
+	size_t size = sizeof(old_enable);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.self_fault_around",
+	    &old_enable, &size, &enable, sizeof(enable)), "vm.self_fault_around");
+	return old_enable;
+}
+
+T_DECL(vm_fault_around_self_opt_out,
+    "A process can opt its own map out of fault-around",
+    T_META_TAG_VM_PREFERRED)
+{
+	uint32_t old_pages;
+	int32_t faults;
+
+	old_pages = set_fault_around_pages(16);
+
+	T_EXPECT_EQ(set_self_fault_around(0), 1, "fault-around starts enabled");
+	faults = touch_resident_file();
+	T_LOG("%d faults with fault-around disabled for this map", faults);
+	T_EXPECT_GE(faults, FAULT_AROUND_FILE_PAGES, "one fault per page");
+
+	T_EXPECT_EQ(set_self_fault_around(1), 0, "fault-around was disabled");
+	faults = touch_resident_file();
+	T_LOG("%d faults with fault-around enabled again", faults);
+	T_EXPECT_LT(faults, FAULT_AROUND_FILE_PAGES / 2, "fewer faults than pages");
+
+	set_fault_around_pages(old_pages);
+}
@@ -0,0 +1,282 @@
+#include <darwintest.h>
+#include <darwintest_utils.h>
+
+#include <pthread.h>
+#include <sched.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/sysctl.h>
+
+#include <mach/mach_init.h>
+#include <mach/mach_vm.h>
+#include <mach/vm_page_size.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"),
+	T_META_RUN_CONCURRENTLY(false));
+
+#define SPEC_FAULT_THREADS      8
+#define SPEC_FAULT_PAGES        1024
+#define SPEC_FAULT_ROUNDS       64
+
+static char *spec_region;
+static size_t spec_region_size;
+static atomic_bool spec_done;
+
+static uint64_t
+spec_counter(const char *name)
+{
+	uint64_t value;
+	size_t size = sizeof(value);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname(name, &value, &size, NULL, 0), "%s", name);
+	return value;
+}
+
+/*
+ * Repeatedly drop and re-fault the translations of a resident,
+ * populated region: each thread owns a slice and checks its contents.
+ */
+static void *
+spec_fault_thread(void *arg)
+{
+	size_t slice = spec_region_size / SPEC_FAULT_THREADS;
+	char *base = spec_region + (uintptr_t)arg * slice;
+
+	for (int round = 0; round < SPEC_FAULT_ROUNDS; round++) {
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(mprotect(base, slice, PROT_NONE), "mprotect(NONE)");
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(mprotect(base, slice, PROT_READ | PROT_WRITE), "mprotect(RW)");
+		for (size_t off = 0; off < slice; off += vm_page_size) {
+			T_QUIET; T_ASSERT_EQ(base[off], (char)((base + off - spec_region) / vm_page_size),
+			    "page contents");
+			base[off + 1] = (char)round;
+		}
+	}
+	return NULL;
+}
+
+/* Keep the map lock busy with unrelated mappings */
+static void *
+spec_mmap_thread(__unused void *arg)
+{
+	while (!atomic_load(&spec_done)) {
+		void *p = mmap(NULL, 16 * vm_page_size, PROT_READ | PROT_WRITE,
+		    MAP_ANON | MAP_PRIVATE, -1, 0);
+		T_QUIET; T_ASSERT_NE(p, MAP_FAILED, "mmap");
+		*(volatile char *)p = 1;
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(munmap(p, 16 * vm_page_size), "munmap");
+	}
+	return NULL;
+}
+
+T_DECL(vm_fault_speculative_concurrent,
+    "Faults on resident pages are resolved without the map lock while the map changes",
+    T_META_TAG_VM_PREFERRED)
+{
+	pthread_t faulters[SPEC_FAULT_THREADS], mapper;
+	uint64_t hits, fallbacks;
+
+	spec_region_size = SPEC_FAULT_PAGES * (size_t)vm_page_size;
+	spec_region = mmap(NULL, spec_region_size, PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_PRIVATE, -1, 0);
+	T_ASSERT_NE((void *)spec_region, MAP_FAILED, "mmap");
+	for (size_t i = 0; i < SPEC_FAULT_PAGES; i++) {
+		spec_region[i * vm_page_size] = (char)i;
+	}
+
+	hits = spec_counter("vm.fault_speculative_hits");
+	fallbacks = spec_counter("vm.fault_speculative_fallbacks");
+
+	T_ASSERT_POSIX_ZERO(pthread_create(&mapper, NULL, spec_mmap_thread, NULL), "pthread_create");
+	for (uintptr_t i = 0; i < SPEC_FAULT_THREADS; i++) {
+		T_ASSERT_POSIX_ZERO(pthread_create(&faulters[i], NULL, spec_fault_thread, (void *)i),
+		    "pthread_create");
+	}
+	for (int i = 0; i < SPEC_FAULT_THREADS; i++) {
+		T_ASSERT_POSIX_ZERO(pthread_join(faulters[i], NULL), "pthread_join");
+	}
+	atomic_store(&spec_done, true);
+	T_ASSERT_POSIX_ZERO(pthread_join(mapper, NULL), "pthread_join");
+
+	hits = spec_counter("vm.fault_speculative_hits") - hits;
+	fallbacks = spec_counter("vm.fault_speculative_fallbacks") - fallbacks;
+	T_LOG("%llu speculative faults, %llu fell back to the map lock", hits, fallbacks);
+	T_EXPECT_GT(hits, 0ULL, "some faults were resolved speculatively");
+
+	T_ASSERT_POSIX_SUCCESS(munmap(spec_region, spec_region_size), "munmap");
+}
+
+/*
+ * Races between write faults and a map change: once mprotect() or a
+ * MAP_FIXED replacement returns, no write may land through the old
+ * translation anymore.  "race_view" is where the writes are checked,
+ * "race_region" where the writers write.
+ */
+#define RACE_WRITERS            4
+#define RACE_PAGES              64
+#define RACE_ROUNDS             256
+
+static volatile uint32_t *race_region;
+static volatile uint32_t *race_view;
+static size_t race_size;
+static _Atomic uint32_t race_round;
+static _Atomic bool race_stop;
+static _Atomic uint32_t race_stopped;
+static __thread sigjmp_buf race_jmp;
+
+static void
+race_fault_handler(__unused int sig)
+{
+	siglongjmp(race_jmp, 1);
+}
+
+static void *
+race_writer_thread(void *arg)
+{
+	size_t slice = race_size / RACE_WRITERS;
+	size_t words = slice / sizeof(uint32_t);
+	size_t stride = vm_page_size / sizeof(uint32_t);
+	volatile uint32_t *base;
+	uint32_t seen = 0, value = 0;
+
+	for (;;) {
+		uint32_t round;
+
+		while ((round = atomic_load(&race_round)) == seen) {
+			sched_yield();
+		}
+		if (round == UINT32_MAX) {
+			return NULL;
+		}
+		seen = round;
+		base = race_region + (uintptr_t)arg * words;
+
+		if (sigsetjmp(race_jmp, 1) == 0) {
+			/* one write per page, so that every page faults */
+			while (!atomic_load_explicit(&race_stop, memory_order_relaxed)) {
+				for (size_t i = 0; i < words; i += stride) {
+					base[i] = ++value;
+				}
+			}
+		}
+		atomic_fetch_add(&race_stopped, 1);
+	}
+}
+
+static void
+race_run(const char *what, void (^drop)(void), void (^change)(void))
+{
+	pthread_t writers[RACE_WRITERS];
+	struct sigaction sa = { .sa_handler = race_fault_handler };
+	uint32_t *snapshot;
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sigaction(SIGBUS, &sa, NULL), "sigaction");
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sigaction(SIGSEGV, &sa, NULL), "sigaction");
+	snapshot = malloc(race_size);
+	T_QUIET; T_ASSERT_NOTNULL(snapshot, "malloc");
+
+	atomic_store(&race_round, 0);
+	for (uintptr_t i = 0; i < RACE_WRITERS; i++) {
+		T_QUIET; T_ASSERT_POSIX_ZERO(pthread_create(&writers[i], NULL,
+		    race_writer_thread, (void *)i), "pthread_create");
+	}
+
+	for (uint32_t round = 1; round <= RACE_ROUNDS; round++) {
+		/* resident pages without translations: the writes fault */
+		drop();
+		atomic_store(&race_stop, false);
+		atomic_store(&race_stopped, 0);
+		atomic_store(&race_round, round);
+
+		usleep(round % 16);
+		change();
+		memcpy(snapshot, (const void *)race_view, race_size);
+
+		atomic_store(&race_stop, true);
+		while (atomic_load(&race_stopped) != RACE_WRITERS) {
+			sched_yield();
+		}
+		T_QUIET; T_ASSERT_EQ(memcmp(snapshot, (const void *)race_view, race_size), 0,
+		    "%s: no write landed after the change returned (round %u)", what, round);
+	}
+
+	atomic_store(&race_round, UINT32_MAX);
+	for (int i = 0; i < RACE_WRITERS; i++) {
+		T_QUIET; T_ASSERT_POSIX_ZERO(pthread_join(writers[i], NULL), "pthread_join");
+	}
+	free(snapshot);
+	signal(SIGBUS, SIG_DFL);
+	signal(SIGSEGV, SIG_DFL);
+	T_PASS("%s: %u rounds without a stale translation", what, RACE_ROUNDS);
+}
+
+T_DECL(vm_fault_speculative_mprotect_race,
+    "No write lands through a speculative translation after mprotect(PROT_READ) returns",
+    T_META_TAG_VM_PREFERRED)
+{
+	uint64_t hits;
+
+	race_size = RACE_PAGES * (size_t)vm_page_size;
+	race_region = mmap(NULL, race_size, PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_PRIVATE, -1, 0);
+	T_ASSERT_NE((void *)race_region, MAP_FAILED, "mmap");
+	memset((void *)race_region, 0, race_size);
+	race_view = race_region;
+
+	hits = spec_counter("vm.fault_speculative_hits");
+	race_run("mprotect", ^{
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(mprotect((void *)race_region, race_size,
+		PROT_NONE), "mprotect(NONE)");
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(mprotect((void *)race_region, race_size,
+		PROT_READ | PROT_WRITE), "mprotect(RW)");
+	}, ^{
+		T_QUIET; T_ASSERT_POSIX_SUCCESS(mprotect((void *)race_region, race_size,
+		PROT_READ), "mprotect(READ)");
+	});
+	T_LOG("%llu speculative faults", spec_counter("vm.fault_speculative_hits") - hits);
+
+	T_ASSERT_POSIX_SUCCESS(munmap((void *)race_region, race_size), "munmap");
+}
+
+T_DECL(vm_fault_speculative_remap_race,
+    "No write lands in the old object through a speculative translation after a MAP_FIXED mmap returns",
+    T_META_TAG_VM_PREFERRED)
+{
+	mach_vm_address_t region, view = 0;
+	vm_prot_t cur, max;
+
+	race_size = RACE_PAGES * (size_t)vm_page_size;
+	race_view = mmap(NULL, race_size, PROT_READ | PROT_WRITE,
+	    MAP_ANON | MAP_SHARED, -1, 0);
+	T_ASSERT_NE((void *)race_view, MAP_FAILED, "mmap");
+	memset((void *)race_view, 0, race_size);
+	view = (mach_vm_address_t)race_view;
+
+	region = 0;
+	T_ASSERT_MACH_SUCCESS(mach_vm_allocate(mach_task_self(), &region,
+	    race_size, VM_FLAGS_ANYWHERE), "mach_vm_allocate");
+	race_region = (volatile uint32_t *)region;
+
+	race_run("MAP_FIXED", ^{
+		/* map the shared object again, over whatever is there */
+		mach_vm_address_t addr = region;
+
+		T_QUIET; T_ASSERT_MACH_SUCCESS(mach_vm_remap(mach_task_self(), &addr,
+		race_size, 0, VM_FLAGS_FIXED | VM_FLAGS_OVERWRITE,
+		mach_task_self(), view, FALSE, &cur, &max, VM_INHERIT_SHARE),
+		"mach_vm_remap");
+	}, ^{
+		T_QUIET; T_ASSERT_NE(mmap((void *)region, race_size, PROT_READ | PROT_WRITE,
+		MAP_ANON | MAP_PRIVATE | MAP_FIXED, -1, 0), MAP_FAILED, "mmap(MAP_FIXED)");
+	});
+
+	T_ASSERT_POSIX_SUCCESS(munmap((void *)race_region, race_size), "munmap");
+	T_ASSERT_POSIX_SUCCESS(munmap((void *)race_view, race_size), "munmap");
+}
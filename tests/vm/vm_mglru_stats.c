@@ -0,0 +1,100 @@
+#include <darwintest.h>
+
+#include <stdint.h>
+#include <sys/sysctl.h>
+
+T_GLOBAL_META(
+	T_META_NAMESPACE("xnu.vm"),
+	T_META_RADAR_COMPONENT_NAME("xnu"),
+	T_META_RADAR_COMPONENT_VERSION("VM"));
+
+/* mirrors struct vm_page_mglru_stats in osfmk/vm/vm_pageout_xnu.h */
+#define VM_PAGE_MGLRU_STATS_GENS        4
+
+struct vm_page_mglru_gen_info {
+	uint64_t        vmgi_seq;
+	uint64_t        vmgi_age_ns;
+	uint32_t        vmgi_nr_anon;
+	uint32_t        vmgi_nr_file;
+	uint64_t        vmgi_promoted;
+	uint64_t        vmgi_aged;
+	uint64_t        vmgi_deactivated;
+	uint64_t        vmgi_scanned;
+	uint64_t        vmgi_reclaimed;
+};
+
+struct vm_page_mglru_stats {
+	uint64_t        vms_evicted_anon;
+	uint64_t        vms_evicted_file;
+	uint64_t        vms_refaulted_anon;
+	uint64_t        vms_refaulted_file;
+	int32_t         vms_reclaim_bias;
+	uint32_t        vms_nr_gens;
+	uint64_t        vms_scanned;
+	uint64_t        vms_reclaimed;
+	struct vm_page_mglru_gen_info vms_total;
+	struct vm_page_mglru_gen_info vms_gens[VM_PAGE_MGLRU_STATS_GENS];
+};
+
+static void
+get_mglru_stats(struct vm_page_mglru_stats *stats)
+{
+	size_t size = sizeof(*stats);
+
+	T_QUIET; T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.mglru_stats",
+	    stats, &size, NULL, 0), "vm.mglru_stats");
+	T_QUIET; T_ASSERT_EQ(size, sizeof(*stats), "vm.mglru_stats size");
+}
+
+T_DECL(vm_mglru_stats,
+    "vm.mglru_stats reports consistent generations",
+    T_META_TAG_VM_PREFERRED)
+{
+	struct vm_page_mglru_stats stats;
+	size_t size = 0;
+
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("vm.mglru_stats", NULL, &size, NULL, 0),
+	    "vm.mglru_stats size query");
+	T_ASSERT_EQ(size, sizeof(stats), "kernel and test agree on the layout");
+
+	get_mglru_stats(&stats);
+	if (stats.vms_nr_gens == 0) {
+		T_SKIP("the multi-generational LRU is off (vm_page_mglru=1 not set)");
+	}
+
+	T_LOG("%u generations, reclaim bias %d, scanned %llu, reclaimed %llu",
+	    stats.vms_nr_gens, stats.vms_reclaim_bias,
+	    stats.vms_scanned, stats.vms_reclaimed);
+
+	T_EXPECT_LE(stats.vms_nr_gens, VM_PAGE_MGLRU_STATS_GENS, "at most 4 generations");
+	T_EXPECT_TRUE(stats.vms_reclaim_bias >= -1 && stats.vms_reclaim_bias <= 1,
+	    "reclaim bias is none, anonymous or file");
+	T_EXPECT_LE(stats.vms_reclaimed, stats.vms_scanned, "reclaimed <= scanned");
+	T_EXPECT_LE(stats.vms_total.vmgi_deactivated, stats.vms_total.vmgi_aged,
+	    "deactivated <= aged since boot");
+	T_EXPECT_LE(stats.vms_total.vmgi_scanned, stats.vms_scanned,
+	    "scans charged to a generation <= all scans");
+	T_EXPECT_LE(stats.vms_total.vmgi_reclaimed, stats.vms_total.vmgi_scanned,
+	    "reclaimed <= scanned, charged to a generation");
+
+	for (uint32_t i = 0; i < stats.vms_nr_gens && i < VM_PAGE_MGLRU_STATS_GENS; i++) {
+		struct vm_page_mglru_gen_info *gen = &stats.vms_gens[i];
+
+		T_LOG("gen %llu: age %llu ns, %u anon, %u file, promoted %llu, aged %llu, "
+		    "deactivated %llu, scanned %llu, reclaimed %llu",
+		    gen->vmgi_seq, gen->vmgi_age_ns, gen->vmgi_nr_anon, gen->vmgi_nr_file,
+		    gen->vmgi_promoted, gen->vmgi_aged, gen->vmgi_deactivated,
+		    gen->vmgi_scanned, gen->vmgi_reclaimed);
+
+		T_EXPECT_LE(gen->vmgi_deactivated, gen->vmgi_aged,
+		    "gen %llu: deactivated <= aged", gen->vmgi_seq);
+		T_EXPECT_LE(gen->vmgi_scanned, gen->vmgi_deactivated,
+		    "gen %llu: scanned <= deactivated", gen->vmgi_seq);
+		T_EXPECT_LE(gen->vmgi_reclaimed, gen->vmgi_scanned,
+		    "gen %llu: reclaimed <= scanned", gen->vmgi_seq);
+		if (i > 0) {
+			T_EXPECT_EQ(gen->vmgi_seq, stats.vms_gens[i - 1].vmgi_seq + 1,
+			    "generations are reported oldest first");
+		}
+	}
+}
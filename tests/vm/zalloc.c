@@ -1,5 +1,7 @@
 #include <sys/sysctl.h>
 #include <signal.h>
+#include <stdlib.h>
+#include <mach_debug/zone_info.h>
 #include <darwintest.h>
 #include <darwintest_utils.h>
 
@@ -29,6 +31,52 @@ T_DECL(basic_zone_test, "General zalloc test", T_META_TAG_VM_PREFERRED)
 	T_EXPECT_EQ(1ull, run_sysctl_test("zone_basic_test", 0), "zone_basic_test");
 }
 
+T_DECL(bulk_zone_test, "zalloc_bulk/zfree_bulk test", T_META_TAG_VM_PREFERRED)
+{
+	T_EXPECT_EQ(1ull, run_sysctl_test("zone_bulk_test", 0), "zone_bulk_test");
+}
+
+T_DECL(zone_cache_tuning, "per-zone cache tuning state is consistent",
+    T_META_TAG_VM_PREFERRED)
+{
+	zone_cache_tune_info_t *info;
+	size_t size = 0;
+	size_t n;
+
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("kern.zone_cache_tuning",
+	    NULL, &size, NULL, 0), "sizing kern.zone_cache_tuning");
+	T_QUIET; T_ASSERT_EQ(size % sizeof(*info), 0ul, "size is a multiple of the entry size");
+
+	info = malloc(size);
+	T_QUIET; T_ASSERT_NOTNULL(info, "malloc");
+	T_ASSERT_POSIX_SUCCESS(sysctlbyname("kern.zone_cache_tuning",
+	    info, &size, NULL, 0), "kern.zone_cache_tuning");
+	n = size / sizeof(*info);
+	T_LOG("%zu zones have caching enabled", n);
+
+	for (size_t i = 0; i < n; i++) {
+		zone_cache_tune_info_t *zcti = &info[i];
+
+		T_QUIET; T_EXPECT_NE(strnlen(zcti->zcti_name, sizeof(zcti->zcti_name)),
+		    sizeof(zcti->zcti_name), "zone name is terminated");
+		T_QUIET; T_EXPECT_LE(zcti->zcti_depot_size, zcti->zcti_depot_limit,
+		    "%s: depot size within its limit", zcti->zcti_name);
+		T_QUIET; T_EXPECT_LE(zcti->zcti_decision, ZONE_CACHE_TUNE_RELAX,
+		    "%s: valid decision", zcti->zcti_name);
+		T_QUIET; T_EXPECT_GT(zcti->zcti_mag_size, 0, "%s: magazine size",
+		    zcti->zcti_name);
+		if (zcti->zcti_grows || zcti->zcti_shrinks) {
+			T_LOG("%-40s rate %8llu/s depot %3u/%3u (default %3u) grows %u shrinks %u",
+			    zcti->zcti_name, zcti->zcti_alloc_rate,
+			    zcti->zcti_depot_size, zcti->zcti_depot_limit,
+			    zcti->zcti_depot_limit_default,
+			    zcti->zcti_grows, zcti->zcti_shrinks);
+		}
+	}
+
+	free(info);
+}
+
 T_DECL(read_only_zone_test, "Read-only zalloc test", T_META_TAG_VM_PREFERRED)
 {
 	T_EXPECT_EQ(1ull, run_sysctl_test("zone_ro_basic_test", 0), "zone_ro_basic_test");
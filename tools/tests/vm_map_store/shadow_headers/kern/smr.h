@@ -0,0 +1,5 @@
+/*
+ * Stand-in for osfmk/kern/smr.h: the harness is single threaded,
+ * nodes are freed immediately (see kern/zalloc.h).
+ */
+#pragma once
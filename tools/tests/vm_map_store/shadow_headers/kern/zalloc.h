@@ -0,0 +1,46 @@
+/*
+ * Stand-in for osfmk/kern/zalloc.h: zones are backed by calloc/free.
+ */
+#pragma once
+
+#include <stdlib.h>
+
+#define SECURITY_READ_ONLY_LATE(type)   type
+#define __startup_func
+
+#define ZC_NOENCRYPT    0
+#define Z_WAITOK        0x0001
+#define Z_ZERO          0x0002
+#define Z_NOFAIL        0x0004
+
+typedef struct zone {
+	const char     *z_name;
+	size_t          z_elem_size;
+} *zone_t;
+
+static inline zone_t
+zone_create(const char *name, size_t size, int flags)
+{
+	zone_t z = calloc(1, sizeof(*z));
+
+	(void)flags;
+	z->z_name = name;
+	z->z_elem_size = size;
+	return z;
+}
+
+static inline void *
+zalloc_flags(zone_t z, int flags)
+{
+	void *elem = calloc(1, z->z_elem_size);
+
+	(void)flags;
+	if (elem == NULL) {
+		abort();
+	}
+	return elem;
+}
+
+#define zone_enable_smr(z, smr, cb)     ((void)(z))
+#define zfree(z, elem)                  ((void)(z), free(elem))
+#define zfree_smr(z, elem)              ((void)(z), free(elem))
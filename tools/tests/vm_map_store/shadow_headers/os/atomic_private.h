@@ -0,0 +1,12 @@
+/*
+ * Stand-in for libkern/os/atomic_private.h, on top of the compiler builtins.
+ */
+#pragma once
+
+#define _os_atomic_mo_relaxed           __ATOMIC_RELAXED
+#define _os_atomic_mo_acquire           __ATOMIC_ACQUIRE
+#define _os_atomic_mo_release           __ATOMIC_RELEASE
+#define _os_atomic_mo_dependency        __ATOMIC_CONSUME
+
+#define os_atomic_load(p, m)            __atomic_load_n(p, _os_atomic_mo_##m)
+#define os_atomic_store(p, v, m)        __atomic_store_n(p, v, _os_atomic_mo_##m)
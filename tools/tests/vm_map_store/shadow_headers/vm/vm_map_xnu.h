@@ -0,0 +1,69 @@
+/*
+ * Stand-in for osfmk/vm/vm_map_xnu.h so that osfmk/vm/vm_map_store_bt.c
+ * builds in userspace: only the entry links are real, the rest of an
+ * entry is padding so that entries are as large as the kernel's.
+ *
+ * Entries also carry the red-black tree linkage of the kernel
+ * (struct vm_map_store) for the reference store in the harness.
+ */
+#pragma once
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __single
+#define __single
+#endif
+#ifndef __unsafe_forge_single
+#define __unsafe_forge_single(type, ptr) ((type)(ptr))
+#endif
+#include <libkern/tree.h>
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+
+__attribute__((noreturn))
+static inline void
+panic(const char *fmt, ...)
+{
+	va_list ap;
+
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	fputc('\n', stderr);
+	abort();
+}
+
+typedef uint64_t vm_map_offset_t;
+typedef uint64_t vm_map_size_t;
+
+struct vm_map_entry;
+
+struct vm_map_links {
+	struct vm_map_entry     *prev;
+	struct vm_map_entry     *next;
+	vm_map_offset_t         start;
+	vm_map_offset_t         end;
+};
+
+struct vm_map_store {
+	RB_ENTRY(vm_map_store) entry;
+};
+
+struct vm_map_entry {
+	struct vm_map_links     links;
+	struct vm_map_store     store;
+	uint64_t                vme_fields[6];
+};
+
+#include <vm/vm_map_store_bt_internal.h>
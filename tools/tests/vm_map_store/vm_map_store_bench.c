@@ -0,0 +1,742 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Conformance and performance harness for osfmk/vm/vm_map_store_bt.c.
+ *
+ * Synthetic maps keep their entries on a list, as the kernel does, and
+ * index them with both the B-tree store and a red-black tree that is
+ * maintained and searched exactly like vm_map_store_rb.c.
+ *
+ * The conformance pass applies random map operations (enter, remove,
+ * clip, coalesce, simplify) and checks that lookups agree between both
+ * trees and a linear scan, and that free space found with the gap
+ * annotations is the first fit a walk of the holes finds.
+ *
+ * The performance pass times lookups, insertions and removals against
+ * both trees, and free space searches against the walk of the holes
+ * that maps without the B-tree store do (vm_map_store_find_space() on
+ * the hole list), for maps of increasing size.
+ *
+ * usage: vm_map_store_bench [-n max_entries] [-i iterations] [-s seed] [-c]
+ */
+
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <vm/vm_map_xnu.h>
+
+#define BENCH_PAGE_SIZE         4096ull
+#define BENCH_MIN_OFFSET        0x100000000ull
+#define BENCH_MAX_OFFSET        0x7fffffff0000ull
+
+#define VME_FOR_STORE(ptr) \
+	((struct vm_map_entry *)((uintptr_t)(ptr) - offsetof(struct vm_map_entry, store)))
+
+RB_HEAD(rb_head, vm_map_store);
+
+static int
+rb_node_compare(struct vm_map_store *node, struct vm_map_store *parent)
+{
+	struct vm_map_entry *vme_c = VME_FOR_STORE(node);
+	struct vm_map_entry *vme_p = VME_FOR_STORE(parent);
+
+	if (vme_c->links.start < vme_p->links.start) {
+		return -1;
+	}
+	if (vme_c->links.start >= vme_p->links.end) {
+		return 1;
+	}
+	return 0;
+}
+
+RB_PROTOTYPE(rb_head, vm_map_store, entry, rb_node_compare);
+RB_GENERATE(rb_head, vm_map_store, entry, rb_node_compare);
+
+struct bench_map {
+	struct vm_map_links     head;
+	int                     nentries;
+	bool                    use_rb;
+	bool                    use_bt;
+	struct rb_head          rb;
+	struct vm_map_bt        bt;
+};
+
+#define map_to_entry(m)         ((struct vm_map_entry *)(void *)&(m)->head)
+
+static uint64_t bench_seed = 0x2545f4914f6cdd1dull;
+
+static uint64_t
+bench_rand(void)
+{
+	/* xorshift64* */
+	bench_seed ^= bench_seed >> 12;
+	bench_seed ^= bench_seed << 25;
+	bench_seed ^= bench_seed >> 27;
+	return bench_seed * 0x2545f4914f6cdd1dull;
+}
+
+static uint64_t
+bench_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void
+map_init(struct bench_map *m, bool use_rb, bool use_bt)
+{
+	memset(m, 0, sizeof(*m));
+	m->head.prev = m->head.next = map_to_entry(m);
+	m->head.start = BENCH_MIN_OFFSET;
+	m->head.end = BENCH_MAX_OFFSET;
+	m->use_rb = use_rb;
+	m->use_bt = use_bt;
+	RB_INIT(&m->rb);
+	vm_map_bt_init(&m->bt, &m->head);
+}
+
+static struct vm_map_entry *
+entry_create(vm_map_offset_t start, vm_map_offset_t end)
+{
+	struct vm_map_entry *entry = calloc(1, sizeof(*entry));
+
+	entry->links.start = start;
+	entry->links.end = end;
+	return entry;
+}
+
+/* vm_map_store_entry_link_ll() then the trees, as _vm_map_store_entry_link() */
+static void
+map_link(struct bench_map *m, struct vm_map_entry *after, struct vm_map_entry *entry)
+{
+	m->nentries++;
+	entry->links.prev = after;
+	entry->links.next = after->links.next;
+	entry->links.prev->links.next = entry;
+	entry->links.next->links.prev = entry;
+	if (m->use_bt) {
+		vm_map_bt_insert(&m->bt, &entry->links);
+	}
+	if (m->use_rb && RB_INSERT(rb_head, &m->rb, &entry->store) != NULL) {
+		panic("rb insert of [0x%llx:0x%llx] failed",
+		    (unsigned long long)entry->links.start,
+		    (unsigned long long)entry->links.end);
+	}
+}
+
+static void
+map_unlink(struct bench_map *m, struct vm_map_entry *entry)
+{
+	m->nentries--;
+	entry->links.next->links.prev = entry->links.prev;
+	entry->links.prev->links.next = entry->links.next;
+	if (m->use_bt) {
+		vm_map_bt_remove(&m->bt, &entry->links);
+	}
+	if (m->use_rb) {
+		RB_REMOVE(rb_head, &m->rb, &entry->store);
+	}
+}
+
+/* vm_map_store_lookup_entry_rb() */
+static bool
+map_lookup_rb(struct bench_map *m, vm_map_offset_t address, struct vm_map_entry **entryp)
+{
+	struct vm_map_store *rb_entry = RB_ROOT(&m->rb);
+	struct vm_map_entry *cur, *prev = NULL;
+
+	while (rb_entry != NULL) {
+		cur = VME_FOR_STORE(rb_entry);
+		if (address >= cur->links.start) {
+			if (address < cur->links.end) {
+				*entryp = cur;
+				return true;
+			}
+			rb_entry = RB_RIGHT(rb_entry, entry);
+			prev = cur;
+		} else {
+			rb_entry = RB_LEFT(rb_entry, entry);
+		}
+	}
+	*entryp = prev ? prev : map_to_entry(m);
+	return false;
+}
+
+static bool
+map_lookup_bt(struct bench_map *m, vm_map_offset_t address, struct vm_map_entry **entryp)
+{
+	struct vm_map_links *links;
+	bool found;
+
+	found = vm_map_bt_lookup(&m->bt, address, &links);
+	*entryp = links ? (struct vm_map_entry *)(void *)links : map_to_entry(m);
+	return found;
+}
+
+static bool
+map_lookup_list(struct bench_map *m, vm_map_offset_t address, struct vm_map_entry **entryp)
+{
+	struct vm_map_entry *entry = map_to_entry(m);
+
+	while (entry->links.next != map_to_entry(m) &&
+	    entry->links.next->links.start <= address) {
+		entry = entry->links.next;
+	}
+	*entryp = entry;
+	return entry != map_to_entry(m) && address < entry->links.end;
+}
+
+static inline vm_map_offset_t
+hole_start(struct bench_map *m, struct vm_map_entry *entry)
+{
+	return entry == map_to_entry(m) ? m->head.start : entry->links.end;
+}
+
+static inline vm_map_offset_t
+hole_end(struct bench_map *m, struct vm_map_entry *entry)
+{
+	return entry->links.next == map_to_entry(m) ?
+	       m->head.end : entry->links.next->links.start;
+}
+
+/*
+ * First fit at or above "start", walking every hole from the bottom
+ * of the map like the hole list walk of vm_map_store_find_space_forward().
+ */
+static struct vm_map_entry *
+find_space_list(struct bench_map *m, vm_map_offset_t start, vm_map_size_t size,
+    vm_map_offset_t *addr_out)
+{
+	struct vm_map_entry *entry = map_to_entry(m);
+
+	for (;;) {
+		vm_map_offset_t addr = MAX(hole_start(m, entry), start);
+
+		if (addr < hole_end(m, entry) && size <= hole_end(m, entry) - addr) {
+			*addr_out = addr;
+			return entry;
+		}
+		entry = entry->links.next;
+		if (entry == map_to_entry(m)) {
+			return NULL;
+		}
+	}
+}
+
+/* vm_map_store_find_space_bt_forward() without alignment constraints */
+static struct vm_map_entry *
+find_space_bt(struct bench_map *m, vm_map_offset_t start, vm_map_size_t size,
+    vm_map_offset_t *addr_out)
+{
+	struct vm_map_entry *entry;
+	struct vm_map_links *next;
+
+	start = MAX(start, m->head.start);
+	if (map_lookup_bt(m, start, &entry)) {
+		start = entry->links.end;
+	}
+
+	for (;;) {
+		if (start + size < start || m->head.end < start + size) {
+			return NULL;
+		}
+		if (entry->links.next == map_to_entry(m) ||
+		    start + size <= entry->links.next->links.start) {
+			break;
+		}
+		next = vm_map_bt_next_gap(&m->bt, entry->links.next->links.start, size);
+		if (next == NULL) {
+			entry = m->head.prev;
+		} else {
+			entry = next->prev;
+		}
+		start = entry->links.end;
+	}
+
+	*addr_out = start;
+	return entry;
+}
+
+/* Highest fit ending at or below "end", walking the holes downwards */
+static struct vm_map_entry *
+find_space_list_backwards(struct bench_map *m, vm_map_offset_t end,
+    vm_map_size_t size, vm_map_offset_t *addr_out)
+{
+	struct vm_map_entry *entry = m->head.prev;
+
+	for (;;) {
+		vm_map_offset_t hend = MIN(hole_end(m, entry), end);
+
+		if (hole_start(m, entry) < hend &&
+		    size <= hend - hole_start(m, entry)) {
+			*addr_out = hend - size;
+			return entry;
+		}
+		if (entry == map_to_entry(m)) {
+			return NULL;
+		}
+		entry = entry->links.prev;
+	}
+}
+
+/* vm_map_store_find_space_bt_backwards() without alignment constraints */
+static struct vm_map_entry *
+find_space_bt_backwards(struct bench_map *m, vm_map_offset_t end,
+    vm_map_size_t size, vm_map_offset_t *addr_out)
+{
+	struct vm_map_entry *entry;
+	struct vm_map_links *prev;
+	vm_map_offset_t start;
+
+	if (m->head.end <= end) {
+		entry = map_to_entry(m);
+		end = m->head.end;
+	} else if (map_lookup_bt(m, end - 1, &entry)) {
+		end = entry->links.start;
+	} else {
+		entry = entry->links.next;
+	}
+
+	for (;;) {
+		start = end - size;
+		if (end < start || start < m->head.start) {
+			return NULL;
+		}
+		entry = entry->links.prev;
+		if (entry == map_to_entry(m) || entry->links.end <= start) {
+			break;
+		}
+		prev = vm_map_bt_prev_gap(&m->bt, entry->links.start, size);
+		if (prev == NULL) {
+			return NULL;
+		}
+		entry = (struct vm_map_entry *)(void *)prev;
+		end = entry->links.start;
+	}
+
+	*addr_out = start;
+	return entry;
+}
+
+/* Pick a random entry, or the header when the map is empty */
+static struct vm_map_entry *
+map_random_entry(struct bench_map *m)
+{
+	vm_map_offset_t span, addr;
+	struct vm_map_entry *entry;
+
+	if (m->nentries == 0) {
+		return map_to_entry(m);
+	}
+	span = m->head.prev->links.end - m->head.next->links.start;
+	addr = m->head.next->links.start + bench_rand() % span;
+	map_lookup_bt(m, addr, &entry);
+	return entry;
+}
+
+static vm_map_size_t
+random_size(void)
+{
+	uint64_t r = bench_rand() % 100;
+
+	if (r < 70) {
+		return (1 + bench_rand() % 4) * BENCH_PAGE_SIZE;
+	}
+	if (r < 95) {
+		return (1 + bench_rand() % 64) * BENCH_PAGE_SIZE;
+	}
+	return (1 + bench_rand() % 4096) * BENCH_PAGE_SIZE;
+}
+
+/*
+ * Lays out "n" entries: mostly back to back, with small holes
+ * and the occasional large one, like a fragmented heap.
+ */
+static void
+map_populate(struct bench_map *m, int n)
+{
+	vm_map_offset_t addr = m->head.start;
+
+	for (int i = 0; i < n; i++) {
+		struct vm_map_entry *entry;
+		uint64_t r = bench_rand() % 100;
+		vm_map_size_t size = (1 + bench_rand() % 8) * BENCH_PAGE_SIZE;
+
+		if (r >= 60 && r < 95) {
+			addr += (1 + bench_rand() % 16) * BENCH_PAGE_SIZE;
+		} else if (r >= 95) {
+			addr += (1 + bench_rand() % 1024) * BENCH_PAGE_SIZE;
+		}
+		entry = entry_create(addr, addr + size);
+		map_link(m, m->head.prev, entry);
+		addr += size;
+	}
+}
+
+static void
+map_destroy(struct bench_map *m)
+{
+	while (m->head.next != map_to_entry(m)) {
+		struct vm_map_entry *entry = m->head.next;
+
+		map_unlink(m, entry);
+		free(entry);
+	}
+	if (m->bt.vbt_root != NULL || m->bt.vbt_nodes != 0) {
+		panic("%u B-tree nodes left in an empty map", m->bt.vbt_nodes);
+	}
+}
+
+static int check_failures;
+
+#define CHECK(cond, ...) ({ \
+	if (!(cond)) { \
+	        fprintf(stderr, "FAIL: " __VA_ARGS__); \
+	        fputc('\n', stderr); \
+	        check_failures++; \
+	} \
+})
+
+static void
+map_check(struct bench_map *m, int probes)
+{
+	struct vm_map_entry *entry, *rb, *bt, *list;
+	bool found_rb, found_bt, found_list;
+	vm_map_offset_t addr;
+	int n = 0;
+
+	/* every entry can be found by its bounds, and the list is sorted */
+	for (entry = m->head.next; entry != map_to_entry(m); entry = entry->links.next) {
+		CHECK(entry->links.start < entry->links.end, "empty entry %p", entry);
+		CHECK(entry->links.prev == map_to_entry(m) ||
+		    entry->links.prev->links.end <= entry->links.start,
+		    "overlapping entries at 0x%llx", (unsigned long long)entry->links.start);
+		CHECK(map_lookup_bt(m, entry->links.start, &bt) && bt == entry,
+		    "entry 0x%llx not found by its start", (unsigned long long)entry->links.start);
+		CHECK(map_lookup_bt(m, entry->links.end - 1, &bt) && bt == entry,
+		    "entry 0x%llx not found by its end", (unsigned long long)entry->links.start);
+		n++;
+	}
+	CHECK(n == m->nentries, "%d entries listed, %d expected", n, m->nentries);
+
+	for (int i = 0; i < probes; i++) {
+		addr = m->head.start + bench_rand() %
+		    (MAX(m->head.prev->links.end, m->head.start + BENCH_PAGE_SIZE) + BENCH_PAGE_SIZE - m->head.start);
+		found_rb = map_lookup_rb(m, addr, &rb);
+		found_bt = map_lookup_bt(m, addr, &bt);
+		found_list = map_lookup_list(m, addr, &list);
+		CHECK(found_rb == found_list && rb == list, "rb lookup 0x%llx", (unsigned long long)addr);
+		CHECK(found_bt == found_list && bt == list, "bt lookup 0x%llx", (unsigned long long)addr);
+		bt = (struct vm_map_entry *)(void *)vm_map_bt_lookup_speculative(&m->bt, addr);
+		CHECK(bt == (found_list ? list : NULL), "speculative lookup 0x%llx",
+		    (unsigned long long)addr);
+	}
+
+	for (int i = 0; i < probes; i++) {
+		vm_map_size_t size = random_size();
+		vm_map_offset_t a1 = 0, a2 = 0;
+		struct vm_map_entry *e1, *e2;
+
+		addr = m->head.start + bench_rand() %
+		    (m->head.prev->links.end + BENCH_PAGE_SIZE - m->head.start);
+		e1 = find_space_list(m, addr, size, &a1);
+		e2 = find_space_bt(m, addr, size, &a2);
+		CHECK(e1 == e2 && a1 == a2, "forward find space 0x%llx/0x%llx: 0x%llx vs 0x%llx",
+		    (unsigned long long)addr, (unsigned long long)size,
+		    (unsigned long long)a1, (unsigned long long)a2);
+
+		a1 = a2 = 0;
+		e1 = find_space_list_backwards(m, addr, size, &a1);
+		e2 = find_space_bt_backwards(m, addr, size, &a2);
+		CHECK(e1 == e2 && a1 == a2, "backward find space 0x%llx/0x%llx: 0x%llx vs 0x%llx",
+		    (unsigned long long)addr, (unsigned long long)size,
+		    (unsigned long long)a1, (unsigned long long)a2);
+	}
+}
+
+/*
+ * Random map operations, mimicking how vm_map.c edits entries in place:
+ * vm_map_clip_start() moves the start of an entry before linking the new
+ * front piece, vm_map_enter() and vm_map_simplify_entry() grow entries
+ * and call vm_map_store_entry_resized().
+ */
+static void
+conformance(int rounds)
+{
+	struct bench_map m;
+
+	map_init(&m, true, true);
+	map_populate(&m, 2000);
+	map_check(&m, 1000);
+
+	for (int round = 0; round < rounds; round++) {
+		struct vm_map_entry *entry = map_random_entry(&m);
+		struct vm_map_entry *new_entry;
+		vm_map_offset_t addr = 0, mid;
+		vm_map_size_t size;
+
+		int op = (int)(bench_rand() % 6);
+
+		if (op < 2 && m.nentries > 4000) {
+			op = 2;
+		}
+
+		switch (op) {
+		case 0: /* enter */
+		case 1:
+			size = random_size();
+			entry = find_space_bt(&m, m.head.start + bench_rand() %
+			    (m.head.prev->links.end + BENCH_PAGE_SIZE - m.head.start), size, &addr);
+			if (entry != NULL) {
+				map_link(&m, entry, entry_create(addr, addr + size));
+			}
+			break;
+
+		case 2: /* remove */
+			if (entry != map_to_entry(&m)) {
+				map_unlink(&m, entry);
+				free(entry);
+			}
+			break;
+
+		case 3: /* clip */
+			if (entry == map_to_entry(&m) ||
+			    entry->links.end - entry->links.start < 2 * BENCH_PAGE_SIZE) {
+				break;
+			}
+			mid = entry->links.start + BENCH_PAGE_SIZE *
+			    (1 + bench_rand() % ((entry->links.end - entry->links.start) / BENCH_PAGE_SIZE - 1));
+			if (bench_rand() & 1) {
+				/* vm_map_clip_start() */
+				new_entry = entry_create(entry->links.start, mid);
+				entry->links.start = mid;
+				map_link(&m, entry->links.prev, new_entry);
+			} else {
+				/* vm_map_clip_end() */
+				new_entry = entry_create(mid, entry->links.end);
+				entry->links.end = mid;
+				map_link(&m, entry, new_entry);
+			}
+			break;
+
+		case 4: /* coalesce: grow into the next hole */
+			if (entry == map_to_entry(&m) ||
+			    hole_end(&m, entry) - entry->links.end < BENCH_PAGE_SIZE) {
+				break;
+			}
+			size = MIN((hole_end(&m, entry) - entry->links.end) / BENCH_PAGE_SIZE, 64);
+			entry->links.end += BENCH_PAGE_SIZE * (1 + bench_rand() % size);
+			vm_map_bt_update(&m.bt, &entry->links);
+			break;
+
+		case 5: /* simplify: merge with an adjacent predecessor */
+			if (entry == map_to_entry(&m) || entry->links.prev == map_to_entry(&m) ||
+			    entry->links.prev->links.end != entry->links.start) {
+				break;
+			}
+			new_entry = entry->links.prev;
+			map_unlink(&m, new_entry);
+			entry->links.start = new_entry->links.start;
+			vm_map_bt_update(&m.bt, &entry->links);
+			free(new_entry);
+			break;
+		}
+
+		if (round % 1000 == 0) {
+			map_check(&m, 200);
+		}
+	}
+	map_check(&m, 1000);
+
+	/* drain most of the map to exercise merges and root collapses */
+	while (m.nentries > 10) {
+		struct vm_map_entry *entry = map_random_entry(&m);
+
+		map_unlink(&m, entry);
+		free(entry);
+		if (m.nentries % 97 == 0) {
+			map_check(&m, 50);
+		}
+	}
+	map_check(&m, 200);
+	map_destroy(&m);
+}
+
+static volatile uintptr_t bench_sink;
+
+static void
+bench_size(int n, int iterations)
+{
+	struct bench_map m;
+	struct vm_map_entry **entries, *entry;
+	vm_map_offset_t *addrs, span, addr;
+	vm_map_size_t *sizes;
+	uint64_t t_rb, t_bt, t;
+
+	map_init(&m, true, true);
+	map_populate(&m, n);
+
+	entries = calloc((size_t)n, sizeof(entries[0]));
+	addrs = calloc((size_t)iterations, sizeof(addrs[0]));
+	sizes = calloc((size_t)iterations, sizeof(sizes[0]));
+	span = m.head.prev->links.end - m.head.start;
+	entry = m.head.next;
+	for (int i = 0; i < n; i++, entry = entry->links.next) {
+		entries[i] = entry;
+	}
+	for (int i = 0; i < iterations; i++) {
+		addrs[i] = m.head.start + bench_rand() % span;
+		sizes[i] = (16 + bench_rand() % 48) * BENCH_PAGE_SIZE;
+	}
+
+	/* lookups */
+	t = bench_now();
+	for (int i = 0; i < iterations; i++) {
+		map_lookup_rb(&m, addrs[i], &entry);
+		bench_sink += (uintptr_t)entry;
+	}
+	t_rb = bench_now() - t;
+	t = bench_now();
+	for (int i = 0; i < iterations; i++) {
+		map_lookup_bt(&m, addrs[i], &entry);
+		bench_sink += (uintptr_t)entry;
+	}
+	t_bt = bench_now() - t;
+	printf("%8d entries  lookup      rb %7.1f ns  bt %7.1f ns\n", n,
+	    (double)t_rb / iterations, (double)t_bt / iterations);
+
+	/* unlink and relink a random entry, list included */
+	m.use_bt = false;
+	t = bench_now();
+	for (int i = 0; i < iterations; i++) {
+		entry = entries[addrs[i] % (uint64_t)n];
+		struct vm_map_entry *prev = entry->links.prev;
+
+		map_unlink(&m, entry);
+		map_link(&m, prev, entry);
+	}
+	t_rb = bench_now() - t;
+	m.use_bt = true;
+	m.use_rb = false;
+	t = bench_now();
+	for (int i = 0; i < iterations; i++) {
+		entry = entries[addrs[i] % (uint64_t)n];
+		struct vm_map_entry *prev = entry->links.prev;
+
+		map_unlink(&m, entry);
+		map_link(&m, prev, entry);
+	}
+	t_bt = bench_now() - t;
+	m.use_rb = true;
+	printf("%8d entries  remove+add  rb %7.1f ns  bt %7.1f ns\n", n,
+	    (double)t_rb / iterations, (double)t_bt / iterations);
+
+	/* first fit from the bottom of the map and from random hints */
+	for (int from_hint = 0; from_hint < 2; from_hint++) {
+		int searches = MAX(iterations / (from_hint ? 64 : 256), 16);
+
+		t = bench_now();
+		for (int i = 0; i < searches; i++) {
+			entry = find_space_list(&m, from_hint ? addrs[i] : 0, sizes[i], &addr);
+			bench_sink += (uintptr_t)entry + addr;
+		}
+		t_rb = bench_now() - t;
+		t = bench_now();
+		for (int i = 0; i < searches; i++) {
+			entry = find_space_bt(&m, from_hint ? addrs[i] : 0, sizes[i], &addr);
+			bench_sink += (uintptr_t)entry + addr;
+		}
+		t_bt = bench_now() - t;
+		printf("%8d entries  %s holes %7.1f ns  bt %7.1f ns\n", n,
+		    from_hint ? "fit@hint " : "fit@min  ",
+		    (double)t_rb / searches, (double)t_bt / searches);
+	}
+	printf("%8d entries  %u B-tree nodes, height %u\n", n,
+	    m.bt.vbt_nodes, m.bt.vbt_height);
+
+	map_destroy(&m);
+	free(entries);
+	free(addrs);
+	free(sizes);
+}
+
+static void
+usage(const char *argv0)
+{
+	fprintf(stderr, "usage: %s [-n max_entries] [-i iterations] [-s seed] [-c]\n", argv0);
+	exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+	int max_entries = 262144, iterations = 1 << 20, ch;
+	bool check_only = false;
+
+	while ((ch = getopt(argc, argv, "n:i:s:c")) != -1) {
+		switch (ch) {
+		case 'n':
+			max_entries = atoi(optarg);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		case 's':
+			bench_seed = strtoull(optarg, NULL, 0) | 1;
+			break;
+		case 'c':
+			check_only = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (max_entries <= 0 || iterations <= 0) {
+		usage(argv[0]);
+	}
+
+	vm_map_bt_startup(false);
+
+	conformance(100000);
+	if (check_failures) {
+		fprintf(stderr, "%d conformance failures\n", check_failures);
+		return 1;
+	}
+	printf("conformance: ok\n");
+	if (check_only) {
+		return 0;
+	}
+
+	for (int n = 1024; n <= max_entries; n *= 4) {
+		bench_size(n, iterations);
+	}
+	return 0;
+}
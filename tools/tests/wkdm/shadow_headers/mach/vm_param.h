@@ -0,0 +1,9 @@
+/*
+ * Stand-in for osfmk/mach/vm_param.h so that osfmk/vm/WKdm_new.h can be
+ * included from userspace: only WKdm_SCRATCH_BUF_SIZE_INTERNAL needs it.
+ */
+#pragma once
+
+#ifndef PAGE_SIZE
+#define PAGE_SIZE 4096
+#endif
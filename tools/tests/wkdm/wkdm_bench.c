@@ -0,0 +1,413 @@
+/*
+ * Copyright (c) 2024 Apple Inc. All rights reserved.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_START@
+ *
+ * This file contains Original Code and/or Modifications of Original Code
+ * as defined in and that are subject to the Apple Public Source License
+ * Version 2.0 (the 'License'). You may not use this file except in
+ * compliance with the License. The rights granted to you under the License
+ * may not be used to create, or enable the creation or redistribution of,
+ * unlawful or unlicensed copies of an Apple operating system, or to
+ * circumvent, violate, or enable the circumvention or violation of, any
+ * terms of an Apple operating system software license agreement.
+ *
+ * Please obtain a copy of the License at
+ * http://www.opensource.apple.com/apsl/ and read it before using this file.
+ *
+ * The Original Code and all software distributed under the License are
+ * distributed on an 'AS IS' basis, WITHOUT WARRANTY OF ANY KIND, EITHER
+ * EXPRESS OR IMPLIED, AND APPLE HEREBY DISCLAIMS ALL SUCH WARRANTIES,
+ * INCLUDING WITHOUT LIMITATION, ANY WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE, QUIET ENJOYMENT OR NON-INFRINGEMENT.
+ * Please see the License for the specific language governing rights and
+ * limitations under the License.
+ *
+ * @APPLE_OSREFERENCE_LICENSE_HEADER_END@
+ */
+
+/*
+ * Conformance and throughput harness for osfmk/vm/WKdm_simd.c.
+ *
+ * Every page of the corpus is compressed at several byte budgets with both
+ * the C implementation and the native assembly encoder (when the harness
+ * was built with one, see Makefile), and the results must be identical:
+ * same return value and, when the page compressed, the same bytes.  Each
+ * compressed page is then decoded by both decompressors and compared
+ * against the original.  Finally both implementations are timed over the
+ * whole corpus.
+ *
+ * usage: wkdm_bench [-p page_size] [-i iterations] [corpus ...]
+ *
+ * A corpus is a flat file of pages, e.g. a core or memory dump.  Without
+ * one, a synthetic corpus mixing the usual page shapes is generated.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "WKdm_new.h"
+
+#define SYNTHETIC_PAGES         8192
+#define DEFAULT_ITERATIONS      20
+
+/*
+ * The assembly encoders are referenced by their Mach-O names, which the
+ * Makefile also keeps when assembling them into ELF objects.
+ */
+#if WKDM_BENCH_ASM_X86_64
+int asm_compress_4k(const WK_word *, WK_word *, WK_word *, unsigned int)
+__asm__("_WKdm_compress_new");
+void asm_decompress_4k(const WK_word *, WK_word *, WK_word *, unsigned int)
+__asm__("_WKdm_decompress_new");
+#define HAVE_ASM_4K  1
+#define HAVE_ASM_16K 0
+#elif WKDM_BENCH_ASM_ARM64
+int asm_compress_4k(const WK_word *, WK_word *, WK_word *, unsigned int)
+__asm__("_WKdm_compress_4k");
+void asm_decompress_4k(const WK_word *, WK_word *, WK_word *, unsigned int)
+__asm__("_WKdm_decompress_4k");
+int asm_compress_16k(const WK_word *, WK_word *, WK_word *, unsigned int)
+__asm__("_WKdm_compress_16k");
+void asm_decompress_16k(const WK_word *, WK_word *, WK_word *, unsigned int)
+__asm__("_WKdm_decompress_16k");
+#define HAVE_ASM_4K  1
+#define HAVE_ASM_16K 1
+#else
+#define HAVE_ASM_4K  0
+#define HAVE_ASM_16K 0
+#endif
+
+typedef int (*compress_fn_t)(const WK_word *, WK_word *, WK_word *, unsigned int);
+typedef void (*decompress_fn_t)(const WK_word *, WK_word *, WK_word *, unsigned int);
+
+static size_t page_size = 4096;
+
+static int
+simd_compress(const WK_word *src, WK_word *dst, WK_word *scratch, unsigned int limit)
+{
+	return WKdm_compress_simd(src, dst, scratch, limit, (unsigned int)(page_size / sizeof(WK_word)));
+}
+
+static void
+simd_decompress(const WK_word *src, WK_word *dst, WK_word *scratch, unsigned int bytes)
+{
+	WKdm_decompress_simd(src, dst, scratch, bytes, (unsigned int)(page_size / sizeof(WK_word)));
+}
+
+static compress_fn_t asm_compress;
+static decompress_fn_t asm_decompress;
+
+static void *
+xaligned_alloc(size_t size)
+{
+	void *p = NULL;
+
+	if (posix_memalign(&p, 4096, size) != 0) {
+		fprintf(stderr, "out of memory\n");
+		exit(1);
+	}
+	memset(p, 0, size);
+	return p;
+}
+
+static uint32_t
+xorshift32(uint32_t *state)
+{
+	uint32_t x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static void
+fill_synthetic_page(uint8_t *page, uint32_t kind, uint32_t *rng)
+{
+	uint32_t *w = (uint32_t *)(void *)page;
+	size_t nwords = page_size / sizeof(uint32_t);
+
+	switch (kind % 8) {
+	case 0: /* zero */
+		break;
+	case 1: /* single value */
+		for (size_t i = 0; i < nwords; i++) {
+			w[i] = 0xfeedface;
+		}
+		break;
+	case 2: /* single small value, first word is a partial match */
+		for (size_t i = 0; i < nwords; i++) {
+			w[i] = 0x2a;
+		}
+		break;
+	case 3: /* mostly zero */
+		for (size_t i = 0; i < nwords; i += 97) {
+			w[i] = xorshift32(rng);
+		}
+		break;
+	case 4: /* pointers and small integers */
+		for (size_t i = 0; i < nwords; i++) {
+			w[i] = (i & 1) ? 0x10a4c000u + (xorshift32(rng) & 0xfff) : xorshift32(rng) & 0x3f;
+		}
+		break;
+	case 5: /* random */
+		for (size_t i = 0; i < nwords; i++) {
+			w[i] = xorshift32(rng);
+		}
+		break;
+	case 6: /* compressible prefix, random tail: exercises budgets */
+		for (size_t i = 0; i < nwords; i++) {
+			w[i] = (i < nwords / 2) ? (uint32_t)i * 8 : xorshift32(rng);
+		}
+		break;
+	default: /* random start: exercises the early abort */
+		for (size_t i = 0; i < nwords; i++) {
+			w[i] = (i < nwords / 8) ? xorshift32(rng) : 0;
+		}
+		break;
+	}
+}
+
+static uint8_t *
+load_corpus(int nfiles, char **files, size_t *npages)
+{
+	uint8_t *corpus = NULL;
+	size_t count = 0;
+
+	if (nfiles == 0) {
+		uint32_t rng = 0x12345678;
+
+		count = SYNTHETIC_PAGES;
+		corpus = xaligned_alloc(count * page_size);
+		for (size_t i = 0; i < count; i++) {
+			fill_synthetic_page(corpus + i * page_size, (uint32_t)i, &rng);
+		}
+		printf("corpus: %zu synthetic pages\n", count);
+		*npages = count;
+		return corpus;
+	}
+
+	for (int f = 0; f < nfiles; f++) {
+		FILE *fp = fopen(files[f], "r");
+		long size;
+
+		if (fp == NULL) {
+			fprintf(stderr, "%s: %s\n", files[f], strerror(errno));
+			exit(1);
+		}
+		fseek(fp, 0, SEEK_END);
+		size = ftell(fp);
+		fseek(fp, 0, SEEK_SET);
+
+		size_t pages = (size_t)size / page_size;
+		uint8_t *grown = xaligned_alloc((count + pages) * page_size);
+
+		if (corpus) {
+			memcpy(grown, corpus, count * page_size);
+			free(corpus);
+		}
+		corpus = grown;
+		if (fread(corpus + count * page_size, page_size, pages, fp) != pages) {
+			fprintf(stderr, "%s: short read\n", files[f]);
+			exit(1);
+		}
+		fclose(fp);
+		count += pages;
+		printf("corpus: %zu pages from %s\n", pages, files[f]);
+	}
+	*npages = count;
+	return corpus;
+}
+
+static bool
+page_is_uniform(const uint8_t *page)
+{
+	const uint32_t *w = (const uint32_t *)(const void *)page;
+
+	for (size_t i = 1; i < page_size / sizeof(uint32_t); i++) {
+		if (w[i] != w[0]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static uint64_t
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Returns the number of mismatches found on this page.
+ */
+static int
+check_page(const uint8_t *page, size_t index, unsigned int limit,
+    WK_word *cbuf, WK_word *abuf, WK_word *scratch, uint8_t *out)
+{
+	const WK_word *src = (const WK_word *)(const void *)page;
+	size_t bufsize = 2 * page_size;
+	int csize, asize;
+	int errors = 0;
+
+	memset(cbuf, 0xa5, bufsize);
+	csize = simd_compress(src, cbuf, scratch, limit);
+
+	if (asm_compress) {
+		memset(abuf, 0xa5, bufsize);
+		asize = asm_compress(src, abuf, scratch, limit);
+
+		if (asize != csize) {
+			printf("page %zu budget %u: C returned %d, asm returned %d\n",
+			    index, limit, csize, asize);
+			return 1;
+		}
+		if (csize > 0 && memcmp(cbuf, abuf, (size_t)csize) != 0) {
+			printf("page %zu budget %u: compressed streams differ\n", index, limit);
+			errors++;
+		}
+	}
+
+	if (csize == 0 && !page_is_uniform(page)) {
+		printf("page %zu budget %u: non uniform page reported as single value\n", index, limit);
+		errors++;
+	}
+	if (csize > (int)limit) {
+		printf("page %zu budget %u: C output %d exceeds budget\n", index, limit, csize);
+		errors++;
+	}
+	if (csize <= 0) {
+		return errors;
+	}
+
+	memset(out, 0, page_size);
+	simd_decompress(cbuf, (WK_word *)(void *)out, scratch, (unsigned int)csize);
+	if (memcmp(out, page, page_size) != 0) {
+		printf("page %zu budget %u: C decompressor round trip failed\n", index, limit);
+		errors++;
+	}
+	if (asm_decompress) {
+		memset(out, 0, page_size);
+		asm_decompress(cbuf, (WK_word *)(void *)out, scratch, (unsigned int)csize);
+		if (memcmp(out, page, page_size) != 0) {
+			printf("page %zu budget %u: asm decompressor failed on C output\n", index, limit);
+			errors++;
+		}
+	}
+	return errors;
+}
+
+static void
+bench(const char *name, compress_fn_t compress, decompress_fn_t decompress,
+    const uint8_t *corpus, size_t npages, int iterations,
+    WK_word *cbuf, WK_word *scratch, uint8_t *out)
+{
+	unsigned int limit = (unsigned int)page_size - 4;
+	uint64_t ctime = 0, dtime = 0, cbytes = 0, dbytes = 0, csum = 0;
+
+	for (int it = 0; it < iterations; it++) {
+		for (size_t i = 0; i < npages; i++) {
+			const WK_word *src = (const WK_word *)(const void *)(corpus + i * page_size);
+			uint64_t t0, t1, t2;
+			int csize;
+
+			t0 = now_ns();
+			csize = compress(src, cbuf, scratch, limit);
+			t1 = now_ns();
+			ctime += t1 - t0;
+			cbytes += page_size;
+
+			if (csize <= 0) {
+				csum += csize == 0 ? 4 : page_size;
+				continue;
+			}
+			csum += (uint64_t)csize;
+			decompress(cbuf, (WK_word *)(void *)out, scratch, (unsigned int)csize);
+			t2 = now_ns();
+			dtime += t2 - t1;
+			dbytes += page_size;
+		}
+	}
+
+	printf("%-5s compress %6.2f GB/s, decompress %6.2f GB/s, ratio %.2f\n", name,
+	    ctime ? (double)cbytes / (double)ctime : 0.0,
+	    dtime ? (double)dbytes / (double)dtime : 0.0,
+	    csum ? (double)cbytes / (double)csum : 0.0);
+}
+
+int
+main(int argc, char **argv)
+{
+	static const unsigned int budget_fracs[] = { 1, 2, 4, 8, 12 };
+	int iterations = DEFAULT_ITERATIONS;
+	size_t npages;
+	int ch, errors = 0;
+
+	while ((ch = getopt(argc, argv, "p:i:")) != -1) {
+		switch (ch) {
+		case 'p':
+			page_size = strtoul(optarg, NULL, 0);
+			break;
+		case 'i':
+			iterations = atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "usage: %s [-p page_size] [-i iterations] [corpus ...]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (page_size != 4096 && page_size != 16384) {
+		fprintf(stderr, "page size must be 4096 or 16384\n");
+		return 2;
+	}
+
+#if HAVE_ASM_4K
+	if (page_size == 4096) {
+		asm_compress = asm_compress_4k;
+		asm_decompress = asm_decompress_4k;
+	}
+#endif
+#if HAVE_ASM_16K
+	if (page_size == 16384) {
+		asm_compress = asm_compress_16k;
+		asm_decompress = asm_decompress_16k;
+	}
+#endif
+	if (asm_compress == NULL) {
+		printf("no assembly encoder for %zu byte pages on this host, "
+		    "only checking C round trips\n", page_size);
+	}
+
+	uint8_t *corpus = load_corpus(argc - optind, argv + optind, &npages);
+	/* the assembly encoders may write a little past their budget */
+	WK_word *cbuf = xaligned_alloc(2 * page_size);
+	WK_word *abuf = xaligned_alloc(2 * page_size);
+	WK_word *scratch = xaligned_alloc(page_size);
+	uint8_t *out = xaligned_alloc(page_size);
+
+	for (size_t i = 0; i < npages; i++) {
+		for (size_t b = 0; b < sizeof(budget_fracs) / sizeof(budget_fracs[0]); b++) {
+			unsigned int limit = (unsigned int)(page_size - 4) / budget_fracs[b];
+
+			errors += check_page(corpus + i * page_size, i, limit, cbuf, abuf, scratch, out);
+		}
+	}
+	printf("conformance: %zu pages, %d mismatches\n", npages, errors);
+
+	bench("C", simd_compress, simd_decompress, corpus, npages, iterations, cbuf, scratch, out);
+	if (asm_compress) {
+		bench("asm", asm_compress, asm_decompress, corpus, npages, iterations, cbuf, scratch, out);
+	}
+
+	return errors ? 1 : 0;
+}